@@ -39,6 +39,47 @@ ObjectMember MyClass::sMembers[] = {
 	Object_Method(err, Invoke, 2, 0,0),
 	Object_Method(__New, __New, 0, 0,1),
 };
+#undef CLASSNAME
+
+// The same members with typed parameters: each argument is converted by its C++ type, and the
+// parameter counts come from the signature.
+class MyTypedClass : public Object {
+	TCHAR buf[200] = { 0 };
+public:
+#define CLASSNAME "MyTypedClass"
+	IObject_Type_Impl;
+	static ObjectMember sMembers[];
+	void __New(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount);
+	void Value(ResultToken& aResultToken);
+	__int64 Int() { return 666; }
+	void Err(ResultToken& aResultToken);
+	double Scale(double aValue, Optional<double> aFactor) { return aValue * aFactor.value_or(2.0); }
+};
+
+void MyTypedClass::__New(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+	int i = 0;
+	for (auto c : _T("this a string stored in the typed class"))
+		buf[i++] = c;
+}
+void MyTypedClass::Value(ResultToken& aResultToken) {
+	aResultToken.symbol = SYM_STRING;
+	aResultToken.marker = buf;
+	aResultToken.marker_length = -1;
+}
+void MyTypedClass::Err(ResultToken& aResultToken) {
+	Object a;
+	a.Error(_T("an error from dll"));
+	aResultToken.result = FAIL;
+}
+
+ObjectMember MyTypedClass::sMembers[] = {
+	Object_TypedMethod(value, MyTypedClass, Value),
+	Object_TypedMethod(int, MyTypedClass, Int),
+	Object_TypedMethod(err, MyTypedClass, Err),
+	Object_TypedMethod(scale, MyTypedClass, Scale),
+	Object_Method(__New, __New, 0, 0,1),
+};
+#undef CLASSNAME
 
 class MAP : Map {
 public:
@@ -87,6 +128,7 @@ BIF_DECL(MyFunc) {
 }
 ExportSymbol symbols[] = {
 	EXPORT_CLASS(MyClass,2)
+	EXPORT_CLASS(MyTypedClass,2)
 	EXPORT_FUNC(MyFunc, 0, 1)
 	ExportSymbol(_T("Map"), nullptr, 1, MAP::sMembers)
 };
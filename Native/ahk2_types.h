@@ -2,6 +2,12 @@
 #define AHK2_TYPES_H
 #include <OAIdl.h>
 #include <tchar.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#ifdef AHK2_PROFILE
+#include <intrin.h>
+#endif
 
 // Flags used when calling Invoke; also used by g_ObjGet etc.:
 #define IT_GET				0
@@ -68,6 +74,7 @@ const IID IID_IObjectComCompatible = { 0x619f7e25, 0x6d89, 0x4eb4, 0xb2, 0xfb, 0
 struct ExprTokenType;
 struct ResultToken;
 class Object;
+class FieldIndex;
 
 #ifdef CONFIG_DEBUGGER
 struct IObject;
@@ -90,8 +97,13 @@ struct DECLSPEC_NOVTABLE IDebugProperties
 struct DECLSPEC_NOVTABLE IObject // L31: Abstract interface for "objects".
 	: public IDispatch
 {
+#ifdef _MSC_VER
 #define IObject_Invoke_PARAMS_DECL \
 		ResultToken &aResultToken, int aFlags, LPTSTR aName, ExprTokenType &aThisToken, ExprTokenType *aParam[], int aParamCount
+#else // Other compilers bind temporaries such as ExprTokenType(this) only to const references.
+#define IObject_Invoke_PARAMS_DECL \
+		ResultToken &aResultToken, int aFlags, LPTSTR aName, const ExprTokenType &aThisToken, ExprTokenType *aParam[], int aParamCount
+#endif
 #define IObject_Invoke_PARAMS \
 		aResultToken, aFlags, aName, aThisToken, aParam, aParamCount
 	virtual ResultType Invoke(IObject_Invoke_PARAMS_DECL) = 0;
@@ -258,11 +270,11 @@ struct ExprTokenType  // Something in the compiler hates the name TokenType, so
 		};
 	};
 	SymbolType symbol;
-	ExprTokenType() : value_int64(0)
+	ExprTokenType() : value_int64(0) {
 #ifdef _WIN64
-		, marker_length(0)
+		marker_length = 0; // Not in the initializer list, since it shares the outer union with value_int64.
 #endif // _WIN64
-	{}
+	}
 	ExprTokenType(LPTSTR str) { SetValue(str); }
 	ExprTokenType(IObject* obj) { SetValue(obj); }
 	void SetValue(LPTSTR str, size_t len = -1) {
@@ -342,67 +354,312 @@ struct ResultToken : public ExprTokenType
 	ResultType result;
 };
 
+//
+// TString - growable string builder.
+//
+// Short strings live in an inline buffer; longer ones grow geometrically on the heap.
+// move_to() hands the result to a ResultToken without copying whenever the text is on
+// the heap, so a module can build its return value in place.
+//
+
 struct TString
 {
 private:
-	TCHAR* s = NULL;
+	enum { INLINE_SIZE = 64 };
+	TCHAR* s;
 	size_t len = 0;
-	size_t capacity = 0;
+	size_t capacity = INLINE_SIZE;
+	TCHAR inline_buf[INLINE_SIZE];
+	bool is_inline() { return s == inline_buf; }
 	bool Realloc(size_t aNewSize) {
-		TCHAR* newp = (TCHAR*)realloc(s, sizeof(TCHAR) * aNewSize);
-		if (!newp)
+		TCHAR* newp;
+		if (is_inline()) {
+			if (!(newp = (TCHAR*)malloc(sizeof(TCHAR) * aNewSize)))
+				return false;
+			memcpy(newp, inline_buf, sizeof(TCHAR) * len);
+		}
+		else if (!(newp = (TCHAR*)realloc(s, sizeof(TCHAR) * aNewSize)))
 			return false;
 		s = newp;
 		capacity = aNewSize;
 		return true;
 	}
 	inline bool EnsureCapacity(size_t aLength) {
-		return capacity > aLength ? OK : Realloc(aLength < (capacity << 1) ? capacity << 1 : aLength);
-		if (capacity >= aLength)
-			return OK;
-		size_t newsize = capacity ? capacity : aLength;
-		while (newsize < aLength)
-			newsize *= 2;
-		return Realloc(newsize);
+		return capacity >= aLength || Realloc(aLength < (capacity << 1) ? capacity << 1 : aLength);
 	}
 public:
-	TString() {}
-	~TString() { if (s) free(s); }
+	TString() : s(inline_buf) {}
+	TString(const TString&) = delete;
+	TString& operator=(const TString&) = delete;
+	~TString() { if (!is_inline()) free(s); }
 	TCHAR* data() { s[len] = 0; return s; }
 	size_t size() { return len; }
-	TString& append(ResultToken& token) {
-		if (token.marker_length == -1)
-			token.marker_length = _tcsclen(token.marker);
-		if (!s && token.mem_to_free) {
-			s = token.marker;
-			capacity = len = token.marker_length;
-			token.mem_to_free = nullptr;
-		}
-		else
-			append(token.marker, token.marker_length);
-		return *this;
-	}
+	// Ensures room for aLength chars plus the terminator.
+	bool reserve(size_t aLength) { return EnsureCapacity(aLength + 1); }
+	void clear() { len = 0; }
+	TString& append(ResultToken& token);
+	TString& append(ExprTokenType& token);
 	TString& append(TCHAR ch) {
 		if (EnsureCapacity(len + 2))
 			s[len++] = ch;
 		return *this;
 	}
-	TString& operator+=(TCHAR* str) { return append(str, _tcslen(str)); }
-	TString& append(TCHAR* str, size_t len) {
-		if (EnsureCapacity(len + len + 1)) {
+	TString& operator+=(const TCHAR* str) { return append(str, _tcslen(str)); }
+	TString& append(const TCHAR* str, size_t aLength) {
+		if (EnsureCapacity(len + aLength + 1)) {
 #ifdef UNICODE
-			wmemcpy(s + len, str, len);
+			wmemcpy(s + len, str, aLength);
 #else
-			memcpy(s + len, str, len);
+			memcpy(s + len, str, aLength);
 #endif
-			len += len;
+			len += aLength;
 		}
 		return *this;
 	}
+	TString& append_int(__int64 aValue) {
+		TCHAR buf[MAX_INTEGER_SIZE], * end = buf + MAX_INTEGER_SIZE, * p = end;
+		unsigned __int64 n = aValue < 0 ? 0 - (unsigned __int64)aValue : (unsigned __int64)aValue;
+		do *--p = (TCHAR)('0' + n % 10); while (n /= 10);
+		if (aValue < 0)
+			*--p = '-';
+		return append(p, end - p);
+	}
+	// Formats the same as the host's default float format ("%.17g" with a guaranteed decimal point).
+	TString& append_float(double aValue) {
+		// Integral values within the exact range of a double need no printf (but -0.0 does).
+		__int64 bits;
+		memcpy(&bits, &aValue, sizeof(bits));
+		if (aValue > -9007199254740992.0 && aValue < 9007199254740992.0 && aValue == (double)(__int64)aValue
+			&& (aValue != 0 || bits == 0))
+			return append_int((__int64)aValue).append('.').append('0');
+		TCHAR buf[MAX_NUMBER_SIZE];
+		_stprintf_s(buf, _countof(buf), _T("%.17g"), aValue);
+		*this += buf;
+		for (TCHAR* cp = buf; *cp; ++cp)
+			if (*cp == '.' || *cp == 'e' || *cp == 'n' || *cp == 'N')
+				return *this;
+		return append('.').append('0');
+	}
 	TCHAR& back() { return s[len - 1]; }
-	void release() { s = NULL; len = capacity = 0; }
 	void pop_back() { if (len) len--; }
+	// Returns the heap buffer (allocating one if the text is inline) and resets the string.
+	TCHAR* detach() {
+		TCHAR* p = s;
+		if (is_inline()) {
+			if (!(p = (TCHAR*)malloc(sizeof(TCHAR) * (len + 1))))
+				return nullptr;
+			memcpy(p, inline_buf, sizeof(TCHAR) * len);
+		}
+		p[len] = 0;
+		release();
+		return p;
+	}
+	// Forgets the heap buffer without freeing it, after ownership was taken via data().
+	void release() { s = inline_buf; len = 0; capacity = INLINE_SIZE; }
+	// Stores the text as the result: short text is copied into aResultToken.buf, otherwise the heap buffer is adopted.
+	bool move_to(ResultToken& aResultToken) {
+		if (is_inline() && len < MAX_NUMBER_SIZE && aResultToken.buf) {
+			memcpy(aResultToken.buf, inline_buf, sizeof(TCHAR) * len);
+			aResultToken.buf[len] = 0;
+			aResultToken.SetValue(aResultToken.buf, len);
+			len = 0;
+			return true;
+		}
+		size_t length = len;
+		TCHAR* p = detach();
+		if (!p)
+			return false;
+		aResultToken.AcceptMem(p, length);
+		return true;
+	}
+};
+
+//
+// Arena - bump allocator for temporary data whose lifetime ends together, such as
+// parameter arrays and intermediate strings built while constructing a result.
+// Nothing is freed individually; Rewind() or ArenaScope releases everything allocated
+// after a mark, and the destructor releases the rest.
+//
+
+class Arena
+{
+	struct Block
+	{
+		Block* prev;
+		size_t size, used;
+		char* data() { return (char*)(this + 1); }
+	};
+	Block* mBlock = nullptr;
+	size_t mBlockSize;
+
+	void* AllocSlow(size_t aSize, size_t aAlign) {
+		size_t size = aSize + aAlign > mBlockSize ? aSize + aAlign : mBlockSize;
+		Block* block = (Block*)malloc(sizeof(Block) + size);
+		if (!block)
+			return nullptr;
+		block->prev = mBlock, block->size = size, block->used = 0;
+		mBlock = block;
+		return Alloc(aSize, aAlign);
+	}
+public:
+	struct Mark { Block* block; size_t used; };
+
+	Arena(size_t aBlockSize = 0x10000) : mBlockSize(aBlockSize) {}
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+	~Arena() { Rewind({ nullptr, 0 }); }
+
+	void* Alloc(size_t aSize, size_t aAlign = sizeof(void*)) {
+		if (mBlock) {
+			char* base = mBlock->data();
+			char* p = (char*)(((UINT_PTR)(base + mBlock->used) + aAlign - 1) & ~(UINT_PTR)(aAlign - 1));
+			if ((size_t)(p - base) + aSize <= mBlock->size) {
+				mBlock->used = p - base + aSize;
+				return p;
+			}
+		}
+		return AllocSlow(aSize, aAlign);
+	}
+	// Uninitialized storage for aCount items of a trivially destructible type.
+	template<typename T>
+	T* Alloc(size_t aCount) { return (T*)Alloc(sizeof(T) * aCount, alignof(T)); }
+
+	LPTSTR Strdup(LPCTSTR aStr, size_t aLength) {
+		LPTSTR p = Alloc<TCHAR>(aLength + 1);
+		if (p) {
+			memcpy(p, aStr, aLength * sizeof(TCHAR));
+			p[aLength] = 0;
+		}
+		return p;
+	}
+	// Allocates aCount tokens and the array of pointers to them, as expected by Invoke.
+	// The tokens are uninitialized; the caller sets each one with SetValue.
+	ExprTokenType** NewParams(size_t aCount) {
+		auto params = Alloc<ExprTokenType*>(aCount);
+		auto tokens = Alloc<ExprTokenType>(aCount);
+		if (!params || !tokens)
+			return nullptr;
+		for (size_t i = 0; i < aCount; ++i)
+			params[i] = tokens + i;
+		return params;
+	}
+
+	Mark GetMark() { return { mBlock, mBlock ? mBlock->used : 0 }; }
+	void Rewind(Mark aMark) {
+		while (mBlock != aMark.block) {
+			Block* prev = mBlock->prev;
+			free(mBlock);
+			mBlock = prev;
+		}
+		if (mBlock)
+			mBlock->used = aMark.used;
+	}
+};
+
+class ArenaScope
+{
+	Arena& mArena;
+	Arena::Mark mMark;
+public:
+	ArenaScope(Arena& aArena) : mArena(aArena), mMark(aArena.GetMark()) {}
+	~ArenaScope() { mArena.Rewind(mMark); }
+};
+
+//
+// ObjectPool - size-segregated slabs for the fixed-size headers of objects created by a
+// module.  ObjectBase routes operator new/delete here, so every class instantiated by
+// NewObject<T> (or 'new' elsewhere in the module) is pooled without further changes.
+// Each chunk is one VirtualAlloc region, which is aligned to the allocation granularity
+// (64 KB), so a freed pointer finds its chunk by masking; _aligned_malloc would waste up to
+// a chunk's size for every chunk.  Pages of a chunk are not touched until objects are
+// carved from them.  A chunk whose objects have all been freed goes back to the system,
+// unless it is the only chunk of its class with free space.  Objects may be released on worker threads
+// (e.g. by a WorkPool job), so the lists are guarded by a lock; it is uncontended when
+// only the script's thread allocates.
+//
+
+class ObjectPool
+{
+	enum { GRANULE = 16, MAX_SIZE = 512, CLASS_COUNT = MAX_SIZE / GRANULE, CHUNK_SIZE = 0x10000 };
+	struct Node { Node* next; };
+	struct alignas(GRANULE) Chunk
+	{
+		Chunk* prev, * next;	// Chunks of this class with free items.
+		Node* free;
+		UINT used, carved;		// Items in use; items ever handed out (the rest are untouched).
+		UINT cls, capacity;
+	};
+	static Chunk* sAvail[CLASS_COUNT];
+	static SRWLOCK sLock;
+
+	static void Link(Chunk* aChunk) {
+		Chunk*& head = sAvail[aChunk->cls];
+		aChunk->prev = nullptr, aChunk->next = head;
+		if (head)
+			head->prev = aChunk;
+		head = aChunk;
+	}
+	static void Unlink(Chunk* aChunk) {
+		if (aChunk->prev)
+			aChunk->prev->next = aChunk->next;
+		else
+			sAvail[aChunk->cls] = aChunk->next;
+		if (aChunk->next)
+			aChunk->next->prev = aChunk->prev;
+	}
+	static Chunk* NewChunk(size_t aClass) {
+		auto chunk = (Chunk*)VirtualAlloc(nullptr, CHUNK_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		if (!chunk)
+			return nullptr;
+		chunk->free = nullptr;
+		chunk->used = chunk->carved = 0;
+		chunk->cls = (UINT)aClass;
+		chunk->capacity = (UINT)((CHUNK_SIZE - sizeof(Chunk)) / ((aClass + 1) * GRANULE));
+		Link(chunk);
+		return chunk;
+	}
+public:
+	static void* Alloc(size_t aSize) {
+		if (!aSize || aSize > MAX_SIZE)
+			return malloc(aSize);
+		size_t cls = (aSize - 1) / GRANULE;
+		void* item;
+		AcquireSRWLockExclusive(&sLock);
+		Chunk* chunk = sAvail[cls];
+		if (!chunk && !(chunk = NewChunk(cls)))
+			item = nullptr;
+		else {
+			if (Node* node = chunk->free)
+				chunk->free = node->next, item = node;
+			else
+				item = (char*)(chunk + 1) + chunk->carved++ * (cls + 1) * GRANULE;
+			if (++chunk->used == chunk->capacity)
+				Unlink(chunk);
+		}
+		ReleaseSRWLockExclusive(&sLock);
+		return item;
+	}
+	static void Free(void* aPtr, size_t aSize) {
+		if (!aPtr)
+			return;
+		if (!aSize || aSize > MAX_SIZE)
+			return free(aPtr);
+		auto chunk = (Chunk*)((UINT_PTR)aPtr & ~(UINT_PTR)(CHUNK_SIZE - 1));
+		Node* node = (Node*)aPtr;
+		AcquireSRWLockExclusive(&sLock);
+		node->next = chunk->free;
+		chunk->free = node;
+		if (chunk->used-- == chunk->capacity)
+			Link(chunk);
+		else if (!chunk->used && (chunk->prev || chunk->next)) {
+			Unlink(chunk);
+			VirtualFree(chunk, 0, MEM_RELEASE);
+		}
+		ReleaseSRWLockExclusive(&sLock);
+	}
 };
+ObjectPool::Chunk* ObjectPool::sAvail[ObjectPool::CLASS_COUNT] = {};
+SRWLOCK ObjectPool::sLock = SRWLOCK_INIT;
 
 enum AllocMethod { ALLOC_NONE, ALLOC_SIMPLE, ALLOC_MALLOC };
 enum VarTypes
@@ -500,6 +757,62 @@ public:
 		// Return target if it's an alias, or itself if not.
 		return mType == VAR_ALIAS ? mAliasFor->ResolveAlias() : this;
 	}
+
+	// The following assign a value to a resolved VAR_NORMAL variable, such as an output var
+	// or the target of a VarRef.  Numbers and objects leave the string buffer in place and
+	// mark it out of date; strings reuse the buffer if it was malloc'd and large enough.
+	void Assign(__int64 aValue)
+	{
+		ReleaseObject();
+		mContentsInt64 = aValue;
+		SetAttrib(VAR_ATTRIB_IS_INT64 | VAR_ATTRIB_CONTENTS_OUT_OF_DATE);
+	}
+	void Assign(double aValue)
+	{
+		ReleaseObject();
+		mContentsDouble = aValue;
+		SetAttrib(VAR_ATTRIB_IS_DOUBLE | VAR_ATTRIB_CONTENTS_OUT_OF_DATE);
+	}
+	void Assign(IObject* aValue)
+	{
+		aValue->AddRef();
+		ReleaseObject();
+		mObject = aValue;
+		SetAttrib(VAR_ATTRIB_IS_OBJECT);
+	}
+	bool Assign(LPCTSTR aValue, size_t aLength)
+	{
+		VarSizeType size = (VarSizeType)((aLength + 1) * sizeof(TCHAR));
+		if (mHowAllocated != ALLOC_MALLOC || mByteCapacity < size) {
+			char* mem = (char*)malloc(size);
+			if (!mem)
+				return false;
+			memcpy(mem, aValue, aLength * sizeof(TCHAR));
+			if (mHowAllocated == ALLOC_MALLOC)
+				free(mByteContents);
+			mByteContents = mem, mByteCapacity = size, mHowAllocated = ALLOC_MALLOC;
+		}
+		else memmove(mByteContents, aValue, aLength * sizeof(TCHAR));
+		ReleaseObject();
+		mCharContents[aLength] = 0;
+		mAttrib &= ~(VAR_ATTRIB_TYPES | VAR_ATTRIB_OFTEN_REMOVED);
+		mByteLength = (VarSizeType)(aLength * sizeof(TCHAR));
+		return true;
+	}
+
+private:
+	void ReleaseObject()
+	{
+		if (mAttrib & VAR_ATTRIB_IS_OBJECT)
+			mObject->Release();
+	}
+	void SetAttrib(VarAttribType aType)
+	{
+		mAttrib = (mAttrib & ~(VAR_ATTRIB_TYPES | VAR_ATTRIB_OFTEN_REMOVED)) | aType;
+		if (mByteCapacity)
+			*mCharContents = 0;
+		mByteLength = 0;
+	}
 }; // class Var
 #pragma pack(pop) // Calling pack with no arguments restores the default value (which is 8, but "the alignment of a member will be on a boundary that is either a multiple of n or a multiple of the size of the member, whichever is smaller.")
 #pragma warning(pop)
@@ -555,6 +868,9 @@ public:
 	}
 	ObjectBase() : mRefCount(1) {}
 	virtual ~ObjectBase() {}
+	// The deleting destructor passes the size of the most derived class, which selects the same pool.
+	static void* operator new(size_t aSize) noexcept { return ObjectPool::Alloc(aSize); }
+	static void operator delete(void* aPtr, size_t aSize) { ObjectPool::Free(aPtr, aSize); }
 	Object* Base() { return nullptr; }
 	LPTSTR Type() { return _T(""); }
 	bool IsOfType(Object* aPrototype) override { return Base() == aPrototype; }
@@ -583,6 +899,143 @@ ObjectVTABLE ObjectBase::ahkVT = {};
 
 class VarRef : public ObjectBase, public Var {};
 
+// Resolves a parameter which may be SYM_VAR into a value token.  Strings are not copied.
+static void TokenToValue(ExprTokenType& aToken, ExprTokenType& aValue) {
+	if (aToken.symbol != SYM_VAR) {
+		aValue = aToken;
+		return;
+	}
+	auto var = aToken.var->ResolveAlias();
+	if (var->mAttrib & VAR_ATTRIB_IS_OBJECT)
+		aValue.SetValue(var->mObject);
+	else if (var->mAttrib & VAR_ATTRIB_IS_INT64)
+		aValue.SetValue(var->mContentsInt64);
+	else if (var->mAttrib & VAR_ATTRIB_IS_DOUBLE)
+		aValue.SetValue(var->mContentsDouble);
+	else aValue.SetValue(var->mCharContents, var->mByteLength / sizeof(TCHAR));
+}
+
+static bool TokenToBool(ExprTokenType& aToken) {
+	ExprTokenType val;
+	TokenToValue(aToken, val);
+	switch (val.symbol)
+	{
+	case SYM_INTEGER: return val.value_int64 != 0;
+	case SYM_FLOAT: return val.value_double != 0.0;
+	case SYM_OBJECT: return true;
+	case SYM_STRING:
+		if (val.marker_length == -1)
+			val.marker_length = _tcslen(val.marker);
+		return val.marker_length && !(val.marker_length == 1 && *val.marker == '0');
+	default: return false;
+	}
+}
+
+// Resolves aToken to SYM_INTEGER or SYM_FLOAT, converting a numeric string as the script would:
+// optional spaces or tabs around a signed decimal integer, 0x hex integer or decimal float.
+static bool TokenToNumber(ExprTokenType& aToken, ExprTokenType& aNumber) {
+	TokenToValue(aToken, aNumber);
+	if (aNumber.symbol == SYM_INTEGER || aNumber.symbol == SYM_FLOAT)
+		return true;
+	if (aNumber.symbol != SYM_STRING)
+		return false;
+	LPCTSTR str = aNumber.marker, end = str + (aNumber.marker_length == -1 ? _tcslen(str) : aNumber.marker_length);
+	while (str < end && (*str == ' ' || *str == '\t'))
+		++str;
+	while (end > str && (end[-1] == ' ' || end[-1] == '\t'))
+		--end;
+	LPCTSTR digits = str + (str < end && (*str == '-' || *str == '+'));
+	if (digits == end || !((*digits >= '0' && *digits <= '9') || *digits == '.'))
+		return false;
+	LPTSTR stop;
+	bool hex = digits[0] == '0' && digits + 1 < end && (digits[1] == 'x' || digits[1] == 'X');
+	__int64 n = _tcstoi64(str, &stop, hex ? 16 : 10);
+	if (stop == end) {
+		aNumber.SetValue(n);
+		return true;
+	}
+	if (hex)
+		return false;
+	double d = _tcstod(str, &stop);
+	if (stop != end)
+		return false;
+	aNumber.SetValue(d);
+	return true;
+}
+
+// Compares an integer with a double exactly, without rounding the integer to a double, which
+// is inexact beyond 2^53.  NaN compares above every integer.
+static int CompareIntFloat(__int64 aInt, double aFloat) {
+	if (aFloat != aFloat)
+		return -1;
+	if (aFloat >= 9223372036854775808.0)
+		return -1;
+	if (aFloat < -9223372036854775808.0)
+		return 1;
+	__int64 whole = (__int64)aFloat; // Truncated, so exactly representable.
+	if (aInt != whole)
+		return aInt < whole ? -1 : 1;
+	double frac = aFloat - (double)whole;
+	return frac > 0 ? -1 : frac < 0;
+}
+
+// Resolves a 1-based index, or a negative one counting from the end, as Array does.
+static bool TokenToIndex(ExprTokenType& aToken, size_t aCount, size_t& aIndex) {
+	ExprTokenType val;
+	TokenToValue(aToken, val);
+	if (val.symbol != SYM_INTEGER)
+		return false;
+	__int64 i = val.value_int64;
+	if (i < 0)
+		i += (__int64)aCount + 1;
+	if (i < 1 || (unsigned __int64)i > aCount)
+		return false;
+	aIndex = (size_t)i - 1;
+	return true;
+}
+
+inline TString& TString::append(ExprTokenType& token) {
+	ExprTokenType val;
+	TokenToValue(token, val);
+	switch (val.symbol)
+	{
+	case SYM_STRING: return append(val.marker, val.marker_length == -1 ? _tcslen(val.marker) : val.marker_length);
+	case SYM_INTEGER: return append_int(val.value_int64);
+	case SYM_FLOAT: return append_float(val.value_double);
+	default: return *this;
+	}
+}
+
+// Takes over the token's allocated memory if nothing was appended yet.
+inline TString& TString::append(ResultToken& token) {
+	if (token.symbol != SYM_STRING)
+		return append(static_cast<ExprTokenType&>(token));
+	if (token.marker_length == -1)
+		token.marker_length = _tcslen(token.marker);
+	if (!len && token.mem_to_free && token.marker == token.mem_to_free) {
+		if (!is_inline())
+			free(s);
+		s = token.marker;
+		len = token.marker_length;
+		capacity = len + 1;
+		token.mem_to_free = nullptr;
+		return *this;
+	}
+	return append(token.marker, token.marker_length);
+}
+
+// Returns the variable an output parameter refers to, either directly (SYM_VAR) or through a VarRef.
+static Var* TokenToOutputVar(ExprTokenType& aToken) {
+	Var* var;
+	if (aToken.symbol == SYM_VAR)
+		var = aToken.var;
+	else if (aToken.symbol == SYM_OBJECT && !_tcscmp(aToken.object->Type(), _T("VarRef")))
+		var = static_cast<VarRef*>(static_cast<ObjectBase*>(aToken.object));
+	else return nullptr;
+	var = var->ResolveAlias();
+	return var->mType == VAR_NORMAL ? var : nullptr;
+}
+
 class Object : public ObjectBase
 {
 protected:
@@ -633,8 +1086,15 @@ public:
 
 	Object* mBase = nullptr;
 	FlatVector<FieldType, index_t> mFields;
+	// Objects with a FieldIndex attached, which FindField() consults before searching mFields.
+	// This is module-side state, not part of the object layout.
+	static FieldIndex* sIndexes;
+	inline bool FindIndexed(name_t name, FieldType*& aField);
 	FieldType* FindField(name_t name, index_t* insert_pos = nullptr)
 	{
+		FieldType* indexed;
+		if (sIndexes && !insert_pos && FindIndexed(name, indexed))
+			return indexed;
 		index_t left = 0, mid, right = mFields.Length();
 		int first_char = *name;
 		if (first_char <= 'Z' && first_char >= 'A')
@@ -678,7 +1138,7 @@ public:
 			*insert_pos = left;
 		return nullptr;
 	}
-	void Error(ExprTokenType msg, LPTSTR extra = nullptr, LPTSTR type = nullptr) {
+	static void Error(ExprTokenType msg, LPTSTR extra = nullptr, LPTSTR type = nullptr) {
 		if (ahkProvider) {
 			int paramcount = type ? 3 : extra ? 2 : msg.symbol == SYM_MISSING ? 0 : 1;
 			ResultToken result;
@@ -738,11 +1198,148 @@ public:
 	{ _T(CLASSNAME"."#name".Get"), static_cast<ObjectMethod>(&impl), id, IT_GET, __VA_ARGS__ }
 #define Object_StaticSet(name, impl, id, ...) \
 	{ _T(CLASSNAME"."#name".Set"), static_cast<ObjectMethod>(&impl), id, IT_SET, __VA_ARGS__ }
-#define Object_Method(name, impl, id, ...) Object_StaticMethod(Prototype.##name, impl, id, __VA_ARGS__)
-#define Object_Get(name, impl, id, ...) Object_StaticGet(Prototype.##name, impl, id, __VA_ARGS__)
-#define Object_Set(name, impl, id, ...) Object_StaticSet(Prototype.##name, impl, id, __VA_ARGS__)
+#define Object_Method(name, impl, id, ...) Object_StaticMethod(Prototype.name, impl, id, __VA_ARGS__)
+#define Object_Get(name, impl, id, ...) Object_StaticGet(Prototype.name, impl, id, __VA_ARGS__)
+#define Object_Set(name, impl, id, ...) Object_StaticSet(Prototype.name, impl, id, __VA_ARGS__)
+// Batch form of a method, see InvokeBatch.  Takes one parameter: an Array of argument lists,
+// each of which must have minp to maxp arguments, as for the method itself.
+#define Object_BatchMethod(name, cls, impl, id, minp, maxp) \
+	{ _T(CLASSNAME".Prototype."#name), static_cast<ObjectMethod>(&BatchMethod<cls, &cls::impl, minp, maxp>::Call), id, IT_CALL, 1, 1 }
 };
 
+//
+// FieldIndex - caseless hash index over an object's own fields.
+//
+// FindField() costs O(log n) _tcsicmp calls per lookup (or a linear scan for
+// UnsortedFlag objects), which adds up for objects with thousands of fields.
+// While a FieldIndex is attached to an object, FindField() on that object
+// probes the index first.  The host changes mFields without telling us, so:
+//  - A hit is only returned after comparing the field's name, so it is exact
+//    even if fields were deleted and re-added in between.
+//  - A miss falls back to the binary search; if that finds the field, the
+//    index was stale.
+//  - Once stale (or when the field storage moved or resized), lookups use the
+//    binary search until enough of them have passed to pay for a rebuild, so
+//    interleaved adds and lookups do not rebuild on every lookup.
+// Attach and detach on the script's thread, like other object access.
+//
+
+class FieldIndex
+{
+	typedef Object::FieldType FieldType;
+	typedef Object::index_t index_t;
+	struct Slot
+	{
+		UINT hash;
+		index_t index; // Field index + 1, or 0 for an empty slot.
+	};
+	Object* mObject = nullptr;
+	FieldIndex* mNext = nullptr;
+	Slot* mSlots = nullptr;
+	UINT mMask = 0;
+	void* mFieldData = nullptr;
+	index_t mFieldCount = 0;
+	index_t mStaleLookups = 0;
+
+	static inline TCHAR Fold(TCHAR c) {
+		return (unsigned)c < 128 ? (c <= 'Z' && c >= 'A' ? c + 32 : c) : (TCHAR)_totlower(c);
+	}
+	static UINT Hash(LPCTSTR aName) {
+		UINT h = 2166136261u; // FNV-1a over the folded chars.
+		for (; *aName; ++aName)
+			h = (h ^ (UINT)(_TUCHAR)Fold(*aName)) * 16777619u;
+		return h;
+	}
+	bool IsCurrent() {
+		return mSlots && mObject->mFields.data == mFieldData && mObject->mFields.Length() == mFieldCount;
+	}
+	FieldType* Search(LPCTSTR aName) {
+		index_t insert_pos;
+		return mObject->FindField((LPTSTR)aName, &insert_pos); // Bypasses the index.
+	}
+
+public:
+	FieldIndex() {}
+	FieldIndex(Object* aObject) { Attach(aObject); }
+	~FieldIndex() { Detach(); free(mSlots); }
+	FieldIndex(const FieldIndex&) = delete;
+	FieldIndex& operator=(const FieldIndex&) = delete;
+
+	static FieldIndex* Of(Object* aObject) {
+		for (auto index = Object::sIndexes; index; index = index->mNext)
+			if (index->mObject == aObject)
+				return index;
+		return nullptr;
+	}
+
+	bool Attach(Object* aObject) {
+		Detach();
+		mObject = aObject;
+		mNext = Object::sIndexes;
+		Object::sIndexes = this;
+		return Rebuild();
+	}
+
+	void Detach() {
+		if (!mObject)
+			return;
+		for (auto link = &Object::sIndexes; *link; link = &(*link)->mNext)
+			if (*link == this) {
+				*link = mNext;
+				break;
+			}
+		mObject = nullptr, mNext = nullptr;
+	}
+
+	bool Rebuild() {
+		index_t count = mObject->mFields.Length();
+		UINT capacity = 16;
+		while (capacity < count * 2)
+			capacity <<= 1;
+		if (capacity - 1 != mMask || !mSlots) {
+			Slot* slots = (Slot*)realloc(mSlots, capacity * sizeof(Slot));
+			if (!slots)
+				return false;
+			mSlots = slots, mMask = capacity - 1;
+		}
+		memset(mSlots, 0, capacity * sizeof(Slot));
+		FieldType* fields = mObject->mFields.Value();
+		for (index_t i = 0; i < count; ++i) {
+			UINT h = Hash(fields[i].name), pos = h & mMask;
+			while (mSlots[pos].index)
+				pos = (pos + 1) & mMask;
+			mSlots[pos].hash = h, mSlots[pos].index = i + 1;
+		}
+		mFieldData = mObject->mFields.data, mFieldCount = count, mStaleLookups = 0;
+		return true;
+	}
+
+	FieldType* Find(LPCTSTR aName) {
+		if (!IsCurrent() && (++mStaleLookups < (mObject->mFields.Length() >> 4) || !Rebuild()))
+			return Search(aName);
+		FieldType* fields = mObject->mFields.Value();
+		UINT h = Hash(aName), pos = h & mMask;
+		for (; mSlots[pos].index; pos = (pos + 1) & mMask) {
+			FieldType& field = fields[mSlots[pos].index - 1];
+			if (mSlots[pos].hash == h && !_tcsicmp(aName, field.name))
+				return &field;
+		}
+		FieldType* field = Search(aName);
+		if (field)
+			mFieldData = nullptr; // Stale; see above.
+		return field;
+	}
+};
+FieldIndex* Object::sIndexes = nullptr;
+
+inline bool Object::FindIndexed(name_t name, FieldType*& aField) {
+	auto index = FieldIndex::Of(this);
+	if (!index)
+		return false;
+	aField = index->Find(name);
+	return true;
+}
+
 //
 // Array
 //
@@ -769,6 +1366,7 @@ typedef __int64 IntKeyType;
 
 class Map : public Object
 {
+public:
 	union Key // Which of its members is used depends on the field's position in the mItem array.
 	{
 		LPTSTR s;
@@ -789,6 +1387,9 @@ class Map : public Object
 	Pair* mItem = nullptr;
 	index_t mCount = 0, mCapacity = 0;
 
+	// The CaseSense options, which decide how string keys are ordered and compared.
+	decltype(mFlags) CaseFlags() { return mFlags & (MapCaseless | MapUseLocale); }
+
 	// Holds the index of the first key of a given type within mItem.  Must be in the order: int, object, string.
 	// Compared to storing the key-type with each key-value pair, this approach saves 4 bytes per key (excluding
 	// the 8 bytes taken by the two fields below) and speeds up lookups since only the section within mItem
@@ -873,6 +1474,391 @@ public:
 	UCHAR mMID;
 	UCHAR mMIT;
 };
+//
+// StrRef - borrowed view of text owned by the script (a parameter, a variable or an object
+// field), taken without copying.  It is valid only while the owner is unchanged; for
+// parameters that means until the call returns.
+//
+
+struct StrRef
+{
+	LPTSTR str = nullptr;
+	size_t length = 0;
+	// Passes the text on as a parameter, still without copying.
+	void ToToken(ExprTokenType& aToken) { aToken.SetValue(str, length); }
+};
+
+// Fails if the value is not a string; numbers are not converted.
+static bool BorrowString(ExprTokenType& aToken, StrRef& aRef) {
+	ExprTokenType val;
+	TokenToValue(aToken, val);
+	if (val.symbol != SYM_STRING)
+		return false;
+	aRef.str = val.marker;
+	aRef.length = val.marker_length == -1 ? _tcslen(val.marker) : val.marker_length;
+	return true;
+}
+
+static bool BorrowString(Var& aVar, StrRef& aRef) {
+	Var* var = aVar.ResolveAlias();
+	if (var->mAttrib & (VAR_ATTRIB_TYPES | VAR_ATTRIB_UNINITIALIZED))
+		return false;
+	aRef.str = var->mCharContents;
+	aRef.length = var->mByteLength / sizeof(TCHAR);
+	return true;
+}
+
+// Works for Object fields, Array items (Object::Variant) and Map values.
+static bool BorrowString(Object::Variant& aValue, StrRef& aRef) {
+	if (aValue.symbol != SYM_STRING)
+		return false;
+	aRef.str = aValue.string.Value();
+	aRef.length = aValue.string.Length();
+	return true;
+}
+
+// Borrows the bytes of a Buffer, or of a String's UTF-16 text; fails for any other value.
+static bool BorrowBytes(ExprTokenType& aToken, const BYTE*& aData, size_t& aSize) {
+	ExprTokenType val;
+	TokenToValue(aToken, val);
+	if (val.symbol == SYM_OBJECT && !_tcscmp(val.object->Type(), _T("Buffer"))) {
+		auto buf = static_cast<BufferObject*>(val.object);
+		aData = (const BYTE*)buf->mData, aSize = buf->mSize;
+		return true;
+	}
+	if (val.symbol == SYM_STRING) {
+		aData = (const BYTE*)val.marker;
+		aSize = (val.marker_length == -1 ? _tcslen(val.marker) : val.marker_length) * sizeof(TCHAR);
+		return true;
+	}
+	return false;
+}
+
+// Parameters (data, size?): a Buffer or String, optionally limited to its first size bytes, or an
+// address and size.  Raises a TypeError or ValueError on failure.
+static bool ParamData(ExprTokenType* aParam[], int aParamCount, const BYTE*& aData, size_t& aSize, ResultToken& aResultToken) {
+	bool has_size = aParamCount > 1 && aParam[1]->symbol != SYM_MISSING;
+	if (BorrowBytes(*aParam[0], aData, aSize)) {
+		if (!has_size)
+			return true;
+	}
+	else {
+		ExprTokenType data;
+		TokenToValue(*aParam[0], data);
+		if (data.symbol != SYM_INTEGER || !has_size) {
+			Object::Error(ExprTokenType(_T("Expected a Buffer, String or address and size.")), nullptr, _T("TypeError"));
+			aResultToken.result = FAIL;
+			return false;
+		}
+		aData = (const BYTE*)(size_t)data.value_int64, aSize = (size_t)-1;
+	}
+	ExprTokenType size;
+	TokenToValue(*aParam[1], size);
+	if (size.symbol != SYM_INTEGER || size.value_int64 < 0 || (unsigned __int64)size.value_int64 > aSize) {
+		Object::Error(ExprTokenType(_T("Invalid size.")), nullptr, _T("ValueError"));
+		aResultToken.result = FAIL;
+		return false;
+	}
+	aSize = (size_t)size.value_int64;
+	return true;
+}
+
+//
+// SharedString - ref-counted text built by a module, for results which the module also
+// keeps (e.g. in a cache).  The host only adopts memory it will free itself, so Return()
+// hands the buffer over without copying when this is the last reference, and copies it
+// otherwise.  ReturnBorrowed() returns the text without ownership; the host copies it if
+// it needs to keep it, so the module must keep a reference until the call returns.
+// References are counted without locking, on the script's thread.
+//
+
+class SharedString
+{
+	struct Rep
+	{
+		ULONG refs;
+		size_t length;
+		LPTSTR text;
+	};
+	Rep* mRep = nullptr;
+
+	void Reset() {
+		if (mRep && !--mRep->refs) {
+			free(mRep->text);
+			ObjectPool::Free(mRep, sizeof(Rep));
+		}
+		mRep = nullptr;
+	}
+public:
+	SharedString() {}
+	SharedString(const SharedString& aOther) : mRep(aOther.mRep) { if (mRep) ++mRep->refs; }
+	SharedString& operator=(const SharedString& aOther) {
+		if (aOther.mRep)
+			++aOther.mRep->refs;
+		Reset();
+		mRep = aOther.mRep;
+		return *this;
+	}
+	~SharedString() { Reset(); }
+
+	// Takes ownership of malloc'd text, which must be null-terminated at aLength.
+	bool Adopt(LPTSTR aText, size_t aLength) {
+		Rep* rep = (Rep*)ObjectPool::Alloc(sizeof(Rep));
+		if (!rep)
+			return false;
+		Reset();
+		rep->refs = 1, rep->length = aLength, rep->text = aText;
+		mRep = rep;
+		return true;
+	}
+	bool Adopt(TString& aStr) {
+		size_t length = aStr.size();
+		LPTSTR text = aStr.detach();
+		if (text && Adopt(text, length))
+			return true;
+		free(text);
+		return false;
+	}
+
+	// The text is shared, so it is read-only; a module which needs to change it makes a copy.
+	LPCTSTR data() const { return mRep ? mRep->text : _T(""); }
+	size_t size() const { return mRep ? mRep->length : 0; }
+	bool unique() const { return mRep && mRep->refs == 1; }
+
+	// Gives the text to the result and releases this reference.
+	bool Return(ResultToken& aResultToken) {
+		if (!mRep) {
+			aResultToken.SetValue(_T(""), 0);
+			return true;
+		}
+		size_t length = mRep->length;
+		if (mRep->refs == 1) {
+			aResultToken.AcceptMem(mRep->text, length);
+			ObjectPool::Free(mRep, sizeof(Rep));
+			mRep = nullptr;
+			return true;
+		}
+		LPTSTR copy = (LPTSTR)malloc((length + 1) * sizeof(TCHAR));
+		if (!copy)
+			return false;
+		memcpy(copy, mRep->text, (length + 1) * sizeof(TCHAR));
+		Reset();
+		aResultToken.AcceptMem(copy, length);
+		return true;
+	}
+	// The host treats a result without mem_to_free as read-only, so the cast does not let it write.
+	void ReturnBorrowed(ResultToken& aResultToken) { aResultToken.SetValue((LPTSTR)data(), size()); }
+};
+
+// Returns the global class (Map, Array, etc.) from the ahk provider, the reference is held for the module lifetime.
+static IObject* GetGlobal(LPTSTR aName) {
+	TCHAR buf[MAX_NUMBER_SIZE];
+	ResultToken result;
+	result.InitResult(buf);
+	ObjectBase::ahkProvider->Invoke(result, IT_GET, aName, ExprTokenType(ObjectBase::ahkProvider), nullptr, 0);
+	if (result.symbol == SYM_OBJECT)
+		return result.object;
+	result.Free();
+	return nullptr;
+}
+
+static IObject* CallGlobal(IObject* aFunc, ExprTokenType* aParam[], int aParamCount) {
+	TCHAR buf[MAX_NUMBER_SIZE];
+	ResultToken result;
+	result.InitResult(buf);
+	aFunc->Invoke(result, IT_CALL, nullptr, ExprTokenType(aFunc), aParam, aParamCount);
+	if (result.symbol == SYM_OBJECT && !result.Exited())
+		return result.object;
+	result.Free();
+	return nullptr;
+}
+
+// Assigns a property of a script object, such as one created with CallGlobal(Object).
+static bool SetProperty(IObject* aObj, LPTSTR aName, ExprTokenType& aValue) {
+	TCHAR buf[MAX_NUMBER_SIZE];
+	ResultToken result;
+	ExprTokenType* param = &aValue;
+	result.InitResult(buf);
+	aObj->Invoke(result, IT_SET, aName, ExprTokenType(aObj), &param, 1);
+	result.Free();
+	return !result.Exited();
+}
+
+// Creates a Buffer of aSize bytes (uninitialized, as with Buffer(size)).
+static bool NewBuffer(size_t aSize, BufferObject*& aBuf) {
+	static IObject* sBuffer = GetGlobal(_T("Buffer"));
+	ExprTokenType size, * param = &size;
+	size.SetValue((__int64)aSize);
+	IObject* obj = sBuffer && aSize <= (size_t)LLONG_MAX ? CallGlobal(sBuffer, &param, 1) : nullptr;
+	aBuf = static_cast<BufferObject*>(obj);
+	return obj != nullptr;
+}
+
+// Copies an Object field or Array item into a token without copying string data.
+static void VariantToToken(Object::Variant& aValue, ExprTokenType& aToken) {
+	switch (aToken.symbol = aValue.symbol)
+	{
+	case SYM_STRING:
+		aToken.marker = aValue.string.Value();
+		aToken.marker_length = aValue.string.Length();
+		break;
+	case SYM_DYNAMIC:
+	case SYM_MISSING:
+		aToken.value_int64 = 0, aToken.symbol = SYM_MISSING;
+		break;
+	default:
+		aToken.value_int64 = aValue.n_int64; // Union copy.
+	}
+}
+
+//
+// Batched calls.  InvokeBatch calls a member implementation directly once per argument
+// list, which avoids the per-call Invoke dispatch and parameter marshalling of a script
+// loop.  aBatch must be an Array; each item which is an Array is unpacked as an argument
+// list, any other item is passed as the only argument.  The results are returned as a
+// new Array, in order.  Expose it with Object_BatchMethod:
+//   Object_BatchMethod(GetMany, HashMap, Get, 0, 1, 2)  ; map.GetMany([[k1], [k2, default]])
+// The method is called directly, so the parameter count of each list is checked here.
+//
+
+template<class T>
+static void InvokeBatch(T* aThis, void (T::* aMethod)(ResultToken&, int, int, ExprTokenType*[], int), int aID, int aFlags
+	, int aMinParams, int aMaxParams, ExprTokenType& aBatch, ResultToken& aResultToken)
+{
+	static IObject* sArray = GetGlobal(_T("Array"));
+	ExprTokenType val;
+	TokenToValue(aBatch, val);
+	if (val.symbol != SYM_OBJECT || _tcscmp(val.object->Type(), _T("Array"))) {
+		Object::Error(ExprTokenType(_T("Expected an Array of argument lists.")), nullptr, _T("TypeError"));
+		aResultToken.result = FAIL;
+		return;
+	}
+	auto batch = static_cast<Array*>(val.object);
+	Object::index_t count = batch->mLength, done = 0;
+	Arena results, scratch;
+	ExprTokenType** result_params = results.NewParams(count);
+	TCHAR buf[MAX_NUMBER_SIZE];
+	ResultToken r;
+	// Failures of the called method or of the Array constructor have already thrown.
+	LPTSTR error = nullptr, error_type = _T("MemoryError");
+	if (!sArray)
+		error = _T("The Array class is not available."), error_type = _T("Error");
+	else if (count > INT_MAX)
+		error = _T("Too many argument lists."), error_type = _T("ValueError");
+	else if (!result_params && count)
+		error = _T("Out of memory.");
+	bool ok = !error;
+	for (; ok && done < count; ++done) {
+		ArenaScope scope(scratch);
+		ExprTokenType arg, * single = &arg, ** params = &single;
+		int param_count = 1;
+		VariantToToken(batch->mItem[done], arg);
+		if (arg.symbol == SYM_OBJECT && !_tcscmp(arg.object->Type(), _T("Array"))) {
+			auto args = static_cast<Array*>(arg.object);
+			param_count = (int)args->mLength;
+			if (!(params = scratch.NewParams(param_count)) && param_count) {
+				error = _T("Out of memory.");
+				ok = false;
+				break;
+			}
+			for (int i = 0; i < param_count; ++i)
+				VariantToToken(args->mItem[i], *params[i]);
+		}
+		if (param_count < aMinParams || (param_count > aMaxParams && aMaxParams != MAXP_VARIADIC)) {
+			if (param_count < aMinParams)
+				error = _T("Too few parameters passed to function."), error_type = _T("Error");
+			else
+				error = _T("Too many parameters passed to function."), error_type = _T("Error");
+			ok = false;
+			break;
+		}
+		r.InitResult(buf);
+		(aThis->*aMethod)(r, aID, aFlags, params, param_count);
+		if (r.Exited()) {
+			r.Free();
+			ok = false;
+			break;
+		}
+		// Keep the value until the result Array is constructed; strings may live in buf.
+		ExprTokenType& dest = *result_params[done];
+		if (r.symbol == SYM_STRING) {
+			size_t length = r.marker_length == -1 ? _tcslen(r.marker) : r.marker_length;
+			LPTSTR str = results.Strdup(r.marker, length);
+			r.Free();
+			if (!str) {
+				error = _T("Out of memory.");
+				ok = false;
+				break;
+			}
+			dest.SetValue(str, length);
+		}
+		else dest = r; // Takes over the object reference, if any.
+	}
+	if (ok) {
+		if (IObject* arr = CallGlobal(sArray, result_params, (int)count))
+			aResultToken.SetValue(arr);
+		else ok = false;
+	}
+	for (Object::index_t i = 0; i < done; ++i)
+		if (result_params[i]->symbol == SYM_OBJECT)
+			result_params[i]->object->Release();
+	if (error)
+		Object::Error(ExprTokenType(error), nullptr, error_type);
+	if (!ok)
+		aResultToken.result = FAIL;
+}
+
+template<class T, void (T::* Method)(ResultToken&, int, int, ExprTokenType*[], int), int MinParams, int MaxParams>
+class BatchMethod : public T
+{
+public:
+	void Call(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		InvokeBatch<T>(this, Method, aID, aFlags, MinParams, MaxParams, *aParam[0], aResultToken);
+	}
+};
+
+//
+// Parallel execution on the system thread pool.  The calling thread takes part, so the
+// work completes even if no pool thread becomes available.
+//
+
+static int ThreadCount() {
+	static int sCount = [] {
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return (int)info.dwNumberOfProcessors;
+	}();
+	return sCount;
+}
+
+struct ParallelJob
+{
+	void (*call)(void* aContext, int aIndex);
+	void* context;
+	int count;
+	volatile LONG next;
+};
+
+static VOID CALLBACK ParallelWork(PTP_CALLBACK_INSTANCE, PVOID aJob, PTP_WORK) {
+	auto job = (ParallelJob*)aJob;
+	for (int i; (i = InterlockedIncrement(&job->next) - 1) < job->count; )
+		job->call(job->context, i);
+}
+
+template<typename F>
+static void RunParallel(int aCount, F& aFunc) {
+	ParallelJob job = { [](void* aContext, int aIndex) { (*(F*)aContext)(aIndex); }, &aFunc, aCount, 0 };
+	int threads = aCount < ThreadCount() ? aCount : ThreadCount();
+	PTP_WORK work = threads > 1 ? CreateThreadpoolWork(ParallelWork, &job, nullptr) : nullptr;
+	for (int i = 1; work && i < threads; ++i)
+		SubmitThreadpoolWork(work);
+	ParallelWork(nullptr, &job, nullptr);
+	if (work) {
+		WaitForThreadpoolWorkCallbacks(work, FALSE);
+		CloseThreadpoolWork(work);
+	}
+}
+
 // constexpr int size_BuiltInFunc = sizeof(BuiltInFunc);		//80	48
 // constexpr int size_BuiltInFunc = sizeof(BuiltInMethod);		//104	64
 // constexpr int size_ResultToken = sizeof(ResultToken);		//56	32
@@ -910,6 +1896,288 @@ struct ExportSymbol
 // name, min_params, max_params, id, outputvars
 #define EXPORT_FUNC(name, min_params, max_params, ...) {_T(#name), name, (UCHAR)min_params, (UCHAR)max_params, __VA_ARGS__},
 
+//
+// Typed members.  TypedMember adapts a method declared with ordinary C++ parameters to an
+// ObjectMethod.  The conversion of each argument is chosen at compile time by ArgTraits<T>,
+// and minParams/maxParams are derived from the signature, so the table entry cannot disagree
+// with the method.  An argument of the wrong type raises a TypeError naming the parameter.
+//   __int64 Add(__int64 a, Optional<double> b);
+//   Object_TypedMethod(Add, MyClass, Add),  // MyClass.Prototype.Add(a, b?)
+// Parameters: __int64, int, double, bool, StrRef, IObject* (borrowed), ExprTokenType* (any
+// value) and Optional<T>, which may only be followed by other Optionals.  Numeric parameters
+// also accept numeric strings, as TokenToNumber converts them.  A first parameter of
+// ResultToken& gives the method the result token, for returning strings or reporting errors.
+// Results: void, bool, integers, double or IObject* (a reference handed to the caller).
+//
+
+template<class T>
+struct Optional
+{
+	T value = T();
+	// Not a bool: the method's by-value copy must not read a byte store back as part of a wider load.
+	INT_PTR has_value = false;
+	explicit operator bool() const { return has_value; }
+	T value_or(T aDefault) const { return has_value ? value : aDefault; }
+};
+
+// Get() receives nullptr for a parameter which was not passed.
+template<class T> struct ArgTraits;
+template<> struct ArgTraits<__int64>
+{
+	enum { optional = false };
+	static LPTSTR Expected() { return _T("Expected an Integer."); }
+	static bool Get(ExprTokenType* aToken, __int64& aValue) {
+		ExprTokenType val;
+		if (!aToken || !TokenToNumber(*aToken, val))
+			return false;
+		aValue = val.value_int64;
+		return val.symbol == SYM_INTEGER;
+	}
+};
+template<> struct ArgTraits<int>
+{
+	enum { optional = false };
+	static LPTSTR Expected() { return _T("Expected an Integer."); }
+	static bool Get(ExprTokenType* aToken, int& aValue) {
+		__int64 value;
+		if (!ArgTraits<__int64>::Get(aToken, value) || value < INT_MIN || value > INT_MAX)
+			return false;
+		aValue = (int)value;
+		return true;
+	}
+};
+template<> struct ArgTraits<double>
+{
+	enum { optional = false };
+	static LPTSTR Expected() { return _T("Expected a Number."); }
+	static bool Get(ExprTokenType* aToken, double& aValue) {
+		ExprTokenType val;
+		if (!aToken || !TokenToNumber(*aToken, val))
+			return false;
+		aValue = val.symbol == SYM_INTEGER ? (double)val.value_int64 : val.value_double;
+		return true;
+	}
+};
+template<> struct ArgTraits<bool>
+{
+	enum { optional = false };
+	static LPTSTR Expected() { return _T("Expected a value."); }
+	static bool Get(ExprTokenType* aToken, bool& aValue) {
+		if (!aToken || aToken->symbol == SYM_MISSING)
+			return false;
+		aValue = TokenToBool(*aToken);
+		return true;
+	}
+};
+template<> struct ArgTraits<StrRef>
+{
+	enum { optional = false };
+	static LPTSTR Expected() { return _T("Expected a String."); }
+	static bool Get(ExprTokenType* aToken, StrRef& aValue) { return aToken && BorrowString(*aToken, aValue); }
+};
+template<> struct ArgTraits<IObject*>
+{
+	enum { optional = false };
+	static LPTSTR Expected() { return _T("Expected an Object."); }
+	static bool Get(ExprTokenType* aToken, IObject*& aValue) {
+		ExprTokenType val;
+		if (!aToken)
+			return false;
+		TokenToValue(*aToken, val);
+		aValue = val.object;
+		return val.symbol == SYM_OBJECT;
+	}
+};
+template<> struct ArgTraits<ExprTokenType*>
+{
+	enum { optional = false };
+	static LPTSTR Expected() { return _T("Expected a value."); }
+	static bool Get(ExprTokenType* aToken, ExprTokenType*& aValue) {
+		aValue = aToken;
+		return aToken && aToken->symbol != SYM_MISSING;
+	}
+};
+template<class T> struct ArgTraits<Optional<T>>
+{
+	enum { optional = true };
+	static LPTSTR Expected() { return ArgTraits<T>::Expected(); }
+	static bool Get(ExprTokenType* aToken, Optional<T>& aValue) {
+		if (!aToken || aToken->symbol == SYM_MISSING)
+			return true;
+		return (aValue.has_value = ArgTraits<T>::Get(aToken, aValue.value));
+	}
+};
+
+template<class... A> struct ArgCount
+{
+	enum { min = 0, max = 0 };
+};
+template<class A, class... R> struct ArgCount<A, R...>
+{
+	static_assert(!ArgTraits<A>::optional || !ArgCount<R...>::min, "Optional parameters must come last.");
+	enum { min = ArgTraits<A>::optional ? 0 : 1 + ArgCount<R...>::min, max = 1 + ArgCount<R...>::max };
+};
+
+template<class Sig> struct MethodTraits;
+template<class T, class R, class... A> struct MethodTraits<R(T::*)(A...)>
+{
+	typedef R Result;
+	typedef std::tuple<typename std::decay<A>::type...> Args;
+	typedef ArgCount<typename std::decay<A>::type...> Count;
+	template<class... V>
+	static R Call(T* aThis, R(T::* aMethod)(A...), ResultToken&, V&... aArgs) { return (aThis->*aMethod)(aArgs...); }
+};
+template<class T, class R, class... A> struct MethodTraits<R(T::*)(ResultToken&, A...)>
+{
+	typedef R Result;
+	typedef std::tuple<typename std::decay<A>::type...> Args;
+	typedef ArgCount<typename std::decay<A>::type...> Count;
+	template<class... V>
+	static R Call(T* aThis, R(T::* aMethod)(ResultToken&, A...), ResultToken& aResultToken, V&... aArgs) { return (aThis->*aMethod)(aResultToken, aArgs...); }
+};
+
+template<class R>
+static typename std::enable_if<std::is_integral<R>::value>::type TypedResult(ResultToken& aResultToken, R aValue) { aResultToken.SetValue((__int64)aValue); }
+static void TypedResult(ResultToken& aResultToken, double aValue) { aResultToken.SetValue(aValue); }
+static void TypedResult(ResultToken& aResultToken, IObject* aValue) { if (aValue) aResultToken.SetValue(aValue); }
+
+template<class T, class Sig, Sig Method>
+class TypedMember : public T
+{
+	typedef MethodTraits<Sig> Traits;
+	typedef typename Traits::Args Args;
+	typedef std::make_index_sequence<std::tuple_size<Args>::value> Indices;
+
+	// Returns the 1-based number of the first parameter which could not be converted, or 0.
+	template<size_t... I>
+	static int Unpack(Args& aArgs, ExprTokenType* aParam[], int aParamCount, std::index_sequence<I...>) {
+		int failed = 0;
+		int unused[] = { 0, (failed || ArgTraits<typename std::tuple_element<I, Args>::type>::Get(
+			(int)I < aParamCount ? aParam[I] : nullptr, std::get<I>(aArgs)) || (failed = (int)I + 1))... };
+		(void)unused;
+		return failed;
+	}
+	template<size_t... I>
+	static LPTSTR Expected(int aIndex, std::index_sequence<I...>) {
+		LPTSTR expected[] = { ArgTraits<typename std::tuple_element<I, Args>::type>::Expected()..., nullptr };
+		return expected[aIndex];
+	}
+	template<size_t... I>
+	typename Traits::Result Apply(ResultToken& aResultToken, Args& aArgs, std::index_sequence<I...>) {
+		return Traits::Call(static_cast<T*>(this), Method, aResultToken, std::get<I>(aArgs)...);
+	}
+	void Finish(ResultToken& aResultToken, Args& aArgs, std::true_type) { Apply(aResultToken, aArgs, Indices()); }
+	void Finish(ResultToken& aResultToken, Args& aArgs, std::false_type) {
+		auto value = Apply(aResultToken, aArgs, Indices());
+		if (!aResultToken.Exited())
+			TypedResult(aResultToken, value);
+	}
+public:
+	enum : UCHAR { MinParams = Traits::Count::min, MaxParams = Traits::Count::max };
+	void Call(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		Args args;
+		if (int failed = Unpack(args, aParam, aParamCount, Indices())) {
+			TCHAR extra[32];
+			_stprintf_s(extra, _countof(extra), _T("Parameter #%d"), failed);
+			Object::Error(ExprTokenType(Expected(failed - 1, Indices())), extra, _T("TypeError"));
+			aResultToken.result = FAIL;
+			return;
+		}
+		Finish(aResultToken, args, std::is_void<typename Traits::Result>());
+	}
+};
+
+#define TYPED_MEMBER(cls, impl) TypedMember<cls, decltype(&cls::impl), &cls::impl>
+#define TYPED_MEMBER_ENTRY(name, cls, impl, invoke_type) { name, static_cast<ObjectMethod>(&TYPED_MEMBER(cls, impl)::Call) \
+	, 0, invoke_type, TYPED_MEMBER(cls, impl)::MinParams, TYPED_MEMBER(cls, impl)::MaxParams }
+// Members of a script class (exported with EXPORT_CLASS).
+#define Object_TypedMethod(name, cls, impl) TYPED_MEMBER_ENTRY(_T(CLASSNAME".Prototype."#name), cls, impl, IT_CALL)
+#define Object_TypedGet(name, cls, impl) TYPED_MEMBER_ENTRY(_T(CLASSNAME".Prototype."#name".Get"), cls, impl, IT_GET)
+// Members of an ObjectBase class, dispatched by MemberHash.
+#define Member_TypedMethod(name, cls, impl) TYPED_MEMBER_ENTRY(_T(#name), cls, impl, IT_CALL)
+#define Member_TypedGet(name, cls, impl) TYPED_MEMBER_ENTRY(_T(#name), cls, impl, IT_GET)
+
+//
+// MemberHash - compile-time perfect hash over the member names of an ObjectBase class, for
+// an Invoke which would otherwise compare the name against each member in turn.  The
+// compiler searches for a seed which gives every name its own slot, so a lookup hashes the
+// name once and confirms it with a single comparison.  Invoke() also checks the invoke type
+// and parameter count before calling the member.  Names are compared caselessly as ASCII.
+// AsyncTask (async.h) is dispatched this way.
+//   constexpr ObjectMember sTaskMembers[] = { Member_TypedGet(Status, Task, GetStatus), ... };
+//   constexpr MemberHash<_countof(sTaskMembers)> sTaskLookup(sTaskMembers);
+//   ResultType Task::Invoke(IObject_Invoke_PARAMS_DECL) {
+//       return sTaskLookup.Invoke(this, aResultToken, aFlags, aName, aParam, aParamCount);
+//   }
+//
+
+static constexpr UINT MemberHashBits(UINT aSize) { return aSize > 1 ? 1 + MemberHashBits(aSize / 2) : 0; }
+
+template<UINT N>
+class MemberHash
+{
+	static_assert(N > 0 && N < 256, "MemberHash supports 1 to 255 members.");
+	// At least four slots per name, so a seed is found after few attempts.
+	enum : UINT { BITS = MemberHashBits(N * 4 - 1) + 1, SIZE = 1u << BITS };
+
+	ObjectMember mMembers[N];
+	UCHAR mSlots[SIZE]; // Member index + 1, or 0 for an empty slot.
+	UINT mSeed;
+	bool mValid;
+
+	static constexpr UINT NameHash(LPCTSTR aName) {
+		UINT h = 2166136261u;
+		for (; *aName; ++aName)
+			h = (h ^ (UINT)(*aName | 0x20)) * 16777619u;
+		return h;
+	}
+	constexpr UINT Slot(UINT aHash, UINT aSeed) const { return ((aHash ^ aSeed) * 0x9E3779B1u) >> (32 - BITS); }
+public:
+	constexpr MemberHash(const ObjectMember(&aMembers)[N]) : mMembers(), mSlots(), mSeed(0), mValid(false) {
+		UINT hashes[N] = {};
+		for (UINT i = 0; i < N; ++i)
+			mMembers[i] = aMembers[i], hashes[i] = NameHash(aMembers[i].name);
+		for (UINT seed = 1; seed < 0x10000 && !mValid; ++seed) {
+			for (UINT s = 0; s < SIZE; ++s)
+				mSlots[s] = 0;
+			UINT i = 0;
+			for (; i < N; ++i) {
+				UCHAR& slot = mSlots[Slot(hashes[i], seed)];
+				if (slot)
+					break;
+				slot = (UCHAR)(i + 1);
+			}
+			mValid = i == N, mSeed = seed;
+		}
+	}
+	// False if no seed separated the names, such as when two are the same.
+	constexpr bool Valid() const { return mValid; }
+
+	static bool NameEquals(LPCTSTR aName, LPCTSTR aMember) {
+		for (; *aName; ++aName, ++aMember)
+			if (*aName != *aMember && ((*aName | 0x20) != (*aMember | 0x20) || (TCHAR)((*aName | 0x20) - 'a') > 'z' - 'a'))
+				return false;
+		return !*aMember;
+	}
+	const ObjectMember* Find(LPCTSTR aName) const {
+		UCHAR index = mSlots[Slot(NameHash(aName), mSeed)];
+		return index && NameEquals(aName, mMembers[index - 1].name) ? &mMembers[index - 1] : nullptr;
+	}
+
+	ResultType Invoke(IObject* aThis, ResultToken& aResultToken, int aFlags, LPTSTR aName, ExprTokenType* aParam[], int aParamCount) const {
+		const ObjectMember* member = aName ? Find(aName) : nullptr;
+		if (!member || member->invokeType != (aFlags & IT_BITMASK))
+			return INVOKE_NOT_HANDLED;
+		if (aParamCount < member->minParams || (aParamCount > member->maxParams && member->maxParams != MAXP_VARIADIC)) {
+			Object::Error(ExprTokenType((LPTSTR)(aParamCount < member->minParams ? _T("Too few parameters passed to function.")
+				: _T("Too many parameters passed to function."))), aName);
+			return aResultToken.result = FAIL;
+		}
+		(aThis->*member->method)(aResultToken, member->id, aFlags, aParam, aParamCount);
+		return aResultToken.result;
+	}
+};
+
 template<class T>
 BIF_DECL(NewObject)
 {
@@ -922,14 +2190,323 @@ BIF_DECL(NewObject)
 		aResultToken.result = FAIL;
 }
 
+#ifdef AHK2_PROFILE
+//
+// Profiler - per-symbol call statistics, compiled in only when AHK2_PROFILE is defined.
+//
+// EXPORT_AHKMODULE points every exported function and class member at a numbered trampoline
+// before the symbols reach the loader.  While profiling is on, the trampoline counts the call
+// and its arguments, times it with rdtsc into a log-scale histogram (for p50/p99), and adds up
+// the bytes of strings returned through mem_to_free; for a class, each object returned by its
+// constructor (NewObject<T>) is counted.  The last PROFILE_TRACE_EVENTS calls are also kept
+// for profile_trace().  While it is off, each call costs one extra jump and a flag test.
+// Exported functions and members run on the script's thread, so nothing here is locked.
+//
+// The module gains four functions:
+//   profile_start()     - clears the statistics and starts recording.
+//   profile_stop()      - stops recording; the statistics are kept.
+//   profile_snapshot()  - returns a Map of symbol name => {Calls, TotalUs, MeanUs, P50Us, P99Us,
+//                         MeanArgs, MaxArgs, BytesReturned, Objects} for each symbol called.
+//   profile_trace()     - returns the recorded calls as Chrome trace-event JSON (chrome://tracing).
+//
+
+#define PROFILE_MAX_SLOTS		512
+#define PROFILE_BUCKETS			256 // Four per power of two of the cycle count.
+#define PROFILE_TRACE_EVENTS	65536
+
+struct ProfileSlot
+{
+	LPTSTR name;
+	BuiltInFunctionType call;
+	ObjectMethod method;
+	bool is_class;
+	UINT max_args;
+	unsigned __int64 calls, cycles, args, bytes, objects;
+	UINT histogram[PROFILE_BUCKETS];
+};
+
+struct ProfileEvent
+{
+	unsigned __int64 start, cycles;
+	USHORT slot, args;
+};
+
+static struct Profiler
+{
+	ProfileSlot slots[PROFILE_MAX_SLOTS];
+	ProfileEvent events[PROFILE_TRACE_EVENTS];
+	UINT slot_count;
+	bool enabled;
+	size_t event_count; // Total recorded since profile_start; the ring holds the last PROFILE_TRACE_EVENTS.
+	unsigned __int64 start_tsc, stop_tsc;
+	LARGE_INTEGER start_qpc, stop_qpc;
+
+	static UINT Bucket(unsigned __int64 aCycles) {
+		if (aCycles < 4)
+			return (UINT)aCycles;
+		unsigned long bit;
+#ifdef _WIN64
+		_BitScanReverse64(&bit, aCycles);
+#else
+		if (aCycles >> 32)
+			_BitScanReverse(&bit, (ULONG)(aCycles >> 32)), bit += 32;
+		else
+			_BitScanReverse(&bit, (ULONG)aCycles);
+#endif
+		return 4 * (bit - 1) + (UINT)((aCycles >> (bit - 2)) & 3);
+	}
+	// The middle of the bucket's range of cycle counts.
+	static double BucketValue(UINT aBucket) {
+		if (aBucket < 4)
+			return aBucket;
+		UINT bit = aBucket / 4 + 1;
+		double width = (double)(1ULL << (bit - 2));
+		return (4 + aBucket % 4) * width + width / 2;
+	}
+
+	void Record(UINT aSlot, unsigned __int64 aStart, ResultToken& aResultToken, int aParamCount) {
+		unsigned __int64 cycles = __rdtsc() - aStart;
+		ProfileSlot& slot = slots[aSlot];
+		slot.calls++;
+		slot.cycles += cycles;
+		slot.args += aParamCount;
+		if ((UINT)aParamCount > slot.max_args)
+			slot.max_args = aParamCount;
+		slot.histogram[Bucket(cycles)]++;
+		if (aResultToken.mem_to_free)
+			slot.bytes += ((aResultToken.marker_length == -1 ? _tcslen(aResultToken.mem_to_free)
+				: aResultToken.marker_length) + 1) * sizeof(TCHAR);
+		if (slot.is_class && aResultToken.symbol == SYM_OBJECT && !aResultToken.Exited())
+			slot.objects++;
+		ProfileEvent& ev = events[event_count++ % PROFILE_TRACE_EVENTS];
+		ev.start = aStart, ev.cycles = cycles, ev.slot = (USHORT)aSlot;
+		ev.args = aParamCount > USHRT_MAX ? USHRT_MAX : (USHORT)aParamCount;
+	}
+
+	void Start() {
+		for (UINT i = 0; i < slot_count; ++i) {
+			ProfileSlot& slot = slots[i];
+			slot.max_args = 0;
+			slot.calls = slot.cycles = slot.args = slot.bytes = slot.objects = 0;
+			memset(slot.histogram, 0, sizeof(slot.histogram));
+		}
+		event_count = 0;
+		QueryPerformanceCounter(&start_qpc);
+		start_tsc = __rdtsc();
+		enabled = true;
+	}
+	void Stop() {
+		if (!enabled)
+			return;
+		enabled = false;
+		QueryPerformanceCounter(&stop_qpc);
+		stop_tsc = __rdtsc();
+	}
+	// rdtsc ticks per microsecond, measured against QueryPerformanceCounter over the profiled interval.
+	double TicksPerUs() {
+		LARGE_INTEGER freq, qpc = stop_qpc;
+		unsigned __int64 tsc = stop_tsc;
+		if (enabled)
+			QueryPerformanceCounter(&qpc), tsc = __rdtsc();
+		QueryPerformanceFrequency(&freq);
+		double us = (double)(qpc.QuadPart - start_qpc.QuadPart) * 1000000.0 / (double)freq.QuadPart;
+		return us > 0 && tsc > start_tsc ? (double)(tsc - start_tsc) / us : 1.0;
+	}
+	double Percentile(ProfileSlot& aSlot, double aFraction) {
+		unsigned __int64 rank = (unsigned __int64)(aFraction * (double)(aSlot.calls - 1)), seen = 0;
+		for (UINT i = 0; i < PROFILE_BUCKETS; ++i)
+			if ((seen += aSlot.histogram[i]) > rank)
+				return BucketValue(i);
+		return 0;
+	}
+} sProfiler;
+
+template<int I>
+static BIF_DECL(ProfiledCall)
+{
+	ProfileSlot& slot = sProfiler.slots[I];
+	if (!sProfiler.enabled)
+		return slot.call(aResultToken, aParam, aParamCount);
+	unsigned __int64 start = __rdtsc();
+	slot.call(aResultToken, aParam, aParamCount);
+	sProfiler.Record(I, start, aResultToken, aParamCount);
+}
+
+// Never instantiated; its Call<I> is only a member function pointer stored in place of a member's
+// method, so 'this' is the object the member was invoked on (all objects share IObject at offset 0).
+struct ProfiledObject : public ObjectBase
+{
+	template<int I>
+	void Call(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		ProfileSlot& slot = sProfiler.slots[I];
+		IObject* self = this;
+		if (!sProfiler.enabled)
+			return (self->*slot.method)(aResultToken, aID, aFlags, aParam, aParamCount);
+		unsigned __int64 start = __rdtsc();
+		(self->*slot.method)(aResultToken, aID, aFlags, aParam, aParamCount);
+		sProfiler.Record(I, start, aResultToken, aParamCount);
+	}
+};
+
+template<class S> struct ProfileTrampolines;
+template<int... I> struct ProfileTrampolines<std::integer_sequence<int, I...>>
+{
+	static BuiltInFunctionType Call(UINT aSlot) {
+		static const BuiltInFunctionType sCalls[] = { ProfiledCall<I>... };
+		return sCalls[aSlot];
+	}
+	static ObjectMethod Method(UINT aSlot) {
+		static const ObjectMethod sMethods[] = { static_cast<ObjectMethod>(&ProfiledObject::Call<I>)... };
+		return sMethods[aSlot];
+	}
+};
+typedef ProfileTrampolines<std::make_integer_sequence<int, PROFILE_MAX_SLOTS>> Trampolines;
+
+// profile_start()
+static BIF_DECL(profile_start) { sProfiler.Start(); }
+
+// profile_stop()
+static BIF_DECL(profile_stop) { sProfiler.Stop(); }
+
+// profile_snapshot()
+static BIF_DECL(profile_snapshot)
+{
+	static IObject* sMap = GetGlobal(_T("Map"));
+	static IObject* sObject = GetGlobal(_T("Object"));
+	IObject* map = sMap && sObject ? CallGlobal(sMap, nullptr, 0) : nullptr;
+	if (!map) {
+		aResultToken.result = FAIL;
+		return;
+	}
+	double ticks_per_us = sProfiler.TicksPerUs();
+	for (UINT i = 0; i < sProfiler.slot_count; ++i) {
+		ProfileSlot& slot = sProfiler.slots[i];
+		if (!slot.calls)
+			continue;
+		IObject* stats = CallGlobal(sObject, nullptr, 0);
+		if (!stats)
+			break;
+		struct { LPTSTR name; double value; } fields[] = {
+			{ _T("TotalUs"), slot.cycles / ticks_per_us },
+			{ _T("MeanUs"), slot.cycles / ticks_per_us / slot.calls },
+			{ _T("P50Us"), sProfiler.Percentile(slot, 0.5) / ticks_per_us },
+			{ _T("P99Us"), sProfiler.Percentile(slot, 0.99) / ticks_per_us },
+			{ _T("MeanArgs"), (double)slot.args / slot.calls },
+		};
+		ExprTokenType value;
+		value.SetValue((__int64)slot.calls), SetProperty(stats, _T("Calls"), value);
+		for (auto& field : fields)
+			value.SetValue(field.value), SetProperty(stats, field.name, value);
+		value.SetValue((__int64)slot.max_args), SetProperty(stats, _T("MaxArgs"), value);
+		value.SetValue((__int64)slot.bytes), SetProperty(stats, _T("BytesReturned"), value);
+		value.SetValue((__int64)slot.objects), SetProperty(stats, _T("Objects"), value);
+		TCHAR buf[MAX_NUMBER_SIZE];
+		ResultToken r;
+		ExprTokenType param[2], * params[2] = { param, param + 1 };
+		param[0].SetValue(slot.name), param[1].SetValue(stats);
+		r.InitResult(buf);
+		map->Invoke(r, IT_CALL, _T("Set"), ExprTokenType(map), params, 2);
+		r.Free();
+		stats->Release();
+	}
+	aResultToken.SetValue(map);
+}
+
+// profile_trace()
+static BIF_DECL(profile_trace)
+{
+	// Microseconds with three decimals, as trace viewers expect.
+	auto append_us = [](TString& aOut, double aUs) {
+		__int64 ns = (__int64)(aUs * 1000.0 + 0.5);
+		TCHAR frac[4] = { TCHAR('0' + ns / 100 % 10), TCHAR('0' + ns / 10 % 10), TCHAR('0' + ns % 10), 0 };
+		aOut.append_int(ns / 1000).append('.') += frac;
+	};
+	double ticks_per_us = sProfiler.TicksPerUs();
+	size_t count = sProfiler.event_count < PROFILE_TRACE_EVENTS ? sProfiler.event_count : PROFILE_TRACE_EVENTS;
+	TString out;
+	out += _T("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	for (size_t n = sProfiler.event_count - count; n < sProfiler.event_count; ++n) {
+		ProfileEvent& ev = sProfiler.events[n % PROFILE_TRACE_EVENTS];
+		out += _T("{\"name\":\"");
+		for (LPTSTR cp = sProfiler.slots[ev.slot].name; *cp; ++cp) {
+			if (*cp == '"' || *cp == '\\')
+				out.append('\\');
+			out.append(*cp);
+		}
+		out += _T("\",\"cat\":\"");
+		out += sProfiler.slots[ev.slot].is_class ? _T("class") : sProfiler.slots[ev.slot].method ? _T("method") : _T("function");
+		out += _T("\",\"ph\":\"X\",\"pid\":");
+		out.append_int(GetCurrentProcessId()) += _T(",\"tid\":");
+		out.append_int(GetCurrentThreadId()) += _T(",\"ts\":");
+		append_us(out, (ev.start - sProfiler.start_tsc) / ticks_per_us);
+		out += _T(",\"dur\":");
+		append_us(out, ev.cycles / ticks_per_us);
+		out += _T(",\"args\":{\"argc\":");
+		out.append_int(ev.args) += _T("}},");
+	}
+	if (count)
+		out.pop_back();
+	out += _T("]}");
+	if (!out.move_to(aResultToken))
+		aResultToken.result = FAIL;
+}
+
+// Routes the module's symbols and class members through the trampolines, and returns a copy of
+// the symbol table with the profile_* functions appended.  Symbols past PROFILE_MAX_SLOTS are
+// left as they are.
+static ExportSymbol* ProfileInstall(ExportSymbol* aSymbols, UINT& aCount)
+{
+	static ExportSymbol sProfileSymbols[] = {
+		EXPORT_FUNC(profile_start, 0, 0)
+		EXPORT_FUNC(profile_stop, 0, 0)
+		EXPORT_FUNC(profile_snapshot, 0, 0)
+		EXPORT_FUNC(profile_trace, 0, 0)
+	};
+	auto add_slot = [](LPTSTR aName) -> ProfileSlot* {
+		if (sProfiler.slot_count == PROFILE_MAX_SLOTS)
+			return nullptr;
+		ProfileSlot* slot = &sProfiler.slots[sProfiler.slot_count++];
+		slot->name = aName;
+		return slot;
+	};
+	for (UINT i = 0; i < aCount; ++i) {
+		ExportSymbol& sym = aSymbols[i];
+		if (sym.call)
+			if (ProfileSlot* slot = add_slot(sym.name)) {
+				slot->call = sym.call, slot->is_class = sym.member_count > 0;
+				sym.call = Trampolines::Call(sProfiler.slot_count - 1);
+			}
+		if (sym.members && sym.member_count)
+			for (UINT m = 0; m < sym.member_count; ++m)
+				if (sym.members[m].method)
+					if (ProfileSlot* slot = add_slot(sym.members[m].name)) {
+						slot->method = sym.members[m].method;
+						sym.members[m].method = Trampolines::Method(sProfiler.slot_count - 1);
+					}
+	}
+	ExportSymbol* all = (ExportSymbol*)malloc(sizeof(ExportSymbol) * (aCount + _countof(sProfileSymbols)));
+	if (!all)
+		return aSymbols;
+	memcpy(all, aSymbols, sizeof(ExportSymbol) * aCount);
+	memcpy(all + aCount, sProfileSymbols, sizeof(sProfileSymbols));
+	aCount += _countof(sProfileSymbols);
+	return all;
+}
+#define PROFILE_INSTALL(symbols, count) ProfileInstall(symbols, count)
+#else
+#define PROFILE_INSTALL(symbols, count) (symbols)
+#endif // AHK2_PROFILE
+
 #define EXPORT_AHKMODULE(symbols) \
 extern "C" __declspec(dllexport) void* ahk2_module_load(Object* loader, Object* ahkProvider) {\
 	ResultToken result;\
 	ExprTokenType param[2], * params[2] = { param,param + 1 };\
+	UINT count = _countof(symbols);\
+	ExportSymbol* exports = PROFILE_INSTALL(symbols, count);\
 	ObjectBase::ahkProvider = ahkProvider;\
 	memcpy(&ObjectBase::ahkVT, *(void***)loader - 1, sizeof(ObjectVTABLE));\
 	result.InitResult(_T(""));\
-	param->SetValue((__int64)_countof(symbols)), param[1].SetValue((__int64)symbols);\
+	param->SetValue((__int64)count), param[1].SetValue((__int64)exports);\
 	loader->Invoke(result, IT_CALL, nullptr, ExprTokenType(loader), params, 2);\
 	if (result.symbol == SYM_OBJECT) return result.object;\
 	if (result.mem_to_free)free(result.mem_to_free);\
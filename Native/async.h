@@ -0,0 +1,595 @@
+﻿#ifndef AHK2_ASYNC_H
+#define AHK2_ASYNC_H
+#include "ahk2_types.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+//
+// Background jobs.  A WorkPool runs AsyncJobs on threads of its own.  Each worker takes the newest
+// job from its own queue, then the oldest submitted from outside the pool, then steals the oldest
+// from another worker; a job submitted by a running job goes to that worker's queue.  The pool only
+// uses the C++ library, so it builds and runs apart from the script.
+//
+
+#define ASYNC_MAX_WORKERS 64
+#define ASYNC_WINDOW_CLASS _T("AHK2AsyncWindow")
+
+enum AsyncJobState { JOB_QUEUED, JOB_RUNNING, JOB_FINISHED, JOB_CANCELLED };
+
+struct AsyncJob
+{
+	AsyncJob* next = nullptr; // Link in a CompletionQueue.
+	std::atomic<int> state{ JOB_QUEUED };
+	std::atomic<bool> cancelled{ false };
+	std::atomic<long> refs{ 1 };
+
+	virtual ~AsyncJob() {}
+	// Does the work on a worker thread.  Long jobs should check Cancelled() now and then.
+	virtual void Run() = 0;
+	// Called on the worker thread once Run returns.
+	virtual void Finish() {}
+
+	bool Cancelled() { return cancelled.load(std::memory_order_relaxed); }
+	// Returns true if the job hadn't started and now never will; otherwise a running job is asked
+	// to stop.  A finished job is left as it is.
+	bool Cancel() {
+		int current = JOB_QUEUED;
+		if (state.compare_exchange_strong(current, JOB_CANCELLED)) {
+			cancelled.store(true, std::memory_order_relaxed);
+			return true;
+		}
+		if (current == JOB_RUNNING)
+			cancelled.store(true, std::memory_order_relaxed);
+		return false;
+	}
+	void AddRef() { refs.fetch_add(1, std::memory_order_relaxed); }
+	void Release() {
+		if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete this;
+	}
+};
+
+// A lock-free list which any thread may push to, and one thread drains.  Push returns true if the
+// list was empty, so the consumer is woken once per batch rather than once per item.
+template<class T>
+class CompletionQueue
+{
+	std::atomic<T*> mHead{ nullptr };
+public:
+	bool Push(T* aItem) {
+		T* head = mHead.load(std::memory_order_relaxed);
+		do aItem->next = head;
+		while (!mHead.compare_exchange_weak(head, aItem, std::memory_order_release, std::memory_order_relaxed));
+		return !head;
+	}
+	// Takes everything pushed so far, linked oldest first.
+	T* Drain() {
+		T* item = mHead.exchange(nullptr, std::memory_order_acquire), * prev = nullptr;
+		while (item) {
+			T* next = static_cast<T*>(item->next);
+			item->next = prev, prev = item, item = next;
+		}
+		return prev;
+	}
+};
+
+class WorkPool
+{
+	struct Queue
+	{
+		std::mutex lock;
+		AsyncJob** ring = nullptr;
+		size_t head = 0, count = 0, capacity = 0;
+
+		~Queue() { free(ring); }
+		bool Push(AsyncJob* aJob) {
+			std::lock_guard<std::mutex> guard(lock);
+			if (count == capacity) {
+				size_t new_capacity = capacity ? capacity * 2 : 64;
+				auto new_ring = (AsyncJob**)malloc(new_capacity * sizeof(AsyncJob*));
+				if (!new_ring)
+					return false;
+				for (size_t i = 0; i < count; ++i)
+					new_ring[i] = ring[(head + i) % capacity];
+				free(ring);
+				ring = new_ring, head = 0, capacity = new_capacity;
+			}
+			ring[(head + count++) % capacity] = aJob;
+			return true;
+		}
+		AsyncJob* Pop(bool aOldest) {
+			std::lock_guard<std::mutex> guard(lock);
+			if (!count)
+				return nullptr;
+			if (!aOldest)
+				return ring[(head + --count) % capacity];
+			AsyncJob* job = ring[head];
+			head = (head + 1) % capacity, --count;
+			return job;
+		}
+	};
+
+	struct Current { WorkPool* pool; int index; };
+	static Current& Self() {
+		static thread_local Current sSelf = { nullptr, 0 };
+		return sSelf;
+	}
+
+	Queue mQueues[ASYNC_MAX_WORKERS], mSubmitted;
+	std::thread mThreads[ASYNC_MAX_WORKERS];
+	std::atomic<int> mStarted{ 0 }, mLimit, mSleeping{ 0 }, mWaiting{ 0 };
+	std::atomic<size_t> mQueued{ 0 };
+	std::atomic<bool> mStop{ false };
+	// Workers sleep on mWake while there's nothing to do, and on mIdle while above the limit.
+	std::mutex mWakeLock, mDoneLock;
+	std::condition_variable mWake, mIdle, mDone;
+
+	void Start(int aCount) {
+		std::lock_guard<std::mutex> guard(mWakeLock);
+		for (int i = mStarted.load(); i < aCount && !mStop.load(); ++i) {
+			try { mThreads[i] = std::thread(&WorkPool::Work, this, i); }
+			catch (...) { break; }
+			mStarted.store(i + 1);
+		}
+	}
+
+	AsyncJob* Take(int aIndex) {
+		if (!mQueued.load())
+			return nullptr;
+		AsyncJob* job = mQueues[aIndex].Pop(false);
+		if (!job)
+			job = mSubmitted.Pop(true);
+		for (int n = mStarted.load(), i = 1; !job && i < n; ++i)
+			job = mQueues[(aIndex + i) % n].Pop(true);
+		if (job)
+			mQueued.fetch_sub(1);
+		return job;
+	}
+
+	void Execute(AsyncJob* aJob) {
+		int queued = JOB_QUEUED;
+		if (aJob->state.compare_exchange_strong(queued, JOB_RUNNING)) {
+			aJob->Run();
+			aJob->Finish();
+			aJob->state.store(JOB_FINISHED);
+			if (mWaiting.load()) {
+				std::lock_guard<std::mutex> guard(mDoneLock);
+				mDone.notify_all();
+			}
+		}
+		aJob->Release();
+	}
+
+	void Work(int aIndex) {
+		Self() = { this, aIndex };
+		std::unique_lock<std::mutex> lock(mWakeLock, std::defer_lock);
+		while (!mStop.load()) {
+			if (AsyncJob* job = aIndex < mLimit.load() ? Take(aIndex) : nullptr) {
+				Execute(job);
+				continue;
+			}
+			lock.lock();
+			if (mStop.load())
+				break;
+			if (aIndex >= mLimit.load())
+				mIdle.wait(lock);
+			else {
+				// Pairs with the check of mSleeping in Submit, so a job queued meanwhile isn't missed.
+				mSleeping.fetch_add(1);
+				if (!mQueued.load())
+					mWake.wait(lock);
+				mSleeping.fetch_sub(1);
+			}
+			lock.unlock();
+		}
+	}
+
+public:
+	WorkPool(int aLimit = 0) {
+		int cores = (int)std::thread::hardware_concurrency();
+		mLimit.store(aLimit > 0 ? aLimit : cores > 0 ? cores : 1);
+		if (mLimit.load() > ASYNC_MAX_WORKERS)
+			mLimit.store(ASYNC_MAX_WORKERS);
+	}
+	// Jobs still queued are released without being run.
+	~WorkPool() {
+		{
+			std::lock_guard<std::mutex> guard(mWakeLock);
+			mStop.store(true);
+		}
+		mWake.notify_all();
+		mIdle.notify_all();
+		for (int i = 0; i < mStarted.load(); ++i)
+			mThreads[i].join();
+		for (int i = 0; i < ASYNC_MAX_WORKERS; ++i)
+			while (AsyncJob* job = mQueues[i].Pop(true))
+				job->Release();
+		while (AsyncJob* job = mSubmitted.Pop(true))
+			job->Release();
+	}
+
+	int Limit() { return mLimit.load(); }
+	int Workers() { return mStarted.load(); }
+	// Sets how many workers may run jobs at once.  Workers above the limit finish their current job
+	// and then sleep; more are started by the next Submit.
+	void SetLimit(int aLimit) {
+		{
+			std::lock_guard<std::mutex> guard(mWakeLock);
+			mLimit.store(aLimit < 1 ? 1 : aLimit > ASYNC_MAX_WORKERS ? ASYNC_MAX_WORKERS : aLimit);
+		}
+		mIdle.notify_all();
+		mWake.notify_all();
+	}
+
+	// Queues a job, adding a reference to it.  Returns false if no worker could be started or
+	// there was no memory to queue the job.
+	bool Submit(AsyncJob* aJob) {
+		int limit = mLimit.load();
+		if (mStarted.load() < limit)
+			Start(limit);
+		if (!mStarted.load())
+			return false;
+		Current& self = Self();
+		Queue& queue = self.pool == this ? mQueues[self.index] : mSubmitted;
+		aJob->AddRef();
+		if (!queue.Push(aJob)) {
+			aJob->Release();
+			return false;
+		}
+		mQueued.fetch_add(1);
+		if (mSleeping.load()) {
+			std::lock_guard<std::mutex> guard(mWakeLock);
+			mWake.notify_one();
+		}
+		return true;
+	}
+
+	// Waits up to aTimeout ms (or indefinitely if negative) for a job to finish or be cancelled.
+	// Must not be called from a job, which could be waiting on itself.
+	bool Wait(AsyncJob* aJob, int aTimeout = -1) {
+		auto done = [aJob] { int state = aJob->state.load(); return state == JOB_FINISHED || state == JOB_CANCELLED; };
+		std::unique_lock<std::mutex> lock(mDoneLock);
+		mWaiting.fetch_add(1);
+		bool ok = true;
+		if (aTimeout < 0)
+			mDone.wait(lock, done);
+		else
+			ok = mDone.wait_for(lock, std::chrono::milliseconds(aTimeout), done);
+		mWaiting.fetch_sub(1);
+		return ok;
+	}
+};
+
+//
+// Script side of the pool.  A ScriptJob's outcome reaches the script through an AsyncTask, which
+// has the Status, Result and OnCompleted of a Promise, so code written for Promise.ahk can use it.
+// Finished jobs are posted to a message-only window on the script thread, one message per batch,
+// and the callbacks of every task settled meanwhile run from one SetTimer, as Promise runs its own.
+//
+
+// Module-wide: never destroyed, as joining the workers while the DLL unloads would deadlock.
+static WorkPool& AsyncPool() {
+	static WorkPool* sPool = new WorkPool;
+	return *sPool;
+}
+
+class AsyncTask;
+
+// A job holds no script objects: it may be deleted on a worker thread.
+struct ScriptJob : AsyncJob
+{
+	AsyncTask* task = nullptr;
+	LPTSTR error = nullptr, error_type = nullptr, error_extra = nullptr; // error_extra is malloc'd.
+	DWORD os_error = 0;
+
+	~ScriptJob() { free(error_extra); }
+	// Gives the result on the script thread after Run succeeds, as a BIF returns its value.  Must
+	// not throw; returns false if out of memory.
+	virtual bool Result(ResultToken& aResultToken) = 0;
+	void Finish();
+
+	// For Run to report failure; aMessage and aType must be static.
+	void Reject(LPTSTR aMessage, LPTSTR aType = _T("Error"), LPCTSTR aExtra = nullptr) {
+		error = aMessage, error_type = aType;
+		error_extra = aExtra ? _tcsdup(aExtra) : nullptr;
+	}
+	void RejectOS(DWORD aError, LPCTSTR aExtra = nullptr) {
+		os_error = aError ? aError : ERROR_GEN_FAILURE;
+		error_extra = aExtra ? _tcsdup(aExtra) : nullptr;
+	}
+};
+
+static CompletionQueue<AsyncJob> sAsyncCompletions;
+static HWND sAsyncWindow;
+
+// Creates an error object of class aType without throwing it.
+static IObject* NewError(LPTSTR aType, ExprTokenType aMessage, LPTSTR aExtra = nullptr) {
+	IObject* cls = GetGlobal(aType);
+	ExprTokenType what, extra, * params[] = { &aMessage, &what, &extra };
+	what.symbol = SYM_MISSING;
+	if (aExtra)
+		extra.SetValue(aExtra);
+	IObject* err = cls ? CallGlobal(cls, params, aExtra ? 3 : 1) : nullptr;
+	if (cls)
+		cls->Release();
+	return err;
+}
+
+class AsyncTask : public ObjectBase
+{
+	enum { TASK_PENDING, TASK_FULFILLED, TASK_REJECTED };
+
+	ScriptJob* mJob;
+	ExprTokenType mResult; // Owns its string or object.
+	int mStatus = TASK_PENDING;
+	IObject** mCallbacks = nullptr;
+	UINT mCallbackCount = 0, mCalled = 0;
+	AsyncTask* mNextReady = nullptr;
+	bool mReady = false;
+
+	bool SetResult(ResultToken& aToken) {
+		if (aToken.symbol == SYM_STRING && !aToken.mem_to_free) {
+			size_t length = aToken.marker_length == -1 ? _tcslen(aToken.marker) : aToken.marker_length;
+			LPTSTR copy = (LPTSTR)malloc((length + 1) * sizeof(TCHAR));
+			if (!copy)
+				return false;
+			memcpy(copy, aToken.marker, length * sizeof(TCHAR));
+			copy[length] = '\0';
+			mResult.SetValue(copy, length);
+		}
+		else if (aToken.symbol == SYM_STRING)
+			mResult.SetValue(aToken.mem_to_free, aToken.marker_length);
+		else
+			mResult = aToken;
+		return true;
+	}
+
+	void Reject(LPTSTR aType, ExprTokenType aMessage, LPTSTR aExtra = nullptr) {
+		mStatus = TASK_REJECTED;
+		if (IObject* err = NewError(aType, aMessage, aExtra))
+			mResult.SetValue(err);
+	}
+
+	// Runs the queued callbacks in a new script thread, like any timer.
+	class Dispatcher : public ObjectBase
+	{
+	public:
+		LPTSTR Type() { return _T("Object"); }
+		ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+			if (!IS_INVOKE_CALL || (aName && _tcsicmp(aName, _T("Call"))))
+				return INVOKE_NOT_HANDLED;
+			return RunCallbacks(aResultToken);
+		}
+	};
+
+	static AsyncTask*& ReadyHead() { static AsyncTask* sHead; return sHead; }
+	static AsyncTask*& ReadyTail() { static AsyncTask* sTail; return sTail; }
+
+	static void ArmTimer() {
+		static IObject* sSetTimer = GetGlobal(_T("SetTimer"));
+		static Dispatcher* sDispatcher = new Dispatcher;
+		if (!sSetTimer || !sDispatcher)
+			return;
+		ExprTokenType callback(sDispatcher), period, * params[] = { &callback, &period };
+		period.SetValue((__int64)-1);
+		if (IObject* ret = CallGlobal(sSetTimer, params, 2))
+			ret->Release();
+	}
+
+	// Queues the callbacks not yet called, setting the timer if the queue was empty.
+	void Schedule() {
+		if (mReady || mCalled == mCallbackCount)
+			return;
+		AddRef();
+		mReady = true;
+		bool arm = !ReadyHead();
+		(arm ? ReadyHead() : ReadyTail()->mNextReady) = this;
+		ReadyTail() = this;
+		if (arm)
+			ArmTimer();
+	}
+
+	static ResultType RunCallbacks(ResultToken& aResultToken) {
+		while (AsyncTask* task = ReadyHead()) {
+			while (task->mCalled < task->mCallbackCount) {
+				IObject* callback = task->mCallbacks[task->mCalled++];
+				TCHAR buf[MAX_NUMBER_SIZE];
+				ResultToken result;
+				ExprTokenType arg(task), * param = &arg;
+				result.InitResult(buf);
+				callback->Invoke(result, IT_CALL, nullptr, ExprTokenType(callback), &param, 1);
+				callback->Release();
+				result.Free();
+				if (result.Exited()) {
+					// The rest wait for the next timer, so the error is reported first.
+					ArmTimer();
+					return aResultToken.result = result.result;
+				}
+			}
+			ReadyHead() = task->mNextReady;
+			task->mNextReady = nullptr, task->mReady = false;
+			task->Release();
+		}
+		return OK;
+	}
+
+public:
+	AsyncTask(ScriptJob* aJob) : mJob(aJob) { aJob->AddRef(), mResult.SetValue((__int64)0); }
+	~AsyncTask() {
+		if (mJob)
+			mJob->Release();
+		while (mCalled < mCallbackCount)
+			mCallbacks[mCalled++]->Release();
+		free(mCallbacks);
+		if (mResult.symbol == SYM_OBJECT)
+			mResult.object->Release();
+		else if (mResult.symbol == SYM_STRING)
+			free(mResult.marker);
+	}
+	LPTSTR Type() { return _T("AsyncTask"); }
+
+	// Settles the task with its job's outcome, on the script thread.
+	void Settle() {
+		ScriptJob* job = mJob;
+		mJob = nullptr;
+		// A job which finished its work before it saw the request is fulfilled as usual.
+		if (job->state.load() == JOB_CANCELLED || (job->Cancelled() && (job->error || job->os_error)))
+			Reject(_T("Error"), ExprTokenType(_T("The task was cancelled.")));
+		else if (job->os_error) {
+			ExprTokenType code;
+			code.SetValue((__int64)job->os_error);
+			Reject(_T("OSError"), code, job->error_extra);
+		}
+		else if (job->error)
+			Reject(job->error_type, ExprTokenType(job->error), job->error_extra);
+		else {
+			TCHAR buf[MAX_NUMBER_SIZE];
+			ResultToken result;
+			result.InitResult(buf);
+			if (job->Result(result) && SetResult(result))
+				mStatus = TASK_FULFILLED;
+			else {
+				result.Free();
+				Reject(_T("MemoryError"), ExprTokenType(_T("Out of memory.")));
+			}
+		}
+		job->task = nullptr;
+		job->Release();
+		Schedule();
+		Release(); // The job's reference.
+	}
+
+	// Settles the tasks of every job finished so far.
+	static void Dispatch() {
+		for (AsyncJob* job = sAsyncCompletions.Drain(), * next; job; job = next) {
+			next = job->next;
+			static_cast<ScriptJob*>(job)->task->Settle();
+			job->Release();
+		}
+	}
+
+	// Members, dispatched by sAsyncTaskLookup.
+	void GetStatus(ResultToken& aResultToken) {
+		static LPTSTR sStatus[] = { _T("pending"), _T("fulfilled"), _T("rejected") };
+		aResultToken.SetValue(sStatus[mStatus]);
+	}
+	void GetResult(ResultToken& aResultToken) { ReturnResult(aResultToken); }
+	// OnCompleted(callback): callback(task) runs once the task settles, or soon if it has.
+	void OnCompleted(ResultToken& aResultToken, IObject* aCallback) {
+		auto callbacks = (IObject**)realloc(mCallbacks, (mCallbackCount + 1) * sizeof(IObject*));
+		if (!callbacks) {
+			Object::Error(ExprTokenType(_T("Out of memory.")), nullptr, _T("MemoryError"));
+			aResultToken.result = FAIL;
+			return;
+		}
+		aCallback->AddRef();
+		mCallbacks = callbacks, mCallbacks[mCallbackCount++] = aCallback;
+		if (mStatus != TASK_PENDING)
+			Schedule();
+	}
+	// Cancel(): a job not yet started is dropped and the task rejected at once; a running job
+	// is asked to stop, and the task is rejected when it does.
+	void Cancel() {
+		if (mStatus == TASK_PENDING && mJob->Cancel())
+			Settle();
+	}
+	// Await(timeout := -1): the result, or the rejection thrown.  Blocks the script thread.
+	void Await(ResultToken& aResultToken, Optional<int> aTimeout) {
+		if (mStatus == TASK_PENDING && AsyncPool().Wait(mJob, aTimeout.value_or(-1)))
+			Dispatch();
+		if (mStatus == TASK_PENDING) {
+			Object::Error(ExprTokenType(_T("The task has not completed.")), nullptr, _T("TimeoutError"));
+			aResultToken.result = FAIL;
+		}
+		else if (mStatus == TASK_REJECTED) {
+			Object::Error(mResult);
+			aResultToken.result = FAIL;
+		}
+		else ReturnResult(aResultToken);
+	}
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL);
+
+	ResultType ReturnResult(ResultToken& aResultToken) {
+		if (mStatus == TASK_PENDING)
+			aResultToken.SetValue(_T(""), 0);
+		else if (mResult.symbol == SYM_OBJECT)
+			mResult.object->AddRef(), aResultToken.SetValue(mResult.object);
+		else if (mResult.symbol == SYM_STRING)
+			aResultToken.SetValue(mResult.marker, mResult.marker_length);
+		else if (mResult.symbol == SYM_FLOAT)
+			aResultToken.SetValue(mResult.value_double);
+		else
+			aResultToken.SetValue(mResult.value_int64);
+		return OK;
+	}
+};
+
+constexpr ObjectMember sAsyncTaskMembers[] = {
+	Member_TypedGet(Status, AsyncTask, GetStatus),
+	Member_TypedGet(Result, AsyncTask, GetResult),
+	Member_TypedMethod(OnCompleted, AsyncTask, OnCompleted),
+	Member_TypedMethod(Cancel, AsyncTask, Cancel),
+	Member_TypedMethod(Await, AsyncTask, Await),
+};
+constexpr MemberHash<_countof(sAsyncTaskMembers)> sAsyncTaskLookup(sAsyncTaskMembers);
+static_assert(sAsyncTaskLookup.Valid(), "The AsyncTask member names need another hash seed.");
+
+inline ResultType AsyncTask::Invoke(IObject_Invoke_PARAMS_DECL) {
+	return sAsyncTaskLookup.Invoke(this, aResultToken, aFlags, aName, aParam, aParamCount);
+}
+
+inline void ScriptJob::Finish() {
+	AddRef(); // Released by AsyncTask::Dispatch.
+	if (sAsyncCompletions.Push(this))
+		PostMessage(sAsyncWindow, WM_APP, 0, 0);
+}
+
+static LRESULT CALLBACK AsyncWindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+	if (uMsg != WM_APP)
+		return DefWindowProc(hWnd, uMsg, wParam, lParam);
+	AsyncTask::Dispatch();
+	return 0;
+}
+
+// Creates the message-only window on first use.  The class is registered against this module,
+// so modules which each include this header get windows of their own.
+static HWND AsyncWindow() {
+	if (sAsyncWindow)
+		return sAsyncWindow;
+	HMODULE module = nullptr;
+	GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT
+		, (LPCTSTR)&AsyncWindowProc, &module);
+	WNDCLASSEX wc = { sizeof(wc) };
+	wc.lpfnWndProc = AsyncWindowProc;
+	wc.hInstance = module;
+	wc.lpszClassName = ASYNC_WINDOW_CLASS;
+	if (!RegisterClassEx(&wc) && GetLastError() != ERROR_CLASS_ALREADY_EXISTS)
+		return nullptr;
+	return sAsyncWindow = CreateWindowEx(0, ASYNC_WINDOW_CLASS, nullptr, 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr, module, nullptr);
+}
+
+// Queues aJob on the pool and returns its AsyncTask, or fails as a BIF does.  Takes the caller's
+// reference to aJob.  Must be called on the script thread.
+static void SubmitAsync(ResultToken& aResultToken, ScriptJob* aJob) {
+	AsyncTask* task = AsyncWindow() ? new AsyncTask(aJob) : nullptr;
+	if (task) {
+		aJob->task = task;
+		task->AddRef(); // Released by AsyncTask::Settle.
+		if (AsyncPool().Submit(aJob))
+			aResultToken.SetValue(task);
+		else {
+			aJob->task = nullptr;
+			task->Release(), task->Release();
+			task = nullptr;
+		}
+	}
+	aJob->Release();
+	if (!task) {
+		Object::Error(ExprTokenType(_T("Failed to start the task.")));
+		aResultToken.result = FAIL;
+	}
+}
+
+#endif // !AHK2_ASYNC_H
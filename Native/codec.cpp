@@ -0,0 +1,359 @@
+﻿#include "ahk2_types.h"
+#include "simd.h"
+
+// codec: Base64 (RFC 4648) and hex, without CryptStringToBinary's sizing round trip.
+//   c := Native.LoadModule('codec.dll')
+//   s := c.base64_encode(data, url := false, as_buffer := false)	; data is a Buffer, or a String whose UTF-16 bytes are encoded
+//   buf := c.base64_decode(text, url := false)	; text is a String or a Buffer of ASCII
+//   s := c.hex_encode(data, upper := false, as_buffer := false)	; as_buffer returns the ASCII in a Buffer instead of a String
+//   buf := c.hex_decode(text)
+//   enc := c.Base64Encoder(url := false), enc.Update(data), enc.Final()	; each returns a Buffer of ASCII
+//   dec := c.Base64Decoder(url := false), dec.Update(text), dec.Final()	; each returns a Buffer
+// Standard Base64 is padded with '=', URL-safe Base64 is not.  Decoding skips whitespace and
+// accepts input with or without padding.  Invalid input throws a ValueError.
+
+// Characters are converted to or from ASCII in blocks of this size, so String input and
+// output never needs a second full-size buffer.
+#define CODEC_CHUNK 4096
+
+static bool Fail(ResultToken& aResultToken, LPTSTR aMessage, LPTSTR aType = _T("ValueError")) {
+	Object::Error(ExprTokenType(aMessage), nullptr, aType);
+	aResultToken.result = FAIL;
+	return false;
+}
+
+// Gets the bytes of a Buffer, or of a String's UTF-16 text as Base64.Encode does.
+static bool ParamBytes(ExprTokenType& aParam, const BYTE*& aData, size_t& aSize, ResultToken& aResultToken) {
+	return BorrowBytes(aParam, aData, aSize) || Fail(aResultToken, _T("Parameter #1 must be a Buffer or String."), _T("TypeError"));
+}
+
+// Encoded text: a Buffer of ASCII, or a String which is narrowed to ASCII one chunk at a time.
+struct TextParam
+{
+	const char* bytes = nullptr;
+	LPCTSTR chars = nullptr;
+	size_t length = 0;
+
+	// Returns the next chunk of up to CODEC_CHUNK characters as ASCII, or nullptr at the end.
+	// A character above 0xFF becomes 0xFF, which is never valid.
+	const char* Next(char* aBuf, size_t& aPos, size_t& aLength) {
+		if (aPos >= length)
+			return nullptr;
+		aLength = length - aPos;
+		if (bytes) {
+			aPos = length;
+			return bytes;
+		}
+		if (aLength > CODEC_CHUNK)
+			aLength = CODEC_CHUNK;
+		for (size_t i = 0; i < aLength; ++i) {
+			TCHAR c = chars[aPos + i];
+			aBuf[i] = (char)(c > 0xFF ? 0xFF : c);
+		}
+		aPos += aLength;
+		return aBuf;
+	}
+};
+
+static bool ParamText(ExprTokenType& aParam, TextParam& aText, ResultToken& aResultToken) {
+	ExprTokenType val;
+	TokenToValue(aParam, val);
+	if (val.symbol == SYM_OBJECT && !_tcscmp(val.object->Type(), _T("Buffer"))) {
+		auto buf = static_cast<BufferObject*>(val.object);
+		aText.bytes = (const char*)buf->mData, aText.length = buf->mSize;
+		return true;
+	}
+	if (val.symbol == SYM_STRING) {
+		aText.chars = val.marker;
+		aText.length = val.marker_length == -1 ? _tcslen(val.marker) : val.marker_length;
+		return true;
+	}
+	return Fail(aResultToken, _T("Parameter #1 must be a String or Buffer."), _T("TypeError"));
+}
+
+static bool ParamFlag(ExprTokenType* aParam[], int aParamCount, int aIndex) {
+	return aParamCount > aIndex && aParam[aIndex]->symbol != SYM_MISSING && TokenToBool(*aParam[aIndex]);
+}
+
+// Sets the size of a Buffer which was allocated for the worst case.
+static bool ShrinkBuffer(BufferObject* aBuf, size_t aSize) {
+	if (aSize == aBuf->mSize)
+		return true;
+	ExprTokenType size;
+	size.SetValue((__int64)aSize);
+	return SetProperty(aBuf, _T("Size"), size);
+}
+
+static bool ReturnBuffer(ResultToken& aResultToken, BufferObject* aBuf, size_t aSize) {
+	if (!ShrinkBuffer(aBuf, aSize)) {
+		aBuf->Release();
+		aResultToken.result = FAIL;
+		return false;
+	}
+	aResultToken.SetValue(aBuf);
+	return true;
+}
+
+static size_t Base64Length(size_t aSize, bool aPad) {
+	return aSize / 3 * 4 + (aSize % 3 ? aPad ? 4 : aSize % 3 + 1 : 0);
+}
+
+static char* Base64EncodeAll(const BYTE* aSrc, size_t aSize, char* aDest, bool aUrl) {
+	size_t done = Base64Encode(aSrc, aSize, aDest, aUrl);
+	aDest += done / 3 * 4;
+	return done < aSize ? Base64EncodeTail(aSrc + done, aSize - done, aDest, aUrl, !aUrl) : aDest;
+}
+
+// Returns ASCII output as a Buffer, or widens it into a String.  aEncode(src, size, dest) encodes
+// aSize input bytes into aOutLength characters, and is called on chunks of aChunk input bytes.
+template<typename Encode>
+static void ReturnEncoded(ResultToken& aResultToken, const BYTE* aData, size_t aSize, size_t aOutLength
+	, size_t aChunk, bool aAsBuffer, Encode aEncode) {
+	if (aAsBuffer) {
+		BufferObject* buf;
+		if (!NewBuffer(aOutLength, buf)) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		aEncode(aData, aSize, (char*)buf->mData);
+		aResultToken.SetValue(buf);
+		return;
+	}
+	LPTSTR out = (LPTSTR)malloc((aOutLength + 1) * sizeof(TCHAR));
+	if (!out) {
+		Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+		return;
+	}
+	char chunk[CODEC_CHUNK * 2];
+	LPTSTR p = out;
+	for (size_t pos = 0; pos < aSize; pos += aChunk) {
+		size_t n = aSize - pos < aChunk ? aSize - pos : aChunk;
+		char* end = aEncode(aData + pos, n, chunk);
+		for (char* c = chunk; c < end; ++c)
+			*p++ = (BYTE)*c;
+	}
+	*p = '\0';
+	aResultToken.AcceptMem(out, aOutLength);
+}
+
+// base64_encode(data, url := false, as_buffer := false)
+BIF_DECL(base64_encode) {
+	const BYTE* data;
+	size_t size;
+	if (!ParamBytes(*aParam[0], data, size, aResultToken))
+		return;
+	bool url = ParamFlag(aParam, aParamCount, 1);
+	// Chunks are a multiple of 3 bytes, so only the last one has a tail.
+	ReturnEncoded(aResultToken, data, size, Base64Length(size, !url), CODEC_CHUNK / 4 * 3, ParamFlag(aParam, aParamCount, 2)
+		, [url](const BYTE* aSrc, size_t aSize, char* aDest) { return Base64EncodeAll(aSrc, aSize, aDest, url); });
+}
+
+// hex_encode(data, upper := false, as_buffer := false)
+BIF_DECL(hex_encode) {
+	const BYTE* data;
+	size_t size;
+	if (!ParamBytes(*aParam[0], data, size, aResultToken))
+		return;
+	bool upper = ParamFlag(aParam, aParamCount, 1);
+	ReturnEncoded(aResultToken, data, size, size * 2, CODEC_CHUNK / 2, ParamFlag(aParam, aParamCount, 2)
+		, [upper](const BYTE* aSrc, size_t aSize, char* aDest) { HexEncode(aSrc, aSize, aDest, upper); return aDest + aSize * 2; });
+}
+
+// Decodes all of aText into aBuf, which has room for the worst case, continuing from aState.
+static BYTE* Base64DecodeText(TextParam& aText, BYTE* aDest, Base64State& aState) {
+	char chunk[CODEC_CHUNK];
+	size_t pos = 0, length;
+	for (const char* src; aDest && (src = aText.Next(chunk, pos, length)); )
+		aDest = Base64Decode(src, src + length, aDest, aState);
+	return aDest;
+}
+
+static size_t Base64MaxDecoded(size_t aLength) {
+	return aLength / 4 * 3 + 3;
+}
+
+// base64_decode(text, url := false)
+BIF_DECL(base64_decode) {
+	TextParam text;
+	if (!ParamText(*aParam[0], text, aResultToken))
+		return;
+	Base64State state;
+	state.url = ParamFlag(aParam, aParamCount, 1);
+	BufferObject* buf;
+	if (!NewBuffer(Base64MaxDecoded(text.length), buf)) {
+		aResultToken.result = FAIL;
+		return;
+	}
+	BYTE* end = Base64DecodeText(text, (BYTE*)buf->mData, state);
+	if (!end || !(end = state.Finish(end))) {
+		buf->Release();
+		Fail(aResultToken, _T("Invalid base64 data."));
+		return;
+	}
+	ReturnBuffer(aResultToken, buf, end - (BYTE*)buf->mData);
+}
+
+// hex_decode(text)
+BIF_DECL(hex_decode) {
+	TextParam text;
+	if (!ParamText(*aParam[0], text, aResultToken))
+		return;
+	if (text.length & 1) {
+		Fail(aResultToken, _T("Invalid hex data."));
+		return;
+	}
+	BufferObject* buf;
+	if (!NewBuffer(text.length / 2, buf)) {
+		aResultToken.result = FAIL;
+		return;
+	}
+	// Chunks have an even length, so digit pairs are never split.
+	char chunk[CODEC_CHUNK];
+	size_t pos = 0, length;
+	BYTE* dest = (BYTE*)buf->mData;
+	for (const char* src; (src = text.Next(chunk, pos, length)); dest += length / 2)
+		if (!HexDecode(src, length / 2, dest)) {
+			buf->Release();
+			Fail(aResultToken, _T("Invalid hex data."));
+			return;
+		}
+	aResultToken.SetValue(buf);
+}
+
+class Base64Encoder : public Object {
+	BYTE mCarry[2];      // Bytes of an incomplete group.
+	size_t mCarryCount = 0;
+	bool mUrl = false;
+
+public:
+#define CLASSNAME "Base64Encoder"
+	IObject_Type_Impl;
+	static ObjectMember sMembers[];
+
+	void __New(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		mUrl = ParamFlag(aParam, aParamCount, 0);
+	}
+
+	// Update(data)
+	void Update(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		const BYTE* data;
+		size_t size;
+		BufferObject* buf;
+		if (!ParamBytes(*aParam[0], data, size, aResultToken))
+			return;
+		size_t total = mCarryCount + size;
+		if (!NewBuffer(total / 3 * 4, buf)) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		char* out = (char*)buf->mData;
+		if (mCarryCount && total >= 3) {
+			// Complete the carried group with the first new bytes.
+			BYTE group[3];
+			size_t take = 3 - mCarryCount;
+			memcpy(group, mCarry, mCarryCount);
+			memcpy(group + mCarryCount, data, take);
+			Base64Encode_Scalar(group, 3, out, mUrl);
+			out += 4, data += take, size -= take, mCarryCount = 0;
+		}
+		size_t done = mCarryCount ? 0 : Base64Encode(data, size, out, mUrl);
+		memcpy(mCarry + mCarryCount, data + done, size - done);
+		mCarryCount += size - done;
+		aResultToken.SetValue(buf);
+	}
+
+	// Final(): encodes any incomplete group, and the encoder can be used again.
+	void Final(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		BufferObject* buf;
+		if (!NewBuffer(Base64Length(mCarryCount, !mUrl), buf)) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		if (mCarryCount)
+			Base64EncodeTail(mCarry, mCarryCount, (char*)buf->mData, mUrl, !mUrl);
+		mCarryCount = 0;
+		aResultToken.SetValue(buf);
+	}
+};
+
+ObjectMember Base64Encoder::sMembers[] = {
+	Object_Method(__New, __New, 0, 0, 1),
+	Object_Method(Update, Update, 0, 1, 1),
+	Object_Method(Final, Final, 0, 0, 0),
+};
+#undef CLASSNAME
+
+class Base64Decoder : public Object {
+	Base64State mState;
+
+	void Reset() {
+		bool url = mState.url;
+		mState = Base64State();
+		mState.url = url;
+	}
+
+public:
+#define CLASSNAME "Base64Decoder"
+	IObject_Type_Impl;
+	static ObjectMember sMembers[];
+
+	void __New(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		mState.url = ParamFlag(aParam, aParamCount, 0);
+	}
+
+	// Update(text): a group split across calls is completed by the next one.
+	void Update(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		TextParam text;
+		BufferObject* buf;
+		if (!ParamText(*aParam[0], text, aResultToken))
+			return;
+		if (!NewBuffer(Base64MaxDecoded(text.length), buf)) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		BYTE* end = Base64DecodeText(text, (BYTE*)buf->mData, mState);
+		if (!end) {
+			buf->Release();
+			Reset();
+			Fail(aResultToken, _T("Invalid base64 data."));
+			return;
+		}
+		ReturnBuffer(aResultToken, buf, end - (BYTE*)buf->mData);
+	}
+
+	// Final(): the bytes of an unpadded final group, and the decoder can be used again.
+	void Final(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		BYTE tail[2];
+		BYTE* end = mState.Finish(tail);
+		BufferObject* buf;
+		Reset();
+		if (!end) {
+			Fail(aResultToken, _T("Invalid base64 data."));
+			return;
+		}
+		if (!NewBuffer(end - tail, buf)) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		memcpy(buf->mData, tail, end - tail);
+		aResultToken.SetValue(buf);
+	}
+};
+
+ObjectMember Base64Decoder::sMembers[] = {
+	Object_Method(__New, __New, 0, 0, 1),
+	Object_Method(Update, Update, 0, 1, 1),
+	Object_Method(Final, Final, 0, 0, 0),
+};
+#undef CLASSNAME
+
+ExportSymbol symbols[] = {
+	EXPORT_FUNC(base64_encode, 1, 3)
+	EXPORT_FUNC(base64_decode, 1, 2)
+	EXPORT_FUNC(hex_encode, 1, 3)
+	EXPORT_FUNC(hex_decode, 1, 1)
+	EXPORT_CLASS(Base64Encoder, 1)
+	EXPORT_CLASS(Base64Decoder, 1)
+};
+
+EXPORT_AHKMODULE(symbols)
@@ -0,0 +1,683 @@
+﻿#include "ahk2_types.h"
+
+// compress: streaming zstd and gzip with reusable contexts, for bodies which arrive or leave in chunks.
+//   z := Native.LoadModule('compress.dll')
+//   enc := z.Compressor(format := 'zstd', level?, dictionary?)	; format is 'zstd' or 'gzip'; dictionary is a Buffer (zstd only)
+//   out := enc.Update(data, size?)	; a Buffer of whatever output is ready, possibly empty
+//   out := enc.Flush()	; everything so far, so the receiver can decode it without waiting for Finish
+//   out := enc.Finish(data?, size?)	; the rest of the stream; the context is then ready for the next one
+//   dec := z.Decompressor(format := 'zstd', dictionary?)	; 'gzip' also accepts zlib streams
+//   out := dec.Update(data, size?), out := dec.Finish()	; Finish throws if the stream is incomplete
+//   enc.Reset(), dec.Reset()	; discards a partial stream
+//   buf := z.encode(data, size?, format := 'zstd', level?), buf := z.decode(data, size?, format := 'zstd')
+// data is a Buffer, a String (its UTF-16 bytes) or an address and size.  The output of each call
+// is written straight into the Buffer which is returned.  A context keeps its level, dictionary and
+// working memory between streams, and encode/decode reuse one context per format, so there is no
+// per-request setup.  The libraries are resolved from libzstd.dll and zlib1.dll, which the script
+// loads beforehand with #DllLoad; each is only needed for its own format.
+
+struct ZSTD_CCtx;
+struct ZSTD_DCtx;
+
+struct ZSTD_inBuffer
+{
+	const void* src;
+	size_t size;
+	size_t pos;
+};
+
+struct ZSTD_outBuffer
+{
+	void* dst;
+	size_t size;
+	size_t pos;
+};
+
+enum ZstdConstant
+{
+	ZSTD_c_compressionLevel = 100,
+	ZSTD_e_continue = 0,
+	ZSTD_e_flush = 1,
+	ZSTD_e_end = 2,
+	ZSTD_reset_session_only = 1
+};
+
+#define ZSTD_CONTENTSIZE_UNKNOWN (0ULL - 1)
+#define ZSTD_CONTENTSIZE_ERROR (0ULL - 2)
+
+// Must stay in the same order as sZstdNames.
+static struct ZstdApi
+{
+	ZSTD_CCtx* (__cdecl* createCCtx)();
+	size_t (__cdecl* freeCCtx)(ZSTD_CCtx*);
+	size_t (__cdecl* CCtx_setParameter)(ZSTD_CCtx*, int, int);
+	size_t (__cdecl* CCtx_loadDictionary)(ZSTD_CCtx*, const void*, size_t);
+	size_t (__cdecl* CCtx_reset)(ZSTD_CCtx*, int);
+	size_t (__cdecl* compressStream2)(ZSTD_CCtx*, ZSTD_outBuffer*, ZSTD_inBuffer*, int);
+	size_t (__cdecl* compressBound)(size_t);
+	ZSTD_DCtx* (__cdecl* createDCtx)();
+	size_t (__cdecl* freeDCtx)(ZSTD_DCtx*);
+	size_t (__cdecl* DCtx_loadDictionary)(ZSTD_DCtx*, const void*, size_t);
+	size_t (__cdecl* DCtx_reset)(ZSTD_DCtx*, int);
+	size_t (__cdecl* decompressStream)(ZSTD_DCtx*, ZSTD_outBuffer*, ZSTD_inBuffer*);
+	unsigned long long (__cdecl* getFrameContentSize)(const void*, size_t);
+	unsigned (__cdecl* isError)(size_t);
+	const char* (__cdecl* getErrorName)(size_t);
+} zstd;
+
+static const char* const sZstdNames[] = {
+	"ZSTD_createCCtx", "ZSTD_freeCCtx", "ZSTD_CCtx_setParameter", "ZSTD_CCtx_loadDictionary", "ZSTD_CCtx_reset",
+	"ZSTD_compressStream2", "ZSTD_compressBound", "ZSTD_createDCtx", "ZSTD_freeDCtx", "ZSTD_DCtx_loadDictionary",
+	"ZSTD_DCtx_reset", "ZSTD_decompressStream", "ZSTD_getFrameContentSize", "ZSTD_isError", "ZSTD_getErrorName"
+};
+
+// zlib's z_stream.  uLong is unsigned long, which is 32-bit on Windows but not elsewhere.
+struct z_stream
+{
+	const BYTE* next_in;
+	UINT avail_in;
+	unsigned long total_in;
+	BYTE* next_out;
+	UINT avail_out;
+	unsigned long total_out;
+	const char* msg;
+	void* state;
+	void* zalloc;
+	void* zfree;
+	void* opaque;
+	int data_type;
+	unsigned long adler;
+	unsigned long reserved;
+};
+
+enum ZlibConstant
+{
+	Z_OK = 0,
+	Z_STREAM_END = 1,
+	Z_NEED_DICT = 2,
+	Z_STREAM_ERROR = -2,
+	Z_DATA_ERROR = -3,
+	Z_MEM_ERROR = -4,
+	Z_BUF_ERROR = -5,
+	Z_NO_FLUSH = 0,
+	Z_SYNC_FLUSH = 2,
+	Z_FINISH = 4,
+	Z_DEFLATED = 8,
+	Z_DEFAULT_COMPRESSION = -1,
+	Z_DEFAULT_STRATEGY = 0
+};
+
+// deflateInit2_ and inflateInit2_ only compare the major version and the size of z_stream.
+#define ZLIB_VERSION "1.2.11"
+
+// Must stay in the same order as sZlibNames.
+static struct ZlibApi
+{
+	int (__cdecl* deflateInit2_)(z_stream*, int, int, int, int, int, const char*, int);
+	int (__cdecl* deflate)(z_stream*, int);
+	int (__cdecl* deflateReset)(z_stream*);
+	int (__cdecl* deflateEnd)(z_stream*);
+	unsigned long (__cdecl* deflateBound)(z_stream*, unsigned long);
+	int (__cdecl* inflateInit2_)(z_stream*, int, const char*, int);
+	int (__cdecl* inflate)(z_stream*, int);
+	int (__cdecl* inflateReset)(z_stream*);
+	int (__cdecl* inflateEnd)(z_stream*);
+} zlib;
+
+static const char* const sZlibNames[] = {
+	"deflateInit2_", "deflate", "deflateReset", "deflateEnd", "deflateBound",
+	"inflateInit2_", "inflate", "inflateReset", "inflateEnd"
+};
+
+enum CompressFormat
+{
+	FORMAT_ZSTD,
+	FORMAT_GZIP
+};
+
+static const struct
+{
+	LPCTSTR name;
+	LPCTSTR dll;
+	LPCTSTR alt_dll;
+	const char* const* names;
+	size_t count;
+	void* api;
+} sFormats[] = {
+	{ _T("zstd"), _T("libzstd.dll"), _T("zstd.dll"), sZstdNames, _countof(sZstdNames), &zstd },
+	{ _T("gzip"), _T("zlib1.dll"), _T("zlib.dll"), sZlibNames, _countof(sZlibNames), &zlib }
+};
+
+static bool LoadFormat(int aFormat) {
+	static_assert(sizeof(ZstdApi) == sizeof(sZstdNames) / sizeof(*sZstdNames) * sizeof(void*), "sZstdNames");
+	static_assert(sizeof(ZlibApi) == sizeof(sZlibNames) / sizeof(*sZlibNames) * sizeof(void*), "sZlibNames");
+	static bool sLoaded[_countof(sFormats)];
+	if (sLoaded[aFormat])
+		return true;
+	auto& f = sFormats[aFormat];
+	HMODULE mod = GetModuleHandle(f.dll);
+	if (!mod && !(mod = GetModuleHandle(f.alt_dll))) {
+		Object::Error(ExprTokenType(_T("The library is not loaded.")), (LPTSTR)f.dll, _T("OSError"));
+		return false;
+	}
+	auto fn = (FARPROC*)f.api;
+	for (size_t i = 0; i < f.count; ++i)
+		if (!(fn[i] = GetProcAddress(mod, f.names[i]))) {
+			TCHAR name[64];
+			size_t n = 0;
+			for (; f.names[i][n]; ++n)
+				name[n] = f.names[i][n];
+			name[n] = '\0';
+			Object::Error(ExprTokenType(_T("The library is missing a function.")), name, _T("OSError"));
+			return false;
+		}
+	return sLoaded[aFormat] = true;
+}
+
+static bool Fail(ResultToken& aResultToken, LPTSTR aMessage, LPTSTR aType = _T("ValueError"), LPTSTR aExtra = nullptr) {
+	Object::Error(ExprTokenType(aMessage), aExtra, aType);
+	aResultToken.result = FAIL;
+	return false;
+}
+
+// Fails with a message from the library, which is ASCII.
+static bool LibraryFail(ResultToken& aResultToken, const char* aMessage) {
+	TCHAR message[128];
+	size_t n = 0;
+	for (; aMessage && aMessage[n] && n < _countof(message) - 1; ++n)
+		message[n] = aMessage[n];
+	message[n] = '\0';
+	return Fail(aResultToken, n ? message : (LPTSTR)_T("Invalid compressed data."), _T("Error"));
+}
+
+// An omitted level: zstd's default of 3 or zlib's of 6.
+#define LEVEL_DEFAULT INT_MIN
+// The initial capacity of the output Buffer when no better estimate is known.
+#define STREAM_CHUNK 0x4000
+// The most a declared output size may reserve up front; a larger output grows as it is written.
+#define STREAM_HINT_MAX 0x4000000
+// Upper bounds on the output per input byte, past which a declared size is not believed:
+// deflate's limit, and a zstd RLE block (4 bytes for up to 128 KB).
+#define DEFLATE_MAX_RATIO 1032
+#define ZSTD_MAX_RATIO 32768
+// zlib counts in 32-bit units, so larger input is fed in pieces of this size.
+#define ZLIB_PIECE 0x40000000
+
+enum StreamMode
+{
+	MODE_CONTINUE,
+	MODE_FLUSH,
+	MODE_END
+};
+
+// Output of one call: a Buffer which grows as needed and is returned without copying.
+struct StreamOutput
+{
+	BufferObject* buf = nullptr;
+	size_t length = 0;
+
+	~StreamOutput() {
+		if (buf)
+			buf->Release();
+	}
+
+	// Ensures there are at least aFree bytes after length.
+	bool Reserve(size_t aFree) {
+		if (buf && buf->mSize - length >= aFree)
+			return true;
+		size_t size = buf ? buf->mSize * 2 : 0;
+		if (size < length + aFree)
+			size = length + aFree;
+		if (!buf)
+			return NewBuffer(size, buf);
+		ExprTokenType value;
+		value.SetValue((__int64)size);
+		return SetProperty(buf, _T("Size"), value) && buf->mSize >= size;
+	}
+
+	// Ensures there is some room, growing by at least STREAM_CHUNK once the Buffer is full.
+	bool Room() { return (buf && length < buf->mSize) || Reserve(STREAM_CHUNK); }
+
+	BYTE* Next() { return (BYTE*)buf->mData + length; }
+	size_t Free() { return buf->mSize - length; }
+
+	// Trims the Buffer to the output and returns it.
+	bool Return(ResultToken& aResultToken) {
+		if (!buf && !NewBuffer(0, buf)) {
+			aResultToken.result = FAIL;
+			return false;
+		}
+		if (buf->mSize != length) {
+			ExprTokenType value;
+			value.SetValue((__int64)length);
+			if (!SetProperty(buf, _T("Size"), value)) {
+				aResultToken.result = FAIL;
+				return false;
+			}
+		}
+		aResultToken.SetValue(buf);
+		buf = nullptr;
+		return true;
+	}
+};
+
+// A compression or decompression context of either format, reused from one stream to the next.
+class CompressStream
+{
+	int mFormat = FORMAT_ZSTD;
+	bool mCompress = false;
+	bool mReady = false;
+	// Decompression: the last frame or gzip member seen is complete.
+	bool mComplete = false;
+	union
+	{
+		ZSTD_CCtx* mCCtx;
+		ZSTD_DCtx* mDCtx;
+	};
+	z_stream mZ;
+
+	bool Compress(const BYTE* aData, size_t aSize, int aMode, StreamOutput& aOut, ResultToken& aResultToken) {
+		if (mFormat == FORMAT_ZSTD) {
+			static const int sDirective[] = { ZSTD_e_continue, ZSTD_e_flush, ZSTD_e_end };
+			ZSTD_inBuffer in = { aData, aSize, 0 };
+			for (;;) {
+				if (!aOut.Room())
+					return Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+				ZSTD_outBuffer out = { aOut.Next(), aOut.Free(), 0 };
+				size_t r = zstd.compressStream2(mCCtx, &out, &in, sDirective[aMode]);
+				aOut.length += out.pos;
+				if (zstd.isError(r))
+					return LibraryFail(aResultToken, zstd.getErrorName(r));
+				// With continue, output is only pending while the output was full.
+				if (aMode == MODE_CONTINUE ? in.pos == in.size && out.pos < out.size : !r)
+					return true;
+			}
+		}
+		static const int sFlush[] = { Z_NO_FLUSH, Z_SYNC_FLUSH, Z_FINISH };
+		size_t pos = 0;
+		do {
+			size_t piece = aSize - pos < ZLIB_PIECE ? aSize - pos : ZLIB_PIECE;
+			mZ.next_in = aData + pos, mZ.avail_in = (UINT)piece;
+			pos += piece;
+			int flush = pos == aSize ? sFlush[aMode] : Z_NO_FLUSH;
+			for (;;) {
+				if (!aOut.Room())
+					return Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+				UINT avail = aOut.Free() < ZLIB_PIECE ? (UINT)aOut.Free() : ZLIB_PIECE;
+				mZ.next_out = aOut.Next(), mZ.avail_out = avail;
+				int r = zlib.deflate(&mZ, flush);
+				aOut.length += avail - mZ.avail_out;
+				if (r == Z_STREAM_ERROR)
+					return LibraryFail(aResultToken, mZ.msg);
+				if (flush == Z_FINISH ? r == Z_STREAM_END : !mZ.avail_in && mZ.avail_out)
+					break;
+			}
+		} while (pos < aSize);
+		return true;
+	}
+
+	bool Decompress(const BYTE* aData, size_t aSize, StreamOutput& aOut, ResultToken& aResultToken) {
+		// Nothing is ever left pending between calls, so there is nothing to do without input.
+		if (!aSize)
+			return true;
+		if (mFormat == FORMAT_ZSTD) {
+			ZSTD_inBuffer in = { aData, aSize, 0 };
+			for (;;) {
+				if (!aOut.Room())
+					return Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+				ZSTD_outBuffer out = { aOut.Next(), aOut.Free(), 0 };
+				size_t r = zstd.decompressStream(mDCtx, &out, &in);
+				aOut.length += out.pos;
+				if (zstd.isError(r))
+					return LibraryFail(aResultToken, zstd.getErrorName(r));
+				mComplete = !r;
+				// 0 means the frame is complete and flushed; otherwise a full output may hold more.
+				if (in.pos == in.size && (!r || out.pos < out.size))
+					return true;
+			}
+		}
+		size_t pos = 0;
+		do {
+			size_t piece = aSize - pos < ZLIB_PIECE ? aSize - pos : ZLIB_PIECE;
+			mZ.next_in = aData + pos, mZ.avail_in = (UINT)piece;
+			pos += piece;
+			for (;;) {
+				if (!aOut.Room())
+					return Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+				UINT avail = aOut.Free() < ZLIB_PIECE ? (UINT)aOut.Free() : ZLIB_PIECE;
+				mZ.next_out = aOut.Next(), mZ.avail_out = avail;
+				const BYTE* next_in = mZ.next_in;
+				int r = zlib.inflate(&mZ, Z_NO_FLUSH);
+				aOut.length += avail - mZ.avail_out;
+				if (r == Z_STREAM_END) {
+					mComplete = true;
+					// Concatenated gzip members decode as one stream, as with gzip -d.
+					if (!mZ.avail_in)
+						break;
+					zlib.inflateReset(&mZ);
+					continue;
+				}
+				if (r != Z_OK && r != Z_BUF_ERROR)
+					return LibraryFail(aResultToken, r == Z_NEED_DICT ? "A dictionary is required." : mZ.msg);
+				if (mZ.next_in != next_in || mZ.avail_out != avail)
+					mComplete = false;
+				if (!mZ.avail_in && mZ.avail_out)
+					break;
+			}
+		} while (pos < aSize);
+		return true;
+	}
+
+public:
+	CompressStream() : mCCtx(nullptr) {}
+	~CompressStream() { Free(); }
+
+	void Free() {
+		if (!mReady)
+			return;
+		if (mFormat == FORMAT_ZSTD)
+			mCompress ? zstd.freeCCtx(mCCtx) : zstd.freeDCtx(mDCtx);
+		else
+			mCompress ? zlib.deflateEnd(&mZ) : zlib.inflateEnd(&mZ);
+		mReady = false;
+	}
+
+	bool Init(int aFormat, bool aCompress, int aLevel, const void* aDict, size_t aDictSize, ResultToken& aResultToken) {
+		Free();
+		if (!LoadFormat(aFormat)) {
+			aResultToken.result = FAIL;
+			return false;
+		}
+		mFormat = aFormat, mCompress = aCompress, mComplete = false;
+		if (aFormat == FORMAT_ZSTD) {
+			size_t r = 0;
+			if (aCompress) {
+				if (!(mCCtx = zstd.createCCtx()))
+					return Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+				mReady = true;
+				if (aLevel != LEVEL_DEFAULT)
+					r = zstd.CCtx_setParameter(mCCtx, ZSTD_c_compressionLevel, aLevel);
+				if (!zstd.isError(r) && aDict)
+					r = zstd.CCtx_loadDictionary(mCCtx, aDict, aDictSize);
+			}
+			else {
+				if (!(mDCtx = zstd.createDCtx()))
+					return Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+				mReady = true;
+				if (aDict)
+					r = zstd.DCtx_loadDictionary(mDCtx, aDict, aDictSize);
+			}
+			return !zstd.isError(r) || LibraryFail(aResultToken, zstd.getErrorName(r));
+		}
+		if (aDict)
+			return Fail(aResultToken, _T("Dictionaries are only supported by zstd."));
+		if (aLevel == LEVEL_DEFAULT)
+			aLevel = Z_DEFAULT_COMPRESSION;
+		else if (aLevel < 0 || aLevel > 9)
+			return Fail(aResultToken, _T("Invalid compression level."));
+		memset(&mZ, 0, sizeof(mZ));
+		// 15 + 16 writes a gzip header; 15 + 32 reads either a gzip or zlib header.
+		int r = aCompress
+			? zlib.deflateInit2_(&mZ, aLevel, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY, ZLIB_VERSION, sizeof(z_stream))
+			: zlib.inflateInit2_(&mZ, 15 + 32, ZLIB_VERSION, sizeof(z_stream));
+		if (r != Z_OK)
+			return r == Z_MEM_ERROR ? Fail(aResultToken, _T("Out of memory."), _T("MemoryError")) : LibraryFail(aResultToken, mZ.msg);
+		return mReady = true;
+	}
+
+	// Starts a new stream, keeping the parameters and dictionary.
+	void Reset() {
+		if (mFormat == FORMAT_ZSTD)
+			mCompress ? zstd.CCtx_reset(mCCtx, ZSTD_reset_session_only) : zstd.DCtx_reset(mDCtx, ZSTD_reset_session_only);
+		else
+			mCompress ? zlib.deflateReset(&mZ) : zlib.inflateReset(&mZ);
+		mComplete = false;
+	}
+
+	bool Update(const BYTE* aData, size_t aSize, StreamOutput& aOut, ResultToken& aResultToken, int aMode = MODE_CONTINUE) {
+		bool ok = mCompress ? Compress(aData, aSize, aMode, aOut, aResultToken) : Decompress(aData, aSize, aOut, aResultToken);
+		// A stream which failed cannot be continued.
+		if (!ok)
+			Reset();
+		return ok;
+	}
+
+	// Ends the stream, appending any remaining output, and resets for the next one.
+	bool Finish(const BYTE* aData, size_t aSize, StreamOutput& aOut, ResultToken& aResultToken) {
+		if (mCompress)
+			return Update(aData, aSize, aOut, aResultToken, MODE_END) && (Reset(), true);
+		if (aSize && !Update(aData, aSize, aOut, aResultToken))
+			return false;
+		bool complete = mComplete;
+		Reset();
+		return complete || Fail(aResultToken, _T("Incomplete compressed data."), _T("Error"));
+	}
+
+	// An estimate of the output of a whole stream of aSize bytes, for sizing the Buffer up front.
+	size_t OutputHint(const BYTE* aData, size_t aSize) {
+		if (mCompress)
+			return mFormat == FORMAT_ZSTD ? zstd.compressBound(aSize)
+				: aSize < ZLIB_PIECE ? zlib.deflateBound(&mZ, (unsigned long)aSize) : aSize + (aSize >> 8) + 64;
+		// The frame header and gzip trailer are untrusted input, so neither is believed past the
+		// format's ratio, nor allowed to reserve more than STREAM_HINT_MAX.
+		unsigned long long size;
+		if (mFormat == FORMAT_ZSTD) {
+			size = zstd.getFrameContentSize(aData, aSize);
+			if (size >= ZSTD_CONTENTSIZE_ERROR || size / ZSTD_MAX_RATIO > aSize)
+				return STREAM_CHUNK;
+		}
+		else {
+			// The gzip trailer gives the size modulo 2^32.
+			if (aSize < 18 || aData[0] != 0x1F || aData[1] != 0x8B)
+				return STREAM_CHUNK;
+			size = *(const UINT*)(aData + aSize - 4);
+			if (!size || size / DEFLATE_MAX_RATIO > aSize)
+				return STREAM_CHUNK;
+		}
+		return size < STREAM_HINT_MAX ? (size_t)size : STREAM_HINT_MAX;
+	}
+};
+
+static bool ParamFormat(ExprTokenType* aParam[], int aParamCount, int aIndex, int& aFormat, ResultToken& aResultToken) {
+	aFormat = FORMAT_ZSTD;
+	if (aParamCount <= aIndex || aParam[aIndex]->symbol == SYM_MISSING)
+		return true;
+	ExprTokenType val;
+	TokenToValue(*aParam[aIndex], val);
+	if (val.symbol != SYM_STRING)
+		return Fail(aResultToken, _T("Expected a format name."), _T("TypeError"));
+	for (int i = 0; i < _countof(sFormats); ++i)
+		if (!_tcsicmp(val.marker, sFormats[i].name)) {
+			aFormat = i;
+			return true;
+		}
+	return Fail(aResultToken, _T("Unknown compression format."), _T("ValueError"), val.marker);
+}
+
+static bool ParamLevel(ExprTokenType* aParam[], int aParamCount, int aIndex, int& aLevel, ResultToken& aResultToken) {
+	aLevel = LEVEL_DEFAULT;
+	if (aParamCount <= aIndex || aParam[aIndex]->symbol == SYM_MISSING)
+		return true;
+	ExprTokenType val;
+	TokenToValue(*aParam[aIndex], val);
+	if (val.symbol != SYM_INTEGER || val.value_int64 < INT_MIN || val.value_int64 > INT_MAX)
+		return Fail(aResultToken, _T("Invalid compression level."));
+	aLevel = (int)val.value_int64;
+	return true;
+}
+
+// As ParamData, but omitted data is empty.
+static bool OptionalData(ExprTokenType* aParam[], int aParamCount, const BYTE*& aData, size_t& aSize, ResultToken& aResultToken) {
+	aData = nullptr, aSize = 0;
+	if (!aParamCount || aParam[0]->symbol == SYM_MISSING)
+		return true;
+	return ParamData(aParam, aParamCount, aData, aSize, aResultToken);
+}
+
+// dictionary: a Buffer of a zstd dictionary, which the context copies.
+static bool ParamDictionary(ExprTokenType* aParam[], int aParamCount, int aIndex, const void*& aDict, size_t& aSize, ResultToken& aResultToken) {
+	aDict = nullptr, aSize = 0;
+	if (aParamCount <= aIndex || aParam[aIndex]->symbol == SYM_MISSING)
+		return true;
+	ExprTokenType val;
+	TokenToValue(*aParam[aIndex], val);
+	if (val.symbol != SYM_OBJECT || _tcscmp(val.object->Type(), _T("Buffer")))
+		return Fail(aResultToken, _T("Expected a Buffer."), _T("TypeError"));
+	auto buf = static_cast<BufferObject*>(val.object);
+	aDict = buf->mData, aSize = buf->mSize;
+	return true;
+}
+
+// Members shared by Compressor and Decompressor.
+class StreamObject : public Object {
+protected:
+	CompressStream mStream;
+	bool mReady = false;
+
+	bool Ready(ResultToken& aResultToken) {
+		return mReady || Fail(aResultToken, _T("The stream was not initialized."), _T("Error"));
+	}
+
+public:
+	// Update(data, size?)
+	void Update(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		const BYTE* data;
+		size_t size;
+		StreamOutput out;
+		if (Ready(aResultToken) && OptionalData(aParam, aParamCount, data, size, aResultToken)
+			&& mStream.Update(data, size, out, aResultToken))
+			out.Return(aResultToken);
+	}
+
+	// Finish(data?, size?)
+	void Finish(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		const BYTE* data;
+		size_t size;
+		StreamOutput out;
+		if (Ready(aResultToken) && OptionalData(aParam, aParamCount, data, size, aResultToken)
+			&& mStream.Finish(data, size, out, aResultToken))
+			out.Return(aResultToken);
+	}
+
+	void Reset(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		if (Ready(aResultToken))
+			mStream.Reset();
+	}
+};
+
+class Compressor : public StreamObject {
+public:
+#define CLASSNAME "Compressor"
+	IObject_Type_Impl;
+	static ObjectMember sMembers[];
+
+	void __New(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		int format, level;
+		const void* dict;
+		size_t dict_size;
+		mReady = ParamFormat(aParam, aParamCount, 0, format, aResultToken)
+			&& ParamLevel(aParam, aParamCount, 1, level, aResultToken)
+			&& ParamDictionary(aParam, aParamCount, 2, dict, dict_size, aResultToken)
+			&& mStream.Init(format, true, level, dict, dict_size, aResultToken);
+	}
+
+	// Flush(): the output of everything so far, ending on a boundary the receiver can decode up to.
+	void Flush(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		StreamOutput out;
+		if (Ready(aResultToken) && mStream.Update(nullptr, 0, out, aResultToken, MODE_FLUSH))
+			out.Return(aResultToken);
+	}
+};
+
+ObjectMember Compressor::sMembers[] = {
+	Object_Method(__New, __New, 0, 0, 3),
+	Object_Method(Update, Update, 0, 1, 2),
+	Object_Method(Flush, Flush, 0, 0, 0),
+	Object_Method(Finish, Finish, 0, 0, 2),
+	Object_Method(Reset, Reset, 0, 0, 0),
+};
+#undef CLASSNAME
+
+class Decompressor : public StreamObject {
+public:
+#define CLASSNAME "Decompressor"
+	IObject_Type_Impl;
+	static ObjectMember sMembers[];
+
+	void __New(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		int format;
+		const void* dict;
+		size_t dict_size;
+		mReady = ParamFormat(aParam, aParamCount, 0, format, aResultToken)
+			&& ParamDictionary(aParam, aParamCount, 1, dict, dict_size, aResultToken)
+			&& mStream.Init(format, false, LEVEL_DEFAULT, dict, dict_size, aResultToken);
+	}
+};
+
+ObjectMember Decompressor::sMembers[] = {
+	Object_Method(__New, __New, 0, 0, 2),
+	Object_Method(Update, Update, 0, 1, 2),
+	Object_Method(Finish, Finish, 0, 0, 2),
+	Object_Method(Reset, Reset, 0, 0, 0),
+};
+#undef CLASSNAME
+
+// Returns the shared context for one-shot calls.  These are never freed, since the libraries
+// may already be unloaded by the time static destructors run.
+static CompressStream* OneShotStream(int aFormat, bool aCompress, int aLevel, ResultToken& aResultToken) {
+	static CompressStream* sStreams[_countof(sFormats)][2];
+	static int sLevels[_countof(sFormats)];
+	auto& stream = sStreams[aFormat][aCompress];
+	if (stream && (!aCompress || sLevels[aFormat] == aLevel))
+		return stream;
+	if (!stream)
+		stream = new CompressStream;
+	if (!stream->Init(aFormat, aCompress, aLevel, nullptr, 0, aResultToken)) {
+		// Leave it uninitialized so the next call retries.
+		delete stream;
+		stream = nullptr;
+		return nullptr;
+	}
+	if (aCompress)
+		sLevels[aFormat] = aLevel;
+	return stream;
+}
+
+static void OneShot(ResultToken& aResultToken, ExprTokenType* aParam[], int aParamCount, bool aCompress) {
+	const BYTE* data;
+	size_t size;
+	int format, level = LEVEL_DEFAULT;
+	if (!OptionalData(aParam, aParamCount, data, size, aResultToken)
+		|| !ParamFormat(aParam, aParamCount, 2, format, aResultToken)
+		|| (aCompress && !ParamLevel(aParam, aParamCount, 3, level, aResultToken)))
+		return;
+	CompressStream* stream = OneShotStream(format, aCompress, level, aResultToken);
+	StreamOutput out;
+	if (!stream)
+		return;
+	if (!out.Reserve(stream->OutputHint(data, size))) {
+		Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+		return;
+	}
+	if (stream->Finish(data, size, out, aResultToken))
+		out.Return(aResultToken);
+}
+
+// encode(data, size?, format := 'zstd', level?)
+BIF_DECL(encode) {
+	OneShot(aResultToken, aParam, aParamCount, true);
+}
+
+// decode(data, size?, format := 'zstd')
+BIF_DECL(decode) {
+	OneShot(aResultToken, aParam, aParamCount, false);
+}
+
+ExportSymbol symbols[] = {
+	EXPORT_CLASS(Compressor, 3)
+	EXPORT_CLASS(Decompressor, 2)
+	EXPORT_FUNC(encode, 1, 4)
+	EXPORT_FUNC(decode, 1, 3)
+};
+
+EXPORT_AHKMODULE(symbols)
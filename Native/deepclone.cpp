@@ -0,0 +1,658 @@
+﻿#include "ahk2_types.h"
+
+// Native deepclone (see deepclone.ahk), structural equality and hashing of object graphs.
+//   dc := Native.LoadModule('deepclone.dll')
+//   copy := dc.deepclone(obj)
+//   same := dc.deepEqual(a, b)
+//   h := dc.deepHash(obj)	; an Integer; graphs which are deepEqual hash the same
+// As with deepclone.ahk, Object, Array and Map values are cloned, and so are Buffers; other
+// objects, such as class instances and Map keys, are shared.  Each object reached more than
+// once, including through a cycle, is cloned once.  The graph is walked with an explicit stack,
+// so nesting depth is not limited by the native stack.
+//
+// deepEqual compares the same kinds of objects by content: own fields (Object), items (Array),
+// keys and values (Map, which must have the same CaseSense) or bytes (Buffer).  Any other objects
+// must be the same object.  Values must also be of the same type, so 1 and 1.0 or "1" differ;
+// strings and Map keys compare case-sensitively, field names caselessly.  A pair of objects met
+// again while being compared, as through a cycle, is taken to be equal.
+//
+// deepHash is consistent with deepEqual for graphs without cycles.  An object met again on the
+// path from the root contributes only its type and size.
+
+// Maps an object to a value, by address.  Open addressing with linear probing.
+template<typename V>
+class PtrMap
+{
+	struct Slot
+	{
+		const void* key;
+		V value;
+	};
+	Slot* mSlots = nullptr;
+	size_t mMask = 0, mCount = 0;
+
+	static size_t Hash(const void* aKey) {
+		// Objects are at least 8-byte aligned; mix the bits above that.
+		UINT64 h = (UINT64)(size_t)aKey * 0x9E3779B97F4A7C15ULL;
+		return (size_t)(h >> 32 ^ h);
+	}
+
+	bool Grow() {
+		size_t capacity = mSlots ? (mMask + 1) * 2 : 256;
+		Slot* slots = (Slot*)calloc(capacity, sizeof(Slot));
+		if (!slots)
+			return false;
+		for (size_t i = 0; mSlots && i <= mMask; ++i) {
+			if (!mSlots[i].key)
+				continue;
+			size_t pos = Hash(mSlots[i].key) & (capacity - 1);
+			while (slots[pos].key)
+				pos = (pos + 1) & (capacity - 1);
+			slots[pos] = mSlots[i];
+		}
+		free(mSlots);
+		mSlots = slots, mMask = capacity - 1;
+		return true;
+	}
+
+public:
+	PtrMap() {}
+	PtrMap(const PtrMap&) = delete;
+	~PtrMap() { free(mSlots); }
+
+	V* Find(const void* aKey) {
+		if (!mSlots)
+			return nullptr;
+		for (size_t pos = Hash(aKey) & mMask; mSlots[pos].key; pos = (pos + 1) & mMask)
+			if (mSlots[pos].key == aKey)
+				return &mSlots[pos].value;
+		return nullptr;
+	}
+
+	// Adds a key which is not yet in the map.  Returns nullptr if out of memory.
+	V* Add(const void* aKey, V aValue) {
+		if ((mCount + 1) * 4 > (mMask + 1) * 3 || !mSlots)
+			if (!Grow())
+				return nullptr;
+		size_t pos = Hash(aKey) & mMask;
+		while (mSlots[pos].key)
+			pos = (pos + 1) & mMask;
+		mSlots[pos].key = aKey, mSlots[pos].value = aValue;
+		++mCount;
+		return &mSlots[pos].value;
+	}
+};
+
+// A growable stack of trivially copyable items.
+template<typename T>
+class Stack
+{
+	T* mItems = nullptr;
+	size_t mCount = 0, mCapacity = 0;
+public:
+	Stack() {}
+	Stack(const Stack&) = delete;
+	~Stack() { free(mItems); }
+
+	bool Push(const T& aItem) {
+		if (mCount == mCapacity) {
+			size_t capacity = mCapacity ? mCapacity * 2 : 64;
+			T* items = (T*)realloc(mItems, capacity * sizeof(T));
+			if (!items)
+				return false;
+			mItems = items, mCapacity = capacity;
+		}
+		mItems[mCount++] = aItem;
+		return true;
+	}
+	T& Top() { return mItems[mCount - 1]; }
+	T& At(size_t i) { return mItems[i]; }
+	T Pop() { return mItems[--mCount]; }
+	size_t Count() { return mCount; }
+	bool Empty() { return !mCount; }
+};
+
+enum NodeKind
+{
+	NODE_OTHER,
+	NODE_OBJECT,
+	NODE_ARRAY,
+	NODE_MAP,
+	NODE_BUFFER
+};
+
+static NodeKind KindOf(IObject* aObj) {
+	LPTSTR type = aObj->Type();
+	switch (*type)
+	{
+	case 'O': return _tcscmp(type, _T("Object")) ? NODE_OTHER : NODE_OBJECT;
+	case 'A': return _tcscmp(type, _T("Array")) ? NODE_OTHER : NODE_ARRAY;
+	case 'M': return _tcscmp(type, _T("Map")) ? NODE_OTHER : NODE_MAP;
+	case 'B': return _tcscmp(type, _T("Buffer")) ? NODE_OTHER : NODE_BUFFER;
+	default: return NODE_OTHER;
+	}
+}
+
+// The value slots of an Object, Array or Map, in order.  Map pairs and Object fields are both
+// Variants, so a node's slots are a run of equally sized structs.
+struct Slots
+{
+	BYTE* first;
+	size_t stride;
+	Object::index_t count;
+
+	Slots(IObject* aObj, NodeKind aKind) {
+		switch (aKind)
+		{
+		case NODE_ARRAY: {
+			auto arr = static_cast<Array*>(aObj);
+			first = (BYTE*)arr->mItem, stride = sizeof(Object::Variant), count = arr->mLength;
+			break;
+		}
+		case NODE_MAP: {
+			auto map = static_cast<Map*>(aObj);
+			first = (BYTE*)map->mItem, stride = sizeof(Map::Pair), count = map->mCount;
+			break;
+		}
+		case NODE_OBJECT: {
+			auto obj = static_cast<Object*>(aObj);
+			first = (BYTE*)obj->mFields.Value(), stride = sizeof(Object::FieldType), count = obj->mFields.Length();
+			break;
+		}
+		default:
+			first = nullptr, stride = 0, count = 0;
+		}
+	}
+
+	Object::Variant& operator[](Object::index_t i) { return *(Object::Variant*)(first + i * stride); }
+};
+
+static bool Fail(ResultToken& aResultToken, LPTSTR aMessage, LPTSTR aType = _T("Error")) {
+	Object::Error(ExprTokenType(aMessage), nullptr, aType);
+	aResultToken.result = FAIL;
+	return false;
+}
+
+//
+// deepclone
+//
+
+// Returns a new reference to a shallow copy of aObj, with the same slots and base.
+// The copy is visited with aKind's layout, so a Clone() override must return the same kind.
+// On failure, returns nullptr with an error thrown (by Clone() itself or here).
+static IObject* ShallowClone(IObject* aObj, NodeKind aKind) {
+	if (aKind == NODE_BUFFER) {
+		auto src = static_cast<BufferObject*>(aObj);
+		BufferObject* buf;
+		if (!NewBuffer(src->mSize, buf))
+			return nullptr;
+		memcpy(buf->mData, src->mData, src->mSize);
+		return buf;
+	}
+	TCHAR buf[MAX_NUMBER_SIZE];
+	ResultToken result;
+	result.InitResult(buf);
+	aObj->Invoke(result, IT_CALL, _T("Clone"), ExprTokenType(aObj), nullptr, 0);
+	if (result.Exited()) {
+		result.Free();
+		return nullptr;
+	}
+	if (result.symbol != SYM_OBJECT) {
+		result.Free();
+		Object::Error(ExprTokenType(_T("Clone() did not return an object.")), aObj->Type());
+		return nullptr;
+	}
+	if (KindOf(result.object) != aKind) {
+		result.object->Release();
+		Object::Error(ExprTokenType(_T("Clone() returned an object of a different type.")), aObj->Type(), _T("TypeError"));
+		return nullptr;
+	}
+	return result.object;
+}
+
+class GraphCloner
+{
+	struct Pending
+	{
+		IObject* clone;
+		NodeKind kind;
+	};
+	PtrMap<IObject*> mClones;
+	Stack<Pending> mPending;
+	bool mOutOfMemory = false;
+
+	// Returns a new reference to the clone of aObj, cloning it first if it was not yet.
+	IObject* CloneOf(IObject* aObj, NodeKind aKind) {
+		if (IObject** clone = mClones.Find(aObj)) {
+			(*clone)->AddRef();
+			return *clone;
+		}
+		IObject* clone = ShallowClone(aObj, aKind);
+		if (!clone)
+			return nullptr;
+		// Buffers have no slots to visit.
+		if (!mClones.Add(aObj, clone) || (aKind != NODE_BUFFER && !mPending.Push({ clone, aKind }))) {
+			clone->Release();
+			mOutOfMemory = true;
+			return nullptr;
+		}
+		return clone;
+	}
+
+public:
+	// Returns a new reference to the clone of aRoot, or nullptr on failure.
+	IObject* Clone(IObject* aRoot) {
+		NodeKind kind = KindOf(aRoot);
+		if (kind == NODE_OTHER) {
+			aRoot->AddRef();
+			return aRoot;
+		}
+		IObject* root = CloneOf(aRoot, kind);
+		if (!root)
+			return nullptr;
+		// Each clone starts with the same (counted) references as its original; they are
+		// replaced in place, so every clone stays reachable from root until it is complete.
+		while (!mPending.Empty()) {
+			Pending node = mPending.Pop();
+			Slots slots(node.clone, node.kind);
+			for (Object::index_t i = 0; i < slots.count; ++i) {
+				auto& slot = slots[i];
+				if (slot.symbol != SYM_OBJECT)
+					continue;
+				NodeKind child_kind = KindOf(slot.object);
+				if (child_kind == NODE_OTHER)
+					continue;
+				IObject* child = CloneOf(slot.object, child_kind);
+				if (!child) {
+					root->Release();
+					return nullptr;
+				}
+				slot.object->Release();
+				slot.object = child;
+			}
+		}
+		return root;
+	}
+
+	bool OutOfMemory() { return mOutOfMemory; }
+};
+
+// deepclone(obj)
+BIF_DECL(deepclone) {
+	ExprTokenType val;
+	TokenToValue(*aParam[0], val);
+	if (val.symbol != SYM_OBJECT) {
+		// Strings are immutable, so even those are returned as they are.
+		static_cast<ExprTokenType&>(aResultToken) = val;
+		return;
+	}
+	GraphCloner cloner;
+	if (IObject* clone = cloner.Clone(val.object))
+		aResultToken.SetValue(clone);
+	else if (cloner.OutOfMemory())
+		Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+	else aResultToken.result = FAIL;	// ShallowClone() or the Clone() it called has thrown.
+}
+
+//
+// deepEqual
+//
+
+static bool ScalarEqual(Object::Variant& a, Object::Variant& b) {
+	if (a.symbol != b.symbol)
+		return false;
+	switch (a.symbol)
+	{
+	case SYM_STRING:
+		return a.string.Length() == b.string.Length()
+			&& !memcmp(a.string.Value(), b.string.Value(), a.string.Length() * sizeof(TCHAR));
+	case SYM_INTEGER: return a.n_int64 == b.n_int64;
+	case SYM_FLOAT: return a.n_double == b.n_double;
+	case SYM_OBJECT: return a.object == b.object;
+	case SYM_DYNAMIC: return a.prop == b.prop;
+	default: return true;
+	}
+}
+
+class GraphComparer
+{
+	struct Pair
+	{
+		IObject* a, * b;
+		NodeKind kind;
+	};
+	// Pairs already compared or waiting to be, by a (then a linear search of its pairs).  Nearly
+	// every object of a is only ever paired with one of b, so the first is kept in the map.
+	struct Seen
+	{
+		IObject* b;
+		UINT more;	// Index + 1 of the next pair of the same a in mMore, or 0.
+	};
+	PtrMap<Seen> mSeen;
+	Stack<Seen> mMore;
+	Stack<Pair> mPending;
+	bool mOutOfMemory = false;
+
+	// Records the pair, and returns whether it was new.
+	bool AddPair(IObject* a, IObject* b) {
+		Seen* seen = mSeen.Find(a);
+		if (!seen)
+			return mSeen.Add(a, { b, 0 }) || (mOutOfMemory = true, false);
+		UINT last = 0;	// The index + 1 in mMore of the last pair seen, or 0 for the one in mSeen.
+		for (;;) {
+			if (seen->b == b)
+				return false;
+			if (!seen->more)
+				break;
+			seen = &mMore.At((last = seen->more) - 1);
+		}
+		// Pushing may move mMore, so seen is found again.
+		if (mMore.Count() >= UINT_MAX || !mMore.Push({ b, 0 }))
+			return mOutOfMemory = true, false;
+		(last ? mMore.At(last - 1) : *mSeen.Find(a)).more = (UINT)mMore.Count();
+		return true;
+	}
+
+	bool CompareValues(Object::Variant& a, Object::Variant& b) {
+		if (a.symbol != SYM_OBJECT || b.symbol != SYM_OBJECT || a.object == b.object)
+			return ScalarEqual(a, b);
+		return Compare(a.object, b.object);
+	}
+
+	bool CompareMaps(Map* a, Map* b) {
+		if (a->mCount != b->mCount || a->mKeyOffsetObject != b->mKeyOffsetObject || a->mKeyOffsetString != b->mKeyOffsetString
+			|| a->CaseFlags() != b->CaseFlags())
+			return false;
+		// Keys are kept sorted within each type, so equal maps have them in the same order.
+		for (Object::index_t i = 0; i < a->mCount; ++i) {
+			auto& pa = a->mItem[i], & pb = b->mItem[i];
+			if (i < a->mKeyOffsetString ? pa.key.i != pb.key.i : _tcscmp(pa.key.s, pb.key.s))
+				return false;
+			if (!CompareValues(pa, pb))
+				return false;
+		}
+		return true;
+	}
+
+	bool CompareFields(Object* a, Object* b) {
+		auto count = a->mFields.Length();
+		if (count != b->mFields.Length())
+			return false;
+		auto fields = a->mFields.Value(), other = b->mFields.Value();
+		for (Object::index_t i = 0; i < count; ++i) {
+			// Fields are sorted by name, unless the host keeps them in insertion order.
+			auto field = !_tcsicmp(fields[i].name, other[i].name) ? &other[i] : b->FindField(fields[i].name);
+			if (!field || !CompareValues(fields[i], *field))
+				return false;
+		}
+		return true;
+	}
+
+public:
+	// Compares a pair of objects, or queues it to compare their contents.
+	bool Compare(IObject* a, IObject* b) {
+		if (a == b)
+			return true;
+		NodeKind kind = KindOf(a);
+		if (kind == NODE_OTHER || kind != KindOf(b))
+			return false;
+		if (kind == NODE_BUFFER) {
+			auto ba = static_cast<BufferObject*>(a), bb = static_cast<BufferObject*>(b);
+			return ba->mSize == bb->mSize && !memcmp(ba->mData, bb->mData, ba->mSize);
+		}
+		if (!AddPair(a, b))
+			return !mOutOfMemory;
+		return mPending.Push({ a, b, kind }) || (mOutOfMemory = true, false);
+	}
+
+	// Compares the queued pairs and everything they reach.
+	bool Run() {
+		while (!mPending.Empty()) {
+			Pair pair = mPending.Pop();
+			bool equal;
+			switch (pair.kind)
+			{
+			case NODE_ARRAY: {
+				auto a = static_cast<Array*>(pair.a), b = static_cast<Array*>(pair.b);
+				equal = a->mLength == b->mLength;
+				for (Object::index_t i = 0; equal && i < a->mLength; ++i)
+					equal = CompareValues(a->mItem[i], b->mItem[i]);
+				break;
+			}
+			case NODE_MAP:
+				equal = CompareMaps(static_cast<Map*>(pair.a), static_cast<Map*>(pair.b));
+				break;
+			default:
+				equal = CompareFields(static_cast<Object*>(pair.a), static_cast<Object*>(pair.b));
+			}
+			if (!equal)
+				return false;
+		}
+		return true;
+	}
+
+	bool OutOfMemory() { return mOutOfMemory; }
+};
+
+// deepEqual(a, b)
+BIF_DECL(deepEqual) {
+	ExprTokenType a, b;
+	TokenToValue(*aParam[0], a);
+	TokenToValue(*aParam[1], b);
+	if (a.symbol != SYM_OBJECT || b.symbol != SYM_OBJECT) {
+		bool equal = a.symbol == b.symbol;
+		if (equal && a.symbol == SYM_STRING) {
+			size_t la = a.marker_length == -1 ? _tcslen(a.marker) : a.marker_length;
+			size_t lb = b.marker_length == -1 ? _tcslen(b.marker) : b.marker_length;
+			equal = la == lb && !memcmp(a.marker, b.marker, la * sizeof(TCHAR));
+		}
+		else if (equal)
+			equal = a.symbol == SYM_FLOAT ? a.value_double == b.value_double : a.value_int64 == b.value_int64;
+		aResultToken.SetValue((__int64)equal);
+		return;
+	}
+	GraphComparer comparer;
+	bool equal = comparer.Compare(a.object, b.object) && comparer.Run();
+	if (comparer.OutOfMemory())
+		Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+	else aResultToken.SetValue((__int64)equal);
+}
+
+//
+// deepHash
+//
+
+#define HASH_PRIME_1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME_2 0xC2B2AE3D27D4EB4FULL
+
+static inline UINT64 Mix(UINT64 h) {
+	h ^= h >> 33, h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33, h *= 0xC4CEB9FE1A85EC53ULL;
+	return h ^ h >> 33;
+}
+
+static UINT64 HashBytes(const void* aData, size_t aSize) {
+	const BYTE* p = (const BYTE*)aData;
+	UINT64 h = aSize * HASH_PRIME_1, v;
+	for (; aSize >= 8; p += 8, aSize -= 8) {
+		memcpy(&v, p, 8);
+		h = _rotl64(h ^ v * HASH_PRIME_2, 31) * HASH_PRIME_1;
+	}
+	if (aSize) {
+		v = 0;
+		memcpy(&v, p, aSize);
+		h = _rotl64(h ^ v * HASH_PRIME_2, 31) * HASH_PRIME_1;
+	}
+	return Mix(h);
+}
+
+// Field names are caseless.
+static UINT64 HashName(LPCTSTR aName) {
+	UINT64 h = 0xCBF29CE484222325ULL;
+	for (; *aName; ++aName) {
+		TCHAR c = *aName;
+		c = (unsigned)c < 128 ? (c <= 'Z' && c >= 'A' ? c + 32 : c) : (TCHAR)_totlower(c);
+		h = (h ^ (_TUCHAR)c) * 0x100000001B3ULL;
+	}
+	return Mix(h);
+}
+
+// The hash of an object met again on the path from the root.
+static inline UINT64 BackReferenceHash(NodeKind aKind, Object::index_t aCount) {
+	return Mix((UINT64)aKind << 32 ^ aCount ^ HASH_PRIME_2);
+}
+
+static UINT64 StringHash(LPCTSTR aStr, size_t aLength) {
+	return HashBytes(aStr, aLength * sizeof(TCHAR)) ^ SYM_STRING;
+}
+
+static UINT64 NumberHash(SymbolType aSymbol, __int64 aValue) {
+	if (aSymbol == SYM_INTEGER)
+		return Mix(aValue ^ HASH_PRIME_1);
+	if (aSymbol != SYM_FLOAT)
+		return aSymbol;
+	// -0.0 == 0.0, so both hash the same.
+	double d;
+	memcpy(&d, &aValue, sizeof(d));
+	if (!d)
+		aValue = 0;
+	return Mix(aValue ^ HASH_PRIME_2);
+}
+
+static UINT64 ScalarHash(Object::Variant& aValue) {
+	switch (aValue.symbol)
+	{
+	case SYM_STRING: return StringHash(aValue.string.Value(), aValue.string.Length());
+	case SYM_OBJECT: return Mix((UINT64)(size_t)aValue.object);
+	case SYM_DYNAMIC: return Mix((UINT64)(size_t)aValue.prop ^ SYM_DYNAMIC);
+	default: return NumberHash(aValue.symbol, aValue.n_int64);
+	}
+}
+
+class GraphHasher
+{
+	struct Frame
+	{
+		IObject* obj;
+		Slots slots;
+		NodeKind kind;
+		Object::index_t next;
+		UINT64 acc;
+	};
+	struct Node
+	{
+		UINT64 hash;
+		bool done;	// Otherwise, it is on the path from the root.
+	};
+	PtrMap<Node> mNodes;
+	Stack<Frame> mFrames;
+	bool mOutOfMemory = false;
+
+	// Adds the hash of the value in slot aIndex.  Arrays are ordered; fields and pairs are
+	// summed, so that fields kept in insertion order hash as if sorted.
+	void Combine(Frame& aFrame, Object::index_t aIndex, UINT64 aHash) {
+		switch (aFrame.kind)
+		{
+		case NODE_ARRAY:
+			aFrame.acc = _rotl64(aFrame.acc ^ aHash, 27) * HASH_PRIME_1;
+			break;
+		case NODE_OBJECT:
+			aFrame.acc += Mix(HashName(static_cast<Object*>(aFrame.obj)->mFields.Value()[aIndex].name) ^ aHash * HASH_PRIME_2);
+			break;
+		default: {
+			auto map = static_cast<Map*>(aFrame.obj);
+			auto& pair = map->mItem[aIndex];
+			UINT64 key = aIndex < map->mKeyOffsetObject ? Mix(pair.key.i ^ HASH_PRIME_1)
+				: aIndex < map->mKeyOffsetString ? Mix((UINT64)(size_t)pair.key.p)
+				: HashBytes(pair.key.s, _tcslen(pair.key.s) * sizeof(TCHAR));
+			aFrame.acc += Mix(key ^ aHash * HASH_PRIME_2);
+		}
+		}
+	}
+
+	UINT64 Finish(Frame& aFrame) {
+		UINT64 h = aFrame.acc ^ (UINT64)aFrame.kind << 32 ^ aFrame.slots.count;
+		if (aFrame.kind == NODE_MAP)
+			h ^= (UINT64)static_cast<Map*>(aFrame.obj)->CaseFlags() << 40;
+		return Mix(h);
+	}
+
+	bool Enter(IObject* aObj, NodeKind aKind) {
+		if (!mNodes.Add(aObj, { 0, false }) || !mFrames.Push({ aObj, Slots(aObj, aKind), aKind, 0, 0 }))
+			return mOutOfMemory = true, false;
+		return true;
+	}
+
+public:
+	// Returns the hash of aRoot, or 0 with OutOfMemory() set.
+	UINT64 Hash(IObject* aRoot) {
+		NodeKind kind = KindOf(aRoot);
+		if (kind == NODE_BUFFER)
+			return HashBytes(static_cast<BufferObject*>(aRoot)->mData, static_cast<BufferObject*>(aRoot)->mSize) ^ NODE_BUFFER;
+		if (kind == NODE_OTHER)
+			return Mix((UINT64)(size_t)aRoot);
+		if (!Enter(aRoot, kind))
+			return 0;
+		for (;;) {
+			Frame& frame = mFrames.Top();
+			if (frame.next < frame.slots.count) {
+				Object::index_t index = frame.next++;
+				auto& value = frame.slots[index];
+				UINT64 h;
+				NodeKind child_kind = value.symbol == SYM_OBJECT ? KindOf(value.object) : NODE_OTHER;
+				if (child_kind == NODE_BUFFER) {
+					auto buf = static_cast<BufferObject*>(value.object);
+					h = HashBytes(buf->mData, buf->mSize) ^ NODE_BUFFER;
+				}
+				else if (child_kind == NODE_OTHER)
+					h = ScalarHash(value);
+				else if (Node* node = mNodes.Find(value.object))
+					h = node->done ? node->hash : BackReferenceHash(child_kind, Slots(value.object, child_kind).count);
+				else {
+					// frame is invalidated by the push.
+					if (!Enter(value.object, child_kind))
+						return 0;
+					continue;
+				}
+				Combine(frame, index, h);
+				continue;
+			}
+			UINT64 h = Finish(frame);
+			*mNodes.Find(frame.obj) = { h, true };
+			mFrames.Pop();
+			if (mFrames.Empty())
+				return h;
+			Frame& parent = mFrames.Top();
+			Combine(parent, parent.next - 1, h);
+		}
+	}
+
+	bool OutOfMemory() { return mOutOfMemory; }
+};
+
+// deepHash(value)
+BIF_DECL(deepHash) {
+	ExprTokenType val;
+	TokenToValue(*aParam[0], val);
+	if (val.symbol == SYM_STRING) {
+		aResultToken.SetValue((__int64)StringHash(val.marker, val.marker_length == -1 ? _tcslen(val.marker) : val.marker_length));
+		return;
+	}
+	if (val.symbol != SYM_OBJECT) {
+		aResultToken.SetValue((__int64)NumberHash(val.symbol, val.value_int64));
+		return;
+	}
+	GraphHasher hasher;
+	UINT64 h = hasher.Hash(val.object);
+	if (hasher.OutOfMemory())
+		Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+	else aResultToken.SetValue((__int64)h);
+}
+
+ExportSymbol symbols[] = {
+	EXPORT_FUNC(deepclone, 1, 1)
+	EXPORT_FUNC(deepEqual, 2, 2)
+	EXPORT_FUNC(deepHash, 1, 1)
+};
+
+EXPORT_AHKMODULE(symbols)
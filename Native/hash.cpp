@@ -0,0 +1,1266 @@
+﻿#include "ahk2_types.h"
+#include "simd.h"
+#include "async.h"
+#include <new>
+
+// hash: incremental CRC32C, xxHash3 (64-bit), BLAKE3 and SHA-256, without a CryptoAPI provider per call.
+//   h := Native.LoadModule('hash.dll')
+//   ctx := h.Hasher(algorithm)	; 'crc32c', 'xxh3', 'blake3' or 'sha256'
+//   ctx.Update(data, size?)	; data is a Buffer, a String whose UTF-16 bytes are hashed, or an address and size
+//   digest := ctx.Digest(as_buffer := false)	; lowercase hex, or the bytes in a Buffer; more data may follow
+//   ctx.Reset()
+//   digest := h.hash_file(path, algorithm, as_buffer := false)	; the file is mapped into memory, not read
+//   digests := h.hash_many(algorithm, buffers, as_buffer := false)	; an Array of digests, one per Buffer or String
+//   task := h.hash_file_async(path, algorithm, as_buffer := false)	; an AsyncTask; task.OnCompleted(t => t.Result), task.Cancel()
+//   h.async_limit(limit?)	; how many background jobs may run at once; returns the previous limit
+// CRC32C uses SSE4.2 and SHA-256 the SHA extensions where available, xxHash3 and BLAKE3 use AVX2.
+// BLAKE3 hashes large inputs on the thread pool, and hash_many spreads the buffers over it.
+// CRC32C and xxHash3 digests are big-endian, as printed by other tools.
+
+#define HASH_MAX_DIGEST 32
+// Bytes of a file mapped at a time; a multiple of the allocation granularity.
+#define HASH_FILE_VIEW (64 << 20)
+// hash_many uses the thread pool when the buffers hold at least this many bytes in total.
+#define HASH_PARALLEL_THRESHOLD (1 << 20)
+
+static const UINT32 Sha256IV[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static inline UINT32 Read32(const BYTE* aPtr) {
+	UINT32 v;
+	memcpy(&v, aPtr, sizeof(v));
+	return v;
+}
+
+static inline UINT64 Read64(const BYTE* aPtr) {
+	UINT64 v;
+	memcpy(&v, aPtr, sizeof(v));
+	return v;
+}
+
+//
+// CRC32C (Castagnoli).  The SSE4.2 version runs three streams at once to hide the latency of
+// the crc32 instruction, then shifts the first two CRCs over the following blocks with tables.
+//
+
+#define CRC32C_POLY 0x82f63b78
+#define CRC32C_LONG 8192
+#define CRC32C_SHORT 256
+
+static UINT32 Gf2MatrixTimes(const UINT32* aMat, UINT32 aVec) {
+	UINT32 sum = 0;
+	for (; aVec; aVec >>= 1, ++aMat)
+		if (aVec & 1)
+			sum ^= *aMat;
+	return sum;
+}
+
+static void Gf2MatrixSquare(UINT32* aSquare, const UINT32* aMat) {
+	for (int n = 0; n < 32; ++n)
+		aSquare[n] = Gf2MatrixTimes(aMat, aMat[n]);
+}
+
+struct Crc32cTables
+{
+	UINT32 bytes[256];             // For the scalar version.
+	UINT32 long_shift[4][256];     // Applies CRC32C_LONG zero bytes.
+	UINT32 short_shift[4][256];    // Applies CRC32C_SHORT zero bytes.
+
+	Crc32cTables() {
+		for (UINT32 n = 0; n < 256; ++n) {
+			UINT32 crc = n;
+			for (int k = 0; k < 8; ++k)
+				crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+			bytes[n] = crc;
+		}
+		ZerosTable(long_shift, CRC32C_LONG);
+		ZerosTable(short_shift, CRC32C_SHORT);
+	}
+
+	// Builds the operator which applies aLength zero bytes to a CRC, by repeated squaring.
+	static void ZerosOperator(UINT32* aEven, size_t aLength) {
+		UINT32 odd[32], row = 1;
+		odd[0] = CRC32C_POLY;
+		for (int n = 1; n < 32; ++n, row <<= 1)
+			odd[n] = row;
+		Gf2MatrixSquare(aEven, odd);   // Two zero bits.
+		Gf2MatrixSquare(odd, aEven);   // Four zero bits.
+		for (;;) {
+			Gf2MatrixSquare(aEven, odd);
+			if (!(aLength >>= 1))
+				return;
+			Gf2MatrixSquare(odd, aEven);
+			if (!(aLength >>= 1))
+				break;
+		}
+		memcpy(aEven, odd, sizeof(odd));
+	}
+
+	static void ZerosTable(UINT32 aTable[4][256], size_t aLength) {
+		UINT32 op[32];
+		ZerosOperator(op, aLength);
+		for (UINT32 n = 0; n < 256; ++n)
+			for (int k = 0; k < 4; ++k)
+				aTable[k][n] = Gf2MatrixTimes(op, n << (k * 8));
+	}
+};
+
+static const Crc32cTables& Crc32cTable() {
+	static Crc32cTables sTables;
+	return sTables;
+}
+
+static UINT32 Crc32c_Scalar(UINT32 aCrc, const BYTE* aData, size_t aSize) {
+	const UINT32* table = Crc32cTable().bytes;
+	aCrc = ~aCrc;
+	while (aSize--)
+		aCrc = table[(aCrc ^ *aData++) & 0xFF] ^ (aCrc >> 8);
+	return ~aCrc;
+}
+
+#ifdef _WIN64
+typedef unsigned __int64 CrcWord;
+#define _mm_crc32_word _mm_crc32_u64
+#else
+typedef unsigned int CrcWord;
+#define _mm_crc32_word _mm_crc32_u32
+#endif
+
+static inline UINT32 Crc32cShift(const UINT32 aTable[4][256], UINT32 aCrc) {
+	return aTable[0][aCrc & 0xFF] ^ aTable[1][(aCrc >> 8) & 0xFF] ^ aTable[2][(aCrc >> 16) & 0xFF] ^ aTable[3][aCrc >> 24];
+}
+
+// Hashes blocks of three streams while at least 3 * aBlock bytes remain.
+static inline void Crc32cStreams_SSE42(CrcWord& aCrc, const BYTE*& aData, size_t& aSize, size_t aBlock, const UINT32 aShift[4][256]) {
+	for (; aSize >= aBlock * 3; aSize -= aBlock * 3) {
+		CrcWord crc1 = 0, crc2 = 0;
+		for (const BYTE* end = aData + aBlock; aData < end; aData += sizeof(CrcWord)) {
+			aCrc = _mm_crc32_word(aCrc, *(const CrcWord*)aData);
+			crc1 = _mm_crc32_word(crc1, *(const CrcWord*)(aData + aBlock));
+			crc2 = _mm_crc32_word(crc2, *(const CrcWord*)(aData + aBlock * 2));
+		}
+		aCrc = Crc32cShift(aShift, (UINT32)aCrc) ^ (UINT32)crc1;
+		aCrc = Crc32cShift(aShift, (UINT32)aCrc) ^ (UINT32)crc2;
+		aData += aBlock * 2;
+	}
+}
+
+static UINT32 Crc32c_SSE42(UINT32 aCrc, const BYTE* aData, size_t aSize) {
+	auto& tables = Crc32cTable();
+	CrcWord crc = ~aCrc;
+	for (; aSize && ((size_t)aData & (sizeof(CrcWord) - 1)); --aSize)
+		crc = _mm_crc32_u8((UINT32)crc, *aData++);
+	Crc32cStreams_SSE42(crc, aData, aSize, CRC32C_LONG, tables.long_shift);
+	Crc32cStreams_SSE42(crc, aData, aSize, CRC32C_SHORT, tables.short_shift);
+	for (; aSize >= sizeof(CrcWord); aSize -= sizeof(CrcWord), aData += sizeof(CrcWord))
+		crc = _mm_crc32_word(crc, *(const CrcWord*)aData);
+	for (; aSize; --aSize)
+		crc = _mm_crc32_u8((UINT32)crc, *aData++);
+	return ~(UINT32)crc;
+}
+
+typedef UINT32 (*Crc32cType)(UINT32 aCrc, const BYTE* aData, size_t aSize);
+
+static Crc32cType Crc32c = CpuFeatures() & CPU_SSE42 ? Crc32c_SSE42 : Crc32c_Scalar;
+
+//
+// SHA-256 (FIPS 180-4).
+//
+
+static const UINT32 Sha256K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void Sha256Blocks_Scalar(UINT32 aState[8], const BYTE* aData, size_t aBlocks) {
+	for (; aBlocks; --aBlocks, aData += 64) {
+		UINT32 w[64], s[8];
+		for (int i = 0; i < 16; ++i)
+			w[i] = _byteswap_ulong(Read32(aData + i * 4));
+		for (int i = 16; i < 64; ++i) {
+			UINT32 s0 = _rotr(w[i - 15], 7) ^ _rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			UINT32 s1 = _rotr(w[i - 2], 17) ^ _rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+		memcpy(s, aState, sizeof(s));
+		for (int i = 0; i < 64; ++i) {
+			UINT32 t1 = s[7] + (_rotr(s[4], 6) ^ _rotr(s[4], 11) ^ _rotr(s[4], 25)) + ((s[4] & s[5]) ^ (~s[4] & s[6])) + Sha256K[i] + w[i];
+			UINT32 t2 = (_rotr(s[0], 2) ^ _rotr(s[0], 13) ^ _rotr(s[0], 22)) + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+			s[7] = s[6], s[6] = s[5], s[5] = s[4], s[4] = s[3] + t1;
+			s[3] = s[2], s[2] = s[1], s[1] = s[0], s[0] = t1 + t2;
+		}
+		for (int i = 0; i < 8; ++i)
+			aState[i] += s[i];
+	}
+}
+
+// Four rounds with the SHA extensions, which keep the state as ABEF and CDGH.
+static inline void Sha256Rounds_SHA(__m128i& aState0, __m128i& aState1, __m128i aMsg, int aGroup) {
+	aMsg = _mm_add_epi32(aMsg, _mm_loadu_si128((const __m128i*)(Sha256K + aGroup * 4)));
+	aState1 = _mm_sha256rnds2_epu32(aState1, aState0, aMsg);
+	aState0 = _mm_sha256rnds2_epu32(aState0, aState1, _mm_shuffle_epi32(aMsg, 0x0E));
+}
+
+// The next four message words, from the previous sixteen (oldest first).
+static inline __m128i Sha256Schedule_SHA(__m128i aW0, __m128i aW1, __m128i aW2, __m128i aW3) {
+	return _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(aW0, aW1), _mm_alignr_epi8(aW3, aW2, 4)), aW3);
+}
+
+static void Sha256Blocks_SHA(UINT32 aState[8], const BYTE* aData, size_t aBlocks) {
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)aState), 0xB1);          // CDAB
+	__m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(aState + 4)), 0x1B); // EFGH
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);                                       // ABEF
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);                                              // CDGH
+	for (; aBlocks; --aBlocks, aData += 64) {
+		__m128i abef = state0, cdgh = state1;
+		__m128i w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)aData), bswap);
+		__m128i w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(aData + 16)), bswap);
+		__m128i w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(aData + 32)), bswap);
+		__m128i w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(aData + 48)), bswap);
+		Sha256Rounds_SHA(state0, state1, w0, 0);
+		Sha256Rounds_SHA(state0, state1, w1, 1);
+		Sha256Rounds_SHA(state0, state1, w2, 2);
+		Sha256Rounds_SHA(state0, state1, w3, 3);
+		for (int g = 4; g < 16; g += 4) {
+			w0 = Sha256Schedule_SHA(w0, w1, w2, w3);
+			Sha256Rounds_SHA(state0, state1, w0, g);
+			w1 = Sha256Schedule_SHA(w1, w2, w3, w0);
+			Sha256Rounds_SHA(state0, state1, w1, g + 1);
+			w2 = Sha256Schedule_SHA(w2, w3, w0, w1);
+			Sha256Rounds_SHA(state0, state1, w2, g + 2);
+			w3 = Sha256Schedule_SHA(w3, w0, w1, w2);
+			Sha256Rounds_SHA(state0, state1, w3, g + 3);
+		}
+		state0 = _mm_add_epi32(state0, abef);
+		state1 = _mm_add_epi32(state1, cdgh);
+	}
+	tmp = _mm_shuffle_epi32(state0, 0x1B);     // FEBA
+	state1 = _mm_shuffle_epi32(state1, 0xB1);  // DCHG
+	_mm_storeu_si128((__m128i*)aState, _mm_blend_epi16(tmp, state1, 0xF0));     // DCBA
+	_mm_storeu_si128((__m128i*)(aState + 4), _mm_alignr_epi8(state1, tmp, 8));  // HGFE
+}
+
+typedef void (*Sha256BlocksType)(UINT32 aState[8], const BYTE* aData, size_t aBlocks);
+
+static Sha256BlocksType Sha256Blocks = (CpuFeatures() & (CPU_SHA | CPU_SSE41)) == (CPU_SHA | CPU_SSE41) ? Sha256Blocks_SHA : Sha256Blocks_Scalar;
+
+struct Sha256State
+{
+	UINT32 h[8];
+	BYTE block[64];
+	size_t block_len;
+	UINT64 length;
+
+	void Reset() {
+		memcpy(h, Sha256IV, sizeof(h));
+		block_len = 0, length = 0;
+	}
+
+	void Update(const BYTE* aData, size_t aSize) {
+		length += aSize;
+		if (block_len) {
+			size_t take = 64 - block_len < aSize ? 64 - block_len : aSize;
+			memcpy(block + block_len, aData, take);
+			aData += take, aSize -= take;
+			if ((block_len += take) < 64)
+				return;
+			Sha256Blocks(h, block, 1);
+			block_len = 0;
+		}
+		Sha256Blocks(h, aData, aSize / 64);
+		block_len = aSize % 64;
+		memcpy(block, aData + aSize - block_len, block_len);
+	}
+
+	void Final(BYTE aOut[32]) const {
+		UINT32 state[8];
+		BYTE tail[128] = {};
+		size_t tail_len = block_len + 9 > 64 ? 128 : 64;
+		memcpy(state, h, sizeof(state));
+		memcpy(tail, block, block_len);
+		tail[block_len] = 0x80;
+		UINT64 bits = _byteswap_uint64(length * 8);
+		memcpy(tail + tail_len - 8, &bits, 8);
+		Sha256Blocks(state, tail, tail_len / 64);
+		for (int i = 0; i < 8; ++i)
+			state[i] = _byteswap_ulong(state[i]);
+		memcpy(aOut, state, 32);
+	}
+};
+
+//
+// xxHash3, 64-bit, with the default secret and seed.  Long inputs are accumulated one 64-byte
+// stripe at a time into eight lanes, which are scrambled after each block of 16 stripes.
+//
+
+#define XXH3_STRIPE 64
+#define XXH3_SECRET_SIZE 192
+#define XXH3_STRIPES_PER_BLOCK ((XXH3_SECRET_SIZE - XXH3_STRIPE) / 8)
+#define XXH3_BUFFER 256
+#define XXH3_MIDSIZE_MAX 240
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static const BYTE Xxh3Secret[XXH3_SECRET_SIZE] = {
+	0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+	0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+	0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+	0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+	0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+	0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+	0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+	0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+	0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+	0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+	0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+	0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static inline UINT64 Mul128Fold64(UINT64 aLeft, UINT64 aRight) {
+#ifdef _WIN64
+	UINT64 high, low = _umul128(aLeft, aRight, &high);
+	return low ^ high;
+#else
+	UINT64 lo_lo = __emulu((UINT32)aLeft, (UINT32)aRight), hi_lo = __emulu((UINT32)(aLeft >> 32), (UINT32)aRight);
+	UINT64 lo_hi = __emulu((UINT32)aLeft, (UINT32)(aRight >> 32)), hi_hi = __emulu((UINT32)(aLeft >> 32), (UINT32)(aRight >> 32));
+	UINT64 cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+	return ((cross << 32) | (lo_lo & 0xFFFFFFFF)) ^ ((hi_lo >> 32) + (cross >> 32) + hi_hi);
+#endif
+}
+
+static inline UINT64 Xxh64Avalanche(UINT64 h) {
+	h = (h ^ (h >> 33)) * XXH_PRIME64_2;
+	h = (h ^ (h >> 29)) * XXH_PRIME64_3;
+	return h ^ (h >> 32);
+}
+
+static inline UINT64 Xxh3Avalanche(UINT64 h) {
+	h = (h ^ (h >> 37)) * 0x165667919E3779F9ULL;
+	return h ^ (h >> 32);
+}
+
+static inline UINT64 Xxh3Mix16(const BYTE* aInput, const BYTE* aSecret) {
+	return Mul128Fold64(Read64(aInput) ^ Read64(aSecret), Read64(aInput + 8) ^ Read64(aSecret + 8));
+}
+
+// One-shot hash of up to XXH3_MIDSIZE_MAX bytes.
+static UINT64 Xxh3Short(const BYTE* aInput, size_t aSize) {
+	const BYTE* secret = Xxh3Secret;
+	UINT64 acc;
+	if (aSize <= 16) {
+		if (aSize > 8) {
+			UINT64 lo = Read64(aInput) ^ Read64(secret + 24) ^ Read64(secret + 32);
+			UINT64 hi = Read64(aInput + aSize - 8) ^ Read64(secret + 40) ^ Read64(secret + 48);
+			return Xxh3Avalanche(aSize + _byteswap_uint64(lo) + hi + Mul128Fold64(lo, hi));
+		}
+		if (aSize >= 4) {
+			UINT64 h = (Read32(aInput + aSize - 4) + ((UINT64)Read32(aInput) << 32)) ^ (Read64(secret + 8) ^ Read64(secret + 16));
+			h ^= _rotl64(h, 49) ^ _rotl64(h, 24);
+			h *= 0x9FB21C651E98DF25ULL;
+			h ^= (h >> 35) + aSize;
+			h *= 0x9FB21C651E98DF25ULL;
+			return h ^ (h >> 28);
+		}
+		if (aSize) {
+			UINT32 combo = ((UINT32)aInput[0] << 16) | ((UINT32)aInput[aSize >> 1] << 24) | aInput[aSize - 1] | ((UINT32)aSize << 8);
+			return Xxh64Avalanche(combo ^ (UINT64)(Read32(secret) ^ Read32(secret + 4)));
+		}
+		return Xxh64Avalanche(Read64(secret + 56) ^ Read64(secret + 64));
+	}
+	acc = aSize * XXH_PRIME64_1;
+	if (aSize <= 128) {
+		// Pairs of 16-byte lanes from each end, meeting in the middle.
+		for (size_t i = (aSize - 1) / 32; i != (size_t)-1; --i)
+			acc += Xxh3Mix16(aInput + 16 * i, secret + 32 * i) + Xxh3Mix16(aInput + aSize - 16 * (i + 1), secret + 32 * i + 16);
+		return Xxh3Avalanche(acc);
+	}
+	size_t rounds = aSize / 16;
+	for (size_t i = 0; i < 8; ++i)
+		acc += Xxh3Mix16(aInput + 16 * i, secret + 16 * i);
+	acc = Xxh3Avalanche(acc);
+	for (size_t i = 8; i < rounds; ++i)
+		acc += Xxh3Mix16(aInput + 16 * i, secret + 16 * (i - 8) + 3);
+	acc += Xxh3Mix16(aInput + aSize - 16, secret + 136 - 17);
+	return Xxh3Avalanche(acc);
+}
+
+static void Xxh3Accumulate_Scalar(UINT64 aAcc[8], const BYTE* aInput, const BYTE* aSecret, size_t aStripes) {
+	for (; aStripes; --aStripes, aInput += XXH3_STRIPE, aSecret += 8)
+		for (int i = 0; i < 8; ++i) {
+			UINT64 data = Read64(aInput + i * 8), key = data ^ Read64(aSecret + i * 8);
+			aAcc[i ^ 1] += data;
+			aAcc[i] += (UINT64)(UINT32)key * (key >> 32);
+		}
+}
+
+static void Xxh3Scramble_Scalar(UINT64 aAcc[8], const BYTE* aSecret) {
+	for (int i = 0; i < 8; ++i)
+		aAcc[i] = (aAcc[i] ^ (aAcc[i] >> 47) ^ Read64(aSecret + i * 8)) * XXH_PRIME32_1;
+}
+
+static void Xxh3Accumulate_SSE2(UINT64 aAcc[8], const BYTE* aInput, const BYTE* aSecret, size_t aStripes) {
+	__m128i acc[4];
+	for (int i = 0; i < 4; ++i)
+		acc[i] = _mm_loadu_si128((const __m128i*)aAcc + i);
+	for (; aStripes; --aStripes, aInput += XXH3_STRIPE, aSecret += 8)
+		for (int i = 0; i < 4; ++i) {
+			__m128i data = _mm_loadu_si128((const __m128i*)aInput + i);
+			__m128i key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i*)aSecret + i));
+			__m128i product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+			acc[i] = _mm_add_epi64(_mm_add_epi64(acc[i], _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2))), product);
+		}
+	for (int i = 0; i < 4; ++i)
+		_mm_storeu_si128((__m128i*)aAcc + i, acc[i]);
+}
+
+static void Xxh3Scramble_SSE2(UINT64 aAcc[8], const BYTE* aSecret) {
+	__m128i prime = _mm_set1_epi32((int)XXH_PRIME32_1);
+	for (int i = 0; i < 4; ++i) {
+		__m128i acc = _mm_loadu_si128((const __m128i*)aAcc + i);
+		__m128i key = _mm_xor_si128(_mm_xor_si128(acc, _mm_srli_epi64(acc, 47)), _mm_loadu_si128((const __m128i*)aSecret + i));
+		__m128i hi = _mm_mul_epu32(_mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+		_mm_storeu_si128((__m128i*)aAcc + i, _mm_add_epi64(_mm_mul_epu32(key, prime), _mm_slli_epi64(hi, 32)));
+	}
+}
+
+static void Xxh3Accumulate_AVX2(UINT64 aAcc[8], const BYTE* aInput, const BYTE* aSecret, size_t aStripes) {
+	__m256i acc0 = _mm256_loadu_si256((const __m256i*)aAcc), acc1 = _mm256_loadu_si256((const __m256i*)aAcc + 1);
+	for (; aStripes; --aStripes, aInput += XXH3_STRIPE, aSecret += 8) {
+		__m256i data0 = _mm256_loadu_si256((const __m256i*)aInput), data1 = _mm256_loadu_si256((const __m256i*)aInput + 1);
+		__m256i key0 = _mm256_xor_si256(data0, _mm256_loadu_si256((const __m256i*)aSecret));
+		__m256i key1 = _mm256_xor_si256(data1, _mm256_loadu_si256((const __m256i*)aSecret + 1));
+		acc0 = _mm256_add_epi64(_mm256_add_epi64(acc0, _mm256_shuffle_epi32(data0, _MM_SHUFFLE(1, 0, 3, 2)))
+			, _mm256_mul_epu32(key0, _mm256_srli_epi64(key0, 32)));
+		acc1 = _mm256_add_epi64(_mm256_add_epi64(acc1, _mm256_shuffle_epi32(data1, _MM_SHUFFLE(1, 0, 3, 2)))
+			, _mm256_mul_epu32(key1, _mm256_srli_epi64(key1, 32)));
+	}
+	_mm256_storeu_si256((__m256i*)aAcc, acc0);
+	_mm256_storeu_si256((__m256i*)aAcc + 1, acc1);
+}
+
+static void Xxh3Scramble_AVX2(UINT64 aAcc[8], const BYTE* aSecret) {
+	__m256i prime = _mm256_set1_epi32((int)XXH_PRIME32_1);
+	for (int i = 0; i < 2; ++i) {
+		__m256i acc = _mm256_loadu_si256((const __m256i*)aAcc + i);
+		__m256i key = _mm256_xor_si256(_mm256_xor_si256(acc, _mm256_srli_epi64(acc, 47)), _mm256_loadu_si256((const __m256i*)aSecret + i));
+		__m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(key, 32), prime);
+		_mm256_storeu_si256((__m256i*)aAcc + i, _mm256_add_epi64(_mm256_mul_epu32(key, prime), _mm256_slli_epi64(hi, 32)));
+	}
+}
+
+typedef void (*Xxh3AccumulateType)(UINT64 aAcc[8], const BYTE* aInput, const BYTE* aSecret, size_t aStripes);
+typedef void (*Xxh3ScrambleType)(UINT64 aAcc[8], const BYTE* aSecret);
+
+static Xxh3AccumulateType Xxh3Accumulate = CpuFeatures() & CPU_AVX2 ? Xxh3Accumulate_AVX2 : CpuFeatures() & CPU_SSE2 ? Xxh3Accumulate_SSE2 : Xxh3Accumulate_Scalar;
+static Xxh3ScrambleType Xxh3Scramble = CpuFeatures() & CPU_AVX2 ? Xxh3Scramble_AVX2 : CpuFeatures() & CPU_SSE2 ? Xxh3Scramble_SSE2 : Xxh3Scramble_Scalar;
+
+struct Xxh3State
+{
+	UINT64 acc[8];
+	BYTE buffer[XXH3_BUFFER];   // Input not yet accumulated; always holds the last stripe once any was.
+	size_t buffered;
+	size_t stripes;             // Stripes accumulated in the current block.
+	UINT64 length;
+
+	void Reset() {
+		static const UINT64 sInitial[8] = { XXH_PRIME32_3, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3
+			, XXH_PRIME64_4, XXH_PRIME32_2, XXH_PRIME64_5, XXH_PRIME32_1 };
+		memcpy(acc, sInitial, sizeof(acc));
+		buffered = stripes = 0, length = 0;
+	}
+
+	static size_t ConsumeStripes(UINT64 aAcc[8], const BYTE* aInput, size_t aStripes, size_t aDone) {
+		if (XXH3_STRIPES_PER_BLOCK - aDone > aStripes) {
+			Xxh3Accumulate(aAcc, aInput, Xxh3Secret + aDone * 8, aStripes);
+			return aDone + aStripes;
+		}
+		size_t to_end = XXH3_STRIPES_PER_BLOCK - aDone;
+		Xxh3Accumulate(aAcc, aInput, Xxh3Secret + aDone * 8, to_end);
+		Xxh3Scramble(aAcc, Xxh3Secret + XXH3_SECRET_SIZE - XXH3_STRIPE);
+		Xxh3Accumulate(aAcc, aInput + to_end * XXH3_STRIPE, Xxh3Secret, aStripes - to_end);
+		return aStripes - to_end;
+	}
+
+	// Input is accumulated only when more follows, since the last stripe is treated differently.
+	void Update(const BYTE* aData, size_t aSize) {
+		length += aSize;
+		if (buffered + aSize <= XXH3_BUFFER) {
+			memcpy(buffer + buffered, aData, aSize);
+			buffered += aSize;
+			return;
+		}
+		if (buffered) {
+			size_t fill = XXH3_BUFFER - buffered;
+			memcpy(buffer + buffered, aData, fill);
+			aData += fill, aSize -= fill;
+			stripes = ConsumeStripes(acc, buffer, XXH3_BUFFER / XXH3_STRIPE, stripes);
+			buffered = 0;
+		}
+		if (aSize > XXH3_BUFFER) {
+			size_t blocks = (aSize - 1) / XXH3_BUFFER;
+			for (size_t i = 0; i < blocks; ++i, aData += XXH3_BUFFER)
+				stripes = ConsumeStripes(acc, aData, XXH3_BUFFER / XXH3_STRIPE, stripes);
+			aSize -= blocks * XXH3_BUFFER;
+			memcpy(buffer + XXH3_BUFFER - XXH3_STRIPE, aData - XXH3_STRIPE, XXH3_STRIPE);
+		}
+		memcpy(buffer, aData, aSize);
+		buffered = aSize;
+	}
+
+	UINT64 Final() const {
+		if (length <= XXH3_MIDSIZE_MAX)
+			return Xxh3Short(buffer, buffered);
+		UINT64 a[8];
+		memcpy(a, acc, sizeof(a));
+		const BYTE* last_secret = Xxh3Secret + XXH3_SECRET_SIZE - XXH3_STRIPE - 7;
+		if (buffered >= XXH3_STRIPE) {
+			ConsumeStripes(a, buffer, (buffered - 1) / XXH3_STRIPE, stripes);
+			Xxh3Accumulate(a, buffer + buffered - XXH3_STRIPE, last_secret, 1);
+		}
+		else {
+			// The last stripe ends with the buffered input and begins with previously consumed bytes.
+			BYTE last[XXH3_STRIPE];
+			size_t catchup = XXH3_STRIPE - buffered;
+			memcpy(last, buffer + XXH3_BUFFER - catchup, catchup);
+			memcpy(last + catchup, buffer, buffered);
+			Xxh3Accumulate(a, last, last_secret, 1);
+		}
+		UINT64 result = length * XXH_PRIME64_1;
+		for (int i = 0; i < 4; ++i)
+			result += Mul128Fold64(a[i * 2] ^ Read64(Xxh3Secret + 11 + i * 16), a[i * 2 + 1] ^ Read64(Xxh3Secret + 11 + i * 16 + 8));
+		return Xxh3Avalanche(result);
+	}
+};
+
+//
+// BLAKE3.  Whole chunks are hashed eight at a time with AVX2, in groups on the thread pool
+// for large inputs; each group is a power-of-two subtree, so its root is an ordinary parent.
+//
+
+#define BLAKE3_BLOCK 64
+#define BLAKE3_CHUNK 1024
+#define BLAKE3_MAX_DEPTH 54
+#define BLAKE3_GROUP_CHUNKS 64            // Chunks reduced to one chaining value by each task.
+#define BLAKE3_MAX_SUBTREE_CHUNKS 16384   // Chunks passed to Blake3Subtree at once.
+#define BLAKE3_PARALLEL_CHUNKS 1024       // Subtrees this large use the thread pool.
+
+enum Blake3Flag
+{
+	B3_CHUNK_START = 1,
+	B3_CHUNK_END = 2,
+	B3_PARENT = 4,
+	B3_ROOT = 8
+};
+
+static const BYTE Blake3Schedule[7][16] = {
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+	{2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+	{3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+	{10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+	{12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+	{9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+	{11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+static inline void Blake3G(UINT32& a, UINT32& b, UINT32& c, UINT32& d, UINT32 x, UINT32 y) {
+	a += b + x, d = _rotr(d ^ a, 16);
+	c += d, b = _rotr(b ^ c, 12);
+	a += b + y, d = _rotr(d ^ a, 8);
+	c += d, b = _rotr(b ^ c, 7);
+}
+
+static inline void Blake3G(__m256i& a, __m256i& b, __m256i& c, __m256i& d, __m256i x, __m256i y) {
+	const __m256i rot16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2, 13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+	const __m256i rot8 = _mm256_set_epi8(12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1, 12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1);
+	a = _mm256_add_epi32(_mm256_add_epi32(a, b), x), d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16);
+	c = _mm256_add_epi32(c, d), b = _mm256_xor_si256(b, c), b = _mm256_or_si256(_mm256_srli_epi32(b, 12), _mm256_slli_epi32(b, 20));
+	a = _mm256_add_epi32(_mm256_add_epi32(a, b), y), d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8);
+	c = _mm256_add_epi32(c, d), b = _mm256_xor_si256(b, c), b = _mm256_or_si256(_mm256_srli_epi32(b, 7), _mm256_slli_epi32(b, 25));
+}
+
+template<int R, typename T>
+static inline void Blake3Round(T v[16], const T m[16]) {
+	const BYTE* s = Blake3Schedule[R];
+	Blake3G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+	Blake3G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+	Blake3G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+	Blake3G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+	Blake3G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+	Blake3G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+	Blake3G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+	Blake3G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+}
+
+// Unrolled, so the message schedule is resolved at compile time.
+template<typename T>
+static inline void Blake3Rounds(T v[16], const T m[16]) {
+	Blake3Round<0>(v, m);
+	Blake3Round<1>(v, m);
+	Blake3Round<2>(v, m);
+	Blake3Round<3>(v, m);
+	Blake3Round<4>(v, m);
+	Blake3Round<5>(v, m);
+	Blake3Round<6>(v, m);
+}
+
+// Stores the chaining value (the first half of the output); aOut may be aCV.
+static void Blake3Compress(const UINT32 aCV[8], const BYTE* aBlock, UINT64 aCounter, UINT32 aLength, UINT32 aFlags, UINT32 aOut[8]) {
+	UINT32 m[16], v[16];
+	memcpy(m, aBlock, sizeof(m));
+	memcpy(v, aCV, 32);
+	memcpy(v + 8, Sha256IV, 16);
+	v[12] = (UINT32)aCounter, v[13] = (UINT32)(aCounter >> 32), v[14] = aLength, v[15] = aFlags;
+	Blake3Rounds(v, m);
+	for (int i = 0; i < 8; ++i)
+		aOut[i] = v[i] ^ v[i + 8];
+}
+
+// Hashes aCount inputs of aBlocks blocks each, such as whole chunks or pairs of chaining values,
+// with the counter advancing by aCounterStep per input.  aOut may overlap the input if it
+// doesn't run ahead of it.
+static void Blake3HashMany_Scalar(const BYTE* aInput, size_t aCount, size_t aBlocks, UINT64 aCounter, UINT32 aCounterStep
+	, UINT32 aFlags, UINT32 aFlagsStart, UINT32 aFlagsEnd, UINT32 (*aOut)[8]) {
+	for (; aCount; --aCount, aCounter += aCounterStep, ++aOut) {
+		UINT32 cv[8];
+		memcpy(cv, Sha256IV, sizeof(cv));
+		for (size_t b = 0; b < aBlocks; ++b, aInput += BLAKE3_BLOCK)
+			Blake3Compress(cv, aInput, aCounter, BLAKE3_BLOCK
+				, aFlags | (b == 0 ? aFlagsStart : 0) | (b + 1 == aBlocks ? aFlagsEnd : 0), cv);
+		memcpy(*aOut, cv, sizeof(cv));
+	}
+}
+
+static inline void Transpose8x8_AVX2(__m256i v[8]) {
+	__m256i ab_0145 = _mm256_unpacklo_epi32(v[0], v[1]), ab_2367 = _mm256_unpackhi_epi32(v[0], v[1]);
+	__m256i cd_0145 = _mm256_unpacklo_epi32(v[2], v[3]), cd_2367 = _mm256_unpackhi_epi32(v[2], v[3]);
+	__m256i ef_0145 = _mm256_unpacklo_epi32(v[4], v[5]), ef_2367 = _mm256_unpackhi_epi32(v[4], v[5]);
+	__m256i gh_0145 = _mm256_unpacklo_epi32(v[6], v[7]), gh_2367 = _mm256_unpackhi_epi32(v[6], v[7]);
+	__m256i abcd_04 = _mm256_unpacklo_epi64(ab_0145, cd_0145), abcd_15 = _mm256_unpackhi_epi64(ab_0145, cd_0145);
+	__m256i abcd_26 = _mm256_unpacklo_epi64(ab_2367, cd_2367), abcd_37 = _mm256_unpackhi_epi64(ab_2367, cd_2367);
+	__m256i efgh_04 = _mm256_unpacklo_epi64(ef_0145, gh_0145), efgh_15 = _mm256_unpackhi_epi64(ef_0145, gh_0145);
+	__m256i efgh_26 = _mm256_unpacklo_epi64(ef_2367, gh_2367), efgh_37 = _mm256_unpackhi_epi64(ef_2367, gh_2367);
+	v[0] = _mm256_permute2x128_si256(abcd_04, efgh_04, 0x20);
+	v[1] = _mm256_permute2x128_si256(abcd_15, efgh_15, 0x20);
+	v[2] = _mm256_permute2x128_si256(abcd_26, efgh_26, 0x20);
+	v[3] = _mm256_permute2x128_si256(abcd_37, efgh_37, 0x20);
+	v[4] = _mm256_permute2x128_si256(abcd_04, efgh_04, 0x31);
+	v[5] = _mm256_permute2x128_si256(abcd_15, efgh_15, 0x31);
+	v[6] = _mm256_permute2x128_si256(abcd_26, efgh_26, 0x31);
+	v[7] = _mm256_permute2x128_si256(abcd_37, efgh_37, 0x31);
+}
+
+// Eight inputs at once, one per 32-bit lane.
+static void Blake3Hash8_AVX2(const BYTE* aInput, size_t aBlocks, UINT64 aCounter, UINT32 aCounterStep
+	, UINT32 aFlags, UINT32 aFlagsStart, UINT32 aFlagsEnd, UINT32 (*aOut)[8]) {
+	size_t stride = aBlocks * BLAKE3_BLOCK;
+	UINT32 counter_lo[8], counter_hi[8];
+	for (int j = 0; j < 8; ++j) {
+		UINT64 counter = aCounter + (UINT64)j * aCounterStep;
+		counter_lo[j] = (UINT32)counter, counter_hi[j] = (UINT32)(counter >> 32);
+	}
+	__m256i h[8], m[16], v[16];
+	for (int i = 0; i < 8; ++i)
+		h[i] = _mm256_set1_epi32((int)Sha256IV[i]);
+	for (size_t b = 0; b < aBlocks; ++b) {
+		for (int j = 0; j < 8; ++j) {
+			const BYTE* block = aInput + j * stride + b * BLAKE3_BLOCK;
+			m[j] = _mm256_loadu_si256((const __m256i*)block);
+			m[j + 8] = _mm256_loadu_si256((const __m256i*)(block + 32));
+		}
+		Transpose8x8_AVX2(m);
+		Transpose8x8_AVX2(m + 8);
+		UINT32 flags = aFlags | (b == 0 ? aFlagsStart : 0) | (b + 1 == aBlocks ? aFlagsEnd : 0);
+		for (int i = 0; i < 8; ++i)
+			v[i] = h[i];
+		for (int i = 0; i < 4; ++i)
+			v[i + 8] = _mm256_set1_epi32((int)Sha256IV[i]);
+		v[12] = _mm256_loadu_si256((const __m256i*)counter_lo);
+		v[13] = _mm256_loadu_si256((const __m256i*)counter_hi);
+		v[14] = _mm256_set1_epi32(BLAKE3_BLOCK);
+		v[15] = _mm256_set1_epi32((int)flags);
+		Blake3Rounds(v, m);
+		for (int i = 0; i < 8; ++i)
+			h[i] = _mm256_xor_si256(v[i], v[i + 8]);
+	}
+	Transpose8x8_AVX2(h);
+	for (int j = 0; j < 8; ++j)
+		_mm256_storeu_si256((__m256i*)aOut[j], h[j]);
+}
+
+static void Blake3HashMany_AVX2(const BYTE* aInput, size_t aCount, size_t aBlocks, UINT64 aCounter, UINT32 aCounterStep
+	, UINT32 aFlags, UINT32 aFlagsStart, UINT32 aFlagsEnd, UINT32 (*aOut)[8]) {
+	for (; aCount >= 8; aCount -= 8, aInput += 8 * aBlocks * BLAKE3_BLOCK, aCounter += 8 * aCounterStep, aOut += 8)
+		Blake3Hash8_AVX2(aInput, aBlocks, aCounter, aCounterStep, aFlags, aFlagsStart, aFlagsEnd, aOut);
+	Blake3HashMany_Scalar(aInput, aCount, aBlocks, aCounter, aCounterStep, aFlags, aFlagsStart, aFlagsEnd, aOut);
+}
+
+typedef void (*Blake3HashManyType)(const BYTE* aInput, size_t aCount, size_t aBlocks, UINT64 aCounter, UINT32 aCounterStep
+	, UINT32 aFlags, UINT32 aFlagsStart, UINT32 aFlagsEnd, UINT32 (*aOut)[8]);
+
+static Blake3HashManyType Blake3HashMany = CpuFeatures() & CPU_AVX2 ? Blake3HashMany_AVX2 : Blake3HashMany_Scalar;
+
+// Merges adjacent pairs of chaining values in place until aTarget remain.
+static void Blake3Reduce(UINT32 (*aCV)[8], size_t aCount, size_t aTarget) {
+	for (; aCount > aTarget; aCount /= 2)
+		Blake3HashMany((const BYTE*)aCV, aCount / 2, 1, 0, 0, B3_PARENT, 0, 0, aCV);
+}
+
+// Hashes a power-of-two number of whole chunks, and returns the chaining values of the two
+// children of the subtree's root, which is left to the caller in case it is the final root.
+static void Blake3Subtree(const BYTE* aInput, size_t aChunks, UINT64 aCounter, UINT32 aOut[2][8]) {
+	UINT32 cvs[BLAKE3_MAX_SUBTREE_CHUNKS / BLAKE3_GROUP_CHUNKS][8];
+	size_t group = aChunks < BLAKE3_GROUP_CHUNKS ? aChunks : BLAKE3_GROUP_CHUNKS;
+	int groups = (int)(aChunks / group);
+	// A single group is reduced to the two children directly.
+	size_t group_cvs = groups > 1 ? 1 : 2;
+	auto hash_group = [&](int i) {
+		UINT32 chunk_cvs[BLAKE3_GROUP_CHUNKS][8];
+		Blake3HashMany(aInput + i * group * BLAKE3_CHUNK, group, BLAKE3_CHUNK / BLAKE3_BLOCK, aCounter + i * group, 1
+			, 0, B3_CHUNK_START, B3_CHUNK_END, chunk_cvs);
+		Blake3Reduce(chunk_cvs, group, group_cvs);
+		memcpy(cvs[i * group_cvs], chunk_cvs, group_cvs * 32);
+	};
+	if (aChunks >= BLAKE3_PARALLEL_CHUNKS)
+		RunParallel(groups, hash_group);
+	else for (int i = 0; i < groups; ++i)
+		hash_group(i);
+	Blake3Reduce(cvs, groups * group_cvs, 2);
+	memcpy(aOut, cvs, 64);
+}
+
+// The inputs of the compression which produces a node's chaining value, or the root hash.
+struct Blake3Output
+{
+	UINT32 cv[8];
+	BYTE block[BLAKE3_BLOCK];
+	UINT64 counter;
+	UINT32 block_len, flags;
+
+	void ChainingValue(UINT32 aOut[8]) const {
+		Blake3Compress(cv, block, counter, block_len, flags, aOut);
+	}
+
+	void Root(BYTE aOut[32]) const {
+		UINT32 words[8];
+		Blake3Compress(cv, block, 0, block_len, flags | B3_ROOT, words);
+		memcpy(aOut, words, 32);
+	}
+
+	void Parent(const UINT32 aLeft[8], const UINT32 aRight[8]) {
+		memcpy(cv, Sha256IV, sizeof(cv));
+		memcpy(block, aLeft, 32);
+		memcpy(block + 32, aRight, 32);
+		counter = 0, block_len = BLAKE3_BLOCK, flags = B3_PARENT;
+	}
+};
+
+struct Blake3Chunk
+{
+	UINT32 cv[8];
+	BYTE block[BLAKE3_BLOCK];
+	UINT64 counter;
+	UINT32 block_len, blocks;   // The last block is kept until the chunk is finished.
+
+	void Start(UINT64 aCounter) {
+		memcpy(cv, Sha256IV, sizeof(cv));
+		counter = aCounter, block_len = blocks = 0;
+	}
+
+	size_t Length() const { return blocks * BLAKE3_BLOCK + block_len; }
+	UINT32 StartFlag() const { return blocks ? 0 : B3_CHUNK_START; }
+
+	void Update(const BYTE* aData, size_t aSize) {
+		while (aSize) {
+			if (block_len == BLAKE3_BLOCK) {
+				Blake3Compress(cv, block, counter, BLAKE3_BLOCK, StartFlag(), cv);
+				++blocks, block_len = 0;
+			}
+			size_t take = BLAKE3_BLOCK - block_len < aSize ? BLAKE3_BLOCK - block_len : aSize;
+			memcpy(block + block_len, aData, take);
+			block_len += (UINT32)take, aData += take, aSize -= take;
+		}
+	}
+
+	void Output(Blake3Output& aOut) const {
+		memcpy(aOut.cv, cv, sizeof(cv));
+		memcpy(aOut.block, block, block_len);
+		memset(aOut.block + block_len, 0, BLAKE3_BLOCK - block_len);
+		aOut.counter = counter, aOut.block_len = block_len, aOut.flags = StartFlag() | B3_CHUNK_END;
+	}
+};
+
+struct Blake3State
+{
+	Blake3Chunk chunk;
+	UINT32 stack[BLAKE3_MAX_DEPTH][8];   // Chaining values of complete subtrees, merged lazily.
+	int stack_len;
+
+	void Reset() {
+		chunk.Start(0);
+		stack_len = 0;
+	}
+
+	// Merges subtrees until one remains per set bit of aChunks; the rest may still be the root's children.
+	void MergeStack(UINT64 aChunks) {
+		int bits = 0;
+		for (; aChunks; aChunks &= aChunks - 1)
+			++bits;
+		for (; stack_len > bits; --stack_len)
+			Blake3Compress(Sha256IV, (const BYTE*)stack[stack_len - 2], 0, BLAKE3_BLOCK, B3_PARENT, stack[stack_len - 2]);
+	}
+
+	void PushCV(const UINT32 aCV[8], UINT64 aChunks) {
+		MergeStack(aChunks);
+		memcpy(stack[stack_len++], aCV, 32);
+	}
+
+	void Update(const BYTE* aData, size_t aSize) {
+		if (chunk.Length()) {
+			size_t take = BLAKE3_CHUNK - chunk.Length() < aSize ? BLAKE3_CHUNK - chunk.Length() : aSize;
+			chunk.Update(aData, take);
+			aData += take, aSize -= take;
+			if (!aSize)
+				return;
+			Blake3Output out;
+			UINT32 cv[8];
+			chunk.Output(out);
+			out.ChainingValue(cv);
+			PushCV(cv, chunk.counter);
+			chunk.Start(chunk.counter + 1);
+		}
+		// Whole subtrees, aligned to their size within the input, while more than a chunk remains.
+		while (aSize > BLAKE3_CHUNK) {
+			UINT64 chunks = BLAKE3_MAX_SUBTREE_CHUNKS;
+			while (chunks * BLAKE3_CHUNK > aSize || (chunk.counter & (chunks - 1)))
+				chunks >>= 1;
+			if (chunks == 1) {
+				UINT32 cv[8];
+				Blake3HashMany(aData, 1, BLAKE3_CHUNK / BLAKE3_BLOCK, chunk.counter, 1, 0, B3_CHUNK_START, B3_CHUNK_END, &cv);
+				PushCV(cv, chunk.counter);
+			}
+			else {
+				UINT32 children[2][8];
+				Blake3Subtree(aData, (size_t)chunks, chunk.counter, children);
+				PushCV(children[0], chunk.counter);
+				PushCV(children[1], chunk.counter + chunks / 2);
+			}
+			chunk.counter += chunks;
+			aData += chunks * BLAKE3_CHUNK, aSize -= (size_t)chunks * BLAKE3_CHUNK;
+		}
+		if (aSize) {
+			chunk.Update(aData, aSize);
+			MergeStack(chunk.counter);
+		}
+	}
+
+	void Final(BYTE aOut[32]) const {
+		Blake3Output out;
+		int remaining = stack_len;
+		if (chunk.Length() || !remaining)
+			chunk.Output(out);
+		else {
+			// The input ended with a whole subtree, whose children are the top two entries.
+			out.Parent(stack[remaining - 2], stack[remaining - 1]);
+			remaining -= 2;
+		}
+		while (remaining) {
+			UINT32 cv[8];
+			out.ChainingValue(cv);
+			out.Parent(stack[--remaining], cv);
+		}
+		out.Root(aOut);
+	}
+};
+
+//
+// Algorithm selection.
+//
+
+enum HashAlgorithm
+{
+	HASH_CRC32C,
+	HASH_XXH3,
+	HASH_BLAKE3,
+	HASH_SHA256
+};
+
+static const struct { LPCTSTR name; UINT digest_size; } sAlgorithms[] = {
+	{ _T("crc32c"), 4 },
+	{ _T("xxh3"), 8 },
+	{ _T("blake3"), 32 },
+	{ _T("sha256"), 32 },
+};
+
+struct HashState
+{
+	int algorithm = HASH_CRC32C;
+	union
+	{
+		UINT32 crc;
+		Xxh3State xxh3;
+		Blake3State blake3;
+		Sha256State sha256;
+	};
+
+	HashState() : crc(0) {}
+
+	UINT DigestSize() const { return sAlgorithms[algorithm].digest_size; }
+
+	void Reset() {
+		switch (algorithm) {
+		case HASH_CRC32C: crc = 0; break;
+		case HASH_XXH3: xxh3.Reset(); break;
+		case HASH_BLAKE3: blake3.Reset(); break;
+		case HASH_SHA256: sha256.Reset(); break;
+		}
+	}
+
+	void Update(const BYTE* aData, size_t aSize) {
+		switch (algorithm) {
+		case HASH_CRC32C: crc = Crc32c(crc, aData, aSize); break;
+		case HASH_XXH3: xxh3.Update(aData, aSize); break;
+		case HASH_BLAKE3: blake3.Update(aData, aSize); break;
+		case HASH_SHA256: sha256.Update(aData, aSize); break;
+		}
+	}
+
+	void Digest(BYTE* aOut) const {
+		switch (algorithm) {
+		case HASH_CRC32C: {
+			UINT32 be = _byteswap_ulong(crc);
+			memcpy(aOut, &be, sizeof(be));
+			break;
+		}
+		case HASH_XXH3: {
+			UINT64 be = _byteswap_uint64(xxh3.Final());
+			memcpy(aOut, &be, sizeof(be));
+			break;
+		}
+		case HASH_BLAKE3: blake3.Final(aOut); break;
+		case HASH_SHA256: sha256.Final(aOut); break;
+		}
+	}
+};
+
+static bool Fail(ResultToken& aResultToken, LPTSTR aMessage, LPTSTR aType = _T("ValueError"), LPTSTR aExtra = nullptr) {
+	Object::Error(ExprTokenType(aMessage), aExtra, aType);
+	aResultToken.result = FAIL;
+	return false;
+}
+
+static bool ParamAlgorithm(ExprTokenType& aParam, HashState& aState, ResultToken& aResultToken) {
+	ExprTokenType val;
+	TokenToValue(aParam, val);
+	if (val.symbol != SYM_STRING)
+		return Fail(aResultToken, _T("Expected an algorithm name."), _T("TypeError"));
+	for (int i = 0; i < _countof(sAlgorithms); ++i)
+		if (!_tcsicmp(val.marker, sAlgorithms[i].name)) {
+			aState.algorithm = i;
+			aState.Reset();
+			return true;
+		}
+	return Fail(aResultToken, _T("Unknown hash algorithm."), _T("ValueError"), val.marker);
+}
+
+static bool ParamFlag(ExprTokenType* aParam[], int aParamCount, int aIndex) {
+	return aParamCount > aIndex && aParam[aIndex]->symbol != SYM_MISSING && TokenToBool(*aParam[aIndex]);
+}
+
+static void DigestToHex(const BYTE* aDigest, UINT aSize, TString& aHex) {
+	char hex[HASH_MAX_DIGEST * 2];
+	HexEncode(aDigest, aSize, hex, false);
+	for (UINT i = 0; i < aSize * 2; ++i)
+		aHex.append((TCHAR)hex[i]);
+}
+
+static void ReturnDigest(ResultToken& aResultToken, const BYTE* aDigest, UINT aSize, bool aAsBuffer) {
+	if (aAsBuffer) {
+		BufferObject* buf;
+		if (!NewBuffer(aSize, buf)) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		memcpy(buf->mData, aDigest, aSize);
+		aResultToken.SetValue(buf);
+		return;
+	}
+	TString hex;
+	DigestToHex(aDigest, aSize, hex);
+	if (!hex.move_to(aResultToken))
+		Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+}
+
+class Hasher : public Object {
+	HashState mState;
+
+public:
+#define CLASSNAME "Hasher"
+	IObject_Type_Impl;
+	static ObjectMember sMembers[];
+
+	void __New(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		ParamAlgorithm(*aParam[0], mState, aResultToken);
+	}
+
+	// Update(data, size?)
+	void Update(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		const BYTE* data;
+		size_t size;
+		if (ParamData(aParam, aParamCount, data, size, aResultToken))
+			mState.Update(data, size);
+	}
+
+	// Digest(as_buffer := false): the digest of everything so far, without resetting.
+	void Digest(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		BYTE digest[HASH_MAX_DIGEST];
+		mState.Digest(digest);
+		ReturnDigest(aResultToken, digest, mState.DigestSize(), ParamFlag(aParam, aParamCount, 0));
+	}
+
+	void Reset(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		mState.Reset();
+	}
+};
+
+ObjectMember Hasher::sMembers[] = {
+	Object_Method(__New, __New, 0, 1, 1),
+	Object_Method(Update, Update, 0, 1, 2),
+	Object_Method(Digest, Digest, 0, 0, 1),
+	Object_Method(Reset, Reset, 0, 0, 0),
+};
+
+static void OSFail(ResultToken& aResultToken, DWORD aError, LPTSTR aPath) {
+	ExprTokenType code;
+	code.SetValue((__int64)aError);
+	Object::Error(code, aPath, _T("OSError"));
+	aResultToken.result = FAIL;
+}
+
+// Hashes a file through views of its mapping.  Returns 0 or a system error code, or stops early
+// with ERROR_CANCELLED if aJob is cancelled.
+static DWORD HashFile(LPCTSTR aPath, HashState& aState, AsyncJob* aJob = nullptr) {
+	HANDLE file = CreateFile(aPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	LARGE_INTEGER size;
+	if (file == INVALID_HANDLE_VALUE)
+		return GetLastError();
+	// An empty file can't be mapped, and has nothing to hash.
+	HANDLE mapping = nullptr;
+	DWORD error = 0;
+	if (!GetFileSizeEx(file, &size) || (size.QuadPart && !(mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr))))
+		error = GetLastError();
+	for (UINT64 offset = 0; !error && offset < (UINT64)size.QuadPart; offset += HASH_FILE_VIEW) {
+		size_t length = (UINT64)size.QuadPart - offset < HASH_FILE_VIEW ? (size_t)((UINT64)size.QuadPart - offset) : HASH_FILE_VIEW;
+		if (aJob && aJob->Cancelled()) {
+			error = ERROR_CANCELLED;
+			break;
+		}
+		auto view = (const BYTE*)MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)(offset >> 32), (DWORD)offset, length);
+		if (!view) {
+			error = GetLastError();
+			break;
+		}
+		aState.Update(view, length);
+		UnmapViewOfFile(view);
+	}
+	if (mapping)
+		CloseHandle(mapping);
+	CloseHandle(file);
+	return error;
+}
+
+// hash_file(path, algorithm, as_buffer := false)
+BIF_DECL(hash_file) {
+	ExprTokenType path;
+	HashState state;
+	TokenToValue(*aParam[0], path);
+	if (path.symbol != SYM_STRING) {
+		Fail(aResultToken, _T("Expected a file path."), _T("TypeError"));
+		return;
+	}
+	if (!ParamAlgorithm(*aParam[1], state, aResultToken))
+		return;
+	if (DWORD error = HashFile(path.marker, state)) {
+		OSFail(aResultToken, error, path.marker);
+		return;
+	}
+	BYTE digest[HASH_MAX_DIGEST];
+	state.Digest(digest);
+	ReturnDigest(aResultToken, digest, state.DigestSize(), ParamFlag(aParam, aParamCount, 2));
+}
+
+struct HashFileJob : ScriptJob
+{
+	HashState state;
+	LPTSTR path = nullptr;
+	bool as_buffer = false;
+	BYTE digest[HASH_MAX_DIGEST];
+
+	~HashFileJob() { free(path); }
+
+	void Run() {
+		if (DWORD error = HashFile(path, state, this))
+			RejectOS(error, path);
+		else
+			state.Digest(digest);
+	}
+
+	bool Result(ResultToken& aResultToken) {
+		UINT size = state.DigestSize();
+		if (as_buffer) {
+			BufferObject* buf;
+			if (!NewBuffer(size, buf))
+				return false;
+			memcpy(buf->mData, digest, size);
+			aResultToken.SetValue(buf);
+			return true;
+		}
+		TString hex;
+		DigestToHex(digest, size, hex);
+		return hex.move_to(aResultToken);
+	}
+};
+
+// hash_file_async(path, algorithm, as_buffer := false): hash_file on the module's worker threads.
+BIF_DECL(hash_file_async) {
+	ExprTokenType path;
+	TokenToValue(*aParam[0], path);
+	if (path.symbol != SYM_STRING) {
+		Fail(aResultToken, _T("Expected a file path."), _T("TypeError"));
+		return;
+	}
+	auto job = new (std::nothrow) HashFileJob;
+	if (!job || !(job->path = _tcsdup(path.marker))) {
+		delete job;
+		Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+		return;
+	}
+	job->as_buffer = ParamFlag(aParam, aParamCount, 2);
+	if (ParamAlgorithm(*aParam[1], job->state, aResultToken))
+		SubmitAsync(aResultToken, job);
+	else
+		job->Release();
+}
+
+// async_limit(limit?)
+BIF_DECL(async_limit) {
+	WorkPool& pool = AsyncPool();
+	aResultToken.SetValue((__int64)pool.Limit());
+	if (aParamCount && aParam[0]->symbol != SYM_MISSING) {
+		ExprTokenType limit;
+		TokenToValue(*aParam[0], limit);
+		if (limit.symbol != SYM_INTEGER || limit.value_int64 < 1) {
+			Fail(aResultToken, _T("Invalid limit."));
+			return;
+		}
+		pool.SetLimit(limit.value_int64 < ASYNC_MAX_WORKERS ? (int)limit.value_int64 : ASYNC_MAX_WORKERS);
+	}
+}
+
+// hash_many(algorithm, buffers, as_buffer := false)
+BIF_DECL(hash_many) {
+	static IObject* sArray = GetGlobal(_T("Array"));
+	HashState proto;
+	ExprTokenType val;
+	if (!sArray) {
+		Fail(aResultToken, _T("The Array class is not available."), _T("Error"));
+		return;
+	}
+	if (!ParamAlgorithm(*aParam[0], proto, aResultToken))
+		return;
+	TokenToValue(*aParam[1], val);
+	if (val.symbol != SYM_OBJECT || _tcscmp(val.object->Type(), _T("Array"))) {
+		Fail(aResultToken, _T("Expected an Array of Buffers or Strings."), _T("TypeError"));
+		return;
+	}
+	auto buffers = static_cast<Array*>(val.object);
+	Array::index_t count = buffers->mLength;
+	UINT digest_size = proto.DigestSize();
+	bool as_buffer = ParamFlag(aParam, aParamCount, 2);
+	Arena arena;
+	struct Input { const BYTE* data; size_t size; };
+	auto inputs = arena.Alloc<Input>(count + 1);
+	auto digests = arena.Alloc<BYTE>((size_t)count * digest_size + 1);
+	ExprTokenType** params = arena.NewParams(count);
+	if (!inputs || !digests || (!params && count) || count > INT_MAX) {
+		Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+		return;
+	}
+	size_t total = 0;
+	for (Array::index_t i = 0; i < count; ++i) {
+		ExprTokenType item;
+		VariantToToken(buffers->mItem[i], item);
+		if (!BorrowBytes(item, inputs[i].data, inputs[i].size)) {
+			TCHAR index[MAX_INTEGER_SIZE];
+			Fail(aResultToken, _T("Expected an Array of Buffers or Strings."), _T("TypeError"), _itot(i + 1, index, 10));
+			return;
+		}
+		total += inputs[i].size;
+	}
+	auto hash_one = [&](int i) {
+		HashState state;
+		state.algorithm = proto.algorithm;
+		state.Reset();
+		state.Update(inputs[i].data, inputs[i].size);
+		state.Digest(digests + (size_t)i * digest_size);
+	};
+	if (total >= HASH_PARALLEL_THRESHOLD)
+		RunParallel((int)count, hash_one);
+	else for (int i = 0; i < (int)count; ++i)
+		hash_one(i);
+	Array::index_t done = 0;
+	bool ok = true;
+	for (; done < count; ++done) {
+		const BYTE* digest = digests + (size_t)done * digest_size;
+		if (as_buffer) {
+			BufferObject* buf;
+			if (!(ok = NewBuffer(digest_size, buf)))
+				break;
+			memcpy(buf->mData, digest, digest_size);
+			params[done]->SetValue(buf);
+			continue;
+		}
+		TString hex;
+		DigestToHex(digest, digest_size, hex);
+		LPTSTR str = arena.Strdup(hex.data(), hex.size());
+		if (!(ok = str != nullptr)) {
+			Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+			break;
+		}
+		params[done]->SetValue(str, hex.size());
+	}
+	if (ok) {
+		if (IObject* arr = CallGlobal(sArray, params, (int)count))
+			aResultToken.SetValue(arr);
+		else ok = false;
+	}
+	if (as_buffer)
+		for (Array::index_t i = 0; i < done; ++i)
+			params[i]->object->Release();
+	if (!ok)
+		aResultToken.result = FAIL;
+}
+
+ExportSymbol symbols[] = {
+	EXPORT_CLASS(Hasher, 1)
+	EXPORT_FUNC(hash_file, 2, 3)
+	EXPORT_FUNC(hash_many, 2, 3)
+	EXPORT_FUNC(hash_file_async, 2, 3)
+	EXPORT_FUNC(async_limit, 0, 1)
+};
+
+EXPORT_AHKMODULE(symbols)
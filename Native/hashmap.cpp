@@ -0,0 +1,522 @@
+﻿#include "ahk2_types.h"
+#include "simd.h"
+
+// HashMap: an unordered replacement for Map with O(1) insert and delete.
+//   hm := Native.LoadModule('hashmap.dll').HashMap(key1, value1, ...)
+//   hm.CaseSense := false	; only while empty
+//   hm[key] := value, hm.Get(key, default?), hm.Has(key), hm.Delete(key), hm.Count
+//   hm.GetMany([key1, [key2, default]]), hm.HasMany([key1, key2])	; one native call for the whole batch
+//   for key, value in hm
+// Keys are integers, strings or objects; floats are converted to strings like Map does.
+// Enumeration order is unspecified.
+
+class HashMap : public Object {
+	// Control bytes: 0x00-0x7F = full (low 7 bits of the hash), otherwise empty or deleted.
+	enum : signed char { kEmpty = (signed char)0x80, kDeleted = (signed char)0xFE };
+	enum { kGroupSize = 16 };
+
+	struct Key
+	{
+		union
+		{
+			__int64 i;
+			IObject* p;
+			LPTSTR s;
+		};
+		size_t length;
+		SymbolType symbol; // SYM_INTEGER, SYM_OBJECT or SYM_STRING.
+	};
+	struct Value
+	{
+		union
+		{
+			__int64 n_int64;
+			double n_double;
+			IObject* object;
+			LPTSTR string;
+		};
+		size_t length;
+		SymbolType symbol;
+	};
+	struct Slot
+	{
+		Key key;
+		Value value;
+	};
+
+	signed char* mCtrl = nullptr;
+	Slot* mSlots = nullptr;
+	size_t mCapacity = 0, mCount = 0, mGrowthLeft = 0;
+	bool mCaseless = false;
+
+	friend class HashMapEnum;
+
+	static inline unsigned __int64 Mix(unsigned __int64 x) {
+		x ^= x >> 33, x *= 0xff51afd7ed558ccdULL;
+		x ^= x >> 33, x *= 0xc4ceb9fe1a85ec53ULL;
+		return x ^ (x >> 33);
+	}
+	static inline TCHAR Fold(TCHAR c) {
+		return (unsigned)c < 128 ? (c <= 'Z' && c >= 'A' ? c + 32 : c) : (TCHAR)_totlower(c);
+	}
+
+	unsigned __int64 Hash(Key& aKey) {
+		if (aKey.symbol != SYM_STRING)
+			return Mix((unsigned __int64)aKey.i + aKey.symbol);
+		unsigned __int64 h = 14695981039346656037ULL;
+		LPTSTR s = aKey.s, end = s + aKey.length;
+		if (mCaseless)
+			for (; s < end; ++s)
+				h = (h ^ (_TUCHAR)Fold(*s)) * 1099511628211ULL;
+		else
+			for (; s < end; ++s)
+				h = (h ^ (_TUCHAR)*s) * 1099511628211ULL;
+		return Mix(h);
+	}
+
+	bool KeyEquals(Key& a, Key& b) {
+		if (a.symbol != b.symbol)
+			return false;
+		if (a.symbol != SYM_STRING)
+			return a.i == b.i;
+		if (a.length != b.length)
+			return false;
+		return mCaseless ? !_tcsnicmp(a.s, b.s, a.length) : !memcmp(a.s, b.s, a.length * sizeof(TCHAR));
+	}
+
+	// Returns the slot index of aKey, or -1.
+	ptrdiff_t Find(Key& aKey, unsigned __int64 aHash) {
+		if (!mCount)
+			return -1;
+		size_t group_mask = (mCapacity / kGroupSize) - 1, g = (size_t)(aHash >> 7) & group_mask;
+		const __m128i h2 = _mm_set1_epi8((char)(aHash & 0x7F)), empty = _mm_set1_epi8(kEmpty);
+		for (size_t step = 1;; ++step) {
+			__m128i ctrl = _mm_loadu_si128((const __m128i*)(mCtrl + g * kGroupSize));
+			for (unsigned int match = _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, h2)); match; match &= match - 1) {
+				size_t i = g * kGroupSize + BitScan(match);
+				if (KeyEquals(mSlots[i].key, aKey))
+					return i;
+			}
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, empty)))
+				return -1;
+			g = (g + step) & group_mask; // Triangular probing visits every group.
+		}
+	}
+
+	// Returns the first empty or deleted slot in the probe sequence of aHash.
+	size_t FindFree(unsigned __int64 aHash) {
+		size_t group_mask = (mCapacity / kGroupSize) - 1, g = (size_t)(aHash >> 7) & group_mask;
+		for (size_t step = 1;; ++step) {
+			__m128i ctrl = _mm_loadu_si128((const __m128i*)(mCtrl + g * kGroupSize));
+			if (unsigned int free_mask = _mm_movemask_epi8(ctrl))
+				return g * kGroupSize + BitScan(free_mask);
+			g = (g + step) & group_mask;
+		}
+	}
+
+	bool Rehash(size_t aCapacity) {
+		signed char* ctrl = (signed char*)malloc(aCapacity);
+		Slot* slots = (Slot*)malloc(aCapacity * sizeof(Slot));
+		if (!ctrl || !slots) {
+			free(ctrl), free(slots);
+			return false;
+		}
+		signed char* old_ctrl = mCtrl;
+		Slot* old_slots = mSlots;
+		size_t old_capacity = mCapacity;
+		memset(ctrl, kEmpty, aCapacity);
+		mCtrl = ctrl, mSlots = slots, mCapacity = aCapacity;
+		for (size_t i = 0; i < old_capacity; ++i) {
+			if (old_ctrl[i] < 0)
+				continue;
+			unsigned __int64 h = Hash(old_slots[i].key);
+			size_t pos = FindFree(h);
+			mCtrl[pos] = (signed char)(h & 0x7F);
+			mSlots[pos] = old_slots[i];
+		}
+		mGrowthLeft = aCapacity - aCapacity / 8 - mCount;
+		free(old_ctrl), free(old_slots);
+		return true;
+	}
+
+	// Called when no empty slots are left: purge deleted slots if they make up most of the
+	// table, otherwise double the capacity.
+	bool Grow() {
+		size_t usable = mCapacity - mCapacity / 8;
+		return Rehash(!mCapacity ? kGroupSize : mCount < usable / 2 ? mCapacity : mCapacity * 2);
+	}
+
+	bool Reserve(size_t aCount) {
+		size_t capacity = mCapacity ? mCapacity : kGroupSize;
+		while (capacity - capacity / 8 < aCount)
+			capacity <<= 1;
+		return capacity == mCapacity || Rehash(capacity);
+	}
+
+	static void FreeKey(Key& aKey) {
+		if (aKey.symbol == SYM_STRING)
+			free(aKey.s);
+		else if (aKey.symbol == SYM_OBJECT)
+			aKey.p->Release();
+	}
+	static void FreeValue(Value& aValue) {
+		if (aValue.symbol == SYM_STRING)
+			free(aValue.string);
+		else if (aValue.symbol == SYM_OBJECT)
+			aValue.object->Release();
+	}
+
+	// Converts a parameter into a lookup key; strings are borrowed from the token.
+	bool TokenToKey(ExprTokenType& aToken, Key& aKey, TCHAR* aBuf) {
+		ExprTokenType val;
+		TokenToValue(aToken, val);
+		switch (aKey.symbol = val.symbol)
+		{
+		case SYM_INTEGER: aKey.i = val.value_int64; break;
+		case SYM_OBJECT: aKey.p = val.object; break;
+		case SYM_FLOAT:
+			_stprintf_s(aBuf, MAX_NUMBER_SIZE, _T("%.17g"), val.value_double);
+			aKey.symbol = SYM_STRING, aKey.s = aBuf, aKey.length = _tcslen(aBuf);
+			if (!_tcschr(aBuf, '.') && !_tcschr(aBuf, 'e') && !_tcschr(aBuf, 'n'))
+				aBuf[aKey.length++] = '.', aBuf[aKey.length++] = '0', aBuf[aKey.length] = 0;
+			break;
+		case SYM_STRING:
+			aKey.s = val.marker;
+			aKey.length = val.marker_length == -1 ? _tcslen(val.marker) : val.marker_length;
+			break;
+		default:
+			Object::Error(ExprTokenType(_T("Invalid key.")), nullptr, _T("TypeError"));
+			return false;
+		}
+		return true;
+	}
+
+	static bool CopyString(LPTSTR& aDest, LPCTSTR aSrc, size_t aLength) {
+		if (!(aDest = (LPTSTR)malloc((aLength + 1) * sizeof(TCHAR))))
+			return false;
+		memcpy(aDest, aSrc, aLength * sizeof(TCHAR));
+		aDest[aLength] = 0;
+		return true;
+	}
+
+	static bool TokenToStoredValue(ExprTokenType& aToken, Value& aValue) {
+		ExprTokenType val;
+		TokenToValue(aToken, val);
+		switch (aValue.symbol = val.symbol)
+		{
+		case SYM_INTEGER: aValue.n_int64 = val.value_int64; break;
+		case SYM_FLOAT: aValue.n_double = val.value_double; break;
+		case SYM_OBJECT: (aValue.object = val.object)->AddRef(); break;
+		case SYM_STRING:
+			aValue.length = val.marker_length == -1 ? _tcslen(val.marker) : val.marker_length;
+			return CopyString(aValue.string, val.marker, aValue.length) || OutOfMemory();
+		default:
+			Object::Error(ExprTokenType(_T("Invalid value.")), nullptr, _T("ValueError"));
+			return false;
+		}
+		return true;
+	}
+
+	static void ReturnValue(ResultToken& aResultToken, Value& aValue) {
+		switch (aResultToken.symbol = aValue.symbol)
+		{
+		case SYM_STRING:
+			aResultToken.marker = aValue.string;
+			aResultToken.marker_length = aValue.length;
+			break;
+		case SYM_OBJECT:
+			aValue.object->AddRef();
+			// Fall through to copy the pointer.
+		default:
+			aResultToken.value_int64 = aValue.n_int64; // Union copy.
+		}
+	}
+
+	bool SetItem(ExprTokenType& aKey, ExprTokenType& aValue) {
+		TCHAR buf[MAX_NUMBER_SIZE];
+		Key key;
+		Value value;
+		if (!TokenToKey(aKey, key, buf))
+			return false;
+		if (!TokenToStoredValue(aValue, value))
+			return false;
+		unsigned __int64 h = Hash(key);
+		ptrdiff_t i = Find(key, h);
+		if (i >= 0) {
+			FreeValue(mSlots[i].value);
+			mSlots[i].value = value;
+			return true;
+		}
+		if (!mGrowthLeft && !Grow()) {
+			FreeValue(value);
+			return OutOfMemory();
+		}
+		if (key.symbol == SYM_STRING) {
+			if (!CopyString(key.s, key.s, key.length)) {
+				FreeValue(value);
+				return OutOfMemory();
+			}
+		}
+		else if (key.symbol == SYM_OBJECT)
+			key.p->AddRef();
+		size_t pos = FindFree(h);
+		if (mCtrl[pos] == kEmpty)
+			--mGrowthLeft;
+		mCtrl[pos] = (signed char)(h & 0x7F);
+		mSlots[pos] = { key, value };
+		++mCount;
+		return true;
+	}
+
+	void Erase(size_t aPos) {
+		// An empty slot can be restored only if its group already stops every probe sequence.
+		__m128i ctrl = _mm_loadu_si128((const __m128i*)(mCtrl + (aPos & ~(size_t)(kGroupSize - 1))));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(kEmpty))))
+			mCtrl[aPos] = kEmpty, ++mGrowthLeft;
+		else mCtrl[aPos] = kDeleted;
+		FreeKey(mSlots[aPos].key);
+		FreeValue(mSlots[aPos].value);
+		--mCount;
+	}
+
+	void ClearAll() {
+		for (size_t i = 0; i < mCapacity; ++i)
+			if (mCtrl[i] >= 0) {
+				FreeKey(mSlots[i].key);
+				FreeValue(mSlots[i].value);
+			}
+		free(mCtrl), free(mSlots);
+		mCtrl = nullptr, mSlots = nullptr;
+		mCapacity = mCount = mGrowthLeft = 0;
+	}
+
+	static bool OutOfMemory() {
+		Object::Error(ExprTokenType(_T("Out of memory.")), nullptr, _T("MemoryError"));
+		return false;
+	}
+
+	bool NotFound(ExprTokenType& aKey, ResultToken& aResultToken) {
+		ExprTokenType key;
+		TCHAR buf[MAX_NUMBER_SIZE];
+		TokenToValue(aKey, key);
+		LPTSTR extra = key.symbol == SYM_STRING ? key.marker : nullptr;
+		if (key.symbol == SYM_INTEGER)
+			_i64tot_s(key.value_int64, buf, _countof(buf), 10), extra = buf;
+		Object::Error(ExprTokenType(_T("Item has no value.")), extra, _T("UnsetItemError"));
+		aResultToken.result = FAIL;
+		return false;
+	}
+
+public:
+#define CLASSNAME "HashMap"
+	IObject_Type_Impl;
+	static ObjectMember sMembers[];
+	~HashMap() { ClearAll(); }
+
+	void __New(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		if (aParamCount & 1) {
+			Object::Error(ExprTokenType(_T("Invalid number of parameters.")), nullptr, _T("ValueError"));
+			aResultToken.result = FAIL;
+			return;
+		}
+		if (!Reserve(mCount + aParamCount / 2)) {
+			OutOfMemory();
+			aResultToken.result = FAIL;
+			return;
+		}
+		for (int i = 0; i < aParamCount; i += 2)
+			if (!SetItem(*aParam[i], *aParam[i + 1])) {
+				aResultToken.result = FAIL;
+				return;
+			}
+	}
+
+	void Get(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		TCHAR buf[MAX_NUMBER_SIZE];
+		Key key;
+		ptrdiff_t i;
+		if (!TokenToKey(*aParam[0], key, buf)) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		if ((i = Find(key, Hash(key))) >= 0)
+			ReturnValue(aResultToken, mSlots[i].value);
+		else if (aParamCount > 1 && aParam[1]->symbol != SYM_MISSING) {
+			TokenToValue(*aParam[1], aResultToken);
+			if (aResultToken.symbol == SYM_OBJECT)
+				aResultToken.object->AddRef();
+		}
+		else NotFound(*aParam[0], aResultToken);
+	}
+
+	void Set(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		if (!SetItem(*aParam[0], *aParam[1]))
+			aResultToken.result = FAIL;
+	}
+
+	void __Item(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		if (IS_INVOKE_SET) {
+			// The value is passed first, followed by the key.
+			if (!SetItem(*aParam[1], *aParam[0]))
+				aResultToken.result = FAIL;
+			return;
+		}
+		Get(aResultToken, aID, aFlags, aParam, 1);
+	}
+
+	void Has(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		TCHAR buf[MAX_NUMBER_SIZE];
+		Key key;
+		if (!TokenToKey(*aParam[0], key, buf)) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		aResultToken.SetValue((__int64)(Find(key, Hash(key)) >= 0));
+	}
+
+	void Delete(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		TCHAR buf[MAX_NUMBER_SIZE];
+		Key key;
+		ptrdiff_t i;
+		if (!TokenToKey(*aParam[0], key, buf)) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		if ((i = Find(key, Hash(key))) < 0) {
+			NotFound(*aParam[0], aResultToken);
+			return;
+		}
+		// Return the removed value, transferring its reference to the caller.
+		Value& value = mSlots[i].value;
+		if (value.symbol == SYM_STRING) {
+			aResultToken.AcceptMem(value.string, value.length);
+			value.symbol = SYM_INTEGER;
+		}
+		else {
+			ReturnValue(aResultToken, value);
+		}
+		Erase(i);
+	}
+
+	void Clear(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		ClearAll();
+	}
+
+	void Count(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		aResultToken.SetValue((__int64)mCount);
+	}
+
+	void Capacity(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		if (IS_INVOKE_SET) {
+			ExprTokenType val;
+			TokenToValue(*aParam[0], val);
+			if (val.symbol == SYM_INTEGER && val.value_int64 > 0 && !Reserve((size_t)val.value_int64)) {
+				OutOfMemory();
+				aResultToken.result = FAIL;
+			}
+			return;
+		}
+		aResultToken.SetValue((__int64)(mCapacity - mCapacity / 8));
+	}
+
+	void CaseSense(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		if (IS_INVOKE_SET) {
+			ExprTokenType val;
+			bool caseless;
+			TokenToValue(*aParam[0], val);
+			if (val.symbol == SYM_STRING && (!_tcsicmp(val.marker, _T("On")) || !_tcsicmp(val.marker, _T("Off"))))
+				caseless = !_tcsicmp(val.marker, _T("Off"));
+			else caseless = !TokenToBool(val);
+			if (caseless != mCaseless && mCount) {
+				Object::Error(ExprTokenType(_T("Attempted to change case sensitivity of a map which is not empty.")));
+				aResultToken.result = FAIL;
+				return;
+			}
+			mCaseless = caseless;
+			return;
+		}
+		aResultToken.SetValue((LPTSTR)(mCaseless ? _T("Off") : _T("On")));
+	}
+
+	void __Enum(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount);
+};
+
+class HashMapEnum : public ObjectBase
+{
+	HashMap* mMap;
+	size_t mPos = 0;
+	int mVarCount;
+public:
+	HashMapEnum(HashMap* aMap, int aVarCount) : mMap(aMap), mVarCount(aVarCount) { aMap->AddRef(); }
+	~HashMapEnum() { mMap->Release(); }
+	LPTSTR Type() { return _T("Enumerator"); }
+
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+		if (!IS_INVOKE_CALL || (aName && _tcsicmp(aName, _T("Call"))))
+			return INVOKE_NOT_HANDLED;
+		// Slots may move if the map is resized during enumeration; stop rather than read past the end.
+		for (; mPos < mMap->mCapacity; ++mPos) {
+			if (mMap->mCtrl[mPos] < 0)
+				continue;
+			auto& slot = mMap->mSlots[mPos++];
+			Var* var;
+			if (aParamCount > 0 && (var = TokenToOutputVar(*aParam[0]))) {
+				if (slot.key.symbol == SYM_STRING)
+					var->Assign(slot.key.s, slot.key.length);
+				else if (slot.key.symbol == SYM_OBJECT)
+					var->Assign(slot.key.p);
+				else var->Assign(slot.key.i);
+			}
+			if (aParamCount > 1 && mVarCount > 1 && (var = TokenToOutputVar(*aParam[1]))) {
+				auto& value = slot.value;
+				switch (value.symbol)
+				{
+				case SYM_STRING: var->Assign(value.string, value.length); break;
+				case SYM_OBJECT: var->Assign(value.object); break;
+				case SYM_FLOAT: var->Assign(value.n_double); break;
+				default: var->Assign(value.n_int64);
+				}
+			}
+			aResultToken.SetValue((__int64)1);
+			return OK;
+		}
+		aResultToken.SetValue((__int64)0);
+		return OK;
+	}
+};
+
+void HashMap::__Enum(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+	int var_count = 1;
+	if (aParamCount && aParam[0]->symbol != SYM_MISSING) {
+		ExprTokenType val;
+		TokenToValue(*aParam[0], val);
+		if (val.symbol == SYM_INTEGER)
+			var_count = (int)val.value_int64;
+	}
+	aResultToken.SetValue(new HashMapEnum(this, var_count));
+}
+
+ObjectMember HashMap::sMembers[] = {
+	Object_Method(__New, __New, 0, 0, MAXP_VARIADIC),
+	Object_Method(__Enum, __Enum, 0, 0, 1),
+	Object_Method(Get, Get, 0, 1, 2),
+	Object_Method(Set, Set, 0, 2, 2),
+	Object_Method(Has, Has, 0, 1, 1),
+	Object_BatchMethod(GetMany, HashMap, Get, 0, 1, 2),
+	Object_BatchMethod(HasMany, HashMap, Has, 0, 1, 1),
+	Object_Method(Delete, Delete, 0, 1, 1),
+	Object_Method(Clear, Clear, 0, 0, 0),
+	Object_Get(__Item, __Item, 0, 1, 1),
+	Object_Set(__Item, __Item, 0, 1, 1),
+	Object_Get(Count, Count, 0, 0, 0),
+	Object_Get(Capacity, Capacity, 0, 0, 0),
+	Object_Set(Capacity, Capacity, 0, 0, 0),
+	Object_Get(CaseSense, CaseSense, 0, 0, 0),
+	Object_Set(CaseSense, CaseSense, 0, 0, 0),
+};
+
+ExportSymbol symbols[] = {
+	EXPORT_CLASS(HashMap, MAXP_VARIADIC)
+};
+
+EXPORT_AHKMODULE(symbols)
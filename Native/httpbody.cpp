@@ -0,0 +1,453 @@
+﻿#include "ahk2_types.h"
+#include "simd.h"
+
+// httpbody: request body parsing for HttpServer.ahk.
+//   mod := Native.LoadModule('httpbody.dll')
+//   mp := mod.MultipartParser(boundary)	; the boundary parameter of Content-Type, without the leading '--'
+//   done := mp.Feed(body, length?)	; call again with the same (possibly resized) Buffer as more bytes arrive
+//   for part in mp.Parts	; {key, filename?, type?, ptr, size}, ptr/size is a slice of the last body fed
+//   params := mod.parse_urlencoded(str)	; a caseless Map of the decoded names and values
+//   str := mod.urldecode(str)
+// Feed only scans the bytes added since the previous call, so an upload can be parsed while it
+// is received.  Parts refer into the body without copying; read them before the body is freed
+// or resized.  Escaped bytes are decoded as UTF-8, and '+' is left as is, like UrlUnescape.
+
+class MultipartParser : public Object {
+	enum State { kPreamble, kHeaders, kData, kDone };
+	enum : size_t { kNone = SIZE_MAX };
+	struct Slice { size_t offset, length; };
+	struct Part { Slice key, filename, type, data; };
+
+	char* mDelimiter = nullptr; // CRLF "--" boundary
+	size_t mDelimiterLength = 0;
+	Part* mParts = nullptr;
+	Part mPart;
+	size_t mCount = 0, mCapacity = 0;
+	const char* mBase = nullptr;
+	size_t mLength = 0;
+	size_t mPos = 0;  // Start of the current header line or part data.
+	size_t mScan = 0; // Where the delimiter search resumes.
+	State mState = kPreamble;
+
+	static bool IsSpace(char c) { return c == ' ' || c == '\t'; }
+
+	static Slice Trim(const char* aBase, size_t aStart, size_t aEnd) {
+		while (aStart < aEnd && IsSpace(aBase[aStart]))
+			++aStart;
+		while (aEnd > aStart && IsSpace(aBase[aEnd - 1]))
+			--aEnd;
+		return { aStart, aEnd - aStart };
+	}
+
+	bool Equals(Slice aSlice, const char* aName) {
+		size_t length = strlen(aName);
+		return aSlice.length == length && !_strnicmp(mBase + aSlice.offset, aName, length);
+	}
+
+	// Parses the parameters of a Content-Disposition value, such as: form-data; name="a"; filename="b.txt"
+	void ParseDisposition(size_t aStart, size_t aEnd) {
+		size_t p = aStart;
+		while (p < aEnd && mBase[p] != ';')
+			++p;
+		while (p++ < aEnd) {
+			size_t name_start = p;
+			while (p < aEnd && mBase[p] != '=' && mBase[p] != ';')
+				++p;
+			Slice name = Trim(mBase, name_start, p), value = { p, 0 };
+			if (p < aEnd && mBase[p] == '=') {
+				size_t value_start = ++p;
+				while (value_start < aEnd && IsSpace(mBase[value_start]))
+					++value_start;
+				if (value_start < aEnd && mBase[value_start] == '"') {
+					for (p = ++value_start; p < aEnd && mBase[p] != '"'; ++p);
+					value = { value_start, p - value_start };
+					while (p < aEnd && mBase[p] != ';')
+						++p;
+				}
+				else {
+					while (p < aEnd && mBase[p] != ';')
+						++p;
+					value = Trim(mBase, value_start, p);
+				}
+			}
+			if (Equals(name, "name"))
+				mPart.key = value;
+			else if (Equals(name, "filename"))
+				mPart.filename = value;
+		}
+	}
+
+	void ParseHeader(size_t aStart, size_t aEnd) {
+		size_t colon = aStart;
+		while (colon < aEnd && mBase[colon] != ':')
+			++colon;
+		if (colon == aEnd)
+			return;
+		Slice name = Trim(mBase, aStart, colon);
+		if (Equals(name, "Content-Disposition"))
+			ParseDisposition(colon + 1, aEnd);
+		else if (Equals(name, "Content-Type"))
+			mPart.type = Trim(mBase, colon + 1, aEnd);
+	}
+
+	// Checks what follows a boundary: 1 for CRLF (another part), 2 for "--" (the end),
+	// 0 if more data is needed to tell, or -1 if this is not a delimiter line after all.
+	int DelimiterEnd(size_t aPos) {
+		if (mLength - aPos >= 2 && mBase[aPos] == '-' && mBase[aPos + 1] == '-')
+			return 2;
+		while (aPos < mLength && IsSpace(mBase[aPos])) // Transport padding.
+			++aPos;
+		if (mLength - aPos < 2)
+			return 0;
+		return mBase[aPos] == '\r' && mBase[aPos + 1] == '\n' ? 1 : -1;
+	}
+
+	void BeginPart(size_t aPos) {
+		mPart = { { kNone, 0 }, { kNone, 0 }, { kNone, 0 }, { aPos, 0 } };
+		mState = kHeaders;
+		mPos = aPos;
+	}
+
+	bool EndPart(size_t aEnd) {
+		if (mCount == mCapacity) {
+			size_t newcap = mCapacity ? mCapacity * 2 : 8;
+			Part* newp = (Part*)realloc(mParts, newcap * sizeof(Part));
+			if (!newp)
+				return false;
+			mParts = newp, mCapacity = newcap;
+		}
+		mPart.data.length = aEnd - mPart.data.offset;
+		mParts[mCount++] = mPart;
+		return true;
+	}
+
+	// Parses as far as the available data allows.
+	bool Parse() {
+		const char* end = mBase + mLength;
+		for (;;) {
+			if (mState == kDone)
+				return true;
+			if (mState == kHeaders) {
+				const char* line = mBase + mPos, * lf = line;
+				while ((lf = (const char*)memchr(lf, '\n', end - lf)) && (lf == line || lf[-1] != '\r'))
+					++lf;
+				if (!lf)
+					return true;
+				size_t line_end = lf - 1 - mBase;
+				mPos = lf + 1 - mBase;
+				if (line_end == (size_t)(line - mBase)) {
+					// The blank line ends the headers; the CRLF before the next delimiter belongs to it.
+					mState = kData;
+					mPart.data.offset = mScan = mPos;
+				}
+				else ParseHeader(line - mBase, line_end);
+				continue;
+			}
+			// The first delimiter may also begin the body, without the CRLF.
+			size_t found, after;
+			if (mState == kPreamble && mScan == 0) {
+				size_t length = mDelimiterLength - 2;
+				if (mLength < length + 2)
+					return true;
+				if (!memcmp(mBase, mDelimiter + 2, length)) {
+					found = 0, after = length;
+					goto check_end;
+				}
+			}
+			found = FindBytes(mBase + mScan, end, mDelimiter, mDelimiterLength) - mBase;
+			if (found == mLength) {
+				// Keep the tail which could be the start of a delimiter.
+				if (mLength - mScan >= mDelimiterLength)
+					mScan = mLength - mDelimiterLength + 1;
+				return true;
+			}
+			after = found + mDelimiterLength;
+		check_end:
+			int kind = DelimiterEnd(after);
+			if (kind == 0) {
+				mScan = found;
+				return true;
+			}
+			if (kind < 0) {
+				mScan = found + 1;
+				continue;
+			}
+			if (mState == kData && !EndPart(found))
+				return false;
+			if (kind == 2) {
+				mState = kDone;
+				continue;
+			}
+			while (mBase[after] != '\n')
+				++after;
+			BeginPart(after + 1);
+		}
+	}
+
+	static bool Utf8ToToken(Arena& aArena, const char* aStr, size_t aLength, ExprTokenType& aToken) {
+		LPTSTR str = aArena.Alloc<TCHAR>(aLength + 1);
+		if (!str)
+			return false;
+#ifdef UNICODE
+		size_t length = Utf8ToUtf16(aStr, aStr + aLength, str) - str;
+#else
+		size_t length = aLength;
+		memcpy(str, aStr, aLength);
+#endif
+		str[length] = 0;
+		aToken.SetValue(str, length);
+		return true;
+	}
+
+	bool SetProp(IObject* aObj, LPTSTR aName, Slice aValue, Arena& aArena) {
+		ExprTokenType value;
+		return Utf8ToToken(aArena, mBase + aValue.offset, aValue.length, value) && SetProperty(aObj, aName, value);
+	}
+
+	IObject* PartToObject(IObject* aClass, Part& aPart) {
+		Arena arena(0x400);
+		ExprTokenType value;
+		IObject* obj = CallGlobal(aClass, nullptr, 0);
+		if (!obj)
+			return nullptr;
+		value.SetValue((LPTSTR)_T(""), 0);
+		bool ok = aPart.key.offset == kNone ? SetProperty(obj, _T("key"), value) : SetProp(obj, _T("key"), aPart.key, arena);
+		if (ok && aPart.filename.offset != kNone)
+			ok = SetProp(obj, _T("filename"), aPart.filename, arena);
+		if (ok && aPart.type.offset != kNone)
+			ok = SetProp(obj, _T("type"), aPart.type, arena);
+		if (ok) {
+			value.SetValue((__int64)(size_t)(mBase + aPart.data.offset));
+			ok = SetProperty(obj, _T("ptr"), value);
+		}
+		if (ok) {
+			value.SetValue((__int64)aPart.data.length);
+			ok = SetProperty(obj, _T("size"), value);
+		}
+		if (!ok)
+			obj->Release(), obj = nullptr;
+		return obj;
+	}
+
+	static void OutOfMemory(ResultToken& aResultToken) {
+		Object::Error(ExprTokenType(_T("Out of memory.")), nullptr, _T("MemoryError"));
+		aResultToken.result = FAIL;
+	}
+
+public:
+#define CLASSNAME "MultipartParser"
+	IObject_Type_Impl;
+	static ObjectMember sMembers[];
+	~MultipartParser() { free(mDelimiter), free(mParts); }
+
+	void __New(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		StrRef boundary;
+		if (mDelimiter) {
+			Object::Error(ExprTokenType(_T("Invalid number of parameters.")), nullptr, _T("ValueError"));
+			aResultToken.result = FAIL;
+			return;
+		}
+		if (!BorrowString(*aParam[0], boundary) || !boundary.length || boundary.length > 200) {
+			Object::Error(ExprTokenType(_T("Invalid boundary.")), nullptr, _T("ValueError"));
+			aResultToken.result = FAIL;
+			return;
+		}
+		if (!(mDelimiter = (char*)malloc(boundary.length + 4)))
+			return OutOfMemory(aResultToken);
+		memcpy(mDelimiter, "\r\n--", 4);
+		for (size_t i = 0; i < boundary.length; ++i) // The boundary is restricted to ASCII.
+			mDelimiter[i + 4] = (char)boundary.str[i];
+		mDelimiterLength = boundary.length + 4;
+	}
+
+	// Feed(body, length?): body is a Buffer or an address; length is the number of bytes received so far.
+	void Feed(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		ExprTokenType body, length;
+		const char* base = nullptr;
+		size_t size = kNone;
+		TokenToValue(*aParam[0], body);
+		if (body.symbol == SYM_OBJECT && !_tcscmp(body.object->Type(), _T("Buffer"))) {
+			auto buf = static_cast<BufferObject*>(body.object);
+			base = (const char*)buf->mData, size = buf->mSize;
+		}
+		else if (body.symbol == SYM_INTEGER && aParamCount > 1)
+			base = (const char*)(size_t)body.value_int64;
+		if (aParamCount > 1 && aParam[1]->symbol != SYM_MISSING) {
+			TokenToValue(*aParam[1], length);
+			if (length.symbol != SYM_INTEGER || length.value_int64 < 0 || (size != kNone && (size_t)length.value_int64 > size))
+				base = nullptr;
+			else size = (size_t)length.value_int64;
+		}
+		if (!base || size < mLength) {
+			Object::Error(ExprTokenType(_T("Invalid body or length.")), nullptr, _T("ValueError"));
+			aResultToken.result = FAIL;
+			return;
+		}
+		mBase = base, mLength = size;
+		if (!Parse())
+			return OutOfMemory(aResultToken);
+		aResultToken.SetValue((__int64)(mState == kDone));
+	}
+
+	void Parts(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		static IObject* sArray = GetGlobal(_T("Array")), * sObject = GetGlobal(_T("Object"));
+		Arena arena;
+		ExprTokenType** params = arena.NewParams(mCount);
+		size_t done = 0;
+		bool ok = sArray && sObject && (params || !mCount) && mCount <= INT_MAX;
+		for (; ok && done < mCount; ++done) {
+			IObject* obj = PartToObject(sObject, mParts[done]);
+			if (!obj)
+				ok = false;
+			else params[done]->SetValue(obj);
+		}
+		IObject* arr = ok ? CallGlobal(sArray, params, (int)mCount) : nullptr;
+		for (size_t i = 0; i < done; ++i)
+			if (params[i]->symbol == SYM_OBJECT)
+				params[i]->object->Release();
+		if (arr)
+			aResultToken.SetValue(arr);
+		else aResultToken.result = FAIL;
+	}
+
+	void Done(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		aResultToken.SetValue((__int64)(mState == kDone));
+	}
+};
+
+ObjectMember MultipartParser::sMembers[] = {
+	Object_Method(__New, __New, 0, 1, 1),
+	Object_Method(Feed, Feed, 0, 1, 2),
+	Object_Get(Parts, Parts, 0, 0, 0),
+	Object_Get(Done, Done, 0, 0, 0),
+};
+
+static int HexValue(TCHAR c) {
+	return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+}
+
+// Decodes [aStr, aEnd) into aOut up to aStop1 or aStop2 (0 for none) and returns where it stopped.
+// aOut needs room for as many chars as the input and aBytes for a third of that.
+// Each run of %XX escapes is converted from UTF-8 at once; malformed escapes are kept as is.
+static LPCTSTR DecodeUrl(LPCTSTR aStr, LPCTSTR aEnd, LPTSTR& aOut, char* aBytes, TCHAR aStop1, TCHAR aStop2) {
+	for (;;) {
+		LPCTSTR p = ScanUrlDelim((LPTSTR)aStr, (LPTSTR)aEnd);
+		memcpy(aOut, aStr, (p - aStr) * sizeof(TCHAR));
+		aOut += p - aStr;
+		if (p == aEnd || *p == aStop1 || (aStop2 && *p == aStop2))
+			return p;
+		char* bytes = aBytes;
+		int hi, lo;
+		for (; aEnd - p >= 3 && *p == '%' && (hi = HexValue(p[1])) >= 0 && (lo = HexValue(p[2])) >= 0; p += 3)
+			*bytes++ = (char)(hi << 4 | lo);
+		if (bytes == aBytes)
+			*aOut++ = *p++; // A separator which is not a stop, or a lone '%'.
+		else {
+#ifdef UNICODE
+			aOut = Utf8ToUtf16(aBytes, bytes, aOut);
+#else
+			memcpy(aOut, aBytes, bytes - aBytes);
+			aOut += bytes - aBytes;
+#endif
+		}
+		aStr = p;
+	}
+}
+
+static bool ParamString(ExprTokenType& aToken, StrRef& aRef, ResultToken& aResultToken) {
+	if (BorrowString(aToken, aRef) && aRef.length <= INT_MAX)
+		return true;
+	Object::Error(ExprTokenType(_T("Parameter #1 must be a string.")), nullptr, _T("TypeError"));
+	aResultToken.result = FAIL;
+	return false;
+}
+
+// urldecode(str)
+BIF_DECL(urldecode) {
+	StrRef str;
+	if (!ParamString(*aParam[0], str, aResultToken))
+		return;
+	LPTSTR out = (LPTSTR)malloc((str.length + 1) * sizeof(TCHAR) + str.length / 3 + 1), start = out;
+	if (!out) {
+		Object::Error(ExprTokenType(_T("Out of memory.")), nullptr, _T("MemoryError"));
+		aResultToken.result = FAIL;
+		return;
+	}
+	DecodeUrl(str.str, str.str + str.length, out, (char*)(start + str.length + 1), 0, 0);
+	*out = 0;
+	aResultToken.AcceptMem(start, out - start);
+}
+
+// parse_urlencoded(str): name1=value1&name2=value2...
+BIF_DECL(parse_urlencoded) {
+	static IObject* sMap = GetGlobal(_T("Map"));
+	StrRef str;
+	if (!ParamString(*aParam[0], str, aResultToken))
+		return;
+	LPCTSTR p = str.str, end = p + str.length;
+	size_t pairs = 1;
+	for (LPCTSTR cp = p; cp < end; ++cp)
+		pairs += *cp == '&';
+	// Each name and value needs at most its own length, and a terminator in place of the '=' or '&' after it.
+	Arena arena;
+	LPTSTR out = arena.Alloc<TCHAR>(str.length + 1);
+	char* bytes = arena.Alloc<char>(str.length / 3 + 1);
+	ExprTokenType** params = arena.NewParams(pairs * 2);
+	IObject* map = nullptr;
+	if (!out || !bytes || !params) {
+		Object::Error(ExprTokenType(_T("Out of memory.")), nullptr, _T("MemoryError"));
+		aResultToken.result = FAIL;
+		return;
+	}
+	size_t count = 0;
+	while (p < end) {
+		LPTSTR name = out, value = out;
+		p = DecodeUrl(p, end, out, bytes, '&', '=');
+		size_t name_length = out - name, value_length = 0;
+		*out++ = 0;
+		if (p < end && *p == '=') {
+			value = out;
+			p = DecodeUrl(p + 1, end, out, bytes, '&', 0);
+			value_length = out - value;
+			*out++ = 0;
+		}
+		else value = (LPTSTR)_T("");
+		if (p < end)
+			++p;
+		if (!name_length && !value_length)
+			continue;
+		params[count++]->SetValue(name, name_length);
+		params[count++]->SetValue(value, value_length);
+	}
+	bool ok = sMap && (map = CallGlobal(sMap, nullptr, 0));
+	if (ok) {
+		TCHAR buf[MAX_NUMBER_SIZE];
+		ResultToken r;
+		ExprTokenType casesense, * param = &casesense;
+		casesense.SetValue((__int64)0);
+		r.InitResult(buf);
+		map->Invoke(r, IT_SET, _T("CaseSense"), ExprTokenType(map), &param, 1);
+		r.Free();
+		if ((ok = !r.Exited()) && count) {
+			r.InitResult(buf);
+			map->Invoke(r, IT_CALL, _T("Set"), ExprTokenType(map), params, (int)count);
+			r.Free();
+			ok = !r.Exited();
+		}
+	}
+	if (ok)
+		aResultToken.SetValue(map);
+	else {
+		if (map)
+			map->Release();
+		aResultToken.result = FAIL;
+	}
+}
+
+ExportSymbol symbols[] = {
+	EXPORT_CLASS(MultipartParser, 1)
+	EXPORT_FUNC(urldecode, 1, 1)
+	EXPORT_FUNC(parse_urlencoded, 1, 1)
+};
+
+EXPORT_AHKMODULE(symbols)
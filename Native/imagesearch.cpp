@@ -0,0 +1,1075 @@
+﻿#include "ahk2_types.h"
+#include "simd.h"
+
+// imagesearch: color and picture search over BitmapBuffer pixels, for wincapture.ahk.
+//   im := Native.LoadModule('imagesearch.dll')
+//   pos := im.findColor(bb.info, color, variation := 0, direction := 0, dirty?)	; {x, y}, or "" if there is none
+//   arr := im.findAllColor(bb.info, color, maxcount := 10, variation := 0, direction := 0, dirty?)	; an Array of {x, y}, or ""
+//   pos := im.findMultiColors(bb.info, colors, similarity := 1.0, variation := 0, direction := 0, dirty?)
+//   arr := im.findAllMultiColors(bb.info, colors, similarity := 1.0, maxcount := 10, variation := 0, direction := 0, dirty?)
+//   pos := im.findPic(bb.info, bmp.info, similarity := 1.0, variation := 0, direction := 0, dirty?)
+//   arr := im.findAllPic(bb.info, bmp.info, similarity := 1.0, maxcount := 10, variation := 0, direction := 0, dirty?)
+//   diff := im.FrameDiff(tile := 32)	; tile is a multiple of 8, up to 256
+//   rects := diff.Update(bb.info)	; a Buffer of Int x, y, w, h for the changed runs of tiles
+//   diff.Reset()
+// The parameters mean the same as for the BitmapBuffer methods of the same names, and info is
+// the same descriptor: bits, pitch, width, height, bytespixel, offsetx, offsety.  colors is an
+// Array of [color, dx, dy] or the Buffer findMultiColors packs it into.  Positions include the
+// bitmap's offset, so those found in a range() are relative to the whole capture.
+//
+// A FrameDiff keeps a hash of each tile of the last frame given to Update, which returns the
+// tiles that changed; rects.Size is 0 if none did.  Passed as dirty, it limits a search to
+// positions where the pattern overlaps one of those tiles, so a script polling with
+// waitScreenChange or captureAndSave only searches what changed.
+//
+// Every search is a pattern of pixels, each with a color and a per-channel tolerance, tried at
+// each anchor position; findColor is a pattern of one pixel.  The vector kernels try 8 (32bpp)
+// or 16 (8bpp) adjacent anchors at once, one pattern pixel at a time, and stop as soon as every
+// anchor has more mismatches than the similarity allows.  Since similarity counts pixels, a
+// downscaled level could only reject after as many mismatches as the full one, so there is no
+// pyramid; the pattern starts with pixels spread across the picture instead, which reject most
+// anchors within a few loads.  Large searches are split into bands of rows on the thread pool.
+
+// The BitmapBuffer info descriptor.
+struct BitmapInfo
+{
+	BYTE* bits;
+	int pitch;
+	int width;
+	int height;
+	int bytespixel;
+	int offsetx;
+	int offsety;
+};
+
+struct PatternPixel
+{
+	// Byte offset from the anchor pixel, using the pitch of the bitmap being searched.
+	ptrdiff_t offset;
+	UINT color;
+	// The maximum difference of each channel; 0xFF ignores the channel.
+	UINT tolerance;
+};
+
+struct Pattern
+{
+	PatternPixel* pixels;
+	UINT count;
+	// A match needs at least this many of the pixels to be within tolerance.
+	UINT required;
+	// The pixels' offsets from the anchor span [left, right] x [top, bottom].
+	int left, top, right, bottom;
+};
+
+struct MatchPos
+{
+	int x, y;
+};
+
+static inline UINT LoadPixel(const BYTE* aPixel, int aBytes) {
+	switch (aBytes)
+	{
+	case 4: return *(const UINT*)aPixel;
+	case 3: return aPixel[0] | aPixel[1] << 8 | aPixel[2] << 16;
+	default: return aPixel[0];
+	}
+}
+
+static inline bool PixelNear(UINT aPixel, UINT aColor, UINT aTolerance) {
+	for (int shift = 0; shift < 32; shift += 8) {
+		int a = aPixel >> shift & 0xFF, b = aColor >> shift & 0xFF;
+		if ((a > b ? a - b : b - a) > (int)(aTolerance >> shift & 0xFF))
+			return false;
+	}
+	return true;
+}
+
+//
+// Match kernels.  Each sets a bit in aBits (which starts zeroed) for each of aCount anchors,
+// starting at aAnchor and advancing one pixel at a time, where the pattern matches.
+//
+
+typedef void (*MatchRowType)(const BYTE* aAnchor, int aCount, const Pattern& aPattern, UINT* aBits);
+
+template<int BYTES>
+static bool MatchOne(const BYTE* aAnchor, const Pattern& aPattern) {
+	// Stop once the remaining pixels cannot make up the shortfall.
+	UINT allowed = aPattern.count - aPattern.required, missed = 0;
+	for (UINT i = 0; i < aPattern.count; ++i) {
+		auto& px = aPattern.pixels[i];
+		if (!PixelNear(LoadPixel(aAnchor + px.offset, BYTES), px.color, px.tolerance) && ++missed > allowed)
+			return false;
+	}
+	return true;
+}
+
+template<int BYTES>
+static void MatchRow_Scalar(const BYTE* aAnchor, int aCount, const Pattern& aPattern, UINT* aBits) {
+	for (int i = 0; i < aCount; ++i)
+		if (MatchOne<BYTES>(aAnchor + i * BYTES, aPattern))
+			aBits[i >> 5] |= 1u << (i & 31);
+}
+
+// |a - b| per byte, less the tolerance: zero where the channel is within tolerance.
+static inline __m128i ExcessDiff_SSE2(__m128i a, __m128i b, __m128i aTolerance) {
+	return _mm_subs_epu8(_mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)), aTolerance);
+}
+
+static inline __m256i ExcessDiff_AVX2(__m256i a, __m256i b, __m256i aTolerance) {
+	return _mm256_subs_epu8(_mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a)), aTolerance);
+}
+
+// Anchors are dropped once their matches fall below (pixels tried) - allowed, that is,
+// once they have missed more pixels than the similarity allows.
+
+static UINT MatchBlock32_SSE2(const BYTE* aAnchor, const Pattern& aPattern) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i matches = zero;
+	int allowed = (int)(aPattern.count - aPattern.required);
+	for (UINT i = 0; i < aPattern.count; ++i) {
+		auto& px = aPattern.pixels[i];
+		__m128i p = _mm_loadu_si128((const __m128i*)(aAnchor + px.offset));
+		__m128i excess = ExcessDiff_SSE2(p, _mm_set1_epi32(px.color), _mm_set1_epi32(px.tolerance));
+		matches = _mm_sub_epi32(matches, _mm_cmpeq_epi32(excess, zero));
+		if ((int)i >= allowed && _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32((int)i + 1 - allowed), matches))) == 0xF)
+			return 0;
+	}
+	return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32((int)aPattern.required), matches))) ^ 0xF;
+}
+
+static UINT MatchBlock32_AVX2(const BYTE* aAnchor, const Pattern& aPattern) {
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i matches = zero;
+	int allowed = (int)(aPattern.count - aPattern.required);
+	for (UINT i = 0; i < aPattern.count; ++i) {
+		auto& px = aPattern.pixels[i];
+		__m256i p = _mm256_loadu_si256((const __m256i*)(aAnchor + px.offset));
+		__m256i excess = ExcessDiff_AVX2(p, _mm256_set1_epi32(px.color), _mm256_set1_epi32(px.tolerance));
+		matches = _mm256_sub_epi32(matches, _mm256_cmpeq_epi32(excess, zero));
+		if ((int)i >= allowed && _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32((int)i + 1 - allowed), matches))) == 0xFF)
+			return 0;
+	}
+	return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32((int)aPattern.required), matches))) ^ 0xFF;
+}
+
+// 8bpp counts in 16-bit lanes, so these are only used for patterns of up to INT16_MAX pixels.
+
+static UINT MatchBlock8_SSE2(const BYTE* aAnchor, const Pattern& aPattern) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i matches = zero;
+	int allowed = (int)(aPattern.count - aPattern.required);
+	for (UINT i = 0; i < aPattern.count; ++i) {
+		auto& px = aPattern.pixels[i];
+		__m128i p = _mm_loadl_epi64((const __m128i*)(aAnchor + px.offset));
+		__m128i hit = _mm_cmpeq_epi8(ExcessDiff_SSE2(p, _mm_set1_epi8((char)px.color), _mm_set1_epi8((char)px.tolerance)), zero);
+		matches = _mm_sub_epi16(matches, _mm_unpacklo_epi8(hit, hit));
+		if ((int)i >= allowed && _mm_movemask_epi8(_mm_cmpgt_epi16(_mm_set1_epi16((short)(i + 1 - allowed)), matches)) == 0xFFFF)
+			return 0;
+	}
+	__m128i fail = _mm_cmpgt_epi16(_mm_set1_epi16((short)aPattern.required), matches);
+	return _mm_movemask_epi8(_mm_packs_epi16(fail, zero)) ^ 0xFF;
+}
+
+static UINT MatchBlock8_AVX2(const BYTE* aAnchor, const Pattern& aPattern) {
+	__m256i matches = _mm256_setzero_si256();
+	int allowed = (int)(aPattern.count - aPattern.required);
+	for (UINT i = 0; i < aPattern.count; ++i) {
+		auto& px = aPattern.pixels[i];
+		__m128i p = _mm_loadu_si128((const __m128i*)(aAnchor + px.offset));
+		__m128i hit = _mm_cmpeq_epi8(ExcessDiff_SSE2(p, _mm_set1_epi8((char)px.color), _mm_set1_epi8((char)px.tolerance)), _mm_setzero_si128());
+		matches = _mm256_sub_epi16(matches, _mm256_cvtepi8_epi16(hit));
+		if ((int)i >= allowed && (UINT)_mm256_movemask_epi8(_mm256_cmpgt_epi16(_mm256_set1_epi16((short)(i + 1 - allowed)), matches)) == 0xFFFFFFFF)
+			return 0;
+	}
+	__m256i fail = _mm256_cmpgt_epi16(_mm256_set1_epi16((short)aPattern.required), matches);
+	return _mm_movemask_epi8(_mm_packs_epi16(_mm256_castsi256_si128(fail), _mm256_extracti128_si256(fail, 1))) ^ 0xFFFF;
+}
+
+// Row filters: the anchors whose pixel at aRow + x matches a single color, one bit each.
+// These write whole words of aBits, so a full pattern needs no more work where they fail.
+
+typedef void (*FilterRowType)(const BYTE* aRow, int aCount, UINT aColor, UINT aTolerance, UINT* aBits);
+
+template<int BYTES>
+static void FilterTail(const BYTE* aRow, int i, int aCount, UINT aColor, UINT aTolerance, UINT* aBits) {
+	for (; i < aCount; ++i)
+		if (PixelNear(LoadPixel(aRow + i * BYTES, BYTES), aColor, aTolerance))
+			aBits[i >> 5] |= 1u << (i & 31);
+}
+
+static void FilterRow32_SSE2(const BYTE* aRow, int aCount, UINT aColor, UINT aTolerance, UINT* aBits) {
+	const __m128i color = _mm_set1_epi32(aColor), tolerance = _mm_set1_epi32(aTolerance), zero = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 32 <= aCount; i += 32) {
+		UINT word = 0;
+		for (int k = 0; k < 32; k += 4) {
+			__m128i p = _mm_loadu_si128((const __m128i*)(aRow + (i + k) * 4));
+			word |= (UINT)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(ExcessDiff_SSE2(p, color, tolerance), zero))) << k;
+		}
+		aBits[i >> 5] = word;
+	}
+	FilterTail<4>(aRow, i, aCount, aColor, aTolerance, aBits);
+}
+
+static void FilterRow32_AVX2(const BYTE* aRow, int aCount, UINT aColor, UINT aTolerance, UINT* aBits) {
+	const __m256i color = _mm256_set1_epi32(aColor), tolerance = _mm256_set1_epi32(aTolerance), zero = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 32 <= aCount; i += 32) {
+		UINT word = 0;
+		for (int k = 0; k < 32; k += 8) {
+			__m256i p = _mm256_loadu_si256((const __m256i*)(aRow + (i + k) * 4));
+			word |= (UINT)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(ExcessDiff_AVX2(p, color, tolerance), zero))) << k;
+		}
+		aBits[i >> 5] = word;
+	}
+	FilterTail<4>(aRow, i, aCount, aColor, aTolerance, aBits);
+}
+
+static void FilterRow8_SSE2(const BYTE* aRow, int aCount, UINT aColor, UINT aTolerance, UINT* aBits) {
+	const __m128i color = _mm_set1_epi8((char)aColor), tolerance = _mm_set1_epi8((char)aTolerance), zero = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 32 <= aCount; i += 32) {
+		__m128i lo = _mm_loadu_si128((const __m128i*)(aRow + i)), hi = _mm_loadu_si128((const __m128i*)(aRow + i + 16));
+		aBits[i >> 5] = (UINT)_mm_movemask_epi8(_mm_cmpeq_epi8(ExcessDiff_SSE2(lo, color, tolerance), zero))
+			| (UINT)_mm_movemask_epi8(_mm_cmpeq_epi8(ExcessDiff_SSE2(hi, color, tolerance), zero)) << 16;
+	}
+	FilterTail<1>(aRow, i, aCount, aColor, aTolerance, aBits);
+}
+
+static void FilterRow8_AVX2(const BYTE* aRow, int aCount, UINT aColor, UINT aTolerance, UINT* aBits) {
+	const __m256i color = _mm256_set1_epi8((char)aColor), tolerance = _mm256_set1_epi8((char)aTolerance), zero = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 32 <= aCount; i += 32) {
+		__m256i p = _mm256_loadu_si256((const __m256i*)(aRow + i));
+		aBits[i >> 5] = (UINT)_mm256_movemask_epi8(_mm256_cmpeq_epi8(ExcessDiff_AVX2(p, color, tolerance), zero));
+	}
+	FilterTail<1>(aRow, i, aCount, aColor, aTolerance, aBits);
+}
+
+// Runs a block kernel over whole blocks of LANES anchors and finishes the row one at a time.
+// When every pixel must match, the row is first filtered on the pattern's first pixel, and
+// only the blocks with an anchor left are tried in full.
+template<int BYTES, int LANES, UINT (*BLOCK)(const BYTE*, const Pattern&), FilterRowType FILTER>
+static void MatchRowBlocks(const BYTE* aAnchor, int aCount, const Pattern& aPattern, UINT* aBits) {
+	const UINT lane_mask = (1u << LANES) - 1;
+	int i = 0;
+	if (aPattern.count && aPattern.required == aPattern.count) {
+		auto& first = aPattern.pixels[0];
+		FILTER(aAnchor + first.offset, aCount, first.color, first.tolerance, aBits);
+		if (aPattern.count == 1)
+			return;
+		for (; i + LANES <= aCount; i += LANES)
+			if (UINT lanes = aBits[i >> 5] >> (i & 31) & lane_mask)
+				aBits[i >> 5] ^= (lanes & ~BLOCK(aAnchor + i * BYTES, aPattern)) << (i & 31);
+		for (; i < aCount; ++i)
+			if (aBits[i >> 5] & 1u << (i & 31) && !MatchOne<BYTES>(aAnchor + i * BYTES, aPattern))
+				aBits[i >> 5] &= ~(1u << (i & 31));
+		return;
+	}
+	for (; i + LANES <= aCount; i += LANES)
+		if (UINT mask = BLOCK(aAnchor + i * BYTES, aPattern))
+			aBits[i >> 5] |= mask << (i & 31);
+	for (; i < aCount; ++i)
+		if (MatchOne<BYTES>(aAnchor + i * BYTES, aPattern))
+			aBits[i >> 5] |= 1u << (i & 31);
+}
+
+static MatchRowType SelectMatchRow(int aBytes, UINT aCount) {
+	int features = CpuFeatures();
+	if (aBytes == 4)
+		return features & CPU_AVX2 ? MatchRowBlocks<4, 8, MatchBlock32_AVX2, FilterRow32_AVX2>
+			: features & CPU_SSE2 ? MatchRowBlocks<4, 4, MatchBlock32_SSE2, FilterRow32_SSE2> : MatchRow_Scalar<4>;
+	if (aBytes == 1 && aCount <= INT16_MAX)
+		return features & CPU_AVX2 ? MatchRowBlocks<1, 16, MatchBlock8_AVX2, FilterRow8_AVX2>
+			: features & CPU_SSE2 ? MatchRowBlocks<1, 8, MatchBlock8_SSE2, FilterRow8_SSE2> : MatchRow_Scalar<1>;
+	return aBytes == 1 ? MatchRow_Scalar<1> : MatchRow_Scalar<3>;
+}
+
+//
+// Tile hashing, for FrameDiff.  Each tile gets a 64-bit hash of its pixels, so a frame is
+// compared with the last one without keeping a copy of it.  Pixel rows are hashed in order
+// across the whole frame, each tile's bytes of the row going into four 64-bit accumulators
+// 32 bytes at a time, as in xxHash3: (d ^ key).lo32 * (d ^ key).hi32 + d with its halves
+// swapped.  The key depends on the row and the chunk within the tile, so moving content
+// within a tile changes its hash.
+//
+
+#define TILE_KEY_STEP 0x9E3779B185EBCA87ULL
+
+static const UINT64 TileLaneKeys[4] = {
+	0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL
+};
+
+// The key of a tile's aRow'th row; each following chunk of the row adds TILE_KEY_STEP.
+static inline UINT64 TileRowKey(int aRow) {
+	return (UINT64)(aRow + 1) * 0xC2B2AE3D27D4EB4FULL;
+}
+
+static UINT64 TileDigest(const UINT64 aAcc[4]) {
+	UINT64 h = aAcc[0] ^ _rotl64(aAcc[1], 17) ^ _rotl64(aAcc[2], 31) ^ _rotl64(aAcc[3], 47);
+	h ^= h >> 33, h *= 0xC2B2AE3D27D4EB4FULL;
+	h ^= h >> 29, h *= 0x165667B19E3779F9ULL;
+	return h ^ h >> 32;
+}
+
+// Adds aBytes of a pixel row to the accumulators of the tiles it spans, aTileBytes each.
+typedef void (*HashRowType)(const BYTE* aRow, int aBytes, int aTileBytes, UINT64 aKey, UINT64* aAcc);
+
+// A chunk at the end of a tile, zero-padded to 32 bytes.
+static inline const BYTE* TileChunk(const BYTE* aData, int aSize, BYTE aPadded[32]) {
+	if (aSize >= 32)
+		return aData;
+	memset(aPadded, 0, 32);
+	memcpy(aPadded, aData, aSize);
+	return aPadded;
+}
+
+static void HashRow_Scalar(const BYTE* aRow, int aBytes, int aTileBytes, UINT64 aKey, UINT64* aAcc) {
+	BYTE padded[32];
+	for (int x = 0; x < aBytes; x += aTileBytes, aAcc += 4) {
+		int end = x + aTileBytes < aBytes ? x + aTileBytes : aBytes;
+		UINT64 key = aKey;
+		for (int i = x; i < end; i += 32, key += TILE_KEY_STEP) {
+			const BYTE* chunk = TileChunk(aRow + i, end - i, padded);
+			for (int l = 0; l < 4; ++l) {
+				UINT64 d, dk;
+				memcpy(&d, chunk + l * 8, sizeof(d));
+				dk = d ^ TileLaneKeys[l] ^ key;
+				aAcc[l] += (dk & 0xFFFFFFFF) * (dk >> 32) + (d << 32 | d >> 32);
+			}
+		}
+	}
+}
+
+static inline __m128i TileAccumulate_SSE2(__m128i aAcc, __m128i aData, __m128i aKey) {
+	__m128i dk = _mm_xor_si128(aData, aKey);
+	__m128i product = _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32));
+	return _mm_add_epi64(aAcc, _mm_add_epi64(product, _mm_shuffle_epi32(aData, _MM_SHUFFLE(2, 3, 0, 1))));
+}
+
+static void HashRow_SSE2(const BYTE* aRow, int aBytes, int aTileBytes, UINT64 aKey, UINT64* aAcc) {
+	const __m128i lanes0 = _mm_loadu_si128((const __m128i*)TileLaneKeys), lanes1 = _mm_loadu_si128((const __m128i*)TileLaneKeys + 1);
+	const __m128i step = _mm_set1_epi64x(TILE_KEY_STEP), row_key = _mm_set1_epi64x(aKey);
+	BYTE padded[32];
+	for (int x = 0; x < aBytes; x += aTileBytes, aAcc += 4) {
+		int end = x + aTileBytes < aBytes ? x + aTileBytes : aBytes;
+		__m128i acc0 = _mm_loadu_si128((const __m128i*)aAcc), acc1 = _mm_loadu_si128((const __m128i*)aAcc + 1);
+		__m128i key = row_key;
+		for (int i = x; i < end; i += 32, key = _mm_add_epi64(key, step)) {
+			const BYTE* chunk = TileChunk(aRow + i, end - i, padded);
+			acc0 = TileAccumulate_SSE2(acc0, _mm_loadu_si128((const __m128i*)chunk), _mm_xor_si128(lanes0, key));
+			acc1 = TileAccumulate_SSE2(acc1, _mm_loadu_si128((const __m128i*)chunk + 1), _mm_xor_si128(lanes1, key));
+		}
+		_mm_storeu_si128((__m128i*)aAcc, acc0);
+		_mm_storeu_si128((__m128i*)aAcc + 1, acc1);
+	}
+}
+
+static void HashRow_AVX2(const BYTE* aRow, int aBytes, int aTileBytes, UINT64 aKey, UINT64* aAcc) {
+	const __m256i lanes = _mm256_loadu_si256((const __m256i*)TileLaneKeys);
+	const __m256i step = _mm256_set1_epi64x(TILE_KEY_STEP), row_key = _mm256_set1_epi64x(aKey);
+	BYTE padded[32];
+	for (int x = 0; x < aBytes; x += aTileBytes, aAcc += 4) {
+		int end = x + aTileBytes < aBytes ? x + aTileBytes : aBytes;
+		__m256i acc = _mm256_loadu_si256((const __m256i*)aAcc), key = row_key;
+		for (int i = x; i < end; i += 32, key = _mm256_add_epi64(key, step)) {
+			__m256i d = _mm256_loadu_si256((const __m256i*)TileChunk(aRow + i, end - i, padded));
+			__m256i dk = _mm256_xor_si256(d, _mm256_xor_si256(lanes, key));
+			__m256i product = _mm256_mul_epu32(dk, _mm256_srli_epi64(dk, 32));
+			acc = _mm256_add_epi64(acc, _mm256_add_epi64(product, _mm256_shuffle_epi32(d, _MM_SHUFFLE(2, 3, 0, 1))));
+		}
+		_mm256_storeu_si256((__m256i*)aAcc, acc);
+	}
+}
+
+static HashRowType HashRow = CpuFeatures() & CPU_AVX2 ? HashRow_AVX2 : CpuFeatures() & CPU_SSE2 ? HashRow_SSE2 : HashRow_Scalar;
+
+// Frames of at least this many bytes are hashed on the thread pool, a row of tiles per task.
+#define TILE_PARALLEL_BYTES (1 << 20)
+
+// The tile hashes of the last frame given to a FrameDiff, and which of them it changed.
+struct TileMap
+{
+	int tile = 0, cols = 0, rows = 0;
+	int width = 0, height = 0, bytespixel = 0, offsetx = 0, offsety = 0;
+	UINT64* hashes = nullptr;
+	// One flag per tile, set if the tile differed from the frame before.
+	BYTE* dirty = nullptr;
+
+	TileMap() {}
+	TileMap(const TileMap&) = delete;
+	~TileMap() { Free(); }
+
+	void Free() {
+		free(hashes), free(dirty);
+		hashes = nullptr, dirty = nullptr, cols = rows = 0;
+	}
+
+	// Hashes aBmp and marks the tiles which differ from the previous frame; all of them if
+	// it was the first or of another size or format.  Returns false if out of memory.
+	bool Update(const BitmapInfo& aBmp, Arena& aArena) {
+		bool same = hashes && aBmp.width == width && aBmp.height == height && aBmp.bytespixel == bytespixel;
+		if (!same) {
+			Free();
+			int c = (aBmp.width + tile - 1) / tile, r = (aBmp.height + tile - 1) / tile;
+			hashes = (UINT64*)malloc((size_t)c * r * sizeof(UINT64));
+			dirty = (BYTE*)malloc((size_t)c * r);
+			if (!hashes || !dirty) {
+				Free();
+				return false;
+			}
+			cols = c, rows = r, width = aBmp.width, height = aBmp.height, bytespixel = aBmp.bytespixel;
+		}
+		offsetx = aBmp.offsetx, offsety = aBmp.offsety;
+		struct {
+			const BitmapInfo* bmp;
+			TileMap* map;
+			UINT64* acc;
+			bool same;
+			void operator()(int aRow) {
+				int tile = map->tile, cols = map->cols;
+				UINT64* acc = this->acc + (size_t)aRow * cols * 4;
+				for (int c = 0; c < cols * 4; c += 4)
+					memcpy(acc + c, TileLaneKeys, sizeof(TileLaneKeys));
+				int end = (aRow + 1) * tile < bmp->height ? (aRow + 1) * tile : bmp->height;
+				for (int y = aRow * tile; y < end; ++y)
+					HashRow(bmp->bits + (ptrdiff_t)y * bmp->pitch, bmp->width * bmp->bytespixel, tile * bmp->bytespixel, TileRowKey(y - aRow * tile), acc);
+				UINT64* hashes = map->hashes + (size_t)aRow * cols;
+				BYTE* dirty = map->dirty + (size_t)aRow * cols;
+				for (int c = 0; c < cols; ++c) {
+					UINT64 h = TileDigest(acc + c * 4);
+					dirty[c] = !same || hashes[c] != h;
+					hashes[c] = h;
+				}
+			}
+		} hasher = { &aBmp, this, aArena.Alloc<UINT64>((size_t)rows * cols * 4), same };
+		if (!hasher.acc)
+			return false;
+		if ((size_t)aBmp.width * aBmp.height * aBmp.bytespixel < TILE_PARALLEL_BYTES)
+			for (int r = 0; r < rows; ++r)
+				hasher(r);
+		else RunParallel(rows, hasher);
+		return true;
+	}
+
+	// Sets the bits of aMask for anchors [aX0, aX0 + aCount) of a bitmap at aOffsetX whose
+	// columns [x + aLeft, x + aRight] overlap a dirty tile in tile rows [aTop, aBottom].
+	void DirtyAnchors(int aTop, int aBottom, int aOffsetX, int aX0, int aCount, int aLeft, int aRight, UINT* aMask, UINT aWords) const {
+		memset(aMask, 0, aWords * sizeof(UINT));
+		for (int c = 0; c < cols; ++c) {
+			bool changed = false;
+			for (int r = aTop; r <= aBottom && !changed; ++r)
+				changed = dirty[(size_t)r * cols + c];
+			if (!changed)
+				continue;
+			// The tile's columns, relative to the first anchor.
+			int tx = c * tile + offsetx - aOffsetX - aX0;
+			int tw = (c + 1) * tile < width ? tile : width - c * tile;
+			int first = tx - aRight, last = tx + tw - 1 - aLeft;
+			if (first < 0) first = 0;
+			if (last >= aCount) last = aCount - 1;
+			for (int i = first; i <= last; ++i)
+				aMask[i >> 5] |= 1u << (i & 31);
+		}
+	}
+};
+
+//
+// Search driver.  Anchor rows are split into bands, in the order given by direction, and each
+// band keeps up to max matches.  A band stops early once an earlier band has max matches, as
+// its own could never be returned.
+//
+
+// Below this many pixel comparisons, a search runs on the calling thread.
+#define PARALLEL_WORK (1 << 20)
+
+struct Search
+{
+	const BitmapInfo* bmp;
+	const Pattern* pattern;
+	MatchRowType match_row;
+	int direction;
+	UINT max;
+	// Anchors: x in [x0, x0 + xcount), y in [y0, y0 + ycount).
+	int x0, xcount, y0, ycount;
+	int band_rows;
+	UINT words;
+	UINT* bits;
+	MatchPos* matches;
+	UINT* found;
+	// The lowest band which has max matches.
+	volatile LONG full_band;
+	// If set, only anchors where the pattern overlaps a dirty tile are tried, using a mask
+	// of words bits per band.
+	const TileMap* tiles;
+	UINT* masks;
+
+	// Matches the anchors of row y which are near a dirty tile.  aTop and aBottom are the
+	// tile rows aMask was last built for.
+	bool MatchDirty(int y, const BYTE* aAnchor, UINT* aBits, UINT* aMask, int& aTop, int& aBottom) {
+		int fy0 = y + pattern->top + bmp->offsety - tiles->offsety, fy1 = y + pattern->bottom + bmp->offsety - tiles->offsety;
+		if (fy0 < 0) fy0 = 0;
+		if (fy1 >= tiles->height) fy1 = tiles->height - 1;
+		if (fy0 > fy1)
+			return false;
+		if (aTop != fy0 / tiles->tile || aBottom != fy1 / tiles->tile) {
+			aTop = fy0 / tiles->tile, aBottom = fy1 / tiles->tile;
+			tiles->DirtyAnchors(aTop, aBottom, bmp->offsetx, x0, xcount, pattern->left, pattern->right, aMask, words);
+		}
+		bool any = false;
+		for (UINT w = 0; w < words; ) {
+			if (!aMask[w]) {
+				++w;
+				continue;
+			}
+			UINT end = w + 1;
+			while (end < words && aMask[end])
+				++end;
+			int first = (int)w * 32, last = (int)end * 32 < xcount ? (int)end * 32 : xcount;
+			match_row(aAnchor + (ptrdiff_t)first * bmp->bytespixel, last - first, *pattern, aBits + w);
+			for (; w < end; ++w)
+				aBits[w] &= aMask[w];
+			any = true;
+		}
+		return any;
+	}
+
+	void operator()(int aBand) {
+		UINT* bits = this->bits + (size_t)aBand * words;
+		MatchPos* out = matches + (size_t)aBand * max;
+		UINT* mask = tiles ? masks + (size_t)aBand * words : nullptr;
+		int mask_top = -1, mask_bottom = -1;
+		UINT count = 0;
+		int end = (aBand + 1) * band_rows < ycount ? (aBand + 1) * band_rows : ycount;
+		for (int r = aBand * band_rows; r < end && full_band > aBand; ++r) {
+			int y = direction & 2 ? y0 + ycount - 1 - r : y0 + r;
+			const BYTE* anchor = bmp->bits + (ptrdiff_t)y * bmp->pitch + (ptrdiff_t)x0 * bmp->bytespixel;
+			memset(bits, 0, words * sizeof(UINT));
+			if (!tiles)
+				match_row(anchor, xcount, *pattern, bits);
+			else if (!MatchDirty(y, anchor, bits, mask, mask_top, mask_bottom))
+				continue;
+			for (UINT w = 0; w < words; ++w) {
+				UINT word = direction & 1 ? words - 1 - w : w;
+				for (UINT mask = bits[word]; mask; ) {
+					unsigned long bit;
+					if (direction & 1)
+						_BitScanReverse(&bit, mask);
+					else _BitScanForward(&bit, mask);
+					mask &= ~(1u << bit);
+					out[count].x = x0 + (int)(word * 32 + bit), out[count].y = y;
+					if (++count == max) {
+						found[aBand] = count;
+						for (LONG prev = full_band; aBand < prev; prev = full_band)
+							if (InterlockedCompareExchange(&full_band, aBand, prev) == prev)
+								break;
+						return;
+					}
+				}
+			}
+		}
+		found[aBand] = count;
+	}
+};
+
+// Finds up to aMax anchors where aPattern matches, in direction order, and near a dirty tile
+// if aTiles is given.  Returns the number found, or -1 if out of memory.
+static int FindPattern(const BitmapInfo& aBmp, const Pattern& aPattern, int aDirection, UINT aMax, MatchPos*& aMatches, Arena& aArena, const TileMap* aTiles = nullptr) {
+	Search s;
+	s.bmp = &aBmp, s.pattern = &aPattern, s.direction = aDirection, s.max = aMax, s.tiles = aTiles;
+	s.x0 = -aPattern.left, s.xcount = aBmp.width - aPattern.right + aPattern.left;
+	s.y0 = -aPattern.top, s.ycount = aBmp.height - aPattern.bottom + aPattern.top;
+	aMatches = nullptr;
+	if (s.xcount <= 0 || s.ycount <= 0)
+		return 0;
+	s.match_row = SelectMatchRow(aBmp.bytespixel, aPattern.count);
+	// Rejecting an anchor takes at most allowed + 1 comparisons.
+	UINT allowed = aPattern.count - aPattern.required;
+	double work = (double)s.xcount * s.ycount * (allowed < aPattern.count ? allowed + 1 : 1);
+	int bands = work < PARALLEL_WORK ? 1 : ThreadCount() * 4;
+	if (bands > s.ycount)
+		bands = s.ycount;
+	s.band_rows = (s.ycount + bands - 1) / bands;
+	bands = (s.ycount + s.band_rows - 1) / s.band_rows;
+	s.words = ((UINT)s.xcount + 31) / 32;
+	if (s.max > (size_t)s.xcount * s.band_rows)
+		s.max = (UINT)((size_t)s.xcount * s.band_rows);
+	s.bits = aArena.Alloc<UINT>((size_t)bands * s.words);
+	s.matches = aArena.Alloc<MatchPos>((size_t)bands * s.max);
+	s.found = aArena.Alloc<UINT>(bands);
+	s.masks = aTiles ? aArena.Alloc<UINT>((size_t)bands * s.words) : nullptr;
+	if (!s.bits || !s.matches || !s.found || (aTiles && !s.masks))
+		return -1;
+	s.full_band = bands;
+	RunParallel(bands, s);
+	// Bands are in order, so the first aMax matches of all bands are the ones to return.
+	UINT total = 0;
+	for (int b = 0; b < bands && total < aMax; ++b) {
+		UINT n = s.found[b] < aMax - total ? s.found[b] : aMax - total;
+		memmove(s.matches + total, s.matches + (size_t)b * s.max, n * sizeof(MatchPos));
+		total += n;
+	}
+	aMatches = s.matches;
+	return (int)total;
+}
+
+//
+// Parameters and results.
+//
+
+static bool Fail(ResultToken& aResultToken, LPTSTR aMessage, LPTSTR aType = _T("ValueError")) {
+	Object::Error(ExprTokenType(aMessage), nullptr, aType);
+	aResultToken.result = FAIL;
+	return false;
+}
+
+// info: the info Buffer of a BitmapBuffer, or its address.
+static bool ParamBitmap(ExprTokenType& aParam, BitmapInfo& aBmp, ResultToken& aResultToken) {
+	ExprTokenType val;
+	TokenToValue(aParam, val);
+	const BYTE* info;
+	if (val.symbol == SYM_OBJECT && !_tcscmp(val.object->Type(), _T("Buffer"))
+		&& static_cast<BufferObject*>(val.object)->mSize >= sizeof(void*) + 6 * sizeof(int))
+		info = (const BYTE*)static_cast<BufferObject*>(val.object)->mData;
+	else if (val.symbol == SYM_INTEGER && val.value_int64)
+		info = (const BYTE*)(size_t)val.value_int64;
+	else
+		return Fail(aResultToken, _T("Expected a bitmap info Buffer."), _T("TypeError"));
+	// The fields are packed after the pointer, as BitmapBuffer writes them with NumPut.
+	const int* fields = (const int*)(info + sizeof(void*));
+	aBmp.bits = *(BYTE* const*)info;
+	aBmp.pitch = fields[0], aBmp.width = fields[1], aBmp.height = fields[2];
+	aBmp.bytespixel = fields[3], aBmp.offsetx = fields[4], aBmp.offsety = fields[5];
+	if (!aBmp.bits || aBmp.width <= 0 || aBmp.height <= 0
+		|| (aBmp.bytespixel != 1 && aBmp.bytespixel != 3 && aBmp.bytespixel != 4)
+		|| (aBmp.pitch < 0 ? -aBmp.pitch : aBmp.pitch) < aBmp.width * aBmp.bytespixel)
+		return Fail(aResultToken, _T("Invalid bitmap."));
+	return true;
+}
+
+static bool ParamInt(ExprTokenType* aParam[], int aParamCount, int aIndex, __int64 aDefault, __int64& aValue, ResultToken& aResultToken) {
+	aValue = aDefault;
+	if (aParamCount <= aIndex || aParam[aIndex]->symbol == SYM_MISSING)
+		return true;
+	ExprTokenType val;
+	TokenToValue(*aParam[aIndex], val);
+	if (val.symbol != SYM_INTEGER)
+		return Fail(aResultToken, _T("Expected an Integer."), _T("TypeError"));
+	aValue = val.value_int64;
+	return true;
+}
+
+static bool ParamSimilarity(ExprTokenType* aParam[], int aParamCount, int aIndex, double& aValue, ResultToken& aResultToken) {
+	aValue = 1.0;
+	if (aParamCount <= aIndex || aParam[aIndex]->symbol == SYM_MISSING)
+		return true;
+	ExprTokenType val;
+	TokenToValue(*aParam[aIndex], val);
+	if (val.symbol == SYM_INTEGER)
+		aValue = (double)val.value_int64;
+	else if (val.symbol == SYM_FLOAT)
+		aValue = val.value_double;
+	else
+		return Fail(aResultToken, _T("Expected a Number."), _T("TypeError"));
+	if (!(aValue >= 0.0 && aValue <= 1.0))
+		return Fail(aResultToken, _T("Invalid similarity."));
+	return true;
+}
+
+// The common trailing parameters: maxcount (for findAll*), variation and direction.
+static bool ParamSearch(ExprTokenType* aParam[], int aParamCount, int aIndex, bool aAll, UINT& aMax, __int64& aVariation, int& aDirection, ResultToken& aResultToken) {
+	__int64 max = 1, direction;
+	if ((aAll && !ParamInt(aParam, aParamCount, aIndex++, 10, max, aResultToken))
+		|| !ParamInt(aParam, aParamCount, aIndex++, 0, aVariation, aResultToken)
+		|| !ParamInt(aParam, aParamCount, aIndex, 0, direction, aResultToken))
+		return false;
+	if (max < 1 || max > INT_MAX)
+		return Fail(aResultToken, _T("Invalid maxcount."));
+	if (direction < 0 || direction > 3)
+		return Fail(aResultToken, _T("Invalid direction."));
+	aMax = (UINT)max, aDirection = (int)direction;
+	return true;
+}
+
+// The channels compared for a pixel format; 32bpp colors without alpha ignore the pixel's alpha.
+static UINT ColorTolerance(int aBytes, UINT aColor, UINT aVariation) {
+	if (aBytes == 1)
+		return aVariation & 0xFF;
+	if (aBytes == 3)
+		return aVariation & 0xFFFFFF;
+	return aColor >> 24 ? aVariation : aVariation | 0xFF000000;
+}
+
+static UINT ColorKey(int aBytes, UINT aColor) {
+	return aBytes == 4 ? aColor : aBytes == 3 ? aColor & 0xFFFFFF : aColor & 0xFF;
+}
+
+static UINT Required(UINT aCount, double aSimilarity) {
+	// Rounded up, less a little for the float error in values such as 0.9.
+	double exact = aCount * aSimilarity - 1e-6;
+	UINT required = exact <= 0 ? 0 : (UINT)exact;
+	return required < exact && required < aCount ? required + 1 : required;
+}
+
+static void PatternBounds(Pattern& aPattern, const int* aXY, UINT aCount) {
+	// The anchor itself must be inside the bitmap, as it is the position returned.
+	aPattern.left = aPattern.right = aPattern.top = aPattern.bottom = 0;
+	for (UINT i = 0; i < aCount; ++i) {
+		int x = aXY[i * 2], y = aXY[i * 2 + 1];
+		if (x < aPattern.left) aPattern.left = x;
+		if (x > aPattern.right) aPattern.right = x;
+		if (y < aPattern.top) aPattern.top = y;
+		if (y > aPattern.bottom) aPattern.bottom = y;
+	}
+}
+
+static IObject* NewPos(const BitmapInfo& aBmp, const MatchPos& aPos) {
+	static IObject* sObject = GetGlobal(_T("Object"));
+	IObject* obj = sObject ? CallGlobal(sObject, nullptr, 0) : nullptr;
+	ExprTokenType value;
+	if (!obj)
+		return nullptr;
+	value.SetValue((__int64)aPos.x + aBmp.offsetx);
+	if (SetProperty(obj, _T("x"), value)) {
+		value.SetValue((__int64)aPos.y + aBmp.offsety);
+		if (SetProperty(obj, _T("y"), value))
+			return obj;
+	}
+	obj->Release();
+	return nullptr;
+}
+
+// Returns the first match as {x, y} or all of them as an Array, or "" if there are none.
+static void ReturnMatches(ResultToken& aResultToken, const BitmapInfo& aBmp, const MatchPos* aMatches, int aCount, bool aAll, Arena& aArena) {
+	static IObject* sArray = GetGlobal(_T("Array"));
+	if (aCount < 0) {
+		Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+		return;
+	}
+	if (!aCount) {
+		aResultToken.SetValue(_T(""), 0);
+		return;
+	}
+	if (!aAll) {
+		if (IObject* obj = NewPos(aBmp, aMatches[0]))
+			aResultToken.SetValue(obj);
+		else aResultToken.result = FAIL;
+		return;
+	}
+	ExprTokenType** params = aArena.NewParams(aCount);
+	int done = 0;
+	bool ok = sArray && params;
+	for (; ok && done < aCount; ++done) {
+		IObject* obj = NewPos(aBmp, aMatches[done]);
+		if (!obj)
+			ok = false;
+		else params[done]->SetValue(obj);
+	}
+	IObject* arr = ok ? CallGlobal(sArray, params, aCount) : nullptr;
+	for (int i = 0; i < done; ++i)
+		if (params[i]->symbol == SYM_OBJECT)
+			params[i]->object->Release();
+	if (arr)
+		aResultToken.SetValue(arr);
+	else aResultToken.result = FAIL;
+}
+
+//
+// Exports.
+//
+
+class FrameDiff : public Object {
+public:
+#define CLASSNAME "FrameDiff"
+	IObject_Type_Impl;
+	static ObjectMember sMembers[];
+	TileMap mTiles;
+
+	// __New(tile := 32)
+	void __New(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		__int64 tile;
+		if (!ParamInt(aParam, aParamCount, 0, 32, tile, aResultToken))
+			return;
+		if (tile < 8 || tile > 256 || tile % 8)
+			Fail(aResultToken, _T("Invalid tile size."));
+		else mTiles.tile = (int)tile;
+	}
+
+	// Update(info): the tiles which changed since the previous frame, as a Buffer of Int
+	// x, y, w, h for each run of adjacent tiles in a row, or all of them for the first frame.
+	void Update(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		BitmapInfo bmp;
+		Arena arena;
+		if (!mTiles.tile) {
+			Fail(aResultToken, _T("The FrameDiff was not initialized."), _T("Error"));
+			return;
+		}
+		if (!ParamBitmap(*aParam[0], bmp, aResultToken))
+			return;
+		if (!mTiles.Update(bmp, arena)) {
+			Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+			return;
+		}
+		size_t runs = 0;
+		for (int r = 0; r < mTiles.rows; ++r)
+			for (int c = 0; c < mTiles.cols; ++c)
+				runs += mTiles.dirty[(size_t)r * mTiles.cols + c] && (!c || !mTiles.dirty[(size_t)r * mTiles.cols + c - 1]);
+		BufferObject* buf;
+		if (!NewBuffer(runs * 4 * sizeof(int), buf)) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		int* out = (int*)buf->mData, tile = mTiles.tile;
+		for (int r = 0; r < mTiles.rows; ++r) {
+			const BYTE* dirty = mTiles.dirty + (size_t)r * mTiles.cols;
+			for (int c = 0; c < mTiles.cols; ) {
+				if (!dirty[c]) {
+					++c;
+					continue;
+				}
+				int end = c + 1;
+				while (end < mTiles.cols && dirty[end])
+					++end;
+				int x = c * tile, y = r * tile;
+				out[0] = x + mTiles.offsetx, out[1] = y + mTiles.offsety;
+				out[2] = (end * tile < mTiles.width ? end * tile : mTiles.width) - x;
+				out[3] = ((r + 1) * tile < mTiles.height ? (r + 1) * tile : mTiles.height) - y;
+				out += 4, c = end;
+			}
+		}
+		aResultToken.SetValue(buf);
+	}
+
+	// Reset(): forgets the previous frame, so the next Update reports every tile.
+	void Reset(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		mTiles.Free();
+	}
+};
+
+ObjectMember FrameDiff::sMembers[] = {
+	Object_Method(__New, __New, 0, 0, 1),
+	Object_Method(Update, Update, 0, 1, 1),
+	Object_Method(Reset, Reset, 0, 0, 0),
+};
+
+// dirty: a FrameDiff to search only where its last Update found changes.  Positions outside
+// its frames are taken as unchanged.
+static bool ParamDirty(ExprTokenType* aParam[], int aParamCount, int aIndex, const TileMap*& aTiles, ResultToken& aResultToken) {
+	aTiles = nullptr;
+	if (aParamCount <= aIndex || aParam[aIndex]->symbol == SYM_MISSING)
+		return true;
+	ExprTokenType val;
+	TokenToValue(*aParam[aIndex], val);
+	if (val.symbol != SYM_OBJECT || _tcscmp(val.object->Type(), _T("FrameDiff")))
+		return Fail(aResultToken, _T("Expected a FrameDiff."), _T("TypeError"));
+	// Before its first Update, every tile counts as changed.
+	auto& tiles = static_cast<FrameDiff*>(val.object)->mTiles;
+	aTiles = tiles.hashes ? &tiles : nullptr;
+	return true;
+}
+
+static void FindColor(ResultToken& aResultToken, ExprTokenType* aParam[], int aParamCount, bool aAll) {
+	BitmapInfo bmp;
+	__int64 color, variation;
+	UINT max;
+	int direction;
+	const TileMap* tiles;
+	if (!ParamBitmap(*aParam[0], bmp, aResultToken)
+		|| !ParamInt(aParam, aParamCount, 1, 0, color, aResultToken)
+		|| !ParamSearch(aParam, aParamCount, 2, aAll, max, variation, direction, aResultToken)
+		|| !ParamDirty(aParam, aParamCount, aAll ? 5 : 4, tiles, aResultToken))
+		return;
+	Arena arena;
+	PatternPixel px = { 0, ColorKey(bmp.bytespixel, (UINT)color), ColorTolerance(bmp.bytespixel, (UINT)color, (UINT)variation) };
+	Pattern pattern = { &px, 1, 1, 0, 0, 0, 0 };
+	MatchPos* matches;
+	int count = FindPattern(bmp, pattern, direction, max, matches, arena, tiles);
+	ReturnMatches(aResultToken, bmp, matches, count, aAll, arena);
+}
+
+// colors: an Array of [color, dx, dy], or a Buffer of its count followed by each triple, as Ints.
+static bool ParamColors(ExprTokenType& aParam, const BitmapInfo& aBmp, UINT aVariation, double aSimilarity, Pattern& aPattern, Arena& aArena, ResultToken& aResultToken) {
+	ExprTokenType val;
+	TokenToValue(aParam, val);
+	int* triples = nullptr;
+	UINT count = 0;
+	if (val.symbol == SYM_OBJECT && !_tcscmp(val.object->Type(), _T("Buffer"))) {
+		auto buf = static_cast<BufferObject*>(val.object);
+		int* data = (int*)buf->mData;
+		if (buf->mSize < sizeof(int) || data[0] < 0 || (size_t)data[0] > (buf->mSize / sizeof(int) - 1) / 3)
+			return Fail(aResultToken, _T("Invalid colors."));
+		count = (UINT)data[0], triples = data + 1;
+	}
+	else if (val.symbol == SYM_OBJECT && !_tcscmp(val.object->Type(), _T("Array"))) {
+		auto arr = static_cast<Array*>(val.object);
+		count = arr->mLength;
+		if (!(triples = aArena.Alloc<int>((size_t)count * 3 + 1)))
+			return Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+		for (UINT i = 0; i < count; ++i) {
+			ExprTokenType item;
+			VariantToToken(arr->mItem[i], item);
+			if (item.symbol != SYM_OBJECT || _tcscmp(item.object->Type(), _T("Array")) || static_cast<Array*>(item.object)->mLength != 3)
+				return Fail(aResultToken, _T("Expected an Array of [color, dx, dy]."), _T("TypeError"));
+			auto triple = static_cast<Array*>(item.object);
+			for (int k = 0; k < 3; ++k) {
+				ExprTokenType n;
+				VariantToToken(triple->mItem[k], n);
+				if (n.symbol != SYM_INTEGER)
+					return Fail(aResultToken, _T("Expected an Array of [color, dx, dy]."), _T("TypeError"));
+				triples[i * 3 + k] = (int)n.value_int64;
+			}
+		}
+	}
+	else
+		return Fail(aResultToken, _T("Expected an Array or Buffer of colors."), _T("TypeError"));
+	if (!count)
+		return Fail(aResultToken, _T("Invalid colors."));
+	auto pixels = aArena.Alloc<PatternPixel>(count);
+	auto xy = aArena.Alloc<int>((size_t)count * 2);
+	if (!pixels || !xy)
+		return Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+	for (UINT i = 0; i < count; ++i) {
+		UINT color = (UINT)triples[i * 3];
+		int dx = triples[i * 3 + 1], dy = triples[i * 3 + 2];
+		if (dx <= -aBmp.width || dx >= aBmp.width || dy <= -aBmp.height || dy >= aBmp.height)
+			return Fail(aResultToken, _T("Invalid colors."));
+		pixels[i].offset = (ptrdiff_t)dy * aBmp.pitch + (ptrdiff_t)dx * aBmp.bytespixel;
+		pixels[i].color = ColorKey(aBmp.bytespixel, color);
+		pixels[i].tolerance = ColorTolerance(aBmp.bytespixel, color, aVariation);
+		xy[i * 2] = dx, xy[i * 2 + 1] = dy;
+	}
+	aPattern.pixels = pixels, aPattern.count = count;
+	aPattern.required = Required(count, aSimilarity);
+	PatternBounds(aPattern, xy, count);
+	return true;
+}
+
+static void FindMultiColors(ResultToken& aResultToken, ExprTokenType* aParam[], int aParamCount, bool aAll) {
+	BitmapInfo bmp;
+	__int64 variation;
+	double similarity;
+	UINT max;
+	int direction;
+	Pattern pattern;
+	Arena arena;
+	MatchPos* matches;
+	const TileMap* tiles;
+	if (!ParamBitmap(*aParam[0], bmp, aResultToken)
+		|| !ParamSimilarity(aParam, aParamCount, 2, similarity, aResultToken)
+		|| !ParamSearch(aParam, aParamCount, 3, aAll, max, variation, direction, aResultToken)
+		|| !ParamDirty(aParam, aParamCount, aAll ? 6 : 5, tiles, aResultToken)
+		|| !ParamColors(*aParam[1], bmp, (UINT)variation, similarity, pattern, arena, aResultToken))
+		return;
+	int count = FindPattern(bmp, pattern, direction, max, matches, arena, tiles);
+	ReturnMatches(aResultToken, bmp, matches, count, aAll, arena);
+}
+
+// Number of template pixels tried first, spread evenly over the picture.
+#define PATTERN_PROBES 16
+
+// Builds the pattern of a picture's opaque pixels.  For 32bpp, a pixel with alpha < 255 is
+// transparent and the searched bitmap's alpha is ignored.  A non-zero transparent color also
+// makes pixels of that RGB (or gray level) transparent.
+static bool PicturePattern(const BitmapInfo& aBmp, const BitmapInfo& aPic, __int64 aVariation, double aSimilarity, Pattern& aPattern, Arena& aArena, ResultToken& aResultToken) {
+	if (aPic.bytespixel != aBmp.bytespixel)
+		return Fail(aResultToken, _T("The bitmaps have different pixel formats."));
+	int bytes = aPic.bytespixel;
+	UINT transparent = (UINT)(aVariation >> 32), key_mask = bytes == 1 ? 0xFF : 0xFFFFFF;
+	UINT tolerance = ColorTolerance(bytes, 0, (UINT)aVariation);
+	size_t area = (size_t)aPic.width * aPic.height;
+	auto pixels = aArena.Alloc<PatternPixel>(area);
+	auto order = aArena.Alloc<PatternPixel>(area);
+	if (!pixels || !order)
+		return Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+	UINT count = 0;
+	for (int y = 0; y < aPic.height; ++y) {
+		const BYTE* row = aPic.bits + (ptrdiff_t)y * aPic.pitch;
+		for (int x = 0; x < aPic.width; ++x) {
+			UINT color = LoadPixel(row + x * bytes, bytes);
+			if ((bytes == 4 && color >> 24 != 0xFF) || (transparent && (color & key_mask) == (transparent & key_mask)))
+				continue;
+			auto& px = pixels[count++];
+			px.offset = (ptrdiff_t)y * aBmp.pitch + (ptrdiff_t)x * bytes;
+			px.color = color, px.tolerance = tolerance;
+		}
+	}
+	// Probes first, then the rest in row order, which keeps the loads mostly sequential.
+	UINT probes = count < PATTERN_PROBES ? count : PATTERN_PROBES, n = 0;
+	for (UINT i = 0; i < probes; ++i)
+		order[n++] = pixels[(size_t)count * (2 * i + 1) / (2 * probes)];
+	for (UINT i = 0, next = 0; i < count; ++i) {
+		if (next < probes && i == (size_t)count * (2 * next + 1) / (2 * probes)) {
+			++next;
+			continue;
+		}
+		order[n++] = pixels[i];
+	}
+	aPattern.pixels = order, aPattern.count = count;
+	aPattern.required = Required(count, aSimilarity);
+	aPattern.left = aPattern.top = 0;
+	aPattern.right = aPic.width - 1, aPattern.bottom = aPic.height - 1;
+	return true;
+}
+
+static void FindPic(ResultToken& aResultToken, ExprTokenType* aParam[], int aParamCount, bool aAll) {
+	BitmapInfo bmp, pic;
+	__int64 variation;
+	double similarity;
+	UINT max;
+	int direction;
+	Pattern pattern;
+	Arena arena;
+	MatchPos* matches;
+	const TileMap* tiles;
+	if (!ParamBitmap(*aParam[0], bmp, aResultToken)
+		|| !ParamBitmap(*aParam[1], pic, aResultToken)
+		|| !ParamSimilarity(aParam, aParamCount, 2, similarity, aResultToken)
+		|| !ParamSearch(aParam, aParamCount, 3, aAll, max, variation, direction, aResultToken)
+		|| !ParamDirty(aParam, aParamCount, aAll ? 6 : 5, tiles, aResultToken)
+		|| !PicturePattern(bmp, pic, variation, similarity, pattern, arena, aResultToken))
+		return;
+	int count = FindPattern(bmp, pattern, direction, max, matches, arena, tiles);
+	ReturnMatches(aResultToken, bmp, matches, count, aAll, arena);
+}
+
+// findColor(info, color, variation := 0, direction := 0, dirty?)
+BIF_DECL(findColor) {
+	FindColor(aResultToken, aParam, aParamCount, false);
+}
+
+// findAllColor(info, color, maxcount := 10, variation := 0, direction := 0, dirty?)
+BIF_DECL(findAllColor) {
+	FindColor(aResultToken, aParam, aParamCount, true);
+}
+
+// findMultiColors(info, colors, similarity := 1.0, variation := 0, direction := 0, dirty?)
+BIF_DECL(findMultiColors) {
+	FindMultiColors(aResultToken, aParam, aParamCount, false);
+}
+
+// findAllMultiColors(info, colors, similarity := 1.0, maxcount := 10, variation := 0, direction := 0, dirty?)
+BIF_DECL(findAllMultiColors) {
+	FindMultiColors(aResultToken, aParam, aParamCount, true);
+}
+
+// findPic(info, pic_info, similarity := 1.0, variation := 0, direction := 0, dirty?)
+BIF_DECL(findPic) {
+	FindPic(aResultToken, aParam, aParamCount, false);
+}
+
+// findAllPic(info, pic_info, similarity := 1.0, maxcount := 10, variation := 0, direction := 0, dirty?)
+BIF_DECL(findAllPic) {
+	FindPic(aResultToken, aParam, aParamCount, true);
+}
+
+ExportSymbol symbols[] = {
+	EXPORT_CLASS(FrameDiff, 1)
+	EXPORT_FUNC(findColor, 2, 5)
+	EXPORT_FUNC(findAllColor, 2, 6)
+	EXPORT_FUNC(findMultiColors, 2, 6)
+	EXPORT_FUNC(findAllMultiColors, 2, 7)
+	EXPORT_FUNC(findPic, 2, 6)
+	EXPORT_FUNC(findAllPic, 2, 7)
+};
+
+EXPORT_AHKMODULE(symbols)
@@ -0,0 +1,647 @@
+﻿#include "ahk2_types.h"
+#include "simd.h"
+
+// Native implementation of JSON.parse/JSON.stringify (see JSON.ahk).
+//   json := Native.LoadModule('json.dll')
+//   obj := json.parse(text, keepbooltype := false, as_map := true)
+//   str := json.stringify(obj, expandlevel := unset, space := "  ")
+
+#define JSON_MAX_DEPTH 10000
+
+class JsonParser
+{
+	struct Frame
+	{
+		size_t start;
+		bool is_array;
+	};
+
+	TCHAR* mText = nullptr, * p = nullptr, * mEnd = nullptr;
+	TCHAR* mIndexEnd = nullptr; // The end of the text described by mIndex (see JsonIndex).
+	UINT64* mIndex = nullptr;
+	ExprTokenType* mValues = nullptr;
+	ExprTokenType** mParams = nullptr;
+	Frame* mFrames = nullptr;
+	size_t mValueCount = 0, mValueCapacity = 0, mParamCapacity = 0, mFrameCount = 0, mFrameCapacity = 0;
+	bool mKeepBoolType, mAsMap;
+
+	static IObject* sMap, * sArray, * sObject, * sTrue, * sFalse, * sNull;
+
+	template<typename T>
+	static bool Grow(T*& aData, size_t& aCapacity, size_t aNeed) {
+		if (aNeed <= aCapacity)
+			return true;
+		size_t newcap = aCapacity ? aCapacity << 1 : 64;
+		if (newcap < aNeed)
+			newcap = aNeed;
+		T* newp = (T*)realloc(aData, sizeof(T) * newcap);
+		if (!newp)
+			return false;
+		aData = newp, aCapacity = newcap;
+		return true;
+	}
+
+	bool Fail(LPTSTR aMessage) {
+		TCHAR extra[32];
+		size_t n = 0;
+		while (n < _countof(extra) - 1 && p + n < mEnd && p[n])
+			extra[n] = p[n], n++;
+		extra[n] = 0;
+		Object::Error(ExprTokenType(aMessage), extra);
+		return false;
+	}
+
+	bool Push(ExprTokenType& aValue) {
+		if (!Grow(mValues, mValueCapacity, mValueCount + 1))
+			return Fail(_T("Out of memory."));
+		mValues[mValueCount++] = aValue;
+		return true;
+	}
+
+	// Returns the first token start at or after p, or mIndexEnd.
+	TCHAR* NextIndexed() {
+		size_t pos = p - mText, word = pos / JSON_BLOCK, words = (mIndexEnd - mText + JSON_BLOCK - 1) / JSON_BLOCK;
+		UINT64 bits = mIndex[word] & (~0ULL << (pos % JSON_BLOCK));
+		while (!bits) {
+			if (++word == words)
+				return mIndexEnd;
+			bits = mIndex[word];
+		}
+		return mText + word * JSON_BLOCK + BitScan64(bits);
+	}
+
+	void SkipWhitespace() {
+		if (p < mIndexEnd) {
+			if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+				p = NextIndexed();
+			if (p < mIndexEnd)
+				return;
+		}
+		for (;;) {
+			while (p < mEnd && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+				++p;
+			if (p + 1 < mEnd && *p == '/') {
+				if (p[1] == '/') {
+					for (p += 2; p < mEnd && *p != '\n'; ++p);
+					continue;
+				}
+				if (p[1] == '*') {
+					for (p += 2; p + 1 < mEnd && !(*p == '*' && p[1] == '/'); ++p);
+					p = p + 1 < mEnd ? p + 2 : mEnd;
+					continue;
+				}
+			}
+			return;
+		}
+	}
+
+	static int HexValue(TCHAR c) {
+		if (c >= '0' && c <= '9')
+			return c - '0';
+		if ((c |= 32) >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+		return -1;
+	}
+
+	// Decodes the string in place; the closing quote is overwritten by the terminator.
+	bool ParseString(ExprTokenType& aToken) {
+		TCHAR* start = ++p, * dst, * next;
+		dst = p = ScanQuote(p, mEnd);
+		while (p < mEnd) {
+			TCHAR c = *p++;
+			if (c == '"') {
+				*dst = 0;
+				aToken.SetValue(start, dst - start);
+				return true;
+			}
+			if (p >= mEnd)
+				break;
+			switch (c = *p++)
+			{
+			case '"': case '\\': case '/': *dst++ = c; break;
+			case 'a': *dst++ = '\a'; break;
+			case 'b': *dst++ = '\b'; break;
+			case 'f': *dst++ = '\f'; break;
+			case 'n': *dst++ = '\n'; break;
+			case 'r': *dst++ = '\r'; break;
+			case 't': *dst++ = '\t'; break;
+			case 'v': *dst++ = '\v'; break;
+			case 'u':
+			case 'x':
+			{
+				int digits = c == 'u' ? 4 : 2, code = 0, i = 0;
+				for (int h; i < digits && p + i < mEnd && (h = HexValue(p[i])) >= 0; ++i)
+					code = (code << 4) | h;
+				if (i < digits) {
+					*dst++ = '\\', * dst++ = c;
+					break;
+				}
+#ifdef UNICODE
+				* dst++ = (TCHAR)code;
+#else
+				* dst++ = code < 0x100 ? (TCHAR)code : '?';
+#endif
+				p += digits;
+				break;
+			}
+			default:
+				*dst++ = '\\', * dst++ = c;
+			}
+			// Shift the run up to the next quote or escape over the decoded gap.
+			next = ScanQuote(p, mEnd);
+			memmove(dst, p, (next - p) * sizeof(TCHAR));
+			dst += next - p, p = next;
+		}
+		p = start - 1;
+		return Fail(_T("Malformed JSON - unterminated string."));
+	}
+
+	bool ParseNumber(ExprTokenType& aToken) {
+		TCHAR* start = p;
+		bool negative = *p == '-', is_float = false;
+		unsigned __int64 n = 0;
+		int digits = 0;
+		if (negative)
+			++p;
+		for (; p < mEnd && *p >= '0' && *p <= '9'; ++p, ++digits)
+			n = n * 10 + (*p - '0');
+		if (!digits) {
+			p = start;
+			return Fail(_T("Malformed JSON - unrecognized character."));
+		}
+		if (p < mEnd && *p == '.') {
+			is_float = true;
+			for (++p; p < mEnd && *p >= '0' && *p <= '9'; ++p);
+		}
+		if (p < mEnd && (*p == 'e' || *p == 'E')) {
+			is_float = true;
+			if (++p < mEnd && (*p == '+' || *p == '-'))
+				++p;
+			for (; p < mEnd && *p >= '0' && *p <= '9'; ++p);
+		}
+		if (!is_float && (digits < 19 || (digits == 19 && n <= (unsigned __int64)_I64_MAX + negative)))
+			aToken.SetValue(negative ? (__int64)(0 - n) : (__int64)n);
+		else
+			aToken.SetValue(_tcstod(start, nullptr));
+		return true;
+	}
+
+	bool ParseLiteral(ExprTokenType& aToken) {
+		static LPCTSTR sLiteral[] = { _T("true"), _T("false"), _T("null") };
+		for (int i = 0; i < 3; i++) {
+			size_t len = _tcslen(sLiteral[i]);
+			if ((size_t)(mEnd - p) >= len && !_tcsncmp(p, sLiteral[i], len)) {
+				p += len;
+				if (mKeepBoolType) {
+					IObject* obj = i == 0 ? sTrue : i == 1 ? sFalse : sNull;
+					obj->AddRef();
+					aToken.SetValue(obj);
+				}
+				else if (i == 2)
+					aToken.SetValue(_T(""), 0);
+				else aToken.SetValue((__int64)(i == 0));
+				return true;
+			}
+		}
+		return Fail(_T("Malformed JSON - unrecognized character."));
+	}
+
+	bool ParseScalar(ExprTokenType& aToken) {
+		switch (*p)
+		{
+		case '"': return ParseString(aToken);
+		case 't': case 'f': case 'n': return ParseLiteral(aToken);
+		default: return ParseNumber(aToken);
+		}
+	}
+
+	// Creates the container from the values pushed since the frame was opened.
+	bool CloseFrame() {
+		Frame& frame = mFrames[--mFrameCount];
+		size_t count = mValueCount - frame.start;
+		ExprTokenType* values = mValues + frame.start, result;
+		IObject* obj;
+		if (count > INT_MAX || !Grow(mParams, mParamCapacity, count))
+			return Fail(_T("Out of memory."));
+		for (size_t i = 0; i < count; ++i)
+			mParams[i] = values + i;
+		if (frame.is_array)
+			obj = CallGlobal(sArray, mParams, (int)count);
+		else if (mAsMap)
+			obj = CallGlobal(sMap, mParams, (int)count);
+		else if ((obj = CallGlobal(sObject, nullptr, 0))) {
+			TCHAR buf[MAX_NUMBER_SIZE];
+			ResultToken r;
+			for (size_t i = 0; i < count; i += 2) {
+				r.InitResult(buf);
+				obj->Invoke(r, IT_SET, values[i].marker, ExprTokenType(obj), mParams + i + 1, 1);
+				r.Free();
+				if (r.Exited()) {
+					obj->Release(), obj = nullptr;
+					break;
+				}
+			}
+		}
+		for (size_t i = 0; i < count; ++i)
+			if (values[i].symbol == SYM_OBJECT)
+				values[i].object->Release();
+		mValueCount = frame.start;
+		if (!obj)
+			return false;
+		result.SetValue(obj);
+		return Push(result);
+	}
+
+	bool OpenFrame(bool aIsArray) {
+		if (mFrameCount >= JSON_MAX_DEPTH)
+			return Fail(_T("Malformed JSON - nesting too deep."));
+		if (!Grow(mFrames, mFrameCapacity, mFrameCount + 1))
+			return Fail(_T("Out of memory."));
+		mFrames[mFrameCount++] = { mValueCount, aIsArray };
+		++p;
+		return true;
+	}
+
+	bool Parse() {
+		ExprTokenType token;
+		SkipWhitespace();
+		if (p >= mEnd || (*p != '{' && *p != '['))
+			return Fail(_T("Malformed JSON - unrecognized character."));
+		if (!OpenFrame(*p == '['))
+			return false;
+		for (;;) {
+			Frame* frame = mFrames + mFrameCount - 1;
+			TCHAR close = frame->is_array ? ']' : '}';
+			SkipWhitespace();
+			if (p < mEnd && *p == close && mValueCount == frame->start) {
+				// Empty container.
+				++p;
+			}
+			else {
+				if (!frame->is_array) {
+					if (p >= mEnd || *p != '"')
+						return Fail(_T("Malformed JSON - missing key."));
+					if (!ParseString(token) || !Push(token))
+						return false;
+					SkipWhitespace();
+					if (p >= mEnd || *p != ':')
+						return Fail(_T("Malformed JSON - missing value."));
+					++p;
+					SkipWhitespace();
+				}
+				if (p >= mEnd)
+					return Fail(_T("Malformed JSON - missing value."));
+				if (*p == '{' || *p == '[') {
+					if (!OpenFrame(*p == '['))
+						return false;
+					continue;
+				}
+				if (!ParseScalar(token))
+					return false;
+				if (!Push(token)) {
+					if (token.symbol == SYM_OBJECT)
+						token.object->Release();
+					return false;
+				}
+				SkipWhitespace();
+				if (p < mEnd && *p == ',') {
+					++p;
+					continue;
+				}
+				if (p >= mEnd || *p != close)
+					return Fail(_T("Malformed JSON - unrecognized character."));
+				++p;
+			}
+			// The current container is complete; keep closing the parents which end here too.
+			for (;;) {
+				if (!CloseFrame())
+					return false;
+				if (!mFrameCount) {
+					SkipWhitespace();
+					if (p < mEnd)
+						return Fail(_T("Malformed JSON - unrecognized character."));
+					return true;
+				}
+				SkipWhitespace();
+				if (p < mEnd && *p == ',') {
+					++p;
+					break;
+				}
+				frame = mFrames + mFrameCount - 1;
+				if (p >= mEnd || *p != (frame->is_array ? ']' : '}'))
+					return Fail(_T("Malformed JSON - unrecognized character."));
+				++p;
+			}
+		}
+	}
+
+public:
+	JsonParser(bool aKeepBoolType, bool aAsMap) : mKeepBoolType(aKeepBoolType), mAsMap(aAsMap) {}
+	~JsonParser() {
+		for (size_t i = 0; i < mValueCount; ++i)
+			if (mValues[i].symbol == SYM_OBJECT)
+				mValues[i].object->Release();
+		free(mValues), free(mParams), free(mFrames), free(mText);
+	}
+
+	static bool Init() {
+		if (!sMap) {
+			if (!(sMap = GetGlobal(_T("Map"))) || !(sArray = GetGlobal(_T("Array"))) || !(sObject = GetGlobal(_T("Object"))))
+				return false;
+			IObject* comvalue = GetGlobal(_T("ComValue"));
+			if (!comvalue)
+				return false;
+			ExprTokenType param[2], * params[] = { param, param + 1 };
+			param[0].SetValue((__int64)VT_BOOL), param[1].SetValue((__int64)-1);
+			sTrue = CallGlobal(comvalue, params, 2);
+			param[1].SetValue((__int64)0);
+			sFalse = CallGlobal(comvalue, params, 2);
+			param[0].SetValue((__int64)VT_NULL);
+			sNull = CallGlobal(comvalue, params, 2);
+			comvalue->Release();
+		}
+		return sTrue && sFalse && sNull;
+	}
+
+	IObject* Parse(LPCTSTR aText, size_t aLength) {
+		// The index follows the copy of the text, one bit per char.
+		size_t text_size = ((aLength + 1) * sizeof(TCHAR) + sizeof(UINT64) - 1) & ~(sizeof(UINT64) - 1);
+		if (!(mText = (TCHAR*)malloc(text_size + (aLength + JSON_BLOCK - 1) / JSON_BLOCK * sizeof(UINT64)))) {
+			Fail(_T("Out of memory."));
+			return nullptr;
+		}
+		memcpy(mText, aText, aLength * sizeof(TCHAR));
+		mText[aLength] = 0;
+		p = mText, mEnd = mText + aLength;
+		mIndex = (UINT64*)((char*)mText + text_size);
+		mIndexEnd = mText + JsonIndex(mText, aLength, mIndex);
+		if (!Parse())
+			return nullptr;
+		mValueCount = 0;
+		return mValues[0].object;
+	}
+};
+
+IObject* JsonParser::sMap = nullptr, * JsonParser::sArray = nullptr, * JsonParser::sObject = nullptr;
+IObject* JsonParser::sTrue = nullptr, * JsonParser::sFalse = nullptr, * JsonParser::sNull = nullptr;
+
+class JsonWriter
+{
+	TString& mOut;
+	int mExpandLevel;
+	LPTSTR mSpace;
+	size_t mSpaceLength;
+
+	void Indent(int aDepth) {
+		mOut.append('\n');
+		for (int i = 0; i < aDepth; ++i)
+			mOut.append(mSpace, mSpaceLength);
+	}
+
+	void WriteString(LPTSTR aStr, size_t aLength) {
+		static const TCHAR sHex[] = _T("0123456789abcdef");
+		TCHAR* start = aStr, * end = aStr + aLength;
+		mOut.append('"');
+		for (; (aStr = ScanEscape(aStr, end)) < end; ++aStr) {
+			TCHAR c = *aStr, esc;
+			switch (c)
+			{
+			case '"': esc = '"'; break;
+			case '\\': esc = '\\'; break;
+			case '\b': esc = 'b'; break;
+			case '\f': esc = 'f'; break;
+			case '\n': esc = 'n'; break;
+			case '\r': esc = 'r'; break;
+			case '\t': esc = 't'; break;
+			default: esc = 'u';
+			}
+			mOut.append(start, aStr - start).append('\\').append(esc);
+			if (esc == 'u')
+				mOut.append('0').append('0').append(sHex[c >> 4]).append(sHex[c & 15]);
+			start = aStr + 1;
+		}
+		mOut.append(start, end - start).append('"');
+	}
+
+	void WriteInteger(__int64 aValue) {
+		mOut.append_int(aValue);
+	}
+
+	void WriteFloat(double aValue) {
+		// JSON has no infinity or NaN (all exponent bits set), so they are written as null,
+		// as JavaScript's JSON.stringify writes them.
+		UINT64 bits;
+		memcpy(&bits, &aValue, sizeof(bits));
+		if ((bits & 0x7FF0000000000000) == 0x7FF0000000000000) {
+			mOut += _T("null");
+			return;
+		}
+		TCHAR buf[MAX_NUMBER_SIZE];
+		// Use the shortest representation which round-trips, rather than the 17 digits which
+		// JSON.ahk has to trim (e.g. 0.1 instead of 0.10000000000000001).
+		for (int precision = 15; precision <= 17; ++precision) {
+			_stprintf_s(buf, _countof(buf), _T("%.*g"), precision, aValue);
+			if (_tcstod(buf, nullptr) == aValue)
+				break;
+		}
+		mOut += buf;
+		for (TCHAR* cp = buf; *cp; ++cp)
+			if (*cp == '.' || *cp == 'e')
+				return;
+		mOut.append('.').append('0');
+	}
+
+	void WriteNull(IObject* aObj) {
+		if (aObj && !_tcscmp(aObj->Type(), _T("ComValue"))) {
+			auto com = static_cast<ComObject*>(aObj);
+			if (com->mVarType == VT_BOOL) {
+				mOut += (short)com->mVal64 ? _T("true") : _T("false");
+				return;
+			}
+		}
+		mOut += _T("null");
+	}
+
+	bool WriteToken(ExprTokenType& aToken, int aDepth) {
+		switch (aToken.symbol)
+		{
+		case SYM_STRING:
+			if (aToken.marker_length == -1)
+				aToken.marker_length = _tcslen(aToken.marker);
+			WriteString(aToken.marker, aToken.marker_length);
+			return true;
+		case SYM_INTEGER: WriteInteger(aToken.value_int64); return true;
+		case SYM_FLOAT: WriteFloat(aToken.value_double); return true;
+		case SYM_OBJECT: return WriteObject(aToken.object, aDepth);
+		default: WriteNull(nullptr); return true;
+		}
+	}
+
+	bool WriteVariant(Object::Variant& aValue, int aDepth) {
+		switch (aValue.symbol)
+		{
+		case SYM_STRING: WriteString(aValue.string.Value(), aValue.string.Length()); return true;
+		case SYM_INTEGER: WriteInteger(aValue.n_int64); return true;
+		case SYM_FLOAT: WriteFloat(aValue.n_double); return true;
+		case SYM_OBJECT: return WriteObject(aValue.object, aDepth);
+		default: WriteNull(nullptr); return true;
+		}
+	}
+
+	// Separates the items and begins a new line if the container is expanded.
+	void BeginItem(size_t aIndex, int aDepth) {
+		if (aIndex)
+			mOut.append(',');
+		if (mExpandLevel > aDepth)
+			Indent(aDepth + 1);
+	}
+
+	void BeginKey(size_t aIndex, int aDepth, LPTSTR aKey, size_t aLength) {
+		BeginItem(aIndex, aDepth);
+		WriteString(aKey, aLength);
+		mOut.append(':');
+	}
+
+	bool EndContainer(size_t aCount, int aDepth, TCHAR aClose) {
+		if (aCount && mExpandLevel > aDepth)
+			Indent(aDepth);
+		mOut.append(aClose);
+		return true;
+	}
+
+	bool WriteObject(IObject* aObj, int aDepth) {
+		LPTSTR type = aObj->Type();
+		size_t count = 0;
+		if (aDepth >= JSON_MAX_DEPTH) {
+			Object::Error(ExprTokenType(_T("Object nesting too deep, possibly a circular reference.")));
+			return false;
+		}
+		if (!_tcscmp(type, _T("Array"))) {
+			auto arr = static_cast<Array*>(aObj);
+			mOut.append('[');
+			for (; count < arr->mLength; ++count) {
+				BeginItem(count, aDepth);
+				if (!WriteVariant(arr->mItem[count], aDepth + 1))
+					return false;
+			}
+			return EndContainer(count, aDepth, ']');
+		}
+		if (!_tcscmp(type, _T("Map"))) {
+			auto map = static_cast<Map*>(aObj);
+			TCHAR buf[MAX_INTEGER_SIZE];
+			mOut.append('{');
+			for (Object::index_t i = 0; i < map->mCount; ++i) {
+				auto& pair = map->mItem[i];
+				if (i < map->mKeyOffsetObject) {
+					_i64tot_s(pair.key.i, buf, _countof(buf), 10);
+					BeginKey(count, aDepth, buf, _tcslen(buf));
+				}
+				else if (i < map->mKeyOffsetString)
+					continue;
+				else BeginKey(count, aDepth, pair.key.s, _tcslen(pair.key.s));
+				++count;
+				if (!WriteVariant(pair, aDepth + 1))
+					return false;
+			}
+			return EndContainer(count, aDepth, '}');
+		}
+		if (!_tcscmp(type, _T("Object"))) {
+			auto obj = static_cast<Object*>(aObj);
+			mOut.append('{');
+			for (Object::index_t i = 0; i < obj->mFields.Length(); ++i) {
+				auto& field = obj->mFields.Value()[i];
+				if (field.symbol != SYM_DYNAMIC) {
+					BeginKey(count++, aDepth, field.name, _tcslen(field.name));
+					if (!WriteVariant(field, aDepth + 1))
+						return false;
+					continue;
+				}
+				if (!field.prop->mGet)
+					continue;
+				TCHAR buf[MAX_NUMBER_SIZE];
+				ResultToken result;
+				result.InitResult(buf);
+				obj->Invoke(result, IT_GET, field.name, ExprTokenType(aObj), nullptr, 0);
+				if (result.Exited()) {
+					result.Free();
+					return false;
+				}
+				BeginKey(count++, aDepth, field.name, _tcslen(field.name));
+				bool ok = WriteToken(result, aDepth + 1);
+				result.Free();
+				if (!ok)
+					return false;
+			}
+			return EndContainer(count, aDepth, '}');
+		}
+		WriteNull(aObj);
+		return true;
+	}
+
+public:
+	JsonWriter(TString& aOut, int aExpandLevel, LPTSTR aSpace, size_t aSpaceLength)
+		: mOut(aOut), mExpandLevel(aExpandLevel), mSpace(aSpace), mSpaceLength(aSpaceLength) {}
+
+	bool Write(ExprTokenType& aValue) { return WriteToken(aValue, 0); }
+};
+
+// parse(text, keepbooltype := false, as_map := true)
+BIF_DECL(parse) {
+	StrRef text;
+	if (!BorrowString(*aParam[0], text)) {
+		Object::Error(ExprTokenType(_T("Parameter #1 of parse must be a string.")), nullptr, _T("TypeError"));
+		aResultToken.result = FAIL;
+		return;
+	}
+	bool keepbooltype = aParamCount > 1 && TokenToBool(*aParam[1]);
+	bool as_map = aParamCount < 3 || aParam[2]->symbol == SYM_MISSING || TokenToBool(*aParam[2]);
+	if (!JsonParser::Init()) {
+		aResultToken.result = FAIL;
+		return;
+	}
+	JsonParser parser(keepbooltype, as_map);
+	if (IObject* obj = parser.Parse(text.str, text.length))
+		aResultToken.SetValue(obj);
+	else aResultToken.result = FAIL;
+}
+
+// stringify(obj, expandlevel := unset, space := "  ")
+BIF_DECL(stringify) {
+	ExprTokenType value, level, space;
+	int expandlevel = 10000000;
+	TCHAR spaces[] = _T("  ");
+	LPTSTR indent = spaces;
+	size_t indent_length = 2;
+	TokenToValue(*aParam[0], value);
+	if (aParamCount > 1 && aParam[1]->symbol != SYM_MISSING) {
+		TokenToValue(*aParam[1], level);
+		__int64 n = level.symbol == SYM_INTEGER ? level.value_int64 : level.symbol == SYM_FLOAT ? (__int64)level.value_double
+			: level.symbol == SYM_STRING ? _tcstoi64(level.marker, nullptr, 10) : 0;
+		if (n < 0)
+			n = -n;
+		expandlevel = n > INT_MAX ? INT_MAX : (int)n;
+	}
+	if (aParamCount > 2 && aParam[2]->symbol != SYM_MISSING) {
+		TokenToValue(*aParam[2], space);
+		if (space.symbol == SYM_STRING) {
+			indent = space.marker;
+			indent_length = space.marker_length == -1 ? _tcslen(indent) : space.marker_length;
+		}
+		else indent_length = 0;
+	}
+	TString out;
+	JsonWriter writer(out, expandlevel, indent, indent_length);
+	if (!writer.Write(value)) {
+		aResultToken.result = FAIL;
+		return;
+	}
+	if (!out.move_to(aResultToken))
+		aResultToken.result = FAIL;
+}
+
+ExportSymbol symbols[] = {
+	EXPORT_FUNC(parse, 1, 3)
+	EXPORT_FUNC(stringify, 1, 3)
+};
+
+EXPORT_AHKMODULE(symbols)
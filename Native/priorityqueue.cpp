@@ -0,0 +1,460 @@
+﻿#include "ahk2_types.h"
+
+// PriorityQueue: a 4-ary heap of values ordered by number or string priorities.
+//   pq := Native.LoadModule('priorityqueue.dll').PriorityQueue(max := false)
+//   handle := pq.Push(value, priority), value := pq.Pop(&priority?), value := pq.Peek(&priority?)
+//   pq.Update(handle, priority), value := pq.Remove(handle), pq.Has(handle), pq.Count
+//   pq.Heapify(values, priorities?)	; bulk insert, each value is its own priority if omitted
+// Lower priorities come first unless max is true.  Numbers come before strings, and strings
+// are compared ordinally, and integers with floats exactly; a NaN priority is a ValueError.
+// Values with equal priorities are popped in no particular order.
+
+class PriorityQueue : public Object {
+	enum { kArity = 4 };
+	enum : UINT { kNone = UINT_MAX };
+
+	struct Node
+	{
+		union
+		{
+			__int64 i;
+			double d;
+			LPTSTR s;
+		};
+		UINT slot;
+		SymbolType symbol; // SYM_INTEGER, SYM_FLOAT or SYM_STRING.
+	};
+	// Handles refer to entries, which keep their slot while the nodes move within the heap.
+	// A handle combines the slot with its generation, so that handles of removed values go stale.
+	struct Entry
+	{
+		union
+		{
+			__int64 n_int64;
+			double n_double;
+			IObject* object;
+			LPTSTR string;
+		};
+		size_t length;
+		SymbolType symbol;
+		UINT pos; // Index in mHeap, or the next free slot.
+		UINT generation;
+	};
+
+	Node* mHeap = nullptr;
+	Entry* mEntries = nullptr;
+	UINT mCount = 0, mHeapCapacity = 0, mEntryCount = 0, mEntryCapacity = 0, mFreeSlot = kNone;
+	bool mMax = false;
+
+	static int ComparePriority(const Node& a, const Node& b) {
+		if (a.symbol == SYM_STRING || b.symbol == SYM_STRING) {
+			if (a.symbol != b.symbol)
+				return a.symbol == SYM_STRING ? 1 : -1;
+			LPCTSTR sa = a.s, sb = b.s;
+			while (*sa && *sa == *sb)
+				++sa, ++sb;
+			return (_TUCHAR)*sa < (_TUCHAR)*sb ? -1 : (_TUCHAR)*sa > (_TUCHAR)*sb;
+		}
+		if (a.symbol == SYM_INTEGER && b.symbol == SYM_INTEGER)
+			return a.i < b.i ? -1 : a.i > b.i;
+		if (a.symbol == SYM_INTEGER)
+			return CompareIntFloat(a.i, b.d);
+		if (b.symbol == SYM_INTEGER)
+			return -CompareIntFloat(b.i, a.d);
+		return a.d < b.d ? -1 : a.d > b.d; // NaN is rejected by TokenToPriority.
+	}
+
+	// Whether a belongs above b.
+	inline bool Before(const Node& a, const Node& b) {
+		int c = ComparePriority(a, b);
+		return mMax ? c > 0 : c < 0;
+	}
+
+	inline void Place(UINT aPos, const Node& aNode) {
+		mHeap[aPos] = aNode;
+		mEntries[aNode.slot].pos = aPos;
+	}
+
+	void SiftUp(UINT aPos) {
+		Node node = mHeap[aPos];
+		while (aPos) {
+			UINT parent = (aPos - 1) / kArity;
+			if (!Before(node, mHeap[parent]))
+				break;
+			Place(aPos, mHeap[parent]);
+			aPos = parent;
+		}
+		Place(aPos, node);
+	}
+
+	void SiftDown(UINT aPos) {
+		Node node = mHeap[aPos];
+		for (;;) {
+			UINT first = aPos * kArity + 1, best = first;
+			if (first >= mCount)
+				break;
+			UINT last = mCount - first > kArity ? first + kArity : mCount;
+			for (UINT c = first + 1; c < last; ++c)
+				if (Before(mHeap[c], mHeap[best]))
+					best = c;
+			if (!Before(mHeap[best], node))
+				break;
+			Place(aPos, mHeap[best]);
+			aPos = best;
+		}
+		Place(aPos, node);
+	}
+
+	// Restores the heap after the node at aPos changed.
+	void Fix(UINT aPos) {
+		if (aPos && Before(mHeap[aPos], mHeap[(aPos - 1) / kArity]))
+			SiftUp(aPos);
+		else SiftDown(aPos);
+	}
+
+	template<typename T>
+	static bool Grow(T*& aData, UINT& aCapacity, size_t aNeed) {
+		if (aNeed <= aCapacity)
+			return true;
+		size_t newcap = aCapacity ? (size_t)aCapacity << 1 : 16;
+		if (newcap < aNeed)
+			newcap = aNeed;
+		if (newcap > kNone - 1)
+			return false;
+		T* newp = (T*)realloc(aData, sizeof(T) * newcap);
+		if (!newp)
+			return false;
+		aData = newp, aCapacity = (UINT)newcap;
+		return true;
+	}
+
+	// Makes room for aCount more values; free slots are not counted, so entries may be over-allocated.
+	bool Reserve(size_t aCount) {
+		return Grow(mHeap, mHeapCapacity, (size_t)mCount + aCount)
+			&& ((mFreeSlot != kNone && aCount == 1) || Grow(mEntries, mEntryCapacity, (size_t)mEntryCount + aCount));
+	}
+
+	static bool OutOfMemory() {
+		Object::Error(ExprTokenType(_T("Out of memory.")), nullptr, _T("MemoryError"));
+		return false;
+	}
+
+	static bool CopyString(LPTSTR& aDest, LPCTSTR aSrc, size_t aLength) {
+		if (!(aDest = (LPTSTR)malloc((aLength + 1) * sizeof(TCHAR))))
+			return false;
+		memcpy(aDest, aSrc, aLength * sizeof(TCHAR));
+		aDest[aLength] = 0;
+		return true;
+	}
+
+	// Converts a parameter into a priority, copying strings.
+	static bool TokenToPriority(ExprTokenType& aToken, Node& aNode) {
+		ExprTokenType val;
+		TokenToValue(aToken, val);
+		switch (aNode.symbol = val.symbol)
+		{
+		case SYM_INTEGER: aNode.i = val.value_int64; return true;
+		case SYM_FLOAT:
+			// NaN is neither before nor after anything, which would break the heap order.
+			if (val.value_double != val.value_double) {
+				Object::Error(ExprTokenType(_T("Priority must not be NaN.")), nullptr, _T("ValueError"));
+				return false;
+			}
+			aNode.d = val.value_double;
+			return true;
+		case SYM_STRING:
+			if (!CopyString(aNode.s, val.marker, val.marker_length == -1 ? _tcslen(val.marker) : val.marker_length))
+				return OutOfMemory();
+			return true;
+		default:
+			Object::Error(ExprTokenType(_T("Priority must be a number or string.")), nullptr, _T("TypeError"));
+			return false;
+		}
+	}
+
+	static void FreePriority(Node& aNode) {
+		if (aNode.symbol == SYM_STRING)
+			free(aNode.s);
+	}
+
+	static bool TokenToStoredValue(ExprTokenType& aToken, Entry& aEntry) {
+		ExprTokenType val;
+		TokenToValue(aToken, val);
+		switch (aEntry.symbol = val.symbol)
+		{
+		case SYM_INTEGER: aEntry.n_int64 = val.value_int64; break;
+		case SYM_FLOAT: aEntry.n_double = val.value_double; break;
+		case SYM_OBJECT: (aEntry.object = val.object)->AddRef(); break;
+		case SYM_STRING:
+			aEntry.length = val.marker_length == -1 ? _tcslen(val.marker) : val.marker_length;
+			if (!CopyString(aEntry.string, val.marker, aEntry.length))
+				return OutOfMemory();
+			break;
+		default:
+			Object::Error(ExprTokenType(_T("Invalid value.")), nullptr, _T("TypeError"));
+			return false;
+		}
+		return true;
+	}
+
+	static void FreeValue(Entry& aEntry) {
+		if (aEntry.symbol == SYM_STRING)
+			free(aEntry.string);
+		else if (aEntry.symbol == SYM_OBJECT)
+			aEntry.object->Release();
+	}
+
+	static void ReturnValue(ResultToken& aResultToken, Entry& aEntry) {
+		switch (aResultToken.symbol = aEntry.symbol)
+		{
+		case SYM_STRING:
+			aResultToken.marker = aEntry.string;
+			aResultToken.marker_length = aEntry.length;
+			break;
+		case SYM_OBJECT:
+			aEntry.object->AddRef();
+		default:
+			aResultToken.value_int64 = aEntry.n_int64; // Union copy.
+		}
+	}
+
+	// Transfers the value of a removed entry to the caller.
+	static void ReturnTakenValue(ResultToken& aResultToken, Entry& aEntry) {
+		if (aEntry.symbol == SYM_STRING)
+			aResultToken.AcceptMem(aEntry.string, aEntry.length);
+		else {
+			aResultToken.symbol = aEntry.symbol;
+			aResultToken.value_int64 = aEntry.n_int64; // Union copy; the object reference is transferred.
+		}
+	}
+
+	static void AssignPriority(Var* aVar, Node& aNode) {
+		switch (aNode.symbol)
+		{
+		case SYM_INTEGER: aVar->Assign(aNode.i); break;
+		case SYM_FLOAT: aVar->Assign(aNode.d); break;
+		default: aVar->Assign(aNode.s, _tcslen(aNode.s));
+		}
+	}
+
+	UINT AllocSlot() {
+		UINT slot = mFreeSlot;
+		if (slot != kNone)
+			mFreeSlot = mEntries[slot].pos;
+		else mEntries[slot = mEntryCount++].generation = 0;
+		return slot;
+	}
+
+	void FreeSlot(UINT aSlot) {
+		auto& entry = mEntries[aSlot];
+		entry.generation = (entry.generation + 1) & 0x7FFFFFFF; // Handles stay positive.
+		entry.pos = mFreeSlot;
+		mFreeSlot = aSlot;
+	}
+
+	__int64 MakeHandle(UINT aSlot) { return ((__int64)mEntries[aSlot].generation << 32) | aSlot; }
+
+	// Returns the slot of a live entry, or kNone.
+	UINT HandleToSlot(ExprTokenType& aToken) {
+		ExprTokenType val;
+		TokenToValue(aToken, val);
+		if (val.symbol != SYM_INTEGER || val.value_int64 < 0)
+			return kNone;
+		UINT slot = (UINT)val.value_int64, generation = (UINT)(val.value_int64 >> 32);
+		if (slot >= mEntryCount || mEntries[slot].generation != generation)
+			return kNone;
+		// Free slots hold the next free slot in pos; a live entry's node points back at it.
+		UINT pos = mEntries[slot].pos;
+		return pos < mCount && mHeap[pos].slot == slot ? slot : kNone;
+	}
+
+	UINT ParamHandle(ExprTokenType& aToken, ResultToken& aResultToken) {
+		UINT slot = HandleToSlot(aToken);
+		if (slot == kNone) {
+			Object::Error(ExprTokenType(_T("Invalid handle.")), nullptr, _T("ValueError"));
+			aResultToken.result = FAIL;
+		}
+		return slot;
+	}
+
+	// Appends a node without restoring the heap.
+	bool Append(ExprTokenType& aValue, ExprTokenType& aPriority, UINT& aSlot) {
+		Node node;
+		if (!Reserve(1))
+			return OutOfMemory();
+		if (!TokenToPriority(aPriority, node))
+			return false;
+		aSlot = AllocSlot();
+		if (!TokenToStoredValue(aValue, mEntries[aSlot])) {
+			FreePriority(node);
+			FreeSlot(aSlot);
+			return false;
+		}
+		node.slot = aSlot;
+		Place(mCount++, node);
+		return true;
+	}
+
+	// Removes the node at aPos, leaving its value for the caller to take or free.
+	void RemoveAt(UINT aPos) {
+		FreePriority(mHeap[aPos]);
+		FreeSlot(mHeap[aPos].slot);
+		if (aPos < --mCount) {
+			Place(aPos, mHeap[mCount]);
+			Fix(aPos);
+		}
+	}
+
+	bool IsEmpty(ResultToken& aResultToken) {
+		if (mCount)
+			return false;
+		Object::Error(ExprTokenType(_T("The queue is empty.")), nullptr, _T("IndexError"));
+		aResultToken.result = FAIL;
+		return true;
+	}
+
+	void ClearAll() {
+		for (UINT i = 0; i < mCount; ++i) {
+			FreePriority(mHeap[i]);
+			FreeValue(mEntries[mHeap[i].slot]);
+		}
+		free(mHeap), free(mEntries);
+		mHeap = nullptr, mEntries = nullptr;
+		mCount = mHeapCapacity = mEntryCount = mEntryCapacity = 0;
+		mFreeSlot = kNone;
+	}
+
+public:
+#define CLASSNAME "PriorityQueue"
+	IObject_Type_Impl;
+	static ObjectMember sMembers[];
+	~PriorityQueue() { ClearAll(); }
+
+	void __New(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		mMax = aParamCount && aParam[0]->symbol != SYM_MISSING && TokenToBool(*aParam[0]);
+	}
+
+	void Push(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		UINT slot;
+		if (!Append(*aParam[0], *aParam[1], slot)) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		SiftUp(mCount - 1);
+		aResultToken.SetValue(MakeHandle(slot));
+	}
+
+	void Pop(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		Var* var;
+		if (IsEmpty(aResultToken))
+			return;
+		if (aParamCount && (var = TokenToOutputVar(*aParam[0])))
+			AssignPriority(var, mHeap[0]);
+		ReturnTakenValue(aResultToken, mEntries[mHeap[0].slot]);
+		RemoveAt(0);
+	}
+
+	void Peek(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		Var* var;
+		if (IsEmpty(aResultToken))
+			return;
+		if (aParamCount && (var = TokenToOutputVar(*aParam[0])))
+			AssignPriority(var, mHeap[0]);
+		ReturnValue(aResultToken, mEntries[mHeap[0].slot]);
+	}
+
+	// Changes the priority of a value; works for both decrease-key and increase-key.
+	void Update(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		Node node;
+		UINT slot = ParamHandle(*aParam[0], aResultToken);
+		if (slot == kNone)
+			return;
+		if (!TokenToPriority(*aParam[1], node)) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		UINT pos = mEntries[slot].pos;
+		FreePriority(mHeap[pos]);
+		node.slot = slot;
+		mHeap[pos] = node;
+		Fix(pos);
+	}
+
+	void Remove(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		UINT slot = ParamHandle(*aParam[0], aResultToken);
+		if (slot == kNone)
+			return;
+		ReturnTakenValue(aResultToken, mEntries[slot]);
+		RemoveAt(mEntries[slot].pos);
+	}
+
+	void Has(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		aResultToken.SetValue((__int64)(HandleToSlot(*aParam[0]) != kNone));
+	}
+
+	// Appends all values, then restores the heap once (Floyd's method), which is O(n).
+	void Heapify(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		ExprTokenType val;
+		Array* values, * priorities = nullptr;
+		TokenToValue(*aParam[0], val);
+		values = val.symbol == SYM_OBJECT && !_tcscmp(val.object->Type(), _T("Array")) ? static_cast<Array*>(val.object) : nullptr;
+		if (values && aParamCount > 1 && aParam[1]->symbol != SYM_MISSING) {
+			TokenToValue(*aParam[1], val);
+			priorities = val.symbol == SYM_OBJECT && !_tcscmp(val.object->Type(), _T("Array")) ? static_cast<Array*>(val.object) : nullptr;
+			if (!priorities || priorities->mLength != values->mLength)
+				values = nullptr;
+		}
+		if (!values) {
+			Object::Error(ExprTokenType(_T("Expected an Array of values and an optional Array of priorities of the same length.")), nullptr, _T("TypeError"));
+			aResultToken.result = FAIL;
+			return;
+		}
+		if (!Reserve(values->mLength)) {
+			OutOfMemory();
+			aResultToken.result = FAIL;
+			return;
+		}
+		bool ok = true;
+		for (Object::index_t i = 0; i < values->mLength && ok; ++i) {
+			ExprTokenType value, priority;
+			UINT slot;
+			VariantToToken(values->mItem[i], value);
+			if (priorities)
+				VariantToToken(priorities->mItem[i], priority);
+			ok = Append(value, priorities ? priority : value, slot);
+		}
+		// Restore the heap even if an item failed, since the others were already added.
+		if (mCount > 1)
+			for (UINT i = (mCount - 2) / kArity + 1; i--; )
+				SiftDown(i);
+		if (!ok)
+			aResultToken.result = FAIL;
+	}
+
+	void Clear(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		ClearAll();
+	}
+
+	void Count(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		aResultToken.SetValue((__int64)mCount);
+	}
+};
+
+ObjectMember PriorityQueue::sMembers[] = {
+	Object_Method(__New, __New, 0, 0, 1),
+	Object_Method(Push, Push, 0, 2, 2),
+	Object_Method(Pop, Pop, 0, 0, 1),
+	Object_Method(Peek, Peek, 0, 0, 1),
+	Object_Method(Update, Update, 0, 2, 2),
+	Object_Method(Remove, Remove, 0, 1, 1),
+	Object_Method(Has, Has, 0, 1, 1),
+	Object_Method(Heapify, Heapify, 0, 1, 2),
+	Object_Method(Clear, Clear, 0, 0, 0),
+	Object_Get(Count, Count, 0, 0, 0),
+};
+
+ExportSymbol symbols[] = {
+	EXPORT_CLASS(PriorityQueue, 1)
+};
+
+EXPORT_AHKMODULE(symbols)
@@ -0,0 +1,1123 @@
+﻿#include "ahk2_types.h"
+
+// Compact binary serialization of Object, Array and Map graphs, for persisting script state
+// without a JSON.stringify/JSON.parse round trip.
+//   ser := Native.LoadModule('serialize.dll')
+//   buf := ser.dump(obj)	; a Buffer
+//   ser.save(obj, path)
+//   obj := ser.load(source)	; source is a Buffer or a file path
+//   view := ser.load(source, true)	; a read-only view, which reads only what is accessed
+//   view[key], view.name, view.Get(key, default?), view.Has(key), view.Length, view.Count
+//   for k, v in view
+//   obj := view.Materialize()	; the same as load() would return for this part of the graph
+// Values are Integers, Floats, Strings, Objects, Arrays and Maps (with their CaseSense).  An
+// object reached more than once, including through a cycle, is written once and loaded as one
+// object.  Other objects, such as class instances and Buffers, can't be saved; dynamic
+// properties are skipped.  Each distinct string is written once.
+//
+// A file loaded as a view is memory-mapped, so only the pages which are read become resident.
+// Items which are containers are returned as views of their own (the same view while it
+// exists), and strings are copied out of the mapping only when read.  A view of a Buffer
+// reads a copy of it.  Map keys are looked up by Integer, String or view; Map and Object
+// lookups are binary searches, as the keys are saved in the order the host keeps them.
+
+#define SERIAL_MAGIC 0x53424841	// "AHBS"
+#define SERIAL_VERSION 1
+
+// File layout, little-endian, with offsets from the start of the file:
+//   SerialHeader
+//   node records, 8-byte aligned: SerialNode, UINT64 payload[slots], BYTE type[slots]
+//   string records, 4-byte aligned: UINT32 length, TCHAR text[length], 0
+//   UINT64 string_offset[string_count], UINT64 node_offset[node_count]
+// Node 0 is the root.  An Array has a slot per item; a Map or Object has two per pair, the
+// key followed by the value.  A slot's payload is the value itself, or a string or node index.
+struct SerialHeader
+{
+	UINT32 magic;
+	UINT16 version, char_size;
+	UINT32 string_count, node_count;
+	UINT64 string_index, node_index;
+	UINT64 size;
+};
+
+enum SerialKind : BYTE { SERIAL_ARRAY = 1, SERIAL_MAP, SERIAL_OBJECT };
+enum SerialType : BYTE { SERIAL_MISSING, SERIAL_INTEGER, SERIAL_FLOAT, SERIAL_STRING, SERIAL_NODE };
+enum SerialFlag : BYTE
+{
+	SERIAL_CASELESS = 0x01,	// Map: CaseSense "Off"
+	SERIAL_LOCALE = 0x02,	// Map: CaseSense "Locale"
+	SERIAL_SORTED = 0x04	// Object: the names are in FindField() order
+};
+
+struct SerialNode
+{
+	BYTE kind, flags;
+	UINT16 reserved;
+	UINT32 count;	// Items, or key-value pairs.
+
+	UINT64 Slots() const { return kind == SERIAL_ARRAY ? count : (UINT64)count * 2; }
+	const UINT64* Payload() const { return (const UINT64*)(this + 1); }
+	const BYTE* Types() const { return (const BYTE*)(Payload() + Slots()); }
+	static UINT64 SizeOf(UINT64 aSlots) { return (sizeof(SerialNode) + aSlots * 9 + 7) & ~(UINT64)7; }
+};
+
+static bool Fail(ResultToken& aResultToken, LPTSTR aMessage, LPTSTR aType = _T("Error")) {
+	Object::Error(ExprTokenType(aMessage), nullptr, aType);
+	aResultToken.result = FAIL;
+	return false;
+}
+
+static bool OutOfMemory() {
+	Object::Error(ExprTokenType(_T("Out of memory.")), nullptr, _T("MemoryError"));
+	return false;
+}
+
+static bool InvalidData() {
+	Object::Error(ExprTokenType(_T("Invalid or corrupt data.")));
+	return false;
+}
+
+static void OSFail(ResultToken& aResultToken, LPTSTR aPath) {
+	ExprTokenType code;
+	code.SetValue((__int64)GetLastError());
+	Object::Error(code, aPath, _T("OSError"));
+	aResultToken.result = FAIL;
+}
+
+static SerialKind KindOf(IObject* aObj) {
+	LPTSTR type = aObj->Type();
+	return !_tcscmp(type, _T("Object")) ? SERIAL_OBJECT : !_tcscmp(type, _T("Array")) ? SERIAL_ARRAY
+		: !_tcscmp(type, _T("Map")) ? SERIAL_MAP : (SerialKind)0;
+}
+
+// Orders field names as Object::FindField() does: by the lower-case first character, then caselessly.
+static int CompareNames(LPCTSTR a, LPCTSTR b) {
+	int ca = *a, cb = *b;
+	if (ca <= 'Z' && ca >= 'A')
+		ca += 32;
+	if (cb <= 'Z' && cb >= 'A')
+		cb += 32;
+	return ca != cb ? ca - cb : _tcsicmp(a, b);
+}
+
+static inline UINT64 Mix(UINT64 h) {
+	h ^= h >> 33, h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33, h *= 0xC4CEB9FE1A85EC53ULL;
+	return h ^ h >> 33;
+}
+
+static UINT64 HashBytes(const void* aData, size_t aSize) {
+	const BYTE* p = (const BYTE*)aData;
+	UINT64 h = aSize * 0x9E3779B185EBCA87ULL, v;
+	for (; aSize >= 8; p += 8, aSize -= 8) {
+		memcpy(&v, p, 8);
+		h = _rotl64(h ^ v * 0xC2B2AE3D27D4EB4FULL, 31) * 0x9E3779B185EBCA87ULL;
+	}
+	if (aSize) {
+		v = 0;
+		memcpy(&v, p, aSize);
+		h = _rotl64(h ^ v * 0xC2B2AE3D27D4EB4FULL, 31) * 0x9E3779B185EBCA87ULL;
+	}
+	return Mix(h);
+}
+
+// A growable byte buffer.  Pointers into it are invalidated by Append().
+class ByteBuffer
+{
+	BYTE* mData = nullptr;
+	size_t mSize = 0, mCapacity = 0;
+public:
+	ByteBuffer() {}
+	ByteBuffer(const ByteBuffer&) = delete;
+	~ByteBuffer() { free(mData); }
+
+	// Returns the offset of aSize new bytes, after zero padding to a multiple of aAlign, or -1.
+	size_t Append(size_t aSize, size_t aAlign = 1) {
+		size_t start = (mSize + aAlign - 1) & ~(aAlign - 1);
+		if (start + aSize > mCapacity) {
+			size_t capacity = mCapacity ? mCapacity * 2 : 0x10000;
+			if (capacity < start + aSize)
+				capacity = start + aSize;
+			BYTE* data = (BYTE*)realloc(mData, capacity);
+			if (!data)
+				return (size_t)-1;
+			mData = data, mCapacity = capacity;
+		}
+		memset(mData + mSize, 0, start - mSize);
+		mSize = start + aSize;
+		return start;
+	}
+	template<typename T>
+	bool Push(T aValue) {
+		size_t at = Append(sizeof(T), alignof(T));
+		if (at == (size_t)-1)
+			return false;
+		memcpy(mData + at, &aValue, sizeof(T));
+		return true;
+	}
+
+	BYTE* Data() { return mData; }
+	size_t Size() { return mSize; }
+	template<typename T>
+	T& At(size_t aIndex) { return ((T*)mData)[aIndex]; }
+};
+
+// Maps an object to its node index, by address.  Open addressing with linear probing.
+class NodeIds
+{
+	struct Slot
+	{
+		IObject* key;
+		UINT32 id;
+	};
+	Slot* mSlots = nullptr;
+	size_t mMask = 0, mCount = 0;
+
+	static size_t Hash(IObject* aKey) {
+		UINT64 h = (UINT64)(size_t)aKey * 0x9E3779B97F4A7C15ULL;
+		return (size_t)(h >> 32 ^ h);
+	}
+
+	bool Grow() {
+		size_t capacity = mSlots ? (mMask + 1) * 2 : 256;
+		Slot* slots = (Slot*)calloc(capacity, sizeof(Slot));
+		if (!slots)
+			return false;
+		for (size_t i = 0; mSlots && i <= mMask; ++i) {
+			if (!mSlots[i].key)
+				continue;
+			size_t pos = Hash(mSlots[i].key) & (capacity - 1);
+			while (slots[pos].key)
+				pos = (pos + 1) & (capacity - 1);
+			slots[pos] = mSlots[i];
+		}
+		free(mSlots);
+		mSlots = slots, mMask = capacity - 1;
+		return true;
+	}
+
+public:
+	NodeIds() {}
+	NodeIds(const NodeIds&) = delete;
+	~NodeIds() { free(mSlots); }
+
+	UINT32* Find(IObject* aKey) {
+		if (!mSlots)
+			return nullptr;
+		for (size_t pos = Hash(aKey) & mMask; mSlots[pos].key; pos = (pos + 1) & mMask)
+			if (mSlots[pos].key == aKey)
+				return &mSlots[pos].id;
+		return nullptr;
+	}
+
+	bool Add(IObject* aKey, UINT32 aId) {
+		if (((mCount + 1) * 4 > (mMask + 1) * 3 || !mSlots) && !Grow())
+			return false;
+		size_t pos = Hash(aKey) & mMask;
+		while (mSlots[pos].key)
+			pos = (pos + 1) & mMask;
+		mSlots[pos] = { aKey, aId };
+		++mCount;
+		return true;
+	}
+};
+
+//
+// SerialWriter - numbers the objects of a graph in breadth-first order and writes a record
+// for each, without recursion.  Strings are deduplicated by content.
+//
+
+class SerialWriter
+{
+	ByteBuffer mNodes, mStrings;
+	ByteBuffer mNodeOffsets, mStringOffsets;	// UINT64, relative to each section.
+	ByteBuffer mQueue;	// IObject*, by node index.
+	ByteBuffer mStringHashes;	// UINT32, by string index.
+	NodeIds mIds;
+	UINT32* mTable = nullptr;	// String index + 1, or 0 for an empty slot.
+	size_t mTableMask = 0;
+	UINT32 mNodeCount = 0, mStringCount = 0;
+
+	bool GrowTable() {
+		size_t capacity = mTable ? (mTableMask + 1) * 2 : 1024;
+		auto table = (UINT32*)calloc(capacity, sizeof(UINT32));
+		if (!table)
+			return OutOfMemory();
+		for (UINT32 i = 0; i < mStringCount; ++i) {
+			size_t pos = mStringHashes.At<UINT32>(i) & (capacity - 1);
+			while (table[pos])
+				pos = (pos + 1) & (capacity - 1);
+			table[pos] = i + 1;
+		}
+		free(mTable);
+		mTable = table, mTableMask = capacity - 1;
+		return true;
+	}
+
+	bool StringId(LPCTSTR aStr, size_t aLength, UINT64& aId) {
+		UINT32 hash = (UINT32)HashBytes(aStr, aLength * sizeof(TCHAR));
+		size_t pos = hash & mTableMask;
+		for (UINT32 id; mTable && (id = mTable[pos]); pos = (pos + 1) & mTableMask) {
+			if (mStringHashes.At<UINT32>(--id) != hash)
+				continue;
+			BYTE* rec = mStrings.Data() + mStringOffsets.At<UINT64>(id);
+			if (*(UINT32*)rec == aLength && !memcmp(rec + sizeof(UINT32), aStr, aLength * sizeof(TCHAR))) {
+				aId = id;
+				return true;
+			}
+		}
+		if (aLength > UINT_MAX || mStringCount == UINT_MAX) {
+			Object::Error(ExprTokenType(_T("Too much data.")));
+			return false;
+		}
+		if ((size_t)(mStringCount + 1) * 4 > (mTableMask + 1) * 3 || !mTable) {
+			if (!GrowTable())
+				return false;
+			for (pos = hash & mTableMask; mTable[pos]; pos = (pos + 1) & mTableMask);
+		}
+		size_t at = mStrings.Append(sizeof(UINT32) + (aLength + 1) * sizeof(TCHAR), sizeof(UINT32));
+		if (at == (size_t)-1 || !mStringOffsets.Push((UINT64)at) || !mStringHashes.Push(hash))
+			return OutOfMemory();
+		BYTE* rec = mStrings.Data() + at;
+		*(UINT32*)rec = (UINT32)aLength;
+		memcpy(rec + sizeof(UINT32), aStr, aLength * sizeof(TCHAR));
+		((TCHAR*)(rec + sizeof(UINT32)))[aLength] = 0;
+		mTable[pos] = ++mStringCount;
+		aId = mStringCount - 1;
+		return true;
+	}
+
+	// Returns the index of aObj's node, numbering it if it is new.
+	bool NodeId(IObject* aObj, UINT64& aId) {
+		if (UINT32* id = mIds.Find(aObj)) {
+			aId = *id;
+			return true;
+		}
+		if (!KindOf(aObj)) {
+			Object::Error(ExprTokenType(_T("Unsupported type.")), aObj->Type(), _T("TypeError"));
+			return false;
+		}
+		if (mNodeCount == UINT_MAX) {
+			Object::Error(ExprTokenType(_T("Too much data.")));
+			return false;
+		}
+		if (!mIds.Add(aObj, mNodeCount) || !mQueue.Push(aObj))
+			return OutOfMemory();
+		aId = mNodeCount++;
+		return true;
+	}
+
+	bool Value(Object::Variant& aValue, UINT64& aPayload, BYTE& aType) {
+		switch (aValue.symbol)
+		{
+		case SYM_INTEGER: aType = SERIAL_INTEGER, aPayload = aValue.n_int64; return true;
+		case SYM_FLOAT: aType = SERIAL_FLOAT, memcpy(&aPayload, &aValue.n_double, sizeof(double)); return true;
+		case SYM_STRING: aType = SERIAL_STRING; return StringId(aValue.string.Value(), aValue.string.Length(), aPayload);
+		case SYM_OBJECT: aType = SERIAL_NODE; return NodeId(aValue.object, aPayload);
+		default: aType = SERIAL_MISSING, aPayload = 0; return true;
+		}
+	}
+
+	// Reserves the record of a node with aCount items or pairs; returns its offset in mNodes.
+	size_t NewRecord(SerialKind aKind, UINT32 aCount, BYTE aFlags) {
+		SerialNode node = { aKind, aFlags, 0, aCount };
+		size_t at = mNodes.Append((size_t)SerialNode::SizeOf(node.Slots()), 8);
+		if (at == (size_t)-1 || !mNodeOffsets.Push((UINT64)at))
+			return OutOfMemory(), (size_t)-1;
+		*(SerialNode*)(mNodes.Data() + at) = node;
+		return at;
+	}
+
+	// Fills a slot of the record at aRecord.  Only mStrings and mQueue grow meanwhile, so the
+	// record stays where it is.
+	void SetSlot(size_t aRecord, UINT64 aSlot, UINT64 aPayload, BYTE aType) {
+		auto node = (SerialNode*)(mNodes.Data() + aRecord);
+		((UINT64*)node->Payload())[aSlot] = aPayload;
+		((BYTE*)node->Types())[aSlot] = aType;
+	}
+
+	bool WriteNode(IObject* aObj) {
+		UINT64 payload;
+		BYTE type;
+		size_t rec;
+		switch (KindOf(aObj))
+		{
+		case SERIAL_ARRAY: {
+			auto arr = static_cast<Array*>(aObj);
+			if ((rec = NewRecord(SERIAL_ARRAY, arr->mLength, 0)) == (size_t)-1)
+				return false;
+			for (Object::index_t i = 0; i < arr->mLength; ++i) {
+				if (!Value(arr->mItem[i], payload, type))
+					return false;
+				SetSlot(rec, i, payload, type);
+			}
+			return true;
+		}
+		case SERIAL_MAP: {
+			auto map = static_cast<Map*>(aObj);
+			auto case_flags = map->CaseFlags();
+			BYTE flags = (case_flags & Map::MapCaseless ? SERIAL_CASELESS : 0) | (case_flags & Map::MapUseLocale ? SERIAL_LOCALE : 0);
+			if ((rec = NewRecord(SERIAL_MAP, map->mCount, flags)) == (size_t)-1)
+				return false;
+			for (Object::index_t i = 0; i < map->mCount; ++i) {
+				auto& pair = map->mItem[i];
+				if (i < map->mKeyOffsetObject)
+					payload = pair.key.i, type = SERIAL_INTEGER;
+				else if (i < map->mKeyOffsetString ? (type = SERIAL_NODE, !NodeId(pair.key.p, payload))
+					: (type = SERIAL_STRING, !StringId(pair.key.s, _tcslen(pair.key.s), payload)))
+					return false;
+				SetSlot(rec, (UINT64)i * 2, payload, type);
+				if (!Value(pair, payload, type))
+					return false;
+				SetSlot(rec, (UINT64)i * 2 + 1, payload, type);
+			}
+			return true;
+		}
+		default: {
+			auto obj = static_cast<Object*>(aObj);
+			auto fields = obj->mFields.Value();
+			Object::index_t count = 0, length = obj->mFields.Length();
+			// Dynamic properties are skipped.  The host's UnsortedFlag isn't visible, so whether
+			// the names are in binary search order is checked here.
+			bool sorted = true;
+			LPTSTR last = nullptr;
+			for (Object::index_t i = 0; i < length; ++i) {
+				if (fields[i].symbol == SYM_DYNAMIC)
+					continue;
+				if (last && CompareNames(last, fields[i].name) >= 0)
+					sorted = false;
+				last = fields[i].name, ++count;
+			}
+			if ((rec = NewRecord(SERIAL_OBJECT, count, sorted ? SERIAL_SORTED : 0)) == (size_t)-1)
+				return false;
+			for (Object::index_t i = 0, n = 0; i < length; ++i) {
+				auto& field = fields[i];
+				if (field.symbol == SYM_DYNAMIC)
+					continue;
+				if (!StringId(field.name, _tcslen(field.name), payload))
+					return false;
+				SetSlot(rec, (UINT64)n * 2, payload, SERIAL_STRING);
+				if (!Value(field, payload, type))
+					return false;
+				SetSlot(rec, (UINT64)n++ * 2 + 1, payload, type);
+			}
+			return true;
+		}
+		}
+	}
+
+	static UINT64 Align8(UINT64 aSize) { return (aSize + 7) & ~(UINT64)7; }
+
+	template<typename W>
+	static bool WriteOffsets(W& aWrite, ByteBuffer& aOffsets, UINT32 aCount, UINT64 aBase) {
+		UINT64 chunk[1024];
+		for (UINT32 i = 0; i < aCount; ) {
+			UINT32 n = aCount - i < _countof(chunk) ? aCount - i : (UINT32)_countof(chunk);
+			for (UINT32 j = 0; j < n; ++j)
+				chunk[j] = aOffsets.At<UINT64>(i + j) + aBase;
+			if (!aWrite(chunk, n * sizeof(UINT64)))
+				return false;
+			i += n;
+		}
+		return true;
+	}
+
+public:
+	SerialWriter() {}
+	SerialWriter(const SerialWriter&) = delete;
+	~SerialWriter() { free(mTable); }
+
+	bool Write(IObject* aRoot) {
+		UINT64 id;
+		if (!NodeId(aRoot, id))
+			return false;
+		for (UINT32 i = 0; i < mNodeCount; ++i)
+			if (!WriteNode(mQueue.At<IObject*>(i)))
+				return false;
+		return true;
+	}
+
+	UINT64 Size() {
+		return sizeof(SerialHeader) + Align8(mNodes.Size()) + Align8(mStrings.Size())
+			+ ((UINT64)mStringCount + mNodeCount) * sizeof(UINT64);
+	}
+
+	// Passes the file to aWrite(data, size) in order.
+	template<typename W>
+	bool Emit(W& aWrite) {
+		static const BYTE sZero[8] = {};
+		UINT64 nodes = sizeof(SerialHeader), strings = nodes + Align8(mNodes.Size());
+		SerialHeader header = { SERIAL_MAGIC, SERIAL_VERSION, (UINT16)sizeof(TCHAR), mStringCount, mNodeCount };
+		header.string_index = strings + Align8(mStrings.Size());
+		header.node_index = header.string_index + (UINT64)mStringCount * sizeof(UINT64);
+		header.size = Size();
+		return aWrite(&header, sizeof(header))
+			&& aWrite(mNodes.Data(), mNodes.Size()) && aWrite(sZero, (size_t)(Align8(mNodes.Size()) - mNodes.Size()))
+			&& aWrite(mStrings.Data(), mStrings.Size()) && aWrite(sZero, (size_t)(Align8(mStrings.Size()) - mStrings.Size()))
+			&& WriteOffsets(aWrite, mStringOffsets, mStringCount, strings)
+			&& WriteOffsets(aWrite, mNodeOffsets, mNodeCount, nodes);
+	}
+};
+
+//
+// SerialData - a loaded file: mapped, copied from a Buffer, or borrowed for the duration of
+// a load().  Every offset read from it is checked before use.
+//
+
+class SerialView;
+
+class SerialData : public ObjectBase
+{
+	const BYTE* mData = nullptr;
+	size_t mSize = 0;
+	void* mView = nullptr;	// The mapping of a file.
+	void* mCopy = nullptr;
+	const SerialHeader* mHeader = nullptr;
+	const UINT64* mStringIndex = nullptr, * mNodeIndex = nullptr;
+	SerialView** mViews = nullptr;	// The live view of each node, or nullptr.
+
+	bool Validate() {
+		auto h = (const SerialHeader*)mData;
+		if (mSize < sizeof(SerialHeader) || h->magic != SERIAL_MAGIC || h->version != SERIAL_VERSION
+			|| h->char_size != sizeof(TCHAR) || h->size != mSize || !h->node_count
+			|| (h->string_index & 7) || h->string_index > mSize || h->string_count > (mSize - h->string_index) / sizeof(UINT64)
+			|| (h->node_index & 7) || h->node_index > mSize || h->node_count > (mSize - h->node_index) / sizeof(UINT64))
+			return InvalidData();
+		mHeader = h;
+		mStringIndex = (const UINT64*)(mData + h->string_index);
+		mNodeIndex = (const UINT64*)(mData + h->node_index);
+		return Node(0) || InvalidData();
+	}
+
+public:
+	~SerialData() {
+		if (mView)
+			UnmapViewOfFile(mView);
+		free(mCopy);
+		free(mViews);
+	}
+	LPTSTR Type() { return _T("SerialData"); }
+
+	bool Borrow(const void* aData, size_t aSize) {
+		mData = (const BYTE*)aData, mSize = aSize;
+		return Validate();
+	}
+
+	bool Copy(const void* aData, size_t aSize) {
+		if (!(mCopy = malloc(aSize ? aSize : 1)))
+			return OutOfMemory();
+		memcpy(mCopy, aData, aSize);
+		return Borrow(mCopy, aSize);
+	}
+
+	// Maps the file read-only; returns false after setting GetLastError(), or throwing.
+	bool MapFile(LPCTSTR aPath, bool& aOSError) {
+		aOSError = true;
+		HANDLE file = CreateFile(aPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		HANDLE mapping = nullptr;
+		bool ok = GetFileSizeEx(file, &size);
+		// Too small to map (an empty file can't be) or to be valid.
+		if (ok && (UINT64)size.QuadPart < sizeof(SerialHeader))
+			aOSError = ok = false;
+		else if (ok && (UINT64)size.QuadPart > (SIZE_T)-1)
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY), ok = false;
+		if (ok && (ok = (mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr)) != nullptr))
+			ok = (mView = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, (SIZE_T)size.QuadPart)) != nullptr;
+		// The view keeps the file open.
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		if (!ok)
+			return aOSError || InvalidData();
+		aOSError = false;
+		return Borrow(mView, (size_t)size.QuadPart);
+	}
+
+	UINT32 NodeCount() { return mHeader->node_count; }
+
+	const SerialNode* Node(UINT64 aId) {
+		if (aId >= mHeader->node_count)
+			return nullptr;
+		UINT64 offset = mNodeIndex[aId];
+		if ((offset & 7) || offset < sizeof(SerialHeader) || offset > mSize - sizeof(SerialNode))
+			return nullptr;
+		auto node = (const SerialNode*)(mData + offset);
+		if (node->kind < SERIAL_ARRAY || node->kind > SERIAL_OBJECT || SerialNode::SizeOf(node->Slots()) > mSize - offset)
+			return nullptr;
+		return node;
+	}
+
+	bool String(UINT64 aId, LPTSTR& aStr, size_t& aLength) {
+		if (aId >= mHeader->string_count)
+			return false;
+		UINT64 offset = mStringIndex[aId];
+		if ((offset & 3) || offset > mSize - sizeof(UINT32))
+			return false;
+		UINT64 length = *(const UINT32*)(mData + offset);
+		if ((length + 1) * sizeof(TCHAR) > mSize - offset - sizeof(UINT32))
+			return false;
+		aStr = (LPTSTR)(mData + offset + sizeof(UINT32));
+		aLength = (size_t)length;
+		return !aStr[length];
+	}
+
+	// Returns a new reference to the view of a node which Node() accepted, or nullptr.
+	SerialView* View(UINT32 aId);
+	void Forget(UINT32 aId) { mViews[aId] = nullptr; }
+};
+
+//
+// SerialLoader - builds the Objects, Arrays and Maps reachable from a node.  Each container
+// is created empty when first reached and filled when its turn comes, so shared objects and
+// cycles need no special handling.
+//
+
+#define SERIAL_LOAD_BATCH 4096	// Slots passed to each Push or Set call.
+
+class SerialLoader
+{
+	SerialData& mData;
+	IObject** mObjects = nullptr;	// By node index.
+	UINT32* mQueue = nullptr;
+	UINT32 mQueued = 0;
+	Arena mArena;
+
+	static IObject* sArray, * sMap, * sObject;
+
+	static bool Call(IObject* aObj, LPTSTR aName, ExprTokenType* aParam[], int aParamCount) {
+		TCHAR buf[MAX_NUMBER_SIZE];
+		ResultToken result;
+		result.InitResult(buf);
+		aObj->Invoke(result, IT_CALL, aName, ExprTokenType(aObj), aParam, aParamCount);
+		result.Free();
+		return !result.Exited();
+	}
+
+	bool Reach(UINT64 aId) {
+		const SerialNode* node = mData.Node(aId);
+		if (!node)
+			return InvalidData();
+		if (mObjects[aId])
+			return true;
+		IObject* obj = CallGlobal(node->kind == SERIAL_ARRAY ? sArray : node->kind == SERIAL_MAP ? sMap : sObject, nullptr, 0);
+		if (!obj)
+			return false;
+		mObjects[aId] = obj, mQueue[mQueued++] = (UINT32)aId;
+		if (node->kind == SERIAL_MAP && (node->flags & (SERIAL_CASELESS | SERIAL_LOCALE))) {
+			ExprTokenType mode;
+			mode.SetValue((LPTSTR)(node->flags & SERIAL_LOCALE ? _T("Locale") : _T("Off")));
+			return SetProperty(obj, _T("CaseSense"), mode);
+		}
+		return true;
+	}
+
+	bool Token(BYTE aType, UINT64 aPayload, ExprTokenType& aToken) {
+		LPTSTR str;
+		size_t length;
+		switch (aType)
+		{
+		case SERIAL_INTEGER: aToken.SetValue((__int64)aPayload); return true;
+		case SERIAL_FLOAT: aToken.symbol = SYM_FLOAT, memcpy(&aToken.value_double, &aPayload, sizeof(double)); return true;
+		case SERIAL_STRING:
+			if (!mData.String(aPayload, str, length))
+				return InvalidData();
+			aToken.SetValue(str, length);
+			return true;
+		case SERIAL_NODE: aToken.SetValue(mObjects[aPayload]); return true;
+		case SERIAL_MISSING: aToken.symbol = SYM_MISSING, aToken.value_int64 = 0; return true;
+		default: return InvalidData();
+		}
+	}
+
+	bool Fill(UINT32 aId) {
+		const SerialNode* node = mData.Node(aId);
+		IObject* obj = mObjects[aId];
+		UINT64 slots = node->Slots();
+		auto payload = node->Payload();
+		auto types = node->Types();
+		for (UINT64 i = 0; i < slots; ++i)
+			if (types[i] == SERIAL_NODE && !Reach(payload[i]))
+				return false;
+		if (node->kind == SERIAL_OBJECT) {
+			ExprTokenType name, value;
+			for (UINT64 i = 0; i < slots; i += 2) {
+				if (types[i] != SERIAL_STRING || types[i + 1] == SERIAL_MISSING)
+					return InvalidData();
+				if (!Token(types[i], payload[i], name) || !Token(types[i + 1], payload[i + 1], value)
+					|| !SetProperty(obj, name.marker, value))
+					return false;
+			}
+			return true;
+		}
+		for (UINT64 i = 0; i < slots; ) {
+			ArenaScope scope(mArena);
+			UINT64 n = slots - i < SERIAL_LOAD_BATCH ? slots - i : SERIAL_LOAD_BATCH;
+			ExprTokenType** params = mArena.NewParams((size_t)n);
+			if (!params)
+				return OutOfMemory();
+			for (UINT64 j = 0; j < n; ++j, ++i) {
+				// Map keys are integers, strings or objects, and values can't be missing.
+				if (node->kind == SERIAL_MAP && (i & 1 ? types[i] == SERIAL_MISSING : types[i] == SERIAL_MISSING || types[i] == SERIAL_FLOAT))
+					return InvalidData();
+				if (!Token(types[i], payload[i], *params[j]))
+					return false;
+			}
+			if (!Call(obj, (LPTSTR)(node->kind == SERIAL_ARRAY ? _T("Push") : _T("Set")), params, (int)n))
+				return false;
+		}
+		return true;
+	}
+
+public:
+	SerialLoader(SerialData& aData) : mData(aData) {}
+	SerialLoader(const SerialLoader&) = delete;
+	~SerialLoader() {
+		// Each object is referenced by its parent by now, or is being discarded.
+		for (UINT32 i = 0; i < mQueued; ++i)
+			mObjects[mQueue[i]]->Release();
+		free(mObjects), free(mQueue);
+	}
+
+	static bool Init() {
+		if (!sMap && (!(sMap = GetGlobal(_T("Map"))) || !(sArray = GetGlobal(_T("Array"))) || !(sObject = GetGlobal(_T("Object")))))
+			return false;
+		return true;
+	}
+
+	// Returns a new reference to the object of node aRoot, or nullptr after throwing.
+	IObject* Load(UINT32 aRoot) {
+		if (!Init())
+			return nullptr;
+		UINT32 count = mData.NodeCount();
+		if (!(mObjects = (IObject**)calloc(count, sizeof(IObject*))) || !(mQueue = (UINT32*)malloc(count * sizeof(UINT32)))) {
+			OutOfMemory();
+			return nullptr;
+		}
+		if (!Reach(aRoot))
+			return nullptr;
+		for (UINT32 i = 0; i < mQueued; ++i)
+			if (!Fill(mQueue[i]))
+				return nullptr;
+		mObjects[aRoot]->AddRef();
+		return mObjects[aRoot];
+	}
+};
+
+IObject* SerialLoader::sArray = nullptr, * SerialLoader::sMap = nullptr, * SerialLoader::sObject = nullptr;
+
+//
+// SerialView - read-only access to one node of a SerialData.
+//
+
+class SerialView : public ObjectBase
+{
+	SerialData* mData;
+	UINT32 mId;
+
+	bool IndexOf(const SerialNode* aNode, ExprTokenType& aKey, UINT64& aSlot);
+	bool FindPair(const SerialNode* aNode, ExprTokenType& aKey, UINT64& aSlot);
+	bool FindField(const SerialNode* aNode, LPCTSTR aName, UINT64& aSlot);
+
+public:
+	SerialView(SerialData* aData, UINT32 aId) : mData(aData), mId(aId) { aData->AddRef(); }
+	~SerialView() { mData->Forget(mId), mData->Release(); }
+	LPTSTR Type() { return _T("SerialView"); }
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL);
+
+	SerialData* Data() { return mData; }
+	UINT32 Id() { return mId; }
+	const SerialNode* Node() { return mData->Node(mId); }
+	// Finds the slot of the value of aKey: an index, Map key or field name.
+	bool Find(ExprTokenType& aKey, UINT64& aSlot);
+	bool ReturnSlot(ResultToken& aResultToken, UINT64 aSlot);
+	bool AssignSlot(Var* aVar, UINT64 aSlot);
+};
+
+SerialView* SerialData::View(UINT32 aId) {
+	if (!mViews && !(mViews = (SerialView**)calloc(mHeader->node_count, sizeof(SerialView*)))) {
+		OutOfMemory();
+		return nullptr;
+	}
+	if (SerialView* view = mViews[aId]) {
+		view->AddRef();
+		return view;
+	}
+	if (!(mViews[aId] = new SerialView(this, aId)))
+		OutOfMemory();
+	return mViews[aId];
+}
+
+static bool UnsetItem(ExprTokenType& aKey) {
+	ExprTokenType key;
+	TCHAR buf[MAX_NUMBER_SIZE];
+	TokenToValue(aKey, key);
+	LPTSTR extra = key.symbol == SYM_STRING ? key.marker : nullptr;
+	if (key.symbol == SYM_INTEGER)
+		_i64tot_s(key.value_int64, buf, _countof(buf), 10), extra = buf;
+	Object::Error(ExprTokenType(_T("Item has no value.")), extra, _T("UnsetItemError"));
+	return false;
+}
+
+// Resolves an index as Array does, to a slot which has a value.
+bool SerialView::IndexOf(const SerialNode* aNode, ExprTokenType& aKey, UINT64& aSlot) {
+	size_t index;
+	if (!TokenToIndex(aKey, (size_t)aNode->count, index))
+		return false;
+	aSlot = index;
+	return aNode->Types()[aSlot] != SERIAL_MISSING;
+}
+
+// Keys were written in the order Map keeps them: integers, objects, then strings, each sorted.
+bool SerialView::FindPair(const SerialNode* aNode, ExprTokenType& aKey, UINT64& aSlot) {
+	auto payload = aNode->Payload();
+	auto types = aNode->Types();
+	if (aKey.symbol == SYM_OBJECT) {
+		// Only a view of this data can be a key here; object keys are few, so search them in turn.
+		if (_tcscmp(aKey.object->Type(), _T("SerialView")))
+			return false;
+		auto view = static_cast<SerialView*>(aKey.object);
+		for (UINT64 i = 0; view->mData == mData && i < aNode->count; ++i)
+			if (types[i * 2] == SERIAL_NODE && payload[i * 2] == view->mId)
+				return aSlot = i * 2 + 1, true;
+		return false;
+	}
+	if (aKey.symbol != SYM_INTEGER && aKey.symbol != SYM_STRING)
+		return false;
+	int rank = aKey.symbol == SYM_INTEGER ? 0 : 2;
+	UINT64 left = 0, right = aNode->count;
+	while (left < right) {
+		UINT64 mid = left + (right - left) / 2;
+		BYTE type = types[mid * 2];
+		int mid_rank = type == SERIAL_INTEGER ? 0 : type == SERIAL_NODE ? 1 : 2, result = rank - mid_rank;
+		if (!result && rank == 0)
+			result = aKey.value_int64 < (__int64)payload[mid * 2] ? -1 : aKey.value_int64 > (__int64)payload[mid * 2];
+		else if (!result) {
+			LPTSTR str;
+			size_t length;
+			if (type != SERIAL_STRING || !mData->String(payload[mid * 2], str, length))
+				return false;
+			result = aNode->flags & SERIAL_LOCALE ? lstrcmpi(aKey.marker, str)
+				: aNode->flags & SERIAL_CASELESS ? _tcsicmp(aKey.marker, str) : _tcscmp(aKey.marker, str);
+		}
+		if (!result)
+			return aSlot = mid * 2 + 1, true;
+		if (result < 0)
+			right = mid;
+		else left = mid + 1;
+	}
+	return false;
+}
+
+bool SerialView::FindField(const SerialNode* aNode, LPCTSTR aName, UINT64& aSlot) {
+	auto payload = aNode->Payload();
+	LPTSTR str;
+	size_t length;
+	if (!(aNode->flags & SERIAL_SORTED)) {
+		for (UINT64 i = 0; i < aNode->count; ++i)
+			if (mData->String(payload[i * 2], str, length) && !_tcsicmp(aName, str))
+				return aSlot = i * 2 + 1, true;
+		return false;
+	}
+	UINT64 left = 0, right = aNode->count;
+	while (left < right) {
+		UINT64 mid = left + (right - left) / 2;
+		if (!mData->String(payload[mid * 2], str, length))
+			return false;
+		int result = CompareNames(aName, str);
+		if (!result)
+			return aSlot = mid * 2 + 1, true;
+		if (result < 0)
+			right = mid;
+		else left = mid + 1;
+	}
+	return false;
+}
+
+bool SerialView::Find(ExprTokenType& aKey, UINT64& aSlot) {
+	const SerialNode* node = Node();
+	ExprTokenType key;
+	TokenToValue(aKey, key);
+	if (node->kind == SERIAL_ARRAY)
+		return IndexOf(node, key, aSlot);
+	if (node->kind == SERIAL_MAP)
+		return FindPair(node, key, aSlot);
+	TCHAR buf[MAX_NUMBER_SIZE];
+	if (key.symbol == SYM_INTEGER)
+		key.SetValue(_i64tot(key.value_int64, buf, 10));
+	return key.symbol == SYM_STRING && FindField(node, key.marker, aSlot);
+}
+
+bool SerialView::ReturnSlot(ResultToken& aResultToken, UINT64 aSlot) {
+	const SerialNode* node = Node();
+	UINT64 payload = node->Payload()[aSlot];
+	LPTSTR str;
+	size_t length;
+	switch (node->Types()[aSlot])
+	{
+	case SERIAL_INTEGER: aResultToken.SetValue((__int64)payload); return true;
+	case SERIAL_FLOAT: aResultToken.symbol = SYM_FLOAT, memcpy(&aResultToken.value_double, &payload, sizeof(double)); return true;
+	case SERIAL_STRING:
+		// The mapping outlives the call, and the caller copies the string.
+		if (!mData->String(payload, str, length))
+			return InvalidData();
+		aResultToken.SetValue(str, length);
+		return true;
+	case SERIAL_NODE:
+		if (!mData->Node(payload))
+			return InvalidData();
+		if (SerialView* view = mData->View((UINT32)payload)) {
+			aResultToken.SetValue(view);
+			return true;
+		}
+		return false;
+	default: return InvalidData();
+	}
+}
+
+bool SerialView::AssignSlot(Var* aVar, UINT64 aSlot) {
+	const SerialNode* node = Node();
+	UINT64 payload = node->Payload()[aSlot];
+	LPTSTR str;
+	size_t length;
+	double d;
+	switch (node->Types()[aSlot])
+	{
+	case SERIAL_INTEGER: aVar->Assign((__int64)payload); return true;
+	case SERIAL_FLOAT: memcpy(&d, &payload, sizeof(d)), aVar->Assign(d); return true;
+	case SERIAL_STRING:
+		if (!mData->String(payload, str, length))
+			return InvalidData();
+		return aVar->Assign(str, length) || OutOfMemory();
+	case SERIAL_NODE:
+		if (!mData->Node(payload))
+			return InvalidData();
+		if (SerialView* view = mData->View((UINT32)payload)) {
+			aVar->Assign(view);
+			view->Release();
+			return true;
+		}
+		return false;
+	case SERIAL_MISSING: return true;	// An unset Array item leaves the variable as it is.
+	default: return InvalidData();
+	}
+}
+
+// for v in view, for i, v in view (Arrays) and for k, v in view (Maps and Objects).
+class SerialEnum : public ObjectBase
+{
+	SerialView* mView;
+	UINT64 mPos = 0;
+	int mVarCount;
+public:
+	SerialEnum(SerialView* aView, int aVarCount) : mView(aView), mVarCount(aVarCount) { aView->AddRef(); }
+	~SerialEnum() { mView->Release(); }
+	LPTSTR Type() { return _T("Enumerator"); }
+
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+		if (!IS_INVOKE_CALL || (aName && _tcsicmp(aName, _T("Call"))))
+			return INVOKE_NOT_HANDLED;
+		const SerialNode* node = mView->Node();
+		if (mPos >= node->count) {
+			aResultToken.SetValue((__int64)0);
+			return OK;
+		}
+		UINT64 i = mPos++;
+		Var* var;
+		bool ok = true;
+		if (node->kind == SERIAL_ARRAY) {
+			int value_param = mVarCount > 1 ? 1 : 0;
+			if (value_param && aParamCount > 0 && (var = TokenToOutputVar(*aParam[0])))
+				var->Assign((__int64)i + 1);
+			if (aParamCount > value_param && (var = TokenToOutputVar(*aParam[value_param])))
+				ok = mView->AssignSlot(var, i);
+		}
+		else {
+			if (aParamCount > 0 && (var = TokenToOutputVar(*aParam[0])))
+				ok = mView->AssignSlot(var, i * 2);
+			if (ok && aParamCount > 1 && mVarCount > 1 && (var = TokenToOutputVar(*aParam[1])))
+				ok = mView->AssignSlot(var, i * 2 + 1);
+		}
+		if (!ok)
+			return aResultToken.result = FAIL;
+		aResultToken.SetValue((__int64)1);
+		return OK;
+	}
+};
+
+static int EnumVarCount(ExprTokenType* aParam[], int aParamCount) {
+	ExprTokenType val;
+	if (!aParamCount || aParam[0]->symbol == SYM_MISSING)
+		return 1;
+	TokenToValue(*aParam[0], val);
+	return val.symbol == SYM_INTEGER ? (int)val.value_int64 : 1;
+}
+
+ResultType SerialView::Invoke(IObject_Invoke_PARAMS_DECL) {
+	const SerialNode* node = Node();
+	UINT64 slot;
+	if (!aName || !_tcsicmp(aName, _T("__Item"))) {
+		if (!IS_INVOKE_GET || aParamCount != 1)
+			return INVOKE_NOT_HANDLED;
+		if (!Find(*aParam[0], slot))
+			return UnsetItem(*aParam[0]), aResultToken.result = FAIL;
+		return ReturnSlot(aResultToken, slot) ? OK : aResultToken.result = FAIL;
+	}
+	// An Object's own properties take precedence over the view's, as they would on the Object.
+	if (node->kind == SERIAL_OBJECT && IS_INVOKE_GET && !aParamCount && FindField(node, aName, slot))
+		return ReturnSlot(aResultToken, slot) ? OK : aResultToken.result = FAIL;
+	if (IS_INVOKE_CALL) {
+		if (!_tcsicmp(aName, _T("Get")) && (aParamCount == 1 || aParamCount == 2)) {
+			if (Find(*aParam[0], slot))
+				return ReturnSlot(aResultToken, slot) ? OK : aResultToken.result = FAIL;
+			if (aParamCount == 1 || aParam[1]->symbol == SYM_MISSING)
+				return UnsetItem(*aParam[0]), aResultToken.result = FAIL;
+			ExprTokenType val;
+			TokenToValue(*aParam[1], val);
+			if (val.symbol == SYM_OBJECT)
+				val.object->AddRef();
+			static_cast<ExprTokenType&>(aResultToken) = val;
+			return OK;
+		}
+		if (!_tcsicmp(aName, _T("Has")) && aParamCount == 1) {
+			aResultToken.SetValue((__int64)Find(*aParam[0], slot));
+			return OK;
+		}
+		if (!_tcsicmp(aName, _T("__Enum"))) {
+			aResultToken.SetValue(new SerialEnum(this, EnumVarCount(aParam, aParamCount)));
+			return OK;
+		}
+		if (!_tcsicmp(aName, _T("Materialize")) && !aParamCount) {
+			SerialLoader loader(*mData);
+			IObject* obj = loader.Load(mId);
+			if (!obj)
+				return aResultToken.result = FAIL;
+			aResultToken.SetValue(obj);
+			return OK;
+		}
+		return INVOKE_NOT_HANDLED;
+	}
+	if (!IS_INVOKE_GET || aParamCount)
+		return INVOKE_NOT_HANDLED;
+	if (!_tcsicmp(aName, node->kind == SERIAL_ARRAY ? _T("Length") : _T("Count")))
+		aResultToken.SetValue((__int64)node->count);
+	else if (!_tcsicmp(aName, _T("CaseSense")) && node->kind == SERIAL_MAP)
+		aResultToken.SetValue((LPTSTR)(node->flags & SERIAL_LOCALE ? _T("Locale") : node->flags & SERIAL_CASELESS ? _T("Off") : _T("On")));
+	else return INVOKE_NOT_HANDLED;
+	return OK;
+}
+
+//
+// Exports
+//
+
+static bool ParamFlag(ExprTokenType* aParam[], int aParamCount, int aIndex) {
+	return aParamCount > aIndex && aParam[aIndex]->symbol != SYM_MISSING && TokenToBool(*aParam[aIndex]);
+}
+
+static bool WriteGraph(ExprTokenType& aParam, SerialWriter& aWriter, ResultToken& aResultToken) {
+	ExprTokenType val;
+	TokenToValue(aParam, val);
+	if (val.symbol != SYM_OBJECT || !KindOf(val.object))
+		return Fail(aResultToken, _T("Expected an Object, Array or Map."), _T("TypeError"));
+	if (!aWriter.Write(val.object)) {
+		aResultToken.result = FAIL;
+		return false;
+	}
+	return true;
+}
+
+// dump(obj)
+BIF_DECL(dump) {
+	SerialWriter writer;
+	if (!WriteGraph(*aParam[0], writer, aResultToken))
+		return;
+	BufferObject* buf;
+	if (writer.Size() > (SIZE_T)-1 || !NewBuffer((size_t)writer.Size(), buf)) {
+		aResultToken.result = FAIL;
+		return;
+	}
+	BYTE* out = (BYTE*)buf->mData;
+	auto write = [&](const void* aData, size_t aSize) {
+		// An empty section has no data at all.
+		if (aSize)
+			memcpy(out, aData, aSize);
+		out += aSize;
+		return true;
+	};
+	writer.Emit(write);
+	aResultToken.SetValue(buf);
+}
+
+// save(obj, path)
+BIF_DECL(save) {
+	ExprTokenType path;
+	SerialWriter writer;
+	TokenToValue(*aParam[1], path);
+	if (path.symbol != SYM_STRING) {
+		Fail(aResultToken, _T("Expected a file path."), _T("TypeError"));
+		return;
+	}
+	if (!WriteGraph(*aParam[0], writer, aResultToken))
+		return;
+	HANDLE file = CreateFile(path.marker, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		OSFail(aResultToken, path.marker);
+		return;
+	}
+	auto write = [&](const void* aData, size_t aSize) {
+		for (DWORD written; aSize; aSize -= written, aData = (const BYTE*)aData + written)
+			if (!WriteFile(file, aData, aSize < 0x40000000 ? (DWORD)aSize : 0x40000000, &written, nullptr))
+				return false;
+		return true;
+	};
+	if (!writer.Emit(write))
+		OSFail(aResultToken, path.marker);
+	CloseHandle(file);
+}
+
+// load(source, lazy := false)
+BIF_DECL(load) {
+	ExprTokenType source;
+	TokenToValue(*aParam[0], source);
+	bool lazy = ParamFlag(aParam, aParamCount, 1), os_error = false, ok;
+	auto data = new SerialData;
+	if (!data) {
+		Fail(aResultToken, _T("Out of memory."), _T("MemoryError"));
+		return;
+	}
+	if (source.symbol == SYM_OBJECT && !_tcscmp(source.object->Type(), _T("Buffer"))) {
+		// A view must not depend on the Buffer staying the same; a load is done before the script runs again.
+		auto buf = static_cast<BufferObject*>(source.object);
+		ok = lazy ? data->Copy(buf->mData, buf->mSize) : data->Borrow(buf->mData, buf->mSize);
+	}
+	else if (source.symbol == SYM_STRING)
+		ok = data->MapFile(source.marker, os_error);
+	else {
+		data->Release();
+		Fail(aResultToken, _T("Expected a Buffer or file path."), _T("TypeError"));
+		return;
+	}
+	IObject* result = nullptr;
+	if (ok) {
+		if (lazy)
+			result = data->View(0);
+		else result = SerialLoader(*data).Load(0);
+	}
+	else if (os_error)
+		OSFail(aResultToken, source.marker);
+	data->Release();
+	if (result)
+		aResultToken.SetValue(result);
+	else aResultToken.result = FAIL;
+}
+
+ExportSymbol symbols[] = {
+	EXPORT_FUNC(dump, 1, 1)
+	EXPORT_FUNC(save, 2, 2)
+	EXPORT_FUNC(load, 1, 2)
+};
+
+EXPORT_AHKMODULE(symbols)
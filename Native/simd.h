@@ -0,0 +1,1091 @@
+﻿#ifndef AHK2_SIMD_H
+#define AHK2_SIMD_H
+#include <intrin.h>
+
+//
+// CPU feature detection, evaluated once per module.
+//
+
+enum CpuFeature
+{
+	CPU_SSE2 = 0x01,
+	CPU_SSSE3 = 0x02,
+	CPU_SSE41 = 0x04,
+	CPU_SSE42 = 0x08,
+	CPU_AVX2 = 0x10,
+	CPU_PCLMUL = 0x20,
+	CPU_SHA = 0x40
+};
+
+static int DetectCpuFeatures() {
+	int info[4], features = 0;
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+	__cpuid(info, 1);
+	if (info[3] & (1 << 26)) features |= CPU_SSE2;
+	if (info[2] & (1 << 9)) features |= CPU_SSSE3;
+	if (info[2] & (1 << 19)) features |= CPU_SSE41;
+	if (info[2] & (1 << 20)) features |= CPU_SSE42;
+	if (info[2] & (1 << 1)) features |= CPU_PCLMUL;
+	// AVX2 also requires the OS to save the YMM registers.
+	bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+	if (max_leaf >= 7) {
+		__cpuidex(info, 7, 0);
+		if (os_avx && (info[1] & (1 << 5))) features |= CPU_AVX2;
+		if (info[1] & (1 << 29)) features |= CPU_SHA;
+	}
+	return features;
+}
+
+static int CpuFeatures() {
+	static int sFeatures = DetectCpuFeatures();
+	return sFeatures;
+}
+
+//
+// Character scanning kernels.  Each returns the first matching position in [aStr, aEnd), or aEnd.
+//   ScanQuote:  '"' or '\\'                     (end of a JSON string or start of an escape)
+//   ScanEscape: '"', '\\' or a control char     (chars which must be escaped by stringify)
+//   ScanUrlDelim: '%', '&' or '='               (escapes and separators of urlencoded text)
+//
+
+#ifdef UNICODE
+#define _mm_cmpeq_tch _mm_cmpeq_epi16
+#define _mm_subs_tch _mm_subs_epu16
+#define _mm256_cmpeq_tch _mm256_cmpeq_epi16
+#define _mm256_subs_tch _mm256_subs_epu16
+#define _mm_set1_tch _mm_set1_epi16
+#define _mm256_set1_tch _mm256_set1_epi16
+#else
+#define _mm_cmpeq_tch _mm_cmpeq_epi8
+#define _mm_subs_tch _mm_subs_epu8
+#define _mm256_cmpeq_tch _mm256_cmpeq_epi8
+#define _mm256_subs_tch _mm256_subs_epu8
+#define _mm_set1_tch _mm_set1_epi8
+#define _mm256_set1_tch _mm256_set1_epi8
+#endif
+#define SIMD_CHARS_SSE (16 / sizeof(TCHAR))
+#define SIMD_CHARS_AVX (32 / sizeof(TCHAR))
+
+static inline unsigned long BitScan(unsigned int aMask) {
+	unsigned long index;
+	_BitScanForward(&index, aMask);
+	return index;
+}
+
+static TCHAR* ScanQuote_Scalar(TCHAR* aStr, TCHAR* aEnd) {
+	while (aStr < aEnd && *aStr != '"' && *aStr != '\\')
+		++aStr;
+	return aStr;
+}
+
+static TCHAR* ScanEscape_Scalar(TCHAR* aStr, TCHAR* aEnd) {
+	while (aStr < aEnd && *aStr != '"' && *aStr != '\\' && (unsigned)(_TUCHAR)*aStr >= 0x20)
+		++aStr;
+	return aStr;
+}
+
+static TCHAR* ScanUrlDelim_Scalar(TCHAR* aStr, TCHAR* aEnd) {
+	while (aStr < aEnd && *aStr != '%' && *aStr != '&' && *aStr != '=')
+		++aStr;
+	return aStr;
+}
+
+static TCHAR* ScanQuote_SSE2(TCHAR* aStr, TCHAR* aEnd) {
+	const __m128i quote = _mm_set1_tch('"'), backslash = _mm_set1_tch('\\');
+	for (; aEnd - aStr >= (ptrdiff_t)SIMD_CHARS_SSE; aStr += SIMD_CHARS_SSE) {
+		__m128i v = _mm_loadu_si128((const __m128i*)aStr);
+		unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_tch(v, quote), _mm_cmpeq_tch(v, backslash)));
+		if (mask)
+			return aStr + BitScan(mask) / sizeof(TCHAR);
+	}
+	return ScanQuote_Scalar(aStr, aEnd);
+}
+
+static TCHAR* ScanEscape_SSE2(TCHAR* aStr, TCHAR* aEnd) {
+	const __m128i quote = _mm_set1_tch('"'), backslash = _mm_set1_tch('\\'), space = _mm_set1_tch(0x1F), zero = _mm_setzero_si128();
+	for (; aEnd - aStr >= (ptrdiff_t)SIMD_CHARS_SSE; aStr += SIMD_CHARS_SSE) {
+		__m128i v = _mm_loadu_si128((const __m128i*)aStr);
+		// Saturating subtraction yields zero for every char <= 0x1F.
+		__m128i ctrl = _mm_cmpeq_tch(_mm_subs_tch(v, space), zero);
+		unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_tch(v, quote), _mm_cmpeq_tch(v, backslash)), ctrl));
+		if (mask)
+			return aStr + BitScan(mask) / sizeof(TCHAR);
+	}
+	return ScanEscape_Scalar(aStr, aEnd);
+}
+
+static TCHAR* ScanUrlDelim_SSE2(TCHAR* aStr, TCHAR* aEnd) {
+	const __m128i percent = _mm_set1_tch('%'), amp = _mm_set1_tch('&'), equals = _mm_set1_tch('=');
+	for (; aEnd - aStr >= (ptrdiff_t)SIMD_CHARS_SSE; aStr += SIMD_CHARS_SSE) {
+		__m128i v = _mm_loadu_si128((const __m128i*)aStr);
+		unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_tch(v, percent), _mm_cmpeq_tch(v, amp)), _mm_cmpeq_tch(v, equals)));
+		if (mask)
+			return aStr + BitScan(mask) / sizeof(TCHAR);
+	}
+	return ScanUrlDelim_Scalar(aStr, aEnd);
+}
+
+static TCHAR* ScanQuote_AVX2(TCHAR* aStr, TCHAR* aEnd) {
+	const __m256i quote = _mm256_set1_tch('"'), backslash = _mm256_set1_tch('\\');
+	for (; aEnd - aStr >= (ptrdiff_t)SIMD_CHARS_AVX; aStr += SIMD_CHARS_AVX) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)aStr);
+		unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_tch(v, quote), _mm256_cmpeq_tch(v, backslash)));
+		if (mask)
+			return aStr + BitScan(mask) / sizeof(TCHAR);
+	}
+	return ScanQuote_SSE2(aStr, aEnd);
+}
+
+static TCHAR* ScanEscape_AVX2(TCHAR* aStr, TCHAR* aEnd) {
+	const __m256i quote = _mm256_set1_tch('"'), backslash = _mm256_set1_tch('\\'), space = _mm256_set1_tch(0x1F), zero = _mm256_setzero_si256();
+	for (; aEnd - aStr >= (ptrdiff_t)SIMD_CHARS_AVX; aStr += SIMD_CHARS_AVX) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)aStr);
+		__m256i ctrl = _mm256_cmpeq_tch(_mm256_subs_tch(v, space), zero);
+		unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_tch(v, quote), _mm256_cmpeq_tch(v, backslash)), ctrl));
+		if (mask)
+			return aStr + BitScan(mask) / sizeof(TCHAR);
+	}
+	return ScanEscape_SSE2(aStr, aEnd);
+}
+
+static TCHAR* ScanUrlDelim_AVX2(TCHAR* aStr, TCHAR* aEnd) {
+	const __m256i percent = _mm256_set1_tch('%'), amp = _mm256_set1_tch('&'), equals = _mm256_set1_tch('=');
+	for (; aEnd - aStr >= (ptrdiff_t)SIMD_CHARS_AVX; aStr += SIMD_CHARS_AVX) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)aStr);
+		unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_tch(v, percent), _mm256_cmpeq_tch(v, amp)), _mm256_cmpeq_tch(v, equals)));
+		if (mask)
+			return aStr + BitScan(mask) / sizeof(TCHAR);
+	}
+	return ScanUrlDelim_SSE2(aStr, aEnd);
+}
+
+typedef TCHAR* (*ScanCharsType)(TCHAR* aStr, TCHAR* aEnd);
+
+static ScanCharsType SelectScan(ScanCharsType aAVX2, ScanCharsType aSSE2, ScanCharsType aScalar) {
+	int features = CpuFeatures();
+	return features & CPU_AVX2 ? aAVX2 : features & CPU_SSE2 ? aSSE2 : aScalar;
+}
+
+static ScanCharsType ScanQuote = SelectScan(ScanQuote_AVX2, ScanQuote_SSE2, ScanQuote_Scalar);
+static ScanCharsType ScanEscape = SelectScan(ScanEscape_AVX2, ScanEscape_SSE2, ScanEscape_Scalar);
+static ScanCharsType ScanUrlDelim = SelectScan(ScanUrlDelim_AVX2, ScanUrlDelim_SSE2, ScanUrlDelim_Scalar);
+
+//
+// JSON structural index, after stage 1 of simdjson (Langdale and Lemire).  JsonIndex sets one
+// bit per char in aMask (64 chars per word) for every char which starts a token outside
+// strings: the structural chars {}[]:, and the first char of any other run, such as the
+// opening quote of a string, a number or a literal.  Quotes after an odd number of backslashes
+// are escaped, and the chars between the other quotes are found with a prefix XOR, by
+// carry-less multiplication where available.  Between two set bits there is only the rest of
+// a token or whitespace, so a parser can skip whitespace by finding the next set bit.  A '/'
+// outside strings may start a comment, which the index does not describe, so indexing stops
+// there; JsonIndex returns how many chars were indexed (aLength unless a '/' was found).
+//
+
+#define JSON_BLOCK 64
+
+struct JsonBlock
+{
+	UINT64 quote, backslash, space, op, slash;
+};
+
+// The state carried from one block to the next.
+struct JsonIndexState
+{
+	UINT64 in_string, escaped, scalar;
+};
+
+static inline unsigned long BitScan64(UINT64 aMask) {
+	unsigned long index;
+#ifdef _WIN64
+	_BitScanForward64(&index, aMask);
+#else
+	if (!_BitScanForward(&index, (ULONG)aMask))
+		_BitScanForward(&index, (ULONG)(aMask >> 32)), index += 32;
+#endif
+	return index;
+}
+
+static inline UINT64 PrefixXor_Scalar(UINT64 aMask) {
+	aMask ^= aMask << 1, aMask ^= aMask << 2, aMask ^= aMask << 4;
+	aMask ^= aMask << 8, aMask ^= aMask << 16, aMask ^= aMask << 32;
+	return aMask;
+}
+
+static inline UINT64 PrefixXor_CLMUL(UINT64 aMask) {
+#ifdef _WIN64
+	return (UINT64)_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_set_epi64x(0, (__int64)aMask), _mm_set1_epi8(-1), 0));
+#else
+	return PrefixXor_Scalar(aMask);
+#endif
+}
+
+// Returns the starts of tokens in the block, and sets aComment to any '/' outside strings.
+template<UINT64 (*PrefixXor)(UINT64)>
+static inline UINT64 JsonStarts(const JsonBlock& aBlock, JsonIndexState& aState, UINT64& aComment) {
+	// Chars after an odd-length run of backslashes are escaped (simdjson's find_escaped).
+	const UINT64 even = 0x5555555555555555;
+	UINT64 backslash = aBlock.backslash & ~aState.escaped;
+	UINT64 follows_escape = backslash << 1 | aState.escaped;
+	UINT64 odd_starts = backslash & ~even & ~follows_escape;
+	UINT64 sum = odd_starts + backslash;
+	aState.escaped = sum < odd_starts;
+	UINT64 escaped = (even ^ (sum << 1)) & follows_escape;
+	UINT64 quote = aBlock.quote & ~escaped;
+	// in_string covers each opening quote and the chars up to the closing one.
+	UINT64 in_string = PrefixXor(quote) ^ aState.in_string;
+	aState.in_string = 0 - (in_string >> 63);
+	UINT64 scalar = ~(aBlock.op | aBlock.space), nonquote = scalar & ~quote;
+	UINT64 follows_scalar = nonquote << 1 | aState.scalar;
+	aState.scalar = nonquote >> 63;
+	aComment = aBlock.slash & ~in_string;
+	return (aBlock.op | (scalar & ~follows_scalar)) & ~(in_string ^ quote);
+}
+
+template<void (*Classify)(const TCHAR*, JsonBlock&), UINT64 (*PrefixXor)(UINT64)>
+static size_t JsonIndexBlocks(const TCHAR* aStr, size_t aLength, UINT64* aMask) {
+	JsonIndexState state = {};
+	JsonBlock block;
+	TCHAR tail[JSON_BLOCK];
+	for (size_t i = 0; i < aLength; i += JSON_BLOCK) {
+		const TCHAR* chars = aStr + i;
+		if (aLength - i < JSON_BLOCK) {
+			size_t n = aLength - i;
+			memcpy(tail, chars, n * sizeof(TCHAR));
+			for (; n < JSON_BLOCK; ++n)
+				tail[n] = ' ';
+			chars = tail;
+		}
+		Classify(chars, block);
+		UINT64 comment, starts = JsonStarts<PrefixXor>(block, state, comment);
+		if (comment) {
+			unsigned long at = BitScan64(comment);
+			aMask[i / JSON_BLOCK] = starts & ((1ULL << at) - 1);
+			return i + at;
+		}
+		aMask[i / JSON_BLOCK] = starts;
+	}
+	return aLength;
+}
+
+static void JsonClassify_Scalar(const TCHAR* aStr, JsonBlock& aBlock) {
+	aBlock = {};
+	for (int i = 0; i < JSON_BLOCK; ++i) {
+		UINT64 bit = 1ULL << i;
+		switch (aStr[i])
+		{
+		case '"': aBlock.quote |= bit; break;
+		case '\\': aBlock.backslash |= bit; break;
+		case ' ': case '\t': case '\r': case '\n': aBlock.space |= bit; break;
+		case '{': case '}': case '[': case ']': case ':': case ',': aBlock.op |= bit; break;
+		case '/': aBlock.slash |= bit; break;
+		}
+	}
+}
+
+// The vector versions classify bytes: 16-bit chars are packed with unsigned saturation first,
+// which maps every char above 0xFF to 0x00 or 0xFF, neither of which is of interest.
+
+#ifdef UNICODE
+#define JSON_LOAD_SSE2(p) _mm_packus_epi16(_mm_loadu_si128((const __m128i*)(p)), _mm_loadu_si128((const __m128i*)((p) + 8)))
+// packus works within each 128-bit lane, so put the 64-bit quarters back in order.
+#define JSON_LOAD_AVX2(p) _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_loadu_si256((const __m256i*)(p)) \
+	, _mm256_loadu_si256((const __m256i*)((p) + 16))), 0xD8)
+#else
+#define JSON_LOAD_SSE2(p) _mm_loadu_si128((const __m128i*)(p))
+#define JSON_LOAD_AVX2(p) _mm256_loadu_si256((const __m256i*)(p))
+#endif
+
+// Sets 16 bits of each mask from aShift.  '[' and ']' differ from '{' and '}' only by 0x20.
+static inline void JsonClassify16_SSE2(__m128i v, JsonBlock& aBlock, int aShift) {
+	__m128i space = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')))
+		, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+	__m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	__m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}')))
+		, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+	aBlock.quote |= (UINT64)(UINT)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << aShift;
+	aBlock.backslash |= (UINT64)(UINT)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << aShift;
+	aBlock.space |= (UINT64)(UINT)_mm_movemask_epi8(space) << aShift;
+	aBlock.op |= (UINT64)(UINT)_mm_movemask_epi8(op) << aShift;
+	aBlock.slash |= (UINT64)(UINT)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('/'))) << aShift;
+}
+
+static void JsonClassify_SSE2(const TCHAR* aStr, JsonBlock& aBlock) {
+	aBlock = {};
+	JsonClassify16_SSE2(JSON_LOAD_SSE2(aStr), aBlock, 0);
+	JsonClassify16_SSE2(JSON_LOAD_SSE2(aStr + 16), aBlock, 16);
+	JsonClassify16_SSE2(JSON_LOAD_SSE2(aStr + 32), aBlock, 32);
+	JsonClassify16_SSE2(JSON_LOAD_SSE2(aStr + 48), aBlock, 48);
+}
+
+// Sets 32 bits of each mask from aShift.  As in simdjson, whitespace and the structural chars
+// are found by looking up the low nibble in a table of the one char each nibble could be;
+// control chars which would match after folding '[' to '{' are excluded.
+static inline void JsonClassify32_AVX2(__m256i v, JsonBlock& aBlock, int aShift) {
+	const __m256i space_table = _mm256_setr_epi8(' ', 100, 100, 100, 17, 100, 113, 2, 100, '\t', '\n', 112, 100, '\r', 100, 100
+		, ' ', 100, 100, 100, 17, 100, 113, 2, 100, '\t', '\n', 112, 100, '\r', 100, 100);
+	const __m256i op_table = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0
+		, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0);
+	__m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+	__m256i op = _mm256_and_si256(_mm256_cmpeq_epi8(folded, _mm256_shuffle_epi8(op_table, v)), _mm256_cmpgt_epi8(v, _mm256_set1_epi8(0x1F)));
+	aBlock.quote |= (UINT64)(UINT)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << aShift;
+	aBlock.backslash |= (UINT64)(UINT)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << aShift;
+	aBlock.space |= (UINT64)(UINT)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_shuffle_epi8(space_table, v))) << aShift;
+	aBlock.op |= (UINT64)(UINT)_mm256_movemask_epi8(op) << aShift;
+	aBlock.slash |= (UINT64)(UINT)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'))) << aShift;
+}
+
+static void JsonClassify_AVX2(const TCHAR* aStr, JsonBlock& aBlock) {
+	aBlock = {};
+	JsonClassify32_AVX2(JSON_LOAD_AVX2(aStr), aBlock, 0);
+	JsonClassify32_AVX2(JSON_LOAD_AVX2(aStr + 32), aBlock, 32);
+}
+
+#undef JSON_LOAD_SSE2
+#undef JSON_LOAD_AVX2
+
+typedef size_t (*JsonIndexType)(const TCHAR* aStr, size_t aLength, UINT64* aMask);
+
+static JsonIndexType JsonIndex = (CpuFeatures() & (CPU_AVX2 | CPU_PCLMUL)) == (CPU_AVX2 | CPU_PCLMUL)
+	? JsonIndexBlocks<JsonClassify_AVX2, PrefixXor_CLMUL>
+	: CpuFeatures() & CPU_SSE2 ? JsonIndexBlocks<JsonClassify_SSE2, PrefixXor_Scalar> : JsonIndexBlocks<JsonClassify_Scalar, PrefixXor_Scalar>;
+
+//
+// Byte substring search.  FindBytes returns the first occurrence of aNeedle in [aHay, aEnd),
+// or aEnd.  The vector versions compare the first and last needle bytes against a whole block
+// at once and only verify the candidates where both match, which rarely happens for needles
+// such as multipart boundaries.  aLength must be at least 2.
+//
+
+static const char* FindBytes_Scalar(const char* aHay, const char* aEnd, const char* aNeedle, size_t aLength) {
+	const char* last = aEnd - aLength;
+	for (const char* p = aHay; p <= last; ++p) {
+		if (!(p = (const char*)memchr(p, aNeedle[0], last - p + 1)))
+			break;
+		if (!memcmp(p + 1, aNeedle + 1, aLength - 1))
+			return p;
+	}
+	return aEnd;
+}
+
+static const char* FindBytes_SSE2(const char* aHay, const char* aEnd, const char* aNeedle, size_t aLength) {
+	const __m128i first = _mm_set1_epi8(aNeedle[0]), last = _mm_set1_epi8(aNeedle[aLength - 1]);
+	const char* p = aHay;
+	for (; aEnd - p >= (ptrdiff_t)(aLength - 1 + 16); p += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)p), b = _mm_loadu_si128((const __m128i*)(p + aLength - 1));
+		unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+		for (; mask; mask &= mask - 1) {
+			const char* candidate = p + BitScan(mask);
+			if (!memcmp(candidate + 1, aNeedle + 1, aLength - 2))
+				return candidate;
+		}
+	}
+	return FindBytes_Scalar(p, aEnd, aNeedle, aLength);
+}
+
+static const char* FindBytes_AVX2(const char* aHay, const char* aEnd, const char* aNeedle, size_t aLength) {
+	const __m256i first = _mm256_set1_epi8(aNeedle[0]), last = _mm256_set1_epi8(aNeedle[aLength - 1]);
+	const char* p = aHay;
+	for (; aEnd - p >= (ptrdiff_t)(aLength - 1 + 32); p += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)p), b = _mm256_loadu_si256((const __m256i*)(p + aLength - 1));
+		unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+		for (; mask; mask &= mask - 1) {
+			const char* candidate = p + BitScan(mask);
+			if (!memcmp(candidate + 1, aNeedle + 1, aLength - 2))
+				return candidate;
+		}
+	}
+	return FindBytes_SSE2(p, aEnd, aNeedle, aLength);
+}
+
+typedef const char* (*FindBytesType)(const char* aHay, const char* aEnd, const char* aNeedle, size_t aLength);
+
+static FindBytesType FindBytes = CpuFeatures() & CPU_AVX2 ? FindBytes_AVX2 : CpuFeatures() & CPU_SSE2 ? FindBytes_SSE2 : FindBytes_Scalar;
+
+//
+// WebSocket masking.  MaskBytes XORs aLength bytes of aSrc with the repeating 4-byte key and
+// stores them at aDest, which may be aSrc or any address before it (the copy runs forwards).
+// aKey holds the key bytes in memory order.
+//
+
+static void MaskBytes_Scalar(char* aDest, const char* aSrc, size_t aLength, UINT aKey) {
+	unsigned __int64 key = (unsigned __int64)aKey << 32 | aKey, v;
+	size_t i = 0;
+	for (; aLength - i >= 8; i += 8) {
+		memcpy(&v, aSrc + i, 8);
+		v ^= key;
+		memcpy(aDest + i, &v, 8);
+	}
+	for (; i < aLength; ++i)
+		aDest[i] = aSrc[i] ^ (char)(aKey >> (i & 3) * 8);
+}
+
+static void MaskBytes_SSE2(char* aDest, const char* aSrc, size_t aLength, UINT aKey) {
+	const __m128i key = _mm_set1_epi32((int)aKey);
+	size_t i = 0;
+	for (; aLength - i >= 16; i += 16)
+		_mm_storeu_si128((__m128i*)(aDest + i), _mm_xor_si128(_mm_loadu_si128((const __m128i*)(aSrc + i)), key));
+	MaskBytes_Scalar(aDest + i, aSrc + i, aLength - i, aKey);
+}
+
+static void MaskBytes_AVX2(char* aDest, const char* aSrc, size_t aLength, UINT aKey) {
+	const __m256i key = _mm256_set1_epi32((int)aKey);
+	size_t i = 0;
+	for (; aLength - i >= 64; i += 64) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(aSrc + i)), b = _mm256_loadu_si256((const __m256i*)(aSrc + i + 32));
+		_mm256_storeu_si256((__m256i*)(aDest + i), _mm256_xor_si256(a, key));
+		_mm256_storeu_si256((__m256i*)(aDest + i + 32), _mm256_xor_si256(b, key));
+	}
+	MaskBytes_SSE2(aDest + i, aSrc + i, aLength - i, aKey);
+}
+
+typedef void (*MaskBytesType)(char* aDest, const char* aSrc, size_t aLength, UINT aKey);
+
+static MaskBytesType MaskBytes = CpuFeatures() & CPU_AVX2 ? MaskBytes_AVX2 : CpuFeatures() & CPU_SSE2 ? MaskBytes_SSE2 : MaskBytes_Scalar;
+
+//
+// UTF-8 validation (RFC 3629: no overlong forms, surrogates or code points above U+10FFFF).
+// The vector versions skip blocks of ASCII and validate the other sequences one at a time.
+//
+
+// Returns the end of the sequence starting at aStr, or nullptr if it is invalid.
+static const unsigned char* Utf8Sequence(const unsigned char* aStr, const unsigned char* aEnd) {
+	unsigned c = *aStr;
+	size_t n;
+	if (c < 0x80)
+		return aStr + 1;
+	if (c < 0xC2)
+		return nullptr;
+	n = c < 0xE0 ? 1 : c < 0xF0 ? 2 : c < 0xF5 ? 3 : 0;
+	if (!n || (size_t)(aEnd - aStr) <= n)
+		return nullptr;
+	for (size_t i = 1; i <= n; ++i)
+		if ((aStr[i] & 0xC0) != 0x80)
+			return nullptr;
+	if ((c == 0xE0 && aStr[1] < 0xA0) || (c == 0xED && aStr[1] > 0x9F)
+		|| (c == 0xF0 && aStr[1] < 0x90) || (c == 0xF4 && aStr[1] > 0x8F))
+		return nullptr;
+	return aStr + n + 1;
+}
+
+static bool Utf8Valid_Scalar(const char* aStr, const char* aEnd) {
+	auto p = (const unsigned char*)aStr, end = (const unsigned char*)aEnd;
+	while (p < end) {
+		unsigned __int64 v;
+		if (end - p >= 8 && (memcpy(&v, p, 8), !(v & 0x8080808080808080))) {
+			p += 8;
+			continue;
+		}
+		if (!(p = Utf8Sequence(p, end)))
+			return false;
+	}
+	return true;
+}
+
+static bool Utf8Valid_SSE2(const char* aStr, const char* aEnd) {
+	auto p = (const unsigned char*)aStr, end = (const unsigned char*)aEnd;
+	while (end - p >= 16) {
+		unsigned int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p));
+		if (!mask) {
+			p += 16;
+			continue;
+		}
+		p += BitScan(mask);
+		do if (!(p = Utf8Sequence(p, end))) return false;
+		while (p < end && *p >= 0x80);
+	}
+	return Utf8Valid_Scalar((const char*)p, aEnd);
+}
+
+static bool Utf8Valid_AVX2(const char* aStr, const char* aEnd) {
+	auto p = (const unsigned char*)aStr, end = (const unsigned char*)aEnd;
+	while (end - p >= 32) {
+		unsigned int mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)p));
+		if (!mask) {
+			p += 32;
+			continue;
+		}
+		p += BitScan(mask);
+		do if (!(p = Utf8Sequence(p, end))) return false;
+		while (p < end && *p >= 0x80);
+	}
+	return Utf8Valid_SSE2((const char*)p, aEnd);
+}
+
+typedef bool (*Utf8ValidType)(const char* aStr, const char* aEnd);
+
+static Utf8ValidType Utf8Valid = CpuFeatures() & CPU_AVX2 ? Utf8Valid_AVX2 : CpuFeatures() & CPU_SSE2 ? Utf8Valid_SSE2 : Utf8Valid_Scalar;
+
+//
+// UTF-16 <-> UTF-8 transcoding.  The vector versions convert whole blocks of ASCII at once and
+// convert any other block one code point at a time.
+//   Utf8Length:  the number of bytes Utf16ToUtf8 writes for [aStr, aEnd).
+//   Utf16ToUtf8: converts [aStr, aEnd) into aDest and returns the end of the output.  UTF-16 is
+//                validated on the way: unpaired surrogates become U+FFFD, as with
+//                WideCharToMultiByte.
+//   Utf8ToUtf16: converts [aStr, aEnd) into aDest, which needs room for one char per byte, and
+//                returns the end of the output.  Each byte of an invalid sequence becomes U+FFFD.
+//
+
+// Returns the code point at aStr and moves past it, or U+FFFD for an unpaired surrogate.
+static inline UINT Utf16Next(const WCHAR*& aStr, const WCHAR* aEnd) {
+	UINT c = *aStr++;
+	if (c - 0xD800 >= 0x800)
+		return c;
+	if (c < 0xDC00 && aStr < aEnd && (UINT)(*aStr - 0xDC00) < 0x400)
+		return 0x10000 + ((c - 0xD800) << 10) + (*aStr++ - 0xDC00);
+	return 0xFFFD;
+}
+
+static inline size_t Utf8Length_Char(const WCHAR*& aStr, const WCHAR* aEnd) {
+	UINT c = Utf16Next(aStr, aEnd);
+	return c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+}
+
+static inline char* Utf16ToUtf8_Char(const WCHAR*& aStr, const WCHAR* aEnd, char* aDest) {
+	UINT c = Utf16Next(aStr, aEnd);
+	if (c < 0x80)
+		*aDest++ = (char)c;
+	else if (c < 0x800)
+		*aDest++ = (char)(0xC0 | c >> 6), *aDest++ = (char)(0x80 | (c & 0x3F));
+	else if (c < 0x10000)
+		*aDest++ = (char)(0xE0 | c >> 12), *aDest++ = (char)(0x80 | (c >> 6 & 0x3F)), *aDest++ = (char)(0x80 | (c & 0x3F));
+	else *aDest++ = (char)(0xF0 | c >> 18), *aDest++ = (char)(0x80 | (c >> 12 & 0x3F))
+		, *aDest++ = (char)(0x80 | (c >> 6 & 0x3F)), *aDest++ = (char)(0x80 | (c & 0x3F));
+	return aDest;
+}
+
+static inline WCHAR* Utf8ToUtf16_Char(const unsigned char*& aStr, const unsigned char* aEnd, WCHAR* aDest) {
+	const unsigned char* next = Utf8Sequence(aStr, aEnd);
+	if (!next) {
+		++aStr;
+		*aDest++ = 0xFFFD;
+		return aDest;
+	}
+	UINT c = *aStr;
+	switch (next - aStr)
+	{
+	case 2: c = (c & 0x1F) << 6 | (aStr[1] & 0x3F); break;
+	case 3: c = (c & 0x0F) << 12 | (aStr[1] & 0x3F) << 6 | (aStr[2] & 0x3F); break;
+	case 4: c = (c & 0x07) << 18 | (aStr[1] & 0x3F) << 12 | (aStr[2] & 0x3F) << 6 | (aStr[3] & 0x3F); break;
+	}
+	aStr = next;
+	if (c >= 0x10000)
+		*aDest++ = (WCHAR)(0xD800 + ((c - 0x10000) >> 10)), c = 0xDC00 + (c & 0x3FF);
+	*aDest++ = (WCHAR)c;
+	return aDest;
+}
+
+static size_t Utf8Length_Scalar(const WCHAR* aStr, const WCHAR* aEnd) {
+	size_t length = 0;
+	while (aStr < aEnd)
+		length += Utf8Length_Char(aStr, aEnd);
+	return length;
+}
+
+static char* Utf16ToUtf8_Scalar(const WCHAR* aStr, const WCHAR* aEnd, char* aDest) {
+	while (aStr < aEnd)
+		aDest = Utf16ToUtf8_Char(aStr, aEnd, aDest);
+	return aDest;
+}
+
+static WCHAR* Utf8ToUtf16_Scalar(const char* aStr, const char* aEnd, WCHAR* aDest) {
+	auto p = (const unsigned char*)aStr, end = (const unsigned char*)aEnd;
+	while (p < end)
+		aDest = Utf8ToUtf16_Char(p, end, aDest);
+	return aDest;
+}
+
+// A block of 16 chars is ASCII if no char has a bit above 0x7F.
+static inline bool Utf16Ascii_SSE2(__m128i a, __m128i b) {
+	__m128i high = _mm_and_si128(_mm_or_si128(a, b), _mm_set1_epi16((short)0xFF80));
+	return _mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) == 0xFFFF;
+}
+
+static size_t Utf8Length_SSE2(const WCHAR* aStr, const WCHAR* aEnd) {
+	size_t length = 0;
+	while (aEnd - aStr >= 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)aStr), b = _mm_loadu_si128((const __m128i*)(aStr + 8));
+		if (Utf16Ascii_SSE2(a, b)) {
+			aStr += 16, length += 16;
+			continue;
+		}
+		for (const WCHAR* block_end = aStr + 16; aStr < block_end;)
+			length += Utf8Length_Char(aStr, aEnd);
+	}
+	return length + Utf8Length_Scalar(aStr, aEnd);
+}
+
+static char* Utf16ToUtf8_SSE2(const WCHAR* aStr, const WCHAR* aEnd, char* aDest) {
+	while (aEnd - aStr >= 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)aStr), b = _mm_loadu_si128((const __m128i*)(aStr + 8));
+		if (Utf16Ascii_SSE2(a, b)) {
+			_mm_storeu_si128((__m128i*)aDest, _mm_packus_epi16(a, b));
+			aStr += 16, aDest += 16;
+			continue;
+		}
+		for (const WCHAR* block_end = aStr + 16; aStr < block_end;)
+			aDest = Utf16ToUtf8_Char(aStr, aEnd, aDest);
+	}
+	return Utf16ToUtf8_Scalar(aStr, aEnd, aDest);
+}
+
+static WCHAR* Utf8ToUtf16_SSE2(const char* aStr, const char* aEnd, WCHAR* aDest) {
+	auto p = (const unsigned char*)aStr, end = (const unsigned char*)aEnd;
+	const __m128i zero = _mm_setzero_si128();
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		if (!_mm_movemask_epi8(v)) {
+			_mm_storeu_si128((__m128i*)aDest, _mm_unpacklo_epi8(v, zero));
+			_mm_storeu_si128((__m128i*)(aDest + 8), _mm_unpackhi_epi8(v, zero));
+			p += 16, aDest += 16;
+			continue;
+		}
+		for (const unsigned char* block_end = p + 16; p < block_end;)
+			aDest = Utf8ToUtf16_Char(p, end, aDest);
+	}
+	return Utf8ToUtf16_Scalar((const char*)p, aEnd, aDest);
+}
+
+static inline bool Utf16Ascii_AVX2(__m256i a, __m256i b) {
+	return _mm256_testz_si256(_mm256_or_si256(a, b), _mm256_set1_epi16((short)0xFF80));
+}
+
+static size_t Utf8Length_AVX2(const WCHAR* aStr, const WCHAR* aEnd) {
+	size_t length = 0;
+	while (aEnd - aStr >= 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)aStr), b = _mm256_loadu_si256((const __m256i*)(aStr + 16));
+		if (Utf16Ascii_AVX2(a, b)) {
+			aStr += 32, length += 32;
+			continue;
+		}
+		for (const WCHAR* block_end = aStr + 32; aStr < block_end;)
+			length += Utf8Length_Char(aStr, aEnd);
+	}
+	return length + Utf8Length_SSE2(aStr, aEnd);
+}
+
+static char* Utf16ToUtf8_AVX2(const WCHAR* aStr, const WCHAR* aEnd, char* aDest) {
+	while (aEnd - aStr >= 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)aStr), b = _mm256_loadu_si256((const __m256i*)(aStr + 16));
+		if (Utf16Ascii_AVX2(a, b)) {
+			_mm256_storeu_si256((__m256i*)aDest, _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8));
+			aStr += 32, aDest += 32;
+			continue;
+		}
+		for (const WCHAR* block_end = aStr + 32; aStr < block_end;)
+			aDest = Utf16ToUtf8_Char(aStr, aEnd, aDest);
+	}
+	return Utf16ToUtf8_SSE2(aStr, aEnd, aDest);
+}
+
+static WCHAR* Utf8ToUtf16_AVX2(const char* aStr, const char* aEnd, WCHAR* aDest) {
+	auto p = (const unsigned char*)aStr, end = (const unsigned char*)aEnd;
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+		if (!_mm256_movemask_epi8(v)) {
+			_mm256_storeu_si256((__m256i*)aDest, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+			_mm256_storeu_si256((__m256i*)(aDest + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+			p += 32, aDest += 32;
+			continue;
+		}
+		for (const unsigned char* block_end = p + 32; p < block_end;)
+			aDest = Utf8ToUtf16_Char(p, end, aDest);
+	}
+	return Utf8ToUtf16_SSE2((const char*)p, aEnd, aDest);
+}
+
+typedef size_t (*Utf8LengthType)(const WCHAR* aStr, const WCHAR* aEnd);
+typedef char* (*Utf16ToUtf8Type)(const WCHAR* aStr, const WCHAR* aEnd, char* aDest);
+typedef WCHAR* (*Utf8ToUtf16Type)(const char* aStr, const char* aEnd, WCHAR* aDest);
+
+static Utf8LengthType Utf8Length = CpuFeatures() & CPU_AVX2 ? Utf8Length_AVX2 : CpuFeatures() & CPU_SSE2 ? Utf8Length_SSE2 : Utf8Length_Scalar;
+static Utf16ToUtf8Type Utf16ToUtf8 = CpuFeatures() & CPU_AVX2 ? Utf16ToUtf8_AVX2 : CpuFeatures() & CPU_SSE2 ? Utf16ToUtf8_SSE2 : Utf16ToUtf8_Scalar;
+static Utf8ToUtf16Type Utf8ToUtf16 = CpuFeatures() & CPU_AVX2 ? Utf8ToUtf16_AVX2 : CpuFeatures() & CPU_SSE2 ? Utf8ToUtf16_SSE2 : Utf8ToUtf16_Scalar;
+
+//
+// Base64 (RFC 4648) and hex codecs.  The vector versions follow the pshufb-based method of
+// Muła and Lemire: encoding reshuffles 3 bytes into four 6-bit indices per 32-bit lane and
+// maps them to ASCII with a 16-entry offset table; decoding validates by nibble lookups and
+// merges the sextets with multiply-add.  Any block which fails validation (whitespace,
+// padding or invalid characters) is left to the scalar code.
+//
+//   Base64Encode: encodes the complete groups of 3 bytes and returns how many bytes it used.
+//   Base64Decode: decodes [aSrc, aEnd) into aDest, continuing from aState, and returns the
+//                 end of the output or nullptr on invalid input.  Whitespace is skipped.
+//   HexEncode:    writes 2 * aLength digits.
+//   HexDecode:    decodes aLength bytes from 2 * aLength digits; fails on any non-digit.
+//
+
+struct Base64State
+{
+	UINT bits = 0;
+	int count = 0;      // Sextets in bits.
+	int pad = -1;       // '=' still expected, or -1 before padding.
+	bool url = false;   // '-' and '_' instead of '+' and '/'.
+	// Validates the end of the input and writes the bytes of an unpadded final group.
+	BYTE* Finish(BYTE* aDest) {
+		if (pad > 0 || count == 1)
+			return nullptr;
+		if (count > 1) {
+			aDest[0] = (BYTE)(bits >> (count * 6 - 8));
+			if (count == 3)
+				aDest[1] = (BYTE)(bits >> 2);
+			aDest += count - 1;
+		}
+		count = 0, bits = 0;
+		return aDest;
+	}
+};
+
+enum { B64_INVALID = -1, B64_SPACE = -2, B64_PAD = -3 };
+
+static const signed char* Base64DecodeTable(bool aUrl) {
+	static signed char sTable[2][256];
+	static bool sInit = false;
+	if (!sInit) {
+		for (int t = 0; t < 2; ++t) {
+			memset(sTable[t], B64_INVALID, 256);
+			for (int i = 0; i < 26; ++i)
+				sTable[t]['A' + i] = (signed char)i, sTable[t]['a' + i] = (signed char)(26 + i);
+			for (int i = 0; i < 10; ++i)
+				sTable[t]['0' + i] = (signed char)(52 + i);
+			sTable[t][UCHAR(t ? '-' : '+')] = 62, sTable[t][UCHAR(t ? '_' : '/')] = 63;
+			sTable[t][UCHAR(' ')] = sTable[t][UCHAR('\t')] = sTable[t][UCHAR('\r')] = sTable[t][UCHAR('\n')] = B64_SPACE;
+			sTable[t][UCHAR('=')] = B64_PAD;
+		}
+		sInit = true;
+	}
+	return sTable[aUrl];
+}
+
+static const char* Base64Alphabet(bool aUrl) {
+	return aUrl ? "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"
+		: "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+}
+
+// Encodes the final 1 or 2 bytes, with or without padding, and returns the end of the output.
+static char* Base64EncodeTail(const BYTE* aSrc, size_t aLength, char* aDest, bool aUrl, bool aPad) {
+	const char* alphabet = Base64Alphabet(aUrl);
+	UINT v = aSrc[0] << 16 | (aLength > 1 ? aSrc[1] << 8 : 0);
+	*aDest++ = alphabet[v >> 18];
+	*aDest++ = alphabet[v >> 12 & 63];
+	if (aLength > 1)
+		*aDest++ = alphabet[v >> 6 & 63];
+	if (aPad)
+		for (size_t i = aLength; i < 3; ++i)
+			*aDest++ = '=';
+	return aDest;
+}
+
+static size_t Base64Encode_Scalar(const BYTE* aSrc, size_t aLength, char* aDest, bool aUrl) {
+	const char* alphabet = Base64Alphabet(aUrl);
+	size_t i = 0;
+	for (; aLength - i >= 3; i += 3, aDest += 4) {
+		UINT v = aSrc[i] << 16 | aSrc[i + 1] << 8 | aSrc[i + 2];
+		aDest[0] = alphabet[v >> 18], aDest[1] = alphabet[v >> 12 & 63];
+		aDest[2] = alphabet[v >> 6 & 63], aDest[3] = alphabet[v & 63];
+	}
+	return i;
+}
+
+static inline BYTE* Base64DecodeChar(BYTE aChar, BYTE* aDest, Base64State& aState, const signed char* aTable) {
+	int v = aTable[aChar];
+	if (v >= 0) {
+		if (aState.pad >= 0)
+			return nullptr;
+		aState.bits = aState.bits << 6 | v;
+		if (++aState.count == 4) {
+			aDest[0] = (BYTE)(aState.bits >> 16), aDest[1] = (BYTE)(aState.bits >> 8), aDest[2] = (BYTE)aState.bits;
+			aState.count = 0, aState.bits = 0;
+			return aDest + 3;
+		}
+		return aDest;
+	}
+	if (v == B64_SPACE)
+		return aDest;
+	if (v != B64_PAD)
+		return nullptr;
+	if (aState.pad < 0) {
+		int count = aState.count;
+		if (count < 2 || !(aDest = aState.Finish(aDest)))
+			return nullptr;
+		aState.pad = 4 - count;
+	}
+	return aState.pad-- > 0 ? aDest : nullptr;
+}
+
+static BYTE* Base64Decode_Scalar(const char* aSrc, const char* aEnd, BYTE* aDest, Base64State& aState) {
+	auto table = Base64DecodeTable(aState.url);
+	for (auto p = (const BYTE*)aSrc; p < (const BYTE*)aEnd && aDest; ++p)
+		aDest = Base64DecodeChar(*p, aDest, aState, table);
+	return aDest;
+}
+
+static inline __m128i Base64Translate_SSSE3(__m128i aIndex, bool aUrl) {
+	// Offsets from each index range to its ASCII: A-Z, a-z, 0-9, then the last two characters.
+	const __m128i offsets = aUrl ? _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -17, 32, 0, 0)
+		: _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+	__m128i range = _mm_subs_epu8(aIndex, _mm_set1_epi8(51));
+	range = _mm_sub_epi8(range, _mm_cmpgt_epi8(aIndex, _mm_set1_epi8(25)));
+	return _mm_add_epi8(aIndex, _mm_shuffle_epi8(offsets, range));
+}
+
+static inline __m128i Base64Indices_SSSE3(__m128i aIn) {
+	aIn = _mm_shuffle_epi8(aIn, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+	__m128i hi = _mm_mulhi_epu16(_mm_and_si128(aIn, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+	__m128i lo = _mm_mullo_epi16(_mm_and_si128(aIn, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+	return _mm_or_si128(hi, lo);
+}
+
+static size_t Base64Encode_SSSE3(const BYTE* aSrc, size_t aLength, char* aDest, bool aUrl) {
+	size_t i = 0;
+	// Each block uses 12 bytes but loads 16.
+	for (; aLength - i >= 16; i += 12, aDest += 16) {
+		__m128i in = _mm_loadu_si128((const __m128i*)(aSrc + i));
+		_mm_storeu_si128((__m128i*)aDest, Base64Translate_SSSE3(Base64Indices_SSSE3(in), aUrl));
+	}
+	return i + Base64Encode_Scalar(aSrc + i, aLength - i, aDest, aUrl);
+}
+
+static size_t Base64Encode_AVX2(const BYTE* aSrc, size_t aLength, char* aDest, bool aUrl) {
+	const __m256i offsets = aUrl
+		? _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -17, 32, 0, 0, 65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -17, 32, 0, 0)
+		: _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0, 65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+	const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	size_t i = 0;
+	// Each block uses 24 bytes, 12 per lane, but loads 28.
+	for (; aLength - i >= 28; i += 24, aDest += 32) {
+		__m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(aSrc + i))),
+			_mm_loadu_si128((const __m128i*)(aSrc + i + 12)), 1);
+		in = _mm256_shuffle_epi8(in, shuffle);
+		__m256i hi = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040));
+		__m256i lo = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010));
+		__m256i index = _mm256_or_si256(hi, lo);
+		__m256i range = _mm256_subs_epu8(index, _mm256_set1_epi8(51));
+		range = _mm256_sub_epi8(range, _mm256_cmpgt_epi8(index, _mm256_set1_epi8(25)));
+		_mm256_storeu_si256((__m256i*)aDest, _mm256_add_epi8(index, _mm256_shuffle_epi8(offsets, range)));
+	}
+	return i + Base64Encode_SSSE3(aSrc + i, aLength - i, aDest, aUrl);
+}
+
+// Maps 16 characters to sextets, or returns false if any is not in the alphabet.
+static inline bool Base64Sextets_SSSE3(__m128i& aStr, bool aUrl) {
+	const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2f = _mm_set1_epi8(0x2F);
+	__m128i str = aStr;
+	if (aUrl) {
+		// Check the URL-safe alphabet by mapping it onto the standard one.
+		__m128i dash = _mm_cmpeq_epi8(str, _mm_set1_epi8('-')), underscore = _mm_cmpeq_epi8(str, _mm_set1_epi8('_'));
+		__m128i standard = _mm_or_si128(_mm_cmpeq_epi8(str, _mm_set1_epi8('+')), _mm_cmpeq_epi8(str, mask_2f));
+		if (_mm_movemask_epi8(standard))
+			return false;
+		str = _mm_or_si128(_mm_andnot_si128(_mm_or_si128(dash, underscore), str),
+			_mm_or_si128(_mm_and_si128(dash, _mm_set1_epi8('+')), _mm_and_si128(underscore, mask_2f)));
+	}
+	__m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+	__m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(str, mask_2f));
+	__m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF)
+		return false;
+	__m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(str, mask_2f), hi_nibbles));
+	aStr = _mm_add_epi8(str, roll);
+	return true;
+}
+
+// Packs 4 sextets per 32-bit lane into 3 bytes, in the low 12 bytes of each 128-bit lane.
+static inline __m128i Base64Pack_SSSE3(__m128i aSextets) {
+	__m128i merged = _mm_maddubs_epi16(aSextets, _mm_set1_epi32(0x01400140));
+	merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+	return _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+static inline bool Base64DecodeBlock_SSSE3(const BYTE* aSrc, BYTE* aDest, bool aUrl) {
+	__m128i str = _mm_loadu_si128((const __m128i*)aSrc);
+	if (!Base64Sextets_SSSE3(str, aUrl))
+		return false;
+	__m128i out = Base64Pack_SSSE3(str);
+	_mm_storel_epi64((__m128i*)aDest, out);
+	UINT last = (UINT)_mm_cvtsi128_si32(_mm_srli_si128(out, 8));
+	memcpy(aDest + 8, &last, 4);
+	return true;
+}
+
+// Decodes whole blocks while the state is between groups, and passes anything else
+// (whitespace, padding, a split group) one character at a time to the scalar code until
+// a group boundary is reached again.
+template<size_t BlockSize, bool (*DecodeBlock)(const BYTE*, BYTE*, bool)>
+static BYTE* Base64DecodeBlocks(const char* aSrc, const char* aEnd, BYTE* aDest, Base64State& aState) {
+	auto table = Base64DecodeTable(aState.url);
+	auto p = (const BYTE*)aSrc, end = (const BYTE*)aEnd;
+	while (p < end) {
+		if (!aState.count && aState.pad < 0)
+			for (; (size_t)(end - p) >= BlockSize && DecodeBlock(p, aDest, aState.url); p += BlockSize)
+				aDest += BlockSize / 4 * 3;
+		if (p == end)
+			break;
+		do if (!(aDest = Base64DecodeChar(*p++, aDest, aState, table))) return nullptr;
+		while (p < end && (aState.count || aState.pad >= 0));
+	}
+	return aDest;
+}
+
+static BYTE* Base64Decode_SSSE3(const char* aSrc, const char* aEnd, BYTE* aDest, Base64State& aState) {
+	return Base64DecodeBlocks<16, Base64DecodeBlock_SSSE3>(aSrc, aEnd, aDest, aState);
+}
+
+static inline bool Base64DecodeBlock_AVX2(const BYTE* aSrc, BYTE* aDest, bool aUrl) {
+	const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+	__m256i str = _mm256_loadu_si256((const __m256i*)aSrc);
+	if (aUrl) {
+		__m256i dash = _mm256_cmpeq_epi8(str, _mm256_set1_epi8('-')), underscore = _mm256_cmpeq_epi8(str, _mm256_set1_epi8('_'));
+		__m256i standard = _mm256_or_si256(_mm256_cmpeq_epi8(str, _mm256_set1_epi8('+')), _mm256_cmpeq_epi8(str, mask_2f));
+		if (!_mm256_testz_si256(standard, standard))
+			return false;
+		str = _mm256_blendv_epi8(str, _mm256_set1_epi8('+'), dash);
+		str = _mm256_blendv_epi8(str, mask_2f, underscore);
+	}
+	__m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+	__m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(str, mask_2f));
+	__m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+	if (!_mm256_testz_si256(lo, hi))
+		return false;
+	str = _mm256_add_epi8(str, _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(str, mask_2f), hi_nibbles)));
+	__m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+	merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+	merged = _mm256_shuffle_epi8(merged, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+	merged = _mm256_permutevar8x32_epi32(merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+	_mm_storeu_si128((__m128i*)aDest, _mm256_castsi256_si128(merged));
+	_mm_storel_epi64((__m128i*)(aDest + 16), _mm256_extracti128_si256(merged, 1));
+	return true;
+}
+
+static BYTE* Base64Decode_AVX2(const char* aSrc, const char* aEnd, BYTE* aDest, Base64State& aState) {
+	return Base64DecodeBlocks<32, Base64DecodeBlock_AVX2>(aSrc, aEnd, aDest, aState);
+}
+
+static void HexEncode_Scalar(const BYTE* aSrc, size_t aLength, char* aDest, bool aUpper) {
+	const char* digits = aUpper ? "0123456789ABCDEF" : "0123456789abcdef";
+	for (size_t i = 0; i < aLength; ++i, aDest += 2)
+		aDest[0] = digits[aSrc[i] >> 4], aDest[1] = digits[aSrc[i] & 15];
+}
+
+static void HexEncode_SSSE3(const BYTE* aSrc, size_t aLength, char* aDest, bool aUpper) {
+	const __m128i digits = aUpper ? _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F')
+		: _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+	const __m128i low4 = _mm_set1_epi8(15);
+	size_t i = 0;
+	for (; aLength - i >= 16; i += 16, aDest += 32) {
+		__m128i in = _mm_loadu_si128((const __m128i*)(aSrc + i));
+		__m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(in, 4), low4));
+		__m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(in, low4));
+		_mm_storeu_si128((__m128i*)aDest, _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i*)(aDest + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+	HexEncode_Scalar(aSrc + i, aLength - i, aDest, aUpper);
+}
+
+static void HexEncode_AVX2(const BYTE* aSrc, size_t aLength, char* aDest, bool aUpper) {
+	const __m256i digits = _mm256_broadcastsi128_si256(aUpper
+		? _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F')
+		: _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'));
+	const __m256i low4 = _mm256_set1_epi8(15);
+	size_t i = 0;
+	for (; aLength - i >= 32; i += 32, aDest += 64) {
+		__m256i in = _mm256_loadu_si256((const __m256i*)(aSrc + i));
+		__m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(in, 4), low4));
+		__m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(in, low4));
+		// unpack works within each 128-bit lane, so put the lanes back in order.
+		__m256i a = _mm256_unpacklo_epi8(hi, lo), b = _mm256_unpackhi_epi8(hi, lo);
+		_mm256_storeu_si256((__m256i*)aDest, _mm256_permute2x128_si256(a, b, 0x20));
+		_mm256_storeu_si256((__m256i*)(aDest + 32), _mm256_permute2x128_si256(a, b, 0x31));
+	}
+	HexEncode_SSSE3(aSrc + i, aLength - i, aDest, aUpper);
+}
+
+static bool HexDecode_Scalar(const char* aSrc, size_t aLength, BYTE* aDest) {
+	for (size_t i = 0; i < aLength; ++i, aSrc += 2) {
+		int v = 0;
+		for (int j = 0; j < 2; ++j) {
+			unsigned c = (BYTE)aSrc[j], d = c - '0', a = (c | 0x20) - 'a';
+			if (d < 10)
+				v = v << 4 | d;
+			else if (a < 6)
+				v = v << 4 | (a + 10);
+			else return false;
+		}
+		aDest[i] = (BYTE)v;
+	}
+	return true;
+}
+
+// Maps 16 digits to nibbles; any other character sets its byte of aInvalid.
+static inline __m128i HexNibbles_SSSE3(__m128i aStr, __m128i& aInvalid) {
+	__m128i digit = _mm_sub_epi8(aStr, _mm_set1_epi8('0'));
+	__m128i alpha = _mm_sub_epi8(_mm_or_si128(aStr, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	// Unsigned range checks: x < n  <=>  min(x, n - 1) == x.
+	__m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+	__m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+	aInvalid = _mm_or_si128(aInvalid, _mm_andnot_si128(_mm_or_si128(is_digit, is_alpha), _mm_set1_epi8(-1)));
+	return _mm_or_si128(_mm_and_si128(is_digit, digit), _mm_andnot_si128(is_digit, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+}
+
+static bool HexDecode_SSSE3(const char* aSrc, size_t aLength, BYTE* aDest) {
+	size_t i = 0;
+	for (; aLength - i >= 16; i += 16, aSrc += 32) {
+		__m128i invalid = _mm_setzero_si128();
+		__m128i a = HexNibbles_SSSE3(_mm_loadu_si128((const __m128i*)aSrc), invalid);
+		__m128i b = HexNibbles_SSSE3(_mm_loadu_si128((const __m128i*)(aSrc + 16)), invalid);
+		if (_mm_movemask_epi8(invalid))
+			return false;
+		// High nibble * 16 + low nibble, for each pair of digits.
+		a = _mm_maddubs_epi16(a, _mm_set1_epi16(0x0110)), b = _mm_maddubs_epi16(b, _mm_set1_epi16(0x0110));
+		_mm_storeu_si128((__m128i*)(aDest + i), _mm_packus_epi16(a, b));
+	}
+	return HexDecode_Scalar(aSrc, aLength - i, aDest + i);
+}
+
+static bool HexDecode_AVX2(const char* aSrc, size_t aLength, BYTE* aDest) {
+	size_t i = 0;
+	for (; aLength - i >= 32; i += 32, aSrc += 64) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)aSrc), b = _mm256_loadu_si256((const __m256i*)(aSrc + 32));
+		__m256i digit_a = _mm256_sub_epi8(a, _mm256_set1_epi8('0')), digit_b = _mm256_sub_epi8(b, _mm256_set1_epi8('0'));
+		__m256i alpha_a = _mm256_sub_epi8(_mm256_or_si256(a, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+		__m256i alpha_b = _mm256_sub_epi8(_mm256_or_si256(b, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+		__m256i is_digit_a = _mm256_cmpeq_epi8(_mm256_min_epu8(digit_a, _mm256_set1_epi8(9)), digit_a);
+		__m256i is_digit_b = _mm256_cmpeq_epi8(_mm256_min_epu8(digit_b, _mm256_set1_epi8(9)), digit_b);
+		__m256i is_alpha_a = _mm256_cmpeq_epi8(_mm256_min_epu8(alpha_a, _mm256_set1_epi8(5)), alpha_a);
+		__m256i is_alpha_b = _mm256_cmpeq_epi8(_mm256_min_epu8(alpha_b, _mm256_set1_epi8(5)), alpha_b);
+		__m256i valid = _mm256_and_si256(_mm256_or_si256(is_digit_a, is_alpha_a), _mm256_or_si256(is_digit_b, is_alpha_b));
+		if ((UINT)_mm256_movemask_epi8(valid) != 0xFFFFFFFF)
+			return false;
+		a = _mm256_blendv_epi8(_mm256_add_epi8(alpha_a, _mm256_set1_epi8(10)), digit_a, is_digit_a);
+		b = _mm256_blendv_epi8(_mm256_add_epi8(alpha_b, _mm256_set1_epi8(10)), digit_b, is_digit_b);
+		a = _mm256_maddubs_epi16(a, _mm256_set1_epi16(0x0110)), b = _mm256_maddubs_epi16(b, _mm256_set1_epi16(0x0110));
+		// packus works within each 128-bit lane, so put the 64-bit quarters back in order.
+		_mm256_storeu_si256((__m256i*)(aDest + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8));
+	}
+	return HexDecode_SSSE3(aSrc, aLength - i, aDest + i);
+}
+
+typedef size_t (*Base64EncodeType)(const BYTE* aSrc, size_t aLength, char* aDest, bool aUrl);
+typedef BYTE* (*Base64DecodeType)(const char* aSrc, const char* aEnd, BYTE* aDest, Base64State& aState);
+typedef void (*HexEncodeType)(const BYTE* aSrc, size_t aLength, char* aDest, bool aUpper);
+typedef bool (*HexDecodeType)(const char* aSrc, size_t aLength, BYTE* aDest);
+
+static Base64EncodeType Base64Encode = CpuFeatures() & CPU_AVX2 ? Base64Encode_AVX2 : CpuFeatures() & CPU_SSSE3 ? Base64Encode_SSSE3 : Base64Encode_Scalar;
+static Base64DecodeType Base64Decode = CpuFeatures() & CPU_AVX2 ? Base64Decode_AVX2 : CpuFeatures() & CPU_SSSE3 ? Base64Decode_SSSE3 : Base64Decode_Scalar;
+static HexEncodeType HexEncode = CpuFeatures() & CPU_AVX2 ? HexEncode_AVX2 : CpuFeatures() & CPU_SSSE3 ? HexEncode_SSSE3 : HexEncode_Scalar;
+static HexDecodeType HexDecode = CpuFeatures() & CPU_AVX2 ? HexDecode_AVX2 : CpuFeatures() & CPU_SSSE3 ? HexDecode_SSSE3 : HexDecode_Scalar;
+
+#endif // !AHK2_SIMD_H
@@ -0,0 +1,668 @@
+﻿#include "ahk2_types.h"
+
+// Native sort for Array, replacing the script-level Sort class (see sort.ahk).
+//   sorter := Native.LoadModule('sort.dll')
+//   sorter.sort(arr, compare := 'asc', stable := false)	; sorts in place and returns arr
+//     compare is 'asc', 'desc' or a function (a, b) => number, negative if a goes first;
+//     sorting with a function is always stable.
+//   sorter.sortby(arr, key, desc := false)	; key(item) is called once per item; always stable
+// Integers, floats and strings have typed paths; mixed values order numbers before strings
+// before objects, and unset items always go last.  Strings are compared ordinally (case-sensitive).
+// Large arrays are sorted in chunks on the system thread pool, then merged.
+
+#define SORT_PARALLEL_THRESHOLD 0x10000
+#define SORT_INSERTION_THRESHOLD 24
+#define SORT_PARTIAL_INSERTION_LIMIT 8
+#define SORT_MAX_CHUNKS 64
+
+typedef Object::index_t index_t;
+
+//
+// pdqsort (pattern-defeating quicksort), after Orson Peters' reference implementation.
+//
+
+template<typename T>
+static inline void Swap(T& a, T& b) {
+	T tmp = a;
+	a = b, b = tmp;
+}
+
+template<typename T, typename Less>
+static void InsertionSort(T* aBegin, T* aEnd, Less& aLess) {
+	if (aBegin == aEnd)
+		return;
+	for (T* cur = aBegin + 1; cur < aEnd; ++cur) {
+		if (!aLess(*cur, cur[-1]))
+			continue;
+		T tmp = *cur, * sift = cur;
+		do *sift = sift[-1];
+		while (--sift != aBegin && aLess(tmp, sift[-1]));
+		*sift = tmp;
+	}
+}
+
+// Gives up (returning false) after a few moves, so that nearly sorted partitions finish early.
+template<typename T, typename Less>
+static bool PartialInsertionSort(T* aBegin, T* aEnd, Less& aLess) {
+	if (aBegin == aEnd)
+		return true;
+	size_t moves = 0;
+	for (T* cur = aBegin + 1; cur < aEnd; ++cur) {
+		if (!aLess(*cur, cur[-1]))
+			continue;
+		T tmp = *cur, * sift = cur;
+		do *sift = sift[-1];
+		while (--sift != aBegin && aLess(tmp, sift[-1]));
+		*sift = tmp;
+		if ((moves += cur - sift) > SORT_PARTIAL_INSERTION_LIMIT)
+			return false;
+	}
+	return true;
+}
+
+template<typename T, typename Less>
+static void SiftDown(T* aData, size_t aRoot, size_t aCount, Less& aLess) {
+	T tmp = aData[aRoot];
+	for (size_t child; (child = 2 * aRoot + 1) < aCount; aRoot = child) {
+		if (child + 1 < aCount && aLess(aData[child], aData[child + 1]))
+			++child;
+		if (!aLess(tmp, aData[child]))
+			break;
+		aData[aRoot] = aData[child];
+	}
+	aData[aRoot] = tmp;
+}
+
+template<typename T, typename Less>
+static void HeapSort(T* aBegin, T* aEnd, Less& aLess) {
+	size_t count = aEnd - aBegin;
+	for (size_t i = count / 2; i--; )
+		SiftDown(aBegin, i, count, aLess);
+	while (count > 1) {
+		Swap(aBegin[0], aBegin[--count]);
+		SiftDown(aBegin, 0, count, aLess);
+	}
+}
+
+template<typename T, typename Less>
+static inline void Sort2(T* a, T* b, Less& aLess) {
+	if (aLess(*b, *a))
+		Swap(*a, *b);
+}
+
+template<typename T, typename Less>
+static inline void Sort3(T* a, T* b, T* c, Less& aLess) {
+	Sort2(a, b, aLess);
+	Sort2(b, c, aLess);
+	Sort2(a, b, aLess);
+}
+
+// Partitions around *aBegin; elements equal to the pivot go to the right.
+template<typename T, typename Less>
+static T* PartitionRight(T* aBegin, T* aEnd, Less& aLess, bool& aAlreadyPartitioned) {
+	T pivot = *aBegin;
+	T* first = aBegin, * last = aEnd;
+	// The median-of-3 guarantees an element >= pivot exists, so the first search is unguarded.
+	while (aLess(*++first, pivot));
+	if (first - 1 == aBegin)
+		while (first < last && !aLess(*--last, pivot));
+	else
+		while (!aLess(*--last, pivot));
+	aAlreadyPartitioned = first >= last;
+	while (first < last) {
+		Swap(*first, *last);
+		while (aLess(*++first, pivot));
+		while (!aLess(*--last, pivot));
+	}
+	T* pivot_pos = first - 1;
+	*aBegin = *pivot_pos;
+	*pivot_pos = pivot;
+	return pivot_pos;
+}
+
+// Partitions around *aBegin; elements equal to the pivot go to the left.  Used when the
+// pivot equals the element before this range, which means the range has many duplicates.
+template<typename T, typename Less>
+static T* PartitionLeft(T* aBegin, T* aEnd, Less& aLess) {
+	T pivot = *aBegin;
+	T* first = aBegin, * last = aEnd;
+	while (aLess(pivot, *--last));
+	if (last + 1 == aEnd)
+		while (first < last && !aLess(pivot, *++first));
+	else
+		while (!aLess(pivot, *++first));
+	while (first < last) {
+		Swap(*first, *last);
+		while (aLess(pivot, *--last));
+		while (!aLess(pivot, *++first));
+	}
+	*aBegin = *last;
+	*last = pivot;
+	return last;
+}
+
+template<typename T, typename Less>
+static void PdqLoop(T* aBegin, T* aEnd, Less& aLess, int aBadAllowed, bool aLeftmost) {
+	for (;;) {
+		size_t size = aEnd - aBegin;
+		if (size < SORT_INSERTION_THRESHOLD) {
+			InsertionSort(aBegin, aEnd, aLess);
+			return;
+		}
+		// Moves the median (of 3, or the pseudo-median of 9 for larger ranges) to aBegin.
+		size_t half = size / 2;
+		if (size > 128) {
+			Sort3(aBegin, aBegin + half, aEnd - 1, aLess);
+			Sort3(aBegin + 1, aBegin + (half - 1), aEnd - 2, aLess);
+			Sort3(aBegin + 2, aBegin + (half + 1), aEnd - 3, aLess);
+			Sort3(aBegin + (half - 1), aBegin + half, aBegin + (half + 1), aLess);
+			Swap(*aBegin, aBegin[half]);
+		}
+		else Sort3(aBegin + half, aBegin, aEnd - 1, aLess);
+
+		if (!aLeftmost && !aLess(aBegin[-1], *aBegin)) {
+			aBegin = PartitionLeft(aBegin, aEnd, aLess) + 1;
+			continue;
+		}
+
+		bool already_partitioned;
+		T* pivot = PartitionRight(aBegin, aEnd, aLess, already_partitioned);
+		size_t left = pivot - aBegin, right = aEnd - (pivot + 1);
+		if (left < size / 8 || right < size / 8) {
+			// A bad pivot; fall back to heapsort if this keeps happening, otherwise shuffle some elements.
+			if (--aBadAllowed == 0) {
+				HeapSort(aBegin, aEnd, aLess);
+				return;
+			}
+			if (left >= SORT_INSERTION_THRESHOLD) {
+				Swap(aBegin[0], aBegin[left / 4]);
+				Swap(pivot[-1], pivot[-(ptrdiff_t)(left / 4)]);
+			}
+			if (right >= SORT_INSERTION_THRESHOLD) {
+				Swap(pivot[1], pivot[1 + right / 4]);
+				Swap(aEnd[-1], aEnd[-(ptrdiff_t)(right / 4)]);
+			}
+		}
+		else if (already_partitioned && PartialInsertionSort(aBegin, pivot, aLess)
+			&& PartialInsertionSort(pivot + 1, aEnd, aLess))
+			return;
+
+		PdqLoop(aBegin, pivot, aLess, aBadAllowed, aLeftmost);
+		aBegin = pivot + 1;
+		aLeftmost = false;
+	}
+}
+
+template<typename T, typename Less>
+static void PdqSort(T* aBegin, T* aEnd, Less& aLess) {
+	int log2 = 0;
+	for (size_t n = aEnd - aBegin; n > 1; n >>= 1)
+		++log2;
+	PdqLoop(aBegin, aEnd, aLess, log2 + 1, true);
+}
+
+// Stable merge of two sorted runs.  aOut may alias the second run, provided it starts before it.
+template<typename T, typename Less>
+static void Merge(const T* a, const T* aEnd, const T* b, const T* bEnd, T* aOut, Less& aLess) {
+	while (a < aEnd && b < bEnd)
+		*aOut++ = aLess(*b, *a) ? *b++ : *a++;
+	while (a < aEnd)
+		*aOut++ = *a++;
+	while (b < bEnd)
+		*aOut++ = *b++;
+}
+
+// Stable top-down merge sort; used with script callbacks, where comparisons dominate.
+template<typename T, typename Less>
+static void MergeSort(T* aData, T* aBuf, size_t aCount, Less& aLess) {
+	if (aCount <= 8) {
+		InsertionSort(aData, aData + aCount, aLess);
+		return;
+	}
+	size_t half = aCount / 2;
+	MergeSort(aData, aBuf, half, aLess);
+	MergeSort(aData + half, aBuf, aCount - half, aLess);
+	if (!aLess(aData[half], aData[half - 1]))
+		return;
+	memcpy(aBuf, aData, half * sizeof(T));
+	Merge(aBuf, aBuf + half, aData + half, aData + aCount, aData, aLess);
+}
+
+// Sorts in chunks on the thread pool and merges them pairwise, or with pdqsort on this
+// thread for small arrays.  Stability comes from the comparer, not the algorithm.
+template<typename T, typename Less>
+static void SortRecords(T* aData, size_t aCount, Less aLess) {
+	T* buf = nullptr;
+	if (aCount < SORT_PARALLEL_THRESHOLD || ThreadCount() < 2 || !(buf = (T*)malloc(aCount * sizeof(T)))) {
+		PdqSort(aData, aData + aCount, aLess);
+		return;
+	}
+	int chunks = 2;
+	while (chunks < ThreadCount() && chunks < SORT_MAX_CHUNKS)
+		chunks <<= 1;
+	auto bound = [&](int i) { return aCount * i / chunks; };
+	auto sort_chunk = [&](int i) { PdqSort(aData + bound(i), aData + bound(i + 1), aLess); };
+	RunParallel(chunks, sort_chunk);
+	T* src = aData, * dst = buf;
+	for (int width = 1; width < chunks; width <<= 1) {
+		auto merge = [&](int i) {
+			int lo = i * 2 * width, mid = lo + width, hi = mid + width;
+			Merge(src + bound(lo), src + bound(mid), src + bound(mid), src + bound(hi), dst + bound(lo), aLess);
+		};
+		RunParallel(chunks / (2 * width), merge);
+		Swap(src, dst);
+	}
+	if (src != aData)
+		memcpy(aData, src, aCount * sizeof(T));
+	free(buf);
+}
+
+//
+// Sort records and comparers.  Each record carries the item's original index, which
+// breaks ties when a stable sort is requested.
+//
+
+struct IntRecord
+{
+	__int64 key;
+	index_t index;
+};
+
+struct StrRecord
+{
+	LPCTSTR key;
+	size_t length;
+	index_t index;
+};
+
+struct AnyRecord
+{
+	ExprTokenType key;
+	index_t index;
+};
+
+// Integers beyond this magnitude are not all exactly representable as doubles.
+#define SORT_EXACT_DOUBLE_INT (1LL << 53)
+
+// Maps a double to an integer with the same order: -0.0 equals 0.0, and NaN sorts last.
+static __int64 FloatKey(double aValue) {
+	__int64 bits;
+	if (aValue == 0)
+		aValue = 0;
+	memcpy(&bits, &aValue, sizeof(bits));
+	if (aValue != aValue)
+		bits = 0x7FF8000000000000;
+	return bits ^ ((bits >> 63) & 0x7FFFFFFFFFFFFFFF);
+}
+
+static inline int CompareStr(LPCTSTR a, size_t aLength, LPCTSTR b, size_t bLength) {
+	for (size_t i = 0, n = aLength < bLength ? aLength : bLength; i < n; ++i)
+		if (a[i] != b[i])
+			return (_TUCHAR)a[i] < (_TUCHAR)b[i] ? -1 : 1;
+	return aLength < bLength ? -1 : aLength > bLength;
+}
+
+static inline bool IsNaN(const ExprTokenType& aToken) {
+	return aToken.symbol == SYM_FLOAT && aToken.value_double != aToken.value_double;
+}
+
+static inline int SymbolRank(SymbolType aSymbol) {
+	switch (aSymbol)
+	{
+	case SYM_INTEGER:
+	case SYM_FLOAT: return 0;
+	case SYM_STRING: return 1;
+	case SYM_OBJECT: return 2;
+	default: return 3;
+	}
+}
+
+static int CompareAny(const ExprTokenType& a, const ExprTokenType& b) {
+	int ra = SymbolRank(a.symbol), rb = SymbolRank(b.symbol);
+	if (ra != rb)
+		return ra < rb ? -1 : 1;
+	switch (ra)
+	{
+	case 0:
+		if (a.symbol == SYM_INTEGER && b.symbol == SYM_INTEGER)
+			return a.value_int64 < b.value_int64 ? -1 : a.value_int64 > b.value_int64;
+		if (a.symbol == SYM_INTEGER)
+			return CompareIntFloat(a.value_int64, b.value_double);
+		if (b.symbol == SYM_INTEGER)
+			return -CompareIntFloat(b.value_int64, a.value_double);
+		{
+			__int64 ka = FloatKey(a.value_double), kb = FloatKey(b.value_double);
+			return ka < kb ? -1 : ka > kb;
+		}
+	case 1: return CompareStr(a.marker, a.marker_length, b.marker, b.marker_length);
+	case 2: return a.object < b.object ? -1 : a.object > b.object;
+	default: return 0;
+	}
+}
+
+// Descending order is applied to IntRecord keys when they are built.
+template<bool Stable>
+struct IntLess
+{
+	bool operator()(const IntRecord& a, const IntRecord& b) const {
+		return a.key < b.key || (Stable && a.key == b.key && a.index < b.index);
+	}
+};
+
+template<bool Stable>
+struct StrLess
+{
+	bool desc;
+	bool operator()(const StrRecord& a, const StrRecord& b) const {
+		int c = CompareStr(a.key, a.length, b.key, b.length);
+		if (desc)
+			c = -c;
+		return c < 0 || (Stable && !c && a.index < b.index);
+	}
+};
+
+template<bool Stable>
+struct AnyLess
+{
+	bool desc;
+	bool operator()(const AnyRecord& a, const AnyRecord& b) const {
+		int c = CompareAny(a.key, b.key);
+		// Unset items stay last in either order, as does NaN among the numbers.
+		if (desc && a.key.symbol != SYM_MISSING && b.key.symbol != SYM_MISSING
+			&& !(SymbolRank(a.key.symbol) == SymbolRank(b.key.symbol) && (IsNaN(a.key) || IsNaN(b.key))))
+			c = -c;
+		return c < 0 || (Stable && !c && a.index < b.index);
+	}
+};
+
+//
+// Array access.
+//
+
+static bool OutOfMemory() {
+	Object::Error(ExprTokenType(_T("Out of memory.")), nullptr, _T("MemoryError"));
+	return false;
+}
+
+static bool ArrayModified() {
+	Object::Error(ExprTokenType(_T("The array was modified during the sort.")));
+	return false;
+}
+
+static Array* ParamArray(ExprTokenType& aToken) {
+	ExprTokenType val;
+	TokenToValue(aToken, val);
+	if (val.symbol == SYM_OBJECT && !_tcscmp(val.object->Type(), _T("Array")))
+		return static_cast<Array*>(val.object);
+	Object::Error(ExprTokenType(_T("Parameter #1 must be an Array.")), nullptr, _T("TypeError"));
+	return nullptr;
+}
+
+static inline index_t& RecordIndex(index_t& aIndex) { return aIndex; }
+template<typename T>
+static inline index_t& RecordIndex(T& aRecord) { return aRecord.index; }
+
+// Reorders the items by the sorted records.  Items are moved as-is, so no references change hands.
+// Gathering from a copy is faster; without the memory, each cycle of the permutation is followed
+// in place, resetting each record's index to its own position to mark it as done.
+template<typename T>
+static void Permute(Array* aArray, T* aRecords, index_t aCount) {
+	auto items = aArray->mItem;
+	if (auto copy = (Object::Variant*)malloc(aCount * sizeof(Object::Variant))) {
+		memcpy(copy, items, aCount * sizeof(Object::Variant));
+		for (index_t i = 0; i < aCount; ++i)
+			items[i] = copy[RecordIndex(aRecords[i])];
+		free(copy);
+		return;
+	}
+	for (index_t i = 0; i < aCount; ++i) {
+		if (RecordIndex(aRecords[i]) == i)
+			continue;
+		Object::Variant first = items[i];
+		index_t j = i;
+		for (;;) {
+			index_t k = RecordIndex(aRecords[j]);
+			RecordIndex(aRecords[j]) = j;
+			if (k == i)
+				break;
+			items[j] = items[k];
+			j = k;
+		}
+		items[j] = first;
+	}
+}
+
+template<typename T, typename Less>
+static bool SortAndPermute(Array* aArray, T* aRecords, index_t aCount, Less aLess) {
+	SortRecords(aRecords, aCount, aLess);
+	Permute(aArray, aRecords, aCount);
+	return true;
+}
+
+static inline void GetKey(Object::Variant& aItem, ExprTokenType& aKey) { VariantToToken(aItem, aKey); }
+static inline void GetKey(ExprTokenType& aToken, ExprTokenType& aKey) { aKey = aToken; }
+
+// Sorts the items by aKeys[i] (the items themselves or the results of a key function),
+// choosing the record type from the kinds of keys present.  String keys must have a length.
+template<typename K>
+static bool SortKeys(Array* aArray, K* aKeys, index_t aCount, bool aDesc, bool aStable, Arena& aArena) {
+	index_t ints = 0, floats = 0, strings = 0, wide = 0;
+	ExprTokenType key;
+	for (index_t i = 0; i < aCount; ++i) {
+		GetKey(aKeys[i], key);
+		switch (key.symbol)
+		{
+		case SYM_INTEGER:
+			++ints;
+			if (key.value_int64 > SORT_EXACT_DOUBLE_INT || key.value_int64 < -SORT_EXACT_DOUBLE_INT)
+				++wide;
+			break;
+		case SYM_FLOAT: ++floats; break;
+		case SYM_STRING: ++strings; break;
+		default: break;
+		}
+	}
+	// Mixed keys are mapped through FloatKey only while every integer converts exactly;
+	// otherwise they take the generic path, which compares integers and doubles exactly.
+	if (ints + floats == aCount && !(floats && wide)) {
+		auto records = aArena.Alloc<IntRecord>(aCount);
+		if (!records)
+			return OutOfMemory();
+		for (index_t i = 0; i < aCount; ++i) {
+			GetKey(aKeys[i], key);
+			__int64 k = !floats ? key.value_int64
+				: FloatKey(key.symbol == SYM_INTEGER ? (double)key.value_int64 : key.value_double);
+			records[i] = { aDesc && !IsNaN(key) ? ~k : k, i };
+		}
+		return aStable ? SortAndPermute(aArray, records, aCount, IntLess<true>())
+			: SortAndPermute(aArray, records, aCount, IntLess<false>());
+	}
+	if (strings == aCount) {
+		auto records = aArena.Alloc<StrRecord>(aCount);
+		if (!records)
+			return OutOfMemory();
+		for (index_t i = 0; i < aCount; ++i) {
+			GetKey(aKeys[i], key);
+			records[i] = { key.marker, key.marker_length, i };
+		}
+		return aStable ? SortAndPermute(aArray, records, aCount, StrLess<true>{ aDesc })
+			: SortAndPermute(aArray, records, aCount, StrLess<false>{ aDesc });
+	}
+	auto records = aArena.Alloc<AnyRecord>(aCount);
+	if (!records)
+		return OutOfMemory();
+	for (index_t i = 0; i < aCount; ++i) {
+		GetKey(aKeys[i], records[i].key);
+		records[i].index = i;
+	}
+	return aStable ? SortAndPermute(aArray, records, aCount, AnyLess<true>{ aDesc })
+		: SortAndPermute(aArray, records, aCount, AnyLess<false>{ aDesc });
+}
+
+// Calls aKeyFunc once per item and sorts by the results, which are kept in aArena.
+static bool SortByKeyFunc(Array* aArray, IObject* aKeyFunc, bool aDesc) {
+	index_t count = aArray->mLength, done = 0;
+	if (count < 2)
+		return true;
+	Arena arena;
+	auto keys = arena.Alloc<ExprTokenType>(count);
+	if (!keys)
+		return OutOfMemory();
+	bool ok = true;
+	TCHAR buf[MAX_NUMBER_SIZE];
+	ResultToken r;
+	for (; done < count; ++done) {
+		ExprTokenType item, * params = &item;
+		VariantToToken(aArray->mItem[done], item);
+		r.InitResult(buf);
+		aKeyFunc->Invoke(r, IT_CALL, nullptr, ExprTokenType(aKeyFunc), &params, 1);
+		if (r.Exited()) {
+			r.Free();
+			ok = false;
+			break;
+		}
+		auto& key = keys[done];
+		if (r.symbol == SYM_STRING) {
+			size_t length = r.marker_length == -1 ? _tcslen(r.marker) : r.marker_length;
+			LPTSTR str = arena.Strdup(r.marker, length);
+			r.Free();
+			if (!str) {
+				ok = OutOfMemory();
+				break;
+			}
+			key.SetValue(str, length);
+		}
+		else key = r; // Takes over the object reference, if any.
+		if (aArray->mLength != count) {
+			++done;
+			ok = ArrayModified();
+			break;
+		}
+	}
+	if (ok)
+		ok = SortKeys(aArray, keys, count, aDesc, true, arena);
+	for (index_t i = 0; i < done; ++i)
+		if (keys[i].symbol == SYM_OBJECT)
+			keys[i].object->Release();
+	return ok;
+}
+
+struct CallbackLess
+{
+	Array* array;
+	IObject* func;
+	index_t count;
+	int* error; // 0, or 1 if the callback threw, or 2 if the array was modified.
+
+	bool operator()(index_t a, index_t b) const {
+		if (*error)
+			return false;
+		ExprTokenType param[2], * params[] = { param, param + 1 }, val;
+		VariantToToken(array->mItem[a], param[0]);
+		VariantToToken(array->mItem[b], param[1]);
+		TCHAR buf[MAX_NUMBER_SIZE];
+		ResultToken r;
+		r.InitResult(buf);
+		func->Invoke(r, IT_CALL, nullptr, ExprTokenType(func), params, 2);
+		double n = 0;
+		if (r.Exited())
+			*error = 1;
+		else if (array->mLength != count)
+			*error = 2;
+		else {
+			TokenToValue(r, val);
+			n = val.symbol == SYM_INTEGER ? (double)val.value_int64 : val.symbol == SYM_FLOAT ? val.value_double
+				: val.symbol == SYM_STRING ? _tcstod(val.marker, nullptr) : 0;
+		}
+		r.Free();
+		return n < 0;
+	}
+};
+
+static bool SortByCallback(Array* aArray, IObject* aCompare) {
+	index_t count = aArray->mLength;
+	if (count < 2)
+		return true;
+	auto order = (index_t*)malloc(count * 2 * sizeof(index_t));
+	if (!order)
+		return OutOfMemory();
+	for (index_t i = 0; i < count; ++i)
+		order[i] = i;
+	int error = 0;
+	CallbackLess less = { aArray, aCompare, count, &error };
+	MergeSort(order, order + count, count, less);
+	bool ok = !error;
+	if (ok)
+		Permute(aArray, order, count);
+	else if (error == 2)
+		ArrayModified();
+	free(order);
+	return ok;
+}
+
+// sort(arr, compare := 'asc', stable := false)
+BIF_DECL(sort) {
+	Array* arr = ParamArray(*aParam[0]);
+	IObject* compare = nullptr;
+	bool desc = false, ok;
+	if (!arr) {
+		aResultToken.result = FAIL;
+		return;
+	}
+	if (aParamCount > 1 && aParam[1]->symbol != SYM_MISSING) {
+		ExprTokenType val;
+		TokenToValue(*aParam[1], val);
+		if (val.symbol == SYM_OBJECT)
+			compare = val.object;
+		else if (val.symbol == SYM_STRING && !_tcsicmp(val.marker, _T("desc")))
+			desc = true;
+		else if (val.symbol != SYM_STRING || _tcsicmp(val.marker, _T("asc"))) {
+			Object::Error(ExprTokenType(_T("Parameter #2 must be 'asc', 'desc' or a function.")), nullptr, _T("ValueError"));
+			aResultToken.result = FAIL;
+			return;
+		}
+	}
+	if (compare)
+		ok = SortByCallback(arr, compare);
+	else if (arr->mLength < 2)
+		ok = true;
+	else {
+		Arena arena;
+		ok = SortKeys(arr, arr->mItem, arr->mLength, desc, aParamCount > 2 && TokenToBool(*aParam[2]), arena);
+	}
+	if (!ok) {
+		aResultToken.result = FAIL;
+		return;
+	}
+	arr->AddRef();
+	aResultToken.SetValue(arr);
+}
+
+// sortby(arr, key, desc := false)
+BIF_DECL(sortby) {
+	Array* arr = ParamArray(*aParam[0]);
+	ExprTokenType key;
+	if (!arr) {
+		aResultToken.result = FAIL;
+		return;
+	}
+	TokenToValue(*aParam[1], key);
+	if (key.symbol != SYM_OBJECT) {
+		Object::Error(ExprTokenType(_T("Parameter #2 must be a function.")), nullptr, _T("TypeError"));
+		aResultToken.result = FAIL;
+		return;
+	}
+	if (!SortByKeyFunc(arr, key.object, aParamCount > 2 && TokenToBool(*aParam[2]))) {
+		aResultToken.result = FAIL;
+		return;
+	}
+	arr->AddRef();
+	aResultToken.SetValue(arr);
+}
+
+ExportSymbol symbols[] = {
+	EXPORT_FUNC(sort, 1, 3)
+	EXPORT_FUNC(sortby, 2, 3)
+};
+
+EXPORT_AHKMODULE(symbols)
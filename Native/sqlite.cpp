@@ -0,0 +1,779 @@
+﻿#include "ahk2_types.h"
+
+// sqlite: typed, columnar query results for CSQLite.ahk.
+//   sq := Native.LoadModule('sqlite.dll')
+//   db := sq.Connection(csqlite.ptr, cache_size := 16)	; an open sqlite3 handle, which stays owned by the caller
+//   rs := db.Query(sql, params*)	; rs.RowCount, rs.ColCount, rs.Cols, rs[row, col], rs.Row(row), rs.Column(col)
+//   for v in rs.Column('name')	; col.Length, col[row]; integers and floats keep their type, NULL is ""
+//   n := db.Exec(sql, params*)	; the number of rows changed
+//   n := db.ExecMany(sql, rows)	; binds each Array in rows in turn, all in one transaction
+//   db.Close()	; finalizes the cached statements; call it before CSQLite.CloseDB()
+// Rows are stepped natively into one typed array and one string arena per column, and
+// script values are only created for the cells which are read.  Statements are prepared
+// once per SQL text and kept in a small LRU cache.  Columns can be given by index or name.
+// Each SQL text must hold one statement; a second raises a ValueError rather than being dropped.
+// The SQLite API is resolved from SQLite3.dll, which CSQLite.ahk has already loaded.
+
+#ifndef UNICODE
+#error The sqlite module uses the UTF-16 SQLite API.
+#endif
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+enum SqliteCode
+{
+	SQLITE_OK = 0,
+	SQLITE_ROW = 100,
+	SQLITE_DONE = 101,
+	SQLITE_INTEGER = 1,
+	SQLITE_FLOAT = 2,
+	SQLITE_TEXT = 3,
+	SQLITE_BLOB = 4,
+	SQLITE_NULL = 5
+};
+
+#define SQLITE_TRANSIENT ((void (__cdecl*)(void*))-1)
+
+// Must stay in the same order as sSqliteNames.
+static struct SqliteApi
+{
+	int (__cdecl* prepare16_v2)(sqlite3*, const void*, int, sqlite3_stmt**, const void**);
+	int (__cdecl* step)(sqlite3_stmt*);
+	int (__cdecl* reset)(sqlite3_stmt*);
+	int (__cdecl* clear_bindings)(sqlite3_stmt*);
+	int (__cdecl* finalize)(sqlite3_stmt*);
+	int (__cdecl* column_count)(sqlite3_stmt*);
+	const void* (__cdecl* column_name16)(sqlite3_stmt*, int);
+	int (__cdecl* column_type)(sqlite3_stmt*, int);
+	__int64 (__cdecl* column_int64)(sqlite3_stmt*, int);
+	double (__cdecl* column_double)(sqlite3_stmt*, int);
+	const void* (__cdecl* column_text16)(sqlite3_stmt*, int);
+	int (__cdecl* column_bytes16)(sqlite3_stmt*, int);
+	const void* (__cdecl* column_blob)(sqlite3_stmt*, int);
+	int (__cdecl* column_bytes)(sqlite3_stmt*, int);
+	int (__cdecl* bind_parameter_count)(sqlite3_stmt*);
+	int (__cdecl* bind_int64)(sqlite3_stmt*, int, __int64);
+	int (__cdecl* bind_double)(sqlite3_stmt*, int, double);
+	int (__cdecl* bind_text16)(sqlite3_stmt*, int, const void*, int, void (__cdecl*)(void*));
+	int (__cdecl* bind_blob)(sqlite3_stmt*, int, const void*, int, void (__cdecl*)(void*));
+	int (__cdecl* bind_null)(sqlite3_stmt*, int);
+	int (__cdecl* changes)(sqlite3*);
+	const void* (__cdecl* errmsg16)(sqlite3*);
+	int (__cdecl* exec)(sqlite3*, const char*, void*, void*, char**);
+} sqlite;
+
+static const char* const sSqliteNames[] = {
+	"sqlite3_prepare16_v2", "sqlite3_step", "sqlite3_reset", "sqlite3_clear_bindings", "sqlite3_finalize",
+	"sqlite3_column_count", "sqlite3_column_name16", "sqlite3_column_type", "sqlite3_column_int64",
+	"sqlite3_column_double", "sqlite3_column_text16", "sqlite3_column_bytes16", "sqlite3_column_blob",
+	"sqlite3_column_bytes", "sqlite3_bind_parameter_count", "sqlite3_bind_int64", "sqlite3_bind_double",
+	"sqlite3_bind_text16", "sqlite3_bind_blob", "sqlite3_bind_null", "sqlite3_changes", "sqlite3_errmsg16",
+	"sqlite3_exec"
+};
+
+static bool LoadSqlite() {
+	static bool sLoaded = false;
+	if (sLoaded)
+		return true;
+	HMODULE mod = GetModuleHandle(_T("SQLite3.dll"));
+	if (!mod) {
+		Object::Error(ExprTokenType(_T("SQLite3.dll is not loaded.")), nullptr, _T("OSError"));
+		return false;
+	}
+	static_assert(sizeof(SqliteApi) == sizeof(sSqliteNames) / sizeof(*sSqliteNames) * sizeof(void*), "sSqliteNames");
+	auto fn = (FARPROC*)&sqlite;
+	for (size_t i = 0; i < _countof(sSqliteNames); ++i)
+		if (!(fn[i] = GetProcAddress(mod, sSqliteNames[i]))) {
+			TCHAR name[64];
+			size_t n = 0;
+			for (; sSqliteNames[i][n]; ++n)
+				name[n] = sSqliteNames[i][n];
+			name[n] = '\0';
+			Object::Error(ExprTokenType(_T("SQLite3.dll is missing a function.")), name, _T("OSError"));
+			return false;
+		}
+	return sLoaded = true;
+}
+
+static bool OutOfMemory() {
+	Object::Error(ExprTokenType(_T("Out of memory.")), nullptr, _T("MemoryError"));
+	return false;
+}
+
+//
+// ResultTable - every row of a query, stored by column.  Integers and floats are kept in
+// mValue; text and blobs are appended to the column's arena as a size_t length followed by
+// the data (text is null-terminated), and mValue holds the offset.
+//
+
+struct ResultTable
+{
+	struct Column
+	{
+		LPTSTR name = nullptr;
+		BYTE* type = nullptr;
+		__int64* value = nullptr; // Doubles are stored bitwise.
+		char* arena = nullptr;
+		size_t arena_size = 0, arena_capacity = 0;
+	};
+	Column* mCol = nullptr;
+	size_t mColCount = 0, mRowCount = 0, mRowCapacity = 0;
+
+	~ResultTable() {
+		for (size_t c = 0; c < mColCount; ++c) {
+			auto& col = mCol[c];
+			free(col.name), free(col.type), free(col.value), free(col.arena);
+		}
+		free(mCol);
+	}
+
+	bool Init(sqlite3_stmt* aStmt) {
+		int count = sqlite.column_count(aStmt);
+		if (count && !(mCol = (Column*)calloc(count, sizeof(Column))))
+			return false;
+		for (mColCount = 0; mColCount < (size_t)count; ++mColCount) {
+			auto name = (LPCTSTR)sqlite.column_name16(aStmt, (int)mColCount);
+			if (!(mCol[mColCount].name = _tcsdup(name ? name : _T(""))))
+				return false;
+		}
+		return true;
+	}
+
+	bool GrowRows() {
+		size_t capacity = mRowCapacity ? mRowCapacity * 2 : 64;
+		for (size_t c = 0; c < mColCount; ++c) {
+			auto& col = mCol[c];
+			auto type = (BYTE*)realloc(col.type, capacity);
+			if (type)
+				col.type = type;
+			auto value = type ? (__int64*)realloc(col.value, capacity * sizeof(__int64)) : nullptr;
+			if (!value)
+				return false;
+			col.value = value;
+		}
+		mRowCapacity = capacity;
+		return true;
+	}
+
+	static bool Append(Column& aCol, const void* aData, size_t aSize, size_t aTerminator, __int64& aOffset) {
+		size_t need = sizeof(size_t) + aSize + aTerminator;
+		need = (need + 7) & ~(size_t)7; // Keep the length prefixes aligned.
+		if (aCol.arena_capacity - aCol.arena_size < need) {
+			size_t capacity = aCol.arena_capacity ? aCol.arena_capacity : 4096;
+			while (capacity - aCol.arena_size < need)
+				capacity *= 2;
+			auto arena = (char*)realloc(aCol.arena, capacity);
+			if (!arena)
+				return false;
+			aCol.arena = arena, aCol.arena_capacity = capacity;
+		}
+		char* p = aCol.arena + aCol.arena_size;
+		*(size_t*)p = aSize;
+		if (aSize) // An empty blob's data is NULL.
+			memcpy(p + sizeof(size_t), aData, aSize);
+		memset(p + sizeof(size_t) + aSize, 0, aTerminator);
+		aOffset = (__int64)aCol.arena_size;
+		aCol.arena_size += need;
+		return true;
+	}
+
+	// Copies the current row of aStmt.
+	bool AddRow(sqlite3_stmt* aStmt) {
+		if (mRowCount == mRowCapacity && !GrowRows())
+			return false;
+		size_t row = mRowCount;
+		for (size_t c = 0; c < mColCount; ++c) {
+			auto& col = mCol[c];
+			int i = (int)c, type = sqlite.column_type(aStmt, i);
+			__int64& value = col.value[row];
+			switch (type)
+			{
+			case SQLITE_INTEGER:
+				value = sqlite.column_int64(aStmt, i);
+				break;
+			case SQLITE_FLOAT: {
+				double d = sqlite.column_double(aStmt, i);
+				memcpy(&value, &d, sizeof(d));
+				break;
+			}
+			case SQLITE_TEXT: {
+				// The pointer must be fetched before the size, or the size may be of the wrong encoding.
+				auto text = sqlite.column_text16(aStmt, i);
+				if (!Append(col, text, sqlite.column_bytes16(aStmt, i), sizeof(TCHAR), value))
+					return false;
+				break;
+			}
+			case SQLITE_BLOB: {
+				auto blob = sqlite.column_blob(aStmt, i);
+				if (!Append(col, blob, sqlite.column_bytes(aStmt, i), 0, value))
+					return false;
+				break;
+			}
+			default:
+				type = SQLITE_NULL, value = 0;
+			}
+			col.type[row] = (BYTE)type;
+		}
+		++mRowCount;
+		return true;
+	}
+
+	// Finds a column by 1-based index or by name (case-insensitive).
+	bool FindColumn(ExprTokenType& aToken, size_t& aCol) {
+		ExprTokenType val;
+		TokenToValue(aToken, val);
+		if (val.symbol != SYM_STRING)
+			return TokenToIndex(val, mColCount, aCol);
+		for (aCol = 0; aCol < mColCount; ++aCol)
+			if (!_tcsicmp(mCol[aCol].name, val.marker))
+				return true;
+		return false;
+	}
+
+	// Blobs become new Buffers, which the caller releases; text points into the arena.
+	bool CellToToken(size_t aCol, size_t aRow, ExprTokenType& aToken) {
+		auto& col = mCol[aCol];
+		__int64 value = col.value[aRow];
+		switch (col.type[aRow])
+		{
+		case SQLITE_INTEGER:
+			aToken.SetValue(value);
+			return true;
+		case SQLITE_FLOAT: {
+			double d;
+			memcpy(&d, &value, sizeof(d));
+			aToken.SetValue(d);
+			return true;
+		}
+		case SQLITE_TEXT: {
+			char* p = col.arena + (size_t)value;
+			aToken.SetValue((LPTSTR)(p + sizeof(size_t)), *(size_t*)p / sizeof(TCHAR));
+			return true;
+		}
+		case SQLITE_BLOB: {
+			char* p = col.arena + (size_t)value;
+			size_t size = *(size_t*)p;
+			BufferObject* buf;
+			if (!NewBuffer(size, buf))
+				return false;
+			memcpy(buf->mData, p + sizeof(size_t), size);
+			aToken.SetValue((IObject*)buf);
+			return true;
+		}
+		default:
+			aToken.SetValue((LPTSTR)_T(""), 0);
+			return true;
+		}
+	}
+
+	// Returns a cell, transferring ownership of any new Buffer to the result.
+	bool ReturnCell(ResultToken& aResultToken, size_t aCol, size_t aRow) {
+		ExprTokenType cell;
+		if (!CellToToken(aCol, aRow, cell))
+			return false;
+		switch (cell.symbol)
+		{
+		case SYM_OBJECT: aResultToken.SetValue(cell.object); break;
+		case SYM_STRING: aResultToken.SetValue(cell.marker, cell.marker_length); break;
+		case SYM_FLOAT: aResultToken.SetValue(cell.value_double); break;
+		default: aResultToken.SetValue(cell.value_int64);
+		}
+		return true;
+	}
+
+	IObject* NewRow(size_t aRow) {
+		static IObject* sArray = GetGlobal(_T("Array"));
+		Arena arena(mColCount * (sizeof(ExprTokenType) + sizeof(void*)) + 64);
+		ExprTokenType** params = arena.NewParams(mColCount);
+		if (!params)
+			return OutOfMemory(), nullptr;
+		size_t done = 0;
+		while (done < mColCount && CellToToken(done, aRow, *params[done]))
+			++done;
+		IObject* row = done == mColCount && sArray ? CallGlobal(sArray, params, (int)mColCount) : nullptr;
+		for (size_t c = 0; c < done; ++c)
+			if (params[c]->symbol == SYM_OBJECT)
+				params[c]->object->Release();
+		return row;
+	}
+
+	IObject* NewNames() {
+		static IObject* sArray = GetGlobal(_T("Array"));
+		Arena arena(mColCount * (sizeof(ExprTokenType) + sizeof(void*)) + 64);
+		ExprTokenType** params = arena.NewParams(mColCount);
+		if (!params)
+			return OutOfMemory(), nullptr;
+		for (size_t c = 0; c < mColCount; ++c)
+			params[c]->SetValue(mCol[c].name);
+		return sArray ? CallGlobal(sArray, params, (int)mColCount) : nullptr;
+	}
+};
+
+//
+// Script-facing views.  These are not module classes, so they dispatch by name like
+// HashMapEnum.  Each keeps the ResultSet (and so the table) alive.
+//
+
+class ResultSet : public ObjectBase
+{
+public:
+	ResultTable mTable;
+	LPTSTR Type() { return _T("ResultSet"); }
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL);
+};
+
+static ResultType InvalidIndex(ResultToken& aResultToken, ExprTokenType& aIndex) {
+	TCHAR buf[MAX_NUMBER_SIZE];
+	ExprTokenType val;
+	TokenToValue(aIndex, val);
+	Object::Error(ExprTokenType(_T("Invalid index.")), val.symbol == SYM_STRING ? val.marker
+		: val.symbol == SYM_INTEGER ? _i64tot(val.value_int64, buf, 10) : nullptr, _T("IndexError"));
+	return aResultToken.result = FAIL;
+}
+
+class ColumnView : public ObjectBase
+{
+	ResultSet* mSet;
+	size_t mCol;
+public:
+	ColumnView(ResultSet* aSet, size_t aCol) : mSet(aSet), mCol(aCol) { aSet->AddRef(); }
+	~ColumnView() { mSet->Release(); }
+	LPTSTR Type() { return _T("Column"); }
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL);
+};
+
+// for row in rs, for i, row in rs, for v in col and for i, v in col.
+class ResultEnum : public ObjectBase
+{
+	ResultSet* mSet;
+	size_t mCol, mPos = 0; // mCol is -1 for rows.
+	int mVarCount;
+public:
+	ResultEnum(ResultSet* aSet, size_t aCol, int aVarCount) : mSet(aSet), mCol(aCol), mVarCount(aVarCount) { aSet->AddRef(); }
+	~ResultEnum() { mSet->Release(); }
+	LPTSTR Type() { return _T("Enumerator"); }
+
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+		if (!IS_INVOKE_CALL || (aName && _tcsicmp(aName, _T("Call"))))
+			return INVOKE_NOT_HANDLED;
+		auto& table = mSet->mTable;
+		if (mPos >= table.mRowCount) {
+			aResultToken.SetValue((__int64)0);
+			return OK;
+		}
+		size_t row = mPos++;
+		Var* var;
+		int value_param = mVarCount > 1 ? 1 : 0;
+		if (value_param && aParamCount > 0 && (var = TokenToOutputVar(*aParam[0])))
+			var->Assign((__int64)row + 1);
+		if (aParamCount > value_param && (var = TokenToOutputVar(*aParam[value_param]))) {
+			if (mCol == (size_t)-1) {
+				IObject* obj = table.NewRow(row);
+				if (!obj)
+					return aResultToken.result = FAIL;
+				var->Assign(obj);
+				obj->Release();
+			}
+			else {
+				ExprTokenType cell;
+				if (!table.CellToToken(mCol, row, cell))
+					return aResultToken.result = FAIL;
+				switch (cell.symbol)
+				{
+				case SYM_STRING: var->Assign(cell.marker, cell.marker_length); break;
+				case SYM_FLOAT: var->Assign(cell.value_double); break;
+				case SYM_OBJECT: var->Assign(cell.object), cell.object->Release(); break;
+				default: var->Assign(cell.value_int64);
+				}
+			}
+		}
+		aResultToken.SetValue((__int64)1);
+		return OK;
+	}
+};
+
+static int EnumVarCount(ExprTokenType* aParam[], int aParamCount) {
+	ExprTokenType val;
+	if (!aParamCount || aParam[0]->symbol == SYM_MISSING)
+		return 1;
+	TokenToValue(*aParam[0], val);
+	return val.symbol == SYM_INTEGER ? (int)val.value_int64 : 1;
+}
+
+ResultType ColumnView::Invoke(IObject_Invoke_PARAMS_DECL) {
+	auto& table = mSet->mTable;
+	if (!aName || !_tcsicmp(aName, _T("__Item"))) {
+		size_t row;
+		if (!IS_INVOKE_GET || aParamCount != 1)
+			return INVOKE_NOT_HANDLED;
+		if (!TokenToIndex(*aParam[0], table.mRowCount, row))
+			return InvalidIndex(aResultToken, *aParam[0]);
+		return table.ReturnCell(aResultToken, mCol, row) ? OK : aResultToken.result = FAIL;
+	}
+	if (!_tcsicmp(aName, _T("Length")) && IS_INVOKE_GET && !aParamCount) {
+		aResultToken.SetValue((__int64)table.mRowCount);
+		return OK;
+	}
+	if (!_tcsicmp(aName, _T("Name")) && IS_INVOKE_GET && !aParamCount) {
+		aResultToken.SetValue(table.mCol[mCol].name);
+		return OK;
+	}
+	if (!_tcsicmp(aName, _T("__Enum")) && IS_INVOKE_CALL) {
+		aResultToken.SetValue(new ResultEnum(mSet, mCol, EnumVarCount(aParam, aParamCount)));
+		return OK;
+	}
+	return INVOKE_NOT_HANDLED;
+}
+
+ResultType ResultSet::Invoke(IObject_Invoke_PARAMS_DECL) {
+	bool is_row = aName && !_tcsicmp(aName, _T("Row"));
+	if (is_row || !aName || !_tcsicmp(aName, _T("__Item"))) {
+		size_t row, col;
+		if (is_row ? !IS_INVOKE_CALL || aParamCount != 1 : !IS_INVOKE_GET || aParamCount < 1 || aParamCount > 2)
+			return INVOKE_NOT_HANDLED;
+		if (!TokenToIndex(*aParam[0], mTable.mRowCount, row))
+			return InvalidIndex(aResultToken, *aParam[0]);
+		if (aParamCount == 2) {
+			if (!mTable.FindColumn(*aParam[1], col))
+				return InvalidIndex(aResultToken, *aParam[1]);
+			return mTable.ReturnCell(aResultToken, col, row) ? OK : aResultToken.result = FAIL;
+		}
+		IObject* obj = mTable.NewRow(row);
+		if (!obj)
+			return aResultToken.result = FAIL;
+		aResultToken.SetValue(obj);
+		return OK;
+	}
+	if (!_tcsicmp(aName, _T("Column")) && IS_INVOKE_CALL && aParamCount == 1) {
+		size_t col;
+		if (!mTable.FindColumn(*aParam[0], col))
+			return InvalidIndex(aResultToken, *aParam[0]);
+		aResultToken.SetValue(new ColumnView(this, col));
+		return OK;
+	}
+	if (!_tcsicmp(aName, _T("__Enum")) && IS_INVOKE_CALL) {
+		aResultToken.SetValue(new ResultEnum(this, (size_t)-1, EnumVarCount(aParam, aParamCount)));
+		return OK;
+	}
+	if (!IS_INVOKE_GET || aParamCount)
+		return INVOKE_NOT_HANDLED;
+	if (!_tcsicmp(aName, _T("RowCount")))
+		aResultToken.SetValue((__int64)mTable.mRowCount);
+	else if (!_tcsicmp(aName, _T("ColCount")))
+		aResultToken.SetValue((__int64)mTable.mColCount);
+	else if (!_tcsicmp(aName, _T("Cols"))) {
+		IObject* obj = mTable.NewNames();
+		if (!obj)
+			return aResultToken.result = FAIL;
+		aResultToken.SetValue(obj);
+	}
+	else return INVOKE_NOT_HANDLED;
+	return OK;
+}
+
+class Connection : public Object {
+	struct CachedStatement
+	{
+		LPTSTR sql;
+		size_t length;
+		sqlite3_stmt* stmt;
+	};
+	sqlite3* mDB = nullptr;
+	CachedStatement* mCache = nullptr; // Most recently used first.
+	UINT mCacheCount = 0, mCacheSize = 16;
+
+	bool Fail(int aCode) {
+		TCHAR buf[MAX_NUMBER_SIZE];
+		auto msg = mDB ? (LPTSTR)sqlite.errmsg16(mDB) : nullptr;
+		Object::Error(ExprTokenType(msg ? msg : (LPTSTR)_T("SQLite error.")), _itot(aCode, buf, 10), _T("Error"));
+		return false;
+	}
+
+	bool Ready() {
+		if (mDB)
+			return true;
+		Object::Error(ExprTokenType(_T("The connection is closed.")), nullptr, _T("Error"));
+		return false;
+	}
+
+	// True if aTail holds another statement, rather than only spaces, semicolons or comments.
+	// SQLite reports a tail of comments by preparing no statement.
+	bool HasMoreSQL(LPCTSTR aTail, LPCTSTR aEnd) {
+		while (aTail < aEnd && (*aTail == ' ' || *aTail == '\t' || *aTail == '\r' || *aTail == '\n' || *aTail == ';'))
+			++aTail;
+		if (aTail == aEnd)
+			return false;
+		sqlite3_stmt* next = nullptr;
+		int rc = sqlite.prepare16_v2(mDB, aTail, (int)((aEnd - aTail) * sizeof(TCHAR)), &next, nullptr);
+		if (next)
+			sqlite.finalize(next);
+		return rc != SQLITE_OK || next;
+	}
+
+	// Returns a reset statement for the SQL text, prepared or from the cache.
+	// The text must hold one statement; the rest would otherwise be silently ignored.
+	sqlite3_stmt* Prepare(ExprTokenType& aSQL) {
+		StrRef sql;
+		if (!BorrowString(aSQL, sql)) {
+			Object::Error(ExprTokenType(_T("Parameter #1 must be a String.")), nullptr, _T("TypeError"));
+			return nullptr;
+		}
+		for (UINT i = 0; i < mCacheCount; ++i) {
+			auto& entry = mCache[i];
+			if (entry.length == sql.length && !memcmp(entry.sql, sql.str, sql.length * sizeof(TCHAR))) {
+				CachedStatement hit = entry;
+				memmove(mCache + 1, mCache, i * sizeof(CachedStatement));
+				return (mCache[0] = hit).stmt;
+			}
+		}
+		sqlite3_stmt* stmt = nullptr;
+		const void* tail = nullptr;
+		int rc = sqlite.prepare16_v2(mDB, sql.str, (int)(sql.length * sizeof(TCHAR)), &stmt, &tail);
+		if (rc != SQLITE_OK)
+			return Fail(rc), nullptr;
+		if (!stmt) {
+			Object::Error(ExprTokenType(_T("The SQL has no statement.")), nullptr, _T("ValueError"));
+			return nullptr;
+		}
+		if (tail && HasMoreSQL((LPCTSTR)tail, sql.str + sql.length)) {
+			sqlite.finalize(stmt);
+			Object::Error(ExprTokenType(_T("The SQL has more than one statement.")), nullptr, _T("ValueError"));
+			return nullptr;
+		}
+		if (!mCacheSize)
+			return stmt; // Finalized by Done().
+		LPTSTR copy = (LPTSTR)malloc((sql.length + 1) * sizeof(TCHAR));
+		if (!copy) {
+			sqlite.finalize(stmt);
+			return OutOfMemory(), nullptr;
+		}
+		memcpy(copy, sql.str, sql.length * sizeof(TCHAR));
+		copy[sql.length] = '\0';
+		if (mCacheCount == mCacheSize) {
+			auto& oldest = mCache[--mCacheCount];
+			sqlite.finalize(oldest.stmt);
+			free(oldest.sql);
+		}
+		memmove(mCache + 1, mCache, mCacheCount++ * sizeof(CachedStatement));
+		mCache[0] = { copy, sql.length, stmt };
+		return stmt;
+	}
+
+	// Resets a statement after use; uncached ones are finalized.
+	void Done(sqlite3_stmt* aStmt) {
+		if (!mCacheSize)
+			sqlite.finalize(aStmt);
+		else {
+			sqlite.reset(aStmt);
+			sqlite.clear_bindings(aStmt);
+		}
+	}
+
+	bool Bind(sqlite3_stmt* aStmt, int aIndex, ExprTokenType& aValue) {
+		ExprTokenType val;
+		int rc;
+		TokenToValue(aValue, val);
+		switch (val.symbol)
+		{
+		case SYM_INTEGER: rc = sqlite.bind_int64(aStmt, aIndex, val.value_int64); break;
+		case SYM_FLOAT: rc = sqlite.bind_double(aStmt, aIndex, val.value_double); break;
+		case SYM_STRING: {
+			size_t length = val.marker_length == -1 ? _tcslen(val.marker) : val.marker_length;
+			rc = sqlite.bind_text16(aStmt, aIndex, val.marker, (int)(length * sizeof(TCHAR)), SQLITE_TRANSIENT);
+			break;
+		}
+		case SYM_OBJECT:
+			if (!_tcscmp(val.object->Type(), _T("Buffer"))) {
+				auto buf = static_cast<BufferObject*>(val.object);
+				rc = sqlite.bind_blob(aStmt, aIndex, buf->mData, (int)buf->mSize, SQLITE_TRANSIENT);
+				break;
+			}
+			Object::Error(ExprTokenType(_T("Only a Buffer can be bound as an object.")), nullptr, _T("TypeError"));
+			return false;
+		default: rc = sqlite.bind_null(aStmt, aIndex);
+		}
+		return rc == SQLITE_OK || Fail(rc);
+	}
+
+	bool BindAll(sqlite3_stmt* aStmt, ExprTokenType* aParam[], int aParamCount) {
+		if (aParamCount != sqlite.bind_parameter_count(aStmt)) {
+			Object::Error(ExprTokenType(_T("Invalid number of parameters.")), nullptr, _T("ValueError"));
+			return false;
+		}
+		for (int i = 0; i < aParamCount; ++i)
+			if (!Bind(aStmt, i + 1, *aParam[i]))
+				return false;
+		return true;
+	}
+
+	// Runs a statement to completion, for SQL which returns no rows.
+	bool Run(sqlite3_stmt* aStmt) {
+		int rc;
+		while ((rc = sqlite.step(aStmt)) == SQLITE_ROW);
+		return rc == SQLITE_DONE || Fail(rc);
+	}
+
+	bool ExecText(const char* aSQL) {
+		int rc = sqlite.exec(mDB, aSQL, nullptr, nullptr, nullptr);
+		return rc == SQLITE_OK || Fail(rc);
+	}
+
+public:
+#define CLASSNAME "Connection"
+	IObject_Type_Impl;
+	static ObjectMember sMembers[];
+
+	~Connection() {
+		Close();
+	}
+
+	void Close() {
+		for (UINT i = 0; i < mCacheCount; ++i) {
+			sqlite.finalize(mCache[i].stmt);
+			free(mCache[i].sql);
+		}
+		free(mCache);
+		mCache = nullptr, mCacheCount = 0, mDB = nullptr;
+	}
+
+	void Close(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		Close();
+	}
+
+	void __New(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		ExprTokenType val;
+		if (!LoadSqlite()) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		TokenToValue(*aParam[0], val);
+		if (val.symbol != SYM_INTEGER || !val.value_int64) {
+			Object::Error(ExprTokenType(_T("Invalid database handle.")), nullptr, _T("ValueError"));
+			aResultToken.result = FAIL;
+			return;
+		}
+		if (aParamCount > 1 && aParam[1]->symbol != SYM_MISSING) {
+			ExprTokenType size;
+			TokenToValue(*aParam[1], size);
+			if (size.symbol != SYM_INTEGER || size.value_int64 < 0 || size.value_int64 > 1024) {
+				Object::Error(ExprTokenType(_T("Invalid cache_size.")), nullptr, _T("ValueError"));
+				aResultToken.result = FAIL;
+				return;
+			}
+			mCacheSize = (UINT)size.value_int64;
+		}
+		if (mCacheSize && !(mCache = (CachedStatement*)malloc(mCacheSize * sizeof(CachedStatement)))) {
+			OutOfMemory();
+			aResultToken.result = FAIL;
+			return;
+		}
+		mDB = (sqlite3*)(size_t)val.value_int64;
+	}
+
+	// Query(sql, params*)
+	void Query(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		sqlite3_stmt* stmt = Ready() ? Prepare(*aParam[0]) : nullptr;
+		if (!stmt) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		auto set = new ResultSet;
+		bool ok = BindAll(stmt, aParam + 1, aParamCount - 1);
+		if (ok && !(ok = set->mTable.Init(stmt)))
+			OutOfMemory();
+		int rc = SQLITE_DONE;
+		while (ok && (rc = sqlite.step(stmt)) == SQLITE_ROW)
+			if (!(ok = set->mTable.AddRow(stmt)))
+				OutOfMemory();
+		if (ok && rc != SQLITE_DONE)
+			ok = Fail(rc);
+		Done(stmt);
+		if (!ok) {
+			set->Release();
+			aResultToken.result = FAIL;
+			return;
+		}
+		aResultToken.SetValue(set);
+	}
+
+	// Exec(sql, params*)
+	void Exec(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		sqlite3_stmt* stmt = Ready() ? Prepare(*aParam[0]) : nullptr;
+		if (!stmt) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		bool ok = BindAll(stmt, aParam + 1, aParamCount - 1) && Run(stmt);
+		Done(stmt);
+		if (!ok) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		aResultToken.SetValue((__int64)sqlite.changes(mDB));
+	}
+
+	// ExecMany(sql, rows)
+	// A savepoint makes the batch atomic whether or not a transaction is already open.
+	void ExecMany(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		ExprTokenType val;
+		TokenToValue(*aParam[1], val);
+		auto rows = val.symbol == SYM_OBJECT && !_tcscmp(val.object->Type(), _T("Array")) ? static_cast<Array*>(val.object) : nullptr;
+		if (!rows) {
+			Object::Error(ExprTokenType(_T("Parameter #2 must be an Array.")), nullptr, _T("TypeError"));
+			aResultToken.result = FAIL;
+			return;
+		}
+		sqlite3_stmt* stmt = Ready() ? Prepare(*aParam[0]) : nullptr;
+		if (!stmt || !ExecText("SAVEPOINT native_batch")) {
+			if (stmt)
+				Done(stmt);
+			aResultToken.result = FAIL;
+			return;
+		}
+		int count = sqlite.bind_parameter_count(stmt);
+		Arena arena(count * (sizeof(ExprTokenType) + sizeof(void*)) + 64);
+		ExprTokenType** params = arena.NewParams(count);
+		__int64 changes = 0;
+		bool ok = params || OutOfMemory();
+		for (Array::index_t r = 0; ok && r < rows->mLength; ++r) {
+			// Each row is an Array of values, or a single value.
+			auto& item = rows->mItem[r];
+			auto row = item.symbol == SYM_OBJECT && !_tcscmp(item.object->Type(), _T("Array")) ? static_cast<Array*>(item.object) : nullptr;
+			Object::Variant* values = row ? row->mItem : &item;
+			int n = row ? (int)row->mLength : 1;
+			for (int i = 0; i < n && i < count; ++i)
+				VariantToToken(values[i], *params[i]);
+			ok = n == count ? BindAll(stmt, params, count) && Run(stmt)
+				: BindAll(stmt, params, n); // Reports the mismatch.
+			if (ok)
+				changes += sqlite.changes(mDB);
+			sqlite.reset(stmt);
+		}
+		Done(stmt);
+		if (!ok) {
+			sqlite.exec(mDB, "ROLLBACK TO native_batch; RELEASE native_batch", nullptr, nullptr, nullptr);
+			aResultToken.result = FAIL;
+			return;
+		}
+		if (!ExecText("RELEASE native_batch")) {
+			aResultToken.result = FAIL;
+			return;
+		}
+		aResultToken.SetValue(changes);
+	}
+};
+
+ObjectMember Connection::sMembers[] = {
+	Object_Method(__New, __New, 0, 1, 2),
+	Object_Method(Query, Query, 0, 1, MAXP_VARIADIC),
+	Object_Method(Exec, Exec, 0, 1, MAXP_VARIADIC),
+	Object_Method(ExecMany, ExecMany, 0, 2, 2),
+	Object_Method(Close, Close, 0, 0, 0),
+};
+
+ExportSymbol symbols[] = {
+	EXPORT_CLASS(Connection, 2)
+};
+
+EXPORT_AHKMODULE(symbols)
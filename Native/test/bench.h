@@ -0,0 +1,133 @@
+#ifndef AHK2_TEST_BENCH_H
+#define AHK2_TEST_BENCH_H
+//
+// Benchmark support for the Linux build.  Each result is printed as one JSON object per line:
+//   {"bench":"types","case":"FindField","size":10000,"metric":"ns/op","value":21.5}
+// and appended to the file named by --json, so runs can be collected and compared by a script.
+// --quick shrinks the workloads, which is how ctest runs the benchmarks: as a smoke test of
+// the code paths rather than as a measurement.
+//
+// Define BENCH_COUNT_ALLOCS before including this file to count malloc calls and bytes (glibc only).
+//
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <x86intrin.h>
+#include "check.h"
+
+struct BenchOptions
+{
+	const char* name = "";
+	bool quick = false;
+	FILE* json = nullptr;
+};
+static BenchOptions sBench;
+
+static void BenchInit(int argc, char** argv, const char* aName) {
+	sBench.name = aName;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--quick"))
+			sBench.quick = true;
+		else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+			if (!(sBench.json = fopen(argv[++i], "a")))
+				fprintf(stderr, "cannot open %s\n", argv[i]);
+		}
+	}
+}
+
+static int BenchExit() {
+	if (sBench.json)
+		fclose(sBench.json);
+	return CheckExit();
+}
+
+// Picks the full size, or the small one for --quick.
+template<class T>
+static T BenchSize(T aFull, T aQuick) { return sBench.quick ? aQuick : aFull; }
+
+static void BenchReport(const char* aCase, double aSize, const char* aMetric, double aValue) {
+	char line[512];
+	snprintf(line, sizeof(line), "{\"bench\":\"%s\",\"case\":\"%s\",\"size\":%.0f,\"metric\":\"%s\",\"value\":%.6g}\n"
+		, sBench.name, aCase, aSize, aMetric, aValue);
+	fputs(line, stdout);
+	if (sBench.json)
+		fputs(line, sBench.json);
+}
+
+static double BenchNow() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs aBody aReps times and returns the fastest run, in seconds.
+template<class F>
+static double BenchTime(F&& aBody, int aReps = 3) {
+	double best = 1e300;
+	for (int i = 0; i < (sBench.quick ? 1 : aReps); ++i) {
+		double start = BenchNow();
+		aBody();
+		double elapsed = BenchNow() - start;
+		if (elapsed < best)
+			best = elapsed;
+	}
+	return best;
+}
+
+// Runs aBody aReps times and returns the fastest run, in TSC cycles.
+template<class F>
+static double BenchCycles(F&& aBody, int aReps = 3) {
+	double best = 1e300;
+	for (int i = 0; i < (sBench.quick ? 1 : aReps); ++i) {
+		unsigned long long start = __rdtsc();
+		aBody();
+		double elapsed = (double)(__rdtsc() - start);
+		if (elapsed < best)
+			best = elapsed;
+	}
+	return best;
+}
+
+// Keeps the compiler from discarding a result.
+template<class T>
+static inline void BenchKeep(const T& aValue) { asm volatile("" : : "g"(&aValue) : "memory"); }
+
+// Peak resident set size of the process, in bytes.
+static double BenchPeakRss() {
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss * 1024.0;
+}
+
+// Current resident set size of the process, in bytes.
+static double BenchRss() {
+	long pages = 0, resident = 0;
+	if (FILE* f = fopen("/proc/self/statm", "r")) {
+		if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+			resident = 0;
+		fclose(f);
+	}
+	return (double)resident * sysconf(_SC_PAGESIZE);
+}
+
+#ifdef BENCH_COUNT_ALLOCS
+extern "C" void* __libc_malloc(size_t);
+extern "C" void* __libc_calloc(size_t, size_t);
+extern "C" void* __libc_realloc(void*, size_t);
+static size_t sBenchAllocs, sBenchAllocBytes;
+static inline void BenchCountAlloc(size_t aSize) {
+	__atomic_fetch_add(&sBenchAllocs, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&sBenchAllocBytes, aSize, __ATOMIC_RELAXED);
+}
+extern "C" void* malloc(size_t aSize) noexcept { BenchCountAlloc(aSize); return __libc_malloc(aSize); }
+extern "C" void* calloc(size_t aCount, size_t aSize) noexcept { BenchCountAlloc(aCount * aSize); return __libc_calloc(aCount, aSize); }
+extern "C" void* realloc(void* aPtr, size_t aSize) noexcept { BenchCountAlloc(aSize); return __libc_realloc(aPtr, aSize); }
+// The number of allocations so far, and the bytes they asked for.
+static size_t BenchAllocs() { return __atomic_load_n(&sBenchAllocs, __ATOMIC_RELAXED); }
+static size_t BenchAllocBytes() { return __atomic_load_n(&sBenchAllocBytes, __ATOMIC_RELAXED); }
+#endif
+
+#endif // !AHK2_TEST_BENCH_H
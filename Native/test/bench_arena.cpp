@@ -0,0 +1,151 @@
+// Benchmarks of the Arena and ObjectPool allocators on a 1M-node tree: allocations per second
+// and the resident memory the tree holds, against the same nodes from malloc.  The last case
+// builds the tree from real objects, as a module returning a large object graph does, and
+// counts the malloc calls left per node.
+#define BENCH_COUNT_ALLOCS
+#include "../ahk2.cpp"
+#include "host.h"
+#include "bench.h"
+
+// A binary tree node the size of a small object header.
+struct Node
+{
+	Node* left, * right;
+	__int64 value;
+	void* pad[3];
+};
+struct PooledNode : Node
+{
+	static void* operator new(size_t aSize) noexcept { return ObjectPool::Alloc(aSize); }
+	static void operator delete(void* aPtr, size_t aSize) { ObjectPool::Free(aPtr, aSize); }
+};
+
+// Builds a complete binary tree in breadth-first order, so node i has children 2i+1 and 2i+2.
+template<class T>
+static void BuildTree(std::vector<Node*>& aNodes) {
+	for (size_t i = 0; i < aNodes.size(); ++i) {
+		Node* node = new T;
+		node->left = node->right = nullptr;
+		node->value = (__int64)i;
+		aNodes[i] = node;
+		if (i)
+			((i & 1) ? aNodes[(i - 1) / 2]->left : aNodes[(i - 1) / 2]->right) = node;
+	}
+}
+
+static __int64 SumTree(Node* aRoot) {
+	__int64 sum = 0;
+	std::vector<Node*> stack { aRoot };
+	while (!stack.empty()) {
+		Node* node = stack.back();
+		stack.pop_back();
+		sum += node->value;
+		if (node->left)
+			stack.push_back(node->left);
+		if (node->right)
+			stack.push_back(node->right);
+	}
+	return sum;
+}
+
+// Reports the build rate, the memory held per node and the rate of freeing the tree.
+template<class T>
+static void BenchTree(const char* aName, size_t aCount) {
+	char name[64];
+	std::vector<Node*> nodes(aCount);
+	malloc_trim(0);
+	double rss = BenchRss();
+	double t = BenchNow();
+	BuildTree<T>(nodes);
+	t = BenchNow() - t;
+	double held = BenchRss() - rss;
+	CHECK_EQ(SumTree(nodes[0]), (__int64)(aCount * (aCount - 1) / 2));
+	snprintf(name, sizeof(name), "%s tree build", aName);
+	BenchReport(name, (double)aCount, "allocs/s", aCount / t);
+	snprintf(name, sizeof(name), "%s tree RSS", aName);
+	BenchReport(name, (double)aCount, "bytes/node", held / aCount);
+	t = BenchNow();
+	for (Node* node : nodes)
+		delete static_cast<T*>(node);
+	t = BenchNow() - t;
+	snprintf(name, sizeof(name), "%s tree free", aName);
+	BenchReport(name, (double)aCount, "frees/s", aCount / t);
+}
+
+// The temporary data of one call: a parameter array and a string per node, released together.
+static void BenchTemporaries(size_t aCount) {
+	const size_t per_call = 64, calls = aCount / per_call;
+	malloc_trim(0);
+	double rss = BenchRss();
+	Arena arena;
+	double t = BenchTime([&] {
+		for (size_t c = 0; c < calls; ++c) {
+			ArenaScope scope(arena);
+			ExprTokenType** params = arena.NewParams(per_call);
+			for (size_t p = 0; p < per_call; ++p)
+				params[p]->SetValue(arena.Strdup(_T("parameter"), 9), 9);
+			BenchKeep(params);
+		}
+	});
+	BenchReport("Arena params + strings", (double)aCount, "allocs/s", calls * (per_call + 2) / t);
+	BenchReport("Arena params + strings RSS", (double)aCount, "MB", (BenchRss() - rss) / 1e6);
+	t = BenchTime([&] {
+		for (size_t c = 0; c < calls; ++c) {
+			auto params = (ExprTokenType**)malloc(per_call * sizeof(ExprTokenType*));
+			auto tokens = (ExprTokenType*)malloc(per_call * sizeof(ExprTokenType));
+			for (size_t p = 0; p < per_call; ++p) {
+				params[p] = tokens + p;
+				auto str = (LPTSTR)malloc(10 * sizeof(TCHAR));
+				memcpy(str, _T("parameter"), 10 * sizeof(TCHAR));
+				params[p]->SetValue(str, 9);
+			}
+			BenchKeep(params);
+			for (size_t p = 0; p < per_call; ++p)
+				free(params[p]->marker);
+			free(tokens);
+			free(params);
+		}
+	});
+	BenchReport("malloc params + strings", (double)aCount, "allocs/s", calls * (per_call + 2) / t);
+}
+
+// A tree of script objects: each node an Object with a value and up to two children.
+static void BenchObjectTree(size_t aCount) {
+	std::vector<HostObject*> nodes(aCount);
+	malloc_trim(0);
+	double rss = BenchRss();
+	size_t allocs = BenchAllocs();
+	double t = BenchNow();
+	for (auto& node : nodes)
+		node = new HostObject;
+	CHECK(BenchAllocs() - allocs < aCount / 256); // The headers come from pool chunks, not malloc.
+	for (size_t i = 0; i < aCount; ++i)
+		nodes[i]->Set(_T("value"), HostValue((__int64)i));
+	for (size_t i = aCount; --i > 0; ) {
+		nodes[(i - 1) / 2]->Set((i & 1) ? _T("left") : _T("right"), HostValue((IObject*)nodes[i]));
+		nodes[i]->Release(); // The parent holds the only reference now.
+	}
+	t = BenchNow() - t;
+	allocs = BenchAllocs() - allocs;
+	BenchReport("Object tree build", (double)aCount, "objects/s", aCount / t);
+	BenchReport("Object tree RSS", (double)aCount, "bytes/node", (BenchRss() - rss) / aCount);
+	// What is left is the host's field storage: the field array and the field names.
+	BenchReport("Object tree malloc calls", (double)aCount, "calls/node", (double)allocs / aCount);
+	HostObject* root = nodes[0];
+	CHECK(root->Get(_T("left")) && root->Get(_T("right")));
+	t = BenchNow();
+	root->Release(); // Releases the whole tree.
+	t = BenchNow() - t;
+	BenchReport("Object tree release", (double)aCount, "objects/s", aCount / t);
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "arena");
+	HostModule module;
+	size_t count = BenchSize<size_t>(1000000, 20000);
+	BenchTree<PooledNode>("ObjectPool", count);
+	BenchTree<Node>("malloc", count);
+	BenchTemporaries(count);
+	BenchObjectTree(count);
+	return BenchExit();
+}
@@ -0,0 +1,183 @@
+// Benchmarks of async.h, from 1 worker up to one per core: GB/s of BLAKE3 jobs of 256 KB each,
+// with the speedup over one worker; jobs/s of empty jobs submitted from outside the pool and
+// from running jobs (a binary tree, which the workers steal from each other); and end to end,
+// hash_file_async tasks settled per second and per message posted to the script thread.
+#include "../hash.cpp"
+#include "host.h"
+#include "bench.h"
+#include <unistd.h>
+
+// Counts jobs down to zero, for the benchmark to wait on.
+struct Batch
+{
+	std::atomic<size_t> left;
+	std::mutex lock;
+	std::condition_variable done;
+
+	Batch(size_t aCount) : left(aCount) {}
+	void Finished() {
+		if (left.fetch_sub(1) == 1) {
+			std::lock_guard<std::mutex> guard(lock);
+			done.notify_all();
+		}
+	}
+	void Wait() {
+		std::unique_lock<std::mutex> guard(lock);
+		done.wait(guard, [this] { return !left.load(); });
+	}
+};
+
+struct HashJob : AsyncJob
+{
+	const BYTE* data;
+	size_t size;
+	Batch* batch;
+	BYTE digest[32];
+
+	HashJob(const BYTE* aData, size_t aSize, Batch* aBatch) : data(aData), size(aSize), batch(aBatch) {}
+	void Run() {
+		HashState state;
+		state.algorithm = HASH_BLAKE3;
+		state.Reset();
+		state.Update(data, size);
+		state.Digest(digest);
+	}
+	void Finish() { batch->Finished(); }
+};
+
+struct EmptyJob : AsyncJob
+{
+	Batch* batch;
+	EmptyJob(Batch* aBatch) : batch(aBatch) {}
+	void Run() {}
+	void Finish() { batch->Finished(); }
+};
+
+struct TreeJob : AsyncJob
+{
+	WorkPool* pool;
+	int depth;
+	Batch* batch;
+	TreeJob(WorkPool* aPool, int aDepth, Batch* aBatch) : pool(aPool), depth(aDepth), batch(aBatch) {}
+	void Run() {
+		for (int i = 0; depth && i < 2; ++i) {
+			auto child = new TreeJob(pool, depth - 1, batch);
+			pool->Submit(child);
+			child->Release();
+		}
+	}
+	void Finish() { batch->Finished(); }
+};
+
+static void BenchWorkers(int aWorkers, const std::vector<BYTE>& aData, double& aBaseline) {
+	char name[96];
+	WorkPool pool(aWorkers);
+	const size_t job_size = 256 << 10, jobs = aData.size() / job_size;
+	double t = BenchTime([&] {
+		Batch batch(jobs);
+		for (size_t i = 0; i < jobs; ++i) {
+			auto job = new HashJob(aData.data() + i * job_size, job_size, &batch);
+			pool.Submit(job);
+			job->Release();
+		}
+		batch.Wait();
+	});
+	double rate = aData.size() / t / 1e9;
+	if (aWorkers == 1)
+		aBaseline = rate;
+	snprintf(name, sizeof(name), "blake3 jobs %d workers", aWorkers);
+	BenchReport(name, (double)job_size, "GB/s", rate);
+	snprintf(name, sizeof(name), "blake3 jobs %d workers speedup", aWorkers);
+	BenchReport(name, (double)job_size, "x", rate / aBaseline);
+
+	const size_t count = BenchSize<size_t>(1 << 20, 1 << 15);
+	t = BenchTime([&] {
+		Batch batch(count);
+		for (size_t i = 0; i < count; ++i) {
+			auto job = new EmptyJob(&batch);
+			pool.Submit(job);
+			job->Release();
+		}
+		batch.Wait();
+	});
+	snprintf(name, sizeof(name), "empty jobs %d workers", aWorkers);
+	BenchReport(name, (double)count, "Mjobs/s", count / t / 1e6);
+
+	int depth = 0;
+	while (((size_t)2 << (depth + 1)) - 1 <= count)
+		++depth;
+	size_t tree = ((size_t)2 << depth) - 1;
+	t = BenchTime([&] {
+		Batch batch(tree);
+		auto root = new TreeJob(&pool, depth, &batch);
+		pool.Submit(root);
+		root->Release();
+		batch.Wait();
+	});
+	snprintf(name, sizeof(name), "job tree %d workers", aWorkers);
+	BenchReport(name, (double)tree, "Mjobs/s", tree / t / 1e6);
+}
+
+// hash_file_async on small files, as the script would call it, with the message loop run
+// until every task has settled.
+static void BenchTasks(HostModule& aModule, const std::vector<BYTE>& aData) {
+	char path[] = "/tmp/bench_async_XXXXXX";
+	int fd = mkstemp(path);
+	const size_t size = 4096;
+	if (fd < 0 || write(fd, aData.data(), size) != (ssize_t)size)
+		return perror("bench_async"), (void)CHECK(false);
+	close(fd);
+	auto wpath = HostWiden(path);
+	const size_t count = BenchSize<size_t>(20000, 1000);
+	int messages = 0;
+	double t = BenchTime([&] {
+		std::vector<IObject*> tasks;
+		tasks.reserve(count);
+		messages = 0;
+		for (size_t i = 0; i < count; ++i) {
+			HostResult r = aModule.Call(_T("hash_file_async"), { HostValue(wpath), _T("xxh3") });
+			if (r.Obj())
+				r.Obj()->AddRef(), tasks.push_back(r.Obj());
+			if (i % 64 == 63)
+				messages += HostPumpMessages();	// As the script thread would between calls.
+		}
+		CHECK_EQ(tasks.size(), count);
+		for (IObject* task : tasks) {
+			for (;;) {
+				HostResult status;
+				task->Invoke(status, IT_GET, (LPTSTR)_T("Status"), ExprTokenType(task), nullptr, 0);
+				if (status.Str() != "pending") {
+					CHECK_EQ(status.Str(), "fulfilled");
+					break;
+				}
+				std::this_thread::yield();
+				messages += HostPumpMessages();
+			}
+			task->Release();
+		}
+	});
+	BenchReport("hash_file_async tasks", (double)size, "Ktasks/s", count / t / 1e3);
+	BenchReport("hash_file_async tasks per message", (double)size, "tasks", (double)count / (messages ? messages : 1));
+	unlink(path);
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "async");
+	HostModule module;
+	std::vector<BYTE> data(BenchSize<size_t>(256 << 20, 8 << 20));
+	for (size_t i = 0; i < data.size(); ++i)
+		data[i] = (BYTE)(i * 2654435761u >> 13);
+
+	// At least two workers, so that stealing is measured on one core too.
+	int cores = std::max((int)std::thread::hardware_concurrency(), 2);
+	double baseline = 0;
+	for (int workers = 1; ; workers *= 2) {
+		if (workers > cores)
+			workers = cores;
+		BenchWorkers(workers, data, baseline);
+		if (workers == cores)
+			break;
+	}
+	BenchTasks(module, data);
+	return BenchExit();
+}
@@ -0,0 +1,135 @@
+// Benchmarks of batched invocation (InvokeBatch, exposed as HashMap.GetMany/HasMany) against
+// one call per item.  The per-call loop here calls the member directly, so it leaves out the
+// script's own per-call dispatch and shows only what the native side saves; a script loop
+// pays more per call.  Integer and string values, and argument lists with defaults.
+#include "../hashmap.cpp"
+#include "host.h"
+#include "bench.h"
+
+static void BenchValues(HostModule& aModule, const char* aKind, IObject* aMap, size_t aSize, bool aStrings) {
+	const ObjectMember* get = aModule.Member(_T("HashMap.Prototype.Get"));
+	const ObjectMember* get_many = aModule.Member(_T("HashMap.Prototype.GetMany"));
+	const ObjectMember* has_many = aModule.Member(_T("HashMap.Prototype.HasMany"));
+	CHECK(get && get_many && has_many);
+	char name[96];
+	const size_t batches[] = { 16, 1024, 65536, 1000000 };
+	for (size_t batch : batches) {
+		if (batch > aSize)
+			break;
+		std::vector<HostValue> keys;
+		for (size_t i = 0; i < batch; ++i)
+			keys.emplace_back((__int64)((i * 7919) % aSize));
+		size_t reps = BenchSize<size_t>(4000000, 20000) / batch + 1;
+
+		__int64 sum = 0, expected = 0;
+		for (auto& key : keys)
+			expected += key.value_int64;
+		double t = BenchTime([&] {
+			sum = 0;
+			for (size_t r = 0; r < reps; ++r)
+				for (auto& key : keys) {
+					ExprTokenType* params[] = { &key };
+					HostResult result = aModule.Invoke(aMap, get, params, 1);
+					sum += aStrings ? _tcstoi64(result.marker, nullptr, 10) : result.Int();
+				}
+		});
+		CHECK_EQ(sum, expected * (__int64)reps);
+		snprintf(name, sizeof(name), "Get per call %s", aKind);
+		BenchReport(name, (double)batch, "ns/item", t * 1e9 / (reps * batch));
+
+		auto list = new HostArray;
+		list->Reserve((Object::index_t)batch);
+		for (auto& key : keys)
+			list->Push(key);
+		t = BenchTime([&] {
+			sum = 0;
+			for (size_t r = 0; r < reps; ++r) {
+				HostResult result = aModule.Invoke(aMap, get_many, { list });
+				auto arr = static_cast<Array*>(result.Obj());
+				if (!arr || arr->mLength != batch)
+					continue;
+				for (Object::index_t i = 0; i < arr->mLength; ++i)
+					sum += aStrings ? _tcstoi64(arr->mItem[i].string.Value(), nullptr, 10) : arr->mItem[i].n_int64;
+			}
+		});
+		CHECK_EQ(sum, expected * (__int64)reps);
+		snprintf(name, sizeof(name), "GetMany %s", aKind);
+		BenchReport(name, (double)batch, "ns/item", t * 1e9 / (reps * batch));
+
+		size_t found = 0;
+		t = BenchTime([&] {
+			found = 0;
+			for (size_t r = 0; r < reps; ++r) {
+				HostResult result = aModule.Invoke(aMap, has_many, { list });
+				if (auto arr = static_cast<Array*>(result.Obj()))
+					for (Object::index_t i = 0; i < arr->mLength; ++i)
+						found += (size_t)arr->mItem[i].n_int64;
+			}
+		});
+		CHECK_EQ(found, batch * reps);
+		snprintf(name, sizeof(name), "HasMany %s", aKind);
+		BenchReport(name, (double)batch, "ns/item", t * 1e9 / (reps * batch));
+
+		// [key, default] lists for keys which are all missing.
+		auto tuples = new HostArray;
+		tuples->Reserve((Object::index_t)batch);
+		for (size_t i = 0; i < batch; ++i) {
+			auto tuple = new HostArray;
+			tuple->Push(HostValue((__int64)(aSize + i)));
+			tuple->Push(HostValue((__int64)1));
+			tuples->Push(HostValue((IObject*)tuple));
+			tuple->Release();
+		}
+		t = BenchTime([&] {
+			sum = 0;
+			for (size_t r = 0; r < reps; ++r) {
+				HostResult result = aModule.Invoke(aMap, get_many, { tuples });
+				if (auto arr = static_cast<Array*>(result.Obj()))
+					for (Object::index_t i = 0; i < arr->mLength; ++i)
+						sum += arr->mItem[i].n_int64;
+			}
+		});
+		CHECK_EQ(sum, (__int64)(batch * reps));
+		snprintf(name, sizeof(name), "GetMany with defaults %s", aKind);
+		BenchReport(name, (double)batch, "ns/item", t * 1e9 / (reps * batch));
+		tuples->Release();
+		list->Release();
+	}
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "batch");
+	HostModule module;
+	const ObjectMember* set = module.Member(_T("HashMap.Prototype.Set"));
+	size_t size = BenchSize<size_t>(1000000, 1024);
+	for (int strings = 0; strings < 2; ++strings) {
+		IObject* map = module.New(_T("HashMap"));
+		CHECK(map && set);
+		if (!map || !set)
+			break;
+		char buf[32];
+		for (size_t i = 0; i < size; ++i) {
+			snprintf(buf, sizeof(buf), "%zu", i);
+			auto text = HostWiden(buf);
+			if (strings)
+				module.Invoke(map, set, { (__int64)i, text });
+			else module.Invoke(map, set, { (__int64)i, (__int64)i });
+		}
+		BenchValues(module, strings ? "string" : "int", map, size, strings);
+		// An argument list with the wrong number of arguments fails the whole batch.
+		for (int count : { 0, 3 }) {
+			auto bad = new HostArray, args = new HostArray;
+			for (int i = 0; i < count; ++i)
+				args->Push(HostValue((__int64)i));
+			bad->Push(HostValue((__int64)0));
+			bad->Push(HostValue((IObject*)args));
+			HostResult r = module.Invoke(map, _T("HashMap.Prototype.GetMany"), { bad });
+			CHECK(r.Failed() && sHostError.count == 1);
+			CHECK_EQ(sHostError.message, count ? "Too many parameters passed to function." : "Too few parameters passed to function.");
+			args->Release();
+			bad->Release();
+		}
+		map->Release();
+	}
+	return BenchExit();
+}
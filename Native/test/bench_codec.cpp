@@ -0,0 +1,129 @@
+// Benchmarks of codec.cpp and its simd.h kernels, in GB/s of binary data: Base64 and hex encode
+// and decode for each path (AVX2, SSSE3 and scalar), then the module's functions from a Buffer
+// and to or from a String, which is narrowed or widened in chunks.  Every path must produce the
+// same output as the scalar one.
+#include "../codec.cpp"
+#include "host.h"
+#include "bench.h"
+#include <random>
+
+struct CodecPath
+{
+	const char* name;
+	int needs;
+	Base64EncodeType base64_encode;
+	Base64DecodeType base64_decode;
+	HexEncodeType hex_encode;
+	HexDecodeType hex_decode;
+};
+static const CodecPath sPaths[] = {
+	{ "avx2", CPU_AVX2, Base64Encode_AVX2, Base64Decode_AVX2, HexEncode_AVX2, HexDecode_AVX2 },
+	{ "ssse3", CPU_SSSE3, Base64Encode_SSSE3, Base64Decode_SSSE3, HexEncode_SSSE3, HexDecode_SSSE3 },
+	{ "scalar", 0, Base64Encode_Scalar, Base64Decode_Scalar, HexEncode_Scalar, HexDecode_Scalar },
+};
+
+static void BenchKernels(const std::vector<BYTE>& aData) {
+	size_t size = aData.size();
+	std::string base64(size / 3 * 4, 0), hex(size * 2, 0), expected64(base64.size(), 0), expected_hex(hex.size(), 0);
+	std::vector<BYTE> decoded(size + 3);
+	Base64Encode_Scalar(aData.data(), size, expected64.data(), false);
+	HexEncode_Scalar(aData.data(), size, expected_hex.data(), false);
+	size_t reps = (64 << 20) / size + 1;
+	char name[96];
+	for (auto& path : sPaths) {
+		if ((CpuFeatures() & path.needs) != path.needs)
+			continue;
+		double t = BenchTime([&] {
+			for (size_t r = 0; r < reps; ++r)
+				path.base64_encode(aData.data(), size, base64.data(), false);
+		});
+		CHECK(base64 == expected64);
+		snprintf(name, sizeof(name), "base64 encode %s", path.name);
+		BenchReport(name, (double)size, "GB/s", size * reps / t / 1e9);
+
+		BYTE* end = nullptr;
+		t = BenchTime([&] {
+			for (size_t r = 0; r < reps; ++r) {
+				Base64State state;
+				end = path.base64_decode(expected64.data(), expected64.data() + expected64.size(), decoded.data(), state);
+			}
+		});
+		CHECK(end == decoded.data() + size / 3 * 3 && !memcmp(decoded.data(), aData.data(), size / 3 * 3));
+		snprintf(name, sizeof(name), "base64 decode %s", path.name);
+		BenchReport(name, (double)size, "GB/s", size * reps / t / 1e9);
+
+		t = BenchTime([&] {
+			for (size_t r = 0; r < reps; ++r)
+				path.hex_encode(aData.data(), size, hex.data(), false);
+		});
+		CHECK(hex == expected_hex);
+		snprintf(name, sizeof(name), "hex encode %s", path.name);
+		BenchReport(name, (double)size, "GB/s", size * reps / t / 1e9);
+
+		bool ok = true;
+		t = BenchTime([&] {
+			for (size_t r = 0; r < reps; ++r)
+				ok &= path.hex_decode(expected_hex.data(), size, decoded.data());
+		});
+		CHECK(ok && !memcmp(decoded.data(), aData.data(), size));
+		snprintf(name, sizeof(name), "hex decode %s", path.name);
+		BenchReport(name, (double)size, "GB/s", size * reps / t / 1e9);
+	}
+}
+
+// The module's functions, as a script calls them: from a Buffer, and to or from a String.
+static void BenchModule(HostModule& aModule, const std::vector<BYTE>& aData) {
+	size_t size = aData.size();
+	auto buf = new HostBuffer(size);
+	memcpy(buf->mData, aData.data(), size);
+	size_t reps = (16 << 20) / size + 1;
+	char name[96];
+	struct { const char* name; LPCTSTR encode, decode; } codecs[] = {
+		{ "base64", _T("base64_encode"), _T("base64_decode") }, { "hex", _T("hex_encode"), _T("hex_decode") } };
+	for (auto& codec : codecs) {
+		for (int as_buffer = 1; as_buffer >= 0; --as_buffer) {
+			const char* kind = as_buffer ? "Buffer" : "String";
+			double t = BenchTime([&] {
+				for (size_t r = 0; r < reps; ++r)
+					HostResult encoded = aModule.Call(codec.encode, { (IObject*)buf, 0, as_buffer });
+			});
+			snprintf(name, sizeof(name), "%s_encode to %s", codec.name, kind);
+			BenchReport(name, (double)size, "GB/s", size * reps / t / 1e9);
+
+			HostResult encoded = aModule.Call(codec.encode, { (IObject*)buf, 0, as_buffer });
+			CHECK(!encoded.Failed());
+			HostValue text = as_buffer ? HostValue(encoded.Obj()) : HostValue(encoded.marker, encoded.marker_length);
+			bool ok = true;
+			t = BenchTime([&] {
+				for (size_t r = 0; r < reps; ++r) {
+					HostResult decoded = aModule.Call(codec.decode, { text });
+					auto out = static_cast<BufferObject*>(decoded.Obj());
+					ok &= out && out->mSize == size;
+				}
+			});
+			HostResult decoded = aModule.Call(codec.decode, { text });
+			auto out = static_cast<BufferObject*>(decoded.Obj());
+			CHECK(ok && out && !memcmp(out->mData, aData.data(), size));
+			snprintf(name, sizeof(name), "%s_decode from %s", codec.name, kind);
+			BenchReport(name, (double)size, "GB/s", size * reps / t / 1e9);
+		}
+	}
+	buf->Release();
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "codec");
+	HostModule module;
+	std::mt19937 random(13);
+	const size_t sizes[] = { 96, 4096, 1 << 20, 64 << 20 };
+	for (size_t size : sizes) {
+		if (sBench.quick && size > (1 << 20))
+			break;
+		std::vector<BYTE> data(size);
+		for (BYTE& b : data)
+			b = (BYTE)random();
+		BenchKernels(data);
+		BenchModule(module, data);
+	}
+	return BenchExit();
+}
@@ -0,0 +1,223 @@
+// Benchmarks of compress.cpp: MB/s of payload and allocations per request for zstd and gzip at
+// 1 KB, 64 KB and 10 MB, compressing and decompressing as HttpServer would, fed in 16 KB pieces
+// through one reused Compressor or Decompressor, against encode and decode of the whole body and
+// a new context per request.  Each Update returns a Buffer, so the streamed cases allocate per
+// piece; the new-context case drives CompressStream directly into one output, so what it adds
+// is the context's setup.  Then small JSON responses with and without a zstd dictionary.
+// A format whose library is not installed is skipped.
+#define BENCH_COUNT_ALLOCS
+#include "../compress.cpp"
+#include "host.h"
+#include "bench.h"
+#include <random>
+
+// The size of each piece passed to Update, as on_read_body and send_body deliver them.
+#define PIECE_SIZE 0x4000
+
+static const LPCTSTR sFormatNames[] = { _T("zstd"), _T("gzip") };
+
+// JSON-like text, compressible about as well as an API response.
+static std::string JsonText(std::mt19937& aRandom, size_t aSize) {
+	static const char* const words[] = { "{\"id\":", "\"name\":\"", "alpha", "beta", "\",", "}", "[", "]",
+		"\"value\":", "\"enabled\":true,", "null", "\"tags\":[\"x\",\"y\"]," };
+	std::string text;
+	while (text.size() < aSize) {
+		text += words[aRandom() % _countof(words)];
+		if (aRandom() % 4 == 0)
+			text += std::to_string(aRandom() % 100000);
+	}
+	text.resize(aSize);
+	return text;
+}
+
+static std::string BufferBytes(IObject* aObj) {
+	auto buf = static_cast<BufferObject*>(aObj);
+	return buf ? std::string((const char*)buf->mData, buf->mSize) : std::string();
+}
+
+// Calls aMember of aObj on the bytes at aData, passed by address and size so that the host
+// adds no allocations of its own.
+static HostResult InvokeBytes(HostModule& aModule, IObject* aObj, const ObjectMember* aMember, const void* aData, size_t aSize) {
+	HostValue args[] = { (__int64)(size_t)aData, (__int64)aSize };
+	ExprTokenType* params[] = { &args[0], &args[1] };
+	return aModule.Invoke(aObj, aMember, params, aSize ? 2 : 0);
+}
+
+// Streams aData through aStream (a Compressor or Decompressor) in pieces, returning the output.
+static std::string Stream(HostModule& aModule, IObject* aStream, const ObjectMember* aUpdate, const ObjectMember* aFinish,
+	const std::string& aData, bool aKeep = true) {
+	std::string out;
+	size_t pos = 0;
+	for (; aData.size() - pos > PIECE_SIZE; pos += PIECE_SIZE) {
+		HostResult r = InvokeBytes(aModule, aStream, aUpdate, aData.data() + pos, PIECE_SIZE);
+		CHECK(!r.Failed());
+		if (aKeep)
+			out += BufferBytes(r.Obj());
+	}
+	HostResult r = InvokeBytes(aModule, aStream, aFinish, aData.data() + pos, aData.size() - pos);
+	CHECK(!r.Failed());
+	if (aKeep)
+		out += BufferBytes(r.Obj());
+	return out;
+}
+
+// One-shot encode or decode of the whole of aData.
+static HostResult OneShotCall(BuiltInFunctionType aFunc, const std::string& aData, int aFormat) {
+	HostResult result;
+	HostValue args[] = { (__int64)(size_t)aData.data(), (__int64)aData.size(), sFormatNames[aFormat] };
+	ExprTokenType* params[] = { &args[0], &args[1], &args[2] };
+	sHostError.Clear();
+	aFunc(result, params, 3);
+	return result;
+}
+
+// A new context for each request, set up and freed around it.
+static std::string NewContext(int aFormat, bool aCompress, const std::string& aData) {
+	CompressStream stream;
+	StreamOutput out;
+	HostResult result;
+	size_t pos = 0;
+	bool ok = stream.Init(aFormat, aCompress, LEVEL_DEFAULT, nullptr, 0, result);
+	for (; ok && aData.size() - pos > PIECE_SIZE; pos += PIECE_SIZE)
+		ok = stream.Update((const BYTE*)aData.data() + pos, PIECE_SIZE, out, result);
+	ok = ok && stream.Finish((const BYTE*)aData.data() + pos, aData.size() - pos, out, result);
+	CHECK(ok);
+	return ok ? std::string((const char*)out.buf->mData, out.length) : std::string();
+}
+
+// Times aRequest, which handles one payload of aSize bytes, reporting MB/s and allocations per request.
+template<class F>
+static void BenchRequests(const char* aCase, size_t aSize, F aRequest) {
+	char name[96];
+	size_t reps = BenchSize<size_t>(16 << 20, 1 << 20) / aSize + 1, requests = 0, allocs = BenchAllocs();
+	double t = BenchTime([&] {
+		for (size_t r = 0; r < reps; ++r)
+			aRequest(), ++requests;
+	});
+	allocs = BenchAllocs() - allocs;
+	BenchReport(aCase, (double)aSize, "MB/s", aSize * reps / t / 1e6);
+	snprintf(name, sizeof(name), "%s allocs", aCase);
+	BenchReport(name, (double)aSize, "allocs/request", (double)allocs / requests);
+}
+
+static void BenchFormat(HostModule& aModule, int aFormat, const std::string& aData) {
+	const char* format = aFormat == FORMAT_ZSTD ? "zstd" : "gzip";
+	char name[96];
+	size_t size = aData.size();
+	IObject* compressor = aModule.New(_T("Compressor"), { sFormatNames[aFormat] });
+	IObject* decompressor = aModule.New(_T("Decompressor"), { sFormatNames[aFormat] });
+	const ObjectMember* compress_update = aModule.Member(_T("Compressor.Prototype.Update"));
+	const ObjectMember* compress_finish = aModule.Member(_T("Compressor.Prototype.Finish"));
+	const ObjectMember* decompress_update = aModule.Member(_T("Decompressor.Prototype.Update"));
+	const ObjectMember* decompress_finish = aModule.Member(_T("Decompressor.Prototype.Finish"));
+	BuiltInFunctionType encode = aModule.Func(_T("encode")), decode = aModule.Func(_T("decode"));
+
+	// Every way round must decode to the payload, and the streamed output must match one-shot
+	// decoding of it.
+	std::string packed = Stream(aModule, compressor, compress_update, compress_finish, aData);
+	CHECK(Stream(aModule, decompressor, decompress_update, decompress_finish, packed) == aData);
+	HostResult whole = OneShotCall(encode, aData, aFormat);
+	std::string whole_packed = BufferBytes(whole.Obj());
+	HostResult unpacked = OneShotCall(decode, packed, aFormat);
+	CHECK(BufferBytes(unpacked.Obj()) == aData);
+	CHECK(NewContext(aFormat, false, whole_packed) == aData);
+	CHECK(NewContext(aFormat, false, NewContext(aFormat, true, aData)) == aData);
+	snprintf(name, sizeof(name), "%s ratio", format);
+	BenchReport(name, (double)size, "x", (double)size / packed.size());
+
+	snprintf(name, sizeof(name), "%s compress reused context", format);
+	BenchRequests(name, size, [&] { Stream(aModule, compressor, compress_update, compress_finish, aData, false); });
+	snprintf(name, sizeof(name), "%s compress new context", format);
+	BenchRequests(name, size, [&] { BenchKeep(NewContext(aFormat, true, aData).size()); });
+	snprintf(name, sizeof(name), "%s encode", format);
+	BenchRequests(name, size, [&] { OneShotCall(encode, aData, aFormat); });
+
+	snprintf(name, sizeof(name), "%s decompress reused context", format);
+	BenchRequests(name, size, [&] { Stream(aModule, decompressor, decompress_update, decompress_finish, packed, false); });
+	snprintf(name, sizeof(name), "%s decompress new context", format);
+	BenchRequests(name, size, [&] { BenchKeep(NewContext(aFormat, false, packed).size()); });
+	snprintf(name, sizeof(name), "%s decode", format);
+	BenchRequests(name, size, [&] { OneShotCall(decode, packed, aFormat); });
+
+	compressor->Release();
+	decompressor->Release();
+}
+
+// Small JSON responses, each its own frame, with a dictionary of earlier responses and without.
+static void BenchDictionary(HostModule& aModule, std::mt19937& aRandom) {
+	const size_t size = 1024, count = 64;
+	auto dict = new HostBuffer(64 << 10);
+	std::string samples = JsonText(aRandom, dict->mSize);
+	memcpy(dict->mData, samples.data(), samples.size());
+	std::vector<std::string> responses;
+	for (size_t i = 0; i < count; ++i)
+		responses.push_back(JsonText(aRandom, size));
+
+	const ObjectMember* compress_update = aModule.Member(_T("Compressor.Prototype.Update"));
+	const ObjectMember* compress_finish = aModule.Member(_T("Compressor.Prototype.Finish"));
+	const ObjectMember* decompress_update = aModule.Member(_T("Decompressor.Prototype.Update"));
+	const ObjectMember* decompress_finish = aModule.Member(_T("Decompressor.Prototype.Finish"));
+	for (int with = 0; with < 2; ++with) {
+		const char* kind = with ? "with dictionary" : "without dictionary";
+		char name[96];
+		IObject* compressor = with ? aModule.New(_T("Compressor"), { _T("zstd"), HostValue::Missing(), (IObject*)dict })
+			: aModule.New(_T("Compressor"), { _T("zstd") });
+		IObject* decompressor = with ? aModule.New(_T("Decompressor"), { _T("zstd"), (IObject*)dict })
+			: aModule.New(_T("Decompressor"), { _T("zstd") });
+		CHECK(compressor && decompressor);
+		if (!compressor || !decompressor)
+			break;
+		std::vector<std::string> packed;
+		size_t total = 0;
+		for (auto& response : responses) {
+			packed.push_back(Stream(aModule, compressor, compress_update, compress_finish, response));
+			total += packed.back().size();
+			CHECK(Stream(aModule, decompressor, decompress_update, decompress_finish, packed.back()) == response);
+		}
+		snprintf(name, sizeof(name), "zstd json %s ratio", kind);
+		BenchReport(name, (double)size, "x", (double)size * count / total);
+		size_t next = 0;
+		snprintf(name, sizeof(name), "zstd json compress %s", kind);
+		BenchRequests(name, size, [&] {
+			Stream(aModule, compressor, compress_update, compress_finish, responses[next++ % count], false);
+		});
+		snprintf(name, sizeof(name), "zstd json decompress %s", kind);
+		BenchRequests(name, size, [&] {
+			Stream(aModule, decompressor, decompress_update, decompress_finish, packed[next++ % count], false);
+		});
+		compressor->Release();
+		decompressor->Release();
+	}
+	// Without the dictionary, a frame which refers to it fails rather than decoding to garbage.
+	IObject* compressor = aModule.New(_T("Compressor"), { _T("zstd"), HostValue::Missing(), (IObject*)dict });
+	HostResult packed = InvokeBytes(aModule, compressor, compress_finish, responses[0].data(), size);
+	HostResult plain = aModule.Call(_T("decode"), { packed.Obj() });
+	CHECK(plain.Failed() && sHostError.type == "Error");
+	compressor->Release();
+	dict->Release();
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "compress");
+	HostModule module;
+	std::mt19937 random(16);
+	bool loaded[_countof(sFormatNames)];
+	for (int f = 0; f < (int)_countof(sFormatNames); ++f) {
+		HostResult r = module.Call(_T("encode"), { _T(""), HostValue::Missing(), sFormatNames[f] });
+		loaded[f] = !r.Failed();
+		if (!loaded[f])
+			fprintf(stderr, "skipped %s: %s\n", HostNarrow(sFormatNames[f]).c_str(), sHostError.message.c_str());
+	}
+	const size_t sizes[] = { 1 << 10, 64 << 10, 10 << 20 };
+	for (size_t size : sizes) {
+		if (sBench.quick && size > (64 << 10))
+			break;
+		std::string data = JsonText(random, size);
+		for (int f = 0; f < (int)_countof(sFormatNames); ++f)
+			if (loaded[f])
+				BenchFormat(module, f, data);
+	}
+	if (loaded[FORMAT_ZSTD])
+		BenchDictionary(module, random);
+	return BenchExit();
+}
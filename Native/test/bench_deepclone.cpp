@@ -0,0 +1,226 @@
+// Benchmarks of deepclone.cpp on generated graphs of about 500k nodes, from wide and shallow to
+// narrow and deep, and a chain 100k deep: nodes/s for deepclone, deepEqual of the clone (and of
+// a clone with one leaf changed) and deepHash, against deepclone.ahk's recursive walk with a
+// Type() switch per node and a Map keyed on ObjPtr, reproduced here in C++ with a hash map, so
+// it is a lower bound on the script's cost.  Nodes are Objects, Arrays and Maps, with a Buffer
+// now and then, and leaves share a few objects, which must be cloned once each.
+#include "../deepclone.cpp"
+#include "host.h"
+#include "bench.h"
+#include <unordered_map>
+#include <cmath>
+
+static IObject* sShared[16];
+
+// A tree aDepth levels below this node, each with aWidth children.  Levels alternate between
+// Objects, Arrays and Maps; a leaf is an Object of a few scalars, or now and then a Buffer.
+static IObject* Generate(int aDepth, int aWidth, size_t& aNodes) {
+	size_t id = aNodes++;
+	if (!aDepth) {
+		if (id % 64 == 63) {
+			auto buf = new HostBuffer(32);
+			memset(buf->mData, (int)id, 32);
+			return buf;
+		}
+		auto leaf = new HostObject;
+		leaf->Set(_T("id"), HostValue((__int64)id));
+		leaf->Set(_T("name"), HostValue(_T("leaf")));
+		leaf->Set(_T("score"), HostValue(id * 0.25));
+		leaf->Set(_T("shared"), HostValue(sShared[id % _countof(sShared)]));
+		return leaf;
+	}
+	switch (aDepth % 3)
+	{
+	case 0: {
+		auto obj = new HostObject;
+		obj->Set(_T("depth"), HostValue(aDepth));
+		TCHAR name[16];
+		for (int i = 0; i < aWidth; ++i) {
+			_stprintf_s(name, _countof(name), _T("c%d"), i);
+			IObject* child = Generate(aDepth - 1, aWidth, aNodes);
+			obj->Set(name, HostValue(child));
+			child->Release();
+		}
+		return obj;
+	}
+	case 1: {
+		auto arr = new HostArray;
+		arr->Reserve(aWidth);
+		for (int i = 0; i < aWidth; ++i) {
+			IObject* child = Generate(aDepth - 1, aWidth, aNodes);
+			arr->Push(HostValue(child));
+			child->Release();
+		}
+		return arr;
+	}
+	default: {
+		auto map = new HostMap;
+		for (int i = 0; i < aWidth; ++i) {
+			IObject* child = Generate(aDepth - 1, aWidth, aNodes);
+			map->Set(HostValue(i), HostValue(child));
+			child->Release();
+		}
+		return map;
+	}
+	}
+}
+
+// deepclone.ahk: Clone() each Object, Array and Map, then replace the values which are objects
+// with their clones, recursing; a Map of ObjPtr to clone stops it cloning one object twice.
+static IObject* ScriptClone(IObject* aObj, std::unordered_map<IObject*, IObject*>& aClones) {
+	auto seen = aClones.find(aObj);
+	if (seen != aClones.end()) {
+		seen->second->AddRef();
+		return seen->second;
+	}
+	NodeKind kind = KindOf(aObj);
+	if (kind == NODE_OTHER) {
+		aObj->AddRef();
+		return aObj;
+	}
+	IObject* clone = ShallowClone(aObj, kind);
+	aClones[aObj] = clone;
+	Slots slots(clone, kind);
+	for (Object::index_t i = 0; i < slots.count; ++i) {
+		auto& slot = slots[i];
+		if (slot.symbol != SYM_OBJECT)
+			continue;
+		IObject* child = ScriptClone(slot.object, aClones);
+		slot.object->Release();
+		slot.object = child;
+	}
+	return clone;
+}
+
+// The first leaf Object of a graph, found by following the first object of each node.
+static HostObject* FirstLeaf(IObject* aObj) {
+	for (;;) {
+		NodeKind kind = KindOf(aObj);
+		if (kind == NODE_OTHER || kind == NODE_BUFFER)
+			return nullptr;
+		Slots slots(aObj, kind);
+		IObject* next = nullptr;
+		for (Object::index_t i = 0; i < slots.count && !next; ++i)
+			if (slots[i].symbol == SYM_OBJECT && KindOf(slots[i].object) != NODE_OTHER)
+				next = slots[i].object;
+		if (!next)
+			return kind == NODE_OBJECT ? static_cast<HostObject*>(aObj) : nullptr;
+		aObj = next;
+	}
+}
+
+static void BenchGraph(HostModule& aModule, const char* aCase, IObject* aRoot, size_t aNodes, bool aBaseline) {
+	char name[96];
+	// Each clone is kept until the last is timed, so that freeing one is not timed with the next.
+	std::vector<IObject*> clones;
+	double t = BenchTime([&] {
+		HostResult r = aModule.Call(_T("deepclone"), { aRoot });
+		if (IObject* obj = r.Obj()) {
+			obj->AddRef();
+			clones.push_back(obj);
+		}
+	});
+	for (size_t i = 1; i < clones.size(); ++i)
+		clones[i - 1]->Release();
+	IObject* clone = clones.empty() ? nullptr : clones.back();
+	snprintf(name, sizeof(name), "deepclone %s", aCase);
+	BenchReport(name, (double)aNodes, "Mnodes/s", aNodes / t / 1e6);
+	CHECK(clone && clone != aRoot);
+	HostObject* leaf = FirstLeaf(aRoot), * cloned_leaf = clone ? FirstLeaf(clone) : nullptr;
+	CHECK(leaf && cloned_leaf && leaf != cloned_leaf);
+	// The shared objects are not cloned, being of no kind the module clones.
+	if (leaf && cloned_leaf && leaf->Get(_T("shared")))
+		CHECK(cloned_leaf->Get(_T("shared"))->object == leaf->Get(_T("shared"))->object);
+
+	__int64 equal = 0;
+	t = BenchTime([&] { equal = aModule.Call(_T("deepEqual"), { aRoot, clone }).Int(); });
+	CHECK_EQ(equal, 1);
+	snprintf(name, sizeof(name), "deepEqual %s", aCase);
+	BenchReport(name, (double)aNodes, "Mnodes/s", aNodes / t / 1e6);
+
+	__int64 hash = 0, clone_hash = aModule.Call(_T("deepHash"), { clone }).Int();
+	t = BenchTime([&] { hash = aModule.Call(_T("deepHash"), { aRoot }).Int(); });
+	CHECK_EQ(hash, clone_hash);
+	snprintf(name, sizeof(name), "deepHash %s", aCase);
+	BenchReport(name, (double)aNodes, "Mnodes/s", aNodes / t / 1e6);
+
+	// One changed leaf, reached first, and the hash which must then differ.
+	if (cloned_leaf) {
+		cloned_leaf->Set(_T("score"), HostValue(-1.0));
+		CHECK_EQ(aModule.Call(_T("deepEqual"), { aRoot, clone }).Int(), 0);
+		CHECK(aModule.Call(_T("deepHash"), { clone }).Int() != hash);
+	}
+	if (clone)
+		clone->Release();
+
+	if (!aBaseline)
+		return;
+	clones.clear();
+	t = BenchTime([&] {
+		std::unordered_map<IObject*, IObject*> seen;
+		clones.push_back(ScriptClone(aRoot, seen));
+	});
+	for (IObject* obj : clones)
+		obj->Release();
+	snprintf(name, sizeof(name), "deepclone.ahk walk %s", aCase);
+	BenchReport(name, (double)aNodes, "Mnodes/s", aNodes / t / 1e6);
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "deepclone");
+	HostModule module;
+	for (auto& shared : sShared)
+		shared = new HostObject((LPTSTR)_T("Config"));
+	struct { int depth, width; } shapes[] = { { 2, 700 }, { 4, 26 }, { 6, 9 }, { 9, 4 }, { 18, 2 } };
+	char name[64];
+	for (auto& shape : shapes) {
+		int depth = shape.depth, width = shape.width;
+		if (sBench.quick) { // About 5k nodes.
+			depth = std::min(depth, 12);
+			width = std::max(2, (int)round(pow(5000.0, 1.0 / depth)));
+		}
+		size_t nodes = 0;
+		IObject* root = Generate(depth, width, nodes);
+		snprintf(name, sizeof(name), "depth %d width %d", depth, width);
+		BenchGraph(module, name, root, nodes, true);
+		root->Release();
+	}
+
+	// A chain deeper than any recursive walk could go on the native stack.
+	size_t depth = BenchSize<size_t>(100000, 5000);
+	IObject* chain = new HostObject;
+	for (size_t i = 1; i < depth; ++i) {
+		auto node = new HostObject;
+		node->Set(_T("id"), HostValue((__int64)i));
+		node->Set(_T("next"), HostValue(chain));
+		chain->Release();
+		chain = node;
+	}
+	snprintf(name, sizeof(name), "chain %zu", depth);
+	BenchGraph(module, name, chain, depth, false);
+	// Each node is released by the one before, recursively, so the chain is taken apart first.
+	for (IObject* node = chain; node; ) {
+		auto next = static_cast<HostObject*>(node)->Get(_T("next"));
+		IObject* child = next ? next->object : nullptr;
+		if (child) {
+			child->AddRef();
+			static_cast<HostObject*>(node)->Set(_T("next"), HostValue(0));
+		}
+		node->Release();
+		node = child;
+	}
+
+	// A cycle is cloned as a cycle, and compares equal to the original.
+	auto a = new HostObject;
+	auto b = new HostArray;
+	b->Push(HostValue((IObject*)a));
+	a->Set(_T("b"), HostValue((IObject*)b));
+	HostResult clone = module.Call(_T("deepclone"), { (IObject*)a });
+	auto ca = static_cast<HostObject*>(clone.Obj());
+	auto cb = ca ? static_cast<HostArray*>(ca->Get(_T("b"))->object) : nullptr;
+	CHECK(ca && ca != a && cb && cb != b && cb->mItem[0].object == ca);
+	CHECK_EQ(module.Call(_T("deepEqual"), { (IObject*)a, clone.Obj() }).Int(), 1);
+	b->Release();
+	a->Release();
+	return BenchExit();
+}
@@ -0,0 +1,106 @@
+// Benchmarks of FieldIndex on wide objects (10k to 100k fields): FindField by binary search
+// against FindField through an attached index, for hits, case-folded hits and misses, plus
+// the cost of a rebuild and of lookups interleaved with adds (the stale path).
+#include "../ahk2.cpp"
+#include "host.h"
+#include "bench.h"
+#include <algorithm>
+#include <random>
+
+static std::mt19937_64 sRandom(3);
+
+static std::vector<TCHAR> Name(const char* aPrefix, size_t aNumber) {
+	char name[32];
+	snprintf(name, sizeof(name), "%s%zu", aPrefix, aNumber);
+	return HostWiden(name);
+}
+
+// Sums the values of the fields named in aOrder, timing the lookups.
+static double TimeLookups(HostObject* aObj, std::vector<LPTSTR>& aOrder, __int64& aSum) {
+	return BenchTime([&] {
+		aSum = 0;
+		for (auto name : aOrder)
+			if (auto field = aObj->FindField(name))
+				aSum += field->n_int64;
+	});
+}
+
+static void BenchObject(size_t aSize) {
+	// Scattered numbers, so the names do not sort in creation order.
+	std::vector<std::vector<TCHAR>> names, upper, missing;
+	for (size_t i = 0; i < aSize; ++i) {
+		size_t n = i * 7919 % 1000003;
+		names.push_back(Name("Key", n));
+		upper.push_back(Name("KEY", n));
+		missing.push_back(Name("Other", n));
+	}
+	auto obj = new HostObject;
+	for (size_t i = 0; i < aSize; ++i)
+		obj->Set(names[i].data(), HostValue((__int64)i));
+	CHECK_EQ((size_t)obj->mFields.Length(), aSize);
+
+	const size_t lookups = BenchSize<size_t>(2000000, 20000);
+	std::vector<LPTSTR> hits, folded, misses;
+	__int64 expected = 0;
+	for (size_t i = 0; i < lookups; ++i) {
+		size_t k = sRandom() % aSize;
+		hits.push_back(names[k].data());
+		folded.push_back(upper[k].data());
+		misses.push_back(missing[k].data());
+		expected += (__int64)k;
+	}
+
+	__int64 sum;
+	double t = TimeLookups(obj, hits, sum);
+	CHECK_EQ(sum, expected);
+	BenchReport("binary search hit", (double)aSize, "ns/op", t * 1e9 / lookups);
+	t = TimeLookups(obj, misses, sum);
+	CHECK_EQ(sum, 0);
+	BenchReport("binary search miss", (double)aSize, "ns/op", t * 1e9 / lookups);
+
+	t = BenchTime([&] {
+		FieldIndex index(obj);
+		BenchKeep(index);
+	});
+	BenchReport("FieldIndex build", (double)aSize, "ns/field", t * 1e9 / aSize);
+
+	FieldIndex index(obj);
+	t = TimeLookups(obj, hits, sum);
+	CHECK_EQ(sum, expected);
+	BenchReport("FieldIndex hit", (double)aSize, "ns/op", t * 1e9 / lookups);
+	t = TimeLookups(obj, folded, sum);
+	CHECK_EQ(sum, expected);
+	BenchReport("FieldIndex case-folded hit", (double)aSize, "ns/op", t * 1e9 / lookups);
+	t = TimeLookups(obj, misses, sum);
+	CHECK_EQ(sum, 0);
+	BenchReport("FieldIndex miss", (double)aSize, "ns/op", t * 1e9 / lookups);
+
+	// Each add moves or resizes the fields behind the index's back; lookups in between must
+	// stay correct and must not rebuild every time.
+	const size_t adds = BenchSize<size_t>(2000, 200);
+	std::vector<std::vector<TCHAR>> added;
+	for (size_t i = 0; i < adds; ++i)
+		added.push_back(Name("Added", i));
+	size_t found = 0;
+	t = BenchTime([&] {
+		for (size_t i = 0; i < adds; ++i) {
+			obj->Set(added[i].data(), HostValue((__int64)i));
+			for (size_t j = 0; j < 8; ++j)
+				found += obj->FindField(hits[(i * 8 + j) % lookups]) != nullptr;
+			found += obj->FindField(added[i].data()) != nullptr;
+		}
+	}, 1);
+	CHECK_EQ(found, adds * 9);
+	BenchReport("FieldIndex add + 9 lookups", (double)aSize, "ns/op", t * 1e9 / adds);
+	index.Detach();
+	obj->Release();
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "fieldindex");
+	HostModule module;
+	const size_t sizes[] = { 10000, 30000, 100000 };
+	for (size_t size : sizes)
+		BenchObject(sBench.quick ? size / 10 : size);
+	return BenchExit();
+}
@@ -0,0 +1,295 @@
+// Benchmarks of FrameDiff in imagesearch.cpp, replaying sequences of 32bpp frames: synthetic
+// ones of a desktop at 720p to 4K (an idle cursor, typing, a window being dragged, a video
+// playing and a page scrolling), or a recording given as --frames file, which holds Int width,
+// height and bytespixel followed by the raw frames, top-down and unpadded.  Reports ms per
+// Update for tiles of 16, 32 and 64 pixels and the share of tiles found dirty, against
+// comparing with a copy of the previous frame as waitScreenChange does; then the tile hash of
+// each path (AVX2, SSE2 and scalar) in GB/s, and findColor over the whole frame against only
+// its dirty tiles.  The dirty tiles must be exactly those whose pixels changed.
+#include "../imagesearch.cpp"
+#include "host.h"
+#include "bench.h"
+
+static UINT PixelNoise(UINT aX, UINT aY, UINT aSeed) {
+	UINT h = aX * 0x9E3779B1u ^ aY * 0x85EBCA77u ^ aSeed * 0xC2B2AE3Du;
+	h ^= h >> 15, h *= 0x2C1B3C6Du, h ^= h >> 12;
+	return h;
+}
+
+// The frame being replayed, and the info Buffer describing it.
+struct Frame
+{
+	std::vector<BYTE> pixels;
+	BitmapInfo bmp;
+	HostBuffer* info;
+
+	Frame(int aWidth, int aHeight, int aBytes) {
+		bmp.pitch = aWidth * aBytes, bmp.width = aWidth, bmp.height = aHeight, bmp.bytespixel = aBytes;
+		bmp.offsetx = bmp.offsety = 0;
+		pixels.resize((size_t)bmp.pitch * aHeight);
+		bmp.bits = pixels.data();
+		info = new HostBuffer(sizeof(void*) + 6 * sizeof(int));
+		*(BYTE**)info->mData = bmp.bits;
+		memcpy((BYTE*)info->mData + sizeof(void*), &bmp.pitch, 6 * sizeof(int));
+	}
+	~Frame() { info->Release(); }
+
+	UINT* Row(int aY) { return (UINT*)(bmp.bits + (ptrdiff_t)aY * bmp.pitch); }
+	// Fills a rectangle, clipped to the frame, with a color or with noise of aSeed if aColor is 0.
+	void Fill(int aX, int aY, int aW, int aH, UINT aColor, UINT aSeed = 0) {
+		int x0 = aX < 0 ? 0 : aX, y0 = aY < 0 ? 0 : aY;
+		int x1 = aX + aW < bmp.width ? aX + aW : bmp.width, y1 = aY + aH < bmp.height ? aY + aH : bmp.height;
+		for (int y = y0; y < y1; ++y) {
+			UINT* row = Row(y);
+			for (int x = x0; x < x1; ++x)
+				row[x] = aColor ? aColor : PixelNoise(x, y, aSeed) | 0xFF000000;
+		}
+	}
+};
+
+// Produces the frames of a sequence in place, returning false after the last.
+struct Sequence
+{
+	const char* name;
+	bool (*next)(Frame& aFrame, int aIndex, int aCount);
+};
+
+// The desktop every synthetic sequence starts from: noise for the wallpaper and a few windows.
+static void Desktop(Frame& aFrame) {
+	int w = aFrame.bmp.width, h = aFrame.bmp.height;
+	aFrame.Fill(0, 0, w, h, 0, 1);
+	aFrame.Fill(w / 10, h / 10, w / 2, h / 2, 0xFFF0F0F0);
+	aFrame.Fill(w / 3, h / 3, w / 2, h / 2, 0xFFFFFFFF);
+	aFrame.Fill(0, h - 40, w, 40, 0xFF202020);
+}
+
+static const Sequence sSequences[] = {
+	{ "idle", [](Frame& aFrame, int aIndex, int aCount) {
+		if (!aIndex)
+			Desktop(aFrame);
+		// A text cursor blinking every other frame.
+		else aFrame.Fill(aFrame.bmp.width / 2, aFrame.bmp.height / 2, 2, 16, aIndex % 2 ? 0xFF000000 : 0xFFFFFFFF);
+		return aIndex < aCount;
+	} },
+	{ "typing", [](Frame& aFrame, int aIndex, int aCount) {
+		if (!aIndex)
+			Desktop(aFrame);
+		// Three glyphs a frame along a line of the front window, wrapping to the next line.
+		int w = aFrame.bmp.width, h = aFrame.bmp.height, per_line = w / 2 / 9 - 2;
+		for (int g = aIndex * 3; g < aIndex * 3 + 3; ++g)
+			aFrame.Fill(w / 3 + 9 * (g % per_line) + 4, h / 3 + 20 * (g / per_line % 20) + 8, 8, 16, 0, g + 2);
+		return aIndex < aCount;
+	} },
+	{ "window drag", [](Frame& aFrame, int aIndex, int aCount) {
+		int w = aFrame.bmp.width, h = aFrame.bmp.height, ww = w / 4, wh = h / 4;
+		if (!aIndex)
+			Desktop(aFrame);
+		else aFrame.Fill((aIndex - 1) * 13, (aIndex - 1) * 7, ww, wh, 0, 1); // The wallpaper behind it.
+		aFrame.Fill(aIndex * 13, aIndex * 7, ww, wh, 0xFF3070C0);
+		return aIndex < aCount;
+	} },
+	{ "video", [](Frame& aFrame, int aIndex, int aCount) {
+		if (!aIndex)
+			Desktop(aFrame);
+		// A new picture every frame in a 16:9 player a third of the screen wide.
+		int w = aFrame.bmp.width / 3;
+		aFrame.Fill(aFrame.bmp.width / 2, aFrame.bmp.height / 6, w, w * 9 / 16, 0, aIndex + 100);
+		return aIndex < aCount;
+	} },
+	{ "scroll", [](Frame& aFrame, int aIndex, int aCount) {
+		if (!aIndex)
+			Desktop(aFrame);
+		// The whole screen moves up 20 rows, with new ones at the bottom.
+		else {
+			auto& bmp = aFrame.bmp;
+			memmove(bmp.bits, bmp.bits + 20 * bmp.pitch, (size_t)(bmp.height - 20) * bmp.pitch);
+			aFrame.Fill(0, bmp.height - 20, bmp.width, 20, 0, aIndex + 200);
+		}
+		return aIndex < aCount;
+	} },
+};
+
+// The tiles whose pixels differ from aPrevious, or all of them if there is none.
+static std::vector<BYTE> ChangedTiles(const Frame& aFrame, const std::vector<BYTE>& aPrevious, int aTile) {
+	auto& bmp = aFrame.bmp;
+	int cols = (bmp.width + aTile - 1) / aTile, rows = (bmp.height + aTile - 1) / aTile;
+	std::vector<BYTE> changed((size_t)cols * rows, aPrevious.empty());
+	for (int y = 0; y < bmp.height && !aPrevious.empty(); ++y)
+		for (int c = 0; c < cols; ++c) {
+			size_t at = (size_t)y * bmp.pitch + (size_t)c * aTile * bmp.bytespixel;
+			int w = (c + 1) * aTile < bmp.width ? aTile : bmp.width - c * aTile;
+			if (memcmp(bmp.bits + at, aPrevious.data() + at, (size_t)w * bmp.bytespixel))
+				changed[(size_t)(y / aTile) * cols + c] = 1;
+		}
+	return changed;
+}
+
+// The tiles covered by the rectangles Update returned.
+static std::vector<BYTE> ReportedTiles(const Frame& aFrame, IObject* aRects, int aTile) {
+	auto& bmp = aFrame.bmp;
+	int cols = (bmp.width + aTile - 1) / aTile, rows = (bmp.height + aTile - 1) / aTile;
+	std::vector<BYTE> reported((size_t)cols * rows, 0);
+	auto buf = static_cast<BufferObject*>(aRects);
+	const int* rect = (const int*)buf->mData;
+	for (size_t i = 0; i < buf->mSize / (4 * sizeof(int)); ++i, rect += 4)
+		for (int c = rect[0] / aTile; c <= (rect[0] + rect[2] - 1) / aTile; ++c)
+			reported[(size_t)(rect[1] / aTile) * cols + c] = 1;
+	return reported;
+}
+
+// Replays a sequence through a FrameDiff of each tile size, checking every Update against the
+// pixels, then times comparing each frame with a copy of the last.
+template<class F>
+static void BenchReplay(HostModule& aModule, const char* aName, Frame& aFrame, int aCount, F aNext) {
+	auto& bmp = aFrame.bmp;
+	size_t size = (size_t)bmp.pitch * bmp.height;
+	const ObjectMember* update = aModule.Member(_T("FrameDiff.Prototype.Update"));
+	char name[128];
+	const int tiles[] = { 16, 32, 64 };
+	for (int tile : tiles) {
+		IObject* diff = aModule.New(_T("FrameDiff"), { tile });
+		std::vector<BYTE> previous;
+		double t = 0, dirty = 0;
+		int frames = 0;
+		bool exact = true;
+		for (int i = 0; aNext(aFrame, i, aCount); ++i, ++frames) {
+			double start = BenchNow();
+			HostResult rects = aModule.Invoke(diff, update, { (IObject*)aFrame.info });
+			t += BenchNow() - start;
+			std::vector<BYTE> changed = ChangedTiles(aFrame, previous, tile);
+			exact &= !rects.Failed() && ReportedTiles(aFrame, rects.Obj(), tile) == changed;
+			for (BYTE c : changed)
+				dirty += c;
+			dirty -= i ? 0 : changed.size(); // The first frame is all dirty.
+			previous.assign(bmp.bits, bmp.bits + size);
+		}
+		CHECK(exact);
+		diff->Release();
+		snprintf(name, sizeof(name), "%s %dx%d tile %d", aName, bmp.width, bmp.height, tile);
+		BenchReport(name, (double)size, "ms/frame", t * 1e3 / frames);
+		snprintf(name, sizeof(name), "%s %dx%d tile %d dirty", aName, bmp.width, bmp.height, tile);
+		BenchReport(name, (double)size, "%", 100 * dirty / ((frames - 1) * ((bmp.width + tile - 1) / tile) * ((bmp.height + tile - 1) / tile)));
+	}
+	// What waitScreenChange does instead: compare with the last frame, then keep a copy of it.
+	std::vector<BYTE> previous(size);
+	double t = 0;
+	int frames = 0, changes = 0;
+	for (int i = 0; aNext(aFrame, i, aCount); ++i, ++frames) {
+		double start = BenchNow();
+		changes += !!memcmp(previous.data(), bmp.bits, size);
+		memcpy(previous.data(), bmp.bits, size);
+		t += BenchNow() - start;
+	}
+	BenchKeep(changes);
+	snprintf(name, sizeof(name), "%s %dx%d compare with copy", aName, bmp.width, bmp.height);
+	BenchReport(name, (double)size, "ms/frame", t * 1e3 / frames);
+}
+
+struct HashPath
+{
+	const char* name;
+	int needs;
+	HashRowType hash_row;
+};
+
+static const HashPath sPaths[] = {
+	{ "avx2", CPU_AVX2, HashRow_AVX2 },
+	{ "sse2", CPU_SSE2, HashRow_SSE2 },
+	{ "scalar", 0, HashRow_Scalar },
+};
+
+// Each path hashing the same frame, which must give the same tiles.
+static void BenchHash(Frame& aFrame) {
+	auto& bmp = aFrame.bmp;
+	size_t size = (size_t)bmp.pitch * bmp.height;
+	HashRowType module_path = HashRow;
+	std::vector<UINT64> expected;
+	char name[96];
+	for (auto& path : sPaths) {
+		if ((CpuFeatures() & path.needs) != path.needs)
+			continue;
+		HashRow = path.hash_row;
+		TileMap tiles;
+		tiles.tile = 32;
+		Arena arena;
+		double t = BenchTime([&] {
+			tiles.Free();
+			tiles.Update(bmp, arena);
+		});
+		std::vector<UINT64> hashes(tiles.hashes, tiles.hashes + (size_t)tiles.cols * tiles.rows);
+		if (expected.empty())
+			expected = hashes;
+		CHECK(hashes == expected);
+		snprintf(name, sizeof(name), "tile hash %s %dx%d", path.name, bmp.width, bmp.height);
+		BenchReport(name, (double)size, "GB/s", size / t / 1e9);
+	}
+	HashRow = module_path;
+}
+
+// findColor of an absent color over the whole frame, and over what the last Update found dirty.
+static void BenchDirtySearch(HostModule& aModule, Frame& aFrame) {
+	auto& bmp = aFrame.bmp;
+	IObject* diff = aModule.New(_T("FrameDiff"));
+	const ObjectMember* update = aModule.Member(_T("FrameDiff.Prototype.Update"));
+	Desktop(aFrame);
+	aModule.Invoke(diff, update, { (IObject*)aFrame.info });
+	aFrame.Fill(bmp.width / 2, bmp.height / 2, 40, 16, 0xFE102030); // A word typed, in a color the noise never has.
+	aModule.Invoke(diff, update, { (IObject*)aFrame.info });
+	char name[96];
+	for (int dirty = 0; dirty < 2; ++dirty) {
+		HostValue no_dirty = HostValue::Missing();
+		int x = -1;
+		double t = BenchTime([&] {
+			HostResult r = aModule.Call(_T("findColor"), { (IObject*)aFrame.info, 0xFE102030, 0, 0, dirty ? HostValue((IObject*)diff) : no_dirty });
+			auto pos = static_cast<HostObject*>(r.Obj());
+			x = pos ? (int)pos->Get(_T("x"))->n_int64 : -1;
+		});
+		CHECK_EQ(x, bmp.width / 2);
+		snprintf(name, sizeof(name), "findColor %s %dx%d", dirty ? "dirty tiles" : "whole frame", bmp.width, bmp.height);
+		BenchReport(name, (double)bmp.width * bmp.height, "ms", t * 1e3);
+	}
+	diff->Release();
+}
+
+// Replays a recording, one frame after another from the file.
+static void BenchRecording(HostModule& aModule, const char* aPath) {
+	FILE* f = fopen(aPath, "rb");
+	int header[3] = {};
+	if (!f || fread(header, sizeof(int), 3, f) != 3 || header[0] <= 0 || header[1] <= 0 || header[2] != 4) {
+		fprintf(stderr, "cannot read frames from %s\n", aPath);
+		CHECK(false);
+		if (f)
+			fclose(f);
+		return;
+	}
+	Frame frame(header[0], header[1], header[2]);
+	size_t size = frame.pixels.size();
+	BenchReplay(aModule, "recording", frame, INT_MAX, [&](Frame& aFrame, int aIndex, int) {
+		if (!aIndex)
+			fseek(f, 3 * sizeof(int), SEEK_SET);
+		return fread(aFrame.bmp.bits, 1, size, f) == size;
+	});
+	fclose(f);
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "framediff");
+	HostModule module;
+	for (int i = 1; i + 1 < argc; ++i)
+		if (!strcmp(argv[i], "--frames")) {
+			BenchRecording(module, argv[i + 1]);
+			return BenchExit();
+		}
+	struct { int width, height; } sizes[] = { { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+	const int count = BenchSize(60, 8);
+	for (auto& size : sizes) {
+		if (sBench.quick && size.width > 1280)
+			break;
+		Frame frame(size.width, size.height, 4);
+		for (auto& seq : sSequences)
+			BenchReplay(module, seq.name, frame, count, seq.next);
+		BenchHash(frame);
+		BenchDirtySearch(module, frame);
+	}
+	return BenchExit();
+}
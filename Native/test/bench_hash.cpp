@@ -0,0 +1,164 @@
+// Benchmarks of hash.cpp: GB/s for each algorithm and each of its paths (SSE4.2 or table CRC32C,
+// AVX2, SSE2 or scalar xxHash3, AVX2 or scalar BLAKE3, SHA extensions or scalar SHA-256) from
+// 64 bytes to 64 MB, then by thread count: BLAKE3 of one large input, and hash_many of many
+// small buffers against a Hasher per buffer.  Each thread count runs in a child process, since
+// ThreadCount() is read once; AHK2_SHIM_NPROC sets what the shim reports.
+#include "../hash.cpp"
+#include "host.h"
+#include "bench.h"
+#include <sys/wait.h>
+
+static const LPCTSTR sNames[] = { _T("crc32c"), _T("xxh3"), _T("blake3"), _T("sha256") };
+
+// Selects one path of an algorithm by swapping the module's dispatch pointers.
+struct HashPath
+{
+	const char* name;
+	int algorithm, needs;
+	void (*select)();
+};
+
+static const HashPath sPaths[] = {
+	{ "crc32c sse4.2", HASH_CRC32C, CPU_SSE42, [] { Crc32c = Crc32c_SSE42; } },
+	{ "crc32c scalar", HASH_CRC32C, 0, [] { Crc32c = Crc32c_Scalar; } },
+	{ "xxh3 avx2", HASH_XXH3, CPU_AVX2, [] { Xxh3Accumulate = Xxh3Accumulate_AVX2, Xxh3Scramble = Xxh3Scramble_AVX2; } },
+	{ "xxh3 sse2", HASH_XXH3, CPU_SSE2, [] { Xxh3Accumulate = Xxh3Accumulate_SSE2, Xxh3Scramble = Xxh3Scramble_SSE2; } },
+	{ "xxh3 scalar", HASH_XXH3, 0, [] { Xxh3Accumulate = Xxh3Accumulate_Scalar, Xxh3Scramble = Xxh3Scramble_Scalar; } },
+	{ "blake3 avx2", HASH_BLAKE3, CPU_AVX2, [] { Blake3HashMany = Blake3HashMany_AVX2; } },
+	{ "blake3 scalar", HASH_BLAKE3, 0, [] { Blake3HashMany = Blake3HashMany_Scalar; } },
+	{ "sha256 sha-ni", HASH_SHA256, CPU_SHA | CPU_SSE41, [] { Sha256Blocks = Sha256Blocks_SHA; } },
+	{ "sha256 scalar", HASH_SHA256, 0, [] { Sha256Blocks = Sha256Blocks_Scalar; } },
+};
+
+static void Digest(int aAlgorithm, const BYTE* aData, size_t aSize, BYTE* aOut) {
+	HashState state;
+	state.algorithm = aAlgorithm;
+	state.Reset();
+	state.Update(aData, aSize);
+	state.Digest(aOut);
+}
+
+// Every path of every algorithm on one thread; the paths must agree.
+static void BenchPaths(const std::vector<BYTE>& aData) {
+	const size_t sizes[] = { 64, 4096, 1 << 20, 64 << 20 };
+	for (size_t size : sizes) {
+		if (size > aData.size())
+			break;
+		BYTE expected[4][HASH_MAX_DIGEST];
+		for (int a = 0; a < 4; ++a)
+			Digest(a, aData.data(), size, expected[a]);
+		size_t reps = (64 << 20) / size + 1;
+		for (auto& path : sPaths) {
+			if ((CpuFeatures() & path.needs) != path.needs)
+				continue;
+			path.select();
+			BYTE digest[HASH_MAX_DIGEST];
+			double t = BenchTime([&] {
+				for (size_t r = 0; r < reps; ++r)
+					Digest(path.algorithm, aData.data(), size, digest);
+			});
+			CHECK(!memcmp(digest, expected[path.algorithm], sAlgorithms[path.algorithm].digest_size));
+			BenchReport(path.name, (double)size, "GB/s", size * reps / t / 1e9);
+		}
+		// The fastest paths again, as the module selects them.
+		for (int i = (int)_countof(sPaths) - 1; i >= 0; --i)
+			if ((CpuFeatures() & sPaths[i].needs) == sPaths[i].needs)
+				sPaths[i].select();
+	}
+}
+
+// Run in a child process which reports aThreads processors.
+static void BenchThreads(HostModule& aModule, const std::vector<BYTE>& aData, int aThreads) {
+	char name[96];
+	BYTE expected[HASH_MAX_DIGEST], digest[HASH_MAX_DIGEST];
+	size_t size = aData.size();
+	// BLAKE3 hashes subtrees of 1024 chunks and more on the thread pool.
+	Digest(HASH_BLAKE3, aData.data(), size, expected);
+	double t = BenchTime([&] { Digest(HASH_BLAKE3, aData.data(), size, digest); });
+	CHECK(!memcmp(digest, expected, 32));
+	snprintf(name, sizeof(name), "blake3 %d threads", aThreads);
+	BenchReport(name, (double)size, "GB/s", size / t / 1e9);
+
+	// Many small buffers in one call, spread over the pool, against one Hasher call per buffer.
+	const size_t item_size = 16384, count = size / item_size;
+	auto items = new HostArray;
+	items->Reserve((Object::index_t)count);
+	for (size_t i = 0; i < count; ++i) {
+		auto buf = new HostBuffer(item_size);
+		memcpy(buf->mData, aData.data() + i * item_size, item_size);
+		items->Push(HostValue((IObject*)buf));
+		buf->Release();
+	}
+	const ObjectMember* update = aModule.Member(_T("Hasher.Prototype.Update"));
+	const ObjectMember* get_digest = aModule.Member(_T("Hasher.Prototype.Digest"));
+	const ObjectMember* reset = aModule.Member(_T("Hasher.Prototype.Reset"));
+	for (int a = 0; a < 4; ++a) {
+		std::string last;
+		t = BenchTime([&] {
+			HostResult r = aModule.Call(_T("hash_many"), { sNames[a], (IObject*)items });
+			auto digests = static_cast<HostArray*>(r.Obj());
+			CHECK(digests && digests->mLength == (Object::index_t)count);
+			if (digests)
+				last = HostNarrow(digests->mItem[count - 1].string.Value());
+		});
+		snprintf(name, sizeof(name), "hash_many %s %d threads", HostNarrow(sNames[a]).c_str(), aThreads);
+		BenchReport(name, (double)item_size, "GB/s", size / t / 1e9);
+
+		if (aThreads > 1)
+			continue; // A Hasher per buffer does not use the pool.
+		IObject* hasher = aModule.New(_T("Hasher"), { sNames[a] });
+		std::string one;
+		t = BenchTime([&] {
+			for (size_t i = 0; i < count; ++i) {
+				aModule.Invoke(hasher, update, { items->mItem[i].object });
+				HostResult r = aModule.Invoke(hasher, get_digest);
+				aModule.Invoke(hasher, reset);
+				if (i == count - 1)
+					one = r.Str();
+			}
+		});
+		CHECK_EQ(one, last);
+		snprintf(name, sizeof(name), "Hasher per buffer %s", HostNarrow(sNames[a]).c_str());
+		BenchReport(name, (double)item_size, "GB/s", size / t / 1e9);
+		hasher->Release();
+	}
+	items->Release();
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "hash");
+	std::vector<BYTE> data(BenchSize<size_t>(64 << 20, 4 << 20));
+	for (size_t i = 0; i < data.size(); ++i)
+		data[i] = (BYTE)(i * 2654435761u >> 13);
+
+	// Forked before anything calls ThreadCount(), which each child then reads afresh.
+	const int threads[] = { 1, 2, 4, 8 };
+	int failed = 0;
+	for (int count : threads) {
+		if (sBench.quick && count > 2)
+			break;
+		fflush(stdout);
+		if (sBench.json)
+			fflush(sBench.json);
+		pid_t pid = fork();
+		if (!pid) {
+			char value[16];
+			snprintf(value, sizeof(value), "%d", count);
+			setenv("AHK2_SHIM_NPROC", value, 1);
+			HostModule module;
+			BenchThreads(module, data, count);
+			fflush(stdout);
+			if (sBench.json)
+				fflush(sBench.json);
+			_exit(CheckExit());
+		}
+		int status = 0;
+		if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status))
+			++failed;
+	}
+	CHECK_EQ(failed, 0);
+
+	setenv("AHK2_SHIM_NPROC", "1", 1);
+	BenchPaths(data);
+	return BenchExit();
+}
@@ -0,0 +1,174 @@
+// Benchmarks of hashmap.cpp's HashMap against a sorted-vector reference: the script's Map,
+// which keeps its keys sorted and finds them by binary search.  Integer and string keys;
+// inserts, hits, misses, deletes and delete/insert churn.
+#include "../hashmap.cpp"
+#include "host.h"
+#include "bench.h"
+#include <random>
+
+static std::mt19937_64 sRandom(11);
+
+struct HashMapMembers
+{
+	const ObjectMember* set, * get, * has, * del, * count;
+	HashMapMembers(HostModule& aModule)
+		: set(aModule.Member(_T("HashMap.Prototype.Set"))), get(aModule.Member(_T("HashMap.Prototype.Get")))
+		, has(aModule.Member(_T("HashMap.Prototype.Has"))), del(aModule.Member(_T("HashMap.Prototype.Delete")))
+		, count(aModule.Member(_T("HashMap.Prototype.Count"), IT_GET)) {}
+};
+
+// The reference lookup: binary search within the Map's int or string section.
+static Map::Pair* MapFind(Map* aMap, ExprTokenType& aKey) {
+	Object::index_t left, right;
+	if (aKey.symbol == SYM_INTEGER)
+		left = 0, right = aMap->mKeyOffsetObject;
+	else left = aMap->mKeyOffsetString, right = aMap->mCount;
+	while (left < right) {
+		Object::index_t mid = left + (right - left) / 2;
+		Map::Pair& pair = aMap->mItem[mid];
+		int c = aKey.symbol == SYM_INTEGER ? (aKey.value_int64 > pair.key.i) - (aKey.value_int64 < pair.key.i)
+			: _tcscmp(aKey.marker, pair.key.s);
+		if (!c)
+			return &pair;
+		if (c < 0)
+			right = mid;
+		else
+			left = mid + 1;
+	}
+	return nullptr;
+}
+
+static void BenchKeys(HostModule& aModule, HashMapMembers& aMembers, const char* aKind, std::vector<HostValue>& aKeys, std::vector<HostValue>& aMissing) {
+	size_t size = aKeys.size();
+	char name[96];
+	std::vector<size_t> order(BenchSize<size_t>(1000000, 20000));
+	__int64 expected = 0;
+	for (auto& k : order) {
+		k = sRandom() % size;
+		expected += (__int64)k;
+	}
+	std::vector<HostValue> values;
+	for (size_t i = 0; i < size; ++i)
+		values.emplace_back((__int64)i);
+
+	// Keys are generated in sorted order, so both structures insert at the end.
+	HostMap* map = nullptr;
+	double t = BenchTime([&] {
+		if (map)
+			map->Release();
+		map = new HostMap;
+		for (size_t i = 0; i < size; ++i)
+			map->Set(aKeys[i], values[i]);
+	});
+	snprintf(name, sizeof(name), "Map insert %s", aKind);
+	BenchReport(name, (double)size, "ns/op", t * 1e9 / size);
+	IObject* hm = nullptr;
+	t = BenchTime([&] {
+		if (hm)
+			hm->Release();
+		hm = aModule.New(_T("HashMap"));
+		for (size_t i = 0; i < size; ++i) {
+			ExprTokenType* params[] = { &aKeys[i], &values[i] };
+			aModule.Invoke(hm, aMembers.set, params, 2);
+		}
+	});
+	snprintf(name, sizeof(name), "HashMap insert %s", aKind);
+	BenchReport(name, (double)size, "ns/op", t * 1e9 / size);
+	CHECK_EQ(aModule.Invoke(hm, aMembers.count).Int(), (__int64)size);
+
+	__int64 sum = 0;
+	t = BenchTime([&] {
+		sum = 0;
+		for (size_t k : order)
+			if (Map::Pair* pair = MapFind(map, aKeys[k]))
+				sum += pair->n_int64;
+	});
+	CHECK_EQ(sum, expected);
+	snprintf(name, sizeof(name), "Map lookup hit %s", aKind);
+	BenchReport(name, (double)size, "ns/op", t * 1e9 / order.size());
+	t = BenchTime([&] {
+		sum = 0;
+		for (size_t k : order) {
+			ExprTokenType* params[] = { &aKeys[k] };
+			sum += aModule.Invoke(hm, aMembers.get, params, 1).Int();
+		}
+	});
+	CHECK_EQ(sum, expected);
+	snprintf(name, sizeof(name), "HashMap lookup hit %s", aKind);
+	BenchReport(name, (double)size, "ns/op", t * 1e9 / order.size());
+
+	size_t found = 0;
+	t = BenchTime([&] {
+		found = 0;
+		for (size_t k : order)
+			found += MapFind(map, aMissing[k]) != nullptr;
+	});
+	CHECK_EQ(found, 0u);
+	snprintf(name, sizeof(name), "Map lookup miss %s", aKind);
+	BenchReport(name, (double)size, "ns/op", t * 1e9 / order.size());
+	t = BenchTime([&] {
+		found = 0;
+		for (size_t k : order) {
+			ExprTokenType* params[] = { &aMissing[k] };
+			found += (size_t)aModule.Invoke(hm, aMembers.has, params, 1).Int();
+		}
+	});
+	CHECK_EQ(found, 0u);
+	snprintf(name, sizeof(name), "HashMap lookup miss %s", aKind);
+	BenchReport(name, (double)size, "ns/op", t * 1e9 / order.size());
+
+	// Delete every other key, then re-insert them; deletes leave tombstones behind.
+	t = BenchTime([&] {
+		for (size_t i = 0; i < size; i += 2) {
+			ExprTokenType* params[] = { &aKeys[i] };
+			aModule.Invoke(hm, aMembers.del, params, 1);
+		}
+		for (size_t i = 0; i < size; i += 2) {
+			ExprTokenType* params[] = { &aKeys[i], &values[i] };
+			aModule.Invoke(hm, aMembers.set, params, 2);
+		}
+	});
+	CHECK_EQ(aModule.Invoke(hm, aMembers.count).Int(), (__int64)size);
+	snprintf(name, sizeof(name), "HashMap delete + reinsert %s", aKind);
+	BenchReport(name, (double)size, "ns/op", t * 1e9 / size);
+	hm->Release();
+	map->Release();
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "hashmap");
+	HostModule module;
+	HashMapMembers members(module);
+	CHECK(members.set && members.get && members.has && members.del && members.count);
+	{
+		IObject* hm = module.New(_T("HashMap"));
+		CHECK(module.Invoke(hm, members.set, { 1, HostValue::Missing() }).Failed() && sHostError.type == "ValueError");
+		hm->Release();
+	}
+	const size_t sizes[] = { 1000, 65536, 1000000 };
+	for (size_t size : sizes) {
+		if (sBench.quick && size > 65536)
+			break;
+		std::vector<HostValue> ints, int_misses;
+		for (size_t i = 0; i < size; ++i) {
+			ints.emplace_back((__int64)(i * 7));
+			int_misses.emplace_back((__int64)(i * 7 + 3));
+		}
+		BenchKeys(module, members, "int", ints, int_misses);
+		std::vector<std::vector<TCHAR>> names, missing_names;
+		std::vector<HostValue> strs, str_misses;
+		char buf[32];
+		for (size_t i = 0; i < size; ++i) {
+			snprintf(buf, sizeof(buf), "key%07zu", i);
+			names.push_back(HostWiden(buf));
+			snprintf(buf, sizeof(buf), "key%07zux", i);
+			missing_names.push_back(HostWiden(buf));
+		}
+		for (size_t i = 0; i < size; ++i) {
+			strs.emplace_back(names[i]);
+			str_misses.emplace_back(missing_names[i]);
+		}
+		BenchKeys(module, members, "string", strs, str_misses);
+	}
+	return BenchExit();
+}
@@ -0,0 +1,272 @@
+// Benchmarks of imagesearch.cpp on synthetic captures of 720p to 4K: the match kernels for
+// each path (AVX2, SSE2 and scalar) over a whole frame in Mpixels/s, for a one-pixel pattern, a
+// five-pixel one which filters on its first pixel, and one with a similarity below 1.0 which
+// cannot; then findColor, findMultiColors, findPic and their findAll* forms as a script calls
+// them, in ms per search, against a brute-force scan which every result must match.  The
+// findAll* searches also run in child processes reporting 1-8 processors, since ThreadCount()
+// is read once; AHK2_SHIM_NPROC sets what the shim reports.
+#include "../imagesearch.cpp"
+#include "host.h"
+#include "bench.h"
+#include <algorithm>
+#include <sys/wait.h>
+
+static UINT PixelNoise(UINT aX, UINT aY, UINT aSeed) {
+	UINT h = aX * 0x9E3779B1u ^ aY * 0x85EBCA77u ^ aSeed * 0xC2B2AE3Du;
+	h ^= h >> 15, h *= 0x2C1B3C6Du, h ^= h >> 12;
+	return h;
+}
+
+// A bitmap and the info Buffer describing it, as BitmapBuffer.info would.
+struct Frame
+{
+	std::vector<BYTE> pixels;
+	BitmapInfo bmp;
+	HostBuffer* info;
+
+	Frame(int aWidth, int aHeight, int aBytes, UINT aSeed) {
+		bmp.pitch = (aWidth * aBytes + 3) & ~3;
+		bmp.width = aWidth, bmp.height = aHeight, bmp.bytespixel = aBytes, bmp.offsetx = bmp.offsety = 0;
+		pixels.resize((size_t)bmp.pitch * aHeight);
+		bmp.bits = pixels.data();
+		for (int y = 0; y < aHeight; ++y)
+			for (int x = 0; x < aWidth; ++x)
+				Set(x, y, PixelNoise(x, y, aSeed) | 0xFF000000);
+		info = new HostBuffer(sizeof(void*) + 6 * sizeof(int));
+		*(BYTE**)info->mData = bmp.bits;
+		memcpy((BYTE*)info->mData + sizeof(void*), &bmp.pitch, 6 * sizeof(int));
+	}
+	~Frame() { info->Release(); }
+
+	BYTE* At(int aX, int aY) { return bmp.bits + (ptrdiff_t)aY * bmp.pitch + aX * bmp.bytespixel; }
+	UINT Get(int aX, int aY) { return LoadPixel(At(aX, aY), bmp.bytespixel); }
+	void Set(int aX, int aY, UINT aColor) { memcpy(At(aX, aY), &aColor, bmp.bytespixel); }
+	// Copies aPic to (aX, aY).
+	void Stamp(Frame& aPic, int aX, int aY) {
+		for (int y = 0; y < aPic.bmp.height; ++y)
+			memcpy(At(aX, aY + y), aPic.At(0, y), (size_t)aPic.bmp.width * bmp.bytespixel);
+	}
+};
+
+// The anchors where aPattern matches, by trying every one in turn.
+static std::vector<MatchPos> BruteForce(const BitmapInfo& aBmp, const Pattern& aPattern) {
+	std::vector<MatchPos> found;
+	for (int y = -aPattern.top; y < aBmp.height - aPattern.bottom; ++y)
+		for (int x = -aPattern.left; x < aBmp.width - aPattern.right; ++x) {
+			const BYTE* anchor = aBmp.bits + (ptrdiff_t)y * aBmp.pitch + (ptrdiff_t)x * aBmp.bytespixel;
+			UINT matched = 0;
+			for (UINT i = 0; i < aPattern.count; ++i) {
+				auto& px = aPattern.pixels[i];
+				matched += PixelNear(LoadPixel(anchor + px.offset, aBmp.bytespixel), px.color, px.tolerance);
+			}
+			if (matched >= aPattern.required)
+				found.push_back({ x, y });
+		}
+	return found;
+}
+
+struct MatchPath
+{
+	const char* name;
+	int bytes, needs;
+	MatchRowType match_row;
+};
+
+static const MatchPath sPaths[] = {
+	{ "avx2", 4, CPU_AVX2, MatchRowBlocks<4, 8, MatchBlock32_AVX2, FilterRow32_AVX2> },
+	{ "sse2", 4, CPU_SSE2, MatchRowBlocks<4, 4, MatchBlock32_SSE2, FilterRow32_SSE2> },
+	{ "scalar", 4, 0, MatchRow_Scalar<4> },
+	{ "avx2", 1, CPU_AVX2, MatchRowBlocks<1, 16, MatchBlock8_AVX2, FilterRow8_AVX2> },
+	{ "sse2", 1, CPU_SSE2, MatchRowBlocks<1, 8, MatchBlock8_SSE2, FilterRow8_SSE2> },
+	{ "scalar", 1, 0, MatchRow_Scalar<1> },
+	{ "scalar", 3, 0, MatchRow_Scalar<3> },
+};
+
+// Each path over every anchor of aFrame, one row at a time on this thread; the paths must
+// find the same anchors as the brute-force scan.
+static void BenchKernels(Frame& aFrame, const char* aKind) {
+	const BitmapInfo& bmp = aFrame.bmp;
+	int bytes = bmp.bytespixel;
+	// Five colors planted 200 times, every third time without the last; in 8bpp they also
+	// occur by chance.
+	PatternPixel pixels[5];
+	const int offsets[5][2] = { { 0, 0 }, { 7, 0 }, { 0, 5 }, { 9, 9 }, { 3, 12 } };
+	for (int i = 0; i < 5; ++i) {
+		pixels[i].offset = (ptrdiff_t)offsets[i][1] * bmp.pitch + offsets[i][0] * bytes;
+		pixels[i].color = ColorKey(bytes, 0xFF000000 | 0x102030 * (i + 1));
+		pixels[i].tolerance = ColorTolerance(bytes, pixels[i].color, 0);
+	}
+	for (int n = 0; n < 200; ++n) {
+		int x = PixelNoise(n, 1, 7) % (bmp.width - 16), y = PixelNoise(n, 2, 7) % (bmp.height - 16);
+		for (int i = n % 3 ? 5 : 4, k = 0; k < i; ++k) // Every third one is a pixel short.
+			aFrame.Set(x + offsets[k][0], y + offsets[k][1], pixels[k].color);
+	}
+	struct { const char* name; UINT count, required; } patterns[] = {
+		{ "1 pixel", 1, 1 }, { "5 pixels", 5, 5 }, { "5 pixels 80%", 5, 4 } };
+	const int width = bmp.width - 16, height = bmp.height - 16;
+	const UINT words = (width + 31) / 32;
+	std::vector<UINT> bits(words);
+	char name[96];
+	for (auto& p : patterns) {
+		Pattern pattern = { pixels, p.count, p.required, 0, 0, 15, 15 };
+		Pattern bounded = pattern;
+		bounded.right = bounded.bottom = 16; // The anchors the kernels try.
+		size_t expected = BruteForce(bmp, bounded).size();
+		for (auto& path : sPaths) {
+			if (path.bytes != bytes || (CpuFeatures() & path.needs) != path.needs)
+				continue;
+			size_t found = 0;
+			double t = BenchTime([&] {
+				found = 0;
+				for (int y = 0; y < height; ++y) {
+					memset(bits.data(), 0, words * sizeof(UINT));
+					path.match_row(aFrame.At(0, y), width, pattern, bits.data());
+					for (UINT w = 0; w < words; ++w)
+						found += __builtin_popcount(bits[w]);
+				}
+			});
+			CHECK_EQ(found, expected);
+			snprintf(name, sizeof(name), "kernel %s %s %s", path.name, aKind, p.name);
+			BenchReport(name, (double)width * height, "Mpixels/s", (double)width * height / t / 1e6);
+		}
+	}
+}
+
+// Every match of a findAll* result, as positions.
+static std::vector<MatchPos> ResultPositions(HostResult& aResult) {
+	std::vector<MatchPos> found;
+	auto arr = static_cast<HostArray*>(aResult.Obj());
+	for (Object::index_t i = 0; arr && i < arr->mLength; ++i) {
+		auto pos = static_cast<HostObject*>(arr->mItem[i].object);
+		found.push_back({ (int)pos->Get(_T("x"))->n_int64, (int)pos->Get(_T("y"))->n_int64 });
+	}
+	return found;
+}
+
+static bool SamePositions(std::vector<MatchPos> a, std::vector<MatchPos> b) {
+	auto less = [](const MatchPos& p, const MatchPos& q) { return p.y != q.y ? p.y < q.y : p.x < q.x; };
+	std::sort(a.begin(), a.end(), less), std::sort(b.begin(), b.end(), less);
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const MatchPos& p, const MatchPos& q) {
+		return p.x == q.x && p.y == q.y;
+	});
+}
+
+// Times a search and checks that it found aExpected, in any order for findAll*.
+static void BenchSearch(HostModule& aModule, const char* aCase, Frame& aFrame, LPCTSTR aFunc, HostArgs aArgs, const std::vector<MatchPos>& aExpected) {
+	size_t pixels = (size_t)aFrame.bmp.width * aFrame.bmp.height;
+	bool all = !_tcsncmp(aFunc, _T("findAll"), 7);
+	std::vector<MatchPos> found;
+	double t = BenchTime([&] {
+		HostResult r = aModule.Call(aFunc, aArgs);
+		CHECK(!r.Failed());
+		if (all)
+			found = ResultPositions(r);
+		else if (auto pos = static_cast<HostObject*>(r.Obj()))
+			found = { { (int)pos->Get(_T("x"))->n_int64, (int)pos->Get(_T("y"))->n_int64 } };
+		else found.clear();
+	});
+	CHECK(all ? SamePositions(found, aExpected) : found.size() == (aExpected.size() ? 1 : 0)
+		&& (!found.size() || found[0].x == aExpected[0].x && found[0].y == aExpected[0].y));
+	char name[96];
+	snprintf(name, sizeof(name), "%s %dx%d", aCase, aFrame.bmp.width, aFrame.bmp.height);
+	BenchReport(name, (double)pixels, "ms", t * 1e3);
+}
+
+// The module's searches on a 32bpp frame.  aAllOnly runs just the findAll* ones, for the
+// thread counts.
+static void BenchModule(HostModule& aModule, Frame& aFrame, bool aAllOnly) {
+	const BitmapInfo& bmp = aFrame.bmp;
+	Frame pic(32, 32, 4, 99), copy(32, 32, 4, 98);
+	// The picture once, near the end, and a different one ten times.
+	const int x = bmp.width - 200, y = bmp.height - 100;
+	aFrame.Stamp(pic, x, y);
+	std::vector<MatchPos> copies;
+	for (int i = 0; i < 10; ++i) {
+		copies.push_back({ 100 + i * 40, 50 + i * 17 });
+		aFrame.Stamp(copy, copies.back().x, copies.back().y);
+	}
+	// A few changed pixels and a slight shift in color, for similarity and variation.
+	Frame near(32, 32, 4, 99);
+	for (int i = 0; i < 32 * 32; ++i)
+		near.Set(i % 32, i / 32, near.Get(i % 32, i / 32) ^ (i % 17 ? 0x030201 : 0xFFFFFF));
+	UINT absent = 0xFF000000 | PixelNoise(1, 1, 2);
+	std::vector<MatchPos> none, at = { { x, y } };
+
+	if (!aAllOnly) {
+		// findColor of a color which is not there scans every pixel.
+		PatternPixel px = { 0, absent, ColorTolerance(4, absent, 0) };
+		Pattern one = { &px, 1, 1, 0, 0, 0, 0 };
+		BenchSearch(aModule, "findColor absent", aFrame, _T("findColor"), { (IObject*)aFrame.info, (__int64)absent }, BruteForce(bmp, one));
+		// From the bottom right, the first match is the last one in row order.
+		px.color = pic.Get(31, 31), px.tolerance = ColorTolerance(4, px.color, 0);
+		BenchSearch(aModule, "findColor from the end", aFrame, _T("findColor"), { (IObject*)aFrame.info, (__int64)px.color, 0, 3 },
+			{ BruteForce(bmp, one).back() });
+
+		auto colors = new HostArray;
+		const int points[4][2] = { { 0, 0 }, { 31, 0 }, { 0, 31 }, { 17, 9 } };
+		for (auto& p : points) {
+			auto triple = new HostArray;
+			triple->Push(HostValue((__int64)pic.Get(p[0], p[1])));
+			triple->Push(HostValue(p[0]));
+			triple->Push(HostValue(p[1]));
+			colors->Push(HostValue((IObject*)triple));
+			triple->Release();
+		}
+		BenchSearch(aModule, "findMultiColors", aFrame, _T("findMultiColors"), { (IObject*)aFrame.info, (IObject*)colors }, at);
+		colors->Release();
+
+		BenchSearch(aModule, "findPic exact", aFrame, _T("findPic"), { (IObject*)aFrame.info, (IObject*)pic.info }, at);
+		BenchSearch(aModule, "findPic 0.9 variation 3", aFrame, _T("findPic"), { (IObject*)aFrame.info, (IObject*)near.info, 0.9, 0x030303 }, at);
+		BenchSearch(aModule, "findPic absent", aFrame, _T("findPic"), { (IObject*)aFrame.info, (IObject*)near.info }, none);
+	}
+	BenchSearch(aModule, "findAllPic", aFrame, _T("findAllPic"), { (IObject*)aFrame.info, (IObject*)copy.info, 1.0, 100 }, copies);
+	BenchSearch(aModule, "findAllPic 0.95 absent", aFrame, _T("findAllPic"), { (IObject*)aFrame.info, (IObject*)near.info, 0.95, 100 }, none);
+	PatternPixel first = { 0, copy.Get(0, 0), ColorTolerance(4, copy.Get(0, 0), 0) };
+	Pattern one = { &first, 1, 1, 0, 0, 0, 0 };
+	BenchSearch(aModule, "findAllColor", aFrame, _T("findAllColor"), { (IObject*)aFrame.info, (__int64)first.color, 1000 }, BruteForce(bmp, one));
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "imagesearch");
+	struct { int width, height; } sizes[] = { { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+	for (auto& size : sizes) {
+		if (sBench.quick && size.width > 1280)
+			break;
+		const int formats[] = { 4, 1, 3 };
+		const char* kinds[] = { "32bpp", "8bpp", "24bpp" };
+		for (int f = 0; f < 3; ++f) {
+			Frame frame(size.width, size.height, formats[f], 1);
+			BenchKernels(frame, kinds[f]);
+		}
+	}
+
+	// Forked before anything calls ThreadCount(), which each child then reads afresh.
+	const int threads[] = { 1, 2, 4, 8 };
+	int failed = 0;
+	for (int count : threads) {
+		if (sBench.quick && count > 2)
+			break;
+		fflush(stdout);
+		if (sBench.json)
+			fflush(sBench.json);
+		pid_t pid = fork();
+		if (!pid) {
+			char value[16];
+			snprintf(value, sizeof(value), "%d", count);
+			setenv("AHK2_SHIM_NPROC", value, 1);
+			HostModule module;
+			BenchReport("threads", 0, "count", ThreadCount());
+			Frame frame(BenchSize(3840, 1280), BenchSize(2160, 720), 4, 1);
+			BenchModule(module, frame, count > 1);
+			fflush(stdout);
+			if (sBench.json)
+				fflush(sBench.json);
+			_exit(CheckExit());
+		}
+		int status = 0;
+		if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status))
+			++failed;
+	}
+	CHECK_EQ(failed, 0);
+	return BenchExit();
+}
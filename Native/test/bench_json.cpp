@@ -0,0 +1,285 @@
+// Benchmarks of json.cpp: parse and stringify throughput on generated documents of three
+// shapes (records, numbers and escaped strings) from 1 MB to 500 MB, and the memory a parsed
+// document holds.  The baseline is JSON.ahk's parse ported to C++, run up to 16 MB; sizes which
+// would not fit in the available memory are skipped.
+#include "../json.cpp"
+#include "host.h"
+#include "bench.h"
+#include <random>
+#include <regex>
+#include <unistd.h>
+
+static std::mt19937_64 sRandom(7);
+
+// Appends records such as {"id":12,"name":"item 12","price":3.25,"tags":["a","b"],"ok":true}.
+static void GenRecord(std::string& aOut, size_t aIndex) {
+	char buf[256];
+	snprintf(buf, sizeof(buf), "{\"id\":%zu,\"name\":\"item %zu\",\"price\":%.2f,\"tags\":[\"t%u\",\"t%u\"],\"ok\":%s,\"parent\":null,"
+		"\"pos\":{\"x\":%d,\"y\":%d}}"
+		, aIndex, aIndex, (double)(sRandom() % 100000) / 100, (unsigned)(sRandom() % 50), (unsigned)(sRandom() % 50)
+		, sRandom() & 1 ? "true" : "false", (int)(sRandom() % 2000) - 1000, (int)(sRandom() % 2000) - 1000);
+	aOut += buf;
+}
+static void GenNumber(std::string& aOut, size_t aIndex) {
+	char buf[64];
+	if (aIndex & 1)
+		snprintf(buf, sizeof(buf), "%lld", (long long)(sRandom() % 2000000000) - 1000000000);
+	else
+		snprintf(buf, sizeof(buf), "%.17g", (double)sRandom() / 1e15);
+	aOut += buf;
+}
+static void GenString(std::string& aOut, size_t aIndex) {
+	aOut += "\"";
+	size_t length = 20 + sRandom() % 200;
+	for (size_t i = 0; i < length; ++i) {
+		unsigned r = sRandom() % 64;
+		if (r == 0)
+			aOut += "\\\"";
+		else if (r == 1)
+			aOut += "\\n";
+		else if (r == 2)
+			aOut += "\\u00e9";
+		else if (r == 3)
+			aOut += "\xc3\xa9"; // é as UTF-8, widened to one char.
+		else aOut += (char)('a' + (aIndex + i) % 26);
+	}
+	aOut += "\"";
+}
+
+typedef void (*GenFn)(std::string&, size_t);
+
+// An array of generated values, about aChars long.
+template<class F>
+static std::string GenDocument(size_t aChars, F aGen) {
+	std::string text = "[";
+	for (size_t i = 0; text.size() < aChars; ++i) {
+		if (i)
+			text += ",";
+		aGen(text, i);
+	}
+	text += "]";
+	return text;
+}
+
+// The baseline: JSON.ahk's parse, without its error checks and comment support.  As the script
+// does, it splits the text at each quote mark, trims each piece between strings and matches each
+// scalar with the script's regular expression, building HostArray and HostMap objects.  The
+// script's SubStr copies the rest of a piece for each scalar, making it quadratic on pieces
+// without strings; the port matches in place, so it is a lower bound on the script's cost.
+static std::string ScriptUnescape(const std::string& aText) {
+	std::string out;
+	for (size_t i = 0; i < aText.size(); ++i) {
+		char c = aText[i];
+		if (c != '\\' || i + 1 == aText.size()) {
+			out += c;
+			continue;
+		}
+		switch (c = aText[++i])
+		{
+		case 'b': out += '\b'; break;
+		case 'f': out += '\f'; break;
+		case 'n': out += '\n'; break;
+		case 'r': out += '\r'; break;
+		case 't': out += '\t'; break;
+		case 'u': {
+			unsigned cp = (unsigned)strtoul(aText.substr(i + 1, 4).c_str(), nullptr, 16);
+			i += 4;
+			if (cp < 0x80)
+				out += (char)cp;
+			else if (cp < 0x800)
+				out += (char)(0xC0 | cp >> 6), out += (char)(0x80 | (cp & 0x3F));
+			else out += (char)(0xE0 | cp >> 12), out += (char)(0x80 | (cp >> 6 & 0x3F)), out += (char)(0x80 | (cp & 0x3F));
+			break;
+		}
+		default: out += c;
+		}
+	}
+	return out;
+}
+
+static IObject* ScriptParse(const std::string& aText) {
+	static const std::regex scalar("(null|false|true|-?\\d+(\\.\\d*)?([eE][-+]\\d+)?)\\s*[,}\\]\\r\\n]");
+	static const char* space = " \t\r\n";
+	std::vector<IObject*> stack;
+	IObject* root = nullptr, * container = nullptr;
+	bool is_array = false, have_key = false, escaped = false, quoted;
+	std::string key, pending;
+	// Adds a value to the current container, under the last key if it is a Map.
+	auto add = [&](HostValue aValue) {
+		if (is_array)
+			static_cast<HostArray*>(container)->Push(aValue);
+		else if (have_key)
+			static_cast<HostMap*>(container)->Set(HostValue(HostWiden(key)), aValue), key.clear(), have_key = false;
+	};
+
+	size_t start = aText.find_first_not_of(space), end;
+	if (start == std::string::npos || (aText[start] != '{' && aText[start] != '['))
+		return nullptr;
+	is_array = aText[start] == '[';
+	root = container = is_array ? (IObject*)new HostArray : new HostMap;
+	stack.push_back(container);
+	start = aText.find_first_not_of(space, start + 1);
+	// Toggled before each piece, so this is whether the first piece is outside a string.
+	quoted = start == std::string::npos || aText[start] != '"';
+	if (!quoted)
+		++start;
+	for (; start != std::string::npos && start <= aText.size(); start = end == std::string::npos ? end : end + 1) {
+		end = aText.find('"', start);
+		std::string piece = aText.substr(start, end == std::string::npos ? end : end - start);
+		quoted = escaped || !quoted;
+		size_t slashes = 0;
+		while (slashes < piece.size() && piece[piece.size() - 1 - slashes] == '\\')
+			++slashes;
+		escaped = quoted && (slashes & 1);
+		if (quoted) {
+			if (escaped) {
+				pending += piece + '"';
+				continue;
+			}
+			std::string text = pending + piece;
+			pending.clear();
+			if (text.find('\\') != std::string::npos)
+				text = ScriptUnescape(text);
+			if (is_array || have_key)
+				add(HostValue(HostWiden(text)));
+			else
+				key = text;
+			continue;
+		}
+		size_t first = piece.find_first_not_of(space);
+		if (first == std::string::npos)
+			continue;
+		std::string t = piece.substr(first, piece.find_last_not_of(space) - first + 1);
+		if (t == "," || (t == ":" && (have_key = true)))
+			continue;
+		size_t skip = 0;
+		for (size_t i = 0; i < t.size(); ++i) {
+			char c = t[i];
+			if (skip && skip--)
+				continue;
+			if (strchr(space, c))
+				continue;
+			if (c == '{' || c == '[') {
+				IObject* child = c == '[' ? (IObject*)new HostArray : new HostMap;
+				add(HostValue(child));
+				child->Release();
+				stack.push_back(container = child);
+				is_array = c == '[', have_key = false;
+			}
+			else if (c == ']' || c == '}') {
+				stack.pop_back();
+				container = stack.empty() ? nullptr : stack.back();
+				is_array = container && !_tcscmp(container->Type(), _T("Array"));
+			}
+			else if (c != ',' && !(c == ':' && (have_key = true))) {
+				std::smatch m;
+				if (!std::regex_search(t.cbegin() + i, t.cend(), m, scalar, std::regex_constants::match_continuous))
+					break;
+				skip = m.length(0) - 2;
+				std::string r = m.str(1);
+				if (r == "null")
+					add(HostValue(_T("")));
+				else if (r == "true" || r == "false")
+					add(HostValue((__int64)(r == "true")));
+				else if (r.find_first_of(".eE") != std::string::npos)
+					add(HostValue(strtod(r.c_str(), nullptr)));
+				else add(HostValue((__int64)strtoll(r.c_str(), nullptr, 10)));
+			}
+		}
+	}
+	return root;
+}
+
+static void BenchShape(HostModule& aModule, const char* aShape, std::vector<TCHAR>& aText, const std::string& aUtf8) {
+	char name[64];
+	double chars = (double)(aText.size() - 1);
+	double mb = chars * sizeof(TCHAR) / 1e6;
+	double rss = BenchPeakRss();
+	IObject* obj = nullptr;
+	double t = BenchTime([&] {
+		if (obj)
+			obj->Release();
+		HostResult r = aModule.Call(_T("parse"), { aText });
+		obj = r.Obj();
+		r.symbol = SYM_INTEGER; // Take the reference.
+	});
+	CHECK(obj != nullptr);
+	if (!obj)
+		return;
+	snprintf(name, sizeof(name), "parse %s", aShape);
+	BenchReport(name, chars, "MB/s", mb / t);
+	snprintf(name, sizeof(name), "parse %s peak RSS growth", aShape);
+	BenchReport(name, chars, "MB", (BenchPeakRss() - rss) / 1e6);
+	if (aUtf8.size() < (32 << 20)) { // The 16 MB documents run a little over.
+		IObject* script = nullptr;
+		double script_t = BenchTime([&] {
+			if (script)
+				script->Release();
+			script = ScriptParse(aUtf8);
+		}, 1);
+		snprintf(name, sizeof(name), "parse %s JSON.ahk baseline", aShape);
+		BenchReport(name, chars, "MB/s", mb / script_t);
+		snprintf(name, sizeof(name), "parse %s speedup", aShape);
+		BenchReport(name, chars, "x", script_t / t);
+		// Both must build the same objects.
+		CHECK(script != nullptr);
+		if (script) {
+			CHECK(aModule.Call(_T("stringify"), { script, 0, _T("") }).Str() == aModule.Call(_T("stringify"), { obj, 0, _T("") }).Str());
+			script->Release();
+		}
+	}
+
+	// Compact output is canonical, so a second round trip must reproduce it exactly.
+	std::string compact;
+	size_t compact_chars = 0;
+	t = BenchTime([&] {
+		HostResult r = aModule.Call(_T("stringify"), { obj, 0, _T("") });
+		compact = r.Str();
+		compact_chars = r.symbol == SYM_STRING ? r.marker_length : 0;
+	});
+	snprintf(name, sizeof(name), "stringify %s", aShape);
+	BenchReport(name, (double)compact_chars, "MB/s", compact_chars * sizeof(TCHAR) / 1e6 / t);
+	size_t indented = 0;
+	t = BenchTime([&] {
+		HostResult r = aModule.Call(_T("stringify"), { obj });
+		indented = r.symbol == SYM_STRING ? r.marker_length : 0;
+	});
+	snprintf(name, sizeof(name), "stringify %s indented", aShape);
+	BenchReport(name, (double)indented, "MB/s", indented * sizeof(TCHAR) / 1e6 / t);
+	obj->Release();
+
+	auto wide = HostWiden(compact);
+	HostResult again = aModule.Call(_T("parse"), { wide });
+	CHECK(again.Obj() != nullptr);
+	if (again.Obj()) {
+		HostResult r = aModule.Call(_T("stringify"), { again.Obj(), 0, _T("") });
+		CHECK(r.Str() == compact);
+	}
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "json");
+	HostModule module;
+	const size_t sizes[] = { 1 << 20, 16 << 20, 128 << 20, 500 << 20 };
+	// A parsed record holds about 10 bytes per char, with the text, its copies and a second
+	// parse beside it.
+	const double bytes_per_char = 32, available = (double)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+	for (size_t size : sizes) {
+		if (sBench.quick)
+			size = 64 << 10;
+		else if (size * bytes_per_char > available) {
+			fprintf(stderr, "skipped %zu MB: needs about %.0f MB of %.0f MB available\n", size >> 20, size * bytes_per_char / 1e6, available / 1e6);
+			continue;
+		}
+		GenFn gens[] = { GenRecord, GenNumber, GenString };
+		const char* shapes[] = { "records", "numbers", "strings" };
+		for (int i = 0; i < 3; ++i) {
+			std::string utf8 = GenDocument(size, gens[i]);
+			auto text = HostWiden(utf8);
+			BenchShape(module, shapes[i], text, utf8);
+		}
+		if (sBench.quick)
+			break;
+	}
+	return BenchExit();
+}
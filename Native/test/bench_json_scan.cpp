@@ -0,0 +1,153 @@
+// Benchmarks of the simd.h scanning kernels used by json.cpp, in chars per TSC cycle for each
+// path (AVX2, SSE2 and scalar): the JSON structural index, ScanQuote/ScanEscape, and UTF-16 <->
+// UTF-8 transcoding.  Every path must produce the same output as the scalar one.  parse is
+// also timed with the index disabled, to show what it saves.
+#include "../json.cpp"
+#include "host.h"
+#include "bench.h"
+
+static void Add(std::vector<TCHAR>& aDoc, const char* aText) {
+	while (*aText)
+		aDoc.push_back((TCHAR)(unsigned char)*aText++);
+}
+
+// An array of records, pretty-printed or compact, optionally with non-ASCII chars in the strings.
+static std::vector<TCHAR> Document(size_t aRecords, bool aPretty, bool aUnicode) {
+	std::vector<TCHAR> doc;
+	char num[32];
+	Add(doc, "[");
+	for (size_t i = 0; i < aRecords; ++i) {
+		snprintf(num, sizeof(num), "%zu", i);
+		Add(doc, i ? "," : "");
+		Add(doc, aPretty ? "\n  {\n    \"id\": " : "{\"id\":");
+		Add(doc, num);
+		Add(doc, aPretty ? ",\n    \"name\": \"item " : ",\"name\":\"item ");
+		Add(doc, num);
+		if (aUnicode)
+			doc.push_back(0x4E2D), doc.push_back(0xE9), doc.push_back(0xD83D), doc.push_back(0xDE00);
+		Add(doc, aPretty ? " \\\"q\\\"\",\n    \"tags\": [\"a\", \"bb\", \"ccc\"], \"v\": 1.25, \"ok\": true\n  }"
+			: " \\\"q\\\"\",\"tags\":[\"a\",\"bb\",\"ccc\"],\"v\":1.25,\"ok\":true}");
+	}
+	Add(doc, aPretty ? "\n]" : "]");
+	doc.push_back(0);
+	return doc;
+}
+
+static size_t NoIndex(const TCHAR*, size_t, UINT64*) { return 0; }
+
+static void BenchIndex(const char* aDoc, std::vector<TCHAR>& aText) {
+	struct { const char* name; JsonIndexType index; int needs; } paths[] = {
+		{ "avx2+clmul", JsonIndexBlocks<JsonClassify_AVX2, PrefixXor_CLMUL>, CPU_AVX2 | CPU_PCLMUL },
+		{ "sse2", JsonIndexBlocks<JsonClassify_SSE2, PrefixXor_Scalar>, CPU_SSE2 },
+		{ "scalar", JsonIndexBlocks<JsonClassify_Scalar, PrefixXor_Scalar>, 0 },
+	};
+	size_t n = aText.size() - 1;
+	std::vector<UINT64> expected(n / JSON_BLOCK + 1), mask(n / JSON_BLOCK + 1);
+	size_t expected_length = JsonIndexBlocks<JsonClassify_Scalar, PrefixXor_Scalar>(aText.data(), n, expected.data());
+	CHECK_EQ(expected_length, n);
+	char name[96];
+	for (auto& path : paths) {
+		if ((CpuFeatures() & path.needs) != path.needs)
+			continue;
+		size_t length = 0;
+		double cycles = BenchCycles([&] { length = path.index(aText.data(), n, mask.data()); }, 5);
+		CHECK_EQ(length, expected_length);
+		CHECK(mask == expected);
+		snprintf(name, sizeof(name), "JsonIndex %s %s", aDoc, path.name);
+		BenchReport(name, (double)n, "chars/cycle", n / cycles);
+	}
+}
+
+static void BenchParse(HostModule& aModule, const char* aDoc, std::vector<TCHAR>& aText) {
+	JsonIndexType index = JsonIndex;
+	char name[96];
+	for (int use = 1; use >= 0; --use) {
+		JsonIndex = use ? index : NoIndex;
+		bool ok = true;
+		double cycles = BenchCycles([&] {
+			HostResult r = aModule.Call(_T("parse"), { aText });
+			ok = ok && r.Obj();
+		}, 5);
+		CHECK(ok);
+		snprintf(name, sizeof(name), "parse %s %s", aDoc, use ? "indexed" : "unindexed");
+		BenchReport(name, (double)(aText.size() - 1), "chars/cycle", (aText.size() - 1) / cycles);
+	}
+	JsonIndex = index;
+}
+
+// A run of plain chars ending in the char searched for.
+static void BenchScan() {
+	struct { const char* name; ScanCharsType quote, escape; int needs; } paths[] = {
+		{ "avx2", ScanQuote_AVX2, ScanEscape_AVX2, CPU_AVX2 },
+		{ "sse2", ScanQuote_SSE2, ScanEscape_SSE2, CPU_SSE2 },
+		{ "scalar", ScanQuote_Scalar, ScanEscape_Scalar, 0 },
+	};
+	std::vector<TCHAR> text(BenchSize<size_t>(1 << 20, 1 << 14), 'a');
+	TCHAR* end = text.data() + text.size();
+	char name[64];
+	for (auto& path : paths) {
+		if ((CpuFeatures() & path.needs) != path.needs)
+			continue;
+		for (TCHAR c : { '"', '\\' }) {
+			ScanCharsType scan = c == '"' ? path.quote : path.escape;
+			text.back() = c;
+			TCHAR* found = nullptr;
+			double cycles = BenchCycles([&] { found = scan(text.data(), end); }, 5);
+			CHECK(found == end - 1);
+			snprintf(name, sizeof(name), "%s %s", c == '"' ? "ScanQuote" : "ScanEscape", path.name);
+			BenchReport(name, (double)text.size(), "chars/cycle", text.size() / cycles);
+			text.back() = 'a';
+		}
+	}
+}
+
+static void BenchTranscode(const char* aDoc, std::vector<TCHAR>& aText) {
+	struct { const char* name; Utf8LengthType length; Utf16ToUtf8Type encode; Utf8ToUtf16Type decode; int needs; } paths[] = {
+		{ "avx2", Utf8Length_AVX2, Utf16ToUtf8_AVX2, Utf8ToUtf16_AVX2, CPU_AVX2 },
+		{ "sse2", Utf8Length_SSE2, Utf16ToUtf8_SSE2, Utf8ToUtf16_SSE2, CPU_SSE2 },
+		{ "scalar", Utf8Length_Scalar, Utf16ToUtf8_Scalar, Utf8ToUtf16_Scalar, 0 },
+	};
+	size_t n = aText.size() - 1;
+	const WCHAR* str = (const WCHAR*)aText.data(), * str_end = str + n;
+	size_t expected = Utf8Length_Scalar(str, str_end);
+	std::vector<char> utf8(expected);
+	std::vector<WCHAR> utf16(expected);
+	char name[96];
+	for (auto& path : paths) {
+		if ((CpuFeatures() & path.needs) != path.needs)
+			continue;
+		size_t length = 0;
+		char* end = nullptr;
+		WCHAR* wend = nullptr;
+		double cycles = BenchCycles([&] { length = path.length(str, str_end); }, 5);
+		CHECK_EQ(length, expected);
+		snprintf(name, sizeof(name), "Utf8Length %s %s", aDoc, path.name);
+		BenchReport(name, (double)n, "chars/cycle", n / cycles);
+		cycles = BenchCycles([&] { end = path.encode(str, str_end, utf8.data()); }, 5);
+		CHECK_EQ((size_t)(end - utf8.data()), expected);
+		snprintf(name, sizeof(name), "Utf16ToUtf8 %s %s", aDoc, path.name);
+		BenchReport(name, (double)n, "chars/cycle", n / cycles);
+		cycles = BenchCycles([&] { wend = path.decode(utf8.data(), end, utf16.data()); }, 5);
+		CHECK_EQ((size_t)(wend - utf16.data()), n);
+		CHECK(!memcmp(utf16.data(), str, n * sizeof(WCHAR)));
+		snprintf(name, sizeof(name), "Utf8ToUtf16 %s %s", aDoc, path.name);
+		BenchReport(name, (double)n, "chars/cycle", n / cycles);
+	}
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "json_scan");
+	HostModule module;
+	size_t records = BenchSize<size_t>(60000, 2000);
+	struct { const char* name; bool pretty, unicode; } docs[] = {
+		{ "compact", false, false }, { "pretty", true, false }, { "compact-unicode", false, true },
+	};
+	for (auto& doc : docs) {
+		auto text = Document(records, doc.pretty, doc.unicode);
+		BenchIndex(doc.name, text);
+		BenchParse(module, doc.name, text);
+		BenchTranscode(doc.name, text);
+	}
+	BenchScan();
+	return BenchExit();
+}
@@ -0,0 +1,239 @@
+// Benchmarks of typed members and MemberHash dispatch against the hand-written pattern they
+// replace: one method per class with a switch on aID, converting each parameter itself, and an
+// Invoke which compares the name against each member with _tcsicmp.  The class has ten members,
+// and the same bodies behind both.  Reports ns per call through the ObjectMember for four
+// signatures, and ns per Invoke by name, over all ten names and for the last of them.
+#include "../ahk2_types.h"
+#include "bench.h"
+
+class Calc : public ObjectBase
+{
+public:
+	enum MemberID { M_Add, M_Sub, M_Mul, M_Min, M_Max, M_Scale, M_Clamp, M_Length, M_Count, M_Reset };
+	__int64 mCount = 0;
+
+	__int64 Add(__int64 a, __int64 b) { return ++mCount, a + b; }
+	__int64 Sub(__int64 a, __int64 b) { return ++mCount, a - b; }
+	__int64 Mul(__int64 a, __int64 b) { return ++mCount, a * b; }
+	double Min(double a, double b) { return ++mCount, a < b ? a : b; }
+	double Max(double a, double b) { return ++mCount, a > b ? a : b; }
+	double Scale(double aValue, Optional<double> aFactor) { return ++mCount, aValue * aFactor.value_or(2.0); }
+	double Clamp(double aValue, double aLow, double aHigh) { return ++mCount, aValue < aLow ? aLow : aValue > aHigh ? aHigh : aValue; }
+	__int64 Length(StrRef aText) { return ++mCount, (__int64)aText.length; }
+	__int64 GetCount() { return mCount; }
+	void Reset() { mCount = 0; }
+
+	// The hand-written member: every parameter converted and checked by the case which needs it.
+	void Call(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		ExprTokenType a, b, c;
+		switch (aID)
+		{
+		case M_Add:
+		case M_Sub:
+		case M_Mul:
+			if (!TokenToNumber(*aParam[0], a) || a.symbol != SYM_INTEGER || !TokenToNumber(*aParam[1], b) || b.symbol != SYM_INTEGER)
+				return TypeError(aResultToken, _T("Expected an Integer."));
+			aResultToken.SetValue(aID == M_Add ? Add(a.value_int64, b.value_int64)
+				: aID == M_Sub ? Sub(a.value_int64, b.value_int64) : Mul(a.value_int64, b.value_int64));
+			return;
+		case M_Min:
+		case M_Max:
+			if (!TokenToNumber(*aParam[0], a) || !TokenToNumber(*aParam[1], b))
+				return TypeError(aResultToken, _T("Expected a Number."));
+			aResultToken.SetValue(aID == M_Min ? Min(ToDouble(a), ToDouble(b)) : Max(ToDouble(a), ToDouble(b)));
+			return;
+		case M_Scale: {
+			Optional<double> factor;
+			if (!TokenToNumber(*aParam[0], a))
+				return TypeError(aResultToken, _T("Expected a Number."));
+			if (aParamCount > 1 && aParam[1]->symbol != SYM_MISSING) {
+				if (!TokenToNumber(*aParam[1], b))
+					return TypeError(aResultToken, _T("Expected a Number."));
+				factor.value = ToDouble(b), factor.has_value = true;
+			}
+			aResultToken.SetValue(Scale(ToDouble(a), factor));
+			return;
+		}
+		case M_Clamp:
+			if (!TokenToNumber(*aParam[0], a) || !TokenToNumber(*aParam[1], b) || !TokenToNumber(*aParam[2], c))
+				return TypeError(aResultToken, _T("Expected a Number."));
+			aResultToken.SetValue(Clamp(ToDouble(a), ToDouble(b), ToDouble(c)));
+			return;
+		case M_Length: {
+			StrRef text;
+			if (!BorrowString(*aParam[0], text))
+				return TypeError(aResultToken, _T("Expected a String."));
+			aResultToken.SetValue(Length(text));
+			return;
+		}
+		case M_Count: aResultToken.SetValue(GetCount()); return;
+		case M_Reset: Reset(); return;
+		}
+	}
+
+private:
+	static double ToDouble(ExprTokenType& aNumber) { return aNumber.symbol == SYM_INTEGER ? (double)aNumber.value_int64 : aNumber.value_double; }
+	static void TypeError(ResultToken& aResultToken, LPTSTR aMessage) {
+		Object::Error(ExprTokenType(aMessage), nullptr, _T("TypeError"));
+		aResultToken.result = FAIL;
+	}
+};
+
+constexpr ObjectMember sTypedMembers[] = {
+	Member_TypedMethod(Add, Calc, Add),
+	Member_TypedMethod(Sub, Calc, Sub),
+	Member_TypedMethod(Mul, Calc, Mul),
+	Member_TypedMethod(Min, Calc, Min),
+	Member_TypedMethod(Max, Calc, Max),
+	Member_TypedMethod(Scale, Calc, Scale),
+	Member_TypedMethod(Clamp, Calc, Clamp),
+	Member_TypedMethod(Length, Calc, Length),
+	Member_TypedGet(Count, Calc, GetCount),
+	Member_TypedMethod(Reset, Calc, Reset),
+};
+constexpr MemberHash<_countof(sTypedMembers)> sTypedLookup(sTypedMembers);
+static_assert(sTypedLookup.Valid(), "The benchmark's member names need another hash seed.");
+
+#define SWITCH_MEMBER(name, invoke_type, min, max) { (LPTSTR)_T(#name), static_cast<ObjectMethod>(&Calc::Call), Calc::M_##name, invoke_type, min, max }
+static const ObjectMember sSwitchMembers[] = {
+	SWITCH_MEMBER(Add, IT_CALL, 2, 2),
+	SWITCH_MEMBER(Sub, IT_CALL, 2, 2),
+	SWITCH_MEMBER(Mul, IT_CALL, 2, 2),
+	SWITCH_MEMBER(Min, IT_CALL, 2, 2),
+	SWITCH_MEMBER(Max, IT_CALL, 2, 2),
+	SWITCH_MEMBER(Scale, IT_CALL, 1, 2),
+	SWITCH_MEMBER(Clamp, IT_CALL, 3, 3),
+	SWITCH_MEMBER(Length, IT_CALL, 1, 1),
+	SWITCH_MEMBER(Count, IT_GET, 0, 0),
+	SWITCH_MEMBER(Reset, IT_CALL, 0, 0),
+};
+
+// Dispatched by MemberHash.
+class TypedCalc : public Calc
+{
+public:
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+		return sTypedLookup.Invoke(this, aResultToken, aFlags, aName, aParam, aParamCount);
+	}
+};
+
+// Dispatched by comparing the name with each member's in turn.
+class SwitchCalc : public Calc
+{
+public:
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+		for (auto& member : sSwitchMembers) {
+			if (!aName || _tcsicmp(aName, member.name))
+				continue;
+			if (member.invokeType != (aFlags & IT_BITMASK))
+				return INVOKE_NOT_HANDLED;
+			if (aParamCount < member.minParams || aParamCount > member.maxParams) {
+				Object::Error(ExprTokenType((LPTSTR)(aParamCount < member.minParams ? _T("Too few parameters passed to function.")
+					: _T("Too many parameters passed to function."))), aName);
+				return aResultToken.result = FAIL;
+			}
+			(this->*member.method)(aResultToken, member.id, aFlags, aParam, aParamCount);
+			return aResultToken.result;
+		}
+		return INVOKE_NOT_HANDLED;
+	}
+};
+
+static ExprTokenType sArgs[3];
+static ExprTokenType* sParams[] = { &sArgs[0], &sArgs[1], &sArgs[2] };
+
+static void SetArgs(int aID) {
+	static TCHAR text[] = _T("some text");
+	switch (aID) {
+	case Calc::M_Length: sArgs[0].SetValue(text, 9); break;
+	case Calc::M_Scale: sArgs[0].SetValue(1.5), sArgs[1].SetValue((__int64)4); break;
+	case Calc::M_Min: case Calc::M_Max: case Calc::M_Clamp:
+		sArgs[0].SetValue(5.0), sArgs[1].SetValue((__int64)1), sArgs[2].SetValue(3.0); break;
+	default: sArgs[0].SetValue((__int64)7), sArgs[1].SetValue((__int64)6); break;
+	}
+}
+
+static double ResultValue(ResultToken& aResult) {
+	return aResult.symbol == SYM_FLOAT ? aResult.value_double : aResult.symbol == SYM_INTEGER ? (double)aResult.value_int64 : 0;
+}
+
+// A call through each table's ObjectMember, as the script calls a member it has resolved.
+static void BenchCall(const char* aCase, int aID, int aParamCount, double aExpected, size_t aCalls) {
+	TCHAR buf[MAX_NUMBER_SIZE];
+	char name[96];
+	Calc calc;
+	for (auto table : { sTypedMembers, sSwitchMembers }) {
+		const ObjectMember& member = table[aID];
+		double total = 0;
+		SetArgs(aID);
+		double t = BenchTime([&] {
+			total = 0;
+			for (size_t i = 0; i < aCalls; ++i) {
+				ResultToken result;
+				result.InitResult(buf);
+				(calc.*member.method)(result, member.id, member.invokeType, sParams, aParamCount);
+				total += ResultValue(result);
+			}
+		});
+		CHECK_EQ(total, aExpected * aCalls);
+		snprintf(name, sizeof(name), "%s %s", table == sTypedMembers ? "typed" : "aID switch", aCase);
+		BenchReport(name, (double)aCalls, "ns/call", t * 1e9 / aCalls);
+	}
+}
+
+// The number of parameters SetArgs() sets up for each member.
+static const int sParamCounts[] = { 2, 2, 2, 2, 2, 2, 3, 1, 0, 0 };
+
+// Invoke by name, from the first member to aLast, round robin.
+static void BenchInvoke(const char* aCase, IObject* aObj, int aFirst, int aLast, size_t aCalls) {
+	TCHAR buf[MAX_NUMBER_SIZE];
+	char name[96];
+	ExprTokenType this_token(aObj);
+	std::vector<int> order;
+	for (size_t i = 0; i < aCalls; ++i)
+		order.push_back(aFirst + (int)(i % (aLast - aFirst + 1)));
+	double t = BenchTime([&] {
+		for (int id : order) {
+			SetArgs(id);
+			ResultToken result;
+			result.InitResult(buf);
+			auto& member = sTypedMembers[id];
+			CHECK(aObj->Invoke(result, member.invokeType, member.name, this_token, sParams, sParamCounts[id]) == OK);
+		}
+	});
+	snprintf(name, sizeof(name), "%s %s", aCase, aFirst == aLast ? "last name" : "all names");
+	BenchReport(name, (double)aCalls, "ns/call", t * 1e9 / aCalls);
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "members");
+	const size_t calls = BenchSize<size_t>(10000000, 100000);
+	BenchCall("Add(7, 6)", Calc::M_Add, 2, 13, calls);
+	BenchCall("Scale(1.5, 4)", Calc::M_Scale, 2, 6, calls);
+	BenchCall("Clamp(5.0, 1, 3.0)", Calc::M_Clamp, 3, 3, calls);
+	BenchCall("Length(str)", Calc::M_Length, 1, 9, calls);
+
+	auto typed = new TypedCalc;
+	auto switched = new SwitchCalc;
+	for (IObject* obj : { (IObject*)typed, (IObject*)switched }) {
+		const char* kind = obj == typed ? "MemberHash Invoke" : "_tcsicmp chain Invoke";
+		BenchInvoke(kind, obj, 0, _countof(sTypedMembers) - 1, calls);
+		BenchInvoke(kind, obj, _countof(sTypedMembers) - 1, _countof(sTypedMembers) - 1, calls);
+	}
+	// Both dispatch the same names, caselessly, to the same members.
+	for (IObject* obj : { (IObject*)typed, (IObject*)switched }) {
+		TCHAR buf[MAX_NUMBER_SIZE];
+		ExprTokenType this_token(obj);
+		ResultToken result;
+		result.InitResult(buf);
+		SetArgs(Calc::M_Mul);
+		CHECK(obj->Invoke(result, IT_CALL, (LPTSTR)_T("mUL"), this_token, sParams, 2) == OK && ResultValue(result) == 42);
+		result.InitResult(buf);
+		CHECK(obj->Invoke(result, IT_CALL, (LPTSTR)_T("Divide"), this_token, sParams, 2) == INVOKE_NOT_HANDLED);
+		result.InitResult(buf);
+		CHECK(obj->Invoke(result, IT_CALL, (LPTSTR)_T("Count"), this_token, sParams, 0) == INVOKE_NOT_HANDLED);
+	}
+	typed->Release();
+	switched->Release();
+	return BenchExit();
+}
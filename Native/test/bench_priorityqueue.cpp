@@ -0,0 +1,245 @@
+// Benchmarks of priorityqueue.cpp on 10M operations: pushes then pops, a steady push/pop mix,
+// Update (decrease-key) through handles and Heapify, with integer and string priorities.  The
+// reference is the binary heap a script builds from an Array, swapping items in place; run
+// here as C++ on the same Variants, it is a lower bound on what the script pays.
+#include "../priorityqueue.cpp"
+#include "host.h"
+#include "bench.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+static std::mt19937_64 sRandom(5);
+
+struct QueueMembers
+{
+	const ObjectMember* push, * pop, * peek, * update, * has, * heapify, * count;
+	QueueMembers(HostModule& aModule)
+		: push(aModule.Member(_T("PriorityQueue.Prototype.Push"))), pop(aModule.Member(_T("PriorityQueue.Prototype.Pop")))
+		, peek(aModule.Member(_T("PriorityQueue.Prototype.Peek"))), update(aModule.Member(_T("PriorityQueue.Prototype.Update")))
+		, has(aModule.Member(_T("PriorityQueue.Prototype.Has"))), heapify(aModule.Member(_T("PriorityQueue.Prototype.Heapify")))
+		, count(aModule.Member(_T("PriorityQueue.Prototype.Count"), IT_GET)) {}
+};
+
+// The script's heap: parallel Arrays of priorities and values, sifted one swap at a time.
+struct ScriptHeap
+{
+	HostArray priorities, values;
+
+	static bool Less(Object::Variant& a, Object::Variant& b) {
+		if (a.symbol == SYM_STRING)
+			return _tcscmp(a.string.Value(), b.string.Value()) < 0;
+		return a.n_int64 < b.n_int64;
+	}
+	void Swap(Object::index_t a, Object::index_t b) {
+		std::swap(priorities.mItem[a], priorities.mItem[b]);
+		std::swap(values.mItem[a], values.mItem[b]);
+	}
+	void Push(ExprTokenType& aValue, ExprTokenType& aPriority) {
+		values.Push(aValue);
+		priorities.Push(aPriority);
+		for (Object::index_t i = priorities.mLength - 1; i; ) {
+			Object::index_t parent = (i - 1) / 2;
+			if (!Less(priorities.mItem[i], priorities.mItem[parent]))
+				break;
+			Swap(i, parent);
+			i = parent;
+		}
+	}
+	__int64 Pop() {
+		Object::index_t last = --priorities.mLength;
+		--values.mLength;
+		Swap(0, last);
+		__int64 value = values.mItem[last].n_int64;
+		HostFree(priorities.mItem[last]);
+		HostFree(values.mItem[last]);
+		for (Object::index_t i = 0; ; ) {
+			Object::index_t c = i * 2 + 1;
+			if (c >= last)
+				break;
+			if (c + 1 < last && Less(priorities.mItem[c + 1], priorities.mItem[c]))
+				++c;
+			if (!Less(priorities.mItem[c], priorities.mItem[i]))
+				break;
+			Swap(i, c);
+			i = c;
+		}
+		return value;
+	}
+};
+
+// Pushes aPriorities[i] with value i, then pops them all, which must give aOrder.
+static void BenchPushPop(HostModule& aModule, QueueMembers& aMembers, const char* aKind, std::vector<HostValue>& aPriorities, std::vector<__int64>& aOrder) {
+	char name[96];
+	size_t count = aPriorities.size();
+	std::vector<HostValue> values;
+	for (size_t i = 0; i < count; ++i)
+		values.emplace_back((__int64)i);
+	std::vector<__int64> popped(count);
+
+	IObject* pq = aModule.New(_T("PriorityQueue"));
+	double t = BenchNow();
+	for (size_t i = 0; i < count; ++i) {
+		ExprTokenType* params[] = { &values[i], &aPriorities[i] };
+		aModule.Invoke(pq, aMembers.push, params, 2);
+	}
+	for (size_t i = 0; i < count; ++i)
+		popped[i] = aModule.Invoke(pq, aMembers.pop, nullptr, 0).Int();
+	t = BenchNow() - t;
+	CHECK(popped == aOrder);
+	snprintf(name, sizeof(name), "PriorityQueue push + pop %s", aKind);
+	BenchReport(name, (double)count * 2, "Mops/s", count * 2 / t / 1e6);
+
+	// Heapify from an Array of values and one of priorities, then pop.
+	auto value_arr = new HostArray, priority_arr = new HostArray;
+	value_arr->Reserve((Object::index_t)count), priority_arr->Reserve((Object::index_t)count);
+	for (size_t i = 0; i < count; ++i)
+		value_arr->Push(values[i]), priority_arr->Push(aPriorities[i]);
+	t = BenchNow();
+	aModule.Invoke(pq, aMembers.heapify, { (IObject*)value_arr, (IObject*)priority_arr });
+	t = BenchNow() - t;
+	CHECK_EQ(aModule.Invoke(pq, aMembers.count).Int(), (__int64)count);
+	snprintf(name, sizeof(name), "PriorityQueue heapify %s", aKind);
+	BenchReport(name, (double)count, "Mitems/s", count / t / 1e6);
+	for (size_t i = 0; i < count; ++i)
+		popped[i] = aModule.Invoke(pq, aMembers.pop, nullptr, 0).Int();
+	CHECK(popped == aOrder);
+	value_arr->Release(), priority_arr->Release();
+	pq->Release();
+
+	ScriptHeap heap;
+	heap.priorities.Reserve(16), heap.values.Reserve(16);
+	t = BenchNow();
+	for (size_t i = 0; i < count; ++i)
+		heap.Push(values[i], aPriorities[i]);
+	for (size_t i = 0; i < count; ++i)
+		popped[i] = heap.Pop();
+	t = BenchNow() - t;
+	CHECK(popped == aOrder);
+	snprintf(name, sizeof(name), "Array heap push + pop %s", aKind);
+	BenchReport(name, (double)count * 2, "Mops/s", count * 2 / t / 1e6);
+}
+
+// A queue held at aSize items while pushing and popping aOps times, as a scheduler does.
+static void BenchSteady(HostModule& aModule, QueueMembers& aMembers, size_t aSize, size_t aOps) {
+	std::vector<HostValue> priorities;
+	for (size_t i = 0; i < aSize + aOps / 2; ++i)
+		priorities.emplace_back((__int64)(sRandom() >> 1));
+	HostValue value((__int64)0);
+	IObject* pq = aModule.New(_T("PriorityQueue"));
+	for (size_t i = 0; i < aSize; ++i) {
+		ExprTokenType* params[] = { &value, &priorities[i] };
+		aModule.Invoke(pq, aMembers.push, params, 2);
+	}
+	double t = BenchNow();
+	for (size_t i = aSize; i < priorities.size(); ++i) {
+		ExprTokenType* params[] = { &value, &priorities[i] };
+		aModule.Invoke(pq, aMembers.push, params, 2);
+		aModule.Invoke(pq, aMembers.pop, nullptr, 0);
+	}
+	t = BenchNow() - t;
+	CHECK_EQ(aModule.Invoke(pq, aMembers.count).Int(), (__int64)aSize);
+	BenchReport("PriorityQueue steady push/pop", (double)aSize, "Mops/s", (priorities.size() - aSize) * 2 / t / 1e6);
+	pq->Release();
+
+	ScriptHeap heap;
+	for (size_t i = 0; i < aSize; ++i)
+		heap.Push(value, priorities[i]);
+	t = BenchNow();
+	for (size_t i = aSize; i < priorities.size(); ++i) {
+		heap.Push(value, priorities[i]);
+		heap.Pop();
+	}
+	t = BenchNow() - t;
+	BenchReport("Array heap steady push/pop", (double)aSize, "Mops/s", (priorities.size() - aSize) * 2 / t / 1e6);
+}
+
+// Decrease-key: lowers random items' priorities through their handles, as Dijkstra does.
+static void BenchUpdate(HostModule& aModule, QueueMembers& aMembers, size_t aSize, size_t aOps) {
+	std::vector<HostValue> handles;
+	std::vector<__int64> current(aSize);
+	IObject* pq = aModule.New(_T("PriorityQueue"));
+	for (size_t i = 0; i < aSize; ++i) {
+		current[i] = (__int64)(sRandom() >> 2) + ((__int64)1 << 61);
+		HostValue value((__int64)i), priority(current[i]);
+		ExprTokenType* params[] = { &value, &priority };
+		handles.emplace_back(aModule.Invoke(pq, aMembers.push, params, 2).Int());
+	}
+	std::vector<std::pair<size_t, HostValue>> updates;
+	for (size_t i = 0; i < aOps; ++i) {
+		size_t item = sRandom() % aSize;
+		current[item] -= (__int64)(sRandom() % 1000000) + 1;
+		updates.emplace_back(item, HostValue(current[item]));
+	}
+	double t = BenchNow();
+	for (auto& u : updates) {
+		ExprTokenType* params[] = { &handles[u.first], &u.second };
+		aModule.Invoke(pq, aMembers.update, params, 2);
+	}
+	t = BenchNow() - t;
+	BenchReport("PriorityQueue update", (double)aSize, "Mops/s", aOps / t / 1e6);
+
+	size_t best = 0;
+	for (size_t i = 1; i < aSize; ++i)
+		if (current[i] < current[best])
+			best = i;
+	HostResult top = aModule.Invoke(pq, aMembers.pop, nullptr, 0);
+	CHECK_EQ(top.Int(), (__int64)best);
+	ExprTokenType* params[] = { &handles[best] };
+	CHECK_EQ(aModule.Invoke(pq, aMembers.has, params, 1).Int(), 0); // Its handle is stale now.
+	pq->Release();
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "priorityqueue");
+	HostModule module;
+	QueueMembers members(module);
+	CHECK(members.push && members.pop && members.peek && members.update && members.has && members.heapify && members.count);
+	size_t count = BenchSize<size_t>(5000000, 50000); // Pushes, so 10M operations with the pops.
+
+	std::vector<HostValue> ints;
+	std::vector<std::pair<__int64, __int64>> sorted;
+	for (size_t i = 0; i < count; ++i) {
+		__int64 p = (__int64)(sRandom() >> 1);
+		ints.emplace_back(p);
+		sorted.emplace_back(p, (__int64)i);
+	}
+	std::sort(sorted.begin(), sorted.end());
+	std::vector<__int64> order;
+	for (auto& s : sorted)
+		order.push_back(s.second);
+	BenchPushPop(module, members, "int", ints, order);
+
+	size_t str_count = count / 5;
+	std::vector<std::vector<TCHAR>> names;
+	std::vector<HostValue> strs;
+	std::vector<std::pair<std::string, __int64>> sorted_strs;
+	char buf[32];
+	for (size_t i = 0; i < str_count; ++i) {
+		snprintf(buf, sizeof(buf), "task%016llx", (unsigned long long)sRandom());
+		names.push_back(HostWiden(buf));
+		sorted_strs.emplace_back(buf, (__int64)i);
+	}
+	for (auto& n : names)
+		strs.emplace_back(n);
+	std::sort(sorted_strs.begin(), sorted_strs.end());
+	order.clear();
+	for (auto& s : sorted_strs)
+		order.push_back(s.second);
+	BenchPushPop(module, members, "string", strs, order);
+
+	BenchSteady(module, members, BenchSize<size_t>(1000000, 10000), BenchSize<size_t>(10000000, 100000));
+	BenchUpdate(module, members, BenchSize<size_t>(1000000, 10000), BenchSize<size_t>(10000000, 100000));
+
+	// Integers and floats are compared exactly beyond 2^53, and a NaN priority is refused.
+	IObject* pq = module.New(_T("PriorityQueue"));
+	module.Invoke(pq, members.push, { 1, (__int64)9007199254740993 });
+	module.Invoke(pq, members.push, { 2, 9007199254740992.0 });
+	module.Invoke(pq, members.push, { 3, 9007199254740994.0 });
+	for (__int64 expected : { 2, 1, 3 })
+		CHECK_EQ(module.Invoke(pq, members.pop, nullptr, 0).Int(), expected);
+	CHECK(module.Invoke(pq, members.push, { 4, std::nan("") }).Failed() && sHostError.type == "ValueError");
+	CHECK_EQ(module.Invoke(pq, members.count).Int(), 0);
+	pq->Release();
+	return BenchExit();
+}
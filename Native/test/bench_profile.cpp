@@ -0,0 +1,76 @@
+// Benchmarks of what AHK2_PROFILE costs, with hash.cpp as the module: ns per call of a cheap
+// function (async_limit) and member (Hasher.Prototype.Reset) through the module's export table.
+// CMake builds this twice.  bench_profile defines AHK2_PROFILE and times the calls with
+// profiling off, where each goes through a trampoline and a flag test, and on; it also calls
+// the unwrapped function and method, as a plain build's table holds them, and reports the
+// difference.  bench_profile_plain is the same benchmark built without AHK2_PROFILE.
+#include "../hash.cpp"
+#include "host.h"
+#include "bench.h"
+
+#ifdef AHK2_PROFILE
+static ProfileSlot* Slot(const char* aName) {
+	for (UINT i = 0; i < sProfiler.slot_count; ++i)
+		if (HostNarrow(sProfiler.slots[i].name) == aName)
+			return &sProfiler.slots[i];
+	return nullptr;
+}
+#endif
+
+// Reports ns per call of aFunc and of aMethod on aObj, and returns them.
+static std::pair<double, double> BenchCalls(const char* aCase, size_t aCalls, BuiltInFunctionType aFunc, IObject* aObj, ObjectMethod aMethod) {
+	char name[96];
+	__int64 sum = 0;
+	double t = BenchTime([&] {
+		for (size_t i = 0; i < aCalls; ++i) {
+			ResultToken r;
+			r.InitResult(nullptr);
+			aFunc(r, nullptr, 0);
+			sum += r.value_int64;
+		}
+	});
+	double func_ns = t * 1e9 / aCalls;
+	snprintf(name, sizeof(name), "function %s", aCase);
+	BenchReport(name, (double)aCalls, "ns/call", func_ns);
+	t = BenchTime([&] {
+		for (size_t i = 0; i < aCalls; ++i) {
+			ResultToken r;
+			r.InitResult(nullptr);
+			(aObj->*aMethod)(r, 0, IT_CALL, nullptr, 0);
+			sum += r.symbol;
+		}
+	});
+	snprintf(name, sizeof(name), "member %s", aCase);
+	BenchReport(name, (double)aCalls, "ns/call", t * 1e9 / aCalls);
+	BenchKeep(sum);
+	return { func_ns, t * 1e9 / aCalls };
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "profile");
+	HostModule module;
+	BuiltInFunctionType func = module.Func(_T("async_limit"));
+	const ObjectMember* reset = module.Member(_T("Hasher.Prototype.Reset"));
+	IObject* hasher = module.New(_T("Hasher"), { _T("xxh3") });
+	const size_t calls = BenchSize<size_t>(20000000, 200000);
+	CHECK(func && reset && hasher);
+	if (!func || !reset || !hasher)
+		return BenchExit();
+#ifdef AHK2_PROFILE
+	ProfileSlot* func_slot = Slot("async_limit"), * reset_slot = Slot("Hasher.Prototype.Reset");
+	CHECK(func_slot && reset_slot);
+	if (func_slot && reset_slot) {
+		auto direct = BenchCalls("direct", calls, func_slot->call, hasher, reset_slot->method);
+		auto off = BenchCalls("profiling off", calls, func, hasher, reset->method);
+		BenchReport("function profiling off overhead", (double)calls, "ns/call", off.first - direct.first);
+		BenchReport("member profiling off overhead", (double)calls, "ns/call", off.second - direct.second);
+		module.Call(_T("profile_start"));
+		BenchCalls("profiling on", calls, func, hasher, reset->method);
+		module.Call(_T("profile_stop"));
+	}
+#else
+	BenchCalls("plain build", calls, func, hasher, reset->method);
+#endif
+	hasher->Release();
+	return BenchExit();
+}
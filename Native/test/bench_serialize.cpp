@@ -0,0 +1,187 @@
+// Benchmarks of serialize.cpp against json.cpp, the JSON.stringify/JSON.parse round trip it
+// replaces: save and load times, file size and the memory the loaded state holds, for a tree
+// of about 500k Objects and Arrays like a script's saved state, and a lazy view which reads
+// one record.  The JSON file holds the UTF-16 text as it is, so neither side is timed
+// converting text.  Memory is measured in a child process for each load, as the growth of
+// its resident set, which for a view includes the pages of the mapped file it touched.
+#include "../serialize.cpp"
+#include "../simd.h"
+// json.cpp is compiled alongside for comparison, in a namespace of its own, and with its entry
+// point renamed so that each module is loaded by a HostModule of its own.
+#define ahk2_module_load json_module_load
+namespace json {
+#include "../json.cpp"
+}
+#undef ahk2_module_load
+#include "host.h"
+#include "bench.h"
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Calls a member of a view.
+static HostResult InvokeView(IObject* aObj, int aFlags, LPCTSTR aName, HostArgs aArgs = {}) {
+	HostResult r;
+	HostParams params(aArgs);
+	sHostError.Clear();
+	if (aObj->Invoke(r, aFlags, (LPTSTR)aName, ExprTokenType(aObj), params.ptrs.data(), (int)params.ptrs.size()) == INVOKE_NOT_HANDLED)
+		r.result = FAIL;
+	return r;
+}
+
+// { version, records: [{ id, name, score, active, tags: [3 strings], pos: { x, y } }, ...] },
+// three containers per record.  Names and tags come from small sets, as they would.
+static IObject* GenerateState(size_t aRecords) {
+	TCHAR text[32];
+	auto root = new HostObject;
+	auto records = new HostArray;
+	records->Reserve((Object::index_t)aRecords);
+	for (size_t i = 0; i < aRecords; ++i) {
+		auto rec = new HostObject, pos = new HostObject;
+		auto tags = new HostArray;
+		rec->Set(_T("id"), HostValue((__int64)i));
+		_stprintf_s(text, _countof(text), _T("user %u"), (unsigned)(i * 7919 % 1000));
+		rec->Set(_T("name"), HostValue(text));
+		rec->Set(_T("score"), HostValue((double)(i * 2654435761u % 100000) / 100));
+		rec->Set(_T("active"), HostValue((int)(i % 3 != 0)));
+		for (size_t t = 0; t < 3; ++t) {
+			_stprintf_s(text, _countof(text), _T("tag%u"), (unsigned)((i + t * 17) % 50));
+			tags->Push(HostValue(text));
+		}
+		pos->Set(_T("x"), HostValue((int)(i % 1920)));
+		pos->Set(_T("y"), HostValue((int)(i / 1920 % 1080)));
+		rec->Set(_T("tags"), HostValue((IObject*)tags));
+		rec->Set(_T("pos"), HostValue((IObject*)pos));
+		records->Push(HostValue((IObject*)rec));
+		tags->Release(), pos->Release(), rec->Release();
+	}
+	root->Set(_T("version"), HostValue(3));
+	root->Set(_T("records"), HostValue((IObject*)records));
+	records->Release();
+	return root;
+}
+
+static std::string ReadFile(const std::string& aPath) {
+	std::string bytes;
+	if (FILE* f = fopen(aPath.c_str(), "rb")) {
+		fseek(f, 0, SEEK_END);
+		bytes.resize((size_t)ftell(f));
+		fseek(f, 0, SEEK_SET);
+		if (fread(&bytes[0], 1, bytes.size(), f) != bytes.size())
+			bytes.clear();
+		fclose(f);
+	}
+	return bytes;
+}
+
+static bool WriteFile(const std::string& aPath, const void* aData, size_t aSize) {
+	FILE* f = fopen(aPath.c_str(), "wb");
+	if (!f)
+		return false;
+	bool ok = fwrite(aData, 1, aSize, f) == aSize;
+	return fclose(f) == 0 && ok;
+}
+
+// JSON.parse(FileRead(path)), as the script's startup does.
+static HostResult JsonLoad(HostModule& aJson, const std::string& aPath) {
+	std::string bytes = ReadFile(aPath);
+	return aJson.Call(_T("parse"), { HostValue((LPCTSTR)bytes.data(), bytes.size() / sizeof(TCHAR)), 0, 0 });
+}
+
+// The records of a loaded state, or nullptr.
+static Array* Records(IObject* aState) {
+	auto field = aState ? static_cast<HostObject*>(aState)->Get(_T("records")) : nullptr;
+	return field && field->symbol == SYM_OBJECT ? static_cast<Array*>(field->object) : nullptr;
+}
+
+// Runs aLoad in a child process and returns how far it grew the resident set, in bytes; aLoad
+// returns a HostResult which is kept until the measurement.
+template<class F>
+static double LoadRss(F aLoad) {
+	int fds[2];
+	if (pipe(fds))
+		return 0;
+	fflush(stdout);
+	if (sBench.json)
+		fflush(sBench.json);
+	pid_t pid = fork();
+	if (!pid) {
+		double before = BenchRss();
+		HostResult r = aLoad();
+		double grown = r.Failed() ? -1 : BenchRss() - before;
+		_exit(write(fds[1], &grown, sizeof(grown)) == sizeof(grown) ? 0 : 1);
+	}
+	close(fds[1]);
+	double grown = -1;
+	if (read(fds[0], &grown, sizeof(grown)) != sizeof(grown))
+		grown = -1;
+	close(fds[0]);
+	int status = 0;
+	CHECK(pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && !WEXITSTATUS(status));
+	CHECK(grown >= 0);
+	return grown;
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "serialize");
+	HostModule json(json::json_module_load), module;
+	size_t count = BenchSize<size_t>(170000, 5000), nodes = count * 3 + 2;
+	char dir[] = "/tmp/bench_serialize_XXXXXX";
+	if (!mkdtemp(dir))
+		return perror("mkdtemp"), 1;
+	std::string bin_path = std::string(dir) + "/state.bin", json_path = std::string(dir) + "/state.json";
+	auto bin_wpath = HostWiden(bin_path);
+
+	IObject* state = GenerateState(count);
+	double t = BenchTime([&] { CHECK(!module.Call(_T("save"), { state, HostValue(bin_wpath) }).Failed()); });
+	BenchReport("save", (double)nodes, "ms", t * 1e3);
+	t = BenchTime([&] {
+		HostResult text = json.Call(_T("stringify"), { state, HostValue::Missing(), _T("") });
+		CHECK(!text.Failed() && WriteFile(json_path, text.marker, text.marker_length * sizeof(TCHAR)));
+	});
+	BenchReport("JSON stringify and write", (double)nodes, "ms", t * 1e3);
+	size_t bin_size = ReadFile(bin_path).size(), json_size = ReadFile(json_path).size();
+	BenchReport("file size", (double)nodes, "MB", bin_size / 1e6);
+	BenchReport("JSON file size", (double)nodes, "MB", json_size / 1e6);
+
+	// Both load back as the state they were saved from.
+	HostResult loaded = module.Call(_T("load"), { HostValue(bin_wpath) });
+	HostResult parsed = JsonLoad(json, json_path);
+	for (IObject* obj : { loaded.Obj(), parsed.Obj() }) {
+		Array* records = Records(obj);
+		CHECK(records && records->mLength == (Object::index_t)count);
+		if (!records || !records->mLength)
+			continue;
+		auto last = static_cast<HostObject*>(records->mItem[count - 1].object);
+		CHECK(last->Get(_T("id")) && last->Get(_T("id"))->n_int64 == (__int64)count - 1);
+	}
+
+	t = BenchTime([&] { CHECK(!module.Call(_T("load"), { HostValue(bin_wpath) }).Failed()); });
+	BenchReport("load", (double)nodes, "ms", t * 1e3);
+	t = BenchTime([&] { CHECK(!JsonLoad(json, json_path).Failed()); });
+	BenchReport("JSON read and parse", (double)nodes, "ms", t * 1e3);
+	// A view of the file, and the name of the record in the middle of it.
+	std::string name;
+	t = BenchTime([&] {
+		HostResult view = module.Call(_T("load"), { HostValue(bin_wpath), 1 });
+		HostResult records = InvokeView(view.Obj(), IT_GET, _T("records"));
+		HostResult rec = InvokeView(records.Obj(), IT_GET, nullptr, { (__int64)count / 2 + 1 });
+		name = InvokeView(rec.Obj(), IT_GET, _T("name")).Str();
+	});
+	CHECK_EQ(name, HostNarrow(static_cast<HostObject*>(Records(state)->mItem[count / 2].object)->Get(_T("name"))->string.Value()));
+	BenchReport("lazy load and read one record", (double)nodes, "ms", t * 1e3);
+
+	BenchReport("load RSS", (double)nodes, "MB", LoadRss([&] { return module.Call(_T("load"), { HostValue(bin_wpath) }); }) / 1e6);
+	BenchReport("JSON load RSS", (double)nodes, "MB", LoadRss([&] { return JsonLoad(json, json_path); }) / 1e6);
+	BenchReport("lazy load and read one record RSS", (double)nodes, "MB", LoadRss([&] {
+		HostResult view = module.Call(_T("load"), { HostValue(bin_wpath), 1 });
+		HostResult records = InvokeView(view.Obj(), IT_GET, _T("records"));
+		InvokeView(records.Obj(), IT_GET, nullptr, { (__int64)count / 2 + 1 });
+		return view;
+	}) / 1e6);
+
+	state->Release();
+	unlink(bin_path.c_str());
+	unlink(json_path.c_str());
+	rmdir(dir);
+	return BenchExit();
+}
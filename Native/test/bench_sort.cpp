@@ -0,0 +1,186 @@
+// Benchmarks of sort.cpp on 1M-50M items: integers, floats and strings, random and presorted,
+// stable and not, against std::sort of the same Variants.  Callback comparison is timed against
+// sortby, which calls the key function once per item.  The chunks are sorted in parallel only
+// when the machine has more than one CPU; "threads" reports how many it has.
+#include "../sort.cpp"
+#include "host.h"
+#include "bench.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+
+static std::mt19937_64 sRandom(9);
+
+// A function object which calls back into C++, as a script closure would be called.
+class HostFunc : public ObjectBase
+{
+public:
+	std::function<void(ResultToken&, ExprTokenType*[], int)> mFunc;
+	size_t mCalls = 0;
+
+	HostFunc(std::function<void(ResultToken&, ExprTokenType*[], int)> aFunc) : mFunc(aFunc) {}
+	LPTSTR Type() { return (LPTSTR)_T("Func"); }
+
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+		if (!IS_INVOKE_CALL || aName)
+			return INVOKE_NOT_HANDLED;
+		++mCalls;
+		mFunc(aResultToken, aParam, aParamCount);
+		return OK;
+	}
+};
+
+static bool ItemLess(Object::Variant& a, Object::Variant& b) {
+	if (a.symbol == SYM_STRING)
+		return CompareStr(a.string.Value(), a.string.Length(), b.string.Value(), b.string.Length()) < 0;
+	double x = a.symbol == SYM_INTEGER ? (double)a.n_int64 : a.n_double;
+	double y = b.symbol == SYM_INTEGER ? (double)b.n_int64 : b.n_double;
+	return x < y;
+}
+
+static bool IsSorted(HostArray* aArray, bool aDesc) {
+	for (Object::index_t i = 1; i < aArray->mLength; ++i)
+		if (aDesc ? ItemLess(aArray->mItem[i - 1], aArray->mItem[i]) : ItemLess(aArray->mItem[i], aArray->mItem[i - 1]))
+			return false;
+	return true;
+}
+
+// Times one sort of aArray, restoring its original order before each run.  Sorting only
+// permutes the items, so a shallow copy restores them.
+static double TimeSort(HostArray* aArray, std::function<void()> aSort) {
+	std::vector<Object::Variant> original(aArray->mItem, aArray->mItem + aArray->mLength);
+	double best = 1e300;
+	for (int rep = 0; rep < (sBench.quick ? 1 : 3); ++rep) {
+		memcpy((void*)aArray->mItem, original.data(), original.size() * sizeof(Object::Variant));
+		double t = BenchNow();
+		aSort();
+		t = BenchNow() - t;
+		if (t < best)
+			best = t;
+	}
+	return best;
+}
+
+static void SortModule(HostModule& aModule, HostArray* aArray, LPCTSTR aOrder, bool aStable) {
+	HostResult r = aModule.Call(_T("sort"), { (IObject*)aArray, aOrder, (int)aStable });
+	CHECK(!r.Failed() && r.Obj() == aArray);
+}
+
+static void BenchArray(HostModule& aModule, const char* aKind, HostArray* aArray) {
+	char name[96];
+	size_t count = aArray->mLength;
+	struct { const char* name; LPCTSTR order; bool stable; } cases[] = {
+		{ "sort", _T("asc"), false }, { "sort stable", _T("asc"), true }, { "sort desc", _T("desc"), false } };
+	for (auto& c : cases) {
+		std::shuffle(aArray->mItem, aArray->mItem + count, sRandom);
+		double t = TimeSort(aArray, [&] { SortModule(aModule, aArray, c.order, c.stable); });
+		CHECK(IsSorted(aArray, c.order[0] == 'd'));
+		snprintf(name, sizeof(name), "%s %s", c.name, aKind);
+		BenchReport(name, (double)count, "Mitems/s", count / t / 1e6);
+	}
+	// Sorted input, which pdqsort detects.
+	std::shuffle(aArray->mItem, aArray->mItem + count, sRandom);
+	SortModule(aModule, aArray, _T("asc"), false);
+	double t = TimeSort(aArray, [&] { SortModule(aModule, aArray, _T("asc"), false); });
+	snprintf(name, sizeof(name), "sort presorted %s", aKind);
+	BenchReport(name, (double)count, "Mitems/s", count / t / 1e6);
+	CHECK(IsSorted(aArray, false));
+
+	std::shuffle(aArray->mItem, aArray->mItem + count, sRandom);
+	t = TimeSort(aArray, [&] { std::sort(aArray->mItem, aArray->mItem + count, ItemLess); });
+	CHECK(IsSorted(aArray, false));
+	snprintf(name, sizeof(name), "std::sort %s", aKind);
+	BenchReport(name, (double)count, "Mitems/s", count / t / 1e6);
+}
+
+// sort(arr, (a, b) => ...) against sortby(arr, (item) => ...), which calls back far less.
+static void BenchCallbacks(HostModule& aModule, size_t aCount) {
+	auto arr = new HostArray;
+	arr->Reserve((Object::index_t)aCount);
+	for (size_t i = 0; i < aCount; ++i)
+		arr->Push(HostValue((__int64)(sRandom() >> 1)));
+	HostFunc compare([](ResultToken& aResult, ExprTokenType* aParam[], int) {
+		__int64 a = aParam[0]->value_int64, b = aParam[1]->value_int64;
+		aResult.SetValue((__int64)((a > b) - (a < b)));
+	});
+	HostFunc key([](ResultToken& aResult, ExprTokenType* aParam[], int) { aResult.SetValue(-aParam[0]->value_int64); });
+
+	double t = TimeSort(arr, [&] {
+		compare.mCalls = 0;
+		aModule.Call(_T("sort"), { (IObject*)arr, (IObject*)&compare });
+	});
+	CHECK(IsSorted(arr, false));
+	BenchReport("sort callback int", (double)aCount, "Mitems/s", aCount / t / 1e6);
+	BenchReport("sort callback int calls", (double)aCount, "calls/item", (double)compare.mCalls / aCount);
+
+	std::shuffle(arr->mItem, arr->mItem + aCount, sRandom);
+	t = TimeSort(arr, [&] {
+		key.mCalls = 0;
+		aModule.Call(_T("sortby"), { (IObject*)arr, (IObject*)&key });
+	});
+	CHECK(IsSorted(arr, true));
+	CHECK_EQ(key.mCalls, aCount);
+	BenchReport("sortby key int", (double)aCount, "Mitems/s", aCount / t / 1e6);
+	BenchReport("sortby key int calls", (double)aCount, "calls/item", (double)key.mCalls / aCount);
+	arr->Release();
+}
+
+// Mixed integers and floats compare exactly, and NaN goes last in either order.
+static void CheckMixed(HostModule& aModule) {
+	const __int64 big = 1LL << 53;
+	for (int desc = 0; desc < 2; ++desc) {
+		auto arr = new HostArray;
+		arr->Push(HostValue((double)big));
+		arr->Push(HostValue(big + 1));
+		arr->Push(HostValue(NAN));
+		arr->Push(HostValue(big));
+		arr->Push(HostValue(0.5));
+		arr->Push(HostValue(9007199254740994.0));
+		SortModule(aModule, arr, desc ? _T("desc") : _T("asc"), true);
+		auto& items = arr->mItem;
+		int first = desc ? 4 : 0, step = desc ? -1 : 1; // Position of the smallest non-NaN item, and direction.
+		CHECK(items[first].symbol == SYM_FLOAT && items[first].n_double == 0.5);
+		CHECK(items[first + step * 3].symbol == SYM_INTEGER && items[first + step * 3].n_int64 == big + 1);
+		CHECK(items[first + step * 4].symbol == SYM_FLOAT && items[first + step * 4].n_double == 9007199254740994.0);
+		CHECK(items[5].symbol == SYM_FLOAT && std::isnan(items[5].n_double));
+		arr->Release();
+	}
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "sort");
+	HostModule module;
+	BenchReport("threads", 0, "count", ThreadCount());
+	const size_t sizes[] = { 1000000, 10000000, 50000000 };
+	for (size_t size : sizes) {
+		if (sBench.quick && size > 1000000)
+			break;
+		size_t count = BenchSize<size_t>(size, 100000);
+		auto arr = new HostArray;
+		arr->Reserve((Object::index_t)count);
+		for (size_t i = 0; i < count; ++i)
+			arr->Push(HostValue((__int64)(sRandom() >> 1)));
+		BenchArray(module, "int", arr);
+		for (size_t i = 0; i < count; ++i) // Replaces the integers in place.
+			arr->mItem[i].n_double = std::ldexp((double)(sRandom() >> 11), -20) - 1e9, arr->mItem[i].symbol = SYM_FLOAT;
+		BenchArray(module, "float", arr);
+		arr->Release();
+
+		if (size > 10000000)
+			continue; // 50M strings would not fit in memory alongside their records.
+		arr = new HostArray;
+		arr->Reserve((Object::index_t)count);
+		char buf[32];
+		for (size_t i = 0; i < count; ++i) {
+			snprintf(buf, sizeof(buf), "item%016llx", (unsigned long long)sRandom());
+			auto text = HostWiden(buf);
+			arr->Push(HostValue(text));
+		}
+		BenchArray(module, "string", arr);
+		arr->Release();
+	}
+	BenchCallbacks(module, BenchSize<size_t>(1000000, 20000));
+	CheckMixed(module);
+	return BenchExit();
+}
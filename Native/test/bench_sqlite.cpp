@@ -0,0 +1,149 @@
+// Benchmarks of sqlite.cpp against the row-callback path of CSQLite.GetTable, which runs
+// sqlite3_exec and builds an Array per row with every column converted from UTF-8 to a string
+// (reproduced here in C++, so it is a lower bound on the script's cost).  Reports rows/s for
+// the query alone and with every cell read, and for bulk inserts with ExecMany against one
+// Exec per row, at 10k-1M rows in an in-memory database.
+#include "../sqlite.cpp"
+#include "host.h"
+#include "bench.h"
+
+// sqlite.cpp declares its own subset of the API, so sqlite3.h would clash; these are the
+// functions the benchmark calls directly.
+extern "C" {
+	int sqlite3_open(const char*, sqlite3**);
+	int sqlite3_close(sqlite3*);
+	int sqlite3_exec(sqlite3*, const char*, int (*)(void*, int, char**, char**), void*, char**);
+}
+
+// Calls a member of one of the module's script-facing views.
+static HostResult InvokeView(IObject* aObj, int aFlags, LPCTSTR aName, HostArgs aArgs = {}) {
+	HostResult r;
+	HostParams params(aArgs);
+	sHostError.Clear();
+	if (aObj->Invoke(r, aFlags, (LPTSTR)aName, ExprTokenType(aObj), params.ptrs.data(), (int)params.ptrs.size()) == INVOKE_NOT_HANDLED)
+		r.result = FAIL;
+	return r;
+}
+
+struct GetTableRows
+{
+	HostArray* table;
+	size_t cells;
+};
+
+// callback_gettable: one Array per row, every column as a string (StrGet(ptr, "UTF-8")).
+static int GetTableCallback(void* aContext, int aCount, char** aValues, char**) {
+	auto rows = (GetTableRows*)aContext;
+	auto row = new HostArray;
+	row->Reserve(aCount);
+	for (int i = 0; i < aCount; ++i) {
+		auto text = HostWiden(aValues[i] ? aValues[i] : "");
+		row->Push(HostValue(text));
+	}
+	rows->table->Push(HostValue((IObject*)row));
+	row->Release();
+	rows->cells += aCount;
+	return 0;
+}
+
+static void BenchRows(HostModule& aModule, sqlite3* aDb, IObject* aConn, size_t aRows) {
+	char sql[96];
+	sqlite3_exec(aDb, "DROP TABLE IF EXISTS t; CREATE TABLE t(id INTEGER, name TEXT, score REAL)", nullptr, nullptr, nullptr);
+
+	// Bulk insert: ExecMany binds each row in one transaction.
+	auto rows = new HostArray;
+	rows->Reserve((Object::index_t)aRows);
+	for (size_t i = 0; i < aRows; ++i) {
+		snprintf(sql, sizeof(sql), "name %zu", i);
+		auto name = HostWiden(sql);
+		auto row = new HostArray;
+		row->Push(HostValue((__int64)i));
+		row->Push(HostValue(name));
+		row->Push(HostValue(i * 0.5));
+		rows->Push(HostValue((IObject*)row));
+		row->Release();
+	}
+	double t = BenchNow();
+	HostResult n = aModule.Invoke(aConn, _T("Connection.Prototype.ExecMany"), { _T("INSERT INTO t VALUES(?, ?, ?)"), (IObject*)rows });
+	t = BenchNow() - t;
+	CHECK_EQ(n.Int(), (__int64)aRows);
+	BenchReport("ExecMany insert", (double)aRows, "rows/s", aRows / t);
+	rows->Release();
+
+	// One Exec per row inside a transaction, as a script loop would do it.
+	sqlite3_exec(aDb, "CREATE TABLE u(id INTEGER, name TEXT, score REAL); BEGIN", nullptr, nullptr, nullptr);
+	const ObjectMember* exec = aModule.Member(_T("Connection.Prototype.Exec"));
+	size_t inserts = aRows < 100000 ? aRows : 100000;
+	t = BenchNow();
+	for (size_t i = 0; i < inserts; ++i)
+		aModule.Invoke(aConn, exec, { _T("INSERT INTO u VALUES(?, ?, ?)"), (__int64)i, _T("name"), i * 0.5 });
+	t = BenchNow() - t;
+	sqlite3_exec(aDb, "COMMIT; DROP TABLE u", nullptr, nullptr, nullptr);
+	BenchReport("Exec insert per row", (double)inserts, "rows/s", inserts / t);
+
+	// The query alone; cells become script values only when read.
+	__int64 id_sum = 0, expected = (__int64)(aRows * (aRows - 1) / 2);
+	t = BenchTime([&] {
+		HostResult rs = aModule.Invoke(aConn, _T("Connection.Prototype.Query"), { _T("SELECT id, name, score FROM t") });
+		CHECK_EQ(InvokeView(rs.Obj(), IT_GET, _T("RowCount")).Int(), (__int64)aRows);
+	});
+	BenchReport("Query", (double)aRows, "rows/s", aRows / t);
+
+	// The query and every cell read through a column view, as rs.Column(c)[row].
+	size_t strings = 0;
+	t = BenchTime([&] {
+		HostResult rs = aModule.Invoke(aConn, _T("Connection.Prototype.Query"), { _T("SELECT id, name, score FROM t") });
+		id_sum = 0, strings = 0;
+		HostResult ids = InvokeView(rs.Obj(), IT_CALL, _T("Column"), { 1 });
+		HostResult names = InvokeView(rs.Obj(), IT_CALL, _T("Column"), { _T("name") });
+		HostResult scores = InvokeView(rs.Obj(), IT_CALL, _T("Column"), { 3 });
+		for (size_t row = 1; row <= aRows; ++row) {
+			id_sum += InvokeView(ids.Obj(), IT_GET, nullptr, { (__int64)row }).Int();
+			strings += InvokeView(names.Obj(), IT_GET, nullptr, { (__int64)row }).symbol == SYM_STRING;
+			BenchKeep(InvokeView(scores.Obj(), IT_GET, nullptr, { (__int64)row }).Float());
+		}
+	});
+	CHECK_EQ(id_sum, expected);
+	CHECK_EQ(strings, aRows);
+	BenchReport("Query + read all cells", (double)aRows, "rows/s", aRows / t);
+
+	size_t cells = 0;
+	t = BenchTime([&] {
+		GetTableRows result = { new HostArray, 0 };
+		sqlite3_exec(aDb, "SELECT id, name, score FROM t", GetTableCallback, &result, nullptr);
+		cells = result.cells;
+		result.table->Release();
+	});
+	CHECK_EQ(cells, aRows * 3);
+	BenchReport("GetTable row callback", (double)aRows, "rows/s", aRows / t);
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "sqlite");
+	HostModule module;
+	sqlite3* db = nullptr;
+	CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+	IObject* conn = module.New(_T("Connection"), { (__int64)(size_t)db });
+	CHECK(conn != nullptr);
+	if (!conn)
+		return BenchExit();
+	const size_t sizes[] = { 10000, 100000, 1000000 };
+	for (size_t rows : sizes) {
+		if (sBench.quick && rows > 10000)
+			break;
+		BenchRows(module, db, conn, rows);
+	}
+	// Integers and floats keep their type; a second statement is an error, not dropped.
+	HostResult rs = module.Invoke(conn, _T("Connection.Prototype.Query"), { _T("SELECT 7, 2.5, 'x', NULL") });
+	HostResult seven = InvokeView(rs.Obj(), IT_GET, nullptr, { 1, 1 });
+	HostResult half = InvokeView(rs.Obj(), IT_GET, nullptr, { 1, 2 });
+	CHECK(seven.symbol == SYM_INTEGER && seven.value_int64 == 7);
+	CHECK(half.symbol == SYM_FLOAT && half.value_double == 2.5);
+	CHECK_EQ(InvokeView(rs.Obj(), IT_GET, nullptr, { 1, 4 }).Str(), "");
+	HostResult two = module.Invoke(conn, _T("Connection.Prototype.Exec"), { _T("SELECT 1; SELECT 2") });
+	CHECK(two.Failed() && sHostError.type == "ValueError");
+	module.Invoke(conn, _T("Connection.Prototype.Close"));
+	conn->Release();
+	sqlite3_close(db);
+	return BenchExit();
+}
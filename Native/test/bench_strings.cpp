@@ -0,0 +1,266 @@
+// Benchmarks of passing large strings (up to 100 MB) into a module through EXPORT_FUNC and back:
+// borrowing them with BorrowString against copying them first, for a parameter, a variable
+// passed ByRef and an Array item, where the functions only checksum the text, so what is left
+// is the cost of getting at it; and returning text the module built, or keeps, as a SharedString
+// against copying it into mem_to_free, with the bytes copied per call.  The module is defined here.
+#define BENCH_COUNT_ALLOCS
+#include "../ahk2_types.h"
+
+static UINT64 Checksum(LPCTSTR aStr, size_t aLength) {
+	UINT64 sum = 0;
+	for (size_t i = 0; i < aLength; ++i)
+		sum += (_TUCHAR)aStr[i];
+	return sum;
+}
+
+static void NotAString(ResultToken& aResultToken) {
+	Object::Error(ExprTokenType(_T("Expected a string.")), nullptr, _T("TypeError"));
+	aResultToken.result = FAIL;
+}
+
+// Checksum(str): reads the text in place.
+BIF_DECL(Checksum) {
+	StrRef text;
+	if (!BorrowString(*aParam[0], text))
+		return NotAString(aResultToken);
+	aResultToken.SetValue((__int64)Checksum(text.str, text.length));
+}
+
+// ChecksumCopy(str): copies the text first, as modules did before BorrowString.
+BIF_DECL(ChecksumCopy) {
+	ExprTokenType val;
+	TokenToValue(*aParam[0], val);
+	if (val.symbol != SYM_STRING)
+		return NotAString(aResultToken);
+	size_t length = val.marker_length == -1 ? _tcslen(val.marker) : val.marker_length;
+	auto copy = (LPTSTR)malloc((length + 1) * sizeof(TCHAR));
+	if (!copy) {
+		Object::Error(ExprTokenType(_T("Out of memory.")), nullptr, _T("MemoryError"));
+		aResultToken.result = FAIL;
+		return;
+	}
+	memcpy(copy, val.marker, (length + 1) * sizeof(TCHAR));
+	aResultToken.SetValue((__int64)Checksum(copy, length));
+	free(copy);
+}
+
+static Object::Variant* ParamItem(ExprTokenType** aParam) {
+	ExprTokenType val;
+	TokenToValue(*aParam[0], val);
+	if (val.symbol != SYM_OBJECT || _tcscmp(val.object->Type(), _T("Array")))
+		return nullptr;
+	auto arr = static_cast<Array*>(val.object);
+	ExprTokenType index;
+	TokenToValue(*aParam[1], index);
+	if (index.symbol != SYM_INTEGER)
+		return nullptr;
+	return index.value_int64 >= 1 && index.value_int64 <= (__int64)arr->mLength ? &arr->mItem[index.value_int64 - 1] : nullptr;
+}
+
+// ItemChecksum(arr, index): reads an Array item in place.
+BIF_DECL(ItemChecksum) {
+	StrRef text;
+	Object::Variant* item = ParamItem(aParam);
+	if (!item || !BorrowString(*item, text))
+		return NotAString(aResultToken);
+	aResultToken.SetValue((__int64)Checksum(text.str, text.length));
+}
+
+// ItemChecksumCopy(arr, index): fetches the item as __Item would, copying it into the result.
+BIF_DECL(ItemChecksumCopy) {
+	Object::Variant* item = ParamItem(aParam);
+	if (!item || item->symbol != SYM_STRING)
+		return NotAString(aResultToken);
+	size_t length = item->string.Length();
+	auto copy = (LPTSTR)malloc((length + 1) * sizeof(TCHAR));
+	if (!copy)
+		return NotAString(aResultToken);
+	memcpy(copy, item->string.Value(), (length + 1) * sizeof(TCHAR));
+	aResultToken.SetValue((__int64)Checksum(copy, length));
+	free(copy);
+}
+
+static void OutOfMemory(ResultToken& aResultToken) {
+	Object::Error(ExprTokenType(_T("Out of memory.")), nullptr, _T("MemoryError"));
+	aResultToken.result = FAIL;
+}
+
+// Text of aLength characters in a new malloc'd buffer, as a module would build a result.
+static LPTSTR Generate(size_t aLength) {
+	auto text = (LPTSTR)malloc((aLength + 1) * sizeof(TCHAR));
+	if (!text)
+		return nullptr;
+	for (size_t i = 0; i < aLength; ++i)
+		text[i] = (TCHAR)('a' + i % 26);
+	text[aLength] = 0;
+	return text;
+}
+
+static bool ParamLength(ExprTokenType& aParam, size_t& aLength) {
+	ExprTokenType val;
+	TokenToValue(aParam, val);
+	if (val.symbol != SYM_INTEGER || val.value_int64 < 0)
+		return false;
+	aLength = (size_t)val.value_int64;
+	return true;
+}
+
+// Text(length): builds the text and returns it as a SharedString, which the host adopts.
+BIF_DECL(Text) {
+	size_t length;
+	if (!ParamLength(*aParam[0], length))
+		return NotAString(aResultToken);
+	SharedString text;
+	LPTSTR p = Generate(length);
+	if (!p || !text.Adopt(p, length)) {
+		free(p);
+		return OutOfMemory(aResultToken);
+	}
+	if (!text.Return(aResultToken))
+		OutOfMemory(aResultToken);
+}
+
+// TextCopy(length): builds the text and copies it into mem_to_free, as modules did before.
+BIF_DECL(TextCopy) {
+	size_t length;
+	if (!ParamLength(*aParam[0], length))
+		return NotAString(aResultToken);
+	LPTSTR p = Generate(length);
+	auto copy = p ? (LPTSTR)malloc((length + 1) * sizeof(TCHAR)) : nullptr;
+	if (copy)
+		memcpy(copy, p, (length + 1) * sizeof(TCHAR));
+	free(p);
+	if (!copy)
+		return OutOfMemory(aResultToken);
+	aResultToken.AcceptMem(copy, length);
+}
+
+// The text of the last CachedText call, kept by the module.
+static SharedString sCache;
+
+// CachedText(length): returns the kept text without ownership; only the first call builds it.
+BIF_DECL(CachedText) {
+	size_t length;
+	if (!ParamLength(*aParam[0], length))
+		return NotAString(aResultToken);
+	if (sCache.size() != length) {
+		LPTSTR p = Generate(length);
+		if (!p || !sCache.Adopt(p, length)) {
+			free(p);
+			return OutOfMemory(aResultToken);
+		}
+	}
+	sCache.ReturnBorrowed(aResultToken);
+}
+
+// CachedTextCopy(length): copies the kept text into mem_to_free.
+BIF_DECL(CachedTextCopy) {
+	size_t length;
+	if (!ParamLength(*aParam[0], length))
+		return NotAString(aResultToken);
+	if (sCache.size() != length) {
+		LPTSTR p = Generate(length);
+		if (!p || !sCache.Adopt(p, length)) {
+			free(p);
+			return OutOfMemory(aResultToken);
+		}
+	}
+	SharedString ref(sCache); // Not the last reference, so Return copies.
+	if (!ref.Return(aResultToken))
+		OutOfMemory(aResultToken);
+}
+
+ExportSymbol symbols[] = {
+	EXPORT_FUNC(Checksum, 1, 1)
+	EXPORT_FUNC(ChecksumCopy, 1, 1)
+	EXPORT_FUNC(ItemChecksum, 2, 2)
+	EXPORT_FUNC(ItemChecksumCopy, 2, 2)
+	EXPORT_FUNC(Text, 1, 1)
+	EXPORT_FUNC(TextCopy, 1, 1)
+	EXPORT_FUNC(CachedText, 1, 1)
+	EXPORT_FUNC(CachedTextCopy, 1, 1)
+};
+
+EXPORT_AHKMODULE(symbols)
+
+#include "host.h"
+#include "bench.h"
+
+// Times aFunc on aArgs, reporting GB/s and the bytes each call allocates.
+static void BenchCall(HostModule& aModule, const char* aCase, LPCTSTR aFunc, HostArgs aArgs, size_t aChars, UINT64 aExpected) {
+	char name[96];
+	__int64 sum = 0;
+	size_t calls = 0, bytes = BenchAllocBytes();
+	double t = BenchTime([&] { sum = aModule.Call(aFunc, aArgs).Int(), ++calls; });
+	bytes = BenchAllocBytes() - bytes;
+	CHECK_EQ((UINT64)sum, aExpected);
+	snprintf(name, sizeof(name), "%s %s", aCase, HostNarrow(aFunc).c_str());
+	BenchReport(name, (double)aChars * sizeof(TCHAR), "GB/s", aChars * sizeof(TCHAR) / 1e9 / t);
+	snprintf(name, sizeof(name), "%s %s allocated", aCase, HostNarrow(aFunc).c_str());
+	BenchReport(name, (double)aChars * sizeof(TCHAR), "MB/call", bytes / 1e6 / calls);
+}
+
+// Times aFunc returning aChars of text, reporting GB/s and the bytes it copies per call: those
+// allocated beyond aBuilt, the bytes of text it builds each call.
+static void BenchReturn(HostModule& aModule, LPCTSTR aFunc, size_t aChars, size_t aBuilt, UINT64 aExpected) {
+	char name[96];
+	UINT64 sum = 0;
+	size_t calls = 0, bytes = BenchAllocBytes();
+	double t = BenchTime([&] {
+		HostResult r = aModule.Call(aFunc, { (__int64)aChars });
+		CHECK(!r.Failed() && r.symbol == SYM_STRING && (size_t)r.marker_length == aChars);
+		if (r.symbol == SYM_STRING)
+			sum = Checksum(r.marker, r.marker_length);
+		++calls;
+	});
+	bytes = BenchAllocBytes() - bytes;
+	CHECK_EQ(sum, aExpected);
+	snprintf(name, sizeof(name), "return %s", HostNarrow(aFunc).c_str());
+	BenchReport(name, (double)aChars * sizeof(TCHAR), "GB/s", aChars * sizeof(TCHAR) / 1e9 / t);
+	snprintf(name, sizeof(name), "return %s copied", HostNarrow(aFunc).c_str());
+	BenchReport(name, (double)aChars * sizeof(TCHAR), "MB/call", ((double)bytes / calls - aBuilt) / 1e6);
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "strings");
+	HostModule module;
+	const size_t sizes[] = { 1 << 20, 100 << 20 }; // Bytes.
+	for (size_t size : sizes) {
+		if (sBench.quick && size > (1 << 20))
+			break;
+		size_t chars = size / sizeof(TCHAR);
+		std::vector<TCHAR> text(chars + 1);
+		for (size_t i = 0; i < chars; ++i)
+			text[i] = (TCHAR)('a' + i % 26);
+		text[chars] = 0;
+		UINT64 expected = Checksum(text.data(), chars);
+
+		HostValue param(text.data(), chars);
+		BenchCall(module, "parameter", _T("Checksum"), { param }, chars, expected);
+		BenchCall(module, "parameter", _T("ChecksumCopy"), { param }, chars, expected);
+
+		HostVar var;
+		var.mCharContents = text.data();
+		var.mByteLength = chars * sizeof(TCHAR);
+		BenchCall(module, "variable", _T("Checksum"), { HostValue(var) }, chars, expected);
+		BenchCall(module, "variable", _T("ChecksumCopy"), { HostValue(var) }, chars, expected);
+		var.mCharContents = (LPTSTR)_T(""); // The variable does not own the text.
+		var.mByteLength = 0;
+
+		auto arr = new HostArray;
+		arr->Push(param);
+		BenchCall(module, "array item", _T("ItemChecksum"), { arr, 1 }, chars, expected);
+		BenchCall(module, "array item", _T("ItemChecksumCopy"), { arr, 1 }, chars, expected);
+		arr->Release();
+
+		size_t built = (chars + 1) * sizeof(TCHAR);
+		BenchReturn(module, _T("Text"), chars, built, expected);
+		BenchReturn(module, _T("TextCopy"), chars, built, expected);
+		module.Call(_T("CachedText"), { (__int64)chars }); // Builds the text once, untimed.
+		BenchReturn(module, _T("CachedText"), chars, 0, expected);
+		BenchReturn(module, _T("CachedTextCopy"), chars, 0, expected);
+	}
+	HostResult r = module.Call(_T("Checksum"), { 5 });
+	CHECK(r.Failed() && sHostError.type == "TypeError");
+	return BenchExit();
+}
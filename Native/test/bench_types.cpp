@@ -0,0 +1,362 @@
+// Benchmarks of the ahk2_types.h core: field lookup, FlatVector and Map section scans, TString
+// appends, token marshaling, and the Arena and ObjectPool allocators.  ahk2.cpp is the module,
+// for MyTypedClass's typed members.
+#include "../ahk2.cpp"
+#include "host.h"
+#include "bench.h"
+#include <algorithm>
+#include <random>
+
+static std::mt19937_64 sRandom(42);
+
+static std::vector<std::vector<TCHAR>> FieldNames(size_t aCount, const char* aPrefix) {
+	std::vector<std::vector<TCHAR>> names;
+	char name[32];
+	for (size_t i = 0; i < aCount; ++i) {
+		snprintf(name, sizeof(name), "%s%07zu", aPrefix, i);
+		names.push_back(HostWiden(name));
+	}
+	return names;
+}
+
+// Object::FindField: binary search on key_c and the name, hits and misses (the miss also
+// yields the insert position).
+static void BenchFindField() {
+	const size_t sizes[] = { 16, 256, 4096, 65536 };
+	const size_t lookups = BenchSize(1000000, 20000);
+	for (size_t size : sizes) {
+		if (sBench.quick && size > 4096)
+			break;
+		auto names = FieldNames(size, "Field");
+		auto missing = FieldNames(size, "Other");
+		auto obj = new HostObject;
+		for (size_t i = 0; i < size; ++i)
+			obj->Set(names[i].data(), HostValue((__int64)i)); // Names sort in creation order.
+		std::vector<LPTSTR> order, miss_order;
+		for (size_t i = 0; i < lookups; ++i) {
+			order.push_back(names[sRandom() % size].data());
+			miss_order.push_back(missing[sRandom() % size].data());
+		}
+		__int64 sum = 0, expected = 0;
+		for (auto name : order)
+			expected += _tcstoi64(name + 5, nullptr, 10);
+		double t = BenchTime([&] {
+			sum = 0;
+			for (auto name : order)
+				sum += obj->FindField(name)->n_int64;
+		});
+		CHECK_EQ(sum, expected);
+		BenchReport("FindField hit", (double)size, "ns/op", t * 1e9 / lookups);
+		Object::index_t found = 0;
+		t = BenchTime([&] {
+			found = 0;
+			for (auto name : miss_order) {
+				Object::index_t pos;
+				found += obj->FindField(name, &pos) != nullptr;
+				BenchKeep(pos);
+			}
+		});
+		CHECK_EQ(found, 0u);
+		BenchReport("FindField miss", (double)size, "ns/op", t * 1e9 / lookups);
+		obj->Release();
+	}
+}
+
+// Reading every field through FlatVector and VariantToToken, as modules enumerate objects.
+static void BenchFlatVector() {
+	const size_t sizes[] = { 16, 1024, 65536 };
+	for (size_t size : sizes) {
+		auto names = FieldNames(size, "f");
+		auto obj = new HostObject;
+		for (size_t i = 0; i < size; ++i) {
+			if (i & 1)
+				obj->Set(names[i].data(), HostValue(names[i]));
+			else
+				obj->Set(names[i].data(), HostValue((__int64)i));
+		}
+		const size_t passes = BenchSize<size_t>(20000000 / size + 1, 20);
+		size_t chars = 0;
+		double t = BenchTime([&] {
+			chars = 0;
+			for (size_t p = 0; p < passes; ++p) {
+				auto& fields = obj->mFields;
+				for (Object::index_t i = 0, n = fields.Length(); i < n; ++i) {
+					ExprTokenType value;
+					VariantToToken(fields[i], value);
+					chars += value.symbol == SYM_STRING ? value.marker_length : 1;
+				}
+			}
+		});
+		CHECK(chars > 0);
+		BenchReport("FlatVector scan", (double)size, "ns/item", t * 1e9 / (passes * size));
+		obj->Release();
+	}
+}
+
+// Finds aKey within a Map's string section, as a module looking up Map keys does.
+static Map::Pair* FindStringKey(Map* aMap, LPCTSTR aKey) {
+	Object::index_t left = aMap->mKeyOffsetString, right = aMap->mCount;
+	while (left < right) {
+		Object::index_t mid = left + (right - left) / 2;
+		int c = _tcscmp(aKey, aMap->mItem[mid].key.s);
+		if (!c)
+			return &aMap->mItem[mid];
+		if (c < 0)
+			right = mid;
+		else
+			left = mid + 1;
+	}
+	return nullptr;
+}
+static Map::Pair* FindIntKey(Map* aMap, IntKeyType aKey) {
+	Object::index_t left = 0, right = aMap->mKeyOffsetObject;
+	while (left < right) {
+		Object::index_t mid = left + (right - left) / 2;
+		IntKeyType k = aMap->mItem[mid].key.i;
+		if (k == aKey)
+			return &aMap->mItem[mid];
+		if (aKey < k)
+			right = mid;
+		else
+			left = mid + 1;
+	}
+	return nullptr;
+}
+
+// Map key sections: lookups restricted to the int or string section, and a scan of all
+// pairs section by section.
+static void BenchMapSections() {
+	const size_t sizes[] = { 256, 16384, 262144 };
+	const size_t lookups = BenchSize(1000000, 20000);
+	for (size_t size : sizes) {
+		if (sBench.quick && size > 16384)
+			break;
+		auto names = FieldNames(size / 2, "key");
+		auto map = new HostMap;
+		for (size_t i = 0; i < size / 2; ++i) {
+			map->Set(HostValue((__int64)(i * 3)), HostValue((__int64)i));
+			map->Set(HostValue(names[i]), HostValue((__int64)i));
+		}
+		CHECK_EQ(map->mKeyOffsetObject, size / 2);
+		CHECK_EQ(map->mKeyOffsetString, size / 2);
+		std::vector<size_t> order;
+		for (size_t i = 0; i < lookups; ++i)
+			order.push_back(sRandom() % (size / 2));
+		__int64 sum = 0, expected = 0;
+		for (size_t i : order)
+			expected += i;
+		double t = BenchTime([&] {
+			sum = 0;
+			for (size_t i : order)
+				sum += FindIntKey(map, (IntKeyType)(i * 3))->n_int64;
+		});
+		CHECK_EQ(sum, expected);
+		BenchReport("Map int key lookup", (double)size, "ns/op", t * 1e9 / lookups);
+		t = BenchTime([&] {
+			sum = 0;
+			for (size_t i : order)
+				sum += FindStringKey(map, names[i].data())->n_int64;
+		});
+		CHECK_EQ(sum, expected);
+		BenchReport("Map string key lookup", (double)size, "ns/op", t * 1e9 / lookups);
+		const size_t passes = BenchSize<size_t>(20000000 / size + 1, 10);
+		t = BenchTime([&] {
+			sum = 0;
+			for (size_t p = 0; p < passes; ++p) {
+				for (Object::index_t i = 0; i < map->mKeyOffsetObject; ++i)
+					sum += map->mItem[i].key.i;
+				for (Object::index_t i = map->mKeyOffsetString; i < map->mCount; ++i)
+					sum += *map->mItem[i].key.s;
+			}
+		});
+		BenchKeep(sum);
+		BenchReport("Map section scan", (double)size, "ns/item", t * 1e9 / (passes * size));
+		map->Release();
+	}
+}
+
+// TString appends, from the inline buffer up to heap sizes, then the handoff to a ResultToken.
+static void BenchTString() {
+	const size_t sizes[] = { 1000, 64000, 4000000 };
+	const TCHAR word[] = _T("abcdefghijklmnop");
+	for (size_t size : sizes) {
+		if (sBench.quick && size > 64000)
+			break;
+		const size_t reps = BenchSize<size_t>(40000000 / size + 1, 4);
+		auto run = [&](const char* aCase, auto&& aAppend, size_t aPerOp) {
+			size_t ops = size / aPerOp, length = 0;
+			double t = BenchTime([&] {
+				for (size_t r = 0; r < reps; ++r) {
+					TString s;
+					for (size_t i = 0; i < ops; ++i)
+						aAppend(s, i);
+					length = s.size();
+					BenchKeep(s.data()[0]);
+				}
+			});
+			CHECK(length >= ops);
+			BenchReport(aCase, (double)size, "ns/op", t * 1e9 / (reps * ops));
+		};
+		run("TString append char", [](TString& s, size_t i) { s.append((TCHAR)('a' + (i & 15))); }, 1);
+		run("TString append 16 chars", [&](TString& s, size_t) { s.append(word, 16); }, 16);
+		run("TString append_int", [](TString& s, size_t i) { s.append_int((__int64)(i * 2654435761u)); }, 10);
+		run("TString append_float integral", [](TString& s, size_t i) { s.append_float((double)i); }, 8);
+		run("TString append_float fraction", [](TString& s, size_t i) { s.append_float(i + 0.25); }, 12);
+		ExprTokenType str_token((LPTSTR)word), int_token;
+		int_token.SetValue((__int64)123456);
+		run("TString append token", [&](TString& s, size_t i) { s.append(i & 1 ? str_token : int_token); }, 11);
+		// move_to adopts the heap buffer, so its cost does not depend on the length.
+		size_t handoffs = BenchSize<size_t>(100000, 100);
+		double t = BenchTime([&] {
+			for (size_t i = 0; i < handoffs; ++i) {
+				TString s;
+				s.reserve(size);
+				s.append(word, 16);
+				HostResult result;
+				s.move_to(result);
+			}
+		});
+		BenchReport("TString move_to", (double)size, "ns/op", t * 1e9 / handoffs);
+	}
+}
+
+// Token marshaling: the conversions every exported function and member does on its parameters
+// and results.
+static void BenchTokens(HostModule& aModule) {
+	const size_t ops = BenchSize(10000000, 100000);
+	auto report = [&](const char* aCase, double aSeconds) { BenchReport(aCase, (double)ops, "ns/op", aSeconds * 1e9 / ops); };
+
+	HostVar var;
+	var.Assign((__int64)7);
+	ExprTokenType int_token, var_token, numeric_string((LPTSTR)_T("12345")), float_string((LPTSTR)_T("3.25"));
+	int_token.SetValue((__int64)42);
+	var_token.symbol = SYM_VAR, var_token.var = &var;
+	__int64 sum = 0;
+
+	report("TokenToValue var", BenchTime([&] {
+		for (size_t i = 0; i < ops; ++i) {
+			ExprTokenType value;
+			TokenToValue(var_token, value);
+			sum += value.value_int64;
+		}
+	}));
+	report("TokenToNumber int", BenchTime([&] {
+		for (size_t i = 0; i < ops; ++i) {
+			ExprTokenType n;
+			TokenToNumber(int_token, n);
+			sum += n.value_int64;
+		}
+	}));
+	report("TokenToNumber int string", BenchTime([&] {
+		for (size_t i = 0; i < ops; ++i) {
+			ExprTokenType n;
+			TokenToNumber(numeric_string, n);
+			sum += n.value_int64;
+		}
+	}));
+	report("TokenToNumber float string", BenchTime([&] {
+		for (size_t i = 0; i < ops; ++i) {
+			ExprTokenType n;
+			TokenToNumber(float_string, n);
+			sum += (__int64)n.value_double;
+		}
+	}));
+
+	auto arr = new HostArray;
+	arr->Push(HostValue(_T("a borrowed string")));
+	Object::Variant& item = arr->mItem[0];
+	report("VariantToToken + BorrowString", BenchTime([&] {
+		for (size_t i = 0; i < ops; ++i) {
+			ExprTokenType value;
+			StrRef ref;
+			VariantToToken(item, value);
+			if (BorrowString(value, ref))
+				sum += ref.length;
+		}
+	}));
+	arr->Release();
+
+	HostVar out;
+	ExprTokenType out_token;
+	out_token.symbol = SYM_VAR, out_token.var = &out;
+	report("TokenToOutputVar + Assign string", BenchTime([&] {
+		for (size_t i = 0; i < ops; ++i)
+			if (Var* v = TokenToOutputVar(out_token))
+				v->Assign(_T("output"), 6);
+	}));
+	CHECK(out.Str() == "output");
+
+	TCHAR buf[MAX_NUMBER_SIZE];
+	report("ResultToken init + SetValue", BenchTime([&] {
+		for (size_t i = 0; i < ops; ++i) {
+			ResultToken result;
+			result.InitResult(buf);
+			result.SetValue((__int64)i);
+			sum += result.value_int64;
+			result.Free();
+		}
+	}));
+
+	// A typed member call through its ObjectMember, with a double and an Optional<double>.
+	IObject* obj = aModule.New(_T("MyTypedClass"));
+	const ObjectMember* scale = aModule.Member(_T("MyTypedClass.Prototype.scale"));
+	CHECK(obj && scale);
+	if (obj && scale) {
+		ExprTokenType a, b, * params[] = { &a, &b };
+		a.SetValue(1.5), b.SetValue((__int64)4);
+		double total = 0;
+		const size_t calls = ops / 4;
+		double t = BenchTime([&] {
+			total = 0;
+			for (size_t i = 0; i < calls; ++i) {
+				ResultToken result;
+				result.InitResult(buf);
+				(obj->*scale->method)(result, scale->id, scale->invokeType, params, 2);
+				total += result.value_double;
+			}
+		});
+		CHECK_EQ(total, 6.0 * calls);
+		BenchReport("TypedMember call", (double)calls, "ns/op", t * 1e9 / calls);
+		obj->Release();
+	}
+	BenchKeep(sum);
+}
+
+// Arena parameter arrays and strings, and pooled object headers.
+static void BenchAllocators() {
+	const size_t counts[] = { 4, 64 };
+	const size_t ops = BenchSize(2000000, 20000);
+	for (size_t count : counts) {
+		Arena arena;
+		double t = BenchTime([&] {
+			for (size_t i = 0; i < ops; ++i) {
+				ArenaScope scope(arena);
+				ExprTokenType** params = arena.NewParams(count);
+				for (size_t p = 0; p < count; ++p)
+					params[p]->SetValue(arena.Strdup(_T("parameter"), 9), 9);
+				BenchKeep(params);
+			}
+		});
+		BenchReport("Arena NewParams + Strdup", (double)count, "ns/op", t * 1e9 / ops);
+	}
+	std::vector<HostObject*> objects(BenchSize<size_t>(1000000, 10000));
+	double t = BenchTime([&] {
+		for (auto& obj : objects)
+			obj = new HostObject;
+		for (auto obj : objects)
+			obj->Release();
+	});
+	BenchReport("ObjectPool new + Release", (double)objects.size(), "ns/op", t * 1e9 / objects.size());
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "types");
+	HostModule module;
+	BenchFindField();
+	BenchFlatVector();
+	BenchMapSections();
+	BenchTString();
+	BenchTokens(module);
+	BenchAllocators();
+	return BenchExit();
+}
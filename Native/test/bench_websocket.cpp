@@ -0,0 +1,197 @@
+// Benchmarks of websocket.cpp and its simd.h kernels: MaskBytes and Utf8Valid in GB/s for each
+// path (AVX2, SSE2 and scalar), and FrameDecoder.Feed in frames/s on buffers of many masked
+// frames, whole and fragmented, as a server receives them.  Every path must match the scalar one.
+#include "../websocket.cpp"
+#include "host.h"
+#include "bench.h"
+#include <random>
+
+static std::mt19937 sRandom(3);
+
+struct SimdPath
+{
+	const char* name;
+	int needs;
+};
+static const SimdPath sPaths[] = { { "avx2", CPU_AVX2 }, { "sse2", CPU_SSE2 }, { "scalar", 0 } };
+
+static void BenchMask(size_t aSize) {
+	MaskBytesType funcs[] = { MaskBytes_AVX2, MaskBytes_SSE2, MaskBytes_Scalar };
+	std::vector<char> src(aSize), expected(aSize), dest(aSize);
+	for (char& c : src)
+		c = (char)sRandom();
+	const UINT key = 0x9A3C51E7;
+	MaskBytes_Scalar(expected.data(), src.data(), aSize, key);
+	char name[64];
+	for (int i = 0; i < 3; ++i) {
+		if ((CpuFeatures() & sPaths[i].needs) != sPaths[i].needs)
+			continue;
+		size_t reps = (64 << 20) / aSize + 1;
+		double t = BenchTime([&] {
+			for (size_t r = 0; r < reps; ++r)
+				funcs[i](dest.data(), src.data(), aSize, key);
+		});
+		CHECK(dest == expected);
+		snprintf(name, sizeof(name), "MaskBytes %s", sPaths[i].name);
+		BenchReport(name, (double)aSize, "GB/s", aSize * reps / t / 1e9);
+	}
+}
+
+static void BenchUtf8Valid(size_t aSize) {
+	Utf8ValidType funcs[] = { Utf8Valid_AVX2, Utf8Valid_SSE2, Utf8Valid_Scalar };
+	// Mostly ASCII with some 2-, 3- and 4-byte sequences, as chat messages are.
+	std::string text;
+	while (text.size() < aSize) {
+		text += "message text ";
+		if (sRandom() % 4 == 0)
+			text += "\xC3\xA9\xE4\xB8\xAD\xF0\x9F\x98\x80";
+	}
+	text.resize(aSize);
+	while (!Utf8Valid_Scalar(text.data(), text.data() + text.size()))
+		text.back() = ' ';
+	char name[64];
+	for (int i = 0; i < 3; ++i) {
+		if ((CpuFeatures() & sPaths[i].needs) != sPaths[i].needs)
+			continue;
+		size_t reps = (64 << 20) / aSize + 1;
+		bool valid = true;
+		double t = BenchTime([&] {
+			for (size_t r = 0; r < reps; ++r)
+				valid &= funcs[i](text.data(), text.data() + text.size());
+		});
+		CHECK(valid);
+		std::string bad = text;
+		bad[bad.size() / 2] = '\xFF';
+		CHECK(!funcs[i](bad.data(), bad.data() + bad.size()));
+		snprintf(name, sizeof(name), "Utf8Valid %s", sPaths[i].name);
+		BenchReport(name, (double)aSize, "GB/s", aSize * reps / t / 1e9);
+	}
+}
+
+// Appends a masked frame, as a client sends it.
+static void AddFrame(std::string& aOut, BYTE aFirst, const char* aPayload, size_t aLength) {
+	UINT key = sRandom() | 1;
+	aOut += (char)aFirst;
+	if (aLength < 126)
+		aOut += (char)(0x80 | aLength);
+	else if (aLength < 0x10000)
+		aOut += (char)(0x80 | 126), aOut += (char)(aLength >> 8), aOut += (char)aLength;
+	else {
+		aOut += (char)(0x80 | 127);
+		for (int shift = 56; shift >= 0; shift -= 8)
+			aOut += (char)((unsigned __int64)aLength >> shift);
+	}
+	aOut.append((const char*)&key, 4);
+	size_t start = aOut.size();
+	aOut.resize(start + aLength);
+	MaskBytes_Scalar(&aOut[start], aPayload, aLength, key);
+}
+
+// Feeds aFrames (which unmasks them in place, so each run starts from a fresh copy).
+static void BenchFeed(HostModule& aModule, const char* aCase, std::string& aFrames, size_t aMessages, size_t aPayload, size_t aFrameCount) {
+	auto buf = new HostBuffer(aFrames.size());
+	const ObjectMember* feed = aModule.Member(_T("FrameDecoder.Prototype.Feed"));
+	size_t messages = 0, bytes = 0;
+	double best = 1e300;
+	for (int rep = 0; rep < (sBench.quick ? 1 : 3); ++rep) {
+		memcpy(buf->mData, aFrames.data(), aFrames.size());
+		IObject* dec = aModule.New(_T("FrameDecoder"));
+		double t = BenchNow();
+		HostResult r = aModule.Invoke(dec, feed, { (IObject*)buf });
+		t = BenchNow() - t;
+		best = t < best ? t : best;
+		auto arr = static_cast<HostArray*>(r.Obj());
+		messages = arr ? arr->mLength : 0, bytes = 0;
+		for (Object::index_t i = 0; arr && i < arr->mLength; ++i)
+			bytes += (size_t)static_cast<HostObject*>(arr->mItem[i].object)->Get(_T("size"))->n_int64;
+		dec->Release();
+	}
+	CHECK_EQ(messages, aMessages);
+	CHECK_EQ(bytes, aMessages * aPayload);
+	char name[96];
+	snprintf(name, sizeof(name), "Feed %s frames", aCase);
+	BenchReport(name, (double)aPayload, "frames/s", aFrameCount / best);
+	snprintf(name, sizeof(name), "Feed %s", aCase);
+	BenchReport(name, (double)aPayload, "GB/s", aFrames.size() / best / 1e9);
+	buf->Release();
+}
+
+static void BenchFrames(HostModule& aModule, size_t aPayload) {
+	size_t total = BenchSize<size_t>(64 << 20, 1 << 20), count = total / aPayload + 1;
+	if (count > 100000)
+		count = 100000;
+	std::string binary(aPayload, 0), text;
+	for (char& c : binary)
+		c = (char)sRandom();
+	while (text.size() < aPayload)
+		text += "{\"type\":\"update\",\"value\":42} ";
+	text.resize(aPayload);
+
+	std::string frames;
+	for (size_t i = 0; i < count; ++i)
+		AddFrame(frames, 0x80 | WS_BINARY, binary.data(), aPayload);
+	BenchFeed(aModule, "binary", frames, count, aPayload, count);
+	frames.clear();
+	for (size_t i = 0; i < count; ++i)
+		AddFrame(frames, 0x80 | WS_TEXT, text.data(), aPayload);
+	BenchFeed(aModule, "text", frames, count, aPayload, count);
+
+	// Each message in four fragments, joined in place.
+	if (aPayload >= 4) {
+		frames.clear();
+		size_t part = aPayload / 4;
+		for (size_t i = 0; i < count; ++i)
+			for (int f = 0; f < 4; ++f)
+				AddFrame(frames, (f == 3 ? 0x80 : 0) | (f ? WS_CONTINUATION : WS_BINARY), binary.data() + f * part, f == 3 ? aPayload - 3 * part : part);
+		BenchFeed(aModule, "fragmented", frames, count, aPayload, count * 4);
+	}
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "websocket");
+	HostModule module;
+	const size_t sizes[] = { 125, 4096, 65536, 1 << 20 };
+	for (size_t size : sizes) {
+		BenchMask(size);
+		BenchUtf8Valid(size);
+		BenchFrames(module, size);
+	}
+
+	// EncodeFrame with a mask round-trips through the decoder.
+	HostResult frame = module.Call(_T("EncodeFrame"), { _T("héllo"), 0x12345678 });
+	auto frame_buf = static_cast<BufferObject*>(frame.Obj());
+	CHECK(frame_buf && frame_buf->mSize == 2 + 4 + 6);
+	IObject* dec = module.New(_T("FrameDecoder"));
+	HostResult msgs = module.Invoke(dec, _T("FrameDecoder.Prototype.Feed"), { frame.Obj() });
+	auto arr = static_cast<HostArray*>(msgs.Obj());
+	CHECK(arr && arr->mLength == 1);
+	if (arr && arr->mLength == 1) {
+		Object::Variant* text = static_cast<HostObject*>(arr->mItem[0].object)->Get(_T("text"));
+		CHECK(text && text->symbol == SYM_STRING && HostNarrow(text->string.Value()) == "h\xC3\xA9llo");
+	}
+	dec->Release();
+
+	// An unmasked frame from a client is a protocol error, with the close code as Extra.
+	dec = module.New(_T("FrameDecoder"));
+	auto bad = new HostBuffer(3);
+	memcpy(bad->mData, "\x82\x01x", 3);
+	HostResult r = module.Invoke(dec, _T("FrameDecoder.Prototype.Feed"), { (IObject*)bad });
+	CHECK(r.Failed() && sHostError.extra == "1002");
+	bad->Release();
+	dec->Release();
+
+	// Reserved opcodes are protocol errors both ways.
+	for (BYTE opcode : { 0x3, 0x7, 0xB, 0xF }) {
+		dec = module.New(_T("FrameDecoder"));
+		bad = new HostBuffer(7);
+		memcpy(bad->mData, "\x80\x81\0\0\0\0x", 7);
+		*(BYTE*)bad->mData = 0x80 | opcode;
+		HostResult fed = module.Invoke(dec, _T("FrameDecoder.Prototype.Feed"), { (IObject*)bad });
+		CHECK(fed.Failed() && sHostError.message == "Reserved opcode." && sHostError.extra == "1002");
+		bad->Release();
+		dec->Release();
+		HostResult encoded = module.Call(_T("EncodeFrame"), { _T("x"), 0, opcode });
+		CHECK(encoded.Failed() && sHostError.extra == "1002");
+	}
+	return BenchExit();
+}
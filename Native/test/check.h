@@ -0,0 +1,25 @@
+#ifndef AHK2_TEST_CHECK_H
+#define AHK2_TEST_CHECK_H
+//
+// Checks for the Linux tests.  A failed CHECK prints its location and is counted; the test's
+// main returns CheckExit(), so ctest sees the failure without the rest of the test being cut short.
+//
+#include <cstdio>
+
+static int sCheckFailures;
+
+#define CHECK(cond) ((cond) ? (void)0 : CheckFailed(__FILE__, __LINE__, #cond))
+#define CHECK_EQ(a, b) CHECK((a) == (b))
+
+static void CheckFailed(const char* aFile, int aLine, const char* aCond) {
+	if (++sCheckFailures <= 50)
+		fprintf(stderr, "%s:%d: CHECK failed: %s\n", aFile, aLine, aCond);
+}
+
+static int CheckExit() {
+	if (sCheckFailures)
+		fprintf(stderr, "%d check(s) failed\n", sCheckFailures);
+	return sCheckFailures ? 1 : 0;
+}
+
+#endif // !AHK2_TEST_CHECK_H
@@ -0,0 +1,210 @@
+// Fuzz target and throughput benchmark for httpbody.cpp.  LLVMFuzzerTestOneInput feeds one
+// input to the multipart parser (in one call and again in chunks, which must agree), to
+// urldecode and to parse_urlencoded.  Built with AHK2_LIBFUZZER it is a libFuzzer target;
+// otherwise main() runs it on generated inputs, then measures the parser and decoder.
+#include "../httpbody.cpp"
+#include "host.h"
+#include "bench.h"
+#include <random>
+
+static HostModule* sModule;
+
+struct PartInfo
+{
+	std::string key;
+	size_t offset, size;
+	bool operator==(const PartInfo& aOther) const { return key == aOther.key && offset == aOther.offset && aOther.size == size; }
+};
+
+static __int64 FieldInt(HostObject* aObj, LPCTSTR aName) {
+	Object::Variant* field = aObj->Get(aName);
+	return field && field->symbol == SYM_INTEGER ? field->n_int64 : -1;
+}
+
+// Reads the parts, checking that every slice lies within the bytes fed so far.
+static std::vector<PartInfo> ReadParts(IObject* aParser, const char* aBase, size_t aLength) {
+	std::vector<PartInfo> parts;
+	HostResult r = sModule->Invoke(aParser, _T("MultipartParser.Prototype.Parts"), {}, IT_GET);
+	auto arr = static_cast<HostArray*>(r.Obj());
+	CHECK(arr != nullptr);
+	for (Object::index_t i = 0; arr && i < arr->mLength; ++i) {
+		auto part = static_cast<HostObject*>(arr->mItem[i].object);
+		__int64 ptr = FieldInt(part, _T("ptr")), size = FieldInt(part, _T("size"));
+		size_t offset = (size_t)ptr - (size_t)aBase;
+		CHECK(size >= 0 && offset <= aLength && (size_t)size <= aLength - offset);
+		Object::Variant* key = part->Get(_T("key"));
+		parts.push_back({ key && key->symbol == SYM_STRING ? HostNarrow(key->string.Value()) : "", offset, (size_t)size });
+	}
+	return parts;
+}
+
+static IObject* NewParser(LPCTSTR aBoundary) {
+	IObject* parser = sModule->New(_T("MultipartParser"), { aBoundary });
+	CHECK(parser != nullptr);
+	return parser;
+}
+
+// Input layout: a byte of boundary length (1-16), the boundary, a byte seeding the chunk
+// sizes, then the body.  The boundary is restricted to printable ASCII.
+static void FuzzMultipart(const uint8_t* aData, size_t aSize) {
+	if (aSize < 3)
+		return;
+	size_t boundary_length = aData[0] % 16 + 1;
+	if (aSize < 2 + boundary_length)
+		return;
+	TCHAR boundary[17];
+	for (size_t i = 0; i < boundary_length; ++i)
+		boundary[i] = (TCHAR)(aData[1 + i] % 94 + 33);
+	boundary[boundary_length] = 0;
+	std::minstd_rand chunks(aData[1 + boundary_length]);
+	size_t length = aSize - 2 - boundary_length;
+	auto body = new HostBuffer(length);
+	memcpy(body->mData, aData + 2 + boundary_length, length);
+	auto base = (const char*)body->mData;
+
+	IObject* whole = NewParser(boundary);
+	HostResult done = sModule->Invoke(whole, _T("MultipartParser.Prototype.Feed"), { (IObject*)body });
+	CHECK(!done.Failed());
+	std::vector<PartInfo> expected = ReadParts(whole, base, length);
+
+	IObject* chunked = NewParser(boundary);
+	__int64 chunk_done = 0;
+	for (size_t fed = 0; fed < length; ) {
+		fed += 1 + chunks() % 64;
+		if (fed > length)
+			fed = length;
+		HostResult r = sModule->Invoke(chunked, _T("MultipartParser.Prototype.Feed"), { (IObject*)body, (__int64)fed });
+		CHECK(!r.Failed());
+		chunk_done = r.Int();
+		ReadParts(chunked, base, fed);
+	}
+	if (length) {
+		CHECK_EQ(chunk_done, done.Int());
+		CHECK(ReadParts(chunked, base, length) == expected);
+	}
+	// A length beyond the Buffer is rejected.
+	HostResult bad = sModule->Invoke(chunked, _T("MultipartParser.Prototype.Feed"), { (IObject*)body, (__int64)length + 1 });
+	CHECK(bad.Failed());
+	chunked->Release();
+	whole->Release();
+	body->Release();
+}
+
+static void FuzzUrlencoded(const uint8_t* aData, size_t aSize) {
+	std::vector<TCHAR> text(aSize + 1);
+	for (size_t i = 0; i < aSize; ++i)
+		text[i] = aData[i];
+	HostValue str(text.data(), aSize);
+	HostResult decoded = sModule->Call(_T("urldecode"), { str });
+	CHECK(decoded.symbol == SYM_STRING && (size_t)decoded.marker_length <= aSize);
+	HostResult params = sModule->Call(_T("parse_urlencoded"), { str });
+	CHECK(params.Obj() != nullptr);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* aData, size_t aSize) {
+	static HostModule sHost;
+	sModule = &sHost;
+	if (!aSize)
+		return 0;
+	if (aData[0] & 1)
+		FuzzMultipart(aData + 1, aSize - 1);
+	else FuzzUrlencoded(aData + 1, aSize - 1);
+	return 0;
+}
+
+#ifndef AHK2_LIBFUZZER
+
+// Generated inputs: well-formed bodies with random damage, and bytes from a small alphabet
+// of delimiter fragments, which reach more of the parser's states than uniform bytes.
+static std::string GenerateInput(std::mt19937& aRandom) {
+	std::string input(1, (char)(aRandom() & 1));
+	if (input[0] & 1) {
+		const char boundary[] = { 2, 'X' - 33, 'y' - 33, 'Z' - 33 }; // The boundary "XyZ", as FuzzMultipart reads it.
+		input.append(boundary, sizeof(boundary));
+		input += (char)aRandom();
+	}
+	static const char* fragments[] = { "\r\n", "--", "XyZ", "\r\n--XyZ", "\r\n--XyZ--", "Content-Disposition: form-data; name=\"f\"",
+		"; filename=\"a.txt\"", "Content-Type: text/plain", ":", ";", "=", "\"", " ", "%", "%41", "%e2%82%ac", "%zz", "&", "+", "data" };
+	int count = aRandom() % 40;
+	for (int i = 0; i < count; ++i)
+		input += fragments[aRandom() % (sizeof(fragments) / sizeof(*fragments))];
+	for (int flips = aRandom() % 3; flips-- && input.size() > 1; )
+		input[1 + aRandom() % (input.size() - 1)] = (char)aRandom();
+	return input;
+}
+
+static std::string MultipartBody(size_t aPayload, int aParts, std::mt19937& aRandom) {
+	std::string body = "preamble";
+	for (int p = 0; p < aParts; ++p) {
+		body += "\r\n--XyZ\r\nContent-Disposition: form-data; name=\"file";
+		body += std::to_string(p) + "\"; filename=\"upload.bin\"\r\nContent-Type: application/octet-stream\r\n\r\n";
+		size_t start = body.size();
+		body.resize(start + aPayload / aParts);
+		for (size_t i = start; i < body.size(); ++i)
+			body[i] = (char)aRandom();
+	}
+	return body + "\r\n--XyZ--\r\n";
+}
+
+static void BenchMultipart(std::mt19937& aRandom) {
+	const size_t sizes[] = { 64 << 10, 1 << 20, 50 << 20 };
+	for (size_t size : sizes) {
+		if (sBench.quick && size > (1 << 20))
+			break;
+		std::string body = MultipartBody(size, 4, aRandom);
+		auto buf = new HostBuffer(body.size());
+		memcpy(buf->mData, body.data(), body.size());
+		// In one call, and in 64 KB chunks as on_read_body receives them.
+		for (size_t chunk : { body.size(), (size_t)65536 }) {
+			size_t parts = 0;
+			double t = BenchTime([&] {
+				IObject* parser = NewParser(_T("XyZ"));
+				for (size_t fed = 0; fed < body.size(); ) {
+					fed = fed + chunk < body.size() ? fed + chunk : body.size();
+					sModule->Invoke(parser, _T("MultipartParser.Prototype.Feed"), { (IObject*)buf, (__int64)fed });
+				}
+				parts = ReadParts(parser, (const char*)buf->mData, body.size()).size();
+				parser->Release();
+			});
+			CHECK_EQ(parts, 4u);
+			BenchReport(chunk == 65536 ? "multipart 64 KB chunks" : "multipart", (double)body.size(), "MB/s", body.size() / t / 1e6);
+		}
+		buf->Release();
+	}
+}
+
+static void BenchUrlencoded(std::mt19937& aRandom) {
+	size_t pairs = BenchSize<size_t>(100000, 2000);
+	std::string form;
+	for (size_t i = 0; i < pairs; ++i) {
+		if (i)
+			form += '&';
+		form += "name" + std::to_string(i) + "=value%20" + std::to_string(aRandom()) + (i % 4 ? "+text" : "%E2%82%AC%C3%A9");
+	}
+	auto text = HostWiden(form);
+	HostValue str(text);
+	double t = BenchTime([&] { BenchKeep(sModule->Call(_T("urldecode"), { str }).marker_length); });
+	BenchReport("urldecode", (double)form.size(), "MB/s", form.size() / t / 1e6);
+	t = BenchTime([&] {
+		HostResult params = sModule->Call(_T("parse_urlencoded"), { str });
+		CHECK(params.Obj() != nullptr);
+	});
+	BenchReport("parse_urlencoded", (double)form.size(), "MB/s", form.size() / t / 1e6);
+}
+
+int main(int argc, char** argv) {
+	BenchInit(argc, argv, "httpbody");
+	LLVMFuzzerTestOneInput(nullptr, 0); // Creates the host.
+	std::mt19937 random(17);
+	size_t runs = BenchSize<size_t>(200000, 5000);
+	for (size_t i = 0; i < runs; ++i) {
+		std::string input = GenerateInput(random);
+		LLVMFuzzerTestOneInput((const uint8_t*)input.data(), input.size());
+	}
+	BenchReport("fuzz inputs", (double)runs, "count", (double)runs);
+	BenchMultipart(random);
+	BenchUrlencoded(random);
+	return BenchExit();
+}
+
+#endif // !AHK2_LIBFUZZER
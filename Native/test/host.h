@@ -0,0 +1,797 @@
+#ifndef AHK2_TEST_HOST_H
+#define AHK2_TEST_HOST_H
+//
+// Host - a stand-in for AutoHotkey's side of the module interface, so that the Native modules
+// can be tested and benchmarked on Linux.  A test includes the module source, then this file:
+//   #include "../json.cpp"
+//   #include "host.h"
+// It provides:
+//  - The global classes modules look up with GetGlobal (Array, Map, Object, Buffer, ComValue,
+//    SetTimer and the Error classes), using the object layouts of ahk2_types.h.
+//  - Errors thrown through the provider, recorded in sHostError.
+//  - HostModule, which loads the module's export table through ahk2_module_load, so functions
+//    and members are called as the script would call them.
+// The host's objects are plain C++ classes, so the module's objects dispatch their members
+// through HostModule rather than through a rewritten vtable (see ObjectBase::ReWriteVTB).
+//
+
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+//
+// Strings.
+//
+
+// Converts UTF-16 to UTF-8, for comparing results and printing them.
+static std::string HostNarrow(LPCTSTR aStr, size_t aLength = -1) {
+	std::string out;
+	if (!aStr)
+		return out;
+	if (aLength == (size_t)-1)
+		aLength = _tcslen(aStr);
+	for (size_t i = 0; i < aLength; ++i) {
+		UINT c = (_TUCHAR)aStr[i];
+		if (c >= 0xD800 && c < 0xDC00 && i + 1 < aLength && (_TUCHAR)aStr[i + 1] >= 0xDC00 && (_TUCHAR)aStr[i + 1] < 0xE000)
+			c = 0x10000 + ((c - 0xD800) << 10) + ((_TUCHAR)aStr[++i] - 0xDC00);
+		if (c < 0x80)
+			out += (char)c;
+		else if (c < 0x800)
+			out += (char)(0xC0 | c >> 6), out += (char)(0x80 | (c & 0x3F));
+		else if (c < 0x10000)
+			out += (char)(0xE0 | c >> 12), out += (char)(0x80 | (c >> 6 & 0x3F)), out += (char)(0x80 | (c & 0x3F));
+		else
+			out += (char)(0xF0 | c >> 18), out += (char)(0x80 | (c >> 12 & 0x3F)), out += (char)(0x80 | (c >> 6 & 0x3F)), out += (char)(0x80 | (c & 0x3F));
+	}
+	return out;
+}
+
+// Converts ASCII or UTF-8 to a zero-terminated UTF-16 string.
+static std::vector<TCHAR> HostWiden(const std::string& aStr) {
+	std::vector<TCHAR> out;
+	out.reserve(aStr.size() + 1);
+	for (size_t i = 0; i < aStr.size(); ) {
+		UINT c = (UCHAR)aStr[i++], extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+		if (extra)
+			c &= 0x3F >> extra;
+		for (; extra && i < aStr.size(); --extra)
+			c = c << 6 | ((UCHAR)aStr[i++] & 0x3F);
+		if (c >= 0x10000)
+			out.push_back((TCHAR)(0xD800 + ((c - 0x10000) >> 10))), c = 0xDC00 + ((c - 0x10000) & 0x3FF);
+		out.push_back((TCHAR)c);
+	}
+	out.push_back(0);
+	return out;
+}
+
+//
+// Values.  Object fields, Array items and Map values are Object::Variant, whose strings are
+// FlatVector<TCHAR> data allocated by the host.
+//
+
+static void HostSetString(Object::Variant& aVar, LPCTSTR aStr, size_t aLength) {
+	auto data = (FlatVector<TCHAR>::Data*)malloc(sizeof(FlatVector<TCHAR>::Data) + (aLength + 1) * sizeof(TCHAR));
+	data->size = aLength + 1, data->length = aLength;
+	auto chars = (TCHAR*)(data + 1);
+	memcpy(chars, aStr, aLength * sizeof(TCHAR));
+	chars[aLength] = 0;
+	aVar.symbol = SYM_STRING;
+	aVar.string.data = data;
+}
+
+static void HostFree(Object::Variant& aVar) {
+	if (aVar.symbol == SYM_STRING && aVar.string.data != &FlatVector<TCHAR>::Empty)
+		free(aVar.string.data);
+	else if (aVar.symbol == SYM_OBJECT)
+		aVar.object->Release();
+	aVar.symbol = SYM_MISSING;
+}
+
+// Stores a copy of aValue, as assigning it in script would.
+static void HostAssign(Object::Variant& aVar, ExprTokenType& aValue) {
+	ExprTokenType value;
+	TokenToValue(aValue, value);
+	switch (aVar.symbol = value.symbol)
+	{
+	case SYM_STRING:
+		HostSetString(aVar, value.marker, value.marker_length == (size_t)-1 ? _tcslen(value.marker) : value.marker_length);
+		break;
+	case SYM_OBJECT:
+		aVar.object = value.object;
+		aVar.object->AddRef();
+		break;
+	case SYM_INTEGER:
+	case SYM_FLOAT:
+		aVar.n_int64 = value.value_int64;
+		break;
+	default:
+		aVar.symbol = SYM_MISSING;
+		aVar.n_int64 = 0;
+	}
+}
+
+static void HostCopy(Object::Variant& aDest, Object::Variant& aSource) {
+	ExprTokenType value;
+	VariantToToken(aSource, value);
+	HostAssign(aDest, value);
+	aDest.key_c = aSource.key_c;
+}
+
+// A script variable, for output parameters.
+struct HostVar : Var
+{
+	HostVar() {
+		mContentsInt64 = 0;
+		mCharContents = (LPTSTR)_T("");
+		mAttrib = 0, mScope = VAR_LOCAL, mType = VAR_NORMAL;
+		mName = (LPTSTR)_T("var");
+	}
+	~HostVar() {
+		if (mAttrib & VAR_ATTRIB_IS_OBJECT)
+			mObject->Release();
+		if (mHowAllocated == ALLOC_MALLOC)
+			free(mByteContents);
+	}
+	HostVar(const HostVar&) = delete;
+	bool IsInt() { return mAttrib & VAR_ATTRIB_IS_INT64; }
+	bool IsObject() { return mAttrib & VAR_ATTRIB_IS_OBJECT; }
+	std::string Str() { return HostNarrow(mCharContents, mByteLength / sizeof(TCHAR)); }
+};
+
+// A parameter value: an integer, float, string, object, output variable or missing.
+struct HostValue : ExprTokenType
+{
+	template<class T, class = typename std::enable_if<std::is_integral<T>::value>::type>
+	HostValue(T aValue) { SetValue((__int64)aValue); }
+	HostValue(double aValue) { SetValue(aValue); }
+	HostValue(LPCTSTR aValue, size_t aLength = -1) { SetValue((LPTSTR)aValue, aLength); }
+	HostValue(const std::vector<TCHAR>& aValue) { SetValue((LPTSTR)aValue.data(), aValue.size() - 1); }
+	HostValue(IObject* aValue) { SetValue(aValue); }
+	HostValue(Var& aVar) { symbol = SYM_VAR, var = &aVar; }
+	static HostValue Missing() { HostValue v((__int64)0); v.symbol = SYM_MISSING; return v; }
+};
+typedef std::initializer_list<HostValue> HostArgs;
+
+// A modifiable copy of the arguments and the parameter array pointing at it, optionally
+// preceded by aThis (as a constructor receives its class).
+struct HostParams
+{
+	std::vector<ExprTokenType> values;
+	std::vector<ExprTokenType*> ptrs;
+	HostParams(HostArgs aArgs, IObject* aThis = nullptr) {
+		if (aThis)
+			values.emplace_back(aThis);
+		values.insert(values.end(), aArgs.begin(), aArgs.end());
+		for (auto& value : values)
+			ptrs.push_back(&value);
+	}
+};
+
+// A ResultToken with its own buffer, freed on destruction.
+struct HostResult : ResultToken
+{
+	TCHAR mBuf[MAX_NUMBER_SIZE];
+
+	HostResult() { InitResult(mBuf); }
+	HostResult(HostResult&& aOther) {
+		memcpy((ResultToken*)this, (ResultToken*)&aOther, sizeof(ResultToken));
+		memcpy(mBuf, aOther.mBuf, sizeof(mBuf));
+		buf = mBuf;
+		if (symbol == SYM_STRING && marker >= aOther.mBuf && marker < aOther.mBuf + MAX_NUMBER_SIZE)
+			marker = mBuf + (marker - aOther.mBuf);
+		aOther.InitResult(aOther.mBuf);
+	}
+	HostResult(const HostResult&) = delete;
+	~HostResult() { Free(); }
+
+	bool Failed() { return result == FAIL; }
+	__int64 Int() { return symbol == SYM_INTEGER ? value_int64 : 0; }
+	double Float() { return symbol == SYM_FLOAT ? value_double : symbol == SYM_INTEGER ? (double)value_int64 : 0; }
+	IObject* Obj() { return symbol == SYM_OBJECT ? object : nullptr; }
+	std::string Str() { return symbol == SYM_STRING ? HostNarrow(marker, marker_length) : std::string(); }
+};
+
+//
+// Errors thrown by the module.
+//
+
+struct HostError
+{
+	int count = 0;
+	std::string message, extra, type;
+	void Clear() { count = 0, message.clear(), extra.clear(), type.clear(); }
+};
+static HostError sHostError;
+
+//
+// Object - fields kept sorted by name, as FindField expects.
+//
+
+class HostObject : public Object
+{
+public:
+	LPTSTR mType;
+
+	HostObject(LPTSTR aType = (LPTSTR)_T("Object")) : mType(aType) { mFlags = 0; }
+	~HostObject() {
+		for (index_t i = 0; i < mFields.Length(); ++i) {
+			HostFree(mFields[i]);
+			free(mFields[i].name);
+		}
+		if (mFields.data != &FlatVector<FieldType, index_t>::Empty)
+			free(mFields.data);
+	}
+	LPTSTR Type() { return mType; }
+
+	Variant* Get(LPCTSTR aName) { return FindField((LPTSTR)aName); }
+	void Set(LPCTSTR aName, ExprTokenType& aValue) {
+		index_t pos;
+		if (FieldType* field = FindField((LPTSTR)aName, &pos)) {
+			HostFree(*field);
+			HostAssign(*field, aValue);
+			return;
+		}
+		index_t length = mFields.Length();
+		if (length == mFields.Capacity() || mFields.data == &FlatVector<FieldType, index_t>::Empty) {
+			index_t capacity = length ? length * 2 : 4;
+			auto data = (FlatVector<FieldType, index_t>::Data*)realloc(length ? mFields.data : nullptr
+				, sizeof(FlatVector<FieldType, index_t>::Data) + capacity * sizeof(FieldType));
+			data->size = capacity, data->length = length;
+			mFields.data = data;
+		}
+		memmove(mFields.Value() + pos + 1, mFields.Value() + pos, (length - pos) * sizeof(FieldType));
+		++mFields.Length();
+		FieldType& field = mFields[pos];
+		field.name = _tcsdup(aName);
+		field.key_c = _totlower(*aName);
+		HostAssign(field, aValue);
+	}
+	void Set(LPCTSTR aName, HostValue aValue) { Set(aName, (ExprTokenType&)aValue); }
+
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+		if (IS_INVOKE_SET && aName && aParamCount == 1) {
+			Set(aName, *aParam[0]);
+			return OK;
+		}
+		if (IS_INVOKE_GET && aName) {
+			if (Variant* field = Get(aName)) {
+				ExprTokenType value;
+				VariantToToken(*field, value);
+				if (value.symbol == SYM_STRING)
+					value.marker = _tcsdup(value.marker), aResultToken.mem_to_free = value.marker;
+				else if (value.symbol == SYM_OBJECT)
+					value.object->AddRef();
+				*(ExprTokenType*)&aResultToken = value;
+				return OK;
+			}
+			return INVOKE_NOT_HANDLED;
+		}
+		if (IS_INVOKE_CALL && aName && !_tcsicmp(aName, _T("Clone"))) {
+			auto clone = new HostObject(mType);
+			for (index_t i = 0; i < mFields.Length(); ++i) {
+				ExprTokenType value;
+				VariantToToken(mFields[i], value);
+				clone->Set(mFields[i].name, value);
+			}
+			aResultToken.SetValue(clone);
+			return OK;
+		}
+		return INVOKE_NOT_HANDLED;
+	}
+};
+
+//
+// Array
+//
+
+class HostArray : public Array
+{
+public:
+	HostArray() { mFlags = 0; }
+	~HostArray() {
+		for (index_t i = 0; i < mLength; ++i)
+			HostFree(mItem[i]);
+		free(mItem);
+	}
+	LPTSTR Type() { return (LPTSTR)_T("Array"); }
+
+	void Reserve(index_t aCapacity) {
+		if (aCapacity <= mCapacity)
+			return;
+		mItem = (Variant*)realloc(mItem, aCapacity * sizeof(Variant));
+		mCapacity = aCapacity;
+	}
+	void Push(ExprTokenType& aValue) {
+		if (mLength == mCapacity)
+			Reserve(mCapacity ? mCapacity * 2 : 8);
+		Variant& item = mItem[mLength++];
+		memset((void*)&item, 0, sizeof(item));
+		HostAssign(item, aValue);
+	}
+	void Push(HostValue aValue) { Push((ExprTokenType&)aValue); }
+
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+		if (IS_INVOKE_CALL && aName && !_tcsicmp(aName, _T("Push"))) {
+			for (int i = 0; i < aParamCount; ++i)
+				Push(*aParam[i]);
+			return OK;
+		}
+		if (IS_INVOKE_GET && aName && !_tcsicmp(aName, _T("Length"))) {
+			aResultToken.SetValue((__int64)mLength);
+			return OK;
+		}
+		if (IS_INVOKE_CALL && aName && !_tcsicmp(aName, _T("Clone"))) {
+			auto clone = new HostArray;
+			clone->Reserve(mLength);
+			for (index_t i = 0; i < mLength; ++i) {
+				ExprTokenType value;
+				VariantToToken(mItem[i], value);
+				clone->Push(value);
+			}
+			aResultToken.SetValue(clone);
+			return OK;
+		}
+		return INVOKE_NOT_HANDLED;
+	}
+};
+
+//
+// Map - keys kept sorted within the int, object and string sections.
+//
+
+class HostMap : public Map
+{
+public:
+	HostMap() { mFlags = 0; }
+	~HostMap() {
+		for (index_t i = 0; i < mCount; ++i) {
+			HostFree(mItem[i]);
+			if (i >= mKeyOffsetString)
+				free(mItem[i].key.s);
+			else if (i >= mKeyOffsetObject)
+				mItem[i].key.p->Release();
+		}
+		free(mItem);
+	}
+	LPTSTR Type() { return (LPTSTR)_T("Map"); }
+
+	void Set(ExprTokenType& aKey, ExprTokenType& aValue) {
+		ExprTokenType key;
+		TokenToValue(aKey, key);
+		int section = key.symbol == SYM_INTEGER ? 0 : key.symbol == SYM_OBJECT ? 1 : 2;
+		index_t left = section == 0 ? 0 : section == 1 ? mKeyOffsetObject : mKeyOffsetString;
+		index_t right = section == 0 ? mKeyOffsetObject : section == 1 ? mKeyOffsetString : mCount;
+		auto compare = [&](Key& aOther) {
+			return section == 0 ? (key.value_int64 > aOther.i) - (key.value_int64 < aOther.i)
+				: section == 1 ? (key.object > aOther.p) - (key.object < aOther.p)
+				: CaseFlags() ? _tcsicmp(key.marker, aOther.s) : _tcscmp(key.marker, aOther.s);
+		};
+		while (left < right) {
+			index_t mid = left + (right - left) / 2;
+			int c = compare(mItem[mid].key);
+			if (!c) {
+				HostFree(mItem[mid]);
+				HostAssign(mItem[mid], aValue);
+				return;
+			}
+			if (c < 0)
+				right = mid;
+			else
+				left = mid + 1;
+		}
+		if (mCount == mCapacity) {
+			mCapacity = mCapacity ? mCapacity * 2 : 8;
+			mItem = (Pair*)realloc(mItem, mCapacity * sizeof(Pair));
+		}
+		memmove(mItem + left + 1, mItem + left, (mCount - left) * sizeof(Pair));
+		++mCount;
+		Pair& pair = mItem[left];
+		memset((void*)&pair, 0, sizeof(pair));
+		if (section == 0)
+			pair.key.i = key.value_int64, ++mKeyOffsetObject, ++mKeyOffsetString;
+		else if (section == 1)
+			pair.key.p = key.object, key.object->AddRef(), ++mKeyOffsetString;
+		else
+			pair.key.s = key.marker_length == (size_t)-1 ? _tcsdup(key.marker) : HostDup(key.marker, key.marker_length);
+		HostAssign(pair, aValue);
+	}
+	void Set(HostValue aKey, HostValue aValue) { Set((ExprTokenType&)aKey, (ExprTokenType&)aValue); }
+
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+		if (IS_INVOKE_CALL && aName && !_tcsicmp(aName, _T("Set"))) {
+			for (int i = 0; i + 1 < aParamCount; i += 2)
+				Set(*aParam[i], *aParam[i + 1]);
+			return OK;
+		}
+		if (IS_INVOKE_SET && aName && !_tcsicmp(aName, _T("CaseSense")) && !mCount) {
+			ExprTokenType value;
+			TokenToValue(*aParam[0], value);
+			bool locale = value.symbol == SYM_STRING && !_tcsicmp(value.marker, _T("Locale"));
+			bool caseless = value.symbol == SYM_STRING ? locale || !_tcsicmp(value.marker, _T("Off")) : !TokenToBool(value);
+			mFlags = (mFlags & ~(MapCaseless | MapUseLocale)) | (caseless ? (int)MapCaseless : 0) | (locale ? (int)MapUseLocale : 0);
+			return OK;
+		}
+		if (IS_INVOKE_GET && aName && !_tcsicmp(aName, _T("Count"))) {
+			aResultToken.SetValue((__int64)mCount);
+			return OK;
+		}
+		if (IS_INVOKE_CALL && aName && !_tcsicmp(aName, _T("Clone"))) {
+			auto clone = new HostMap;
+			clone->mFlags = mFlags;
+			for (index_t i = 0; i < mCount; ++i) {
+				ExprTokenType key, value;
+				if (i < mKeyOffsetObject)
+					key.SetValue((__int64)mItem[i].key.i);
+				else if (i < mKeyOffsetString)
+					key.SetValue(mItem[i].key.p);
+				else
+					key.SetValue(mItem[i].key.s);
+				VariantToToken(mItem[i], value);
+				clone->Set(key, value);
+			}
+			aResultToken.SetValue(clone);
+			return OK;
+		}
+		return INVOKE_NOT_HANDLED;
+	}
+
+private:
+	static LPTSTR HostDup(LPCTSTR aStr, size_t aLength) {
+		auto s = (LPTSTR)malloc((aLength + 1) * sizeof(TCHAR));
+		memcpy(s, aStr, aLength * sizeof(TCHAR));
+		s[aLength] = 0;
+		return s;
+	}
+};
+
+//
+// Buffer and ComValue
+//
+
+class HostBuffer : public BufferObject
+{
+public:
+	HostBuffer(size_t aSize) { mFlags = 0, mSize = aSize, mData = malloc(aSize ? aSize : 1); }
+	~HostBuffer() { free(mData); }
+	LPTSTR Type() { return (LPTSTR)_T("Buffer"); }
+
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+		if (!aName)
+			return INVOKE_NOT_HANDLED;
+		if (IS_INVOKE_SET && !_tcsicmp(aName, _T("Size"))) {
+			ExprTokenType size;
+			TokenToValue(*aParam[0], size);
+			if (size.symbol != SYM_INTEGER || size.value_int64 < 0)
+				return aResultToken.result = FAIL;
+			void* data = realloc(mData, size.value_int64 ? (size_t)size.value_int64 : 1);
+			if (!data)
+				return aResultToken.result = FAIL;
+			mData = data, mSize = (size_t)size.value_int64;
+			return OK;
+		}
+		if (IS_INVOKE_GET && !_tcsicmp(aName, _T("Size"))) {
+			aResultToken.SetValue((__int64)mSize);
+			return OK;
+		}
+		if (IS_INVOKE_GET && !_tcsicmp(aName, _T("Ptr"))) {
+			aResultToken.SetValue((__int64)(size_t)mData);
+			return OK;
+		}
+		return INVOKE_NOT_HANDLED;
+	}
+};
+
+class HostComValue : public ComObject
+{
+public:
+	HostComValue(VARTYPE aVarType, __int64 aValue) { mVarType = aVarType, mVal64 = aValue, mEventSink = nullptr, mFlags = 0; }
+	LPTSTR Type() { return (LPTSTR)_T("ComValue"); }
+};
+
+//
+// SetTimer - timers run when the test calls HostRunTimers, as the script's message loop would
+// run them.  Only run-once timers (a negative period) are used by the modules.
+//
+
+static std::vector<IObject*> sHostTimers;
+
+static void HostRunTimers() {
+	while (!sHostTimers.empty()) {
+		std::vector<IObject*> timers;
+		timers.swap(sHostTimers);
+		for (IObject* timer : timers) {
+			HostResult result;
+			timer->Invoke(result, IT_CALL, nullptr, ExprTokenType(timer), nullptr, 0);
+			timer->Release();
+		}
+	}
+}
+
+// Dispatches posted messages (such as async completions), then runs any timers they set.
+static int HostPumpMessages() {
+	int count = 0;
+	for (MSG msg; PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE); ++count)
+		DispatchMessage(&msg);
+	HostRunTimers();
+	return count;
+}
+
+//
+// Global classes and functions, as returned by the provider.
+//
+
+class HostGlobal : public ObjectBase
+{
+public:
+	enum Kind { ARRAY, MAP, OBJECT, BUFFER, COMVALUE, SETTIMER, ERROR_CLASS };
+	Kind mKind;
+	LPTSTR mName;
+
+	HostGlobal(Kind aKind, LPTSTR aName) : mKind(aKind), mName(aName) { mRefCount = 0x10000; } // Never freed.
+	LPTSTR Type() { return (LPTSTR)_T("Class"); }
+
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+		if (!IS_INVOKE_CALL || aName)
+			return INVOKE_NOT_HANDLED;
+		switch (mKind)
+		{
+		case ARRAY: {
+			auto arr = new HostArray;
+			arr->Reserve(aParamCount);
+			for (int i = 0; i < aParamCount; ++i)
+				arr->Push(*aParam[i]);
+			aResultToken.SetValue(arr);
+			break;
+		}
+		case MAP: {
+			auto map = new HostMap;
+			for (int i = 0; i + 1 < aParamCount; i += 2)
+				map->Set(*aParam[i], *aParam[i + 1]);
+			aResultToken.SetValue(map);
+			break;
+		}
+		case OBJECT:
+			aResultToken.SetValue(new HostObject);
+			break;
+		case BUFFER: {
+			ExprTokenType size;
+			size.SetValue((__int64)0);
+			if (aParamCount)
+				TokenToValue(*aParam[0], size);
+			if (size.symbol != SYM_INTEGER || size.value_int64 < 0)
+				return aResultToken.result = FAIL;
+			auto buf = new HostBuffer((size_t)size.value_int64);
+			if (!buf->mData) {
+				buf->Release();
+				Object::Error(ExprTokenType(_T("Out of memory.")), nullptr, _T("MemoryError"));
+				return aResultToken.result = FAIL;
+			}
+			aResultToken.SetValue(buf);
+			break;
+		}
+		case COMVALUE:
+			aResultToken.SetValue(new HostComValue((VARTYPE)aParam[0]->value_int64, aParamCount > 1 ? aParam[1]->value_int64 : 0));
+			break;
+		case SETTIMER:
+			if (aParamCount && aParam[0]->symbol == SYM_OBJECT) {
+				aParam[0]->object->AddRef();
+				sHostTimers.push_back(aParam[0]->object);
+			}
+			aResultToken.SetValue((__int64)0);
+			break;
+		case ERROR_CLASS: {
+			// Error(Message, What?, Extra?)
+			auto err = new HostObject(mName);
+			if (aParamCount > 0)
+				err->Set(_T("Message"), *aParam[0]);
+			if (aParamCount > 2 && aParam[2]->symbol != SYM_MISSING)
+				err->Set(_T("Extra"), *aParam[2]);
+			aResultToken.SetValue(err);
+			break;
+		}
+		}
+		return OK;
+	}
+};
+
+class HostProvider : public Object
+{
+public:
+	HostProvider() { mFlags = 0; mRefCount = 0x10000; }
+
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+		if (IS_INVOKE_GET && aName) {
+			static HostGlobal sGlobals[] = {
+				{ HostGlobal::ARRAY, (LPTSTR)_T("Array") },
+				{ HostGlobal::MAP, (LPTSTR)_T("Map") },
+				{ HostGlobal::OBJECT, (LPTSTR)_T("Object") },
+				{ HostGlobal::BUFFER, (LPTSTR)_T("Buffer") },
+				{ HostGlobal::COMVALUE, (LPTSTR)_T("ComValue") },
+				{ HostGlobal::SETTIMER, (LPTSTR)_T("SetTimer") },
+			};
+			static std::vector<HostGlobal*> sErrors;
+			for (auto& global : sGlobals)
+				if (!_tcscmp(aName, global.mName)) {
+					global.AddRef();
+					aResultToken.SetValue(&global);
+					return OK;
+				}
+			size_t length = _tcslen(aName);
+			if (length >= 5 && !_tcscmp(aName + length - 5, _T("Error"))) {
+				HostGlobal* cls = nullptr;
+				for (auto err : sErrors)
+					if (!_tcscmp(aName, err->mName))
+						cls = err;
+				if (!cls)
+					sErrors.push_back(cls = new HostGlobal(HostGlobal::ERROR_CLASS, _tcsdup(aName)));
+				cls->AddRef();
+				aResultToken.SetValue(cls);
+				return OK;
+			}
+			return aResultToken.result = FAIL;
+		}
+		if (IS_INVOKE_CALL && aName && !_tcscmp(aName, _T("throw"))) {
+			// throw(Message, Extra?, Type?), or throw(ErrorObject)
+			++sHostError.count;
+			sHostError.message.clear(), sHostError.extra.clear(), sHostError.type = "Error";
+			if (aParamCount > 0) {
+				ExprTokenType& msg = *aParam[0];
+				if (msg.symbol == SYM_OBJECT) {
+					auto err = dynamic_cast<HostObject*>(msg.object);
+					Variant* field;
+					if (err && (field = err->Get(_T("Message"))) && field->symbol == SYM_STRING)
+						sHostError.message = HostNarrow(field->string.Value(), field->string.Length());
+					if (err && (field = err->Get(_T("Extra"))) && field->symbol == SYM_STRING)
+						sHostError.extra = HostNarrow(field->string.Value(), field->string.Length());
+					if (err)
+						sHostError.type = HostNarrow(err->mType);
+				}
+				else if (msg.symbol == SYM_STRING)
+					sHostError.message = HostNarrow(msg.marker, msg.marker_length);
+			}
+			if (aParamCount > 1 && aParam[1]->symbol == SYM_STRING)
+				sHostError.extra = HostNarrow(aParam[1]->marker, aParam[1]->marker_length);
+			if (aParamCount > 2 && aParam[2]->symbol == SYM_STRING)
+				sHostError.type = HostNarrow(aParam[2]->marker, aParam[2]->marker_length);
+			return aResultToken.result = FAIL;
+		}
+		return INVOKE_NOT_HANDLED;
+	}
+};
+
+//
+// HostModule - the module's export table, as the loader receives it.
+//
+
+class HostLoader : public Object
+{
+public:
+	HostLoader() { mFlags = 0; }
+	ExportSymbol* mSymbols = nullptr;
+	UINT mCount = 0;
+
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+		mCount = (UINT)aParam[0]->value_int64;
+		mSymbols = (ExportSymbol*)aParam[1]->value_int64;
+		return OK;
+	}
+};
+
+class HostModule
+{
+	HostProvider mProvider;
+	HostLoader mLoader;
+	std::vector<HostObject*> mClasses; // The class objects passed to NewObject, by symbol.
+
+	static std::string MemberKey(LPCTSTR aName, int aInvokeType) {
+		std::string key = HostNarrow(aName);
+		return aInvokeType == IT_GET ? key + ".Get" : aInvokeType == IT_SET ? key + ".Set" : key;
+	}
+
+public:
+	// aLoad is the module's entry point; a benchmark which compiles a second module for
+	// comparison renames that one's (see bench_serialize.cpp) and passes it here.
+	HostModule(void* (*aLoad)(Object*, Object*) = ahk2_module_load) {
+		aLoad(&mLoader, &mProvider);
+		// See the comment at the top of this file.
+		memset(&ObjectBase::ahkVT, 0, sizeof(ObjectBase::ahkVT));
+		mClasses.resize(mLoader.mCount);
+	}
+	~HostModule() {
+		for (auto cls : mClasses)
+			if (cls)
+				cls->Release();
+	}
+
+	ExportSymbol* Symbol(LPCTSTR aName) {
+		for (UINT i = 0; i < mLoader.mCount; ++i)
+			if (!_tcsicmp(mLoader.mSymbols[i].name, aName))
+				return &mLoader.mSymbols[i];
+		return nullptr;
+	}
+	BuiltInFunctionType Func(LPCTSTR aName) {
+		ExportSymbol* sym = Symbol(aName);
+		return sym && !sym->member_count ? sym->call : nullptr;
+	}
+	// Finds a member by its full name, such as _T("HashMap.Prototype.Set"); properties are
+	// found by passing IT_GET or IT_SET.
+	const ObjectMember* Member(LPCTSTR aName, int aInvokeType = IT_CALL) {
+		std::string key = MemberKey(aName, aInvokeType);
+		for (UINT i = 0; i < mLoader.mCount; ++i) {
+			ExportSymbol& sym = mLoader.mSymbols[i];
+			for (UINT m = 0; sym.member_count && m < sym.member_count; ++m)
+				if (!strcasecmp(HostNarrow(sym.members[m].name).c_str(), key.c_str()))
+					return &sym.members[m];
+		}
+		return nullptr;
+	}
+
+	// Calls an exported function.
+	HostResult Call(LPCTSTR aName, HostArgs aArgs = {}) {
+		HostResult result;
+		BuiltInFunctionType func = Func(aName);
+		if (!func) {
+			result.result = FAIL;
+			return result;
+		}
+		HostParams params(aArgs);
+		sHostError.Clear();
+		func(result, params.ptrs.data(), (int)params.ptrs.size());
+		return result;
+	}
+
+	// Calls a member of aThis, checking the parameter count as the script's dispatch would.
+	HostResult Invoke(IObject* aThis, const ObjectMember* aMember, HostArgs aArgs = {}) {
+		HostParams params(aArgs);
+		return Invoke(aThis, aMember, params.ptrs.data(), (int)params.ptrs.size());
+	}
+	HostResult Invoke(IObject* aThis, const ObjectMember* aMember, ExprTokenType* aParam[], int aParamCount) {
+		HostResult result;
+		sHostError.Clear();
+		if (!aMember || aParamCount < aMember->minParams || (aMember->maxParams != MAXP_VARIADIC && aParamCount > aMember->maxParams)) {
+			Object::Error(ExprTokenType((LPTSTR)(aMember ? _T("Invalid number of parameters.") : _T("No such member."))));
+			result.result = FAIL;
+			return result;
+		}
+		(aThis->*aMember->method)(result, aMember->id, aMember->invokeType, aParam, aParamCount);
+		return result;
+	}
+	HostResult Invoke(IObject* aThis, LPCTSTR aName, HostArgs aArgs = {}, int aInvokeType = IT_CALL) {
+		return Invoke(aThis, Member(aName, aInvokeType), aArgs);
+	}
+
+	// Constructs an exported class, then calls its __New, if any.  Returns nullptr on failure.
+	IObject* New(LPCTSTR aClass, HostArgs aArgs = {}) {
+		ExportSymbol* sym = Symbol(aClass);
+		if (!sym || !sym->member_count)
+			return nullptr;
+		HostObject*& cls = mClasses[sym - mLoader.mSymbols];
+		if (!cls) {
+			cls = new HostObject;
+			auto proto = new HostObject;
+			ExprTokenType value(proto);
+			cls->Set(_T("Prototype"), value);
+			proto->Release();
+		}
+		HostParams params(aArgs, cls);
+		HostResult result;
+		sHostError.Clear();
+		sym->call(result, params.ptrs.data(), (int)params.ptrs.size());
+		IObject* obj = result.symbol == SYM_OBJECT && !result.Exited() ? result.object : nullptr;
+		if (!obj)
+			return nullptr;
+		result.symbol = SYM_INTEGER; // Take the reference.
+		std::string ctor = HostNarrow(aClass) + ".Prototype.__New";
+		std::vector<TCHAR> ctor_name = HostWiden(ctor);
+		if (const ObjectMember* member = Member(ctor_name.data())) {
+			HostResult r = Invoke(obj, member, params.ptrs.data() + 1, (int)params.ptrs.size() - 1);
+			if (r.Exited()) {
+				obj->Release();
+				return nullptr;
+			}
+		}
+		return obj;
+	}
+};
+
+#endif // !AHK2_TEST_HOST_H
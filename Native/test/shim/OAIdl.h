@@ -0,0 +1,54 @@
+#ifndef AHK2_SHIM_OAIDL_H
+#define AHK2_SHIM_OAIDL_H
+// The COM declarations ahk2_types.h builds on.  IDispatch is only implemented, never called
+// through, so the automation types it refers to stay incomplete.
+#include "windows.h"
+
+typedef long DISPID;
+typedef wchar_t OLECHAR, * LPOLESTR;
+typedef unsigned short VARTYPE;
+
+struct GUID {
+	uint32_t Data1;
+	uint16_t Data2, Data3;
+	uint8_t Data4[8];
+};
+typedef GUID IID;
+typedef const IID& REFIID;
+inline bool operator==(const GUID& a, const GUID& b) { return !memcmp(&a, &b, sizeof(GUID)); }
+
+inline const IID IID_IUnknown = { 0x00000000, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 };
+inline const IID IID_IDispatch = { 0x00020400, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 };
+
+#define S_OK ((HRESULT)0)
+#define E_NOTIMPL ((HRESULT)0x80004001)
+#define E_NOINTERFACE ((HRESULT)0x80004002)
+#define DISP_E_MEMBERNOTFOUND ((HRESULT)0x80020003)
+#define DISP_E_UNKNOWNNAME ((HRESULT)0x80020006)
+#define DISPID_UNKNOWN (-1)
+
+#define VT_EMPTY 0
+#define VT_NULL 1
+#define VT_BOOL 11
+
+struct ITypeInfo;
+struct DISPPARAMS;
+struct VARIANT;
+struct EXCEPINFO;
+struct SAFEARRAY;
+
+struct IUnknown {
+	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) = 0;
+	virtual ULONG STDMETHODCALLTYPE AddRef() = 0;
+	virtual ULONG STDMETHODCALLTYPE Release() = 0;
+};
+
+struct IDispatch : public IUnknown {
+	virtual HRESULT STDMETHODCALLTYPE GetTypeInfoCount(UINT* pctinfo) = 0;
+	virtual HRESULT STDMETHODCALLTYPE GetTypeInfo(UINT iTInfo, LCID lcid, ITypeInfo** ppTInfo) = 0;
+	virtual HRESULT STDMETHODCALLTYPE GetIDsOfNames(REFIID riid, LPOLESTR* rgszNames, UINT cNames, LCID lcid, DISPID* rgDispId) = 0;
+	virtual HRESULT STDMETHODCALLTYPE Invoke(DISPID dispIdMember, REFIID riid, LCID lcid, WORD wFlags
+		, DISPPARAMS* pDispParams, VARIANT* pVarResult, EXCEPINFO* pExcepInfo, UINT* puArgErr) = 0;
+};
+
+#endif // !AHK2_SHIM_OAIDL_H
@@ -0,0 +1,37 @@
+#ifndef AHK2_SHIM_INTRIN_H
+#define AHK2_SHIM_INTRIN_H
+// MSVC intrinsics in terms of the GCC builtins and <x86intrin.h>.
+#include <x86intrin.h>
+#include <cpuid.h>
+
+#undef __cpuid // <cpuid.h> defines a five-argument macro.
+static inline void __cpuid(int aInfo[4], int aLeaf) { __cpuidex(aInfo, aLeaf, 0); }
+
+static inline unsigned char _BitScanForward(unsigned long* aIndex, unsigned long aMask) {
+	if (!aMask) return 0;
+	*aIndex = (unsigned long)__builtin_ctzl(aMask);
+	return 1;
+}
+static inline unsigned char _BitScanForward64(unsigned long* aIndex, unsigned long long aMask) {
+	if (!aMask) return 0;
+	*aIndex = (unsigned long)__builtin_ctzll(aMask);
+	return 1;
+}
+static inline unsigned char _BitScanReverse(unsigned long* aIndex, unsigned long aMask) {
+	if (!aMask) return 0;
+	*aIndex = (unsigned long)(63 - __builtin_clzl(aMask));
+	return 1;
+}
+static inline unsigned char _BitScanReverse64(unsigned long* aIndex, unsigned long long aMask) {
+	if (!aMask) return 0;
+	*aIndex = (unsigned long)(63 - __builtin_clzll(aMask));
+	return 1;
+}
+
+static inline unsigned long long _umul128(unsigned long long a, unsigned long long b, unsigned long long* aHigh) {
+	unsigned __int128 product = (unsigned __int128)a * b;
+	*aHigh = (unsigned long long)(product >> 64);
+	return (unsigned long long)product;
+}
+
+#endif // !AHK2_SHIM_INTRIN_H
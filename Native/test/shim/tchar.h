@@ -0,0 +1,139 @@
+#ifndef AHK2_SHIM_TCHAR_H
+#define AHK2_SHIM_TCHAR_H
+// UTF-16 TCHAR routines for the Linux build.  -fshort-wchar makes wchar_t match the Windows
+// TCHAR, but glibc's wide-character functions still assume a 4-byte wchar_t, so every routine
+// the modules use is implemented here and the glibc ones are hidden behind macros.  The
+// standard headers which refer to them are included first.
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <cwctype>
+#include <string>
+
+typedef wchar_t TCHAR, * LPTSTR;
+typedef const wchar_t* LPCTSTR;
+typedef unsigned short _TUCHAR;
+#define __T(x) L##x
+#define _T(x) __T(x)
+
+static inline wchar_t ShimLower(wchar_t c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; }
+static inline wchar_t ShimUpper(wchar_t c) { return c >= 'a' && c <= 'z' ? c - 32 : c; }
+
+static inline size_t ShimLen(const wchar_t* s) {
+	const wchar_t* p = s;
+	while (*p) ++p;
+	return p - s;
+}
+static inline int ShimCmp(const wchar_t* a, const wchar_t* b) {
+	for (; *a && *a == *b; ++a, ++b);
+	return (int)(_TUCHAR)*a - (int)(_TUCHAR)*b;
+}
+static inline int ShimNCmp(const wchar_t* a, const wchar_t* b, size_t n) {
+	for (; n; --n, ++a, ++b)
+		if (*a != *b || !*a)
+			return (int)(_TUCHAR)*a - (int)(_TUCHAR)*b;
+	return 0;
+}
+static inline int ShimICmp(const wchar_t* a, const wchar_t* b) {
+	for (; *a && ShimLower(*a) == ShimLower(*b); ++a, ++b);
+	return (int)(_TUCHAR)ShimLower(*a) - (int)(_TUCHAR)ShimLower(*b);
+}
+static inline int ShimNICmp(const wchar_t* a, const wchar_t* b, size_t n) {
+	for (; n; --n, ++a, ++b)
+		if (ShimLower(*a) != ShimLower(*b) || !*a)
+			return (int)(_TUCHAR)ShimLower(*a) - (int)(_TUCHAR)ShimLower(*b);
+	return 0;
+}
+static inline wchar_t* ShimChr(const wchar_t* s, wchar_t c) {
+	for (; *s; ++s)
+		if (*s == c)
+			return (wchar_t*)s;
+	return c ? nullptr : (wchar_t*)s;
+}
+static inline wchar_t* ShimDup(const wchar_t* s) {
+	size_t size = (ShimLen(s) + 1) * sizeof(wchar_t);
+	auto d = (wchar_t*)malloc(size);
+	return d ? (wchar_t*)memcpy(d, s, size) : nullptr;
+}
+static inline wchar_t* ShimMemCpy(wchar_t* d, const wchar_t* s, size_t n) { return (wchar_t*)memcpy(d, s, n * sizeof(wchar_t)); }
+static inline wchar_t* ShimMemMove(wchar_t* d, const wchar_t* s, size_t n) { return (wchar_t*)memmove(d, s, n * sizeof(wchar_t)); }
+static inline wchar_t* ShimMemSet(wchar_t* d, wchar_t c, size_t n) {
+	for (size_t i = 0; i < n; ++i) d[i] = c;
+	return d;
+}
+
+// Numbers are converted through the narrow CRT routines; numeric text is always ASCII.
+static inline size_t ShimNarrowNumber(const wchar_t* s, char (&aBuf)[512]) {
+	size_t i = 0;
+	for (; i + 1 < sizeof(aBuf) && s[i] && s[i] < 0x80; ++i)
+		aBuf[i] = (char)s[i];
+	aBuf[i] = 0;
+	return i;
+}
+static inline double ShimToDouble(const wchar_t* s, wchar_t** aEnd) {
+	char buf[512], * end;
+	ShimNarrowNumber(s, buf);
+	double d = strtod(buf, &end);
+	if (aEnd) *aEnd = (wchar_t*)s + (end - buf);
+	return d;
+}
+static inline long long ShimToInt64(const wchar_t* s, wchar_t** aEnd, int aBase) {
+	char buf[512], * end;
+	ShimNarrowNumber(s, buf);
+	long long n = strtoll(buf, &end, aBase);
+	if (aEnd) *aEnd = (wchar_t*)s + (end - buf);
+	return n;
+}
+static inline int ShimPrintf(wchar_t* aBuf, size_t aSize, const wchar_t* aFormat, ...) {
+	char format[512], out[512];
+	ShimNarrowNumber(aFormat, format); // The modules' formats are ASCII and have no %s.
+	va_list ap;
+	va_start(ap, aFormat);
+	int n = vsnprintf(out, sizeof(out), format, ap);
+	va_end(ap);
+	if (n < 0 || (size_t)n >= aSize) {
+		if (aSize) *aBuf = 0;
+		return -1;
+	}
+	for (int i = 0; i <= n; ++i)
+		aBuf[i] = (unsigned char)out[i];
+	return n;
+}
+static inline wchar_t* ShimI64ToT(long long aValue, wchar_t* aBuf, int aRadix) {
+	char out[72];
+	if (aRadix == 16)
+		snprintf(out, sizeof(out), aValue < 0 ? "-%llx" : "%llx", aValue < 0 ? 0ULL - (unsigned long long)aValue : (unsigned long long)aValue);
+	else
+		snprintf(out, sizeof(out), "%lld", aValue);
+	for (size_t i = 0; ; ++i)
+		if (!(aBuf[i] = (unsigned char)out[i]))
+			break;
+	return aBuf;
+}
+
+#define _tcslen ShimLen
+#define _tcsclen ShimLen
+#define _tcscmp ShimCmp
+#define _tcsncmp ShimNCmp
+#define _tcsicmp ShimICmp
+#define _tcsnicmp ShimNICmp
+#define _tcschr ShimChr
+#define _tcsdup ShimDup
+#define _tcstod ShimToDouble
+#define _tcstoi64 ShimToInt64
+#define _totlower ShimLower
+#define _totupper ShimUpper
+#define _stprintf_s ShimPrintf
+#define _itot(v, b, r) ShimI64ToT((int)(v), b, r)
+#define _i64tot(v, b, r) ShimI64ToT(v, b, r)
+#define _i64tot_s(v, b, n, r) (ShimI64ToT(v, b, r), 0)
+#define wcslen ShimLen
+#define wcsdup ShimDup
+#define wmemcpy ShimMemCpy
+#define wmemmove ShimMemMove
+#define wmemset ShimMemSet
+#define towlower ShimLower
+
+#endif // !AHK2_SHIM_TCHAR_H
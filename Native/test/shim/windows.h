@@ -0,0 +1,358 @@
+#ifndef AHK2_SHIM_WINDOWS_H
+#define AHK2_SHIM_WINDOWS_H
+// The subset of the Win32 API used by ahk2_types.h and the Native modules, implemented on POSIX
+// so the modules build and run on Linux for tests and benchmarks.  Strings are UTF-16, which
+// requires -fshort-wchar; see tchar.h.
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <dlfcn.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static_assert(sizeof(wchar_t) == 2, "The shim requires -fshort-wchar.");
+
+#define __int64 long long
+#define __declspec(x) __attribute__((visibility("default")))
+#define __cdecl
+#define CALLBACK
+#define WINAPI
+#define CDECL
+#define DECLSPEC_NOVTABLE
+#define STDMETHODCALLTYPE
+#define STDMETHODIMP virtual HRESULT
+#define VOID void
+#define FALSE 0
+#define TRUE 1
+#define _countof(a) (sizeof(a) / sizeof((a)[0]))
+#define _I64_MAX LLONG_MAX
+#define _I64_MIN LLONG_MIN
+#define _UI64_MAX ULLONG_MAX
+
+typedef int BOOL;
+typedef uint8_t BYTE, UCHAR;
+typedef uint16_t WORD, USHORT, UINT16;
+typedef int32_t LONG, HRESULT;
+typedef uint32_t ULONG, UINT, UINT32, DWORD, LCID;
+// __int64, as on Windows, so that pointers to them match the intrinsics' parameters.
+typedef long long LONG64, LONGLONG;
+typedef unsigned long long ULONG64, DWORD64, ULONGLONG, UINT64;
+typedef intptr_t INT_PTR, LONG_PTR, LRESULT, LPARAM;
+typedef uintptr_t UINT_PTR, ULONG_PTR, SIZE_T, WPARAM;
+typedef wchar_t WCHAR, * LPWSTR;
+typedef const wchar_t* LPCWSTR;
+typedef char* LPSTR;
+typedef const char* LPCSTR;
+typedef void* HANDLE, * HWND, * HMODULE, * HINSTANCE, * HICON, * HCURSOR, * HBRUSH, * LPVOID, * PVOID;
+typedef int (*FARPROC)();
+typedef union { struct { DWORD LowPart; LONG HighPart; }; LONGLONG QuadPart; } LARGE_INTEGER;
+
+#define INFINITE 0xFFFFFFFF
+#define PAGE_READONLY 2
+#define PAGE_READWRITE 4
+#define ERROR_FILE_NOT_FOUND 2
+#define ERROR_ACCESS_DENIED 5
+#define ERROR_NOT_ENOUGH_MEMORY 8
+#define ERROR_GEN_FAILURE 31
+#define ERROR_CANCELLED 1223
+#define ERROR_CLASS_ALREADY_EXISTS 1410
+
+//
+// Errors and process information.
+//
+
+inline thread_local DWORD tShimLastError;
+static inline DWORD GetLastError() { return tShimLastError; }
+static inline void SetLastError(DWORD aError) { tShimLastError = aError; }
+static inline DWORD ShimErrno() {
+	return tShimLastError = errno == ENOENT ? ERROR_FILE_NOT_FOUND : errno == ENOMEM ? ERROR_NOT_ENOUGH_MEMORY : ERROR_ACCESS_DENIED;
+}
+
+struct SYSTEM_INFO { DWORD dwNumberOfProcessors; };
+// AHK2_SHIM_NPROC overrides the processor count, so thread scaling can be measured on any machine.
+static inline void GetSystemInfo(SYSTEM_INFO* aInfo) {
+	const char* env = getenv("AHK2_SHIM_NPROC");
+	long n = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+	aInfo->dwNumberOfProcessors = n > 0 ? (DWORD)n : 1;
+}
+static inline DWORD GetCurrentProcessId() { return (DWORD)getpid(); }
+static inline DWORD GetCurrentThreadId() { return (DWORD)gettid(); }
+
+static inline BOOL QueryPerformanceCounter(LARGE_INTEGER* aCount) {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	aCount->QuadPart = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	return TRUE;
+}
+static inline BOOL QueryPerformanceFrequency(LARGE_INTEGER* aFreq) { aFreq->QuadPart = 1000000000LL; return TRUE; }
+
+static inline int MessageBox(HWND, LPCWSTR, LPCWSTR, UINT) { return 0; }
+
+static inline int lstrcmpi(LPCWSTR a, LPCWSTR b) {
+	auto lower = [](unsigned c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; };
+	for (; *a && lower(*a) == lower(*b); ++a, ++b);
+	return (int)lower(*a) - (int)lower(*b);
+}
+
+// C runtime extensions, which MSVC declares in <stdlib.h> and <string.h>.
+#define _strnicmp strncasecmp
+static inline unsigned long long _rotl64(unsigned long long x, int n) { return x << (n & 63) | x >> (-n & 63); }
+static inline unsigned int _byteswap_ulong(unsigned int x) { return __builtin_bswap32(x); }
+static inline unsigned long long _byteswap_uint64(unsigned long long x) { return __builtin_bswap64(x); }
+
+//
+// Memory and synchronization.
+//
+
+// The sizes of mappings, which Windows tracks itself but munmap needs.
+struct ShimViews {
+	std::mutex lock;
+	std::map<const void*, size_t> sizes;
+};
+inline ShimViews sShimViews;
+
+#define MEM_COMMIT 0x1000
+#define MEM_RESERVE 0x2000
+#define MEM_RELEASE 0x8000
+#define SHIM_ALLOCATION_GRANULARITY 0x10000
+
+// Regions are aligned to the allocation granularity, as on Windows.
+static inline LPVOID VirtualAlloc(LPVOID, SIZE_T aSize, DWORD, DWORD) {
+	size_t size = (aSize + SHIM_ALLOCATION_GRANULARITY - 1) & ~(size_t)(SHIM_ALLOCATION_GRANULARITY - 1);
+	char* base = (char*)mmap(nullptr, size + SHIM_ALLOCATION_GRANULARITY, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == (char*)MAP_FAILED)
+		return nullptr;
+	char* region = (char*)(((UINT_PTR)base + SHIM_ALLOCATION_GRANULARITY - 1) & ~(UINT_PTR)(SHIM_ALLOCATION_GRANULARITY - 1));
+	if (region > base)
+		munmap(base, region - base);
+	munmap(region + size, base + SHIM_ALLOCATION_GRANULARITY - region);
+	std::lock_guard<std::mutex> guard(sShimViews.lock);
+	sShimViews.sizes[region] = size;
+	return region;
+}
+static inline BOOL VirtualFree(LPVOID aRegion, SIZE_T, DWORD) {
+	std::lock_guard<std::mutex> guard(sShimViews.lock);
+	auto it = sShimViews.sizes.find(aRegion);
+	if (it == sShimViews.sizes.end())
+		return FALSE;
+	munmap(aRegion, it->second);
+	sShimViews.sizes.erase(it);
+	return TRUE;
+}
+static inline BOOL VirtualProtect(void*, SIZE_T, DWORD aNew, DWORD* aOld) { *aOld = aNew; return TRUE; }
+static inline void* _aligned_malloc(size_t aSize, size_t aAlign) { return aligned_alloc(aAlign, (aSize + aAlign - 1) / aAlign * aAlign); }
+static inline void _aligned_free(void* aPtr) { free(aPtr); }
+
+typedef struct { volatile long v; } SRWLOCK, * PSRWLOCK;
+#define SRWLOCK_INIT { 0 }
+static inline void AcquireSRWLockExclusive(PSRWLOCK aLock) {
+	while (__atomic_exchange_n(&aLock->v, 1, __ATOMIC_ACQUIRE))
+		while (__atomic_load_n(&aLock->v, __ATOMIC_RELAXED))
+			sched_yield();
+}
+static inline void ReleaseSRWLockExclusive(PSRWLOCK aLock) { __atomic_store_n(&aLock->v, 0, __ATOMIC_RELEASE); }
+
+template<class T> static inline T InterlockedIncrement(volatile T* aPtr) { return __atomic_add_fetch(aPtr, 1, __ATOMIC_SEQ_CST); }
+template<class T> static inline T InterlockedDecrement(volatile T* aPtr) { return __atomic_sub_fetch(aPtr, 1, __ATOMIC_SEQ_CST); }
+template<class T> static inline T InterlockedCompareExchange(volatile T* aPtr, std::type_identity_t<T> aValue, std::type_identity_t<T> aComparand) {
+	__atomic_compare_exchange_n(aPtr, &aComparand, aValue, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return aComparand;
+}
+
+//
+// Thread pool work objects.  Each submission runs on a thread of its own, which matches the
+// concurrency the modules ask for (one submission per worker).
+//
+
+typedef void* PTP_CALLBACK_INSTANCE, * PTP_CALLBACK_ENVIRON;
+typedef struct TP_WORK* PTP_WORK;
+typedef void (CALLBACK* PTP_WORK_CALLBACK)(PTP_CALLBACK_INSTANCE, PVOID, PTP_WORK);
+struct TP_WORK {
+	PTP_WORK_CALLBACK callback;
+	PVOID context;
+	std::mutex lock;
+	std::vector<std::thread> threads;
+};
+static inline PTP_WORK CreateThreadpoolWork(PTP_WORK_CALLBACK aCallback, PVOID aContext, PTP_CALLBACK_ENVIRON) {
+	auto work = new TP_WORK;
+	work->callback = aCallback, work->context = aContext;
+	return work;
+}
+static inline void SubmitThreadpoolWork(PTP_WORK aWork) {
+	std::lock_guard<std::mutex> guard(aWork->lock);
+	aWork->threads.emplace_back([aWork] { aWork->callback(nullptr, aWork->context, aWork); });
+}
+static inline void WaitForThreadpoolWorkCallbacks(PTP_WORK aWork, BOOL) {
+	std::vector<std::thread> threads;
+	{
+		std::lock_guard<std::mutex> guard(aWork->lock);
+		threads.swap(aWork->threads);
+	}
+	for (auto& thread : threads)
+		thread.join();
+}
+static inline void CloseThreadpoolWork(PTP_WORK aWork) { WaitForThreadpoolWorkCallbacks(aWork, FALSE); delete aWork; }
+
+//
+// Files.  A HANDLE holds the descriptor plus one, so that 0 stays an invalid handle.
+//
+
+#define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
+#define GENERIC_READ 0x80000000
+#define GENERIC_WRITE 0x40000000
+#define FILE_SHARE_READ 1
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000
+#define FILE_MAP_READ 4
+
+static inline int ShimFd(HANDLE aHandle) { return (int)(INT_PTR)aHandle - 1; }
+static inline HANDLE CreateFile(LPCWSTR aPath, DWORD aAccess, DWORD, void*, DWORD, DWORD, HANDLE) {
+	std::vector<char> path;
+	for (; *aPath; ++aPath)
+		path.push_back((char)*aPath); // Paths used by the tests are ASCII.
+	path.push_back(0);
+	int fd = aAccess & GENERIC_WRITE ? open(path.data(), O_WRONLY | O_CREAT | O_TRUNC, 0644) : open(path.data(), O_RDONLY);
+	return fd < 0 ? (ShimErrno(), INVALID_HANDLE_VALUE) : (HANDLE)(INT_PTR)(fd + 1);
+}
+static inline BOOL GetFileSizeEx(HANDLE aFile, LARGE_INTEGER* aSize) {
+	struct stat st;
+	if (fstat(ShimFd(aFile), &st))
+		return ShimErrno(), FALSE;
+	aSize->QuadPart = st.st_size;
+	return TRUE;
+}
+static inline BOOL WriteFile(HANDLE aFile, const void* aData, DWORD aSize, DWORD* aWritten, void*) {
+	ssize_t n = write(ShimFd(aFile), aData, aSize);
+	if (n < 0)
+		return ShimErrno(), FALSE;
+	*aWritten = (DWORD)n;
+	return TRUE;
+}
+static inline HANDLE CreateFileMapping(HANDLE aFile, void*, DWORD, DWORD, DWORD, LPCWSTR) {
+	int fd = dup(ShimFd(aFile));
+	return fd < 0 ? (ShimErrno(), nullptr) : (HANDLE)(INT_PTR)(fd + 1);
+}
+static inline LPVOID MapViewOfFile(HANDLE aMapping, DWORD, DWORD aOffsetHigh, DWORD aOffsetLow, SIZE_T aSize) {
+	void* view = mmap(nullptr, aSize, PROT_READ, MAP_PRIVATE, ShimFd(aMapping), (off_t)aOffsetHigh << 32 | aOffsetLow);
+	if (view == MAP_FAILED)
+		return ShimErrno(), nullptr;
+	std::lock_guard<std::mutex> guard(sShimViews.lock);
+	sShimViews.sizes[view] = aSize; // Windows tracks the view size itself; munmap needs it.
+	return view;
+}
+static inline BOOL UnmapViewOfFile(const void* aView) {
+	std::lock_guard<std::mutex> guard(sShimViews.lock);
+	auto it = sShimViews.sizes.find(aView);
+	if (it == sShimViews.sizes.end())
+		return FALSE;
+	munmap((void*)aView, it->second);
+	sShimViews.sizes.erase(it);
+	return TRUE;
+}
+static inline BOOL CloseHandle(HANDLE aHandle) { return close(ShimFd(aHandle)) == 0; }
+
+//
+// Modules.  The Windows DLL names used by the modules are mapped onto the system libraries.
+//
+
+#define GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT 2
+#define GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS 4
+
+static inline HMODULE GetModuleHandle(LPCWSTR aName) {
+	static const struct { const char* dll, * so; } sLibraries[] = {
+		{ "sqlite3.dll", "libsqlite3.so.0" },
+		{ "libzstd.dll", "libzstd.so.1" },
+		{ "zlib1.dll", "libz.so.1" },
+	};
+	char name[64];
+	size_t i = 0;
+	for (; aName[i] && i + 1 < sizeof(name); ++i)
+		name[i] = (char)(aName[i] >= 'A' && aName[i] <= 'Z' ? aName[i] + 32 : aName[i]);
+	name[i] = 0;
+	for (auto& lib : sLibraries)
+		if (!strcmp(name, lib.dll))
+			return dlopen(lib.so, RTLD_NOW);
+	return nullptr;
+}
+static inline BOOL GetModuleHandleEx(DWORD, LPCWSTR, HMODULE* aModule) { *aModule = dlopen(nullptr, RTLD_NOW); return TRUE; }
+static inline FARPROC GetProcAddress(HMODULE aModule, LPCSTR aName) { return (FARPROC)dlsym(aModule, aName); }
+
+//
+// Message-only windows.  Posted messages queue up until the test pumps them with PeekMessage
+// and DispatchMessage, as the script thread's message loop would.
+//
+
+#define WM_APP 0x8000
+#define PM_REMOVE 1
+#define GWLP_WNDPROC (-4)
+#define HWND_MESSAGE ((HWND)(INT_PTR)-3)
+
+typedef LRESULT (CALLBACK* WNDPROC)(HWND, UINT, WPARAM, LPARAM);
+struct WNDCLASSEX {
+	UINT cbSize, style;
+	WNDPROC lpfnWndProc;
+	int cbClsExtra, cbWndExtra;
+	HINSTANCE hInstance;
+	HICON hIcon;
+	HCURSOR hCursor;
+	HBRUSH hbrBackground;
+	LPCWSTR lpszMenuName, lpszClassName;
+	HICON hIconSm;
+};
+struct MSG { HWND hwnd; UINT message; WPARAM wParam; LPARAM lParam; };
+
+struct ShimWindow { WNDPROC proc; };
+struct ShimMessageQueue {
+	std::mutex lock;
+	std::deque<MSG> messages;
+	WNDPROC proc; // Of the last registered class; the modules register one each.
+};
+inline ShimMessageQueue sShimMessages;
+
+static inline unsigned short RegisterClassEx(const WNDCLASSEX* aClass) { sShimMessages.proc = aClass->lpfnWndProc; return 1; }
+static inline HWND CreateWindowEx(DWORD, LPCWSTR, LPCWSTR, DWORD, int, int, int, int, HWND, void*, HINSTANCE, void*) {
+	return new ShimWindow{ sShimMessages.proc };
+}
+static inline LONG_PTR SetWindowLongPtr(HWND aWnd, int aIndex, LONG_PTR aValue) {
+	auto wnd = (ShimWindow*)aWnd;
+	LONG_PTR prev = (LONG_PTR)wnd->proc;
+	if (aIndex == GWLP_WNDPROC)
+		wnd->proc = (WNDPROC)aValue;
+	return prev;
+}
+static inline LRESULT DefWindowProc(HWND, UINT, WPARAM, LPARAM) { return 0; }
+static inline BOOL PostMessage(HWND aWnd, UINT aMsg, WPARAM wParam, LPARAM lParam) {
+	std::lock_guard<std::mutex> guard(sShimMessages.lock);
+	sShimMessages.messages.push_back({ aWnd, aMsg, wParam, lParam });
+	return TRUE;
+}
+static inline BOOL PeekMessage(MSG* aMsg, HWND, UINT, UINT, UINT aRemove) {
+	std::lock_guard<std::mutex> guard(sShimMessages.lock);
+	if (sShimMessages.messages.empty())
+		return FALSE;
+	*aMsg = sShimMessages.messages.front();
+	if (aRemove & PM_REMOVE)
+		sShimMessages.messages.pop_front();
+	return TRUE;
+}
+static inline LRESULT DispatchMessage(const MSG* aMsg) {
+	return ((ShimWindow*)aMsg->hwnd)->proc(aMsg->hwnd, aMsg->message, aMsg->wParam, aMsg->lParam);
+}
+
+#endif // !AHK2_SHIM_WINDOWS_H
@@ -0,0 +1,442 @@
+// Stress tests of async.h: tens of thousands of jobs through WorkPools of 1-8 workers, submitted
+// from the script thread, from other threads at once and from running jobs (which go to the
+// worker's own queue, for others to steal); cancellation racing the workers; the concurrency
+// limit; a pool destroyed with jobs still queued; CompletionQueue with many producers; and
+// AsyncTasks of hash_file_async, settled in batches as the script's message loop runs.
+#include "../hash.cpp"
+#include "host.h"
+#include "check.h"
+#include <unistd.h>
+
+// Counts jobs down to zero, for the test to wait on.
+struct Batch
+{
+	std::atomic<size_t> left;
+	std::mutex lock;
+	std::condition_variable done;
+
+	Batch(size_t aCount) : left(aCount) {}
+	void Finished() {
+		if (left.fetch_sub(1) == 1) {
+			std::lock_guard<std::mutex> guard(lock);
+			done.notify_all();
+		}
+	}
+	bool Wait(int aSeconds = 60) {
+		std::unique_lock<std::mutex> guard(lock);
+		return done.wait_for(guard, std::chrono::seconds(aSeconds), [this] { return !left.load(); });
+	}
+};
+
+static std::atomic<size_t> sDeleted;
+
+// Records that it ran, and how many jobs ran alongside it.
+struct CountJob : AsyncJob
+{
+	std::atomic<int>* runs;
+	Batch* batch;
+	static inline std::atomic<int> sRunning, sMaxRunning;
+	int spin = 0;
+
+	CountJob(std::atomic<int>* aRuns, Batch* aBatch) : runs(aRuns), batch(aBatch) {}
+	~CountJob() { sDeleted.fetch_add(1); }
+	void Run() {
+		int running = sRunning.fetch_add(1) + 1, max = sMaxRunning.load();
+		while (running > max && !sMaxRunning.compare_exchange_weak(max, running));
+		for (std::atomic<long> i{ 0 }; i < spin; ++i);
+		runs->fetch_add(1);
+		sRunning.fetch_sub(1);
+	}
+	void Finish() {
+		if (batch)
+			batch->Finished();
+	}
+};
+
+// Submits aCount jobs to aPool and checks that each runs exactly once.
+static void RunJobs(WorkPool& aPool, size_t aCount, int aSpin = 0) {
+	std::vector<std::atomic<int>> runs(aCount);
+	Batch batch(aCount);
+	for (size_t i = 0; i < aCount; ++i) {
+		auto job = new CountJob(&runs[i], &batch);
+		job->spin = aSpin;
+		CHECK(aPool.Submit(job));
+		job->Release();
+	}
+	CHECK(batch.Wait());
+	size_t once = 0;
+	for (auto& r : runs)
+		once += r.load() == 1;
+	CHECK_EQ(once, aCount);
+}
+
+static void TestManyJobs() {
+	for (int limit : { 1, 2, 4, 8 }) {
+		WorkPool pool(limit);
+		CHECK_EQ(pool.Limit(), limit);
+		RunJobs(pool, 50000);
+		CHECK(pool.Workers() <= limit);
+	}
+}
+
+// A binary tree of jobs, each submitting its two children from its worker thread.
+struct TreeJob : AsyncJob
+{
+	WorkPool* pool;
+	int depth;
+	std::atomic<size_t>* ran;
+	Batch* batch;
+
+	TreeJob(WorkPool* aPool, int aDepth, std::atomic<size_t>* aRan, Batch* aBatch) : pool(aPool), depth(aDepth), ran(aRan), batch(aBatch) {}
+	void Run() {
+		ran->fetch_add(1);
+		for (int i = 0; depth && i < 2; ++i) {
+			auto child = new TreeJob(pool, depth - 1, ran, batch);
+			CHECK(pool->Submit(child));
+			child->Release();
+		}
+	}
+	void Finish() { batch->Finished(); }
+};
+
+static void TestFanOut() {
+	for (int limit : { 1, 4, 8 }) {
+		WorkPool pool(limit);
+		const int depth = 14;
+		std::atomic<size_t> ran{ 0 };
+		Batch batch(((size_t)2 << depth) - 1);
+		auto root = new TreeJob(&pool, depth, &ran, &batch);
+		CHECK(pool.Submit(root));
+		root->Release();
+		CHECK(batch.Wait());
+		CHECK_EQ(ran.load(), ((size_t)2 << depth) - 1);
+	}
+}
+
+// Several threads submitting to one pool at once.
+static void TestProducers() {
+	WorkPool pool(4);
+	const size_t per_thread = 20000, threads = 4;
+	std::vector<std::atomic<int>> runs(per_thread * threads);
+	Batch batch(per_thread * threads);
+	std::vector<std::thread> producers;
+	for (size_t t = 0; t < threads; ++t)
+		producers.emplace_back([&, t] {
+			for (size_t i = 0; i < per_thread; ++i) {
+				auto job = new CountJob(&runs[t * per_thread + i], &batch);
+				CHECK(pool.Submit(job));
+				job->Release();
+			}
+		});
+	for (auto& p : producers)
+		p.join();
+	CHECK(batch.Wait());
+	size_t once = 0;
+	for (auto& r : runs)
+		once += r.load() == 1;
+	CHECK_EQ(once, per_thread * threads);
+}
+
+// Blocks a worker until released.
+struct GateJob : AsyncJob
+{
+	std::atomic<bool>* open;
+	std::atomic<int>* started;
+	GateJob(std::atomic<bool>* aOpen, std::atomic<int>* aStarted) : open(aOpen), started(aStarted) {}
+	~GateJob() { sDeleted.fetch_add(1); }
+	void Run() {
+		started->fetch_add(1);
+		while (!open->load())
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+};
+
+static void WaitFor(std::atomic<int>& aValue, int aTarget) {
+	for (int i = 0; aValue.load() < aTarget && i < 10000; ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	CHECK(aValue.load() >= aTarget);
+}
+
+static void WaitDeleted(size_t aTarget) {
+	for (int i = 0; sDeleted.load() < aTarget && i < 10000; ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	CHECK_EQ(sDeleted.load(), aTarget);
+}
+
+static void TestCancel() {
+	// Queued behind busy workers, so every cancellation wins.
+	{
+		WorkPool pool(2);
+		std::atomic<bool> open{ false };
+		std::atomic<int> started{ 0 };
+		sDeleted = 0;
+		for (int i = 0; i < 2; ++i) {
+			auto gate = new GateJob(&open, &started);
+			pool.Submit(gate);
+			gate->Release();
+		}
+		WaitFor(started, 2);
+		const size_t count = 2000;
+		std::vector<std::atomic<int>> runs(count);
+		std::vector<AsyncJob*> jobs;
+		for (size_t i = 0; i < count; ++i) {
+			jobs.push_back(new CountJob(&runs[i], nullptr));
+			CHECK(pool.Submit(jobs.back()));
+		}
+		for (size_t i = 0; i < count; i += 2)
+			CHECK(jobs[i]->Cancel());
+		open = true;
+		for (auto job : jobs)
+			job->Release();
+		WaitDeleted(count + 2);
+		for (size_t i = 0; i < count; ++i)
+			CHECK_EQ(runs[i].load(), i % 2 ? 1 : 0);
+	}
+	// Racing the workers: a job either ran or was cancelled before it started, never both.
+	{
+		WorkPool pool(4);
+		const size_t count = 20000;
+		std::vector<std::atomic<int>> runs(count);
+		std::vector<AsyncJob*> jobs;
+		std::vector<bool> cancelled(count);
+		sDeleted = 0;
+		for (size_t i = 0; i < count; ++i) {
+			jobs.push_back(new CountJob(&runs[i], nullptr));
+			static_cast<CountJob*>(jobs.back())->spin = 200;
+			CHECK(pool.Submit(jobs.back()));
+		}
+		for (size_t i = count; i-- > 0; )
+			cancelled[i] = jobs[i]->Cancel();
+		for (auto job : jobs)
+			job->Release();
+		WaitDeleted(count);
+		size_t wrong = 0;
+		for (size_t i = 0; i < count; ++i)
+			wrong += runs[i].load() != (cancelled[i] ? 0 : 1);
+		CHECK_EQ(wrong, 0u);
+	}
+}
+
+static void TestLimit() {
+	WorkPool pool(8);
+	for (int limit : { 2, 1, 4 }) {
+		pool.SetLimit(limit);
+		CountJob::sMaxRunning = 0;
+		RunJobs(pool, 5000, 2000);
+		CHECK(CountJob::sMaxRunning.load() <= limit);
+	}
+	CHECK(pool.Workers() <= 4);	// Workers are started only up to the limit.
+	pool.SetLimit(0);
+	CHECK_EQ(pool.Limit(), 1);
+	pool.SetLimit(1000);
+	CHECK_EQ(pool.Limit(), ASYNC_MAX_WORKERS);
+}
+
+// Jobs still queued when the pool is destroyed are released without running.
+static void TestDestroy() {
+	const size_t count = 500;
+	std::vector<std::atomic<int>> runs(count);
+	std::atomic<bool> open{ false };
+	std::atomic<int> started{ 0 };
+	sDeleted = 0;
+	{
+		WorkPool pool(1);
+		auto gate = new GateJob(&open, &started);
+		pool.Submit(gate);
+		gate->Release();
+		WaitFor(started, 1);
+		for (size_t i = 0; i < count; ++i) {
+			auto job = new CountJob(&runs[i], nullptr);
+			pool.Submit(job);
+			job->Release();
+		}
+		std::thread opener([&] {
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			open = true;
+		});
+		opener.detach();
+	}
+	CHECK_EQ(sDeleted.load(), count + 1);
+	size_t ran = 0;
+	for (auto& r : runs)
+		ran += r.load();
+	CHECK(ran < count);
+}
+
+struct Item
+{
+	Item* next;
+	size_t producer, seq;
+};
+
+// Every item arrives once, each producer's in order, and the consumer is woken once per batch.
+static void TestCompletionQueue() {
+	CompletionQueue<Item> queue;
+	const size_t producers = 4, per_producer = 100000;
+	std::vector<Item> items(producers * per_producer);
+	std::atomic<size_t> wakes{ 0 };
+	std::vector<std::thread> threads;
+	for (size_t p = 0; p < producers; ++p)
+		threads.emplace_back([&, p] {
+			for (size_t i = 0; i < per_producer; ++i) {
+				Item& item = items[p * per_producer + i];
+				item.producer = p, item.seq = i;
+				if (queue.Push(&item))
+					wakes.fetch_add(1);
+			}
+		});
+	std::vector<size_t> next(producers);
+	size_t received = 0, batches = 0, out_of_order = 0;
+	for (int idle = 0; received < items.size() && idle < 100000; ) {
+		Item* item = queue.Drain();
+		if (!item) {
+			++idle;
+			std::this_thread::yield();
+			continue;
+		}
+		for (++batches; item; item = item->next, ++received)
+			out_of_order += item->seq != next[item->producer]++;
+	}
+	for (auto& t : threads)
+		t.join();
+	CHECK_EQ(received, items.size());
+	CHECK_EQ(out_of_order, 0u);
+	CHECK_EQ(wakes.load(), batches);
+	CHECK(!queue.Drain());
+}
+
+// A script callback: counts its calls and keeps the task it was passed.
+class Callback : public ObjectBase
+{
+public:
+	int calls = 0;
+	IObject* task = nullptr;
+	LPTSTR Type() { return _T("Func"); }
+	ResultType Invoke(IObject_Invoke_PARAMS_DECL) {
+		if (!IS_INVOKE_CALL || aName)
+			return INVOKE_NOT_HANDLED;
+		++calls;
+		task = aParamCount ? aParam[0]->object : nullptr;
+		return OK;
+	}
+};
+
+static HostResult TaskMember(IObject* aTask, LPCTSTR aName, int aFlags = IT_GET, HostArgs aArgs = {}) {
+	HostResult r;
+	HostParams params(aArgs);
+	sHostError.Clear();
+	aTask->Invoke(r, aFlags, (LPTSTR)aName, ExprTokenType(aTask), params.ptrs.data(), (int)params.ptrs.size());
+	return r;
+}
+
+// Pumps the script thread's messages until aDone() or 30 s; returns the messages dispatched.
+template<class F>
+static int PumpUntil(F aDone) {
+	int messages = 0;
+	for (int i = 0; !aDone() && i < 3000; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		messages += HostPumpMessages();
+	}
+	CHECK(aDone());
+	return messages;
+}
+
+static void TestTasks(HostModule& aModule) {
+	char path[] = "/tmp/test_async_XXXXXX";
+	int fd = mkstemp(path);
+	std::vector<BYTE> data(256 << 10);
+	for (size_t i = 0; i < data.size(); ++i)
+		data[i] = (BYTE)(i % 251);
+	CHECK(fd >= 0 && write(fd, data.data(), data.size()) == (ssize_t)data.size());
+	close(fd);
+	auto wpath = HostWiden(path);
+	std::string expected = aModule.Call(_T("hash_file"), { HostValue(wpath), _T("xxh3") }).Str();
+	CHECK(!expected.empty());
+
+	// Every task settles once, with callbacks run from the message loop in batches.
+	const int count = 300;
+	std::vector<Callback> callbacks(count);
+	std::vector<IObject*> tasks;
+	for (int i = 0; i < count; ++i) {
+		HostResult r = aModule.Call(_T("hash_file_async"), { HostValue(wpath), _T("xxh3") });
+		CHECK(r.Obj() && !_tcscmp(r.Obj()->Type(), _T("AsyncTask")));
+		if (!r.Obj())
+			return;
+		tasks.push_back(r.Obj());
+		r.Obj()->AddRef();
+		TaskMember(r.Obj(), _T("OnCompleted"), IT_CALL, { (IObject*)&callbacks[i] });
+	}
+	int messages = PumpUntil([&] {
+		for (auto& c : callbacks)
+			if (!c.calls)
+				return false;
+		return true;
+	});
+	CHECK(messages < count);
+	for (int i = 0; i < count; ++i) {
+		CHECK_EQ(callbacks[i].calls, 1);
+		CHECK(callbacks[i].task == tasks[i]);
+		CHECK_EQ(TaskMember(tasks[i], _T("Status")).Str(), "fulfilled");
+		CHECK_EQ(TaskMember(tasks[i], _T("Result")).Str(), expected);
+		tasks[i]->Release();
+	}
+
+	// Queued behind one worker, the last half are cancelled before they start.
+	HostResult old_limit = aModule.Call(_T("async_limit"), { 1 });
+	tasks.clear();
+	for (int i = 0; i < 100; ++i) {
+		HostResult r = aModule.Call(_T("hash_file_async"), { HostValue(wpath), _T("blake3") });
+		if (r.Obj())
+			r.Obj()->AddRef(), tasks.push_back(r.Obj());
+	}
+	int cancelled = 0;
+	for (int i = 50; i < (int)tasks.size(); ++i) {
+		TaskMember(tasks[i], _T("Cancel"), IT_CALL);
+		cancelled += TaskMember(tasks[i], _T("Status")).Str() == "rejected";
+	}
+	CHECK(cancelled > 0);
+	// Await blocks until the task settles; a cancelled one throws.
+	CHECK_EQ(TaskMember(tasks[0], _T("Await"), IT_CALL).Str().size(), 64u);
+	HostResult awaited = TaskMember(tasks.back(), _T("Await"), IT_CALL);
+	CHECK(awaited.Failed() && sHostError.message == "The task was cancelled.");
+	for (auto task : tasks)
+		CHECK(!TaskMember(task, _T("Await"), IT_CALL, { 30000 }).Failed() || sHostError.message == "The task was cancelled.");
+	for (auto task : tasks)
+		task->Release();
+	aModule.Call(_T("async_limit"), { old_limit.Int() });
+
+	// Cancelling a task whose job has finished, before the script thread has heard of it, leaves
+	// it fulfilled.
+	HostResult done = aModule.Call(_T("hash_file_async"), { HostValue(wpath), _T("xxh3") });
+	if (IObject* task = done.Obj()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		TaskMember(task, _T("Cancel"), IT_CALL);
+		PumpUntil([&] { return TaskMember(task, _T("Status")).Str() != "pending"; });
+		CHECK_EQ(TaskMember(task, _T("Status")).Str(), "fulfilled");
+		CHECK_EQ(TaskMember(task, _T("Result")).Str(), expected);
+	}
+
+	// A file which can't be opened rejects the task with an OSError.
+	HostResult missing = aModule.Call(_T("hash_file_async"), { _T("/nonexistent/file"), _T("xxh3") });
+	if (IObject* task = missing.Obj()) {
+		CHECK(TaskMember(task, _T("Await"), IT_CALL).Failed() && sHostError.type == "OSError");
+		CHECK_EQ(TaskMember(task, _T("Status")).Str(), "rejected");
+		HostResult err = TaskMember(task, _T("Result"));
+		CHECK(err.Obj() && !_tcscmp(err.Obj()->Type(), _T("OSError")));
+	}
+	HostPumpMessages();
+	unlink(path);
+}
+
+int main() {
+	HostModule module;
+	TestManyJobs();
+	TestFanOut();
+	TestProducers();
+	TestCancel();
+	TestLimit();
+	TestDestroy();
+	TestCompletionQueue();
+	TestTasks(module);
+	return CheckExit();
+}
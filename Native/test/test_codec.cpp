@@ -0,0 +1,206 @@
+// Tests of codec.cpp: the RFC 4648 test vectors for Base64, URL-safe Base64 and Base16, in one
+// call and streamed in pieces, decoding with whitespace and without padding, invalid input,
+// and the AVX2 and SSSE3 paths of simd.h against the scalar one at every length up to 300.
+#include "../codec.cpp"
+#include "host.h"
+#include "check.h"
+#include <random>
+
+static std::mt19937 sRandom(11);
+
+static HostBuffer* NewBytes(const std::string& aBytes) {
+	auto buf = new HostBuffer(aBytes.size());
+	memcpy(buf->mData, aBytes.data(), aBytes.size());
+	return buf;
+}
+
+static std::string BufferBytes(IObject* aObj) {
+	auto buf = static_cast<BufferObject*>(aObj);
+	return buf ? std::string((const char*)buf->mData, buf->mSize) : std::string();
+}
+
+// Encodes aBytes from a Buffer, returning the String, and checks that as_buffer agrees.
+static std::string Encode(HostModule& aModule, LPCTSTR aFunc, const std::string& aBytes, bool aFlag) {
+	auto buf = NewBytes(aBytes);
+	HostResult str = aModule.Call(aFunc, { (IObject*)buf, (int)aFlag });
+	HostResult ascii = aModule.Call(aFunc, { (IObject*)buf, (int)aFlag, 1 });
+	CHECK_EQ(BufferBytes(ascii.Obj()), str.Str());
+	buf->Release();
+	return str.Str();
+}
+
+// Decodes aText from a String and from a Buffer of ASCII, which must agree; "<error>" if invalid.
+static std::string Decode(HostModule& aModule, LPCTSTR aFunc, const std::string& aText, bool aUrl = false) {
+	auto text = HostWiden(aText);
+	auto ascii = NewBytes(aText);
+	HostResult from_str = aModule.Call(aFunc, { HostValue(text), (int)aUrl });
+	std::string error = sHostError.type;
+	HostResult from_buf = aModule.Call(aFunc, { (IObject*)ascii, (int)aUrl });
+	ascii->Release();
+	CHECK_EQ(from_str.Failed(), from_buf.Failed());
+	if (from_str.Failed()) {
+		CHECK_EQ(error, "ValueError");
+		return "<error>";
+	}
+	CHECK_EQ(BufferBytes(from_str.Obj()), BufferBytes(from_buf.Obj()));
+	return BufferBytes(from_str.Obj());
+}
+
+// Streams aBytes through Base64Encoder in pieces of aPiece bytes.
+static std::string StreamEncode(HostModule& aModule, const std::string& aBytes, bool aUrl, size_t aPiece) {
+	IObject* enc = aModule.New(_T("Base64Encoder"), { (int)aUrl });
+	std::string out;
+	for (size_t pos = 0; pos < aBytes.size(); pos += aPiece) {
+		auto piece = NewBytes(aBytes.substr(pos, aPiece));
+		HostResult r = aModule.Invoke(enc, _T("Base64Encoder.Prototype.Update"), { (IObject*)piece });
+		out += BufferBytes(r.Obj());
+		piece->Release();
+	}
+	HostResult r = aModule.Invoke(enc, _T("Base64Encoder.Prototype.Final"));
+	out += BufferBytes(r.Obj());
+	enc->Release();
+	return out;
+}
+
+static std::string StreamDecode(HostModule& aModule, const std::string& aText, bool aUrl, size_t aPiece) {
+	IObject* dec = aModule.New(_T("Base64Decoder"), { (int)aUrl });
+	std::string out;
+	bool failed = false;
+	for (size_t pos = 0; pos < aText.size() && !failed; pos += aPiece) {
+		auto piece = HostWiden(aText.substr(pos, aPiece));
+		HostResult r = aModule.Invoke(dec, _T("Base64Decoder.Prototype.Update"), { HostValue(piece) });
+		failed = r.Failed();
+		out += BufferBytes(r.Obj());
+	}
+	if (!failed) {
+		HostResult r = aModule.Invoke(dec, _T("Base64Decoder.Prototype.Final"));
+		failed = r.Failed();
+		out += BufferBytes(r.Obj());
+	}
+	dec->Release();
+	return failed ? "<error>" : out;
+}
+
+static void TestVectors(HostModule& aModule) {
+	// RFC 4648 section 10.
+	struct { const char* data, * base64, * base16; } vectors[] = {
+		{ "", "", "" },
+		{ "f", "Zg==", "66" },
+		{ "fo", "Zm8=", "666F" },
+		{ "foo", "Zm9v", "666F6F" },
+		{ "foob", "Zm9vYg==", "666F6F62" },
+		{ "fooba", "Zm9vYmE=", "666F6F6261" },
+		{ "foobar", "Zm9vYmFy", "666F6F626172" },
+	};
+	for (auto& v : vectors) {
+		std::string unpadded = v.base64, lower = v.base16;
+		while (!unpadded.empty() && unpadded.back() == '=')
+			unpadded.pop_back();
+		for (char& c : lower)
+			c = (char)tolower(c);
+		CHECK_EQ(Encode(aModule, _T("base64_encode"), v.data, false), v.base64);
+		CHECK_EQ(Encode(aModule, _T("base64_encode"), v.data, true), unpadded);
+		CHECK_EQ(Encode(aModule, _T("hex_encode"), v.data, true), v.base16);
+		CHECK_EQ(Encode(aModule, _T("hex_encode"), v.data, false), lower);
+		CHECK_EQ(Decode(aModule, _T("base64_decode"), v.base64), v.data);
+		CHECK_EQ(Decode(aModule, _T("base64_decode"), unpadded), v.data);
+		CHECK_EQ(Decode(aModule, _T("base64_decode"), unpadded, true), v.data);
+		CHECK_EQ(Decode(aModule, _T("hex_decode"), v.base16), v.data);
+		CHECK_EQ(Decode(aModule, _T("hex_decode"), lower), v.data);
+		for (size_t piece = 1; piece <= 4; ++piece) {
+			CHECK_EQ(StreamEncode(aModule, v.data, false, piece), v.base64);
+			CHECK_EQ(StreamDecode(aModule, v.base64, false, piece), v.data);
+		}
+	}
+	// The alphabets differ only in the last two characters, and each rejects the other's.
+	std::string high = "\xFB\xEF\xFF\xFE";
+	CHECK_EQ(Encode(aModule, _T("base64_encode"), high, false), "++///g==");
+	CHECK_EQ(Encode(aModule, _T("base64_encode"), high, true), "--___g");
+	CHECK_EQ(Decode(aModule, _T("base64_decode"), "--___g", true), high);
+	CHECK_EQ(Decode(aModule, _T("base64_decode"), "--___g"), "<error>");
+	CHECK_EQ(Decode(aModule, _T("base64_decode"), "++///g==", true), "<error>");
+	// A String is encoded as its UTF-16 bytes.
+	HostResult wide = aModule.Call(_T("hex_encode"), { _T("A€") });
+	CHECK_EQ(wide.Str(), "4100ac20");
+}
+
+static void TestDecodeRules(HostModule& aModule) {
+	CHECK_EQ(Decode(aModule, _T("base64_decode"), " Zm9v\r\nYmFy\t"), "foobar");
+	CHECK_EQ(Decode(aModule, _T("base64_decode"), "Zm9vYg= ="), "foob");
+	const char* invalid[] = { "Z", "Zm9vY", "Zg=", "Zg===", "Zm9v=", "=Zm9v", "Zg==Zg==", "Zm9v!", "Zm\xC3\xA9v" };
+	for (const char* text : invalid) {
+		CHECK_EQ(Decode(aModule, _T("base64_decode"), text), "<error>");
+		CHECK_EQ(StreamDecode(aModule, text, false, 1), "<error>");
+	}
+	// A character above 0xFF in a String is never valid, though its low byte would be.
+	HostResult r = aModule.Call(_T("base64_decode"), { _T("Zm9Ŷ") });
+	CHECK(r.Failed() && sHostError.type == "ValueError");
+	const char* bad_hex[] = { "6", "6G", "666F6", " 66", "0x66" };
+	for (const char* text : bad_hex)
+		CHECK_EQ(Decode(aModule, _T("hex_decode"), text), "<error>");
+	HostResult number = aModule.Call(_T("hex_decode"), { 66 });
+	CHECK(number.Failed() && sHostError.type == "TypeError");
+}
+
+// Each vector path must match the scalar one, including the blocks they leave to it.
+static void TestPaths() {
+	struct { const char* name; int needs; Base64EncodeType enc; Base64DecodeType dec; HexEncodeType hex_enc; HexDecodeType hex_dec; } paths[] = {
+		{ "avx2", CPU_AVX2, Base64Encode_AVX2, Base64Decode_AVX2, HexEncode_AVX2, HexDecode_AVX2 },
+		{ "ssse3", CPU_SSSE3, Base64Encode_SSSE3, Base64Decode_SSSE3, HexEncode_SSSE3, HexDecode_SSSE3 },
+	};
+	for (auto& path : paths) {
+		if ((CpuFeatures() & path.needs) != path.needs) {
+			fprintf(stderr, "skipped the %s path\n", path.name);
+			continue;
+		}
+		for (size_t length = 0; length <= 300; ++length) {
+			std::string src(length, 0);
+			for (char& c : src)
+				c = (char)sRandom();
+			for (int url = 0; url < 2; ++url) {
+				std::string expected(length / 3 * 4, 0), actual(length / 3 * 4, 0);
+				size_t done_expected = Base64Encode_Scalar((const BYTE*)src.data(), length, expected.data(), url);
+				size_t done = path.enc((const BYTE*)src.data(), length, actual.data(), url);
+				CHECK_EQ(done, done_expected);
+				CHECK(actual == expected);
+				// Damage one character now and then, or insert whitespace, to reach the fallback.
+				std::string text = expected;
+				int damage = !text.empty() && sRandom() % 3 == 0 ? (int)(sRandom() % text.size()) : -1;
+				if (damage >= 0)
+					text[damage] = sRandom() % 2 ? '\n' : '*';
+				std::vector<BYTE> out_expected(length + 3), out(length + 3);
+				Base64State state_expected, state;
+				state_expected.url = state.url = url;
+				BYTE* end_expected = Base64Decode_Scalar(text.data(), text.data() + text.size(), out_expected.data(), state_expected);
+				BYTE* end = path.dec(text.data(), text.data() + text.size(), out.data(), state);
+				CHECK_EQ(!end, !end_expected);
+				if (end && end_expected) {
+					CHECK_EQ(end - out.data(), end_expected - out_expected.data());
+					CHECK(!memcmp(out.data(), out_expected.data(), end - out.data()));
+					CHECK(state.count == state_expected.count && state.bits == state_expected.bits);
+				}
+			}
+			for (int upper = 0; upper < 2; ++upper) {
+				std::string expected(length * 2, 0), actual(length * 2, 0);
+				HexEncode_Scalar((const BYTE*)src.data(), length, expected.data(), upper);
+				path.hex_enc((const BYTE*)src.data(), length, actual.data(), upper);
+				CHECK(actual == expected);
+				std::vector<BYTE> out(length + 1);
+				CHECK(path.hex_dec(actual.data(), length, out.data()));
+				CHECK(!memcmp(out.data(), src.data(), length));
+				if (length) {
+					actual[sRandom() % actual.size()] = 'g';
+					CHECK(!path.hex_dec(actual.data(), length, out.data()));
+				}
+			}
+		}
+	}
+}
+
+int main() {
+	HostModule module;
+	TestVectors(module);
+	TestDecodeRules(module);
+	TestPaths();
+	return CheckExit();
+}
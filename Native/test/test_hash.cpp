@@ -0,0 +1,261 @@
+// Tests of hash.cpp against known answers: CRC32C, xxHash3 (64-bit), BLAKE3 and SHA-256 of the
+// BLAKE3 test pattern (byte i is i % 251) at lengths which cross each algorithm's block, stripe,
+// chunk and subtree boundaries, up to 16 MB so that BLAKE3 runs on the thread pool.  The digests
+// were generated with Python's hashlib, blake3 and xxhash packages.  The same inputs are then
+// hashed in pieces, through hash_many and through hash_file.
+#include "../hash.cpp"
+#include "host.h"
+#include "check.h"
+#include <random>
+#include <unistd.h>
+
+struct KnownAnswer
+{
+	size_t length;
+	const char* crc32c, * xxh3, * blake3, * sha256;
+};
+
+static const KnownAnswer sKnown[] = {
+	{ 0, "00000000", "2d06800538d394c2",
+		"af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262",
+		"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+	{ 1, "527d5351", "c44bdff4074eecdb",
+		"2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213",
+		"6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d" },
+	{ 3, "92fd4bfa", "5f4299fc161c9cbb",
+		"e1be4d7a8ab5560aa4199eea339849ba8e293d55ca0a81006726d184519e647f",
+		"ae4b3280e56e2faf83f414a6e3dabe9d5fbe18976544c05fed121accb85b53fc" },
+	{ 4, "d9331aa3", "60dab036a58211f2",
+		"f30f5ab28fe047904037f77b6da4fea1e27241c5d132638d8bedce9d40494f32",
+		"054edec1d0211f624fed0cbca9d4f9400b0e491c43742af2c5b0abebf0c990d8" },
+	{ 8, "8a2cbc3b", "3a1c2d7c85af88f8",
+		"2351207d04fc16ade43ccab08600939c7c1fa70a5c0aaca76063d04c3228eaeb",
+		"8a851ff82ee7048ad09ec3847f1ddf44944104d2cbd17ef4e3db22c6785a0d45" },
+	{ 9, "7144c5a8", "e9612598145bb9dc",
+		"a0fc27e5d7318b723207637bdeeba4f7dcb22f7f9ec3e8b6f3588ddcd4fdf861",
+		"f8348e0b1df00833cbbbd08f07abdecc10c0efb78829d7828c62a7f36d0cc549" },
+	{ 16, "d9c908eb", "8355e3a6f61770db",
+		"a6a492965517a830cb75fdb713465aa465f2f098233896fea44c1d98268bf9e3",
+		"be45cb2605bf36bebde684841a28f0fd43c69850a3dce5fedba69928ee3a8991" },
+	{ 17, "38435e17", "9ef341a99de37328",
+		"8462aa7be93b09fda7b93cf9f9cddb703f6dd2cc0c8edd5f9eee092edf8abf0c",
+		"3e5718fea51a8f3f5baca61c77afab473c1810f8b9db330273b4011ce92c787e" },
+	{ 128, "30d9c515", "85c6174c7ff4c46b",
+		"f17e570564b26578c33bb7f44643f539624b05df1a76c81f30acd548c44b45ef",
+		"471fb943aa23c511f6f72f8d1652d9c880cfa392ad80503120547703e56a2be5" },
+	{ 129, "f514629f", "ec7642b431ba3e5a",
+		"683aaae9f3c5ba37eaaf072aed0f9e30bac0865137bae68b1fde4ca2aebdcb12",
+		"5099c6a56203f9687f7d33f4bfdf576d31dc91f6b695ecea38b2770c87631135" },
+	{ 240, "9f4f71d6", "375a384d957fe865",
+		"45e1a0dc23dbe51733d7269a3c0f519c2a63b0718835b2b537677eba734db0d8",
+		"abf4bafcddb38bbf3855e47b5e61b75dedbcf42aa44ffd4bb85d0b08d97e2682" },
+	{ 241, "54fe7516", "02e8cd95421c6d02",
+		"749b36ae651c22e8567db692a6876e0ca4fd3daeb7aa8fa3ab2f642ccc69a8f6",
+		"211882aeac8a599b0a55ec280e1a978923edef69cd86541bcbd58db864c45eac" },
+	{ 1023, "39a4911a", "d3d91d80ac495685",
+		"10108970eeda3eb932baac1428c7a2163b0e924c9a9e25b35bba72b28f70bd11",
+		"1c5e88a585b61754df6137d66632a7348557a88358afc401b0a0a4fc427104a9" },
+	{ 1024, "2af62c0c", "e5d78bafa45b2aa5",
+		"42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7",
+		"2bce1ba628720664be4b9fdd77aae0678e5f0f3f02fc6ff641ec879094f6a404" },
+	{ 1025, "c8d03add", "e95c42288f28186e",
+		"d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444",
+		"bc0b6b10b89b9487a12fda2a8cc13194e7091c217aabf8b92846274026f4bcd0" },
+	{ 2048, "9f7e33f0", "25339063db861586",
+		"e776b6028c7cd22a4d0ba182a8bf62205d2ef576467e838ed6f2529b85fba24a",
+		"b2a8170614e23194ae2951423d601987f518ce2f11205d7b0b708080103b9f76" },
+	{ 2049, "0be89406", "6c9600c0e506e2ae",
+		"5f4d72f40d7a5f82b15ca2b2e44b1de3c2ef86c426c95c1af0b6879522563030",
+		"26e1e2808e3a6cf967ca03f6749a063c5ed55f92f5874653a1faabed78346f00" },
+	{ 3072, "ed1122eb", "4adb90b35034df6b",
+		"b98cb0ff3623be03326b373de6b9095218513e64f1ee2edd2525c7ad1e5cffd2",
+		"5f24b2f16026ec7d0450a5a08283d3cfd47302fe859f579ed79fe7d2663b73f9" },
+	{ 4097, "bd04b950", "b69d29f17d48293f",
+		"9b4052b38f1c5fc8b1f9ff7ac7b27cd242487b3d890d15c96a1c25b8aa0fb995",
+		"a16560d668b843fb3be99ace41dbd18471f342bd3255a1d21204b35e43f74436" },
+	{ 8193, "e814309c", "d6735a2b792cf505",
+		"bab6c09cb8ce8cf459261398d2e7aef35700bf488116ceb94a36d0f5f1b7bc3b",
+		"7e3691790cd64b19d4edb1a80e988214515abeb53aa0f34ffbfe4b4bf405d120" },
+	{ 16384, "eafca51d", "168f7fb4781d0831",
+		"f875d6646de28985646f34ee13be9a576fd515f76b5b0a26bb324735041ddde4",
+		"4348e3b98e8a327b34ced39c1da9e67cdb4cd5e48e4d7960607a3ae403d35f0c" },
+	{ 31744, "e1a4cb23", "5162bbaf8b257803",
+		"62b6960e1a44bcc1eb1a611a8d6235b6b4b78f32e7abc4fb4c6cdcce94895c47",
+		"3cfe29c8d109f9f2c47826c78f931f31fdec70a2cf0ddfbba8fe8009a729dd42" },
+	{ 102400, "7957da17", "1428e17f1cac2837",
+		"bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085",
+		"74588b7f0bcc354ac14d9cf199fa3a20c05f0c7293b9075b2f2e146e718de800" },
+	{ 1048576, "dc3e0071", "6e0d7ac36b8c10ff",
+		"74cb441fd087764ca9c3694da742ebe30cbeb3060a17009ca81825c7a8d10343",
+		"631b84027d6b9e52b539c4e8373622d23032dfadc64d60af87339c9037e4f769" },
+	{ 16778241, "d3c9fcb6", "498719fbbb0bb11c",
+		"1cf653ff42a3811c669b961d0f3e37848f48405b817e7e3a6db0a0119ae0bd4a",
+		"eb1b31ff8fcc0322396c9173236f6f244e745a5f2f5e488ddc3de63a17bcfe4a" },
+};
+
+static LPCTSTR sNames[] = { _T("crc32c"), _T("xxh3"), _T("blake3"), _T("sha256") };
+
+static const char* Expected(const KnownAnswer& aKnown, int aAlgorithm) {
+	const char* digests[] = { aKnown.crc32c, aKnown.xxh3, aKnown.blake3, aKnown.sha256 };
+	return digests[aAlgorithm];
+}
+
+static std::string HexOf(const void* aData, size_t aSize) {
+	std::string hex;
+	char digits[3];
+	for (size_t i = 0; i < aSize; ++i) {
+		snprintf(digits, sizeof(digits), "%02x", ((const BYTE*)aData)[i]);
+		hex += digits;
+	}
+	return hex;
+}
+
+// Hashes aData in pieces of 1 to aMaxPiece bytes, the first through a Buffer and the rest by
+// address and size, and returns the hex digest.
+static std::string HashPieces(HostModule& aModule, int aAlgorithm, HostBuffer* aData, size_t aLength, size_t aMaxPiece, std::mt19937& aRandom) {
+	IObject* hasher = aModule.New(_T("Hasher"), { sNames[aAlgorithm] });
+	const ObjectMember* update = aModule.Member(_T("Hasher.Prototype.Update"));
+	for (size_t pos = 0; pos < aLength; ) {
+		size_t piece = 1 + aRandom() % aMaxPiece;
+		piece = piece < aLength - pos ? piece : aLength - pos;
+		if (!pos)
+			aModule.Invoke(hasher, update, { (IObject*)aData, (__int64)piece });
+		else aModule.Invoke(hasher, update, { (__int64)(size_t)((BYTE*)aData->mData + pos), (__int64)piece });
+		pos += piece;
+	}
+	HostResult digest = aModule.Invoke(hasher, _T("Hasher.Prototype.Digest"));
+	hasher->Release();
+	return digest.Str();
+}
+
+static void TestKnownAnswers(HostModule& aModule, HostBuffer* aPattern) {
+	std::mt19937 random(7);
+	for (auto& known : sKnown) {
+		for (int a = 0; a < 4; ++a) {
+			IObject* hasher = aModule.New(_T("Hasher"), { sNames[a] });
+			aModule.Invoke(hasher, _T("Hasher.Prototype.Update"), { (IObject*)aPattern, (__int64)known.length });
+			HostResult hex = aModule.Invoke(hasher, _T("Hasher.Prototype.Digest"));
+			HostResult bytes = aModule.Invoke(hasher, _T("Hasher.Prototype.Digest"), { 1 });
+			auto buf = static_cast<BufferObject*>(bytes.Obj());
+			CHECK_EQ(hex.Str(), Expected(known, a));
+			CHECK(buf && HexOf(buf->mData, buf->mSize) == Expected(known, a));
+			if (hex.Str() != Expected(known, a))
+				fprintf(stderr, "  %s of %zu bytes: %s\n", HostNarrow(sNames[a]).c_str(), known.length, hex.Str().c_str());
+			hasher->Release();
+			// Small pieces near the boundaries, and pieces of up to a few subtrees for the large inputs.
+			size_t max_piece = known.length > 200000 ? 3 << 20 : 1500;
+			CHECK_EQ(HashPieces(aModule, a, aPattern, known.length, max_piece, random), Expected(known, a));
+		}
+	}
+}
+
+static void TestContext(HostModule& aModule) {
+	// Standard check values, and a String is hashed as its UTF-16 bytes.
+	IObject* hasher = aModule.New(_T("Hasher"), { _T("CRC32C") });
+	auto digits = new HostBuffer(9);
+	memcpy(digits->mData, "123456789", 9);
+	aModule.Invoke(hasher, _T("Hasher.Prototype.Update"), { (IObject*)digits });
+	CHECK_EQ(aModule.Invoke(hasher, _T("Hasher.Prototype.Digest")).Str(), "e3069283");
+	hasher->Release();
+	digits->Release();
+
+	hasher = aModule.New(_T("Hasher"), { _T("sha256") });
+	aModule.Invoke(hasher, _T("Hasher.Prototype.Update"), { _T("abc") });
+	std::string first = aModule.Invoke(hasher, _T("Hasher.Prototype.Digest")).Str();
+	CHECK_EQ(first, "13e228567e8249fce53337f25d7970de3bd68ab2653424c7b8f9fd05e33caedf");
+	// Digest does not reset, so the context can continue; Reset starts over.
+	CHECK_EQ(aModule.Invoke(hasher, _T("Hasher.Prototype.Digest")).Str(), first);
+	aModule.Invoke(hasher, _T("Hasher.Prototype.Reset"));
+	CHECK_EQ(aModule.Invoke(hasher, _T("Hasher.Prototype.Digest")).Str(), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+	aModule.Invoke(hasher, _T("Hasher.Prototype.Update"), { _T("ab") });
+	aModule.Invoke(hasher, _T("Hasher.Prototype.Update"), { _T("c") });
+	CHECK_EQ(aModule.Invoke(hasher, _T("Hasher.Prototype.Digest")).Str(), first);
+	// A size beyond the String is an error.
+	HostResult too_long = aModule.Invoke(hasher, _T("Hasher.Prototype.Update"), { _T("abc"), 7 });
+	CHECK(too_long.Failed() && sHostError.type == "ValueError");
+	hasher->Release();
+
+	hasher = aModule.New(_T("Hasher"), { _T("md5") });
+	CHECK(!hasher && sHostError.type == "ValueError" && sHostError.extra == "md5");
+	if (hasher)
+		hasher->Release();
+}
+
+static void TestHashMany(HostModule& aModule, HostBuffer* aPattern) {
+	// Enough bytes in total to reach the thread pool, and a String among the Buffers.
+	auto items = new HostArray;
+	std::vector<size_t> lengths;
+	for (auto& known : sKnown)
+		if (known.length <= 102400) {
+			auto buf = new HostBuffer(known.length);
+			memcpy(buf->mData, aPattern->mData, known.length);
+			items->Push(HostValue((IObject*)buf));
+			buf->Release();
+			lengths.push_back(known.length);
+		}
+	for (int i = 0; i < 12; ++i) {
+		auto buf = new HostBuffer(102400);
+		memcpy(buf->mData, aPattern->mData, 102400);
+		items->Push(HostValue((IObject*)buf));
+		buf->Release();
+		lengths.push_back(102400);
+	}
+	items->Push(HostValue(_T("abc")));
+	for (int a = 0; a < 4; ++a) {
+		HostResult r = aModule.Call(_T("hash_many"), { sNames[a], (IObject*)items });
+		auto digests = static_cast<HostArray*>(r.Obj());
+		CHECK(digests && digests->mLength == items->mLength);
+		for (Object::index_t i = 0; digests && i + 1 < digests->mLength; ++i) {
+			const char* expected = nullptr;
+			for (auto& known : sKnown)
+				if (known.length == lengths[i])
+					expected = Expected(known, a);
+			CHECK(digests->mItem[i].symbol == SYM_STRING && HostNarrow(digests->mItem[i].string.Value()) == expected);
+		}
+	}
+	HostResult last = aModule.Call(_T("hash_many"), { _T("sha256"), (IObject*)items, 1 });
+	auto digests = static_cast<HostArray*>(last.Obj());
+	CHECK(digests && digests->mItem[digests->mLength - 1].symbol == SYM_OBJECT);
+	if (digests) {
+		auto buf = static_cast<BufferObject*>(digests->mItem[digests->mLength - 1].object);
+		CHECK_EQ(HexOf(buf->mData, buf->mSize), "13e228567e8249fce53337f25d7970de3bd68ab2653424c7b8f9fd05e33caedf");
+	}
+	items->Push(HostValue((__int64)1));
+	HostResult bad = aModule.Call(_T("hash_many"), { _T("xxh3"), (IObject*)items });
+	CHECK(bad.Failed() && sHostError.type == "TypeError" && sHostError.extra == std::to_string(items->mLength));
+	items->Release();
+}
+
+static void TestHashFile(HostModule& aModule, HostBuffer* aPattern) {
+	const KnownAnswer& known = sKnown[_countof(sKnown) - 1];
+	char path[] = "/tmp/test_hash_XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	if (fd < 0)
+		return;
+	CHECK_EQ(write(fd, aPattern->mData, known.length), (ssize_t)known.length);
+	close(fd);
+	auto wpath = HostWiden(path);
+	for (int a = 0; a < 4; ++a)
+		CHECK_EQ(aModule.Call(_T("hash_file"), { HostValue(wpath), sNames[a] }).Str(), Expected(known, a));
+	// An empty file has the digest of no data.
+	fd = open(path, O_WRONLY | O_TRUNC);
+	close(fd);
+	CHECK_EQ(aModule.Call(_T("hash_file"), { HostValue(wpath), _T("blake3") }).Str(), sKnown[0].blake3);
+	unlink(path);
+	HostResult missing = aModule.Call(_T("hash_file"), { HostValue(wpath), _T("blake3") });
+	CHECK(missing.Failed() && sHostError.type == "OSError" && sHostError.extra == path);
+}
+
+int main() {
+	HostModule module;
+	auto pattern = new HostBuffer(sKnown[_countof(sKnown) - 1].length);
+	for (size_t i = 0; i < pattern->mSize; ++i)
+		((BYTE*)pattern->mData)[i] = (BYTE)(i % 251);
+	TestKnownAnswers(module, pattern);
+	TestContext(module);
+	TestHashMany(module, pattern);
+	TestHashFile(module, pattern);
+	pattern->Release();
+	return CheckExit();
+}
@@ -0,0 +1,210 @@
+// Tests of the AHK2_PROFILE build of ahk2_types.h, with codec.cpp as the module: call, argument
+// and byte counts and the objects a class returns, as profile_snapshot() reports them; p50 and
+// p99 from the histogram, with calls of two sizes; calls made while stopped are not counted; and
+// profile_trace() parsed as JSON, one complete event per call, and only the last
+// PROFILE_TRACE_EVENTS once the ring has wrapped.
+#ifndef AHK2_PROFILE
+#error test_profile must be compiled with AHK2_PROFILE.
+#endif
+#include "../codec.cpp"
+#include "host.h"
+#include "check.h"
+#include <map>
+
+// The statistics profile_snapshot() reports for one symbol, or nullptr.
+static HostObject* Stats(IObject* aSnapshot, const char* aName) {
+	auto map = static_cast<HostMap*>(aSnapshot);
+	for (Object::index_t i = map->mKeyOffsetString; i < map->mCount; ++i)
+		if (HostNarrow(map->mItem[i].key.s) == aName && map->mItem[i].symbol == SYM_OBJECT)
+			return static_cast<HostObject*>(map->mItem[i].object);
+	return nullptr;
+}
+
+static double Field(HostObject* aStats, LPCTSTR aName) {
+	Object::Variant* v = aStats ? aStats->Get(aName) : nullptr;
+	return !v ? -1 : v->symbol == SYM_INTEGER ? (double)v->n_int64 : v->symbol == SYM_FLOAT ? v->n_double : -1;
+}
+
+//
+// A minimal JSON reader, enough to check the trace: values are kept as text, except objects
+// and arrays.
+//
+
+struct JsonValue
+{
+	char kind = 0; // '{', '[', '"', or '0' for numbers and literals.
+	std::string text;
+	std::map<std::string, JsonValue> fields;
+	std::vector<JsonValue> items;
+};
+
+struct JsonReader
+{
+	const std::string& s;
+	size_t pos = 0;
+	bool ok = true;
+
+	void Space() { while (pos < s.size() && strchr(" \t\r\n", s[pos])) ++pos; }
+	bool Eat(char c) {
+		Space();
+		if (pos < s.size() && s[pos] == c)
+			return ++pos, true;
+		return false;
+	}
+	std::string String() {
+		std::string out;
+		if (!Eat('"'))
+			return ok = false, out;
+		while (pos < s.size() && s[pos] != '"') {
+			if (s[pos] == '\\' && ++pos == s.size())
+				break;
+			out += s[pos++];
+		}
+		ok = ok && Eat('"');
+		return out;
+	}
+	JsonValue Value() {
+		JsonValue v;
+		Space();
+		if (pos == s.size())
+			return ok = false, v;
+		if (Eat('{')) {
+			v.kind = '{';
+			if (Eat('}'))
+				return v;
+			do {
+				std::string key = String();
+				ok = ok && Eat(':');
+				v.fields[key] = Value();
+			} while (ok && Eat(','));
+			ok = ok && Eat('}');
+		}
+		else if (Eat('[')) {
+			v.kind = '[';
+			if (Eat(']'))
+				return v;
+			do v.items.push_back(Value());
+			while (ok && Eat(','));
+			ok = ok && Eat(']');
+		}
+		else if (s[pos] == '"')
+			v.kind = '"', v.text = String();
+		else {
+			v.kind = '0';
+			while (pos < s.size() && (isalnum((unsigned char)s[pos]) || strchr("+-.", s[pos])))
+				v.text += s[pos++];
+			ok = ok && !v.text.empty();
+		}
+		return v;
+	}
+};
+
+static bool ParseJson(const std::string& aText, JsonValue& aValue) {
+	JsonReader reader{ aText };
+	aValue = reader.Value();
+	reader.Space();
+	return reader.ok && reader.pos == aText.size();
+}
+
+static HostBuffer* NewBytes(size_t aSize) {
+	auto buf = new HostBuffer(aSize);
+	memset(buf->mData, 'x', aSize);
+	return buf;
+}
+
+int main() {
+	HostModule module;
+	CHECK(module.Func(_T("profile_start")) && module.Func(_T("profile_snapshot")) && module.Func(_T("profile_trace")));
+	auto small = NewBytes(16), large = NewBytes(1 << 20);
+
+	// Calls before profile_start are not counted.
+	module.Call(_T("base64_encode"), { (IObject*)small });
+	module.Call(_T("profile_start"));
+	// 95 small calls and 5 large ones in each 100, so p50 is a small call and p99 a large one.
+	const int calls = 400;
+	__int64 bytes = 0;
+	for (int i = 0; i < calls; ++i) {
+		bool big = i % 100 >= 95;
+		HostResult r = i & 1 ? module.Call(_T("base64_encode"), { (IObject*)(big ? large : small) })
+			: module.Call(_T("base64_encode"), { (IObject*)(big ? large : small), 0, 0 });
+		CHECK(r.symbol == SYM_STRING && r.mem_to_free);
+		if (r.mem_to_free)
+			bytes += (_tcslen(r.mem_to_free) + 1) * sizeof(TCHAR);
+	}
+	// A class counts the objects its constructor returns; its __New is a member of its own.
+	const int objects = 3;
+	for (int i = 0; i < objects; ++i)
+		if (IObject* enc = module.New(_T("Base64Encoder")))
+			enc->Release();
+	module.Call(_T("profile_stop"));
+	module.Call(_T("hex_encode"), { (IObject*)small });
+
+	HostResult snapshot = module.Call(_T("profile_snapshot"));
+	CHECK(snapshot.Obj() && !_tcscmp(snapshot.Obj()->Type(), _T("Map")));
+	if (IObject* map = snapshot.Obj()) {
+		HostObject* encode = Stats(map, "base64_encode");
+		CHECK(encode != nullptr);
+		CHECK_EQ(Field(encode, _T("Calls")), calls);
+		CHECK_EQ(Field(encode, _T("MeanArgs")), 2.0);
+		CHECK_EQ(Field(encode, _T("MaxArgs")), 3);
+		CHECK_EQ(Field(encode, _T("BytesReturned")), (double)bytes);
+		CHECK_EQ(Field(encode, _T("Objects")), 0);
+		double p50 = Field(encode, _T("P50Us")), p99 = Field(encode, _T("P99Us")), mean = Field(encode, _T("MeanUs"));
+		// A 1 MB call takes tens of thousands of times as long as a 16 byte one.
+		CHECK(p50 > 0 && p99 > 100 * p50);
+		CHECK(mean > p50 && mean < p99);
+		CHECK(Field(encode, _T("TotalUs")) >= mean * calls * 0.999);
+
+		HostObject* cls = Stats(map, "Base64Encoder");
+		CHECK_EQ(Field(cls, _T("Calls")), objects);
+		CHECK_EQ(Field(cls, _T("Objects")), objects);
+		CHECK_EQ(Field(Stats(map, "Base64Encoder.Prototype.__New"), _T("Calls")), objects);
+		// Not called while profiling.
+		CHECK(!Stats(map, "hex_encode") && !Stats(map, "base64_decode"));
+	}
+
+	// One complete ("X") event per call, in order, the class's calls last.
+	HostResult trace = module.Call(_T("profile_trace"));
+	JsonValue root;
+	CHECK(ParseJson(trace.Str(), root));
+	auto& events = root.fields["traceEvents"].items;
+	CHECK_EQ(root.fields["displayTimeUnit"].text, "ns");
+	CHECK_EQ(events.size(), (size_t)(calls + objects * 2));
+	double last_ts = -1;
+	for (size_t i = 0; i < events.size(); ++i) {
+		auto& ev = events[i].fields;
+		CHECK_EQ(ev["ph"].text, "X");
+		double ts = atof(ev["ts"].text.c_str()), dur = atof(ev["dur"].text.c_str());
+		CHECK(ts >= last_ts && dur >= 0);
+		last_ts = ts;
+		if (i < (size_t)calls) {
+			CHECK_EQ(ev["name"].text, "base64_encode");
+			CHECK_EQ(ev["cat"].text, "function");
+			CHECK_EQ(ev["args"].fields["argc"].text, i & 1 ? "1" : "3");
+		}
+	}
+	if (events.size() == (size_t)(calls + objects * 2)) {
+		CHECK_EQ(events[calls].fields["cat"].text, "class");
+		CHECK_EQ(events[calls + 1].fields["name"].text, "Base64Encoder.Prototype.__New");
+		CHECK_EQ(events[calls + 1].fields["cat"].text, "method");
+	}
+
+	// Past PROFILE_TRACE_EVENTS calls, the trace keeps the last ones and the counts go on.
+	module.Call(_T("profile_start"));
+	const int many = PROFILE_TRACE_EVENTS + 1000;
+	for (int i = 0; i < many; ++i)
+		module.Call(_T("hex_encode"), { (IObject*)small });
+	module.Call(_T("profile_stop"));
+	HostResult again = module.Call(_T("profile_snapshot"));
+	if (again.Obj()) {
+		CHECK_EQ(Field(Stats(again.Obj(), "hex_encode"), _T("Calls")), many);
+		CHECK(!Stats(again.Obj(), "base64_encode"));
+	}
+	HostResult wrapped = module.Call(_T("profile_trace"));
+	CHECK(ParseJson(wrapped.Str(), root));
+	CHECK_EQ(root.fields["traceEvents"].items.size(), (size_t)PROFILE_TRACE_EVENTS);
+
+	small->Release();
+	large->Release();
+	return CheckExit();
+}
@@ -0,0 +1,495 @@
+// Tests of serialize.cpp: random graphs of Objects, Arrays and Maps (shared objects, cycles,
+// unset items, caseless Maps, every kind of number and string) round-tripped through dump,
+// load, save, a lazy view and Materialize; the members of a view; strings written once; and
+// errors, from unsupported values to truncated and corrupted data, which must fail cleanly.
+#include "../serialize.cpp"
+#include "host.h"
+#include "check.h"
+#include <cmath>
+#include <functional>
+#include <map>
+#include <random>
+#include <unistd.h>
+
+static std::mt19937 sRandom(20);
+
+// Invokes a member of an object which dispatches by name, such as a view.
+static HostResult InvokeName(IObject* aObj, LPCTSTR aName, HostArgs aArgs = {}, int aInvokeType = IT_GET) {
+	HostResult result;
+	HostParams params(aArgs);
+	sHostError.Clear();
+	if (aObj->Invoke(result, aInvokeType, (LPTSTR)aName, ExprTokenType(aObj), params.ptrs.data(), (int)params.ptrs.size()) == INVOKE_NOT_HANDLED)
+		result.result = FAIL;
+	return result;
+}
+
+static std::string BufferBytes(IObject* aObj) {
+	auto buf = static_cast<BufferObject*>(aObj);
+	return buf ? std::string((const char*)buf->mData, buf->mSize) : std::string();
+}
+
+static HostBuffer* NewBytes(const std::string& aBytes) {
+	auto buf = new HostBuffer(aBytes.size());
+	memcpy(buf->mData, aBytes.data(), aBytes.size());
+	return buf;
+}
+
+//
+// Comparison of graphs.  aSeen maps each object of a to its counterpart in b, so that an
+// object reached twice in a must be one object in b.
+//
+
+static bool Same(IObject* a, IObject* b, std::map<IObject*, IObject*>& aSeen);
+
+static bool SameValue(Object::Variant& a, Object::Variant& b, std::map<IObject*, IObject*>& aSeen) {
+	if (a.symbol != b.symbol)
+		return false;
+	switch (a.symbol)
+	{
+	case SYM_STRING: return a.string.Length() == b.string.Length() && !memcmp(a.string.Value(), b.string.Value(), a.string.Length() * sizeof(TCHAR));
+	case SYM_OBJECT: return Same(a.object, b.object, aSeen);
+	case SYM_INTEGER:
+	case SYM_FLOAT: return a.n_int64 == b.n_int64;
+	default: return true;
+	}
+}
+
+static bool Same(IObject* a, IObject* b, std::map<IObject*, IObject*>& aSeen) {
+	auto seen = aSeen.find(a);
+	if (seen != aSeen.end())
+		return seen->second == b;
+	aSeen[a] = b;
+	if (a == b || _tcscmp(a->Type(), b->Type()))
+		return false;
+	switch (KindOf(a))
+	{
+	case SERIAL_ARRAY: {
+		auto x = static_cast<Array*>(a), y = static_cast<Array*>(b);
+		if (x->mLength != y->mLength)
+			return false;
+		for (Object::index_t i = 0; i < x->mLength; ++i)
+			if (!SameValue(x->mItem[i], y->mItem[i], aSeen))
+				return false;
+		return true;
+	}
+	case SERIAL_MAP: {
+		// Object keys are ordered by address, so the graphs here give a Map one at most.
+		auto x = static_cast<Map*>(a), y = static_cast<Map*>(b);
+		if (x->mCount != y->mCount || x->mKeyOffsetObject != y->mKeyOffsetObject || x->mKeyOffsetString != y->mKeyOffsetString
+			|| x->CaseFlags() != y->CaseFlags())
+			return false;
+		for (Object::index_t i = 0; i < x->mCount; ++i) {
+			auto& p = x->mItem[i], & q = y->mItem[i];
+			bool same_key = i < x->mKeyOffsetObject ? p.key.i == q.key.i
+				: i < x->mKeyOffsetString ? Same(p.key.p, q.key.p, aSeen) : !_tcscmp(p.key.s, q.key.s);
+			if (!same_key || !SameValue(p, q, aSeen))
+				return false;
+		}
+		return true;
+	}
+	case SERIAL_OBJECT: {
+		auto x = static_cast<Object*>(a), y = static_cast<Object*>(b);
+		if (x->mFields.Length() != y->mFields.Length())
+			return false;
+		for (Object::index_t i = 0; i < x->mFields.Length(); ++i)
+			if (_tcscmp(x->mFields[i].name, y->mFields[i].name) || !SameValue(x->mFields[i], y->mFields[i], aSeen))
+				return false;
+		return true;
+	}
+	default: return false;
+	}
+}
+
+static bool Same(IObject* a, IObject* b) {
+	std::map<IObject*, IObject*> seen;
+	return a && b && Same(a, b, seen);
+}
+
+//
+// Random graphs.
+//
+
+static HostValue RandomScalar() {
+	static const LPCTSTR sStrings[] = { _T(""), _T("a"), _T("A"), _T("name"), _T("Name"), _T("ünïcödé"), _T("\U0001F600 pair"),
+		_T("with\0nul"), _T("a somewhat longer string, repeated across the graph") };
+	static const double sFloats[] = { 0.0, -0.0, 0.5, -1e300, 1e-310, 3.141592653589793, INFINITY };
+	switch (sRandom() % 4)
+	{
+	case 0: return HostValue((__int64)sRandom() - (__int64)0x80000000);
+	case 1: return HostValue(sRandom() % 2 ? (__int64)0x8000000000000000ULL : (__int64)0x7FFFFFFFFFFFFFFFLL);
+	case 2: return HostValue(sFloats[sRandom() % _countof(sFloats)]);
+	default: {
+		size_t i = sRandom() % _countof(sStrings);
+		return i == 7 ? HostValue(sStrings[i], 8) : HostValue(sStrings[i]);
+	}
+	}
+}
+
+// A graph of about aNodes containers, in which a value is now and then an earlier container,
+// which makes both shared objects and cycles.
+static IObject* RandomGraph(int aNodes) {
+	std::vector<IObject*> made;
+	std::function<IObject*(int)> make = [&](int aDepth) -> IObject* {
+		int kind = sRandom() % 3, count = sRandom() % 6;
+		IObject* obj = kind == 0 ? (IObject*)new HostArray : kind == 1 ? (IObject*)new HostMap : (IObject*)new HostObject;
+		made.push_back(obj);
+		if (kind == 1 && sRandom() % 3 == 0)
+			InvokeName(obj, _T("CaseSense"), { _T("Off") }, IT_SET);
+		bool object_key = false;
+		for (int i = 0; i < count; ++i) {
+			IObject* child = nullptr;
+			int what = sRandom() % 8;
+			if (what < 2 && (int)made.size() < aNodes && aDepth < 12)
+				child = make(aDepth + 1);
+			else if (what == 2)
+				(child = made[sRandom() % made.size()])->AddRef();
+			HostValue value = child ? HostValue(child) : RandomScalar();
+			if (kind == 0)
+				static_cast<HostArray*>(obj)->Push(what == 3 ? HostValue::Missing() : value);
+			else if (kind == 1) {
+				auto map = static_cast<HostMap*>(obj);
+				int key = sRandom() % 3;
+				if (key == 2 && !object_key && !made.empty()) {
+					object_key = true;
+					map->Set(HostValue(made[sRandom() % made.size()]), value);
+				}
+				else if (key == 0)
+					map->Set(HostValue((__int64)(sRandom() % 100) - 50), value);
+				else {
+					TCHAR name[16];
+					_stprintf_s(name, _countof(name), _T("Key%u"), (unsigned)(sRandom() % 20));
+					map->Set(HostValue(name), value);
+				}
+			}
+			else {
+				TCHAR name[16];
+				_stprintf_s(name, _countof(name), sRandom() % 2 ? _T("f%u") : _T("F_%u"), (unsigned)(sRandom() % 30));
+				static_cast<HostObject*>(obj)->Set(name, value);
+			}
+			if (child)
+				child->Release();
+		}
+		return obj;
+	};
+	// The children are referenced by their parents; only the root has a reference of its own.
+	return make(0);
+}
+
+// Breaks the cycles of a graph made by RandomGraph, so that it can be freed.
+static void Unlink(IObject* aRoot) {
+	std::vector<IObject*> stack = { aRoot }, all;
+	std::map<IObject*, bool> seen;
+	while (!stack.empty()) {
+		IObject* obj = stack.back();
+		stack.pop_back();
+		if (seen[obj])
+			continue;
+		seen[obj] = true;
+		obj->AddRef();
+		all.push_back(obj);
+		auto visit = [&](Object::Variant& v) {
+			if (v.symbol == SYM_OBJECT)
+				stack.push_back(v.object);
+		};
+		switch (KindOf(obj))
+		{
+		case SERIAL_ARRAY: for (Object::index_t i = 0; i < static_cast<Array*>(obj)->mLength; ++i) visit(static_cast<Array*>(obj)->mItem[i]); break;
+		case SERIAL_MAP: {
+			auto map = static_cast<Map*>(obj);
+			for (Object::index_t i = 0; i < map->mCount; ++i) {
+				visit(map->mItem[i]);
+				if (i >= map->mKeyOffsetObject && i < map->mKeyOffsetString)
+					stack.push_back(map->mItem[i].key.p);
+			}
+			break;
+		}
+		case SERIAL_OBJECT: for (Object::index_t i = 0; i < static_cast<Object*>(obj)->mFields.Length(); ++i) visit(static_cast<Object*>(obj)->mFields[i]); break;
+		default: break;
+		}
+	}
+	// Replacing each container's values by unset drops every reference they held.
+	for (IObject* obj : all) {
+		switch (KindOf(obj))
+		{
+		case SERIAL_ARRAY: for (Object::index_t i = 0; i < static_cast<Array*>(obj)->mLength; ++i) HostFree(static_cast<Array*>(obj)->mItem[i]); break;
+		case SERIAL_MAP: for (Object::index_t i = 0; i < static_cast<Map*>(obj)->mCount; ++i) HostFree(static_cast<Map*>(obj)->mItem[i]); break;
+		case SERIAL_OBJECT: for (Object::index_t i = 0; i < static_cast<Object*>(obj)->mFields.Length(); ++i) HostFree(static_cast<Object*>(obj)->mFields[i]); break;
+		default: break;
+		}
+	}
+	for (IObject* obj : all)
+		obj->Release();
+}
+
+static std::string TempPath(const char* aName) {
+	char path[256];
+	snprintf(path, sizeof(path), "/tmp/test_serialize_%d_%s", (int)getpid(), aName);
+	return path;
+}
+
+// Every way of loading a random graph gives back the same graph.
+static void TestRoundTrip(HostModule& aModule) {
+	std::string path = TempPath("graph");
+	auto wpath = HostWiden(path);
+	for (int n = 0; n < 300; ++n) {
+		IObject* graph = RandomGraph(1 + n % 60);
+		HostResult dumped = aModule.Call(_T("dump"), { graph });
+		CHECK(!dumped.Failed());
+		if (dumped.Failed()) {
+			Unlink(graph);
+			graph->Release();
+			continue;
+		}
+		HostResult loaded = aModule.Call(_T("load"), { dumped.Obj() });
+		CHECK(Same(graph, loaded.Obj()));
+		// The same graph dumps to the same bytes.
+		HostResult again = aModule.Call(_T("dump"), { loaded.Obj() });
+		CHECK_EQ(BufferBytes(again.Obj()).size(), BufferBytes(dumped.Obj()).size());
+
+		CHECK(!aModule.Call(_T("save"), { graph, HostValue(wpath) }).Failed());
+		HostResult from_file = aModule.Call(_T("load"), { HostValue(wpath) });
+		CHECK(Same(graph, from_file.Obj()));
+		HostResult view = aModule.Call(_T("load"), { HostValue(wpath), 1 });
+		CHECK(view.Obj() && !_tcscmp(view.Obj()->Type(), _T("SerialView")));
+		if (view.Obj()) {
+			HostResult materialized = InvokeName(view.Obj(), _T("Materialize"), {}, IT_CALL);
+			CHECK(Same(graph, materialized.Obj()));
+			if (materialized.Obj())
+				Unlink(materialized.Obj());
+		}
+		HostResult lazy_buf = aModule.Call(_T("load"), { dumped.Obj(), 1 });
+		if (lazy_buf.Obj()) {
+			HostResult materialized = InvokeName(lazy_buf.Obj(), _T("Materialize"), {}, IT_CALL);
+			CHECK(Same(graph, materialized.Obj()));
+			if (materialized.Obj())
+				Unlink(materialized.Obj());
+		}
+		for (IObject* obj : { loaded.Obj(), from_file.Obj() })
+			if (obj)
+				Unlink(obj);
+		Unlink(graph);
+		graph->Release();
+	}
+	unlink(path.c_str());
+}
+
+// The members of a view answer as those of the object it stands for.
+static void TestView(HostModule& aModule) {
+	auto root = new HostObject;
+	auto items = new HostArray;
+	auto map = new HostMap, caseless = new HostMap;
+	auto child = new HostObject;
+	items->Push(HostValue(10));
+	items->Push(HostValue::Missing());
+	items->Push(HostValue(_T("three")));
+	items->Push(HostValue((IObject*)child));
+	child->Set(_T("x"), HostValue(1.5));
+	map->Set(HostValue(7), HostValue(_T("seven")));
+	map->Set(HostValue(_T("k")), HostValue(_T("lower")));
+	map->Set(HostValue(_T("K")), HostValue(_T("upper")));
+	InvokeName(caseless, _T("CaseSense"), { _T("Off") }, IT_SET);
+	caseless->Set(HostValue(_T("Key")), HostValue(1));
+	root->Set(_T("items"), HostValue((IObject*)items));
+	root->Set(_T("map"), HostValue((IObject*)map));
+	root->Set(_T("caseless"), HostValue((IObject*)caseless));
+	root->Set(_T("Name"), HostValue(_T("state")));
+	root->Set(_T("again"), HostValue((IObject*)child));
+
+	HostResult dumped = aModule.Call(_T("dump"), { (IObject*)root });
+	HostResult view = aModule.Call(_T("load"), { dumped.Obj(), 1 });
+	IObject* v = view.Obj();
+	CHECK(v);
+	if (!v)
+		return;
+	CHECK_EQ(InvokeName(v, _T("name")).Str(), "state");	// Field names are caseless.
+	CHECK_EQ(InvokeName(v, _T("Count")).Int(), 5);
+	CHECK_EQ(InvokeName(v, nullptr, { _T("NAME") }).Str(), "state");
+	CHECK_EQ(InvokeName(v, _T("Has"), { _T("items") }, IT_CALL).Int(), 1);
+	CHECK_EQ(InvokeName(v, _T("Has"), { _T("nothing") }, IT_CALL).Int(), 0);
+	CHECK_EQ(InvokeName(v, _T("Get"), { _T("nothing"), 42 }, IT_CALL).Int(), 42);
+	CHECK(InvokeName(v, _T("Get"), { _T("nothing") }, IT_CALL).Failed() && sHostError.type == "UnsetItemError");
+
+	HostResult vitems = InvokeName(v, _T("items")), vitems2 = InvokeName(v, _T("items"));
+	IObject* vi = vitems.Obj();
+	CHECK(vi && vi == vitems2.Obj());	// The same view while it exists.
+	if (vi) {
+		CHECK_EQ(InvokeName(vi, _T("Length")).Int(), 4);
+		CHECK_EQ(InvokeName(vi, nullptr, { 1 }).Int(), 10);
+		CHECK_EQ(InvokeName(vi, nullptr, { -2 }).Str(), "three");
+		CHECK(InvokeName(vi, nullptr, { 2 }).Failed() && sHostError.type == "UnsetItemError");
+		CHECK(InvokeName(vi, nullptr, { 0 }).Failed());
+		CHECK(InvokeName(vi, nullptr, { 5 }).Failed());
+		CHECK_EQ(InvokeName(vi, _T("Has"), { 2 }, IT_CALL).Int(), 0);
+		// A container reached twice is one view, whichever way it is reached.
+		HostResult vchild = InvokeName(vi, nullptr, { 4 }), vagain = InvokeName(v, _T("again"));
+		CHECK(vchild.Obj() && vchild.Obj() == vagain.Obj());
+		if (vchild.Obj())
+			CHECK_EQ(InvokeName(vchild.Obj(), _T("x")).Float(), 1.5);
+
+		// for i, v in items: the unset item leaves v as it was.
+		HostResult e = InvokeName(vi, _T("__Enum"), { 2 }, IT_CALL);
+		HostVar index, value;
+		std::string seen;
+		for (int i = 0; e.Obj() && i < 10; ++i) {
+			HostValue args[] = { HostValue(index), HostValue(value) };
+			ExprTokenType* params[] = { &args[0], &args[1] };
+			HostResult more;
+			e.Obj()->Invoke(more, IT_CALL, nullptr, ExprTokenType(e.Obj()), params, 2);
+			if (!more.Int())
+				break;
+			seen += std::to_string(index.mContentsInt64) + (value.IsObject() ? "o" : value.IsInt() ? "i" : "s") + ",";
+		}
+		CHECK_EQ(seen, "1i,2i,3s,4o,");
+	}
+
+	HostResult vmap = InvokeName(v, _T("map"));
+	if (IObject* vm = vmap.Obj()) {
+		CHECK_EQ(InvokeName(vm, _T("Count")).Int(), 3);
+		CHECK_EQ(InvokeName(vm, _T("CaseSense")).Str(), "On");
+		CHECK_EQ(InvokeName(vm, nullptr, { 7 }).Str(), "seven");
+		CHECK_EQ(InvokeName(vm, nullptr, { _T("k") }).Str(), "lower");
+		CHECK_EQ(InvokeName(vm, nullptr, { _T("K") }).Str(), "upper");
+		CHECK(InvokeName(vm, nullptr, { _T("7") }).Failed());	// Keys are not converted, as with Map.
+		CHECK(InvokeName(vm, nullptr, { 8 }).Failed() && sHostError.type == "UnsetItemError");
+	}
+	HostResult vcaseless = InvokeName(v, _T("caseless"));
+	if (IObject* vc = vcaseless.Obj()) {
+		CHECK_EQ(InvokeName(vc, _T("CaseSense")).Str(), "Off");
+		CHECK_EQ(InvokeName(vc, nullptr, { _T("KEY") }).Int(), 1);
+	}
+	HostResult materialized = InvokeName(v, _T("Materialize"), {}, IT_CALL);
+	CHECK(Same(root, materialized.Obj()));
+
+	for (IObject* obj : { (IObject*)items, (IObject*)map, (IObject*)caseless, (IObject*)child })
+		obj->Release();
+	root->Release();
+}
+
+// Each distinct string, including each field name, is written once.
+static void TestStrings(HostModule& aModule) {
+	auto text = _T("a string long enough that writing it more than once would show");
+	auto one = new HostArray, many = new HostArray;
+	one->Push(HostValue(text));
+	for (int i = 0; i < 1000; ++i) {
+		auto obj = new HostObject;
+		obj->Set(_T("description"), HostValue(text));
+		many->Push(HostValue((IObject*)obj));
+		obj->Release();
+	}
+	size_t one_size = BufferBytes(aModule.Call(_T("dump"), { (IObject*)one }).Obj()).size();
+	size_t many_size = BufferBytes(aModule.Call(_T("dump"), { (IObject*)many }).Obj()).size();
+	// Each Object adds a record of two slots, its offset and an Array slot; the name is added once.
+	CHECK(many_size <= one_size + 1000 * (SerialNode::SizeOf(2) + sizeof(UINT64) + 9) + 64);
+	one->Release();
+	many->Release();
+}
+
+static void CheckFails(HostResult aResult, const char* aType) {
+	CHECK(aResult.Failed());
+	CHECK_EQ(sHostError.type, aType);
+}
+
+static void TestErrors(HostModule& aModule) {
+	CheckFails(aModule.Call(_T("dump"), { 5 }), "TypeError");
+	CheckFails(aModule.Call(_T("dump"), { _T("text") }), "TypeError");
+	auto obj = new HostObject;
+	auto buf = new HostBuffer(4);
+	obj->Set(_T("buf"), HostValue((IObject*)buf));
+	CheckFails(aModule.Call(_T("dump"), { (IObject*)obj }), "TypeError");
+	CheckFails(aModule.Call(_T("load"), { 42 }), "TypeError");
+	CheckFails(aModule.Call(_T("load"), { (IObject*)buf }), "Error");
+	CheckFails(aModule.Call(_T("load"), { _T("/nonexistent/state.bin") }), "OSError");
+	CheckFails(aModule.Call(_T("save"), { (IObject*)obj, 5 }), "TypeError");
+	obj->Release();
+	buf->Release();
+
+	// A file too small to be valid.
+	std::string path = TempPath("short");
+	if (FILE* f = fopen(path.c_str(), "wb")) {
+		fwrite("AHBS", 1, 4, f);
+		fclose(f);
+	}
+	CheckFails(aModule.Call(_T("load"), { HostValue(HostWiden(path)), 1 }), "Error");
+	unlink(path.c_str());
+}
+
+// Loads aBytes every way, touching every part of a view; failing is fine, faulting is not.
+static void LoadAnyway(HostModule& aModule, const std::string& aBytes) {
+	auto buf = NewBytes(aBytes);
+	HostResult eager = aModule.Call(_T("load"), { (IObject*)buf });
+	if (!eager.Failed())
+		Unlink(eager.Obj());
+	else CHECK_EQ(sHostError.type, "Error");
+	HostResult view = aModule.Call(_T("load"), { (IObject*)buf, 1 });
+	if (IObject* v = view.Obj()) {
+		HostResult count = InvokeName(v, _T("Count"));
+		HostResult length = InvokeName(v, _T("Length"));
+		for (__int64 i = 1; i <= 4; ++i)
+			InvokeName(v, nullptr, { i });
+		InvokeName(v, nullptr, { _T("Key3") });
+		InvokeName(v, _T("f1"));
+		HostResult e = InvokeName(v, _T("__Enum"), { 2 }, IT_CALL);
+		HostVar key, value;
+		HostValue args[] = { HostValue(key), HostValue(value) };
+		ExprTokenType* params[] = { &args[0], &args[1] };
+		for (int i = 0; e.Obj() && i < 16; ++i) {
+			HostResult more;
+			e.Obj()->Invoke(more, IT_CALL, nullptr, ExprTokenType(e.Obj()), params, 2);
+			if (more.Failed() || !more.Int())
+				break;
+		}
+		HostResult materialized = InvokeName(v, _T("Materialize"), {}, IT_CALL);
+		if (materialized.Obj())
+			Unlink(materialized.Obj());
+	}
+	buf->Release();
+}
+
+static void TestCorrupt(HostModule& aModule) {
+	IObject* graph = RandomGraph(20);
+	std::string bytes = BufferBytes(aModule.Call(_T("dump"), { graph }).Obj());
+	Unlink(graph);
+	graph->Release();
+	CHECK(bytes.size() > sizeof(SerialHeader));
+
+	// Every truncation fails: the header records the size.
+	for (size_t size = 0; size < bytes.size(); ++size) {
+		auto buf = NewBytes(bytes.substr(0, size));
+		CheckFails(aModule.Call(_T("load"), { (IObject*)buf }), "Error");
+		CheckFails(aModule.Call(_T("load"), { (IObject*)buf, 1 }), "Error");
+		buf->Release();
+	}
+	// A header from another version or build fails.
+	auto header = (SerialHeader*)&bytes[0];
+	for (UINT16* field : { &header->version, &header->char_size }) {
+		UINT16 saved = *field;
+		*field = 0;
+		LoadAnyway(aModule, bytes);
+		auto buf = NewBytes(bytes);
+		CheckFails(aModule.Call(_T("load"), { (IObject*)buf }), "Error");
+		buf->Release();
+		*field = saved;
+	}
+	// Changed bytes anywhere, and offsets pointed out of range.
+	for (int n = 0; n < 3000; ++n) {
+		std::string changed = bytes;
+		for (int flips = 1 + sRandom() % 4; flips; --flips)
+			changed[sizeof(SerialHeader) / 2 + sRandom() % (changed.size() - sizeof(SerialHeader) / 2)] ^= (char)(1 << sRandom() % 8);
+		if (n % 10 == 0) {
+			size_t at = (sRandom() % (changed.size() / 8)) * 8;
+			UINT64 wild = sRandom() % 2 ? (UINT64)-8 : changed.size() - 8 * (sRandom() % 4);
+			memcpy(&changed[at], &wild, 8);
+		}
+		LoadAnyway(aModule, changed);
+	}
+}
+
+int main() {
+	HostModule module;
+	TestRoundTrip(module);
+	TestView(module);
+	TestStrings(module);
+	TestErrors(module);
+	TestCorrupt(module);
+	return CheckExit();
+}
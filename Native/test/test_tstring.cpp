@@ -0,0 +1,205 @@
+// Tests of TString: inline storage and the move to the heap, number formatting, appending
+// tokens (including adopting a ResultToken's memory), and handing the text over with
+// detach() and move_to().  ahk2.cpp is the module the host needs.
+#include "../ahk2.cpp"
+#include "host.h"
+#include "check.h"
+#include <cmath>
+#include <climits>
+
+static std::string Text(TString& aStr) { return HostNarrow(aStr.data(), aStr.size()); }
+
+static std::string Int(__int64 aValue) {
+	TString s;
+	s.append_int(aValue);
+	return Text(s);
+}
+static std::string Float(double aValue) {
+	TString s;
+	s.append_float(aValue);
+	return Text(s);
+}
+
+static void TestAppend() {
+	TString s;
+	CHECK_EQ(s.size(), 0u);
+	CHECK_EQ(Text(s), "");
+	CHECK(s.data()[0] == 0);
+
+	// Grow one char at a time past the inline buffer; the text must survive the move.
+	std::string expected;
+	for (int i = 0; i < 1000; ++i) {
+		TCHAR c = (TCHAR)('a' + i % 26);
+		s.append(c);
+		expected += (char)c;
+		if (s.size() != expected.size())
+			break;
+	}
+	CHECK_EQ(Text(s), expected);
+
+	s.clear();
+	CHECK_EQ(s.size(), 0u);
+	s += _T("abc");
+	s.append(_T("defXYZ"), 3);
+	CHECK_EQ(Text(s), "abcdef");
+	CHECK(s.back() == 'f');
+	s.pop_back();
+	CHECK_EQ(Text(s), "abcde");
+	s.clear();
+	s.pop_back(); // No-op when empty.
+	CHECK_EQ(s.size(), 0u);
+
+	// A single append larger than twice the capacity.
+	std::vector<TCHAR> big(100000, 'x');
+	TString t;
+	t.append('<');
+	t.append(big.data(), big.size());
+	t.append('>');
+	CHECK_EQ(t.size(), big.size() + 2);
+	CHECK(t.data()[0] == '<' && t.data()[big.size()] == 'x' && t.data()[big.size() + 1] == '>' && t.data()[big.size() + 2] == 0);
+
+	TString r;
+	CHECK(r.reserve(5000));
+	TCHAR* before = r.data();
+	for (int i = 0; i < 5000; ++i)
+		r.append('z');
+	CHECK(r.data() == before); // No reallocation within the reserved size.
+	CHECK_EQ(r.size(), 5000u);
+}
+
+static void TestNumbers() {
+	CHECK_EQ(Int(0), "0");
+	CHECK_EQ(Int(7), "7");
+	CHECK_EQ(Int(-1), "-1");
+	CHECK_EQ(Int(1234567890123), "1234567890123");
+	CHECK_EQ(Int(LLONG_MAX), "9223372036854775807");
+	CHECK_EQ(Int(LLONG_MIN), "-9223372036854775808");
+
+	CHECK_EQ(Float(0.0), "0.0");
+	CHECK_EQ(Float(-0.0), "-0.0");
+	CHECK_EQ(Float(1.0), "1.0");
+	CHECK_EQ(Float(-42.0), "-42.0");
+	CHECK_EQ(Float(0.5), "0.5");
+	CHECK_EQ(Float(0.1), "0.10000000000000001");
+	CHECK_EQ(Float(9007199254740991.0), "9007199254740991.0");
+	CHECK_EQ(Float(9007199254740992.0), "9007199254740992.0"); // Past the fast path.
+	CHECK_EQ(Float(1e300), "1.0000000000000001e+300");
+	CHECK_EQ(Float(1e-7), "9.9999999999999995e-08");
+	CHECK(Float(INFINITY).find('.') == std::string::npos);
+	CHECK(Float(NAN).find('.') == std::string::npos);
+
+	TString s;
+	s.append_int(-5).append(',').append_float(2.5).append(',').append_int(0);
+	CHECK_EQ(Text(s), "-5,2.5,0");
+}
+
+static void TestTokens() {
+	TString s;
+	HostValue str(_T("str")), str_len(_T("string"), 3), num((__int64)12), flt(1.5), obj((IObject*)nullptr);
+	obj.symbol = SYM_MISSING;
+	s.append(str).append(str_len).append(num).append(flt).append(obj);
+	CHECK_EQ(Text(s), "strstr121.5");
+
+	HostVar var;
+	var.mContentsInt64 = 99, var.mAttrib = VAR_ATTRIB_IS_INT64;
+	HostValue ref(var);
+	TString v;
+	v.append(ref);
+	CHECK_EQ(Text(v), "99");
+
+	// An empty TString adopts a ResultToken's allocated string instead of copying it.
+	std::vector<TCHAR> text(200, 'q');
+	text.back() = 0;
+	TCHAR* mem = (TCHAR*)malloc(text.size() * sizeof(TCHAR));
+	memcpy(mem, text.data(), text.size() * sizeof(TCHAR));
+	HostResult result;
+	result.AcceptMem(mem, text.size() - 1);
+	TString adopt;
+	adopt.append(result);
+	CHECK(result.mem_to_free == nullptr);
+	CHECK(adopt.data() == mem);
+	CHECK_EQ(adopt.size(), text.size() - 1);
+	adopt.append('!');
+	CHECK(adopt.data()[text.size() - 1] == '!');
+
+	// A non-empty one copies it, and the token keeps its memory.
+	TCHAR* mem2 = (TCHAR*)malloc(4 * sizeof(TCHAR));
+	memcpy(mem2, _T("xyz"), 4 * sizeof(TCHAR));
+	HostResult result2;
+	result2.AcceptMem(mem2, 3);
+	TString copy;
+	copy.append('>');
+	copy.append(result2);
+	CHECK(result2.mem_to_free == mem2);
+	CHECK_EQ(Text(copy), ">xyz");
+
+	HostResult number;
+	number.SetValue((__int64)-3);
+	TString n;
+	n.append(number);
+	CHECK_EQ(Text(n), "-3");
+}
+
+static void TestHandOver() {
+	// Inline text is copied to a new allocation; heap text is handed over as is.
+	TString s;
+	s += _T("short");
+	TCHAR* p = s.detach();
+	CHECK(p && HostNarrow(p) == "short");
+	CHECK_EQ(s.size(), 0u);
+	free(p);
+	std::vector<TCHAR> big(300, 'h');
+	s.append(big.data(), big.size());
+	TCHAR* heap = s.data();
+	p = s.detach();
+	CHECK(p == heap);
+	CHECK(p[300] == 0);
+	free(p);
+	s += _T("reuse");
+	CHECK_EQ(Text(s), "reuse");
+
+	// Short results go into the token's buffer; long ones transfer the heap buffer.
+	TString a;
+	a += _T("tiny");
+	HostResult r1;
+	CHECK(a.move_to(r1));
+	CHECK(r1.symbol == SYM_STRING && r1.marker == r1.buf && r1.marker_length == 4);
+	CHECK_EQ(r1.Str(), "tiny");
+	CHECK(!r1.mem_to_free);
+	CHECK_EQ(a.size(), 0u);
+
+	TString b;
+	b.append(big.data(), big.size());
+	TCHAR* data = b.data();
+	HostResult r2;
+	CHECK(b.move_to(r2));
+	CHECK(r2.symbol == SYM_STRING && r2.marker == data && r2.mem_to_free == data && r2.marker_length == 300);
+	CHECK_EQ(b.size(), 0u);
+
+	// Inline text for a token without a buffer gets an allocation of its own.
+	TString c;
+	c += _T("inline");
+	HostResult r3;
+	r3.buf = nullptr;
+	CHECK(c.move_to(r3));
+	CHECK(r3.mem_to_free && r3.marker == r3.mem_to_free && r3.marker_length == 6);
+	CHECK_EQ(r3.Str(), "inline");
+
+	// release() forgets a buffer taken over through data().
+	TString d;
+	d.append(big.data(), big.size());
+	TCHAR* taken = d.data();
+	d.release();
+	CHECK_EQ(d.size(), 0u);
+	d += _T("ok");
+	CHECK_EQ(Text(d), "ok");
+	free(taken);
+}
+
+int main() {
+	TestAppend();
+	TestNumbers();
+	TestTokens();
+	TestHandOver();
+	return CheckExit();
+}
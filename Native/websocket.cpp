@@ -0,0 +1,361 @@
+﻿#include "ahk2_types.h"
+#include "simd.h"
+
+// websocket: RFC 6455 frame codec for WebSockets.ahk.
+//   ws := Native.LoadModule('websocket.dll')
+//   dec := ws.FrameDecoder(server := true, max_size := 0)	; a server expects masked frames, max_size 0 is unlimited
+//   for msg in dec.Feed(buf, size?, &consumed?)	; every complete message in buf, then remove the first consumed bytes
+//   frame := ws.EncodeFrame(data, mask := 0, opcode?)	; a String is sent as text, a Buffer as binary
+// Messages are {opcode, ptr, size} with the payload unmasked in place, and text messages also
+// have text.  Fragments are joined in place behind the first one, so ptr/size stay valid until
+// the buffer is changed.  Control frames are copied out: ping/pong have data (a Buffer), and
+// close has code and reason.  Protocol errors throw, with the close code to send as Extra.
+
+enum WsOpcode
+{
+	WS_CONTINUATION = 0x0,
+	WS_TEXT = 0x1,
+	WS_BINARY = 0x2,
+	WS_CLOSE = 0x8,
+	WS_PING = 0x9,
+	WS_PONG = 0xA
+};
+
+// Opcodes 3-7 and 0xB-0xF are reserved for further frames (RFC 6455 section 5.2).
+static bool IsReservedOpcode(BYTE aOpcode) {
+	return (aOpcode > WS_BINARY && aOpcode < WS_CLOSE) || aOpcode > WS_PONG;
+}
+
+static bool SetInt(IObject* aObj, LPTSTR aName, __int64 aValue) {
+	ExprTokenType value;
+	value.SetValue(aValue);
+	return SetProperty(aObj, aName, value);
+}
+
+// Sets a property to the text of a UTF-8 payload, which has already been validated.
+static bool SetUtf8(IObject* aObj, LPTSTR aName, const char* aStr, size_t aLength) {
+	TCHAR buf[MAX_NUMBER_SIZE];
+	LPTSTR str = aLength < _countof(buf) ? buf : aLength < INT_MAX ? (LPTSTR)malloc((aLength + 1) * sizeof(TCHAR)) : nullptr;
+	if (!str)
+		return false;
+#ifdef UNICODE
+	size_t length = Utf8ToUtf16(aStr, aStr + aLength, str) - str;
+#else
+	size_t length = aLength;
+	memcpy(str, aStr, aLength);
+#endif
+	str[length] = 0;
+	ExprTokenType value;
+	value.SetValue(str, length);
+	bool ok = SetProperty(aObj, aName, value);
+	if (str != buf)
+		free(str);
+	return ok;
+}
+
+class FrameDecoder : public Object {
+	size_t mMaxSize = 0;
+	size_t mMessageLength = 0; // Payload of a fragmented message, joined at the start of the buffer.
+	size_t mResume = 0;        // Where frame parsing resumes, at or after mMessageLength.
+	BYTE mMessageOpcode = 0;   // Opcode of the fragmented message, or 0.
+	bool mServer = true;
+	bool mFailed = false;
+
+	bool Fail(LPTSTR aMessage, LPTSTR aCloseCode) {
+		mFailed = true;
+		Object::Error(ExprTokenType(aMessage), aCloseCode, _T("Error"));
+		return false;
+	}
+
+	bool Emit(IObject* aArray, IObject* aMessage) {
+		ExprTokenType item(aMessage), * param = &item;
+		TCHAR buf[MAX_NUMBER_SIZE];
+		ResultToken r;
+		r.InitResult(buf);
+		aArray->Invoke(r, IT_CALL, _T("Push"), ExprTokenType(aArray), &param, 1);
+		r.Free();
+		aMessage->Release();
+		return !r.Exited();
+	}
+
+	bool EmitData(IObject* aArray, BYTE aOpcode, char* aData, size_t aLength) {
+		static IObject* sObject = GetGlobal(_T("Object"));
+		if (aOpcode == WS_TEXT && !Utf8Valid(aData, aData + aLength))
+			return Fail(_T("Invalid UTF-8 in a text message."), _T("1007"));
+		IObject* msg = sObject ? CallGlobal(sObject, nullptr, 0) : nullptr;
+		if (!msg)
+			return false;
+		bool ok = SetInt(msg, _T("opcode"), aOpcode) && SetInt(msg, _T("ptr"), (__int64)(size_t)aData)
+			&& SetInt(msg, _T("size"), (__int64)aLength) && (aOpcode != WS_TEXT || SetUtf8(msg, _T("text"), aData, aLength));
+		if (!ok) {
+			msg->Release();
+			return false;
+		}
+		return Emit(aArray, msg);
+	}
+
+	bool EmitControl(IObject* aArray, BYTE aOpcode, char* aData, size_t aLength) {
+		static IObject* sObject = GetGlobal(_T("Object"));
+		IObject* msg = sObject ? CallGlobal(sObject, nullptr, 0) : nullptr;
+		if (!msg)
+			return false;
+		bool ok = SetInt(msg, _T("opcode"), aOpcode);
+		if (ok && aOpcode == WS_CLOSE) {
+			if (aLength == 1)
+				ok = Fail(_T("Invalid close frame."), _T("1002"));
+			else if (aLength > 2 && !Utf8Valid(aData + 2, aData + aLength))
+				ok = Fail(_T("Invalid UTF-8 in a close reason."), _T("1007"));
+			else ok = SetInt(msg, _T("code"), aLength ? (BYTE)aData[0] << 8 | (BYTE)aData[1] : 1005)
+				&& SetUtf8(msg, _T("reason"), aData + 2, aLength > 2 ? aLength - 2 : 0);
+		}
+		else if (ok) {
+			BufferObject* buf;
+			if ((ok = NewBuffer(aLength, buf))) {
+				memcpy(buf->mData, aData, aLength);
+				ExprTokenType value((IObject*)buf);
+				ok = SetProperty(msg, _T("data"), value);
+				buf->Release();
+			}
+		}
+		if (!ok) {
+			msg->Release();
+			return false;
+		}
+		return Emit(aArray, msg);
+	}
+
+	// Parses every complete frame in [aBuf, aBuf + aSize) and returns the number of bytes
+	// the caller can drop, or -1 on failure.
+	ptrdiff_t Decode(char* aBuf, size_t aSize, IObject* aArray) {
+		size_t pos = mResume, message = 0, consumed = mMessageOpcode ? 0 : pos;
+		for (;;) {
+			auto p = (const BYTE*)aBuf + pos;
+			size_t avail = aSize - pos;
+			if (avail < 2)
+				break;
+			BYTE fin = p[0] & 0x80, opcode = p[0] & 0x0F, masked = p[1] & 0x80;
+			unsigned __int64 length = p[1] & 0x7F;
+			size_t header = 2 + (masked ? 4 : 0) + (length == 126 ? 2 : length == 127 ? 8 : 0);
+			if (p[0] & 0x70)
+				return Fail(_T("Reserved bits are set."), _T("1002")), -1;
+			if (!masked != !mServer)
+				return Fail((LPTSTR)(mServer ? _T("Frames from a client must be masked.") : _T("Frames from a server must not be masked.")), _T("1002")), -1;
+			if (IsReservedOpcode(opcode))
+				return Fail(_T("Reserved opcode."), _T("1002")), -1;
+			if (opcode >= WS_CLOSE) {
+				if (!fin || length > 125)
+					return Fail(_T("Invalid control frame."), _T("1002")), -1;
+			}
+			else if (!opcode == !mMessageOpcode)
+				return Fail((LPTSTR)(opcode ? _T("Expected a continuation frame.") : _T("Unexpected continuation frame.")), _T("1002")), -1;
+			if (avail < header)
+				break;
+			if (length == 126)
+				length = (size_t)p[2] << 8 | p[3];
+			else if (length == 127) {
+				length = 0;
+				for (int i = 2; i < 10; ++i)
+					length = length << 8 | p[i];
+				if (length >> 63)
+					return Fail(_T("Invalid frame length."), _T("1002")), -1;
+			}
+			if (mMaxSize && length > mMaxSize - (opcode ? 0 : mMessageLength))
+				return Fail(_T("The message is too big."), _T("1009")), -1;
+			if (avail - header < length)
+				break;
+			UINT key = 0;
+			if (masked)
+				memcpy(&key, p + header - 4, 4);
+			char* payload = aBuf + pos + header;
+			pos += header + (size_t)length;
+			if (opcode >= WS_CLOSE) {
+				if (masked)
+					MaskBytes(payload, payload, (size_t)length, key);
+				if (!EmitControl(aArray, opcode, payload, (size_t)length))
+					return -1;
+			}
+			else if (opcode && fin) {
+				if (masked)
+					MaskBytes(payload, payload, (size_t)length, key);
+				if (!EmitData(aArray, opcode, payload, (size_t)length))
+					return -1;
+			}
+			else {
+				// Join the fragments in place, so the message is contiguous.
+				if (opcode)
+					mMessageOpcode = opcode, mMessageLength = 0, message = payload - aBuf;
+				MaskBytes(aBuf + message + mMessageLength, payload, (size_t)length, key);
+				mMessageLength += (size_t)length;
+				if (fin) {
+					BYTE message_opcode = mMessageOpcode;
+					mMessageOpcode = 0;
+					if (!EmitData(aArray, message_opcode, aBuf + message, mMessageLength))
+						return -1;
+				}
+			}
+			if (!mMessageOpcode)
+				consumed = pos;
+		}
+		// Keep the joined fragments and the incomplete frame; they start the buffer next time.
+		if (mMessageOpcode)
+			consumed = message;
+		mResume = pos - consumed;
+		return (ptrdiff_t)consumed;
+	}
+
+public:
+#define CLASSNAME "FrameDecoder"
+	IObject_Type_Impl;
+	static ObjectMember sMembers[];
+
+	void __New(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		ExprTokenType max_size;
+		mServer = !aParamCount || aParam[0]->symbol == SYM_MISSING || TokenToBool(*aParam[0]);
+		if (aParamCount > 1 && aParam[1]->symbol != SYM_MISSING) {
+			TokenToValue(*aParam[1], max_size);
+			if (max_size.symbol != SYM_INTEGER || max_size.value_int64 < 0) {
+				Object::Error(ExprTokenType(_T("Invalid max_size.")), nullptr, _T("ValueError"));
+				aResultToken.result = FAIL;
+				return;
+			}
+			mMaxSize = (size_t)max_size.value_int64;
+		}
+	}
+
+	// Feed(buf, size?, &consumed?)
+	void Feed(ResultToken& aResultToken, int aID, int aFlags, ExprTokenType* aParam[], int aParamCount) {
+		static IObject* sArray = GetGlobal(_T("Array"));
+		ExprTokenType val;
+		BufferObject* buf = nullptr;
+		size_t size;
+		Var* consumed_var = aParamCount > 2 ? TokenToOutputVar(*aParam[2]) : nullptr;
+		if (mFailed) {
+			Object::Error(ExprTokenType(_T("The decoder has failed.")), nullptr, _T("Error"));
+			aResultToken.result = FAIL;
+			return;
+		}
+		TokenToValue(*aParam[0], val);
+		if (val.symbol == SYM_OBJECT && !_tcscmp(val.object->Type(), _T("Buffer")))
+			buf = static_cast<BufferObject*>(val.object);
+		size = buf ? buf->mSize : 0;
+		if (buf && aParamCount > 1 && aParam[1]->symbol != SYM_MISSING) {
+			TokenToValue(*aParam[1], val);
+			if (val.symbol != SYM_INTEGER || val.value_int64 < 0 || (unsigned __int64)val.value_int64 > size)
+				buf = nullptr;
+			else size = (size_t)val.value_int64;
+		}
+		if (!buf || size < mResume) {
+			Object::Error(ExprTokenType(_T("Invalid buffer or size.")), nullptr, _T("ValueError"));
+			aResultToken.result = FAIL;
+			return;
+		}
+		IObject* arr = sArray ? CallGlobal(sArray, nullptr, 0) : nullptr;
+		ptrdiff_t consumed = arr ? Decode((char*)buf->mData, size, arr) : -1;
+		if (consumed < 0) {
+			if (arr)
+				arr->Release();
+			aResultToken.result = FAIL;
+			return;
+		}
+		if (consumed_var)
+			consumed_var->Assign((__int64)consumed);
+		aResultToken.SetValue(arr);
+	}
+};
+
+ObjectMember FrameDecoder::sMembers[] = {
+	Object_Method(__New, __New, 0, 0, 2),
+	Object_Method(Feed, Feed, 0, 1, 3),
+};
+
+// EncodeFrame(data, mask := 0, opcode?)
+BIF_DECL(EncodeFrame) {
+	ExprTokenType data, val;
+	const char* payload = nullptr;
+	char* utf8 = nullptr;
+	size_t length = 0;
+	UINT key = 0;
+	BYTE opcode;
+	TokenToValue(*aParam[0], data);
+	if (data.symbol == SYM_OBJECT && !_tcscmp(data.object->Type(), _T("Buffer"))) {
+		auto buf = static_cast<BufferObject*>(data.object);
+		payload = (const char*)buf->mData, length = buf->mSize, opcode = WS_BINARY;
+	}
+	else if (data.symbol == SYM_STRING) {
+		size_t chars = data.marker_length == -1 ? _tcslen(data.marker) : data.marker_length;
+#ifdef UNICODE
+		size_t bytes = Utf8Length(data.marker, data.marker + chars);
+		if (bytes && (utf8 = (char*)malloc(bytes)))
+			Utf16ToUtf8(data.marker, data.marker + chars, utf8);
+		payload = utf8, length = bytes;
+		if (bytes && !utf8) {
+			Object::Error(ExprTokenType(_T("Out of memory.")), nullptr, _T("MemoryError"));
+			aResultToken.result = FAIL;
+			return;
+		}
+#else
+		payload = data.marker, length = chars;
+#endif
+		opcode = WS_TEXT;
+	}
+	else {
+		Object::Error(ExprTokenType(_T("Parameter #1 must be a String or Buffer.")), nullptr, _T("TypeError"));
+		aResultToken.result = FAIL;
+		return;
+	}
+	if (aParamCount > 1 && aParam[1]->symbol != SYM_MISSING) {
+		TokenToValue(*aParam[1], val);
+		if (val.symbol == SYM_INTEGER)
+			key = (UINT)val.value_int64; // Stored like NumPut('uint', mask).
+	}
+	if (aParamCount > 2 && aParam[2]->symbol != SYM_MISSING) {
+		TokenToValue(*aParam[2], val);
+		opcode = val.symbol == SYM_INTEGER && val.value_int64 >= 0 && val.value_int64 <= 0xF ? (BYTE)val.value_int64 : 0xFF;
+		if (opcode != 0xFF && IsReservedOpcode(opcode)) {
+			free(utf8);
+			Object::Error(ExprTokenType(_T("Reserved opcode.")), _T("1002"), _T("Error"));
+			aResultToken.result = FAIL;
+			return;
+		}
+		if (opcode == 0xFF || (opcode >= WS_CLOSE && length > 125)) {
+			free(utf8);
+			Object::Error(ExprTokenType(_T("Invalid opcode.")), nullptr, _T("ValueError"));
+			aResultToken.result = FAIL;
+			return;
+		}
+	}
+	size_t header = 2 + (length < 126 ? 0 : length < 0x10000 ? 2 : 8) + (key ? 4 : 0);
+	BufferObject* frame;
+	if (!NewBuffer(header + length, frame)) {
+		free(utf8);
+		aResultToken.result = FAIL;
+		return;
+	}
+	auto p = (BYTE*)frame->mData;
+	BYTE mask_bit = key ? 0x80 : 0;
+	*p++ = 0x80 | opcode;
+	if (length < 126)
+		*p++ = mask_bit | (BYTE)length;
+	else if (length < 0x10000)
+		*p++ = mask_bit | 126, *p++ = (BYTE)(length >> 8), *p++ = (BYTE)length;
+	else {
+		*p++ = mask_bit | 127;
+		for (int shift = 56; shift >= 0; shift -= 8)
+			*p++ = (BYTE)((unsigned __int64)length >> shift);
+	}
+	if (key) {
+		memcpy(p, &key, 4);
+		MaskBytes((char*)p + 4, payload, length, key);
+	}
+	else if (length)
+		memcpy(p, payload, length);
+	free(utf8);
+	aResultToken.SetValue(frame);
+}
+
+ExportSymbol symbols[] = {
+	EXPORT_CLASS(FrameDecoder, 1)
+	EXPORT_FUNC(EncodeFrame, 1, 3)
+};
+
+EXPORT_AHKMODULE(symbols)